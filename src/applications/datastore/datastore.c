@@ -77,6 +77,10 @@ static int stat_filtered;
 
 static int stat_filter_failed;
 
+static int stat_get_time;
+
+static int stat_put_time;
+
 /**
  * Time at which the database was created (used for
  * content aging).
@@ -112,6 +116,7 @@ static int
 get (const GNUNET_HashCode * query,
      unsigned int type, GNUNET_DatastoreValueIterator iter, void *closure)
 {
+  unsigned long long start;
   int ret = 0;
 
   if (!testAvailable (query))
@@ -139,9 +144,14 @@ get (const GNUNET_HashCode * query,
 #endif
       return ret;
     }
+  start = GNUNET_get_time_us ();
   ret = sq->get (query, NULL, type, iter, closure);
-  if ((ret == 0) && (stats != NULL))
-    stats->change (stat_filter_failed, 1);
+  if (stats != NULL)
+    {
+      stats->record (stat_get_time, GNUNET_get_time_us () - start);
+      if (ret == 0)
+        stats->change (stat_filter_failed, 1);
+    }
   return ret;
 }
 
@@ -256,6 +266,7 @@ putUpdate (const GNUNET_HashCode * key, const GNUNET_DatastoreValue * value)
   int comp_prio;
   GNUNET_DatastoreValue *nvalue;
   GNUNET_HashCode vhc;
+  unsigned long long start;
 
   /* check if it already exists... */
   cls.exists = GNUNET_NO;
@@ -306,7 +317,10 @@ putUpdate (const GNUNET_HashCode * key, const GNUNET_DatastoreValue * value)
   memcpy (nvalue, value, ntohl (value->size));
   nvalue->priority = htonl (comp_priority () + ntohl (value->priority));
   /* add the content */
+  start = GNUNET_get_time_us ();
   ok = sq->put (key, nvalue);
+  if (stats != NULL)
+    stats->record (stat_put_time, GNUNET_get_time_us () - start);
   GNUNET_free (nvalue);
   if (ok == GNUNET_YES)
     {
@@ -404,6 +418,10 @@ provide_module_datastore (GNUNET_CoreAPIForPlugins * capi)
         stats->create (gettext_noop ("# requests filtered by bloom filter"));
       stat_filter_failed =
         stats->create (gettext_noop ("# bloom filter false positives"));
+      stat_get_time =
+        stats->create_histogram (gettext_noop ("datastore get time (us)"));
+      stat_put_time =
+        stats->create_histogram (gettext_noop ("datastore put time (us)"));
 
       stats->
         set (stats->create (gettext_noop ("# bytes allowed in datastore")),
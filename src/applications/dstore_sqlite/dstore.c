@@ -626,8 +626,8 @@ provide_module_dstore_sqlite (GNUNET_CoreAPIForPlugins * capi)
   fd = mkstemp (bloom_name);
   if (fd != -1)
     {
-      bloom = GNUNET_bloomfilter_load (coreAPI->ectx, bloom_name, quota / (OVERHEAD + 1024),    /* 8 bit per entry in DB, expect 1k entries */
-                                       5);
+      bloom = GNUNET_bloomfilter_load_blocked (coreAPI->ectx, bloom_name, quota / (OVERHEAD + 1024),    /* 8 bit per entry in DB, expect 1k entries */
+                                               5);
       CLOSE (fd);
     }
   stats = capi->service_request ("stats");
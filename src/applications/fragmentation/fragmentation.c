@@ -24,10 +24,11 @@
  *        the MTU of the transport.  Messages are still limited
  *        to a maximum size of 65535 bytes, which is a good
  *        idea because otherwise we may need ungainly fragmentation
- *        buffers.  Each connected peer can have at most one
- *        fragmented packet at any given point in time (prevents
- *        DoS attacks).  Fragmented messages that have not been
- *        completed after a certain amount of time are discarded.
+ *        buffers.  Each connected peer can have at most a few
+ *        partially received messages at any given point in time
+ *        (prevents DoS attacks).  Fragmented messages that have
+ *        not been completed after a certain amount of time are
+ *        discarded.
  * @author Christian Grothoff
  */
 
@@ -63,11 +64,18 @@ typedef struct
 } P2P_fragmentation_MESSAGE;
 
 /**
- * How many buckets does the fragment GNUNET_hash table
- * have?
+ * Initial size of the map of partially received messages.
  */
 #define DEFRAG_BUCKET_COUNT 16
 
+/**
+ * How many partially received messages do we keep
+ * per peer?  If a peer starts another one (the fourth),
+ * the one that has not made progress for the longest
+ * time is discarded (prevents DoS attacks).
+ */
+#define MAX_PARTIAL_PER_PEER 3
+
 /**
  * After how long do fragments time out?
  */
@@ -76,27 +84,38 @@ typedef struct
 #endif
 
 /**
- * Entry in the linked list of fragments.
- */
-typedef struct FL
-{
-  struct FL *link;
-  P2P_fragmentation_MESSAGE *frag;
-} FL;
-
-/**
- * Entry in the GNUNET_hash table of fragments.
+ * A partially received message.  The struct is followed
+ * by the buffer for the message (len bytes) and a bitmap
+ * with one bit per byte of the message that tells us
+ * which parts we have received so far.
  */
 typedef struct FC
 {
   struct FC *next;
-  FL *head;
+  struct FC *prev;
   GNUNET_PeerIdentity sender;
   int id;
   GNUNET_CronTime ttl;
+
+  /**
+   * Total size of the message.
+   */
+  unsigned short len;
+
+  /**
+   * How many bytes of the message have we received?
+   */
+  unsigned short have;
+
+  /**
+   * How many fragments did we receive?
+   */
+  unsigned int fragments;
 } FC;
 
-#define FRAGSIZE(fl) ((ntohs(fl->frag->header.size)-sizeof(P2P_fragmentation_MESSAGE)))
+#define FC_BUFFER(fc) ((char*) &(fc)[1])
+
+#define FC_BITMAP(fc) ((unsigned char*) &FC_BUFFER(fc)[(fc)->len])
 
 static GNUNET_CoreAPIForPlugins *coreAPI;
 
@@ -109,287 +128,169 @@ static int stat_fragmented;
 static int stat_discarded;
 
 /**
- * Hashtable *with* collision management!
+ * Partially received messages by sender (at most
+ * MAX_PARTIAL_PER_PEER per sender, told apart by id).
+ */
+static struct GNUNET_MultiHashMap *defragmentationCache;
+
+/**
+ * All partially received messages (for the purge cron).
  */
-static FC *defragmentationCache[DEFRAG_BUCKET_COUNT];
+static FC *defragHead;
+
+static FC *defragTail;
 
 /**
  * Lock for the defragmentation cache.
  */
 static struct GNUNET_Mutex *defragCacheLock;
 
+/**
+ * Remove a partially received message from the cache
+ * and free it.
+ *
+ * @param discarded GNUNET_YES if the message was not
+ *        completed (counts its fragments as discarded)
+ */
 static void
-freeFL (FL * fl, int c)
+freeFC (FC * fc, int discarded)
 {
-  while (fl != NULL)
-    {
-      FL *link = fl->link;
-      if (stats != NULL)
-        stats->change (stat_discarded, c);
-      GNUNET_free (fl->frag);
-      GNUNET_free (fl);
-      fl = link;
-    }
+  if ((discarded == GNUNET_YES) && (stats != NULL))
+    stats->change (stat_discarded, fc->fragments);
+  GNUNET_multi_hash_map_remove (defragmentationCache,
+                                &fc->sender.hashPubKey, fc);
+  GNUNET_DLL_remove (defragHead, defragTail, fc);
+  GNUNET_free (fc);
 }
 
 /**
  * This cron job ensures that we purge buffers of fragments
  * that have timed out.  It can run in much longer intervals
  * than the defragmentationCron, e.g. every 60s.
- * <p>
- * This method goes through the hashtable, finds entries that
- * have timed out and removes them (and all the fragments that
- * belong to the entry).  It's a bit more complicated as the
- * collision list is also collapsed.
  */
 static void
 defragmentationPurgeCron (void *unused)
 {
-  int i;
-  FC *smf;
+  FC *pos;
   FC *next;
-  FC *last;
+  GNUNET_CronTime now;
 
+  now = GNUNET_get_time ();
   GNUNET_mutex_lock (defragCacheLock);
-  for (i = 0; i < DEFRAG_BUCKET_COUNT; i++)
+  pos = defragHead;
+  while (pos != NULL)
     {
-      last = NULL;
-      smf = defragmentationCache[i];
-      while (smf != NULL)
-        {
-          if (smf->ttl < GNUNET_get_time ())
-            {
-              /* free linked list of fragments */
-              freeFL (smf->head, 1);
-              next = smf->next;
-              GNUNET_free (smf);
-              if (last == NULL)
-                defragmentationCache[i] = next;
-              else
-                last->next = next;
-              smf = next;
-            }
-          else
-            {
-              last = smf;
-              smf = smf->next;
-            }
-        }                       /* while smf != NULL */
-    }                           /* for all buckets */
+      next = pos->next;
+      if (pos->ttl < now)
+        freeFC (pos, GNUNET_YES);
+      pos = next;
+    }
   GNUNET_mutex_unlock (defragCacheLock);
 }
 
 /**
- * Check if this fragment-list is complete.  If yes, put it together,
- * process and free all buffers.  Does not free the pep
- * itself (but sets the TTL to 0 to have the cron free it
- * in the next iteration).
+ * Mark the bytes [off,end) as received.
  *
- * @param pep the entry in the GNUNET_hash table
+ * @return number of bytes in the range that were
+ *         not marked before
  */
-static void
-checkComplete (FC * pep)
+static unsigned int
+markReceived (unsigned char *bitmap, unsigned int off, unsigned int end)
 {
-  FL *pos;
-  unsigned short off;
-  unsigned short len;
-  char *msg;
-
-  GNUNET_GE_ASSERT (NULL, pep != NULL);
-  pos = pep->head;
-  if (pos == NULL)
-    return;
-  len = ntohs (pos->frag->len);
-  if (len == 0)
-    goto CLEANUP;               /* really bad error! */
-  off = 0;
-  while ((pos != NULL) && (ntohs (pos->frag->off) <= off))
+  unsigned int added;
+  unsigned int i;
+  unsigned int j;
+  unsigned char mask;
+
+  added = 0;
+  /* leading partial byte */
+  while ((off < end) && ((off & 7) != 0))
     {
-      if (off >= off + FRAGSIZE (pos))
-        goto CLEANUP;           /* error! */
-      if (ntohs (pos->frag->off) + FRAGSIZE (pos) > off)
-        off = ntohs (pos->frag->off) + FRAGSIZE (pos);
-      else
-        goto CLEANUP;           /* error! */
-      pos = pos->link;
+      mask = 1 << (off & 7);
+      if (0 == (bitmap[off >> 3] & mask))
+        {
+          bitmap[off >> 3] |= mask;
+          added++;
+        }
+      off++;
     }
-  if (off < len)
-    return;                     /* some fragment is still missing */
-
-  msg = GNUNET_malloc (len);
-  pos = pep->head;
-  while (pos != NULL)
+  /* full bytes */
+  for (i = off >> 3; i < (end >> 3); i++)
     {
-      memcpy (&msg[ntohs (pos->frag->off)], &pos->frag[1], FRAGSIZE (pos));
-      pos = pos->link;
+      if (bitmap[i] == 0)
+        added += 8;
+      else if (bitmap[i] != 0xFF)
+        for (j = 0; j < 8; j++)
+          if (0 == (bitmap[i] & (1 << j)))
+            added++;
+      bitmap[i] = 0xFF;
     }
-  if (stats != NULL)
-    stats->change (stat_defragmented, 1);
-#if 0
-  printf ("Finished defragmentation!\n");
-#endif
-  /* handle message! */
-  coreAPI->loopback_send (&pep->sender, msg, len, GNUNET_YES, NULL);
-  GNUNET_free (msg);
-CLEANUP:
-  /* free fragment buffers */
-  freeFL (pep->head, 0);
-  pep->head = NULL;
-  pep->ttl = 0;
+  if (off < (end & ~7))
+    off = end & ~7;
+  /* trailing partial byte */
+  while (off < end)
+    {
+      mask = 1 << (off & 7);
+      if (0 == (bitmap[off >> 3] & mask))
+        {
+          bitmap[off >> 3] |= mask;
+          added++;
+        }
+      off++;
+    }
+  return added;
 }
 
 /**
- * See if the new fragment is a part of this entry and join them if
- * yes.  Return GNUNET_SYSERR if the fragments do not match.  Return GNUNET_OK if
- * the fragments do match and the fragment has been processed.  The
- * defragCacheLock is already acquired by the caller whenever this
- * method is called.<p>
- *
- * @param entry the entry in the cache
- * @param pep the new entry
- * @param packet the ip part in the new entry
+ * Closure for findEntry.
  */
-static int
-tryJoin (FC * entry,
-         const GNUNET_PeerIdentity * sender,
-         const P2P_fragmentation_MESSAGE * packet)
+struct FindContext
 {
-  /* frame before ours; may end in the middle of
-     our frame or before it starts; NULL if we are
-     the earliest position we have received so far */
-  FL *before;
-  /* frame after ours; may start in the middle of
-     our frame or after it; NULL if we are the last
-     fragment we have received so far */
-  FL *after;
-  /* current position in the frame-list */
-  FL *pos;
-  /* the new entry that we're inserting */
-  FL *pep;
-  FL *tmp;
-  unsigned short end;
-
-  GNUNET_GE_ASSERT (NULL, entry != NULL);
-  if (0 != memcmp (sender, &entry->sender, sizeof (GNUNET_PeerIdentity)))
-    return GNUNET_SYSERR;       /* wrong fragment list, try another! */
-  if (ntohl (packet->id) != entry->id)
-    return GNUNET_SYSERR;       /* wrong fragment list, try another! */
-#if 0
-  printf ("Received fragment %u from %u to %u\n",
-          ntohl (packet->id),
-          ntohs (packet->off),
-          ntohs (packet->off) + ntohs (packet->header.size) -
-          sizeof (P2P_fragmentation_MESSAGE));
-#endif
-  pos = entry->head;
-  if ((pos != NULL) && (packet->len != pos->frag->len))
-    return GNUNET_SYSERR;       /* wrong fragment size */
-
-  before = NULL;
-  /* find the before-frame */
-  while ((pos != NULL) && (ntohs (pos->frag->off) < ntohs (packet->off)))
-    {
-      before = pos;
-      pos = pos->link;
-    }
-
-  /* find the after-frame */
-  end =
-    ntohs (packet->off) + ntohs (packet->header.size) -
-    sizeof (P2P_fragmentation_MESSAGE);
-  if (end <= ntohs (packet->off))
-    {
-      GNUNET_GE_LOG (NULL,
-                     GNUNET_GE_DEVELOPER | GNUNET_GE_DEBUG | GNUNET_GE_BULK,
-                     "Received invalid fragment at %s:%d\n", __FILE__,
-                     __LINE__);
-      return GNUNET_SYSERR;     /* yuck! integer overflow! */
-    }
+  const GNUNET_PeerIdentity *sender;
 
-  if (before != NULL)
-    after = before;
-  else
-    after = entry->head;
-  while ((after != NULL) && (ntohs (after->frag->off) < end))
-    after = after->link;
-
-  if ((before != NULL) && (before == after))
-    {
-      /* this implies after or before != NULL and thereby the new
-         fragment is redundant as it is fully enclosed in an earlier
-         fragment */
-      if (stats != NULL)
-        stats->change (stat_defragmented, 1);
-      return GNUNET_OK;         /* drop, there is a packet that spans our range! */
-    }
+  int id;
 
-  if ((before != NULL) &&
-      (after != NULL) &&
-      ((htons (before->frag->off) +
-        FRAGSIZE (before)) >= htons (after->frag->off)))
-    {
-      /* this implies that the fragment that starts before us and the
-         fragment that comes after this one leave no space in the middle
-         or even overlap; thus we can drop this redundant piece */
-      if (stats != NULL)
-        stats->change (stat_defragmented, 1);
-      return GNUNET_OK;
-    }
+  /**
+   * Set to the entry with the matching id (if any).
+   */
+  FC *match;
 
-  /* allocate pep */
-  pep = GNUNET_malloc (sizeof (FC));
-  pep->frag = GNUNET_malloc (ntohs (packet->header.size));
-  memcpy (pep->frag, packet, ntohs (packet->header.size));
-  pep->link = NULL;
+  /**
+   * Set to the entry of the sender with the lowest ttl.
+   */
+  FC *oldest;
 
-  if (before == NULL)
-    {
-      pep->link = after;
-      pos = entry->head;
-      while (pos != after)
-        {
-          tmp = pos->link;
-          GNUNET_free (pos->frag);
-          GNUNET_free (pos);
-          pos = tmp;
-        }
-      entry->head = pep;
-      goto FINISH;
-      /* end of insert first */
-    }
+  /**
+   * Number of entries of the sender.
+   */
+  unsigned int count;
+};
 
-  if (after == NULL)
-    {
-      /* insert last: find the end, free everything after it */
-      freeFL (before->link, 1);
-      before->link = pep;
-      goto FINISH;
-    }
+static int
+findEntry (const GNUNET_HashCode * key, void *value, void *cls)
+{
+  struct FindContext *fc = cls;
+  FC *entry = value;
 
-  /* ok, we are filling the middle between two fragments; insert.  If
-     there is anything else in the middle, it can be dropped as we're
-     bigger & cover that area as well */
-  /* free everything between before and after */
-  pos = before->link;
-  while (pos != after)
+  if (0 != memcmp (fc->sender, &entry->sender, sizeof (GNUNET_PeerIdentity)))
+    return GNUNET_YES;
+  if (entry->id == fc->id)
     {
-      tmp = pos->link;
-      GNUNET_free (pos->frag);
-      GNUNET_free (pos);
-      pos = tmp;
+      fc->match = entry;
+      return GNUNET_NO;
     }
-  before->link = pep;
-  pep->link = after;
-
-FINISH:
-  entry->ttl = GNUNET_get_time () + DEFRAGMENTATION_TIMEOUT;
-  checkComplete (entry);
-  return GNUNET_OK;
+  if ((fc->oldest == NULL) || (fc->oldest->ttl > entry->ttl))
+    fc->oldest = entry;
+  fc->count++;
+  return GNUNET_YES;
 }
 
 /**
  * Defragment the given fragment and pass to handler once
- * defragmentation is complete.
+ * defragmentation is complete.  The first fragment of a
+ * message allocates the buffer for the complete message;
+ * each fragment is copied to its place and marked in the
+ * bitmap, so the order of arrival does not matter.
  *
  * @param frag the packet to defragment
  * @return GNUNET_SYSERR if the fragment is invalid
@@ -398,44 +299,71 @@ static int
 processFragment (const GNUNET_PeerIdentity * sender,
                  const GNUNET_MessageHeader * frag)
 {
-  unsigned int hash;
-  FC *smf;
+  const P2P_fragmentation_MESSAGE *pf;
+  struct FindContext ctx;
+  FC *entry;
+  unsigned short len;
+  unsigned int off;
+  unsigned int end;
 
-  if (ntohs (frag->size) < sizeof (P2P_fragmentation_MESSAGE))
+  if (ntohs (frag->size) <= sizeof (P2P_fragmentation_MESSAGE))
     return GNUNET_SYSERR;
-
+  pf = (const P2P_fragmentation_MESSAGE *) frag;
+  len = ntohs (pf->len);
+  off = ntohs (pf->off);
+  end = off + ntohs (frag->size) - sizeof (P2P_fragmentation_MESSAGE);
+  if (end > len)
+    {
+      GNUNET_GE_LOG (NULL,
+                     GNUNET_GE_DEVELOPER | GNUNET_GE_DEBUG | GNUNET_GE_BULK,
+                     "Received invalid fragment at %s:%d\n", __FILE__,
+                     __LINE__);
+      return GNUNET_SYSERR;
+    }
   GNUNET_mutex_lock (defragCacheLock);
-  hash = sender->hashPubKey.bits[0] % DEFRAG_BUCKET_COUNT;
-  smf = defragmentationCache[hash];
-  while (smf != NULL)
+  ctx.sender = sender;
+  ctx.id = ntohl (pf->id);
+  ctx.match = NULL;
+  ctx.oldest = NULL;
+  ctx.count = 0;
+  GNUNET_multi_hash_map_get_multiple (defragmentationCache,
+                                      &sender->hashPubKey, &findEntry, &ctx);
+  entry = ctx.match;
+  if ((entry != NULL) && (entry->len != len))
     {
-      if (GNUNET_OK ==
-          tryJoin (smf, sender, (P2P_fragmentation_MESSAGE *) frag))
-        {
-          GNUNET_mutex_unlock (defragCacheLock);
-          return GNUNET_OK;
-        }
-      if (0 == memcmp (sender, &smf->sender, sizeof (GNUNET_PeerIdentity)))
-        {
-          freeFL (smf->head, 1);
-          break;
-        }
-      smf = smf->next;
+      /* wrong message size, start over */
+      freeFC (entry, GNUNET_YES);
+      entry = NULL;
     }
-  if (smf == NULL)
+  if (entry == NULL)
     {
-      smf = GNUNET_malloc (sizeof (FC));
-      smf->next = defragmentationCache[hash];
-      defragmentationCache[hash] = smf;
-      smf->ttl = GNUNET_get_time () + DEFRAGMENTATION_TIMEOUT;
-      smf->sender = *sender;
+      if (ctx.count >= MAX_PARTIAL_PER_PEER)
+        freeFC (ctx.oldest, GNUNET_YES);
+      entry = GNUNET_malloc (sizeof (FC) + len + (len + 7) / 8);
+      memset (FC_BITMAP (entry), 0, (len + 7) / 8);
+      entry->sender = *sender;
+      entry->id = ctx.id;
+      entry->len = len;
+      entry->have = 0;
+      entry->fragments = 0;
+      GNUNET_DLL_insert (defragHead, defragTail, entry);
+      GNUNET_multi_hash_map_put (defragmentationCache,
+                                 &sender->hashPubKey,
+                                 entry, GNUNET_MultiHashMapOption_MULTIPLE);
+    }
+  memcpy (&FC_BUFFER (entry)[off], &pf[1], end - off);
+  entry->have += markReceived (FC_BITMAP (entry), off, end);
+  entry->fragments++;
+  entry->ttl = GNUNET_get_time () + DEFRAGMENTATION_TIMEOUT;
+  if (entry->have == entry->len)
+    {
+      if (stats != NULL)
+        stats->change (stat_defragmented, 1);
+      /* handle message! */
+      coreAPI->loopback_send (&entry->sender, FC_BUFFER (entry), entry->len,
+                              GNUNET_YES, NULL);
+      freeFC (entry, GNUNET_NO);
     }
-  smf->id = ntohl (((P2P_fragmentation_MESSAGE *) frag)->id);
-  smf->head = GNUNET_malloc (sizeof (FL));
-  smf->head->link = NULL;
-  smf->head->frag = GNUNET_malloc (ntohs (frag->size));
-  memcpy (smf->head->frag, frag, ntohs (frag->size));
-
   GNUNET_mutex_unlock (defragCacheLock);
   return GNUNET_OK;
 }
@@ -568,7 +496,6 @@ GNUNET_Fragmentation_ServiceAPI *
 provide_module_fragmentation (GNUNET_CoreAPIForPlugins * capi)
 {
   static GNUNET_Fragmentation_ServiceAPI ret;
-  int i;
 
   coreAPI = capi;
   stats = coreAPI->service_request ("stats");
@@ -580,8 +507,9 @@ provide_module_fragmentation (GNUNET_CoreAPIForPlugins * capi)
         stats->create (gettext_noop ("# messages fragmented"));
       stat_discarded = stats->create (gettext_noop ("# fragments discarded"));
     }
-  for (i = 0; i < DEFRAG_BUCKET_COUNT; i++)
-    defragmentationCache[i] = NULL;
+  defragmentationCache = GNUNET_multi_hash_map_create (DEFRAG_BUCKET_COUNT);
+  defragHead = NULL;
+  defragTail = NULL;
   defragCacheLock = GNUNET_mutex_create (GNUNET_NO);
   GNUNET_cron_add_job (coreAPI->cron,
                        &defragmentationPurgeCron,
@@ -604,23 +532,14 @@ provide_module_fragmentation (GNUNET_CoreAPIForPlugins * capi)
 void
 release_module_fragmentation ()
 {
-  int i;
-
   coreAPI->p2p_ciphertext_handler_unregister
     (GNUNET_P2P_PROTO_MESSAGE_FRAGMENT, &processFragment);
   GNUNET_cron_del_job (coreAPI->cron, &defragmentationPurgeCron,
                        60 * GNUNET_CRON_SECONDS, NULL);
-  for (i = 0; i < DEFRAG_BUCKET_COUNT; i++)
-    {
-      FC *pos = defragmentationCache[i];
-      while (pos != NULL)
-        {
-          FC *next = pos->next;
-          freeFL (pos->head, 1);
-          GNUNET_free (pos);
-          pos = next;
-        }
-    }
+  while (defragHead != NULL)
+    freeFC (defragHead, GNUNET_YES);
+  GNUNET_multi_hash_map_destroy (defragmentationCache);
+  defragmentationCache = NULL;
   if (stats != NULL)
     {
       coreAPI->service_release (stats);
@@ -35,6 +35,7 @@
  * - timeouts
  * - multiple entries in GNUNET_hash-list
  * - id collisions in GNUNET_hash-list
+ * - throughput with many peers sending interleaved fragments
  */
 
 /* -- to speed up the testcases -- */
@@ -53,6 +54,11 @@ static unsigned short myMsgLen;
 static char masterBuffer[65536];
 static char resultBuffer[65536];
 
+/**
+ * Number of messages passed to loopback_send so far.
+ */
+static unsigned int delivered;
+
 static void
 handleHelper (const GNUNET_PeerIdentity * sender,
               const char *msg,
@@ -64,6 +70,7 @@ handleHelper (const GNUNET_PeerIdentity * sender,
   myMsg = resultBuffer;
   memcpy (resultBuffer, msg, len);
   myMsgLen = len;
+  delivered++;
 }
 
 /**
@@ -169,6 +176,35 @@ testSimpleFragmentReverse ()
   checkPacket (42, 32);
 }
 
+/**
+ * A fourth concurrent message from the same peer evicts
+ * the one that has not made progress for the longest time.
+ */
+static void
+testEviction ()
+{
+  GNUNET_MessageHeader *pep;
+  int id;
+
+  for (id = 1; id <= 4; id++)
+    {
+      pep = makeFragment (0, 16, 32, id);
+      processFragment (&mySender, pep);
+      GNUNET_GE_ASSERT (NULL, myMsg == NULL);
+      GNUNET_thread_sleep (10 * GNUNET_CRON_MILLISECONDS);
+    }
+  for (id = 2; id <= 4; id++)
+    {
+      pep = makeFragment (16, 16, 32, id);
+      processFragment (&mySender, pep);
+      checkPacket (id, 32);
+    }
+  pep = makeFragment (16, 16, 32, 1);
+  processFragment (&mySender, pep);
+  GNUNET_GE_ASSERT (NULL, myMsg == NULL);
+  makeTimeout ();
+}
+
 static void
 testManyFragments ()
 {
@@ -364,6 +400,79 @@ testManyFragmentsMultiIdCollisions ()
     }
 }
 
+/**
+ * Number of peers sending at the same time in testPerformance.
+ */
+#define PERF_PEERS 32
+
+/**
+ * Size of the messages in testPerformance.
+ */
+#define PERF_SIZE 60000
+
+/**
+ * Size of the fragments in testPerformance (UDP-sized).
+ */
+#define PERF_FRAGSIZE 1400
+
+/**
+ * Many peers send large messages at the same time; their
+ * fragments arrive interleaved.  Reports the throughput.
+ */
+static void
+testPerformance ()
+{
+  static char frags[PERF_SIZE / PERF_FRAGSIZE + 1][PERF_FRAGSIZE +
+                                                   sizeof
+                                                   (P2P_fragmentation_MESSAGE)];
+  GNUNET_MessageHeader *pep;
+  GNUNET_CronTime start;
+  GNUNET_CronTime end;
+  unsigned long long bytes;
+  unsigned int nfrags;
+  unsigned int size;
+  unsigned int round;
+  int i;
+  int peer;
+
+  nfrags = 0;
+  for (i = 0; i < PERF_SIZE; i += PERF_FRAGSIZE)
+    {
+      size = PERF_SIZE - i;
+      if (size > PERF_FRAGSIZE)
+        size = PERF_FRAGSIZE;
+      pep = makeFragment (i, size, PERF_SIZE, 42);
+      memcpy (frags[nfrags++], pep, ntohs (pep->size));
+    }
+  delivered = 0;
+  bytes = 0;
+  start = GNUNET_get_time ();
+  round = 0;
+  do
+    {
+      for (i = 0; i < nfrags; i++)
+        for (peer = 0; peer < PERF_PEERS; peer++)
+          {
+            mySender.hashPubKey.bits[0] = peer;
+            mySender.hashPubKey.bits[1] = round;
+            pep = (GNUNET_MessageHeader *) frags[i];
+            processFragment (&mySender, pep);
+            bytes += ntohs (pep->size) - sizeof (P2P_fragmentation_MESSAGE);
+          }
+      round++;
+      end = GNUNET_get_time ();
+    }
+  while (end - start < 2 * GNUNET_CRON_SECONDS);
+  GNUNET_GE_ASSERT (NULL, delivered == round * PERF_PEERS);
+  checkPacket (42, PERF_SIZE);
+  mySender.hashPubKey.bits[1] = 0;
+  fprintf (stderr,
+           "\nDefragmented %u messages (%llu kB/s, %llu fragments/s)\n",
+           delivered, bytes / (end - start + 1),
+           (unsigned long long) round * PERF_PEERS * nfrags * 1000 /
+           (end - start + 1));
+}
+
 /* ************* driver ****************** */
 
 static int
@@ -407,6 +516,8 @@ main (int argc, char *argv[])
   fprintf (stderr, ".");
   testSimpleFragmentReverse ();
   fprintf (stderr, ".");
+  testEviction ();
+  fprintf (stderr, ".");
   testManyFragments ();
   fprintf (stderr, ".");
   testManyFragmentsMegaLarge ();
@@ -426,6 +537,7 @@ main (int argc, char *argv[])
   fprintf (stderr, ".");
   testManyFragmentsMultiIdCollisions ();
   fprintf (stderr, ".");
+  testPerformance ();
   release_module_fragmentation ();
   fprintf (stderr, "\n");
   GNUNET_cron_destroy (capi.cron);
@@ -35,6 +35,52 @@
 
 #define DEBUG_DOWNLOAD GNUNET_NO
 
+/**
+ * How long should a streaming reader sleep at most before
+ * re-checking for data (wakeups may be lost in a race)?
+ */
+#define STREAM_POLL_FREQUENCY (100 * GNUNET_CRON_MILLISECONDS)
+
+/**
+ * Maximum number of peers that we keep track of as sources
+ * for a download.
+ */
+#define MAX_DOWNLOAD_SOURCES 16
+
+/**
+ * How long do we wait for a reply from a specific source
+ * before moving the request to another source?
+ */
+#define SOURCE_STALL_TIME (30 * GNUNET_CRON_SECONDS)
+
+/**
+ * A peer known to have (parts of) the file.
+ */
+struct DownloadSource
+{
+  /**
+   * Identity of the peer.
+   */
+  GNUNET_PeerIdentity peer;
+
+  /**
+   * When did we first send a request to this peer
+   * (or learn about it)?
+   */
+  GNUNET_CronTime first_request;
+
+  /**
+   * Number of requests currently targeted at this peer.
+   */
+  unsigned int pending;
+
+  /**
+   * Number of replies received from this peer.
+   */
+  unsigned int replies;
+
+};
+
 /**
  * Node-specific data (not shared, keep small!). 152 bytes.
  * Nodes are kept in a doubly-linked list.
@@ -68,11 +114,22 @@ struct Node
    */
   unsigned long long offset;
 
+  /**
+   * When was the request for this node (last) started?
+   */
+  GNUNET_CronTime request_time;
+
   /**
    * 0 for dblocks, >0 for iblocks.
    */
   unsigned int level;
 
+  /**
+   * Index of the source the request is targeted at,
+   * -1 for none.
+   */
+  int source;
+
 };
 
 /**
@@ -167,10 +224,15 @@ struct GNUNET_ECRS_DownloadContext
   void *dpcbClosure;
 
   /**
-   * Identity of the peer having the content, or all-zeros
-   * if we don't know of such a peer.
+   * Identifier of the file that is being downloaded.
    */
-  GNUNET_PeerIdentity target;
+  GNUNET_EC_FileIdentifier fid;
+
+  /**
+   * Peers known to have the content (from LOC URIs or
+   * because they answered earlier requests).
+   */
+  struct DownloadSource *sources;
 
   /**
    * Abort?  Flag that can be set at any time
@@ -181,10 +243,58 @@ struct GNUNET_ECRS_DownloadContext
   int abortFlag;
 
   /**
-   * Do we have a specific peer from which we download
-   * from?
+   * Number of entries in sources.
+   */
+  unsigned int source_count;
+
+  /**
+   * Requests for nodes that are too far ahead of the
+   * read position of a streaming download (head).
+   * Sorted by the file offset of the data covered.
+   */
+  struct Node *deferred_head;
+
+  /**
+   * Requests for nodes that are too far ahead of the
+   * read position of a streaming download (tail).
+   */
+  struct Node *deferred_tail;
+
+  /**
+   * Read-ahead buffer for streaming downloads, NULL for
+   * ordinary downloads.  Holds stream_window blocks of
+   * GNUNET_ECRS_DBLOCK_SIZE bytes; block b is stored in
+   * slot (b % stream_window).
+   */
+  char *stream_buffer;
+
+  /**
+   * Size of each block in the read-ahead buffer (0 if the
+   * block has not been received yet).
+   */
+  unsigned int *stream_sizes;
+
+  /**
+   * Lock protecting the read-ahead buffer and the read
+   * position.  Never held while calling into fslib.
+   */
+  struct GNUNET_Mutex *stream_lock;
+
+  /**
+   * Thread blocked in GNUNET_ECRS_file_download_stream_read,
+   * or NULL.
+   */
+  struct GNUNET_ThreadHandle *reader;
+
+  /**
+   * Current read position of a streaming download.
    */
-  int have_target;
+  unsigned long long stream_pos;
+
+  /**
+   * Number of blocks in the read-ahead buffer.
+   */
+  unsigned int stream_window;
 
   /**
    * Desired anonymity level for the download.
@@ -231,6 +341,17 @@ free_request_manager (struct GNUNET_ECRS_DownloadContext *rm)
   if (rm->my_sctx != GNUNET_YES)
     GNUNET_FS_resume_search_context (rm->sctx);
   GNUNET_GE_ASSERT (NULL, rm->tail == NULL);
+  while (rm->deferred_head != NULL)
+    {
+      pos = rm->deferred_head;
+      GNUNET_DLL_remove (rm->deferred_head, rm->deferred_tail, pos);
+      GNUNET_free (pos);
+    }
+  if (rm->stream_lock != NULL)
+    GNUNET_mutex_destroy (rm->stream_lock);
+  GNUNET_array_grow (rm->sources, rm->source_count, 0);
+  GNUNET_free_non_null (rm->stream_buffer);
+  GNUNET_free_non_null (rm->stream_sizes);
   if (rm->handle >= 0)
     CLOSE (rm->handle);
   if (rm->main != NULL)
@@ -291,14 +412,141 @@ write_to_files (struct GNUNET_ECRS_DownloadContext *self,
   return ret;
 }
 
+/**
+ * Store a dblock in the read-ahead buffer of a streaming
+ * download and wake up the reader if it was waiting for it.
+ *
+ * @param self reference to the download context
+ * @param pos offset of the block in the file
+ * @param buf plaintext of the block
+ * @param len size of the block
+ */
+static void
+write_to_stream (struct GNUNET_ECRS_DownloadContext *self,
+                 unsigned long long pos, const void *buf, unsigned int len)
+{
+  unsigned int slot;
+
+  slot = (pos / GNUNET_ECRS_DBLOCK_SIZE) % self->stream_window;
+  GNUNET_mutex_lock (self->stream_lock);
+  GNUNET_GE_ASSERT (self->ectx, pos + len > self->stream_pos);
+  memcpy (&self->stream_buffer[slot * GNUNET_ECRS_DBLOCK_SIZE], buf, len);
+  self->stream_sizes[slot] = len;
+  if ((pos <= self->stream_pos) && (self->reader != NULL))
+    GNUNET_thread_stop_sleep (self->reader);
+  GNUNET_mutex_unlock (self->stream_lock);
+}
+
+/**
+ * Find the index of the given peer in the list of sources.
+ *
+ * @return -1 if the peer is not a known source
+ */
+static int
+find_source (struct GNUNET_ECRS_DownloadContext *rm,
+             const GNUNET_PeerIdentity * peer)
+{
+  unsigned int i;
+
+  for (i = 0; i < rm->source_count; i++)
+    if (0 == memcmp (peer, &rm->sources[i].peer,
+                     sizeof (GNUNET_PeerIdentity)))
+      return i;
+  return -1;
+}
+
+/**
+ * Add a peer to the list of sources (if it is not
+ * already known and there is space).
+ *
+ * @return index of the source, -1 if it could not be added
+ */
+static int
+add_source (struct GNUNET_ECRS_DownloadContext *rm,
+            const GNUNET_PeerIdentity * peer)
+{
+  struct DownloadSource src;
+  int ret;
+
+  ret = find_source (rm, peer);
+  if ((ret != -1) || (rm->source_count >= MAX_DOWNLOAD_SOURCES))
+    return ret;
+  memset (&src, 0, sizeof (struct DownloadSource));
+  src.peer = *peer;
+  src.first_request = GNUNET_get_time ();
+  GNUNET_array_append (rm->sources, rm->source_count, src);
+  return rm->source_count - 1;
+}
+
+/**
+ * Pick the source for the next request.  We try to keep the
+ * number of pending requests per source proportional to the
+ * rate at which the source has been producing replies so far
+ * (new sources are optimistically assumed to produce one
+ * reply per second).
+ *
+ * @param exclude source not to consider, -1 for none
+ * @return index of the source, -1 if there is none
+ */
+static int
+select_source (struct GNUNET_ECRS_DownloadContext *rm, int exclude)
+{
+  GNUNET_CronTime now;
+  unsigned int i;
+  int best;
+  double rate;
+  double score;
+  double best_score;
+
+  now = GNUNET_get_time ();
+  best = -1;
+  best_score = 0;
+  for (i = 0; i < rm->source_count; i++)
+    {
+      if (i == exclude)
+        continue;
+      rate = (rm->sources[i].replies + 1.0) /
+        (1.0 + (double) (now - rm->sources[i].first_request) /
+         GNUNET_CRON_SECONDS);
+      score = (rm->sources[i].pending + 1.0) / rate;
+      if ((best == -1) || (score < best_score))
+        {
+          best = i;
+          best_score = score;
+        }
+    }
+  return best;
+}
+
+/**
+ * Send the request for the given node to the given source.
+ *
+ * @param source index of the source, -1 to not use a target
+ */
+static void
+issue_request (struct Node *node, int source)
+{
+  struct GNUNET_ECRS_DownloadContext *rm = node->ctx;
+
+  node->source = source;
+  node->request_time = GNUNET_get_time ();
+  if (source != -1)
+    rm->sources[source].pending++;
+  GNUNET_FS_start_search (rm->sctx,
+                          source == -1 ? NULL : &rm->sources[source].peer,
+                          GNUNET_ECRS_BLOCKTYPE_DATA, 1,
+                          &node->chk.query,
+                          rm->anonymityLevel,
+                          &content_receive_callback, node);
+}
+
 /**
  * Queue a request for execution.
  *
- * @param rm the request manager struct from createRequestManager
  * @param node the node to call once a reply is received
  */
 static void
-add_request (struct Node *node)
+start_request (struct Node *node)
 {
   struct GNUNET_ECRS_DownloadContext *rm = node->ctx;
 
@@ -306,14 +554,136 @@ add_request (struct Node *node)
 #if DEBUG_DOWNLOAD
   GNUNET_GE_LOG (rm->ectx,
                  GNUNET_GE_DEBUG | GNUNET_GE_REQUEST | GNUNET_GE_USER,
-                 "in add_request, rm->have_target is %d\n", rm->have_target);
+                 "in add_request, rm->source_count is %u\n",
+                 rm->source_count);
 #endif
-  GNUNET_FS_start_search (rm->sctx,
-                          rm->have_target == GNUNET_NO ? NULL : &rm->target,
-                          GNUNET_ECRS_BLOCKTYPE_DATA, 1,
-                          &node->chk.query,
-                          rm->anonymityLevel,
-                          &content_receive_callback, node);
+  issue_request (node, select_source (rm, -1));
+}
+
+/**
+ * Compute the offset (in the original file) of the
+ * first byte of data covered by the given node.
+ */
+static unsigned long long
+get_node_data_offset (const struct Node *node)
+{
+  unsigned int i;
+  unsigned long long rsize;
+
+  if (node->level == 0)
+    return node->offset;
+  rsize = GNUNET_ECRS_DBLOCK_SIZE;
+  for (i = 0; i < node->level - 1; i++)
+    rsize *= GNUNET_ECRS_CHK_PER_INODE;
+  return rsize * (node->offset / sizeof (GNUNET_EC_ContentHashKey));
+}
+
+/**
+ * Should a request for the given node be issued now?  For
+ * streaming downloads, only dblocks within the read-ahead
+ * window are requested; iblocks are requested one iblock
+ * ahead of the window so that their children are known by
+ * the time the reader gets there.
+ *
+ * @return GNUNET_YES if the request should be started now
+ */
+static int
+is_request_due (const struct Node *node)
+{
+  struct GNUNET_ECRS_DownloadContext *rm = node->ctx;
+  unsigned long long end;
+
+  if (rm->stream_buffer == NULL)
+    return GNUNET_YES;
+  GNUNET_mutex_lock (rm->stream_lock);
+  end = rm->stream_pos - (rm->stream_pos % GNUNET_ECRS_DBLOCK_SIZE)
+    + (unsigned long long) rm->stream_window * GNUNET_ECRS_DBLOCK_SIZE;
+  GNUNET_mutex_unlock (rm->stream_lock);
+  if (node->level > 0)
+    end += GNUNET_ECRS_DBLOCK_SIZE * GNUNET_ECRS_CHK_PER_INODE;
+  return (get_node_data_offset (node) < end) ? GNUNET_YES : GNUNET_NO;
+}
+
+/**
+ * Queue a request for execution.  Requests for streaming
+ * downloads that are too far ahead of the read position are
+ * deferred until the reader catches up.
+ *
+ * @param node the node to call once a reply is received
+ */
+static void
+add_request (struct Node *node)
+{
+  struct GNUNET_ECRS_DownloadContext *rm = node->ctx;
+  struct Node *pos;
+
+  if (GNUNET_YES == is_request_due (node))
+    {
+      start_request (node);
+      return;
+    }
+  /* keep sorted; children usually arrive in order, so
+     search from the tail */
+  pos = rm->deferred_tail;
+  while ((pos != NULL) &&
+         (get_node_data_offset (pos) > get_node_data_offset (node)))
+    pos = pos->prev;
+  GNUNET_DLL_insert_after (rm->deferred_head, rm->deferred_tail, pos, node);
+}
+
+/**
+ * Move requests that have been pending at one source for
+ * too long to another source.  Must only be called while
+ * the search context is suspended.
+ */
+static void
+rebalance_sources (struct GNUNET_ECRS_DownloadContext *rm)
+{
+  struct Node *pos;
+  GNUNET_CronTime now;
+  int alt;
+
+  if (rm->source_count < 2)
+    return;
+  now = GNUNET_get_time ();
+  for (pos = rm->head; pos != NULL; pos = pos->next)
+    {
+      if ((pos->source == -1) ||
+          (pos->request_time + SOURCE_STALL_TIME > now))
+        continue;
+      alt = select_source (rm, pos->source);
+      if (alt == -1)
+        continue;
+      GNUNET_FS_stop_search (rm->sctx, &content_receive_callback, pos);
+      rm->sources[pos->source].pending--;
+      issue_request (pos, alt);
+    }
+}
+
+/**
+ * Start all deferred requests that are now within the
+ * read-ahead window of a streaming download.  Must only
+ * be called while the search context is suspended.
+ */
+static void
+start_due_requests (struct GNUNET_ECRS_DownloadContext *rm)
+{
+  struct Node *pos;
+  struct Node *next;
+
+  pos = rm->deferred_head;
+  while (pos != NULL)
+    {
+      next = pos->next;
+      if (GNUNET_YES == is_request_due (pos))
+        {
+          GNUNET_DLL_remove (rm->deferred_head, rm->deferred_tail, pos);
+          start_request (pos);
+        }
+      else if (pos->level == 0)
+        break;                  /* sorted, later dblocks are not due either */
+      pos = next;
+    }
 }
 
 static void
@@ -323,6 +693,12 @@ signal_abort (struct GNUNET_ECRS_DownloadContext *rm, const char *msg)
   if ((rm->head != NULL) && (rm->dpcb != NULL))
     rm->dpcb (rm->length + 1, 0, 0, 0, msg, 0, rm->dpcbClosure);
   GNUNET_thread_stop_sleep (rm->main);
+  if (rm->stream_lock != NULL)
+    {
+      GNUNET_mutex_lock (rm->stream_lock);
+      GNUNET_thread_stop_sleep (rm->reader);
+      GNUNET_mutex_unlock (rm->stream_lock);
+    }
 }
 
 /**
@@ -519,6 +895,7 @@ iblock_download_children (const struct Node *node,
       child->offset = baseOffset + i * levelSize;
       GNUNET_GE_ASSERT (ectx, child->offset < node->ctx->total);
       child->level = node->level - 1;
+      child->source = -1;
       GNUNET_GE_ASSERT (ectx, (child->level != 0) ||
                         ((child->offset % GNUNET_ECRS_DBLOCK_SIZE) == 0));
       if (GNUNET_NO == check_node_present (child))
@@ -572,15 +949,30 @@ content_receive_callback (const GNUNET_HashCode * query,
   struct Node *node = cls;
   struct GNUNET_ECRS_DownloadContext *rm = node->ctx;
   struct GNUNET_GE_Context *ectx = rm->ectx;
+  GNUNET_PeerIdentity responder;
+  GNUNET_PeerIdentity zero;
   GNUNET_HashCode hc;
   unsigned int size;
   char *data;
+  int i;
 
   if (rm->abortFlag != GNUNET_NO)
     return GNUNET_SYSERR;
   GNUNET_GE_ASSERT (ectx,
                     0 == memcmp (query, &node->chk.query,
                                  sizeof (GNUNET_HashCode)));
+  if (node->source != -1)
+    rm->sources[node->source].pending--;
+  node->source = -1;
+  GNUNET_FS_get_current_responder (rm->sctx, &responder);
+  memset (&zero, 0, sizeof (GNUNET_PeerIdentity));
+  if (0 != memcmp (&zero, &responder, sizeof (GNUNET_PeerIdentity)))
+    {
+      /* peers that answered are likely to have more of the file */
+      i = add_source (rm, &responder);
+      if (i != -1)
+        rm->sources[i].replies++;
+    }
   size = ntohl (reply->size) - sizeof (GNUNET_DatastoreValue);
   if ((size <= sizeof (GNUNET_EC_DBlock)) ||
       (size - sizeof (GNUNET_EC_DBlock) != get_node_size (node)))
@@ -614,6 +1006,8 @@ content_receive_callback (const GNUNET_HashCode * query,
       signal_abort (rm, _("IO error."));
       return GNUNET_SYSERR;
     }
+  if ((node->level == 0) && (rm->stream_buffer != NULL))
+    write_to_stream (rm, node->offset, data, size);
   notify_client_about_progress (node, data, size);
   if (node->level > 0)
     iblock_download_children (node, data, size);
@@ -682,38 +1076,30 @@ get_real_download_filename (struct GNUNET_GE_Context *ectx,
 
 
 /**
- * Download parts of a file.  Note that this will store
- * the blocks at the respective offset in the given file.
- * Also, the download is still using the blocking of the
- * underlying ECRS encoding.  As a result, the download
- * may *write* outside of the given boundaries (if offset
- * and length do not match the 32k ECRS block boundaries).
- * <p>
- *
- * This function should be used to focus a download towards a
- * particular portion of the file (optimization), not to strictly
- * limit the download to exactly those bytes.
+ * Start a download.
  *
+ * @param sc context to use for searching, NULL to create our own
  * @param uri the URI of the file (determines what to download)
- * @param filename where to store the file
- * @param no_temporaries set to GNUNET_YES to disallow generation of temporary files
- * @param start starting offset
+ * @param filename where to store the file, maybe NULL
+ * @param offset starting offset
  * @param length length of the download (starting at offset)
+ * @param readahead 0 for an ordinary download, otherwise the
+ *        size of the read-ahead buffer for a streaming download
  */
-struct GNUNET_ECRS_DownloadContext *
-GNUNET_ECRS_file_download_partial_start (struct GNUNET_GE_Context *ectx,
-                                         struct GNUNET_GC_Configuration *cfg,
-                                         struct GNUNET_FS_SearchContext *sc,
-                                         const struct GNUNET_ECRS_URI *uri,
-                                         const char *filename,
-                                         unsigned long long offset,
-                                         unsigned long long length,
-                                         unsigned int anonymityLevel,
-                                         int no_temporaries,
-                                         GNUNET_ECRS_DownloadProgressCallback
-                                         dpcb, void *dpcbClosure)
+static struct GNUNET_ECRS_DownloadContext *
+download_start (struct GNUNET_GE_Context *ectx,
+                struct GNUNET_GC_Configuration *cfg,
+                struct GNUNET_FS_SearchContext *sc,
+                const struct GNUNET_ECRS_URI *uri,
+                const char *filename,
+                unsigned long long offset,
+                unsigned long long length,
+                unsigned int anonymityLevel,
+                unsigned long long readahead,
+                GNUNET_ECRS_DownloadProgressCallback dpcb, void *dpcbClosure)
 {
   struct GNUNET_ECRS_DownloadContext *rm;
+  GNUNET_PeerIdentity peer;
   struct stat buf;
   struct Node *top;
   int ret;
@@ -749,9 +1135,28 @@ GNUNET_ECRS_file_download_partial_start (struct GNUNET_GE_Context *ectx,
   rm->dpcb = dpcb;
   rm->dpcbClosure = dpcbClosure;
   rm->main = GNUNET_thread_get_self ();
+  rm->fid = uri->data.fi;
   rm->total = GNUNET_ntohll (uri->data.fi.file_length);
   rm->filename =
     filename != NULL ? get_real_download_filename (ectx, filename) : NULL;
+  if (readahead > 0)
+    {
+      rm->stream_window = (readahead + GNUNET_ECRS_DBLOCK_SIZE - 1)
+        / GNUNET_ECRS_DBLOCK_SIZE;
+      if ((unsigned long long) rm->stream_window * GNUNET_ECRS_DBLOCK_SIZE
+          > rm->total + GNUNET_ECRS_DBLOCK_SIZE - 1)
+        rm->stream_window = (rm->total + GNUNET_ECRS_DBLOCK_SIZE - 1)
+          / GNUNET_ECRS_DBLOCK_SIZE;
+      if (rm->stream_window == 0)
+        rm->stream_window = 1;
+      rm->stream_buffer =
+        GNUNET_malloc ((size_t) rm->stream_window * GNUNET_ECRS_DBLOCK_SIZE);
+      rm->stream_sizes =
+        GNUNET_malloc (rm->stream_window * sizeof (unsigned int));
+      memset (rm->stream_sizes, 0,
+              rm->stream_window * sizeof (unsigned int));
+      rm->stream_lock = GNUNET_mutex_create (GNUNET_NO);
+    }
 
   if ((rm->filename != NULL) &&
       (GNUNET_SYSERR ==
@@ -775,7 +1180,10 @@ GNUNET_ECRS_file_download_partial_start (struct GNUNET_GE_Context *ectx,
             }
           CLOSE (ret);
         }
-      dpcb (0, 0, rm->startTime, 0, NULL, 0, dpcbClosure);
+      if (dpcb != NULL)
+        dpcb (0, 0, rm->startTime, 0, NULL, 0, dpcbClosure);
+      if (readahead > 0)
+        return rm;              /* empty stream, reads will signal EOF */
       free_request_manager (rm);
       return NULL;
     }
@@ -813,10 +1221,10 @@ GNUNET_ECRS_file_download_partial_start (struct GNUNET_GE_Context *ectx,
     {
       GNUNET_GE_LOG (rm->ectx,
                      GNUNET_GE_DEBUG | GNUNET_GE_REQUEST | GNUNET_GE_USER,
-                     "in GNUNET_ECRS_file_download_partial_start, uri is locURI\n");
+                     "in download_start, uri is locURI\n");
       GNUNET_hash (&uri->data.loc.peer, sizeof (GNUNET_RSA_PublicKey),
-                   &rm->target.hashPubKey);
-      rm->have_target = GNUNET_YES;
+                   &peer.hashPubKey);
+      add_source (rm, &peer);
     }
   top = GNUNET_malloc (sizeof (struct Node));
   memset (top, 0, sizeof (struct Node));
@@ -824,6 +1232,7 @@ GNUNET_ECRS_file_download_partial_start (struct GNUNET_GE_Context *ectx,
   top->chk = uri->data.fi.chk;
   top->offset = 0;
   top->level = rm->treedepth;
+  top->source = -1;
   if (GNUNET_NO == check_node_present (top))
     add_request (top);
   else
@@ -831,6 +1240,197 @@ GNUNET_ECRS_file_download_partial_start (struct GNUNET_GE_Context *ectx,
   return rm;
 }
 
+/**
+ * Download parts of a file.  Note that this will store
+ * the blocks at the respective offset in the given file.
+ * Also, the download is still using the blocking of the
+ * underlying ECRS encoding.  As a result, the download
+ * may *write* outside of the given boundaries (if offset
+ * and length do not match the 32k ECRS block boundaries).
+ * <p>
+ *
+ * This function should be used to focus a download towards a
+ * particular portion of the file (optimization), not to strictly
+ * limit the download to exactly those bytes.
+ *
+ * @param uri the URI of the file (determines what to download)
+ * @param filename where to store the file
+ * @param no_temporaries set to GNUNET_YES to disallow generation of temporary files
+ * @param start starting offset
+ * @param length length of the download (starting at offset)
+ */
+struct GNUNET_ECRS_DownloadContext *
+GNUNET_ECRS_file_download_partial_start (struct GNUNET_GE_Context *ectx,
+                                         struct GNUNET_GC_Configuration *cfg,
+                                         struct GNUNET_FS_SearchContext *sc,
+                                         const struct GNUNET_ECRS_URI *uri,
+                                         const char *filename,
+                                         unsigned long long offset,
+                                         unsigned long long length,
+                                         unsigned int anonymityLevel,
+                                         int no_temporaries,
+                                         GNUNET_ECRS_DownloadProgressCallback
+                                         dpcb, void *dpcbClosure)
+{
+  return download_start (ectx, cfg, sc, uri, filename, offset, length,
+                         anonymityLevel, 0, dpcb, dpcbClosure);
+}
+
+/**
+ * Start a streaming download.  Blocks are requested in file
+ * order, starting at the current read position and reaching at
+ * most "readahead" bytes ahead of it.
+ *
+ * @param sc context to use for searching, NULL to create our own
+ * @param uri the URI of the file (determines what to download)
+ * @param readahead how many bytes to request ahead of the
+ *        read position (rounded up to whole blocks)
+ * @return NULL on error
+ */
+struct GNUNET_ECRS_DownloadContext *
+GNUNET_ECRS_file_download_stream_start (struct GNUNET_GE_Context *ectx,
+                                        struct GNUNET_GC_Configuration *cfg,
+                                        struct GNUNET_FS_SearchContext *sc,
+                                        const struct GNUNET_ECRS_URI *uri,
+                                        unsigned int anonymityLevel,
+                                        unsigned long long readahead,
+                                        GNUNET_ECRS_DownloadProgressCallback
+                                        dpcb, void *dpcbClosure)
+{
+  if (readahead == 0)
+    readahead = GNUNET_ECRS_DBLOCK_SIZE;
+  return download_start (ectx, cfg, sc, uri, NULL, 0,
+                         GNUNET_ECRS_uri_get_file_size (uri),
+                         anonymityLevel, readahead, dpcb, dpcbClosure);
+}
+
+/**
+ * Read the next bytes of a streaming download.  Blocks until
+ * at least one byte is available.
+ *
+ * @param buf where to store the data
+ * @param size maximum number of bytes to read
+ * @return number of bytes read, 0 at the end of the file,
+ *         GNUNET_SYSERR on error or if tt asked us to abort
+ */
+int
+GNUNET_ECRS_file_download_stream_read (struct GNUNET_ECRS_DownloadContext
+                                       *rm, void *buf, unsigned int size,
+                                       GNUNET_ECRS_TestTerminate tt,
+                                       void *ttClosure)
+{
+  unsigned int slot;
+  unsigned int boff;
+  unsigned int ret;
+  unsigned int max;
+
+  if (rm->stream_buffer == NULL)
+    {
+      if (rm->total == 0)
+        return 0;
+      GNUNET_GE_BREAK (rm->ectx, 0);
+      return GNUNET_SYSERR;
+    }
+  ret = 0;
+  GNUNET_mutex_lock (rm->stream_lock);
+  while (rm->stream_pos < rm->total)
+    {
+      if (rm->abortFlag != GNUNET_NO)
+        break;
+      slot = (rm->stream_pos / GNUNET_ECRS_DBLOCK_SIZE) % rm->stream_window;
+      if (rm->stream_sizes[slot] != 0)
+        break;
+      if ((tt != NULL) && (GNUNET_OK != tt (ttClosure)))
+        break;
+      if (GNUNET_YES == GNUNET_shutdown_test ())
+        break;
+      rm->reader = GNUNET_thread_get_self ();
+      GNUNET_mutex_unlock (rm->stream_lock);
+      GNUNET_FS_suspend_search_context (rm->sctx);
+      start_due_requests (rm);
+      rebalance_sources (rm);
+      GNUNET_FS_resume_search_context (rm->sctx);
+      GNUNET_thread_sleep (STREAM_POLL_FREQUENCY);
+      GNUNET_mutex_lock (rm->stream_lock);
+      GNUNET_thread_release_self (rm->reader);
+      rm->reader = NULL;
+    }
+  while ((ret < size) && (rm->stream_pos < rm->total))
+    {
+      slot = (rm->stream_pos / GNUNET_ECRS_DBLOCK_SIZE) % rm->stream_window;
+      if (rm->stream_sizes[slot] == 0)
+        break;
+      boff = rm->stream_pos % GNUNET_ECRS_DBLOCK_SIZE;
+      max = rm->stream_sizes[slot] - boff;
+      if (max > size - ret)
+        max = size - ret;
+      memcpy (&((char *) buf)[ret],
+              &rm->stream_buffer[slot * GNUNET_ECRS_DBLOCK_SIZE + boff], max);
+      ret += max;
+      rm->stream_pos += max;
+      if (boff + max == rm->stream_sizes[slot])
+        rm->stream_sizes[slot] = 0;     /* consumed, slot is free again */
+    }
+  GNUNET_mutex_unlock (rm->stream_lock);
+  if (ret > 0)
+    {
+      /* window moved, request the blocks that are now due */
+      GNUNET_FS_suspend_search_context (rm->sctx);
+      start_due_requests (rm);
+      GNUNET_FS_resume_search_context (rm->sctx);
+      return ret;
+    }
+  if (rm->stream_pos >= rm->total)
+    return 0;
+  return GNUNET_SYSERR;
+}
+
+/**
+ * Add another peer that is known to share the file that is
+ * being downloaded.  Requests are distributed over all known
+ * sources in proportion to the rate at which they reply.
+ *
+ * @param uri location URI for the file being downloaded
+ * @return GNUNET_OK on success, GNUNET_NO if we already track
+ *         too many sources, GNUNET_SYSERR if the URI is not a
+ *         location URI for this file
+ */
+int
+GNUNET_ECRS_file_download_add_location (struct GNUNET_ECRS_DownloadContext
+                                        *rm,
+                                        const struct GNUNET_ECRS_URI *uri)
+{
+  GNUNET_PeerIdentity peer;
+  int ret;
+
+  if ((!GNUNET_ECRS_uri_test_loc (uri)) ||
+      (0 != memcmp (&uri->data.loc.fi, &rm->fid,
+                    sizeof (GNUNET_EC_FileIdentifier))))
+    return GNUNET_SYSERR;
+  GNUNET_hash (&uri->data.loc.peer, sizeof (GNUNET_RSA_PublicKey),
+               &peer.hashPubKey);
+  GNUNET_FS_suspend_search_context (rm->sctx);
+  ret = (-1 == add_source (rm, &peer)) ? GNUNET_NO : GNUNET_OK;
+  GNUNET_FS_resume_search_context (rm->sctx);
+  return ret;
+}
+
+/**
+ * Re-distribute requests that have been stuck at a slow
+ * source to other sources.  Should be called periodically
+ * by clients that drive downloads started with
+ * GNUNET_ECRS_file_download_partial_start.
+ */
+void
+GNUNET_ECRS_file_download_rebalance (struct GNUNET_ECRS_DownloadContext *rm)
+{
+  if (rm->source_count < 2)
+    return;
+  GNUNET_FS_suspend_search_context (rm->sctx);
+  rebalance_sources (rm);
+  GNUNET_FS_resume_search_context (rm->sctx);
+}
+
 int
 GNUNET_ECRS_file_download_partial_stop (struct GNUNET_ECRS_DownloadContext
                                         *rm)
@@ -897,7 +1497,10 @@ GNUNET_ECRS_file_download_partial (struct GNUNET_GE_Context *ectx,
   while ((GNUNET_OK == tt (ttClosure)) &&
          (GNUNET_YES != GNUNET_shutdown_test ()) &&
          (rm->abortFlag == GNUNET_NO) && (rm->head != NULL))
-    GNUNET_thread_sleep (5 * GNUNET_CRON_SECONDS);
+    {
+      GNUNET_thread_sleep (5 * GNUNET_CRON_SECONDS);
+      GNUNET_ECRS_file_download_rebalance (rm);
+    }
   ret = GNUNET_ECRS_file_download_partial_stop (rm);
   return ret;
 }
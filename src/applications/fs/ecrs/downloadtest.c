@@ -171,6 +171,52 @@ downloadFile (unsigned int size, const struct GNUNET_ECRS_URI *uri)
   return ret;
 }
 
+static int
+streamFile (unsigned int size, const struct GNUNET_ECRS_URI *uri)
+{
+  struct GNUNET_ECRS_DownloadContext *rm;
+  char *buf;
+  char *in;
+  unsigned int pos;
+  int ret;
+  int i;
+
+  buf = GNUNET_malloc (size);
+  in = GNUNET_malloc (size);
+  memset (buf, size + size / 253, size);
+  for (i = 0; i < (int) (size - 42 - 2 * sizeof (GNUNET_HashCode));
+       i += sizeof (GNUNET_HashCode))
+    GNUNET_hash (&buf[i], 42,
+                 (GNUNET_HashCode *) & buf[i + sizeof (GNUNET_HashCode)]);
+  rm = GNUNET_ECRS_file_download_stream_start (NULL, cfg, NULL, uri, 0,
+                                               4 * 32 * 1024,
+                                               &progress_check, NULL);
+  ret = (rm == NULL) ? GNUNET_SYSERR : GNUNET_OK;
+  pos = 0;
+  while ((ret == GNUNET_OK) && (pos <= size))
+    {
+      /* odd read size to cross block boundaries */
+      i = GNUNET_ECRS_file_download_stream_read (rm, &in[pos],
+                                                 (size - pos <
+                                                  12345) ? size - pos : 12345,
+                                                 &testTerminate, NULL);
+      if (i == 0)
+        break;
+      if (i == GNUNET_SYSERR)
+        ret = GNUNET_SYSERR;
+      else
+        pos += i;
+    }
+  if ((ret == GNUNET_OK) &&
+      ((pos != size) || (0 != memcmp (buf, in, size))))
+    ret = GNUNET_SYSERR;
+  if ((rm != NULL) &&
+      (GNUNET_OK != GNUNET_ECRS_file_download_partial_stop (rm)))
+    ret = GNUNET_SYSERR;
+  GNUNET_free (buf);
+  GNUNET_free (in);
+  return ret;
+}
 
 static int
 unindexFile (unsigned int size)
@@ -222,6 +268,8 @@ main (int argc, char *argv[])
   CHECK (NULL != uri);
   fprintf (stderr, "Downloading... - %llu", GNUNET_get_time());
   CHECK (GNUNET_OK == downloadFile (SIZE, uri));
+  fprintf (stderr, "\nStreaming...\n");
+  CHECK (GNUNET_OK == streamFile (SIZE, uri));
   GNUNET_ECRS_uri_destroy (uri);
   fprintf (stderr, "\nUnindexing... %llu \n", GNUNET_get_time());
   CHECK (GNUNET_OK == unindexFile (SIZE));
@@ -28,6 +28,7 @@
 
 #include "platform.h"
 #include "ecrs.h"
+#include "gnunet_directories.h"
 
 void
 GNUNET_ECRS_encryptInPlace (const GNUNET_HashCode * hc, void *data,
@@ -61,4 +62,37 @@ GNUNET_ECRS_decryptInPlace (const GNUNET_HashCode * hc, void *data,
   GNUNET_free (tmp);
 }
 
+/**
+ * Open the persistent KBlock key cache configured for
+ * the FS service (if any).
+ */
+void
+GNUNET_ECRS_kblock_key_cache_setup (struct GNUNET_GE_Context *ectx,
+                                    struct GNUNET_GC_Configuration *cfg)
+{
+  char *filename;
+  unsigned long long slots;
+
+  if (-1 == GNUNET_GC_get_configuration_value_number (cfg,
+                                                      "FS",
+                                                      "KBLOCK-KEY-CACHE-SIZE",
+                                                      0,
+                                                      1024 * 1024,
+                                                      4096, &slots))
+    return;
+  if (slots == 0)
+    {
+      GNUNET_RSA_kblock_key_cache_close ();
+      return;
+    }
+  GNUNET_GC_get_configuration_value_filename (cfg,
+                                              "FS",
+                                              "KBLOCK-KEY-CACHE",
+                                              GNUNET_DEFAULT_HOME_DIRECTORY
+                                              "/kblock-keys.cache",
+                                              &filename);
+  GNUNET_RSA_kblock_key_cache_open (ectx, filename, (unsigned int) slots);
+  GNUNET_free (filename);
+}
+
 /* end of ecrs.c */
@@ -110,6 +110,10 @@ void GNUNET_ECRS_encryptInPlace (const GNUNET_HashCode * hc,
 void GNUNET_ECRS_decryptInPlace (const GNUNET_HashCode * hc,
                                  void *data, unsigned int len);
 
+void GNUNET_ECRS_kblock_key_cache_setup (struct GNUNET_GE_Context *ectx,
+                                         struct GNUNET_GC_Configuration
+                                         *cfg);
+
 
 
 #endif
@@ -146,6 +146,8 @@ GNUNET_ECRS_publish_under_keyword (struct GNUNET_GE_Context *ectx,
   GNUNET_HashCode hc;
 #endif
   GNUNET_HashCode key;
+  GNUNET_HashCode *keys;
+  struct GNUNET_RSA_PrivateKey **pks;
   char *cpy;                    /* copy of the encrypted portion */
   struct GNUNET_ECRS_URI *xuri;
 
@@ -213,15 +215,25 @@ GNUNET_ECRS_publish_under_keyword (struct GNUNET_GE_Context *ectx,
     xuri = GNUNET_ECRS_uri_expand_keywords_with_date (uri);
   keywords = xuri->data.ksk.keywords;
   keywordCount = xuri->data.ksk.keywordCount;
-  cpy = GNUNET_malloc (mdsize + strlen (dstURI) + 1);
-  memcpy (cpy, &kb[1], mdsize + strlen (dstURI) + 1);
+  keys = GNUNET_malloc (sizeof (GNUNET_HashCode) * (keywordCount + 1));
+  pks = GNUNET_malloc (sizeof (struct GNUNET_RSA_PrivateKey *) *
+                       (keywordCount + 1));
   for (i = 0; i < keywordCount; i++)
     {
-      memcpy (&kb[1], cpy, mdsize + strlen (dstURI) + 1);
       keyword = keywords[i];
       /* first character of keyword indicates if it is
          mandatory or not -- ignore for hashing */
-      GNUNET_hash (&keyword[1], strlen (&keyword[1]), &key);
+      GNUNET_hash (&keyword[1], strlen (&keyword[1]), &keys[i]);
+    }
+  /* key generation is expensive, do it for all keywords at once */
+  GNUNET_ECRS_kblock_key_cache_setup (ectx, cfg);
+  GNUNET_RSA_create_keys_from_hashes (keywordCount, keys, pks);
+  cpy = GNUNET_malloc (mdsize + strlen (dstURI) + 1);
+  memcpy (cpy, &kb[1], mdsize + strlen (dstURI) + 1);
+  for (i = 0; i < keywordCount; i++)
+    {
+      memcpy (&kb[1], cpy, mdsize + strlen (dstURI) + 1);
+      key = keys[i];
 #if DEBUG_KEYSPACE
       IF_GELOG (ectx, GNUNET_GE_DEBUG | GNUNET_GE_REQUEST | GNUNET_GE_USER,
                 GNUNET_hash_to_enc (&key, &enc));
@@ -230,7 +242,7 @@ GNUNET_ECRS_publish_under_keyword (struct GNUNET_GE_Context *ectx,
                      "Encrypting KBlock with key %s.\n", &enc);
 #endif
       GNUNET_ECRS_encryptInPlace (&key, &kb[1], mdsize + strlen (dstURI) + 1);
-      pk = GNUNET_RSA_create_key_from_hash (&key);
+      pk = pks[i];
       GNUNET_RSA_get_public_key (pk, &kb->keyspace);
       GNUNET_GE_ASSERT (ectx,
                         GNUNET_OK == GNUNET_RSA_sign (pk,
@@ -256,6 +268,8 @@ GNUNET_ECRS_publish_under_keyword (struct GNUNET_GE_Context *ectx,
 #endif
     }
   GNUNET_ECRS_uri_destroy (xuri);
+  GNUNET_free (pks);
+  GNUNET_free (keys);
   GNUNET_free (cpy);
   GNUNET_free (dstURI);
   GNUNET_client_connection_destroy (sock);
@@ -163,9 +163,9 @@ add_search_for_uri (const struct GNUNET_ECRS_URI *uri,
       }
     case ksk:
       {
-        GNUNET_HashCode hc;
+        GNUNET_HashCode *hcs;
         GNUNET_HashCode query;
-        struct GNUNET_RSA_PrivateKey *pk;
+        struct GNUNET_RSA_PrivateKey **pks;
         GNUNET_RSA_PublicKey pub;
         int i;
         const char *keyword;
@@ -175,20 +175,31 @@ add_search_for_uri (const struct GNUNET_ECRS_URI *uri,
                        GNUNET_GE_DEBUG | GNUNET_GE_REQUEST | GNUNET_GE_USER,
                        "Computing queries (this may take a while).\n");
 #endif
+        hcs = GNUNET_malloc (sizeof (GNUNET_HashCode) *
+                             (uri->data.ksk.keywordCount + 1));
+        pks = GNUNET_malloc (sizeof (struct GNUNET_RSA_PrivateKey *) *
+                             (uri->data.ksk.keywordCount + 1));
         for (i = 0; i < uri->data.ksk.keywordCount; i++)
           {
             keyword = uri->data.ksk.keywords[i];
             /* first character of the keyword is
                "+" or " " to indicate mandatory or
                not -- ignore for hashing! */
-            GNUNET_hash (&keyword[1], strlen (&keyword[1]), &hc);
-            pk = GNUNET_RSA_create_key_from_hash (&hc);
-            GNUNET_RSA_get_public_key (pk, &pub);
+            GNUNET_hash (&keyword[1], strlen (&keyword[1]), &hcs[i]);
+          }
+        GNUNET_ECRS_kblock_key_cache_setup (ectx, sqc->cfg);
+        GNUNET_RSA_create_keys_from_hashes (uri->data.ksk.keywordCount,
+                                            hcs, pks);
+        for (i = 0; i < uri->data.ksk.keywordCount; i++)
+          {
+            GNUNET_RSA_get_public_key (pks[i], &pub);
             GNUNET_hash (&pub, sizeof (GNUNET_RSA_PublicKey), &query);
             add_search (GNUNET_ECRS_BLOCKTYPE_ANY,      /* GNUNET_ECRS_BLOCKTYPE_KEYWORD, GNUNET_ECRS_BLOCKTYPE_NAMESPACE or GNUNET_ECRS_BLOCKTYPE_KEYWORD_FOR_NAMESPACE ok */
-                        1, &query, &hc, sqc);
-            GNUNET_RSA_free_key (pk);
+                        1, &query, &hcs[i], sqc);
+            GNUNET_RSA_free_key (pks[i]);
           }
+        GNUNET_free (pks);
+        GNUNET_free (hcs);
 #if DEBUG_SEARCH
         GNUNET_GE_LOG (ectx,
                        GNUNET_GE_DEBUG | GNUNET_GE_REQUEST | GNUNET_GE_USER,
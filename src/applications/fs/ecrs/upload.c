@@ -48,6 +48,7 @@
  */
 static int
 pushBlock (struct GNUNET_ClientServerConnection *sock,
+           struct GNUNET_FS_SharedRing *ring,
            const GNUNET_EC_ContentHashKey * chk,
            unsigned int level,
            GNUNET_DatastoreValue ** iblocks,
@@ -72,7 +73,7 @@ pushBlock (struct GNUNET_ClientServerConnection *sock,
     {
       GNUNET_EC_file_block_get_key (db, size, &ichk.key);
       GNUNET_EC_file_block_get_query (db, size, &ichk.query);
-      if (GNUNET_OK != pushBlock (sock,
+      if (GNUNET_OK != pushBlock (sock, ring,
                                   &ichk, level + 1, iblocks, prio,
                                   expirationTime))
         return GNUNET_SYSERR;
@@ -84,7 +85,7 @@ pushBlock (struct GNUNET_ClientServerConnection *sock,
         }
       value->priority = htonl (prio);
       value->expiration_time = GNUNET_htonll (expirationTime);
-      if (GNUNET_OK != GNUNET_FS_insert (sock, value))
+      if (GNUNET_OK != GNUNET_FS_insert_shared (sock, ring, value))
         {
           GNUNET_free (value);
           return GNUNET_SYSERR;
@@ -138,6 +139,7 @@ GNUNET_ECRS_file_upload (struct GNUNET_GE_Context *ectx,
   GNUNET_EC_DBlock *db;
   GNUNET_DatastoreValue *value;
   struct GNUNET_ClientServerConnection *sock;
+  struct GNUNET_FS_SharedRing *ring;
   GNUNET_HashCode fileId;
   GNUNET_EC_ContentHashKey mchk;
   GNUNET_CronTime eta;
@@ -246,6 +248,11 @@ GNUNET_ECRS_file_upload (struct GNUNET_GE_Context *ectx,
       GNUNET_client_connection_destroy (sock);
       return GNUNET_SYSERR;
     }
+  /* if gnunetd runs on this machine, blocks are passed
+     through a shared file instead of the socket */
+  ring = NULL;
+  if (GNUNET_YES == GNUNET_client_connection_test_local (sock))
+    ring = GNUNET_FS_shared_ring_create (ectx);
 
   dblock =
     GNUNET_malloc (sizeof (GNUNET_DatastoreValue) + GNUNET_ECRS_DBLOCK_SIZE +
@@ -344,7 +351,8 @@ GNUNET_ECRS_file_upload (struct GNUNET_GE_Context *ectx,
           GNUNET_GE_ASSERT (ectx, value != NULL);
           *value = *dblock;     /* copy options! */
           if ((doIndex == GNUNET_NO) &&
-              (GNUNET_OK != (ret = GNUNET_FS_insert (sock, value))))
+              (GNUNET_OK !=
+               (ret = GNUNET_FS_insert_shared (sock, ring, value))))
             {
               GNUNET_GE_BREAK (ectx, ret == GNUNET_NO);
               GNUNET_free (value);
@@ -360,7 +368,7 @@ GNUNET_ECRS_file_upload (struct GNUNET_GE_Context *ectx,
                                    (((double) (now - start) / (double) pos))
                                    * (double) filesize);
         }
-      if (GNUNET_OK != pushBlock (sock, &mchk, 0,       /* dblocks are on level 0 */
+      if (GNUNET_OK != pushBlock (sock, ring, &mchk, 0, /* dblocks are on level 0 */
                                   iblocks, priority, expirationTime))
         goto FAILURE;
     }
@@ -404,7 +412,7 @@ GNUNET_ECRS_file_upload (struct GNUNET_GE_Context *ectx,
       fprintf (stderr, "Query for current block at level %u is `%s'.\n", i,
                &enc);
 #endif
-      if (GNUNET_OK != pushBlock (sock,
+      if (GNUNET_OK != pushBlock (sock, ring,
                                   &mchk, i + 1, iblocks, priority,
                                   expirationTime))
         {
@@ -420,7 +428,7 @@ GNUNET_ECRS_file_upload (struct GNUNET_GE_Context *ectx,
       value->expiration_time = GNUNET_htonll (expirationTime);
       value->priority = htonl (priority);
       if ((doIndex != GNUNET_SYSERR) &&
-          (GNUNET_SYSERR == GNUNET_FS_insert (sock, value)))
+          (GNUNET_SYSERR == GNUNET_FS_insert_shared (sock, ring, value)))
         {
           GNUNET_GE_BREAK (ectx, 0);
           GNUNET_free (value);
@@ -430,6 +438,11 @@ GNUNET_ECRS_file_upload (struct GNUNET_GE_Context *ectx,
       GNUNET_free (iblocks[i]);
       iblocks[i] = NULL;
     }
+  if (GNUNET_SYSERR == GNUNET_FS_shared_ring_flush (sock, ring))
+    {
+      GNUNET_GE_BREAK (ectx, 0);
+      goto FAILURE;
+    }
 #if DEBUG_UPLOAD
   GNUNET_hash_to_enc (&mchk.query, &enc);
   GNUNET_GE_LOG (ectx, GNUNET_GE_WARNING | GNUNET_GE_ADMIN | GNUNET_GE_USER
@@ -452,6 +465,8 @@ GNUNET_ECRS_file_upload (struct GNUNET_GE_Context *ectx,
   if (upcb != NULL)
     upcb (filesize, filesize, eta, upcbClosure);
   CLOSE (fd);
+  if (ring != NULL)
+    GNUNET_FS_shared_ring_destroy (ring);
   GNUNET_client_connection_destroy (sock);
   return GNUNET_OK;
 FAILURE:
@@ -460,6 +475,8 @@ FAILURE:
   GNUNET_free (iblocks);
   GNUNET_free (dblock);
   CLOSE (fd);
+  if (ring != NULL)
+    GNUNET_FS_shared_ring_destroy (ring);
   GNUNET_client_connection_destroy (sock);
   return GNUNET_SYSERR;
 }
@@ -48,8 +48,6 @@ read_buffered (ReadBuffer * rb, void *d, unsigned int size)
   unsigned int pos;
   int ret;
 
-  if (rb->fd == -1)
-    return -1;
   pos = 0;
   do
     {
@@ -66,6 +64,8 @@ read_buffered (ReadBuffer * rb, void *d, unsigned int size)
       if (pos == size)
         return pos;             /* done! */
       GNUNET_GE_ASSERT (NULL, rb->have == rb->pos);
+      if (rb->fd == -1)
+        return -1;
       /* fill buffer */
       ret = READ (rb->fd, rb->buffer, rb->size);
       if (ret == -1)
@@ -393,8 +393,13 @@ readDownloadList (struct GNUNET_GE_Context *ectx,
   return ret;
 }
 
+/**
+ * Check the magic at the beginning of the state file.
+ *
+ * @param version set to the version of the file format
+ */
 static int
-checkMagic (ReadBuffer * rb)
+checkMagic (ReadBuffer * rb, int *version)
 {
   char magic[8];
 
@@ -403,12 +408,19 @@ checkMagic (ReadBuffer * rb)
       GNUNET_GE_BREAK (NULL, 0);
       return GNUNET_SYSERR;
     }
-  if (0 != memcmp (magic, "FSUI03\n\0", 8))
+  if (0 == memcmp (magic, "FSUI04\n\0", 8))
     {
-      GNUNET_GE_BREAK (NULL, 0);
-      return GNUNET_SYSERR;
+      *version = 4;
+      return GNUNET_OK;
     }
-  return GNUNET_OK;
+  if (0 == memcmp (magic, "FSUI03\n\0", 8))
+    {
+      /* older format, results are stored in the state file */
+      *version = 3;
+      return GNUNET_OK;
+    }
+  GNUNET_GE_BREAK (NULL, 0);
+  return GNUNET_SYSERR;
 }
 
 static int
@@ -485,9 +497,88 @@ read_search_record_list (struct GNUNET_GE_Context *ectx, ReadBuffer * rb)
   return head;
 }
 
+/**
+ * Read a single search result (the number of matching
+ * searches of the result must already have been read).
+ *
+ * @param matching number of searches matching the result
+ * @param search_count length of search_list
+ * @param search_list list of ECRS search requests
+ * @return NULL on error
+ */
+static struct SearchResultList *
+read_result_entry (struct GNUNET_GE_Context *ectx,
+                   ReadBuffer * rb,
+                   unsigned int matching,
+                   unsigned int search_count,
+                   struct SearchRecordList **search_list)
+{
+  unsigned int remaining;
+  unsigned int probeSucc;
+  unsigned int probeFail;
+  struct SearchResultList *ret;
+  unsigned int i;
+  unsigned int idx;
+
+  if ((matching > search_count) ||
+      (GNUNET_OK != read_uint (rb, &remaining)) ||
+      (GNUNET_OK != read_uint (rb, &probeSucc)) ||
+      (GNUNET_OK != read_uint (rb, &probeFail)))
+    return NULL;
+  ret = GNUNET_malloc (sizeof (struct SearchResultList));
+  memset (ret, 0, sizeof (struct SearchResultList));
+  if (GNUNET_OK != readFileInfo (ectx, rb, &ret->fi))
+    {
+      GNUNET_free (ret);
+      return NULL;
+    }
+  ret->matchingSearchCount = matching;
+  ret->mandatoryMatchesRemaining = remaining;
+  ret->probeSuccess = probeSucc;
+  ret->probeFailure = probeFail;
+  if ((ret->probeSuccess + ret->probeFailure > GNUNET_FSUI_MAX_PROBES) ||
+      (ret->probeSuccess > GNUNET_FSUI_MAX_PROBES) ||
+      (ret->probeFailure > GNUNET_FSUI_MAX_PROBES))
+    {
+      GNUNET_GE_BREAK (NULL, 0);
+      /* try to recover */
+      ret->probeSuccess = 0;
+      ret->probeFailure = 0;
+    }
+  ret->test_download = NULL;
+  ret->matchingSearches = NULL;
+  i = 0;
+  GNUNET_array_grow (ret->matchingSearches, i, ret->matchingSearchCount);
+  while (i-- > 0)
+    {
+      if ((GNUNET_OK != read_uint (rb, &idx)) || (idx > search_count))
+        {
+          GNUNET_GE_BREAK (NULL, 0);
+          GNUNET_array_grow (ret->matchingSearches,
+                             ret->matchingSearchCount, 0);
+          GNUNET_meta_data_destroy (ret->fi.meta);
+          GNUNET_ECRS_uri_destroy (ret->fi.uri);
+          GNUNET_free (ret);
+          return NULL;
+        }
+      if (idx == 0)
+        {
+          GNUNET_GE_BREAK (NULL, 0);
+          ret->matchingSearches[i] = NULL;
+        }
+      else
+        {
+          GNUNET_GE_BREAK (NULL, search_list[idx - 1] != NULL);
+          ret->matchingSearches[i] = search_list[idx - 1];
+        }
+    }
+  return ret;
+}
+
 /**
  * Read all of the results received so far
- * for this search.
+ * for this search (only used by the old
+ * format of the state file).
  *
  * @param search_count length of search_list
  * @param search_list list of ECRS search requests
@@ -499,14 +590,9 @@ read_result_list (struct GNUNET_GE_Context *ectx,
                   struct SearchRecordList **search_list)
 {
   unsigned int matching;
-  unsigned int remaining;
-  unsigned int probeSucc;
-  unsigned int probeFail;
   struct GNUNET_MultiHashMap *map;
   struct SearchResultList *ret;
   GNUNET_HashCode urik;
-  unsigned int i;
-  unsigned int idx;
 
   map = GNUNET_multi_hash_map_create (4);
   while (1)
@@ -515,55 +601,10 @@ read_result_list (struct GNUNET_GE_Context *ectx,
         break;
       if (matching == -1)
         break;                  /* end of list marker */
-      if ((GNUNET_OK != read_uint (rb, &remaining)) ||
-          (GNUNET_OK != read_uint (rb, &probeSucc)) ||
-          (GNUNET_OK != read_uint (rb, &probeFail)))
+      ret = read_result_entry (ectx, rb, matching, search_count, search_list);
+      if (ret == NULL)
         break;
-      ret = GNUNET_malloc (sizeof (struct SearchResultList));
-      if (GNUNET_OK != readFileInfo (ectx, rb, &ret->fi))
-        {
-          GNUNET_free (ret);
-          break;
-        }
       GNUNET_ECRS_uri_to_key (ret->fi.uri, &urik);
-      ret->matchingSearchCount = matching;
-      ret->mandatoryMatchesRemaining = remaining;
-      ret->probeSuccess = probeSucc;
-      ret->probeFailure = probeFail;
-      if ((ret->probeSuccess + ret->probeFailure > GNUNET_FSUI_MAX_PROBES) ||
-          (ret->probeSuccess > GNUNET_FSUI_MAX_PROBES) ||
-          (ret->probeFailure > GNUNET_FSUI_MAX_PROBES))
-        {
-          GNUNET_GE_BREAK (NULL, 0);
-          /* try to recover */
-          ret->probeSuccess = 0;
-          ret->probeFailure = 0;
-        }
-      ret->test_download = NULL;
-      ret->matchingSearches = NULL;
-      i = 0;
-      GNUNET_array_grow (ret->matchingSearches, i, ret->matchingSearchCount);
-      while (i-- > 0)
-        {
-          if ((GNUNET_OK != read_uint (rb, &idx)) || (idx > search_count))
-            {
-              GNUNET_GE_BREAK (NULL, 0);
-              GNUNET_array_grow (ret->matchingSearches,
-                                 ret->matchingSearchCount, 0);
-              GNUNET_free (ret);
-              return map;
-            }
-          if (idx == 0)
-            {
-              GNUNET_GE_BREAK (NULL, 0);
-              ret->matchingSearches[i] = NULL;
-            }
-          else
-            {
-              GNUNET_GE_BREAK (NULL, search_list[idx - 1] != NULL);
-              ret->matchingSearches[i] = search_list[idx - 1];
-            }
-        }
       GNUNET_multi_hash_map_put (map,
                                  &urik,
                                  ret, GNUNET_MultiHashMapOption_MULTIPLE);
@@ -583,7 +624,7 @@ free_entry (const GNUNET_HashCode * key, void *value, void *cls)
  * performing.
  */
 static int
-readSearches (ReadBuffer * rb, struct GNUNET_FSUI_Context *ctx)
+readSearches (ReadBuffer * rb, struct GNUNET_FSUI_Context *ctx, int version)
 {
   int big;
   GNUNET_FSUI_SearchList *list;
@@ -607,11 +648,16 @@ readSearches (ReadBuffer * rb, struct GNUNET_FSUI_Context *ctx)
           (GNUNET_OK != read_long (rb, (long long *) &list->start_time)) ||
           (GNUNET_OK != read_long (rb, (long long *) &stime)) ||
           (GNUNET_OK != read_uint (rb, &list->anonymityLevel)) ||
-          (GNUNET_OK != read_uint (rb, &list->mandatory_keyword_count)))
+          (GNUNET_OK != read_uint (rb, &list->mandatory_keyword_count)) ||
+          ((version >= 4) &&
+           (GNUNET_OK != read_uint (rb, &list->journal_id))))
         {
           GNUNET_GE_BREAK (NULL, 0);
           break;
         }
+      if (version < 4)
+        list->journal_id =
+          GNUNET_random_u32 (GNUNET_RANDOM_QUALITY_STRONG, (unsigned int) -1);
       fixState (&list->state);
       if (stime > GNUNET_get_time ())
         stime = GNUNET_get_time ();
@@ -655,8 +701,11 @@ readSearches (ReadBuffer * rb, struct GNUNET_FSUI_Context *ctx)
           srla[--i] = srl;
           srl = srl->next;
         }
-      list->resultsReceived = read_result_list (ctx->ectx, rb,
-                                                total_searches, srla);
+      if (version >= 4)
+        list->resultsReceived = GNUNET_multi_hash_map_create (4);
+      else
+        list->resultsReceived = read_result_list (ctx->ectx, rb,
+                                                  total_searches, srla);
       GNUNET_free (srla);
       list->next = NULL;
 
@@ -675,8 +724,12 @@ readSearches (ReadBuffer * rb, struct GNUNET_FSUI_Context *ctx)
     }                           /* end OUTER: 'while(1)' */
 ERR:
   /* error - deallocate 'list' */
-  GNUNET_multi_hash_map_iterate (list->resultsReceived, &free_entry, NULL);
-  GNUNET_multi_hash_map_destroy (list->resultsReceived);
+  if (list->resultsReceived != NULL)
+    {
+      GNUNET_multi_hash_map_iterate (list->resultsReceived, &free_entry,
+                                     NULL);
+      GNUNET_multi_hash_map_destroy (list->resultsReceived);
+    }
 
   while (list->searches != NULL)
     {
@@ -898,24 +951,78 @@ readUnindex (ReadBuffer * rb, struct GNUNET_FSUI_Context *ctx)
 }
 
 
+/**
+ * Open the results journal.  Unless the results were
+ * already contained in the state file (old format), the
+ * journal is prepared for loading its records lazily.
+ *
+ * @param version version of the state file, 0 for none
+ */
+static void
+openJournal (struct GNUNET_FSUI_Context *ctx, int version)
+{
+  unsigned long long size;
+
+  ctx->journal_name = GNUNET_malloc (strlen (ctx->name) + 9);
+  strcpy (ctx->journal_name, ctx->name);
+  strcat (ctx->journal_name, ".results");
+  if (version == 3)
+    {
+      /* results were read from the state file; move
+         them to the journal */
+      GNUNET_FSUI_journal_compact (ctx);
+      return;
+    }
+  if ((ctx->activeSearches != NULL) &&
+      (0 == ACCESS (ctx->journal_name, R_OK)) &&
+      (GNUNET_OK == GNUNET_disk_file_size (ctx->ectx,
+                                           ctx->journal_name,
+                                           &size, GNUNET_YES)) && (size > 0))
+    {
+      ctx->journal_load_fd = GNUNET_disk_file_open (ctx->ectx,
+                                                    ctx->journal_name,
+                                                    O_RDONLY);
+      ctx->journal_load_pos = 0;
+      ctx->journal_load_end = size;
+      ctx->journal_fd = GNUNET_disk_file_open (ctx->ectx,
+                                               ctx->journal_name,
+                                               O_CREAT | O_WRONLY |
+                                               O_APPEND,
+                                               S_IRUSR | S_IWUSR);
+    }
+  else
+    {
+      /* no searches, so none of the records are relevant */
+      ctx->journal_fd = GNUNET_disk_file_open (ctx->ectx,
+                                               ctx->journal_name,
+                                               O_CREAT | O_TRUNC |
+                                               O_WRONLY | O_APPEND,
+                                               S_IRUSR | S_IWUSR);
+    }
+}
+
 void
 GNUNET_FSUI_deserialize (struct GNUNET_FSUI_Context *ctx)
 {
   ReadBuffer rb;
+  int version;
 
+  version = 0;
   rb.fd = -1;
-  if (0 != ACCESS (ctx->name, R_OK))
-    return;
-  rb.fd = GNUNET_disk_file_open (ctx->ectx, ctx->name, O_RDONLY);
+  if (0 == ACCESS (ctx->name, R_OK))
+    rb.fd = GNUNET_disk_file_open (ctx->ectx, ctx->name, O_RDONLY);
   if (rb.fd == -1)
-    return;
+    {
+      openJournal (ctx, version);
+      return;
+    }
   rb.pos = 0;
   rb.size = 64 * 1024;
   rb.have = 0;
   rb.buffer = GNUNET_malloc (rb.size);
-  if ((GNUNET_OK != checkMagic (&rb)) ||
+  if ((GNUNET_OK != checkMagic (&rb, &version)) ||
       (GNUNET_OK != readCollection (&rb, ctx)) ||
-      (GNUNET_OK != readSearches (&rb, ctx)) ||
+      (GNUNET_OK != readSearches (&rb, ctx, version)) ||
       (GNUNET_OK != readDownloads (&rb, ctx)) ||
       (GNUNET_OK != readUnindex (&rb, ctx))
       || (GNUNET_OK != readUploads (&rb, ctx)))
@@ -928,8 +1035,245 @@ GNUNET_FSUI_deserialize (struct GNUNET_FSUI_Context *ctx)
                      ctx->name, LSEEK (rb.fd, 0, SEEK_CUR));
     }
   CLOSE (rb.fd);
-  UNLINK (ctx->name);
   GNUNET_free (rb.buffer);
+  /* keep the state file: it is replaced by the next
+     checkpoint, and a crash before then should not
+     lose the state */
+  openJournal (ctx, version);
+}
+
+/**
+ * Signal a result loaded from the journal to the client.
+ */
+static void
+signalRestoredResult (struct GNUNET_FSUI_SearchList *pos,
+                      struct SearchResultList *srl, int update)
+{
+  GNUNET_FSUI_Event event;
+
+  if (update)
+    {
+      event.type = GNUNET_FSUI_search_update;
+      event.data.SearchUpdate.sc.pos = pos;
+      event.data.SearchUpdate.sc.cctx = pos->cctx;
+      event.data.SearchUpdate.fi = srl->fi;
+      event.data.SearchUpdate.searchURI = pos->uri;
+      event.data.SearchUpdate.availability_rank =
+        srl->probeSuccess - srl->probeFailure;
+      event.data.SearchUpdate.availability_certainty =
+        srl->probeSuccess + srl->probeFailure;
+      event.data.SearchUpdate.applicability_rank = srl->matchingSearchCount;
+    }
+  else
+    {
+      event.type = GNUNET_FSUI_search_result;
+      event.data.SearchResult.sc.pos = pos;
+      event.data.SearchResult.sc.cctx = pos->cctx;
+      event.data.SearchResult.fi = srl->fi;
+      event.data.SearchResult.searchURI = pos->uri;
+    }
+  pos->ctx->ecb (pos->ctx->ecbClosure, &event);
+}
+
+struct RestoreClosure
+{
+  const struct SearchResultList *srl;
+  struct SearchResultList *found;
+};
+
+static int
+find_result (const GNUNET_HashCode * key, void *value, void *cls)
+{
+  struct RestoreClosure *rc = cls;
+  struct SearchResultList *srl = value;
+
+  if (!GNUNET_ECRS_uri_test_equal (rc->srl->fi.uri, srl->fi.uri))
+    return GNUNET_OK;
+  rc->found = srl;
+  return GNUNET_SYSERR;
+}
+
+/**
+ * Merge a result loaded from the journal into the results
+ * of the given search.  Journal records only ever add
+ * information, so if we already know about the result we
+ * keep whichever counters are further along.
+ *
+ * @param srl result loaded from the journal, consumed
+ */
+static void
+restoreResult (struct GNUNET_FSUI_SearchList *pos,
+               struct SearchResultList *srl)
+{
+  struct SearchResultList *old;
+  struct RestoreClosure rc;
+  GNUNET_HashCode urik;
+  int visible;
+  int changed;
+
+  GNUNET_ECRS_uri_to_key (srl->fi.uri, &urik);
+  rc.srl = srl;
+  rc.found = NULL;
+  GNUNET_multi_hash_map_get_multiple (pos->resultsReceived,
+                                      &urik, &find_result, &rc);
+  old = rc.found;
+  if (old == NULL)
+    {
+      GNUNET_multi_hash_map_put (pos->resultsReceived,
+                                 &urik, srl,
+                                 GNUNET_MultiHashMapOption_MULTIPLE);
+      if (srl->mandatoryMatchesRemaining == 0)
+        signalRestoredResult (pos, srl, GNUNET_NO);
+      return;
+    }
+  visible = (old->mandatoryMatchesRemaining == 0);
+  changed = GNUNET_NO;
+  if (srl->matchingSearchCount > old->matchingSearchCount)
+    {
+      GNUNET_free_non_null (old->matchingSearches);
+      old->matchingSearches = srl->matchingSearches;
+      old->matchingSearchCount = srl->matchingSearchCount;
+      srl->matchingSearches = NULL;
+      srl->matchingSearchCount = 0;
+      changed = GNUNET_YES;
+    }
+  if (srl->mandatoryMatchesRemaining < old->mandatoryMatchesRemaining)
+    old->mandatoryMatchesRemaining = srl->mandatoryMatchesRemaining;
+  if (srl->probeSuccess > old->probeSuccess)
+    {
+      old->probeSuccess = srl->probeSuccess;
+      changed = GNUNET_YES;
+    }
+  if (srl->probeFailure > old->probeFailure)
+    {
+      old->probeFailure = srl->probeFailure;
+      changed = GNUNET_YES;
+    }
+  if (old->mandatoryMatchesRemaining == 0)
+    {
+      if (!visible)
+        signalRestoredResult (pos, old, GNUNET_NO);
+      else if (changed)
+        signalRestoredResult (pos, old, GNUNET_YES);
+    }
+  GNUNET_free_non_null (srl->matchingSearches);
+  GNUNET_meta_data_destroy (srl->fi.meta);
+  GNUNET_ECRS_uri_destroy (srl->fi.uri);
+  GNUNET_free (srl);
+}
+
+/**
+ * Parse a journal record and merge it into the
+ * search that it belongs to (if that search still
+ * exists).
+ */
+static void
+loadRecord (struct GNUNET_FSUI_Context *ctx,
+            unsigned int search_id, char *data, unsigned int size)
+{
+  struct GNUNET_FSUI_SearchList *pos;
+  struct SearchRecordList *rec;
+  struct SearchRecordList **srla;
+  struct SearchResultList *srl;
+  unsigned int total_searches;
+  unsigned int matching;
+  unsigned int i;
+  ReadBuffer rb;
+
+  pos = ctx->activeSearches;
+  while ((pos != NULL) && (pos->journal_id != search_id))
+    pos = pos->next;
+  if (pos == NULL)
+    return;                     /* search was stopped */
+  total_searches = 0;
+  for (rec = pos->searches; rec != NULL; rec = rec->next)
+    total_searches++;
+  srla = GNUNET_malloc ((total_searches + 1) *
+                        sizeof (struct SearchRecordList *));
+  i = 0;
+  for (rec = pos->searches; rec != NULL; rec = rec->next)
+    srla[i++] = rec;
+  rb.fd = -1;
+  rb.buffer = data;
+  rb.size = size;
+  rb.have = size;
+  rb.pos = 0;
+  srl = NULL;
+  if (GNUNET_OK == read_uint (&rb, &matching))
+    srl = read_result_entry (ctx->ectx, &rb, matching, total_searches, srla);
+  GNUNET_free (srla);
+  if (srl == NULL)
+    {
+      GNUNET_GE_BREAK (ctx->ectx, 0);
+      return;
+    }
+  restoreResult (pos, srl);
+}
+
+int
+GNUNET_FSUI_journal_load (struct GNUNET_FSUI_Context *ctx, unsigned int max)
+{
+  struct JournalRecordHeader hdr;
+  unsigned int size;
+  char *data;
+  int done;
+
+  if (ctx->journal_load_fd == -1)
+    return GNUNET_YES;
+  done = GNUNET_NO;
+  while (max-- > 0)
+    {
+      if (ctx->journal_load_pos + sizeof (struct JournalRecordHeader) >
+          ctx->journal_load_end)
+        {
+          done = GNUNET_YES;
+          break;
+        }
+      if ((ctx->journal_load_pos !=
+           LSEEK (ctx->journal_load_fd, ctx->journal_load_pos, SEEK_SET)) ||
+          (sizeof (struct JournalRecordHeader) !=
+           READ (ctx->journal_load_fd, &hdr,
+                 sizeof (struct JournalRecordHeader))))
+        {
+          GNUNET_GE_LOG_STRERROR_FILE (ctx->ectx,
+                                       GNUNET_GE_WARNING | GNUNET_GE_USER |
+                                       GNUNET_GE_BULK, "read",
+                                       ctx->journal_name);
+          done = GNUNET_YES;
+          break;
+        }
+      size = ntohl (hdr.size);
+      if ((ntohl (hdr.magic) != GNUNET_FSUI_JOURNAL_MAGIC) ||
+          (size > GNUNET_FSUI_JOURNAL_MAX_RECORD) ||
+          (ctx->journal_load_pos + sizeof (struct JournalRecordHeader) +
+           size > ctx->journal_load_end))
+        {
+          /* damaged record (crash during write?), try
+             to find the start of the next record */
+          ctx->journal_load_pos++;
+          continue;
+        }
+      data = GNUNET_malloc_large (size + 1);
+      if ((size != READ (ctx->journal_load_fd, data, size)) ||
+          (ntohl (hdr.crc) != GNUNET_crc32_n (data, size)))
+        {
+          GNUNET_free (data);
+          ctx->journal_load_pos++;
+          continue;
+        }
+      ctx->journal_load_pos += sizeof (struct JournalRecordHeader) + size;
+      ctx->journal_records++;
+      loadRecord (ctx, ntohl (hdr.search_id), data, size);
+      GNUNET_free (data);
+    }
+  if (ctx->journal_load_pos + sizeof (struct JournalRecordHeader) >
+      ctx->journal_load_end)
+    done = GNUNET_YES;
+  if (done == GNUNET_NO)
+    return GNUNET_NO;           /* more to do */
+  CLOSE (ctx->journal_load_fd);
+  ctx->journal_load_fd = -1;
+  return GNUNET_YES;
 }
 
 /* end of deserialize.c */
@@ -503,7 +503,10 @@ GNUNET_FSUI_updateDownloadThread (GNUNET_FSUI_DownloadList * list)
         list->state = GNUNET_FSUI_ERROR_JOINED;
     }
   if (list->state == GNUNET_FSUI_ACTIVE)
-    update_progress_bits (now, list);
+    {
+      update_progress_bits (now, list);
+      GNUNET_ECRS_file_download_rebalance (list->handle);
+    }
   /* should this one be stopped? */
   if ((list->state == GNUNET_FSUI_ACTIVE) &&
       ((list->ctx->threadPoolSize
@@ -80,6 +80,7 @@ process_probes (const GNUNET_HashCode * key, void *value, void *cls)
           GNUNET_ECRS_file_download_partial_stop (srl->test_download);
           srl->test_download = NULL;
           srl->probeSuccess++;
+          GNUNET_FSUI_journal_append (sl, srl);
           event.type = GNUNET_FSUI_search_update;
           event.data.SearchUpdate.sc.pos = sl;
           event.data.SearchUpdate.sc.cctx = sl->cctx;
@@ -107,6 +108,7 @@ process_probes (const GNUNET_HashCode * key, void *value, void *cls)
               GNUNET_ECRS_file_download_partial_stop (srl->test_download);
               srl->test_download = NULL;
               srl->probeFailure++;
+              GNUNET_FSUI_journal_append (sl, srl);
               event.type = GNUNET_FSUI_search_update;
               event.data.SearchUpdate.sc.pos = sl;
               event.data.SearchUpdate.sc.cctx = sl->cctx;
@@ -202,6 +204,35 @@ updateDownloadThreads (void *c)
   GNUNET_mutex_unlock (ctx->lock);
 }
 
+/**
+ * Cron job that loads results of the previous session
+ * from the results journal.
+ */
+static void
+loadJournal (void *c)
+{
+  GNUNET_FSUI_Context *ctx = c;
+
+  if (ctx->journal_load_fd == -1)
+    return;
+  GNUNET_mutex_lock (ctx->lock);
+  GNUNET_FSUI_journal_load (ctx, GNUNET_FSUI_JOURNAL_LOAD_BATCH);
+  GNUNET_mutex_unlock (ctx->lock);
+}
+
+/**
+ * Cron job that writes a checkpoint of the FSUI state.
+ */
+static void
+checkpoint (void *c)
+{
+  GNUNET_FSUI_Context *ctx = c;
+
+  GNUNET_mutex_lock (ctx->lock);
+  GNUNET_FSUI_checkpoint (ctx);
+  GNUNET_mutex_unlock (ctx->lock);
+}
+
 /* ******************* START code *********************** */
 
 static void
@@ -396,6 +427,9 @@ GNUNET_FSUI_start (struct GNUNET_GE_Context *ectx,
   ret->activeDownloadThreads = 0;
   ret->name = GNUNET_get_home_filename (ectx,
                                         cfg, GNUNET_NO, "fsui", name, NULL);
+  ret->journal_lock = GNUNET_mutex_create (GNUNET_NO);
+  ret->journal_fd = -1;
+  ret->journal_load_fd = -1;
   /* 1) read state  in */
   if (doResume)
     {
@@ -551,6 +585,16 @@ GNUNET_FSUI_start (struct GNUNET_GE_Context *ectx,
   GNUNET_cron_add_job (ret->cron,
                        &updateDownloadThreads, 0, GNUNET_FSUI_UDT_FREQUENCY,
                        ret);
+  /* 3e) load results lazily, write checkpoints */
+  if (ret->ipc != NULL)
+    {
+      GNUNET_cron_add_job (ret->cron,
+                           &loadJournal, 0,
+                           GNUNET_FSUI_JOURNAL_LOAD_FREQUENCY, ret);
+      GNUNET_cron_add_job (ret->cron,
+                           &checkpoint, GNUNET_FSUI_CHECKPOINT_FREQUENCY,
+                           GNUNET_FSUI_CHECKPOINT_FREQUENCY, ret);
+    }
   GNUNET_cron_start (ret->cron);
   /* 3d) resume uploads */
   doResumeUploads (ret->activeUploads.child, ret);
@@ -733,6 +777,13 @@ GNUNET_FSUI_stop (struct GNUNET_FSUI_Context *ctx)
   GNUNET_cron_stop (ctx->cron);
   GNUNET_cron_del_job (ctx->cron, &updateDownloadThreads,
                        GNUNET_FSUI_UDT_FREQUENCY, ctx);
+  if (ctx->ipc != NULL)
+    {
+      GNUNET_cron_del_job (ctx->cron, &loadJournal,
+                           GNUNET_FSUI_JOURNAL_LOAD_FREQUENCY, ctx);
+      GNUNET_cron_del_job (ctx->cron, &checkpoint,
+                           GNUNET_FSUI_CHECKPOINT_FREQUENCY, ctx);
+    }
   GNUNET_cron_destroy (ctx->cron);
 
   /* 1a) stop downloading */
@@ -838,9 +889,11 @@ GNUNET_FSUI_stop (struct GNUNET_FSUI_Context *ctx)
       spos = spos->next;
     }
 
-  /* 3) serialize all of the FSUI state */
+  /* 3) serialize all of the FSUI state (search results
+     are already in the journal) */
   if (ctx->ipc != NULL)
     GNUNET_FSUI_serialize (ctx);
+  GNUNET_FSUI_journal_close (ctx);
 
   /* 4) finally, free memory */
   /* 4a) free search memory */
@@ -881,6 +934,7 @@ GNUNET_FSUI_stop (struct GNUNET_FSUI_Context *ctx)
       GNUNET_IPC_semaphore_destroy (ctx->ipc);
     }
   GNUNET_mutex_destroy (ctx->lock);
+  GNUNET_mutex_destroy (ctx->journal_lock);
   GNUNET_free (ctx->name);
   if (ctx->ipc != NULL)
     GNUNET_GE_LOG (ectx,
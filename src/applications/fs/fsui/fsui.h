@@ -69,6 +69,65 @@
  */
 #define GNUNET_FSUI_DL_KILL_TIME_MASK 0x7FFF
 
+/**
+ * How often do we write a checkpoint of the FSUI state
+ * (and consider compacting the results journal)?
+ */
+#define GNUNET_FSUI_CHECKPOINT_FREQUENCY (1 * GNUNET_CRON_MINUTES)
+
+/**
+ * How often do we load more results of the previous
+ * session from the results journal (until all are loaded)?
+ */
+#define GNUNET_FSUI_JOURNAL_LOAD_FREQUENCY (50 * GNUNET_CRON_MILLISECONDS)
+
+/**
+ * How many journal records do we load per run of the loader?
+ */
+#define GNUNET_FSUI_JOURNAL_LOAD_BATCH 256
+
+/**
+ * Compact the results journal once it has this many
+ * records more than twice the number of results that
+ * are still alive.
+ */
+#define GNUNET_FSUI_JOURNAL_SLACK 1024
+
+/**
+ * Largest journal record that we will write or load.
+ */
+#define GNUNET_FSUI_JOURNAL_MAX_RECORD (2 * 1024 * 1024)
+
+/**
+ * Magic number at the start of each journal record.
+ */
+#define GNUNET_FSUI_JOURNAL_MAGIC 0x46535231
+
+/**
+ * Header of a record in the results journal.  The
+ * header is followed by the serialized search result.
+ * All fields are in network byte order.
+ */
+struct JournalRecordHeader
+{
+  unsigned int magic;
+
+  /**
+   * Size of the serialized result (excluding this header).
+   */
+  unsigned int size;
+
+  /**
+   * Journal ID of the search that the result belongs to.
+   */
+  unsigned int search_id;
+
+  /**
+   * CRC of the serialized result.
+   */
+  unsigned int crc;
+};
+
 /**
  * Track record for a given result.
  */
@@ -230,6 +289,12 @@ typedef struct GNUNET_FSUI_SearchList
    */
   unsigned int my_downloads_size;
 
+  /**
+   * ID under which results of this search are recorded
+   * in the results journal.
+   */
+  unsigned int journal_id;
+
   /**
    * FSUI state of this search.
    */
@@ -592,6 +657,44 @@ typedef struct GNUNET_FSUI_Context
    */
   unsigned int active_probes;
 
+  /**
+   * Name of the results journal (NULL if we do not resume).
+   */
+  char *journal_name;
+
+  /**
+   * Lock for appending to the results journal.
+   */
+  struct GNUNET_Mutex *journal_lock;
+
+  /**
+   * Handle for appending to the results journal (-1 if closed).
+   */
+  int journal_fd;
+
+  /**
+   * Handle for loading results of the previous session
+   * from the journal (-1 once everything has been loaded).
+   */
+  int journal_load_fd;
+
+  /**
+   * Offset of the next journal record to load.
+   */
+  unsigned long long journal_load_pos;
+
+  /**
+   * Size of the journal at startup (records beyond
+   * this offset were appended by this session).
+   */
+  unsigned long long journal_load_end;
+
+  /**
+   * Number of records in the results journal (only
+   * accurate once all records have been loaded).
+   */
+  unsigned int journal_records;
+
 } GNUNET_FSUI_Context;
 
 /* ************ cross-file prototypes ************ */
@@ -614,8 +717,50 @@ void *GNUNET_FSUI_uploadThread (void *dl);
 
 void *GNUNET_FSUI_unindexThread (void *cls);
 
+/**
+ * Write the FSUI state (except for search results, which
+ * are kept in the results journal).
+ */
 void GNUNET_FSUI_serialize (struct GNUNET_FSUI_Context *ctx);
 
+/**
+ * Read the FSUI state and open the results journal.
+ * Results from the journal are loaded later by
+ * GNUNET_FSUI_journal_load.
+ */
 void GNUNET_FSUI_deserialize (struct GNUNET_FSUI_Context *ctx);
 
+/**
+ * Write a checkpoint of the FSUI state and compact the
+ * results journal if it contains too many stale records.
+ * Caller must hold ctx->lock.
+ */
+void GNUNET_FSUI_checkpoint (struct GNUNET_FSUI_Context *ctx);
+
+/**
+ * Record the current information about a search result
+ * in the results journal.
+ */
+void GNUNET_FSUI_journal_append (struct GNUNET_FSUI_SearchList *pos,
+                                 const struct SearchResultList *srl);
+
+/**
+ * Rewrite the results journal from the results in memory.
+ */
+void GNUNET_FSUI_journal_compact (struct GNUNET_FSUI_Context *ctx);
+
+/**
+ * Close the results journal.
+ */
+void GNUNET_FSUI_journal_close (struct GNUNET_FSUI_Context *ctx);
+
+/**
+ * Load up to max records of the previous session from the
+ * results journal.  Caller must hold ctx->lock.
+ *
+ * @return GNUNET_YES if all records have been loaded
+ */
+int GNUNET_FSUI_journal_load (struct GNUNET_FSUI_Context *ctx,
+                              unsigned int max);
+
 #endif
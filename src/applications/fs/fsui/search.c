@@ -145,6 +145,7 @@ process_existing (const GNUNET_HashCode * key, void *value, void *arg)
       fprintf (stderr, "Received optional search result\n");
 #endif
     }
+  GNUNET_FSUI_journal_append (pc->pos, srl);
   if (srl->mandatoryMatchesRemaining == 0)
     {
 #if DEBUG_SEARCH
@@ -248,6 +249,7 @@ GNUNET_FSUI_search_progress_callback (const GNUNET_ECRS_FileInfo * fi,
     }
   GNUNET_multi_hash_map_put (pos->resultsReceived,
                              &urik, srl, GNUNET_MultiHashMapOption_MULTIPLE);
+  GNUNET_FSUI_journal_append (pos, srl);
   if (srl->mandatoryMatchesRemaining == 0)
     {
 #if DEBUG_SEARCH
@@ -342,6 +344,10 @@ GNUNET_FSUI_search_start (struct GNUNET_FSUI_Context *ctx,
   pos->start_time = GNUNET_get_time ();
   pos->uri = GNUNET_ECRS_uri_duplicate (uri);
   pos->resultsReceived = GNUNET_multi_hash_map_create (4);
+  /* random, so that records of searches from a session
+     that crashed before its checkpoint never match */
+  pos->journal_id =
+    GNUNET_random_u32 (GNUNET_RANDOM_QUALITY_STRONG, (unsigned int) -1);
   event.type = GNUNET_FSUI_search_started;
   event.data.SearchStarted.sc.pos = pos;
   event.data.SearchStarted.sc.cctx = NULL;
@@ -236,7 +236,25 @@ main (int argc, char *argv[])
       CHECK (prog < 10000);
       GNUNET_thread_sleep (50 * GNUNET_CRON_MILLISECONDS);
     }
-  GNUNET_FSUI_search_abort (search);
+  CHECK (uri != NULL);
+  /* results must survive a restart; the search is paused,
+     so the result can only come from the saved state */
+  GNUNET_FSUI_search_pause (search);
+  GNUNET_FSUI_stop (ctx);
+  GNUNET_mutex_lock (lock);
+  GNUNET_ECRS_uri_destroy (uri);
+  uri = NULL;
+  GNUNET_mutex_unlock (lock);
+  ctx = GNUNET_FSUI_start (NULL,
+                           cfg, "fsuisearch_pause_resume_persistence_test",
+                           32, GNUNET_YES, &eventCallback, NULL);
+  prog = 0;
+  while ((uri == NULL) && (GNUNET_shutdown_test () != GNUNET_YES))
+    {
+      prog++;
+      CHECK (prog < 1000);
+      GNUNET_thread_sleep (50 * GNUNET_CRON_MILLISECONDS);
+    }
   GNUNET_FSUI_search_stop (search);
   CHECK (uri != NULL);
   fn = makeName (43);
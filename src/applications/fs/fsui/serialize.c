@@ -38,6 +38,12 @@ typedef struct
   unsigned int have;
   unsigned int size;
   char *buffer;
+
+  /**
+   * If GNUNET_YES, grow the buffer instead of
+   * writing to fd (which must then be -1).
+   */
+  int grow;
 } WriteBuffer;
 
 static void
@@ -48,7 +54,7 @@ write_buffered (WriteBuffer * wb, const void *s, unsigned int size)
   unsigned int pos;
   int ret;
 
-  if (wb->fd == -1)
+  if ((wb->fd == -1) && (wb->grow != GNUNET_YES))
     return;
   pos = 0;
   do
@@ -63,6 +69,11 @@ write_buffered (WriteBuffer * wb, const void *s, unsigned int size)
       if (pos == size)
         return;                 /* done */
       GNUNET_GE_ASSERT (NULL, wb->have == wb->size);
+      if (wb->grow == GNUNET_YES)
+        {
+          GNUNET_array_grow (wb->buffer, wb->size, wb->size * 2);
+          continue;
+        }
       ret = WRITE (wb->fd, wb->buffer, wb->size);
       if (ret != wb->size)
         {
@@ -286,7 +297,6 @@ static void
 writeSearches (WriteBuffer * wb, struct GNUNET_FSUI_Context *ctx)
 {
   GNUNET_FSUI_SearchList *spos;
-  struct WriteResultContext wrc;
 
   spos = ctx->activeSearches;
   while (spos != NULL)
@@ -300,14 +310,9 @@ writeSearches (WriteBuffer * wb, struct GNUNET_FSUI_Context *ctx)
       WRITELONG (wb, GNUNET_get_time ());
       WRITEINT (wb, spos->anonymityLevel);
       WRITEINT (wb, spos->mandatory_keyword_count);
+      WRITEINT (wb, spos->journal_id);
       writeURI (wb, spos->uri);
       write_search_record_list (ctx->ectx, wb, spos->searches);
-      wrc.ectx = ctx->ectx;
-      wrc.wb = wb;
-      wrc.search_list = spos->searches;
-      GNUNET_multi_hash_map_iterate (spos->resultsReceived,
-                                     &write_result_entry, &wrc);
-      WRITEINT (wb, -1);        /* result list terminator */
       spos = spos->next;
     }
   WRITEINT (wb, 0);
@@ -407,25 +412,254 @@ void
 GNUNET_FSUI_serialize (struct GNUNET_FSUI_Context *ctx)
 {
   WriteBuffer wb;
+  char *tmp;
 
+  /* write to a temporary file first so that a crash
+     never leaves us with a partial state file */
+  tmp = GNUNET_malloc (strlen (ctx->name) + 5);
+  strcpy (tmp, ctx->name);
+  strcat (tmp, ".tmp");
   wb.fd = GNUNET_disk_file_open (ctx->ectx,
-                                 ctx->name,
+                                 tmp,
                                  O_CREAT | O_TRUNC | O_WRONLY,
                                  S_IRUSR | S_IWUSR);
   if (wb.fd == -1)
-    return;
+    {
+      GNUNET_free (tmp);
+      return;
+    }
   wb.have = 0;
   wb.size = 64 * 1024;
+  wb.grow = GNUNET_NO;
   wb.buffer = GNUNET_malloc (wb.size);
-  write_buffered (&wb, "FSUI03\n\0", 8);        /* magic */
+  write_buffered (&wb, "FSUI04\n\0", 8);        /* magic */
   writeCollection (&wb, ctx);
   writeSearches (&wb, ctx);
   writeDownloadList (ctx->ectx, &wb, ctx, ctx->activeDownloads.child);
   writeUnindexing (&wb, ctx);
   writeUploads (&wb, ctx, ctx->activeUploads.child);
-  WRITE (wb.fd, wb.buffer, wb.have);
-  CLOSE (wb.fd);
+  if ((wb.fd != -1) && (wb.have == WRITE (wb.fd, wb.buffer, wb.have)))
+    {
+      CLOSE (wb.fd);
+      if (0 != RENAME (tmp, ctx->name))
+        GNUNET_GE_LOG_STRERROR_FILE (ctx->ectx,
+                                     GNUNET_GE_WARNING | GNUNET_GE_USER |
+                                     GNUNET_GE_BULK, "rename", ctx->name);
+    }
+  else
+    {
+      GNUNET_GE_LOG_STRERROR_FILE (ctx->ectx,
+                                   GNUNET_GE_WARNING | GNUNET_GE_USER |
+                                   GNUNET_GE_BULK, "write", tmp);
+      if (wb.fd != -1)
+        CLOSE (wb.fd);
+      UNLINK (tmp);
+    }
   GNUNET_free (wb.buffer);
+  GNUNET_free (tmp);
+}
+
+/**
+ * Serialize a search result into a journal record
+ * (header followed by the result).
+ *
+ * @param size set to the size of the record
+ * @return the record, NULL if it would be too large
+ */
+static char *
+make_journal_record (struct GNUNET_GE_Context *ectx,
+                     struct GNUNET_FSUI_SearchList *pos,
+                     const struct SearchResultList *srl, unsigned int *size)
+{
+  struct JournalRecordHeader hdr;
+  struct JournalRecordHeader *rh;
+  struct WriteResultContext wrc;
+  WriteBuffer wb;
+
+  wb.fd = -1;
+  wb.have = 0;
+  wb.size = 4 * 1024;
+  wb.grow = GNUNET_YES;
+  wb.buffer = GNUNET_malloc (wb.size);
+  memset (&hdr, 0, sizeof (struct JournalRecordHeader));
+  write_buffered (&wb, &hdr, sizeof (struct JournalRecordHeader));
+  wrc.ectx = ectx;
+  wrc.wb = &wb;
+  wrc.search_list = pos->searches;
+  write_result_entry (NULL, (void *) srl, &wrc);
+  if (wb.have > GNUNET_FSUI_JOURNAL_MAX_RECORD)
+    {
+      GNUNET_free (wb.buffer);
+      return NULL;
+    }
+  rh = (struct JournalRecordHeader *) wb.buffer;
+  rh->magic = htonl (GNUNET_FSUI_JOURNAL_MAGIC);
+  rh->size = htonl (wb.have - sizeof (struct JournalRecordHeader));
+  rh->search_id = htonl (pos->journal_id);
+  rh->crc = htonl (GNUNET_crc32_n (&rh[1],
+                                   wb.have -
+                                   sizeof (struct JournalRecordHeader)));
+  *size = wb.have;
+  return wb.buffer;
+}
+
+void
+GNUNET_FSUI_journal_append (struct GNUNET_FSUI_SearchList *pos,
+                            const struct SearchResultList *srl)
+{
+  struct GNUNET_FSUI_Context *ctx = pos->ctx;
+  char *rec;
+  unsigned int size;
+
+  if (ctx->journal_fd == -1)
+    return;
+  rec = make_journal_record (ctx->ectx, pos, srl, &size);
+  if (rec == NULL)
+    return;
+  GNUNET_mutex_lock (ctx->journal_lock);
+  if (ctx->journal_fd != -1)
+    {
+      if (size != WRITE (ctx->journal_fd, rec, size))
+        GNUNET_GE_LOG_STRERROR_FILE (ctx->ectx,
+                                     GNUNET_GE_WARNING | GNUNET_GE_USER |
+                                     GNUNET_GE_BULK, "write",
+                                     ctx->journal_name);
+      else
+        ctx->journal_records++;
+    }
+  GNUNET_mutex_unlock (ctx->journal_lock);
+  GNUNET_free (rec);
+}
+
+struct CompactContext
+{
+  struct GNUNET_FSUI_SearchList *pos;
+  WriteBuffer *wb;
+  unsigned int records;
+};
+
+static int
+write_journal_entry (const GNUNET_HashCode * key, void *value, void *cls)
+{
+  struct CompactContext *cc = cls;
+  struct SearchResultList *srl = value;
+  char *rec;
+  unsigned int size;
+
+  rec = make_journal_record (cc->pos->ctx->ectx, cc->pos, srl, &size);
+  if (rec == NULL)
+    return GNUNET_OK;
+  write_buffered (cc->wb, rec, size);
+  cc->records++;
+  GNUNET_free (rec);
+  return GNUNET_OK;
+}
+
+void
+GNUNET_FSUI_journal_compact (struct GNUNET_FSUI_Context *ctx)
+{
+  struct CompactContext cc;
+  WriteBuffer wb;
+  char *tmp;
+  int ok;
+
+  if (ctx->journal_name == NULL)
+    return;
+  tmp = GNUNET_malloc (strlen (ctx->journal_name) + 5);
+  strcpy (tmp, ctx->journal_name);
+  strcat (tmp, ".tmp");
+  wb.fd = GNUNET_disk_file_open (ctx->ectx,
+                                 tmp,
+                                 O_CREAT | O_TRUNC | O_WRONLY,
+                                 S_IRUSR | S_IWUSR);
+  if (wb.fd == -1)
+    {
+      GNUNET_free (tmp);
+      return;
+    }
+  wb.have = 0;
+  wb.size = 64 * 1024;
+  wb.grow = GNUNET_NO;
+  wb.buffer = GNUNET_malloc (wb.size);
+  cc.wb = &wb;
+  cc.records = 0;
+  cc.pos = ctx->activeSearches;
+  while (cc.pos != NULL)
+    {
+      GNUNET_multi_hash_map_iterate (cc.pos->resultsReceived,
+                                     &write_journal_entry, &cc);
+      cc.pos = cc.pos->next;
+    }
+  ok = (wb.fd != -1) && (wb.have == WRITE (wb.fd, wb.buffer, wb.have));
+  if (wb.fd != -1)
+    CLOSE (wb.fd);
+  GNUNET_free (wb.buffer);
+  if (!ok)
+    {
+      GNUNET_GE_LOG_STRERROR_FILE (ctx->ectx,
+                                   GNUNET_GE_WARNING | GNUNET_GE_USER |
+                                   GNUNET_GE_BULK, "write", tmp);
+      UNLINK (tmp);
+      GNUNET_free (tmp);
+      return;
+    }
+  GNUNET_mutex_lock (ctx->journal_lock);
+  if (0 != RENAME (tmp, ctx->journal_name))
+    {
+      GNUNET_GE_LOG_STRERROR_FILE (ctx->ectx,
+                                   GNUNET_GE_WARNING | GNUNET_GE_USER |
+                                   GNUNET_GE_BULK, "rename",
+                                   ctx->journal_name);
+      UNLINK (tmp);
+    }
+  else
+    {
+      if (ctx->journal_fd != -1)
+        CLOSE (ctx->journal_fd);
+      ctx->journal_fd = GNUNET_disk_file_open (ctx->ectx,
+                                               ctx->journal_name,
+                                               O_CREAT | O_WRONLY |
+                                               O_APPEND,
+                                               S_IRUSR | S_IWUSR);
+      ctx->journal_records = cc.records;
+    }
+  GNUNET_mutex_unlock (ctx->journal_lock);
+  GNUNET_free (tmp);
+}
+
+void
+GNUNET_FSUI_checkpoint (struct GNUNET_FSUI_Context *ctx)
+{
+  GNUNET_FSUI_SearchList *spos;
+  unsigned int live;
+
+  GNUNET_FSUI_serialize (ctx);
+  if (ctx->journal_load_fd != -1)
+    return;                     /* still loading, cannot compact yet */
+  live = 0;
+  spos = ctx->activeSearches;
+  while (spos != NULL)
+    {
+      live += GNUNET_multi_hash_map_size (spos->resultsReceived);
+      spos = spos->next;
+    }
+  if (ctx->journal_records > 2 * live + GNUNET_FSUI_JOURNAL_SLACK)
+    GNUNET_FSUI_journal_compact (ctx);
+}
+
+void
+GNUNET_FSUI_journal_close (struct GNUNET_FSUI_Context *ctx)
+{
+  GNUNET_mutex_lock (ctx->journal_lock);
+  if (ctx->journal_fd != -1)
+    CLOSE (ctx->journal_fd);
+  ctx->journal_fd = -1;
+  GNUNET_mutex_unlock (ctx->journal_lock);
+  if (ctx->journal_load_fd != -1)
+    CLOSE (ctx->journal_load_fd);
+  ctx->journal_load_fd = -1;
+  GNUNET_free_non_null (ctx->journal_name);
+  ctx->journal_name = NULL;
 }
 
 /* end of serialize.c */
@@ -77,6 +77,51 @@ static GNUNET_Datastore_ServiceAPI *datastore;
 
 static int active_migration;
 
+/**
+ * Largest shared file that we are willing to use.
+ */
+#define MAX_SHARED_FILE_SIZE (16 * 1024 * 1024)
+
+#ifndef O_NOFOLLOW
+#define O_NOFOLLOW 0
+#endif
+
+/**
+ * File shared with a client for inserts
+ * (GNUNET_CS_PROTO_GAP_INSERT_SHARED).  We do not map the
+ * file: the client could change a block after we validated
+ * it, or truncate the file under us.  Each block is read
+ * into our own buffer instead.
+ */
+struct SharedFile
+{
+  struct SharedFile *next;
+
+  struct GNUNET_ClientHandle *client;
+
+  char *filename;
+
+  /**
+   * The open file (read-only).
+   */
+  int fd;
+
+  /**
+   * Size of the file when we opened it.
+   */
+  unsigned int size;
+
+  /**
+   * Cookie from the header (network byte order).
+   */
+  unsigned int cookie;
+};
+
+/**
+ * Files shared with clients (at most one per client).
+ */
+static struct SharedFile *shared_files;
+
 static int stat_gap_query_received;
 
 static int stat_gap_query_drop_busy;
@@ -171,6 +216,252 @@ handle_cs_insert_request (struct GNUNET_ClientHandle *sock,
   return coreAPI->cs_send_value (sock, ret);
 }
 
+static void
+shared_file_free (struct SharedFile *sf)
+{
+  CLOSE (sf->fd);
+  GNUNET_free (sf->filename);
+  GNUNET_free (sf);
+}
+
+/**
+ * Is the given name one that a client could have obtained
+ * from GNUNET_FS_SHARED_TEMPLATE?
+ */
+static int
+shared_file_check_name (const char *filename)
+{
+  const char *suffix;
+  size_t prefix;
+
+  if (strlen (filename) != strlen (GNUNET_FS_SHARED_TEMPLATE))
+    return GNUNET_SYSERR;
+  prefix = strlen (GNUNET_FS_SHARED_TEMPLATE) - strlen ("XXXXXX");
+  if (0 != strncmp (filename, GNUNET_FS_SHARED_TEMPLATE, prefix))
+    return GNUNET_SYSERR;
+  for (suffix = &filename[prefix]; *suffix != '\0'; suffix++)
+    if (!isalnum ((unsigned char) *suffix))
+      return GNUNET_SYSERR;
+  return GNUNET_OK;
+}
+
+/**
+ * Find (or open) the shared file of a client.
+ *
+ * @return NULL if the file cannot be used (for example
+ *         because the client is on another machine)
+ */
+static struct SharedFile *
+shared_file_get (struct GNUNET_ClientHandle *sock,
+                 const char *filename, unsigned int cookie)
+{
+  struct SharedFile *sf;
+  struct SharedFile *prev;
+  GNUNET_FS_SharedHeader hdr;
+  struct stat buf;
+  int fd;
+
+  prev = NULL;
+  sf = shared_files;
+  while ((sf != NULL) && (sf->client != sock))
+    {
+      prev = sf;
+      sf = sf->next;
+    }
+  if (sf != NULL)
+    {
+      if ((sf->cookie == cookie) && (0 == strcmp (sf->filename, filename)))
+        return sf;
+      /* client switched to another file */
+      if (prev == NULL)
+        shared_files = sf->next;
+      else
+        prev->next = sf->next;
+      shared_file_free (sf);
+    }
+  if (GNUNET_OK != shared_file_check_name (filename))
+    return NULL;
+  /* O_NONBLOCK: do not hang on a FIFO; O_NOFOLLOW: do
+     not follow a link planted under an acceptable name */
+  fd = OPEN (filename, O_RDONLY | O_NONBLOCK | O_NOFOLLOW);
+  if (fd == -1)
+    return NULL;
+  if ((0 != FSTAT (fd, &buf)) ||
+      (!S_ISREG (buf.st_mode)) ||
+      (buf.st_size < sizeof (GNUNET_FS_SharedHeader)) ||
+      (buf.st_size > MAX_SHARED_FILE_SIZE) ||
+      (sizeof (GNUNET_FS_SharedHeader) !=
+       READ (fd, &hdr, sizeof (GNUNET_FS_SharedHeader))) ||
+      (ntohl (hdr.magic) != GNUNET_FS_SHARED_MAGIC) ||
+      (hdr.cookie != cookie) || (ntohl (hdr.size) != buf.st_size))
+    {
+      CLOSE (fd);
+      return NULL;
+    }
+  sf = GNUNET_malloc (sizeof (struct SharedFile));
+  sf->client = sock;
+  sf->filename = GNUNET_strdup (filename);
+  sf->fd = fd;
+  sf->size = buf.st_size;
+  sf->cookie = cookie;
+  sf->next = shared_files;
+  shared_files = sf;
+  return sf;
+}
+
+/**
+ * Read a block from a shared file into our own memory
+ * and insert it.
+ *
+ * @param datum buffer of at least "size" bytes
+ * @return GNUNET_SYSERR if the block is malformed or could
+ *         not be read, otherwise the result of putUpdate
+ */
+static int
+shared_file_insert (struct SharedFile *sf,
+                    unsigned int offset,
+                    unsigned int size, GNUNET_DatastoreValue * datum)
+{
+  const GNUNET_EC_DBlock *dblock;
+  GNUNET_HashCode query;
+
+  if ((offset < sizeof (GNUNET_FS_SharedHeader)) ||
+      ((offset & 7) != 0) ||
+      (size <= sizeof (GNUNET_DatastoreValue)) ||
+      (size > sf->size) || (offset > sf->size - size))
+    return GNUNET_SYSERR;
+  /* a short read means that the client truncated the file */
+  if ((offset != LSEEK (sf->fd, offset, SEEK_SET)) ||
+      (size != READ (sf->fd, datum, size)))
+    return GNUNET_SYSERR;
+  dblock = (const GNUNET_EC_DBlock *) &datum[1];
+  size -= sizeof (GNUNET_DatastoreValue);
+  if ((ntohl (datum->size) != size + sizeof (GNUNET_DatastoreValue)) ||
+      (GNUNET_OK !=
+       GNUNET_EC_file_block_check_and_get_query (size, dblock, GNUNET_YES,
+                                                 &query)) ||
+      (ntohl (datum->type) != GNUNET_EC_file_block_get_type (size, dblock)))
+    return GNUNET_SYSERR;
+  return datastore->putUpdate (&query, datum);
+}
+
+/**
+ * Process a request to insert a batch of blocks that the
+ * client placed into a shared file.  The handlers of a
+ * client and its exit handler never run concurrently, so
+ * the file stays open until we are done.
+ *
+ * @return GNUNET_SYSERR if the file cannot be used (the
+ *         client then falls back to GNUNET_CS_PROTO_GAP_INSERT)
+ *         or the request is malformed, otherwise GNUNET_OK
+ */
+static int
+handle_cs_insert_shared_request (struct GNUNET_ClientHandle *sock,
+                                 const GNUNET_MessageHeader * req)
+{
+  const CS_fs_request_insert_shared_MESSAGE *ris;
+  const GNUNET_FS_SharedBlock *blocks;
+  GNUNET_DatastoreValue *datum;
+  struct GNUNET_GE_Context *cectx;
+  struct SharedFile *sf;
+  const char *filename;
+  unsigned short msize;
+  unsigned int count;
+  unsigned int max;
+  unsigned int i;
+  int full;
+  int ret;
+
+  msize = ntohs (req->size);
+  ris = (const CS_fs_request_insert_shared_MESSAGE *) req;
+  if (msize <= sizeof (CS_fs_request_insert_shared_MESSAGE))
+    {
+      GNUNET_GE_BREAK (ectx, 0);
+      return GNUNET_SYSERR;
+    }
+  count = ntohl (ris->count);
+  blocks = (const GNUNET_FS_SharedBlock *) &ris[1];
+  filename = (const char *) &blocks[count];
+  if ((count == 0) ||
+      (count >= msize / sizeof (GNUNET_FS_SharedBlock)) ||
+      (msize <= sizeof (CS_fs_request_insert_shared_MESSAGE) +
+       count * sizeof (GNUNET_FS_SharedBlock)) ||
+      (((const char *) req)[msize - 1] != '\0'))
+    {
+      GNUNET_GE_BREAK (ectx, 0);
+      return GNUNET_SYSERR;
+    }
+  GNUNET_mutex_lock (GNUNET_FS_lock);
+  sf = shared_file_get (sock, filename, ris->cookie);
+  GNUNET_mutex_unlock (GNUNET_FS_lock);
+  if (sf == NULL)
+    return GNUNET_SYSERR;
+  max = 0;
+  for (i = 0; i < count; i++)
+    if (ntohl (blocks[i].size) > max)
+      max = ntohl (blocks[i].size);
+  if (max > sf->size)
+    {
+      GNUNET_GE_BREAK (ectx, 0);
+      return GNUNET_SYSERR;
+    }
+  datum = GNUNET_malloc (max);
+  full = GNUNET_NO;
+  for (i = 0; i < count; i++)
+    {
+      ret = shared_file_insert (sf,
+                                ntohl (blocks[i].offset),
+                                ntohl (blocks[i].size), datum);
+      if (ret == GNUNET_SYSERR)
+        {
+          GNUNET_GE_BREAK (ectx, 0);
+          GNUNET_free (datum);
+          return GNUNET_SYSERR;
+        }
+      if (ret == GNUNET_NO)
+        full = GNUNET_YES;
+    }
+  GNUNET_free (datum);
+  if (full == GNUNET_YES)
+    {
+      cectx = coreAPI->cs_log_context_create (sock);
+      GNUNET_GE_LOG (cectx,
+                     GNUNET_GE_ERROR | GNUNET_GE_BULK | GNUNET_GE_USER,
+                     _("Datastore full.\n"));
+      GNUNET_GE_free_context (cectx);
+    }
+  return coreAPI->cs_send_value (sock,
+                                 (full == GNUNET_YES) ? GNUNET_NO : GNUNET_OK);
+}
+
+/**
+ * Close the shared file of a client that disconnected.
+ */
+static void
+handle_client_exit (struct GNUNET_ClientHandle *client)
+{
+  struct SharedFile *sf;
+  struct SharedFile *prev;
+
+  GNUNET_mutex_lock (GNUNET_FS_lock);
+  prev = NULL;
+  sf = shared_files;
+  while ((sf != NULL) && (sf->client != client))
+    {
+      prev = sf;
+      sf = sf->next;
+    }
+  if (sf != NULL)
+    {
+      if (prev == NULL)
+        shared_files = sf->next;
+      else
+        prev->next = sf->next;
+      shared_file_free (sf);
+    }
+  GNUNET_mutex_unlock (GNUNET_FS_lock);
+}
+
 /**
  * Process a request to symlink a file
  */
@@ -471,6 +762,7 @@ handle_cs_query_start_request (struct GNUNET_ClientHandle *sock,
   unsigned int type;
   unsigned int anonymityLevel;
   int have_target;
+  int report_responder;
 #if DEBUG_FS
   GNUNET_EncName enc;
 #endif
@@ -519,6 +811,9 @@ handle_cs_query_start_request (struct GNUNET_ClientHandle *sock,
          sizeof (CS_fs_request_search_MESSAGE)) / sizeof (GNUNET_HashCode);
   have_target =
     memcmp (&all_zeros, &rs->target, sizeof (GNUNET_PeerIdentity)) != 0;
+  report_responder =
+    (0 != (ntohl (rs->reserved) & GNUNET_FS_SEARCH_OPTION_RESPONDER))
+    ? GNUNET_YES : GNUNET_NO;
 #if DEBUG_FS
   GNUNET_GE_LOG (ectx, GNUNET_GE_DEBUG | GNUNET_GE_REQUEST | GNUNET_GE_USER,
                  "in fs, have_target is %d", have_target);
@@ -527,7 +822,8 @@ handle_cs_query_start_request (struct GNUNET_ClientHandle *sock,
   GNUNET_DV_FS_QUERYMANAGER_start_query (&rs->query[0], keyCount,
                                          anonymityLevel, type, sock,
                                          have_target ? &rs->target : NULL,
-                                         fpp.seen, fpp.have_more);
+                                         fpp.seen, fpp.have_more,
+                                         report_responder);
 CLEANUP:
   if (fpp.seen != NULL)
     GNUNET_multi_hash_map_destroy (fpp.seen);
@@ -1035,13 +1331,14 @@ initialize_module_fs (GNUNET_CoreAPIForPlugins * capi)
   GNUNET_FS_MIGRATION_init (coreAPI);
   GNUNET_GE_LOG (ectx, GNUNET_GE_DEBUG | GNUNET_GE_REQUEST | GNUNET_GE_USER,
                  _
-                 ("`%s' registering client handlers %d %d %d %d %d %d %d %d and P2P handlers %d %d\n"),
+                 ("`%s' registering client handlers %d %d %d %d %d %d %d %d %d and P2P handlers %d %d\n"),
                  "fs", GNUNET_CS_PROTO_GAP_QUERY_START,
                  GNUNET_CS_PROTO_GAP_QUERY_STOP,
                  GNUNET_CS_PROTO_GAP_INSERT,
                  GNUNET_CS_PROTO_GAP_INDEX, GNUNET_CS_PROTO_GAP_DELETE,
                  GNUNET_CS_PROTO_GAP_UNINDEX, GNUNET_CS_PROTO_GAP_TESTINDEX,
                  GNUNET_CS_PROTO_GAP_INIT_INDEX,
+                 GNUNET_CS_PROTO_GAP_INSERT_SHARED,
                  GNUNET_P2P_PROTO_GAP_QUERY, GNUNET_P2P_PROTO_GAP_RESULT);
   GNUNET_GE_ASSERT (ectx,
                     GNUNET_SYSERR !=
@@ -1065,6 +1362,15 @@ initialize_module_fs (GNUNET_CoreAPIForPlugins * capi)
                     GNUNET_SYSERR !=
                     coreAPI->cs_handler_register (GNUNET_CS_PROTO_GAP_INSERT,
                                                   &handle_cs_insert_request));
+  GNUNET_GE_ASSERT (ectx,
+                    GNUNET_SYSERR !=
+                    coreAPI->
+                    cs_handler_register (GNUNET_CS_PROTO_GAP_INSERT_SHARED,
+                                         &handle_cs_insert_shared_request));
+  GNUNET_GE_ASSERT (ectx,
+                    GNUNET_SYSERR !=
+                    coreAPI->
+                    cs_disconnect_handler_register (&handle_client_exit));
   GNUNET_GE_ASSERT (ectx,
                     GNUNET_SYSERR !=
                     coreAPI->cs_handler_register (GNUNET_CS_PROTO_GAP_INDEX,
@@ -1101,6 +1407,8 @@ initialize_module_fs (GNUNET_CoreAPIForPlugins * capi)
 void
 done_module_fs ()
 {
+  struct SharedFile *sf;
+
   GNUNET_GE_LOG (ectx, GNUNET_GE_DEBUG | GNUNET_GE_REQUEST | GNUNET_GE_USER,
                  "fs shutdown\n");
 
@@ -1123,6 +1431,21 @@ done_module_fs ()
                     GNUNET_SYSERR !=
                     coreAPI->cs_handler_unregister
                     (GNUNET_CS_PROTO_GAP_INSERT, &handle_cs_insert_request));
+  GNUNET_GE_ASSERT (ectx,
+                    GNUNET_SYSERR !=
+                    coreAPI->cs_handler_unregister
+                    (GNUNET_CS_PROTO_GAP_INSERT_SHARED,
+                     &handle_cs_insert_shared_request));
+  GNUNET_GE_ASSERT (ectx,
+                    GNUNET_SYSERR !=
+                    coreAPI->
+                    cs_disconnect_handler_unregister (&handle_client_exit));
+  while (shared_files != NULL)
+    {
+      sf = shared_files;
+      shared_files = sf->next;
+      shared_file_free (sf);
+    }
   GNUNET_GE_ASSERT (ectx,
                     GNUNET_SYSERR !=
                     coreAPI->cs_handler_unregister (GNUNET_CS_PROTO_GAP_INDEX,
@@ -0,0 +1,430 @@
+/*
+     This file is part of GNUnet.
+     (C) 2026 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 2, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+
+/**
+ * @file applications/gap/perf_mesh.c
+ * @brief benchmark for the core, tbench and GAP with peers on
+ *        one machine that are connected by emulated links
+ * @author Christian Grothoff
+ *
+ * Starts a chain of peers that only talk via the loopback
+ * transport (with the given latency, bandwidth and loss).
+ * Then every peer sends trains of tbench messages to its
+ * successor, and the last peer downloads a file that the
+ * first peer inserted.  We report throughput and percentiles
+ * of the time it took to transmit the trains.
+ */
+
+#include "platform.h"
+#include "gnunet_protocols.h"
+#include "gnunet_ecrs_lib.h"
+#include "gnunet_testing_lib.h"
+#include "gnunet_util.h"
+#include "../../tbench/tbench.h"
+
+#define BASE_PORT 2087
+
+#define PORT_DELTA 10
+
+static unsigned long long peerCount = 4;
+
+static unsigned long long latency = 10;
+
+static unsigned long long bandwidth = 1024 * 1024;
+
+static unsigned long long loss = 0;
+
+static unsigned long long messageSize = 1024;
+
+static unsigned long long messageCnt = 32;
+
+static unsigned long long rounds = 20;
+
+static unsigned long long fileSize = 1024 * 1024;
+
+static unsigned long long timeOut = 2 * GNUNET_CRON_SECONDS;
+
+static char *cfgFilename = "check.conf";
+
+static struct GNUNET_GE_Context *ectx;
+
+static struct GNUNET_GC_Configuration *cfg;
+
+/**
+ * All perf_mesh command line options
+ */
+static struct GNUNET_CommandLineOption perfOptions[] = {
+  {'b', "bandwidth", "BYTES",
+   gettext_noop ("uplink bandwidth of each peer in bytes per second"), 1,
+   &GNUNET_getopt_configure_set_ulong, &bandwidth},
+  GNUNET_COMMAND_LINE_OPTION_CFG_FILE (&cfgFilename),   /* -c */
+  {'f', "file", "SIZE",
+   gettext_noop ("size of the file to download (0 to skip)"), 1,
+   &GNUNET_getopt_configure_set_ulong, &fileSize},
+  GNUNET_COMMAND_LINE_OPTION_HELP (gettext_noop ("Benchmark peers connected by emulated links.")),      /* -h */
+  {'l', "latency", "MS",
+   gettext_noop ("one-way latency of each link in ms"), 1,
+   &GNUNET_getopt_configure_set_ulong, &latency},
+  {'n', "msg", "MESSAGES",
+   gettext_noop ("number of messages per train"), 1,
+   &GNUNET_getopt_configure_set_ulong, &messageCnt},
+  {'p', "peers", "PEERS",
+   gettext_noop ("number of peers"), 1,
+   &GNUNET_getopt_configure_set_ulong, &peerCount},
+  {'r', "rounds", "ROUNDS",
+   gettext_noop ("number of trains per link"), 1,
+   &GNUNET_getopt_configure_set_ulong, &rounds},
+  {'s', "size", "SIZE",
+   gettext_noop ("message size"), 1,
+   &GNUNET_getopt_configure_set_ulong, &messageSize},
+  {'t', "timeout", "TIMEOUT",
+   gettext_noop ("time to wait for the completion of a train (in ms)"), 1,
+   &GNUNET_getopt_configure_set_ulong, &timeOut},
+  {'x', "loss", "PERMILLE",
+   gettext_noop ("datagrams lost per thousand"), 1,
+   &GNUNET_getopt_configure_set_ulong, &loss},
+  GNUNET_COMMAND_LINE_OPTION_END,
+};
+
+static int
+testTerminate (void *unused)
+{
+  return GNUNET_OK;
+}
+
+static char *
+makeName (unsigned int i)
+{
+  char *fn;
+
+  fn = GNUNET_malloc (strlen ("/tmp/gnunet-perf-mesh/FILE") + 14);
+  GNUNET_snprintf (fn,
+                   strlen ("/tmp/gnunet-perf-mesh/FILE") + 14,
+                   "/tmp/gnunet-perf-mesh/FILE%u", i);
+  GNUNET_disk_directory_create_for_file (NULL, fn);
+  return fn;
+}
+
+static void
+setHost (unsigned int peer)
+{
+  char buf[128];
+
+  GNUNET_snprintf (buf, 128, "localhost:%u", BASE_PORT + PORT_DELTA * peer);
+  GNUNET_GC_set_configuration_value_string (cfg, ectx, "NETWORK", "HOST",
+                                            buf);
+}
+
+static int
+compareTimes (const void *a, const void *b)
+{
+  const GNUNET_CronTime *ta = a;
+  const GNUNET_CronTime *tb = b;
+
+  if (*ta < *tb)
+    return -1;
+  if (*ta > *tb)
+    return 1;
+  return 0;
+}
+
+/**
+ * Get the given percentile of the sorted samples.
+ */
+static GNUNET_CronTime
+percentile (const GNUNET_CronTime * samples, unsigned int count,
+            unsigned int pct)
+{
+  if (count == 0)
+    return 0;
+  return samples[(count - 1) * pct / 100];
+}
+
+/**
+ * Send one train of tbench messages from the peer that sock is
+ * connected to to the given receiver.
+ *
+ * @param time set to the time the train took
+ * @param lost set to the number of messages that were lost
+ * @return GNUNET_OK on success
+ */
+static int
+sendTrain (struct GNUNET_ClientServerConnection *sock,
+           const GNUNET_PeerIdentity * receiver,
+           GNUNET_CronTime * time, unsigned int *lost)
+{
+  CS_tbench_request_MESSAGE msg;
+  CS_tbench_reply_MESSAGE *reply;
+
+  msg.header.size = htons (sizeof (CS_tbench_request_MESSAGE));
+  msg.header.type = htons (GNUNET_CS_PROTO_TBENCH_REQUEST);
+  msg.msgSize = htonl (messageSize);
+  msg.msgCnt = htonl (messageCnt);
+  msg.iterations = htonl (1);
+  msg.intPktSpace = GNUNET_htonll (0);
+  msg.trainSize = htonl (messageCnt);
+  msg.timeOut = GNUNET_htonll (timeOut);
+  msg.priority = htonl (5);
+  msg.receiverId = *receiver;
+  if (GNUNET_SYSERR == GNUNET_client_connection_write (sock, &msg.header))
+    return GNUNET_SYSERR;
+  reply = NULL;
+  if (GNUNET_OK !=
+      GNUNET_client_connection_read (sock, (GNUNET_MessageHeader **) & reply))
+    return GNUNET_SYSERR;
+  *time = GNUNET_ntohll (reply->max_time);
+  *lost = ntohl (reply->max_loss);
+  GNUNET_free (reply);
+  return GNUNET_OK;
+}
+
+/**
+ * tbench workload: each peer sends "rounds" trains to its
+ * successor in the chain.
+ */
+static int
+runTBench (const GNUNET_PeerIdentity * ids)
+{
+  struct GNUNET_ClientServerConnection *sock;
+  GNUNET_CronTime *samples;
+  GNUNET_CronTime total;
+  GNUNET_CronTime start;
+  GNUNET_CronTime wall;
+  unsigned long long received;
+  unsigned long long lost;
+  unsigned int count;
+  unsigned int dropped;
+  unsigned int i;
+  unsigned int r;
+
+  samples = GNUNET_malloc (sizeof (GNUNET_CronTime) * rounds * peerCount);
+  count = 0;
+  total = 0;
+  received = 0;
+  lost = 0;
+  start = GNUNET_get_time ();
+  for (i = 0; i + 1 < peerCount; i++)
+    {
+      setHost (i);
+      sock = GNUNET_client_connection_create (ectx, cfg);
+      for (r = 0; r < rounds; r++)
+        {
+          if ((GNUNET_shutdown_test () == GNUNET_YES) ||
+              (GNUNET_OK !=
+               sendTrain (sock, &ids[i + 1], &samples[count], &dropped)))
+            break;
+          total += samples[count];
+          received += (messageCnt - dropped) * messageSize;
+          lost += dropped;
+          count++;
+        }
+      GNUNET_client_connection_destroy (sock);
+    }
+  wall = GNUNET_get_time () - start;
+  if (count == 0)
+    {
+      GNUNET_free (samples);
+      fprintf (stderr, "tbench failed!\n");
+      return GNUNET_SYSERR;
+    }
+  qsort (samples, count, sizeof (GNUNET_CronTime), &compareTimes);
+  printf ("tbench: %u trains of %llu x %llu bytes in %llu ms\n",
+          count, messageCnt, messageSize, wall);
+  printf ("tbench: throughput %llu kB/s, loss %.2f%%\n",
+          received * GNUNET_CRON_SECONDS / 1024 / (total + 1),
+          100.0 * lost / (count * messageCnt));
+  printf ("tbench: train time (ms) p50 %llu p90 %llu p99 %llu max %llu\n",
+          percentile (samples, count, 50),
+          percentile (samples, count, 90),
+          percentile (samples, count, 99), samples[count - 1]);
+  GNUNET_free (samples);
+  return GNUNET_OK;
+}
+
+static struct GNUNET_ECRS_URI *
+uploadFile (unsigned int size)
+{
+  int ret;
+  char *name;
+  int fd;
+  char *buf;
+  struct GNUNET_ECRS_URI *uri;
+  int i;
+
+  name = makeName (size);
+  fd =
+    GNUNET_disk_file_open (ectx, name, O_WRONLY | O_CREAT, S_IWUSR | S_IRUSR);
+  if (fd == -1)
+    {
+      GNUNET_free (name);
+      return NULL;
+    }
+  buf = GNUNET_malloc (size);
+  memset (buf, size / 253, sizeof (GNUNET_HashCode));
+  for (i = 0; i < size - sizeof (GNUNET_HashCode);
+       i += sizeof (GNUNET_HashCode))
+    GNUNET_hash (&buf[i], sizeof (GNUNET_HashCode),
+                 (GNUNET_HashCode *) & buf[i + sizeof (GNUNET_HashCode)]);
+  WRITE (fd, buf, size);
+  GNUNET_free (buf);
+  GNUNET_disk_file_close (ectx, name, fd);
+  ret = GNUNET_ECRS_file_upload (ectx, cfg, name, GNUNET_YES,   /* index */
+                                 1,     /* anon */
+                                 0,     /* priority */
+                                 GNUNET_get_time () + 100 * GNUNET_CRON_MINUTES,        /* expire */
+                                 NULL, NULL, &testTerminate, NULL, &uri);
+  GNUNET_free (name);
+  if (ret == GNUNET_SYSERR)
+    return NULL;
+  return uri;
+}
+
+static int
+downloadFile (const struct GNUNET_ECRS_URI *uri)
+{
+  char *tmpName;
+  int ret;
+
+  tmpName = makeName (0);
+  UNLINK (tmpName);
+  ret = GNUNET_ECRS_file_download (ectx,
+                                   cfg,
+                                   uri,
+                                   tmpName,
+                                   1, NULL, NULL, &testTerminate, NULL);
+  UNLINK (tmpName);
+  GNUNET_free (tmpName);
+  return ret;
+}
+
+/**
+ * GAP workload: the first peer inserts a file, the last
+ * peer downloads it (routed along the chain).
+ */
+static int
+runGap ()
+{
+  struct GNUNET_ECRS_URI *uri;
+  GNUNET_CronTime start;
+  GNUNET_CronTime delay;
+  char *name;
+  int ret;
+
+  setHost (0);
+  uri = uploadFile (fileSize);
+  if (uri == NULL)
+    {
+      fprintf (stderr, "Upload failed!\n");
+      return GNUNET_SYSERR;
+    }
+  setHost (peerCount - 1);
+  start = GNUNET_get_time ();
+  ret = downloadFile (uri);
+  delay = GNUNET_get_time () - start;
+  GNUNET_ECRS_uri_destroy (uri);
+  if (ret == GNUNET_OK)
+    printf ("gap: %llu bytes over %llu hops in %llu ms (%llu kB/s)\n",
+            fileSize, peerCount - 1, delay,
+            fileSize * GNUNET_CRON_SECONDS / 1024 / (delay + 1));
+  else
+    fprintf (stderr, "Download failed!\n");
+  setHost (0);
+  name = makeName (fileSize);
+  if (GNUNET_OK !=
+      GNUNET_ECRS_file_unindex (ectx, cfg, name, NULL, NULL, &testTerminate,
+                                NULL))
+    ret = GNUNET_SYSERR;
+  UNLINK (name);
+  GNUNET_free (name);
+  return ret;
+}
+
+/**
+ * Benchmark peers connected by emulated links.
+ *
+ * @return 0: ok, -1: error
+ */
+int
+main (int argc, char *const *argv)
+{
+  struct GNUNET_TESTING_DaemonContext *peers;
+  struct GNUNET_TESTING_DaemonContext *pos;
+  GNUNET_PeerIdentity *ids;
+  char buf[32];
+  int ret;
+  int i;
+
+  if (-1 == GNUNET_init (argc,
+                         argv,
+                         "perf_mesh", &cfgFilename, perfOptions, &ectx, &cfg))
+    {
+      GNUNET_fini (ectx, cfg);
+      return -1;
+    }
+  if (peerCount < 2)
+    peerCount = 2;
+  GNUNET_snprintf (buf, sizeof (buf), "%llu", latency);
+  GNUNET_TESTING_set_daemon_option ("LOOPBACK", "LATENCY", buf);
+  GNUNET_snprintf (buf, sizeof (buf), "%llu", bandwidth);
+  GNUNET_TESTING_set_daemon_option ("LOOPBACK", "BANDWIDTH", buf);
+  GNUNET_snprintf (buf, sizeof (buf), "%llu", loss);
+  GNUNET_TESTING_set_daemon_option ("LOOPBACK", "LOSS", buf);
+  /* the emulated links are the bottleneck, not the traffic limits */
+  GNUNET_TESTING_set_daemon_option ("LOAD", "MAXNETUPBPSTOTAL", "1000000000");
+  GNUNET_TESTING_set_daemon_option ("LOAD", "MAXNETDOWNBPSTOTAL",
+                                    "1000000000");
+  printf ("%llu peers, latency %llu ms, bandwidth %llu bytes/s, loss %llu/1000\n",
+          peerCount, latency, bandwidth, loss);
+  peers = GNUNET_TESTING_start_daemons ("loopback",
+                                        "advertising topology fs stats tbench",
+                                        "/tmp/gnunet-perf-mesh",
+                                        BASE_PORT, PORT_DELTA, peerCount);
+  if (peers == NULL)
+    {
+      fprintf (stderr, "Failed to start the gnunetd daemons!\n");
+      GNUNET_fini (ectx, cfg);
+      return -1;
+    }
+  ids = GNUNET_malloc (sizeof (GNUNET_PeerIdentity) * peerCount);
+  for (pos = peers; pos != NULL; pos = pos->next)
+    ids[(pos->port - BASE_PORT) / PORT_DELTA] = pos->peer;
+  ret = 0;
+  for (i = 1; i < peerCount; i++)
+    {
+      if (GNUNET_OK !=
+          GNUNET_TESTING_connect_daemons (BASE_PORT + PORT_DELTA * (i - 1),
+                                          BASE_PORT + PORT_DELTA * i))
+        {
+          fprintf (stderr, "Failed to connect the peers!\n");
+          ret = -1;
+          break;
+        }
+    }
+  if ((ret == 0) && (GNUNET_OK != runTBench (ids)))
+    ret = -1;
+  if ((ret == 0) && (fileSize > 0) && (GNUNET_OK != runGap ()))
+    ret = -1;
+  GNUNET_free (ids);
+  GNUNET_TESTING_stop_daemons (peers);
+  GNUNET_fini (ectx, cfg);
+  return ret;
+}
+
+/* end of perf_mesh.c */
@@ -213,7 +213,7 @@ GNUNET_DV_FS_QUERYMANAGER_start_query (const GNUNET_HashCode * query,
                                        struct GNUNET_ClientHandle *client,
                                        const GNUNET_PeerIdentity * target,
                                        const struct GNUNET_MultiHashMap *seen,
-                                       int have_more)
+                                       int have_more, int report_responder)
 {
   struct ClientDataList *cl;
   struct RequestList *request;
@@ -231,6 +231,7 @@ GNUNET_DV_FS_QUERYMANAGER_start_query (const GNUNET_HashCode * query,
   request->anonymityLevel = anonymityLevel;
   request->key_count = key_count;
   request->type = type;
+  request->report_responder = report_responder;
   request->primary_target = GNUNET_FS_PT_intern (target);
   request->response_client = client;
   request->policy = GNUNET_FS_RoutingPolicy_ALL;
@@ -427,6 +428,8 @@ handle_response (PID_INDEX sender,
 {
   struct IteratorClosure ic;
   CS_fs_reply_content_MESSAGE *msg;
+  CS_fs_reply_content_from_MESSAGE *fmsg;
+  GNUNET_MessageHeader *hdr;
   GNUNET_HashCode hc;
   int ret;
   unsigned int bf_size;
@@ -440,17 +443,33 @@ handle_response (PID_INDEX sender,
   if (sender == 0)              /* dht produced response */
     rl->dht_back_off = GNUNET_GAP_MAX_DHT_DELAY;        /* go back! */
   /* send to client */
-  msg = GNUNET_malloc (sizeof (CS_fs_reply_content_MESSAGE) + size);
-  msg->header.size = htons (sizeof (CS_fs_reply_content_MESSAGE) + size);
-  msg->header.type = htons (GNUNET_CS_PROTO_GAP_RESULT);
-  msg->anonymity_level = htonl (0);     /* unknown */
-  msg->expiration_time = GNUNET_htonll (expirationTime);
-  memcpy (&msg[1], data, size);
+  if ((sender != 0) && (rl->report_responder == GNUNET_YES))
+    {
+      fmsg = GNUNET_malloc (sizeof (CS_fs_reply_content_from_MESSAGE) + size);
+      fmsg->header.size =
+        htons (sizeof (CS_fs_reply_content_from_MESSAGE) + size);
+      fmsg->header.type = htons (GNUNET_CS_PROTO_GAP_RESULT_FROM);
+      fmsg->anonymity_level = htonl (0);        /* unknown */
+      fmsg->expiration_time = GNUNET_htonll (expirationTime);
+      GNUNET_FS_PT_resolve (sender, &fmsg->responder);
+      memcpy (&fmsg[1], data, size);
+      hdr = &fmsg->header;
+    }
+  else
+    {
+      msg = GNUNET_malloc (sizeof (CS_fs_reply_content_MESSAGE) + size);
+      msg->header.size = htons (sizeof (CS_fs_reply_content_MESSAGE) + size);
+      msg->header.type = htons (GNUNET_CS_PROTO_GAP_RESULT);
+      msg->anonymity_level = htonl (0);         /* unknown */
+      msg->expiration_time = GNUNET_htonll (expirationTime);
+      memcpy (&msg[1], data, size);
+      hdr = &msg->header;
+    }
   ret = coreAPI->cs_send_message (client,
-                                  &msg->header,
+                                  hdr,
                                   (rl->type != GNUNET_ECRS_BLOCKTYPE_DATA)
                                   ? GNUNET_NO : GNUNET_YES);
-  GNUNET_free (msg);
+  GNUNET_free (hdr);
   if (ret != GNUNET_OK)
     return GNUNET_NO;
   if (stats != NULL)
@@ -812,9 +831,10 @@ GNUNET_DV_FS_QUERYMANAGER_init (GNUNET_CoreAPIForPlugins * capi)
       stat_gap_dv_sends =
         stats->create (gettext_noop ("# dv gap requests sent"));
     }
-  GNUNET_cron_add_job (coreAPI->cron,
-                       &repeat_requests_job,
-                       CHECK_REPEAT_FREQUENCY, CHECK_REPEAT_FREQUENCY, NULL);
+  GNUNET_cron_add_parallel_job (coreAPI->cron,
+                                &repeat_requests_job,
+                                CHECK_REPEAT_FREQUENCY,
+                                CHECK_REPEAT_FREQUENCY, NULL);
   return 0;
 }
 
@@ -43,6 +43,8 @@ int GNUNET_DV_FS_QUERYMANAGER_done (void);
  *
  * @param target peer known to have the content, maybe NULL.
  * @param have_more do we have more results in our local datastore?
+ * @param report_responder should responses from other peers
+ *        say which peer sent them (GNUNET_CS_PROTO_GAP_RESULT_FROM)?
  */
 void
 GNUNET_DV_FS_QUERYMANAGER_start_query (const GNUNET_HashCode * query,
@@ -52,7 +54,7 @@ GNUNET_DV_FS_QUERYMANAGER_start_query (const GNUNET_HashCode * query,
                                        struct GNUNET_ClientHandle *client,
                                        const GNUNET_PeerIdentity * target,
                                        const struct GNUNET_MultiHashMap *seen,
-                                       int have_more);
+                                       int have_more, int report_responder);
 
 /**
  * A client is asking us to stop running a query (without disconnect).
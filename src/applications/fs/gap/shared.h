@@ -127,6 +127,12 @@ struct RequestList
    */
   unsigned int type;
 
+  /**
+   * Does the client want to learn which peer sent us a response
+   * (GNUNET_YES or GNUNET_NO)?
+   */
+  int report_responder;
+
   /**
    * If there is no peer that is suspected to have the result,
    * the PID_INDEX will be zero.
@@ -40,6 +40,62 @@
  */
 #define AUTO_RETRY 5
 
+/**
+ * Size of the file shared with gnunetd for inserts.
+ */
+#define SHARED_RING_SIZE (1024 * 1024)
+
+/**
+ * How many blocks do we pass to gnunetd in one request?
+ */
+#define SHARED_BATCH_SIZE 32
+
+/**
+ * File shared with gnunetd for inserts.  Blocks are
+ * written one after the other (8-byte aligned) and passed
+ * to gnunetd in batches.  Before we wrap around at the end
+ * of the file, the pending batch is flushed (and gnunetd has
+ * read all earlier blocks once it replied).
+ */
+struct GNUNET_FS_SharedRing
+{
+  struct GNUNET_GE_Context *ectx;
+
+  char *filename;
+
+  /**
+   * The mapped file (starts with a GNUNET_FS_SharedHeader).
+   */
+  char *map;
+
+  /**
+   * Where do we write the next block?
+   */
+  unsigned int pos;
+
+  /**
+   * Cookie from the header (network byte order).
+   */
+  unsigned int cookie;
+
+  /**
+   * Set to GNUNET_YES once gnunetd refused to
+   * use the file.
+   */
+  int disabled;
+
+  /**
+   * Blocks in the file that were not yet passed to gnunetd
+   * (offset and size in network byte order).
+   */
+  GNUNET_FS_SharedBlock pending[SHARED_BATCH_SIZE];
+
+  /**
+   * Number of entries in pending.
+   */
+  unsigned int pending_count;
+};
+
 /**
  * In memory, the search handle is followed
  * by a copy of the corresponding request of
@@ -98,6 +154,12 @@ struct GNUNET_FS_SearchContext
    */
   struct GNUNET_FS_SearchHandle *handles;
 
+  /**
+   * Peer that produced the result that is currently
+   * being passed to the callbacks.
+   */
+  GNUNET_PeerIdentity responder;
+
   /**
    * Flag to signal that we should abort.
    */
@@ -152,6 +214,11 @@ reply_process_thread (void *cls)
   GNUNET_MessageHeader *hdr;
   int matched;
   const CS_fs_reply_content_MESSAGE *rep;
+  const CS_fs_reply_content_from_MESSAGE *frep;
+  const GNUNET_EC_DBlock *data;
+  GNUNET_PeerIdentity responder;
+  GNUNET_CronTime expiration_time;
+  unsigned int anonymity_level;
   GNUNET_HashCode query;
   unsigned int size;
   GNUNET_CronTime delay;
@@ -175,16 +242,34 @@ reply_process_thread (void *cls)
           /* verify hdr, if reply, process, otherwise
              signal protocol problem; if ok, find
              matching callback, call on value */
-          if ((ntohs (hdr->size) < sizeof (CS_fs_reply_content_MESSAGE)) ||
-              (ntohs (hdr->type) != GNUNET_CS_PROTO_GAP_RESULT))
+          if ((ntohs (hdr->type) == GNUNET_CS_PROTO_GAP_RESULT_FROM) &&
+              (ntohs (hdr->size) >= sizeof (CS_fs_reply_content_from_MESSAGE)))
+            {
+              frep = (const CS_fs_reply_content_from_MESSAGE *) hdr;
+              anonymity_level = frep->anonymity_level;
+              expiration_time = frep->expiration_time;
+              responder = frep->responder;
+              data = (const GNUNET_EC_DBlock *) &frep[1];
+              size =
+                ntohs (hdr->size) - sizeof (CS_fs_reply_content_from_MESSAGE);
+            }
+          else if ((ntohs (hdr->type) == GNUNET_CS_PROTO_GAP_RESULT) &&
+                   (ntohs (hdr->size) >= sizeof (CS_fs_reply_content_MESSAGE)))
+            {
+              rep = (const CS_fs_reply_content_MESSAGE *) hdr;
+              anonymity_level = rep->anonymity_level;
+              expiration_time = rep->expiration_time;
+              memset (&responder, 0, sizeof (GNUNET_PeerIdentity));
+              data = (const GNUNET_EC_DBlock *) &rep[1];
+              size = ntohs (hdr->size) - sizeof (CS_fs_reply_content_MESSAGE);
+            }
+          else
             {
               GNUNET_GE_BREAK (ctx->ectx, 0);
               GNUNET_free (hdr);
               continue;
             }
-          rep = (const CS_fs_reply_content_MESSAGE *) hdr;
-          size = ntohs (hdr->size) - sizeof (CS_fs_reply_content_MESSAGE);
-          if (GNUNET_OK != GNUNET_EC_file_block_check_and_get_query (size, (GNUNET_EC_DBlock *) & rep[1], GNUNET_NO,    /* gnunetd will have checked already */
+          if (GNUNET_OK != GNUNET_EC_file_block_check_and_get_query (size, data, GNUNET_NO,    /* gnunetd will have checked already */
                                                                      &query))
             {
               GNUNET_GE_BREAK (ctx->ectx, 0);
@@ -192,18 +277,16 @@ reply_process_thread (void *cls)
               continue;
             }
           unique =
-            GNUNET_EC_file_block_get_type (size,
-                                           (GNUNET_EC_DBlock *) & rep[1]) ==
+            GNUNET_EC_file_block_get_type (size, data) ==
             GNUNET_ECRS_BLOCKTYPE_DATA;
           value = GNUNET_malloc (sizeof (GNUNET_DatastoreValue) + size);
           value->size = htonl (size + sizeof (GNUNET_DatastoreValue));
           value->type =
-            htonl (GNUNET_EC_file_block_get_type
-                   (size, (GNUNET_EC_DBlock *) & rep[1]));
+            htonl (GNUNET_EC_file_block_get_type (size, data));
           value->priority = htonl (0);
-          value->anonymity_level = rep->anonymity_level;
-          value->expiration_time = rep->expiration_time;
-          memcpy (&value[1], &rep[1], size);
+          value->anonymity_level = anonymity_level;
+          value->expiration_time = expiration_time;
+          memcpy (&value[1], data, size);
           matched = 0;
           GNUNET_mutex_lock (ctx->lock);
           while (ctx->block_results > 0)
@@ -212,6 +295,7 @@ reply_process_thread (void *cls)
               GNUNET_thread_sleep (100 * GNUNET_CRON_MILLISECONDS);
               GNUNET_mutex_lock (ctx->lock);
             }
+          ctx->responder = responder;
           prev = NULL;
           pos = ctx->handles;
           while (pos != NULL)
@@ -399,6 +483,7 @@ GNUNET_FS_start_search (struct GNUNET_FS_SearchContext *ctx,
     htons (sizeof (CS_fs_request_search_MESSAGE) +
            (keyCount - 1) * sizeof (GNUNET_HashCode));
   req->header.type = htons (GNUNET_CS_PROTO_GAP_QUERY_START);
+  req->reserved = htonl (GNUNET_FS_SEARCH_OPTION_RESPONDER);
   req->anonymity_level = htonl (anonymityLevel);
   req->type = htonl (type);
   if (target != NULL)
@@ -468,6 +553,18 @@ GNUNET_FS_stop_search (struct
   return GNUNET_SYSERR;
 }
 
+/**
+ * Obtain the identity of the peer that produced the
+ * result that is currently being passed to a callback.
+ */
+void
+GNUNET_FS_get_current_responder (struct GNUNET_FS_SearchContext *ctx,
+                                 GNUNET_PeerIdentity * peer)
+{
+  GNUNET_mutex_lock (ctx->lock);
+  *peer = ctx->responder;
+  GNUNET_mutex_unlock (ctx->lock);
+}
 
 /**
  * Insert a block.
@@ -517,6 +614,195 @@ GNUNET_FS_insert (struct GNUNET_ClientServerConnection *sock,
   return ret;
 }
 
+/**
+ * Create a shared file for inserts.
+ *
+ * @return NULL on error (use GNUNET_FS_insert in that case)
+ */
+struct GNUNET_FS_SharedRing *
+GNUNET_FS_shared_ring_create (struct GNUNET_GE_Context *ectx)
+{
+  struct GNUNET_FS_SharedRing *ring;
+  GNUNET_FS_SharedHeader *hdr;
+  char *fn;
+  void *map;
+  int fd;
+
+  /* not in TMPDIR: gnunetd only accepts files matching
+     the template */
+  fn = GNUNET_strdup (GNUNET_FS_SHARED_TEMPLATE);
+  fd = mkstemp (fn);
+  if (fd == -1)
+    {
+      GNUNET_GE_LOG_STRERROR_FILE (ectx,
+                                   GNUNET_GE_WARNING | GNUNET_GE_USER |
+                                   GNUNET_GE_BULK, "mkstemp", fn);
+      GNUNET_free (fn);
+      return NULL;
+    }
+  map = MAP_FAILED;
+  if (0 == FTRUNCATE (fd, SHARED_RING_SIZE))
+    map = MMAP (NULL, SHARED_RING_SIZE, PROT_READ | PROT_WRITE,
+                MAP_SHARED, fd, 0);
+  CLOSE (fd);
+  if (map == MAP_FAILED)
+    {
+      GNUNET_GE_LOG_STRERROR_FILE (ectx,
+                                   GNUNET_GE_WARNING | GNUNET_GE_USER |
+                                   GNUNET_GE_BULK, "mmap", fn);
+      UNLINK (fn);
+      GNUNET_free (fn);
+      return NULL;
+    }
+  ring = GNUNET_malloc (sizeof (struct GNUNET_FS_SharedRing));
+  ring->ectx = ectx;
+  ring->filename = fn;
+  ring->map = map;
+  ring->pos = sizeof (GNUNET_FS_SharedHeader);
+  ring->cookie = htonl (GNUNET_random_u32 (GNUNET_RANDOM_QUALITY_WEAK,
+                                           0xFFFFFFFF));
+  ring->disabled = GNUNET_NO;
+  ring->pending_count = 0;
+  hdr = map;
+  hdr->magic = htonl (GNUNET_FS_SHARED_MAGIC);
+  hdr->cookie = ring->cookie;
+  hdr->size = htonl (SHARED_RING_SIZE);
+  hdr->reserved = 0;
+  return ring;
+}
+
+/**
+ * Destroy a shared file for inserts.  Blocks that were
+ * not flushed are discarded.
+ */
+void
+GNUNET_FS_shared_ring_destroy (struct GNUNET_FS_SharedRing *ring)
+{
+  MUNMAP (ring->map, SHARED_RING_SIZE);
+  if (0 != UNLINK (ring->filename))
+    GNUNET_GE_LOG_STRERROR_FILE (ring->ectx,
+                                 GNUNET_GE_WARNING | GNUNET_GE_USER |
+                                 GNUNET_GE_BULK, "unlink", ring->filename);
+  GNUNET_free (ring->filename);
+  GNUNET_free (ring);
+}
+
+/**
+ * Pass the pending blocks of the shared file to gnunetd.
+ *
+ * @param ring the shared file, NULL for none
+ * @return GNUNET_OK on success, GNUNET_SYSERR on error, GNUNET_NO on transient error
+ */
+int
+GNUNET_FS_shared_ring_flush (struct GNUNET_ClientServerConnection *sock,
+                             struct GNUNET_FS_SharedRing *ring)
+{
+  CS_fs_request_insert_shared_MESSAGE *ris;
+  unsigned int count;
+  unsigned int nlen;
+  unsigned int size;
+  unsigned int i;
+  int ret;
+  int res;
+  int retry;
+
+  if ((ring == NULL) || (ring->pending_count == 0))
+    return GNUNET_OK;
+  count = ring->pending_count;
+  ring->pending_count = 0;
+  nlen = strlen (ring->filename) + 1;
+  size = sizeof (CS_fs_request_insert_shared_MESSAGE) +
+    count * sizeof (GNUNET_FS_SharedBlock) + nlen;
+  ris = GNUNET_malloc (size);
+  ris->header.size = htons (size);
+  ris->header.type = htons (GNUNET_CS_PROTO_GAP_INSERT_SHARED);
+  ris->cookie = ring->cookie;
+  ris->count = htonl (count);
+  memcpy (&ris[1], ring->pending, count * sizeof (GNUNET_FS_SharedBlock));
+  memcpy (&((GNUNET_FS_SharedBlock *) & ris[1])[count], ring->filename, nlen);
+  retry = AUTO_RETRY;
+  do
+    {
+      if (GNUNET_OK != GNUNET_client_connection_write (sock, &ris->header))
+        {
+          GNUNET_free (ris);
+          return GNUNET_SYSERR;
+        }
+      if (GNUNET_OK != GNUNET_client_connection_read_result (sock, &ret))
+        {
+          /* gnunetd closed the connection: it cannot use the
+             file (other machine, older version); use the socket */
+          GNUNET_GE_LOG (ring->ectx,
+                         GNUNET_GE_INFO | GNUNET_GE_USER | GNUNET_GE_BULK,
+                         _("gnunetd cannot use `%s', sending content over the socket.\n"),
+                         ring->filename);
+          ring->disabled = GNUNET_YES;
+          ret = GNUNET_OK;
+          for (i = 0; i < count; i++)
+            {
+              res = GNUNET_FS_insert (sock,
+                                      (const GNUNET_DatastoreValue *)
+                                      &ring->map[ntohl (ring->pending[i].
+                                                        offset)]);
+              if ((res == GNUNET_SYSERR) || (ret == GNUNET_OK))
+                ret = res;
+            }
+          GNUNET_free (ris);
+          return ret;
+        }
+    }
+  while ((ret == GNUNET_NO) && (retry-- > 0));
+  GNUNET_free (ris);
+  return ret;
+}
+
+/**
+ * Insert a block via the shared file.
+ *
+ * @param ring the shared file, NULL to always use the socket
+ * @param block the block (properly encoded and all)
+ * @return GNUNET_OK on success, GNUNET_SYSERR on error, GNUNET_NO on transient error
+ */
+int
+GNUNET_FS_insert_shared (struct GNUNET_ClientServerConnection *sock,
+                         struct GNUNET_FS_SharedRing *ring,
+                         const GNUNET_DatastoreValue * block)
+{
+  unsigned int size;
+  unsigned int off;
+  int ret;
+
+  if (ring == NULL)
+    return GNUNET_FS_insert (sock, block);
+  size = ntohl (block->size);
+  if (size <= sizeof (GNUNET_DatastoreValue))
+    {
+      GNUNET_GE_BREAK (NULL, 0);
+      return GNUNET_SYSERR;
+    }
+  off = ring->pos;
+  if ((ring->disabled == GNUNET_YES) ||
+      (size > SHARED_RING_SIZE - sizeof (GNUNET_FS_SharedHeader)) ||
+      (off + size > SHARED_RING_SIZE) ||
+      (ring->pending_count == SHARED_BATCH_SIZE))
+    {
+      ret = GNUNET_FS_shared_ring_flush (sock, ring);
+      if (ret != GNUNET_OK)
+        return ret;
+      if ((ring->disabled == GNUNET_YES) ||
+          (size > SHARED_RING_SIZE - sizeof (GNUNET_FS_SharedHeader)))
+        return GNUNET_FS_insert (sock, block);
+      if (off + size > SHARED_RING_SIZE)
+        off = sizeof (GNUNET_FS_SharedHeader);
+    }
+  memcpy (&ring->map[off], block, size);
+  ring->pending[ring->pending_count].offset = htonl (off);
+  ring->pending[ring->pending_count].size = htonl (size);
+  ring->pending_count++;
+  ring->pos = off + ((size + 7) & ~7);
+  return GNUNET_OK;
+}
+
 /**
  * Initialize to index a file
  */
@@ -214,6 +214,7 @@ main (int argc, char *argv[])
   int ok;
   struct GNUNET_FS_SearchContext *ctx = NULL;
   struct GNUNET_ClientServerConnection *sock;
+  struct GNUNET_FS_SharedRing *ring = NULL;
   GNUNET_DatastoreValue *block = NULL;
   GNUNET_DatastoreValue *eblock;
   GNUNET_HashCode hc;
@@ -322,6 +323,48 @@ main (int argc, char *argv[])
       block = NULL;
     }
   fprintf (stderr, "\n");
+  /* inserts via a file shared with gnunetd (in one batch) */
+  ring = GNUNET_FS_shared_ring_create (NULL);
+  CHECK (ring != NULL);
+  for (i = 32; i < GNUNET_MAX_BUFFER_SIZE; i *= 2)
+    {
+      fprintf (stderr, ".");
+      block = makeBlock (i);
+      GNUNET_EC_file_block_get_query ((GNUNET_EC_DBlock *) & block[1],
+                                      ntohl (block->size) -
+                                      sizeof (GNUNET_DatastoreValue), &query);
+      CHECK (GNUNET_OK ==
+             GNUNET_EC_file_block_encode ((GNUNET_EC_DBlock *) & block[1],
+                                          ntohl (block->size) -
+                                          sizeof (GNUNET_DatastoreValue),
+                                          &query, &eblock));
+      eblock->expiration_time = block->expiration_time;
+      eblock->priority = block->priority;
+      CHECK (GNUNET_OK == GNUNET_FS_insert_shared (sock, ring, eblock));
+      GNUNET_free (eblock);
+      GNUNET_free (block);
+      block = NULL;
+    }
+  CHECK (GNUNET_OK == GNUNET_FS_shared_ring_flush (sock, ring));
+  for (i = 32; i < GNUNET_MAX_BUFFER_SIZE; i *= 2)
+    {
+      fprintf (stderr, ".");
+      block = makeBlock (i);
+      GNUNET_EC_file_block_get_query ((GNUNET_EC_DBlock *) & block[1],
+                                      ntohl (block->size) -
+                                      sizeof (GNUNET_DatastoreValue), &query);
+      CHECK (GNUNET_OK ==
+             GNUNET_EC_file_block_encode ((GNUNET_EC_DBlock *) & block[1],
+                                          ntohl (block->size) -
+                                          sizeof (GNUNET_DatastoreValue),
+                                          &query, &eblock));
+      CHECK (GNUNET_OK == trySearch (i));
+      CHECK (1 == GNUNET_FS_delete (sock, eblock));
+      GNUNET_free (eblock);
+      GNUNET_free (block);
+      block = NULL;
+    }
+  fprintf (stderr, "\n");
 
   /* multiple search results test */
   GNUNET_create_random_hash (&hc);
@@ -349,6 +392,8 @@ main (int argc, char *argv[])
 
 FAILURE:
   fprintf (stderr, "\n");
+  if (ring != NULL)
+    GNUNET_FS_shared_ring_destroy (ring);
   if (sock != NULL)
     GNUNET_client_connection_destroy (sock);
   GNUNET_cron_stop (cron);
@@ -49,6 +49,10 @@ static unsigned int anonymity = 1;
 
 static unsigned int parallelism = 32;
 
+static int do_stream;
+
+static unsigned int stream_buffer_kib = 512;
+
 static GNUNET_CronTime start_time;
 
 static struct GNUNET_FSUI_DownloadList *dl;
@@ -59,6 +63,12 @@ static struct GNUNET_FSUI_DownloadList *dl;
 #define EC_ABORTED 2
 #define EC_DOWNLOAD_ERROR 3
 #define DEBUG 0
+
+/**
+ * Size of the buffer used to copy streamed data to stdout.
+ */
+#define STREAM_BUFFER_SIZE (32 * 1024)
+
 static int errorCode;
 
 static unsigned int downloads_running;
@@ -76,6 +86,10 @@ static struct GNUNET_CommandLineOption gnunetdownloadOptions[] = {
   {'a', "anonymity", "LEVEL",
    gettext_noop ("set the desired LEVEL of sender-anonymity"),
    1, &GNUNET_getopt_configure_set_uint, &anonymity},
+  {'b', "buffer", "KIB",
+   gettext_noop
+   ("request at most KIB kilobytes ahead of the output position when streaming (default: 512)"),
+   1, &GNUNET_getopt_configure_set_uint, &stream_buffer_kib},
   GNUNET_COMMAND_LINE_OPTION_CFG_FILE (&cfgFilename),   /* -c */
   {'d', "directory", NULL,
    gettext_noop
@@ -97,6 +111,10 @@ static struct GNUNET_CommandLineOption gnunetdownloadOptions[] = {
   {'R', "recursive", NULL,
    gettext_noop ("download a GNUnet directory recursively"),
    0, &GNUNET_getopt_configure_set_one, &do_recursive},
+  {'s', "stream", NULL,
+   gettext_noop
+   ("write the file to standard output in order while it is being downloaded (for example, for media playback)"),
+   0, &GNUNET_getopt_configure_set_one, &do_stream},
   GNUNET_COMMAND_LINE_OPTION_VERSION (PACKAGE_VERSION), /* -v */
   GNUNET_COMMAND_LINE_OPTION_VERBOSE,
   GNUNET_COMMAND_LINE_OPTION_END,
@@ -169,6 +187,89 @@ progressModel (void *unused, const GNUNET_FSUI_Event * event)
   return NULL;
 }
 
+static int
+testTerminate (void *unused)
+{
+  return (GNUNET_YES == GNUNET_shutdown_test ())? GNUNET_SYSERR : GNUNET_OK;
+}
+
+/**
+ * Download the file in order and write it to stdout.
+ *
+ * @return EC_COMPLETED on success
+ */
+static int
+streamToStdout (const struct GNUNET_ECRS_URI *uri,
+                int argc, char *const *argv)
+{
+  struct GNUNET_ECRS_DownloadContext *rm;
+  struct GNUNET_ECRS_URI *loc;
+  char buf[STREAM_BUFFER_SIZE];
+  unsigned long long done;
+  int ret;
+  int ec;
+  int i;
+
+  rm = GNUNET_ECRS_file_download_stream_start (ectx,
+                                               cfg,
+                                               NULL,
+                                               uri,
+                                               anonymity,
+                                               (unsigned long long) stream_buffer_kib
+                                               * 1024, NULL, NULL);
+  if (rm == NULL)
+    return EC_DOWNLOAD_ERROR;
+  /* additional location URIs for the same file */
+  for (i = 0; i < argc; i++)
+    {
+      loc = GNUNET_ECRS_string_to_uri (ectx, argv[i]);
+      if ((loc == NULL) ||
+          (GNUNET_SYSERR == GNUNET_ECRS_file_download_add_location (rm, loc)))
+        GNUNET_GE_LOG (ectx,
+                       GNUNET_GE_WARNING | GNUNET_GE_BULK | GNUNET_GE_USER,
+                       _("Ignoring `%s': not a location URI for this file.\n"),
+                       argv[i]);
+      if (loc != NULL)
+        GNUNET_ECRS_uri_destroy (loc);
+    }
+  done = 0;
+  ec = EC_INCOMPLETE;
+  while (1)
+    {
+      ret = GNUNET_ECRS_file_download_stream_read (rm,
+                                                   buf, sizeof (buf),
+                                                   &testTerminate, NULL);
+      if (ret == 0)
+        {
+          ec = EC_COMPLETED;
+          break;
+        }
+      if (ret == GNUNET_SYSERR)
+        break;
+      if (ret != fwrite (buf, 1, ret, stdout))
+        {
+          GNUNET_GE_LOG_STRERROR (ectx,
+                                  GNUNET_GE_ERROR | GNUNET_GE_USER |
+                                  GNUNET_GE_IMMEDIATE, "fwrite");
+          ec = EC_DOWNLOAD_ERROR;
+          break;
+        }
+      fflush (stdout);
+      done += ret;
+      if (verbose)
+        fprintf (stderr,
+                 _("Streamed %16llu out of %16llu bytes (%8.3f KiB/s)\n"),
+                 done, GNUNET_ECRS_uri_get_file_size (uri),
+                 (done / 1024.0) /
+                 (((double) (GNUNET_get_time () - (start_time - 1)))
+                  / (double) GNUNET_CRON_SECONDS));
+    }
+  if ((GNUNET_OK != GNUNET_ECRS_file_download_partial_stop (rm)) &&
+      (ec == EC_INCOMPLETE) && (GNUNET_YES != GNUNET_shutdown_test ()))
+    ec = EC_DOWNLOAD_ERROR;
+  return ec;
+}
+
 static int
 directoryIterator (const GNUNET_ECRS_FileInfo * fi,
                    const GNUNET_HashCode * key, int isRoot, void *cls)
@@ -228,7 +329,7 @@ main (int argc, char *const *argv)
 
   i = GNUNET_init (argc,
                    argv,
-                   "gnunet-download [OPTIONS] URI",
+                   "gnunet-download [OPTIONS] URI [LOCATION-URI...]",
                    &cfgFilename, gnunetdownloadOptions, &ectx, &cfg);
   if (i == -1)
     {
@@ -275,6 +376,23 @@ main (int argc, char *const *argv)
         }
     }
 
+  if (do_stream)
+    {
+      if (do_directory || do_recursive)
+        {
+          GNUNET_GE_LOG (ectx,
+                         GNUNET_GE_ERROR | GNUNET_GE_BULK | GNUNET_GE_USER,
+                         _("Option `%s' cannot be combined with `%s'.\n"),
+                         "-s", do_directory ? "-d" : "-R");
+          errorCode = EC_ARGUMENTS;
+          GNUNET_ECRS_uri_destroy (uri);
+          goto quit;
+        }
+      start_time = GNUNET_get_time ();
+      errorCode = streamToStdout (uri, argc - i - 1, &argv[i + 1]);
+      GNUNET_ECRS_uri_destroy (uri);
+      goto quit;
+    }
   try_rename = GNUNET_NO;
   if (filename == NULL)
     {
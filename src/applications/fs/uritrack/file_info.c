@@ -23,8 +23,10 @@
  * @brief Helper functions for keeping track of files for building directories.
  * @author Christian Grothoff
  *
- * An mmapped file (STATE_NAME) is used to store the URIs.
- * An IPC semaphore is used to guard the access.
+ * An append-only, mmapped file (STATE_NAME) is used to store the
+ * URIs; a hash index (see uri_index.c) is used to find out if a URI
+ * is already in the file.  The IPC semaphore of the index is used to
+ * guard the access.
  */
 
 #include "platform.h"
@@ -32,34 +34,12 @@
 #include "gnunet_util.h"
 #include "gnunet_uritrack_lib.h"
 #include "callbacks.h"
+#include "uri_index.h"
 
 #define DEBUG_FILE_INFO GNUNET_NO
 
-#define STATE_NAME DIR_SEPARATOR_STR "data" DIR_SEPARATOR_STR "fs_uridb"
 #define TRACK_OPTION "fs_uridb_status"
 
-static struct GNUNET_IPC_Semaphore *
-createIPC (struct GNUNET_GE_Context *ectx,
-           struct GNUNET_GC_Configuration *cfg)
-{
-  char *ipcName;
-  struct GNUNET_IPC_Semaphore *sem;
-
-  ipcName =
-    GNUNET_get_home_filename (ectx, cfg, GNUNET_NO, "uritrack_ipc_lock",
-                              NULL);
-  sem = GNUNET_IPC_semaphore_create (ectx, ipcName, 1);
-  GNUNET_free (ipcName);
-  return sem;
-}
-
-static char *
-getUriDbName (struct GNUNET_GE_Context *ectx,
-              struct GNUNET_GC_Configuration *cfg)
-{
-  return GNUNET_get_home_filename (ectx, cfg, GNUNET_NO, STATE_NAME, NULL);
-}
-
 static char *
 getToggleName (struct GNUNET_GE_Context *ectx,
                struct GNUNET_GC_Configuration *cfg)
@@ -106,25 +86,6 @@ GNUNET_URITRACK_get_tracking_status (struct GNUNET_GE_Context *ectx,
     }
 }
 
-struct CheckPresentClosure
-{
-  const GNUNET_ECRS_FileInfo *fi;
-  int present;
-};
-
-static int
-checkPresent (const GNUNET_ECRS_FileInfo * fi,
-              const GNUNET_HashCode * key, int isRoot, void *closure)
-{
-  struct CheckPresentClosure *cpc = closure;
-  if (GNUNET_ECRS_uri_test_equal (fi->uri, cpc->fi->uri))
-    {
-      cpc->present = 1;
-      return GNUNET_SYSERR;
-    }
-  return GNUNET_OK;
-}
-
 /**
  * Makes a URI available for directory building.
  */
@@ -133,21 +94,29 @@ GNUNET_URITRACK_track (struct GNUNET_GE_Context *ectx,
                        struct GNUNET_GC_Configuration *cfg,
                        const GNUNET_ECRS_FileInfo * fi)
 {
-  struct GNUNET_IPC_Semaphore *sem;
+  struct GNUNET_URITRACK_Index *idx;
+  GNUNET_HashCode key;
   char *data;
   unsigned int size;
+  unsigned int state;
+  int tracked;
   char *suri;
   int fh;
   char *fn;
-  struct CheckPresentClosure cpc;
+  off_t offset;
 
   if (GNUNET_NO == GNUNET_URITRACK_get_tracking_status (ectx, cfg))
     return;
-  cpc.present = 0;
-  cpc.fi = fi;
-  GNUNET_URITRACK_list (ectx, cfg, GNUNET_NO, &checkPresent, &cpc);
-  if (cpc.present == 1)
+  GNUNET_URITRACK_index_key (fi->uri, &key);
+  idx = GNUNET_URITRACK_index_open (ectx, cfg);
+  if (idx == NULL)
     return;
+  if ((GNUNET_YES == GNUNET_URITRACK_index_get (idx, &key, &state, &tracked))
+      && (tracked == GNUNET_YES))
+    {
+      GNUNET_URITRACK_index_close (idx);
+      return;
+    }
   size = GNUNET_meta_data_get_serialized_size (fi->meta,
                                                GNUNET_SERIALIZE_FULL
                                                |
@@ -163,23 +132,27 @@ GNUNET_URITRACK_track (struct GNUNET_GE_Context *ectx,
                                                         GNUNET_SERIALIZE_NO_COMPRESS));
   size = htonl (size);
   suri = GNUNET_ECRS_uri_to_string (fi->uri);
-  sem = createIPC (ectx, cfg);
-  GNUNET_IPC_semaphore_down (sem, GNUNET_YES);
-  fn = getUriDbName (ectx, cfg);
+  fn = GNUNET_URITRACK_get_db_name (ectx, cfg);
   fh = GNUNET_disk_file_open (ectx,
                               fn,
                               O_WRONLY | O_APPEND | O_CREAT |
                               O_LARGEFILE, S_IRUSR | S_IWUSR);
   if (fh != -1)
     {
-      WRITE (fh, suri, strlen (suri) + 1);
-      WRITE (fh, &size, sizeof (unsigned int));
-      WRITE (fh, data, ntohl (size));
+      offset = LSEEK (fh, 0, SEEK_END);
+      if ((offset != -1) &&
+          (strlen (suri) + 1 == WRITE (fh, suri, strlen (suri) + 1)) &&
+          (sizeof (unsigned int) ==
+           WRITE (fh, &size, sizeof (unsigned int)))
+          && (ntohl (size) == WRITE (fh, data, ntohl (size))))
+        GNUNET_URITRACK_index_put_record (idx, &key, offset,
+                                          offset + strlen (suri) + 1 +
+                                          sizeof (unsigned int) +
+                                          ntohl (size));
       CLOSE (fh);
     }
   GNUNET_free (fn);
-  GNUNET_IPC_semaphore_up (sem);
-  GNUNET_IPC_semaphore_destroy (sem);
+  GNUNET_URITRACK_index_close (idx);
   GNUNET_free (data);
   GNUNET_free (suri);
   GNUNET_URITRACK_internal_notify (fi);
@@ -193,12 +166,11 @@ void
 GNUNET_URITRACK_clear (struct GNUNET_GE_Context *ectx,
                        struct GNUNET_GC_Configuration *cfg)
 {
-  struct GNUNET_IPC_Semaphore *sem;
+  struct GNUNET_URITRACK_Index *idx;
   char *fn;
 
-  sem = createIPC (ectx, cfg);
-  GNUNET_IPC_semaphore_down (sem, GNUNET_YES);
-  fn = getUriDbName (ectx, cfg);
+  idx = GNUNET_URITRACK_index_open (ectx, cfg);
+  fn = GNUNET_URITRACK_get_db_name (ectx, cfg);
   if (GNUNET_YES == GNUNET_disk_file_test (ectx, fn))
     {
       if (0 != UNLINK (fn))
@@ -208,8 +180,11 @@ GNUNET_URITRACK_clear (struct GNUNET_GE_Context *ectx,
                                      "unlink", fn);
     }
   GNUNET_free (fn);
-  GNUNET_IPC_semaphore_up (sem);
-  GNUNET_IPC_semaphore_destroy (sem);
+  if (idx != NULL)
+    {
+      GNUNET_URITRACK_index_clear_records (idx);
+      GNUNET_URITRACK_index_close (idx);
+    }
 }
 
 /**
@@ -232,9 +207,11 @@ GNUNET_URITRACK_toggle_tracking (struct GNUNET_GE_Context *ectx,
 }
 
 /**
- * Iterate over all entries that match the given context
- * mask.
+ * Iterate over the entries that were added since the
+ * given position.
  *
+ * @param position position to start at (0 for the first entry);
+ *        set to the position after the last entry listed
  * @param iterator function to call on each entry, may be NULL
  * @param closure extra argument to the callback
  * @param need_metadata GNUNET_YES if metadata should be
@@ -242,13 +219,14 @@ GNUNET_URITRACK_toggle_tracking (struct GNUNET_GE_Context *ectx,
  * @return number of entries found
  */
 int
-GNUNET_URITRACK_list (struct GNUNET_GE_Context *ectx,
-                      struct GNUNET_GC_Configuration *cfg,
-                      int need_metadata,
-                      GNUNET_ECRS_SearchResultProcessor iterator,
-                      void *closure)
+GNUNET_URITRACK_list_since (struct GNUNET_GE_Context *ectx,
+                            struct GNUNET_GC_Configuration *cfg,
+                            int need_metadata,
+                            unsigned long long *position,
+                            GNUNET_ECRS_SearchResultProcessor iterator,
+                            void *closure)
 {
-  struct GNUNET_IPC_Semaphore *sem;
+  struct GNUNET_URITRACK_Index *idx;
   int rval;
   char *result;
   off_t ret;
@@ -260,21 +238,29 @@ GNUNET_URITRACK_list (struct GNUNET_GE_Context *ectx,
   char *fn;
   struct stat buf;
 
-  fn = getUriDbName (ectx, cfg);
-  sem = createIPC (ectx, cfg);
-  GNUNET_IPC_semaphore_down (sem, GNUNET_YES);
+  idx = GNUNET_URITRACK_index_open (ectx, cfg);
+  if (idx == NULL)
+    return GNUNET_SYSERR;
+  fn = GNUNET_URITRACK_get_db_name (ectx, cfg);
   if ((0 != STAT (fn, &buf)) || (buf.st_size == 0))
     {
-      GNUNET_IPC_semaphore_up (sem);
-      GNUNET_IPC_semaphore_destroy (sem);
+      GNUNET_URITRACK_index_close (idx);
       GNUNET_free (fn);
+      *position = 0;
       return 0;                 /* no URI db */
     }
+  if (*position == buf.st_size)
+    {
+      GNUNET_URITRACK_index_close (idx);
+      GNUNET_free (fn);
+      return 0;                 /* nothing new */
+    }
+  if (*position > buf.st_size)
+    *position = 0;              /* URI db was cleared */
   fd = GNUNET_disk_file_open (ectx, fn, O_LARGEFILE | O_RDONLY);
   if (fd == -1)
     {
-      GNUNET_IPC_semaphore_up (sem);
-      GNUNET_IPC_semaphore_destroy (sem);
+      GNUNET_URITRACK_index_close (idx);
       GNUNET_GE_LOG_STRERROR_FILE (ectx,
                                    GNUNET_GE_ERROR | GNUNET_GE_USER |
                                    GNUNET_GE_ADMIN | GNUNET_GE_BULK, "open",
@@ -291,12 +277,11 @@ GNUNET_URITRACK_list (struct GNUNET_GE_Context *ectx,
                                    GNUNET_GE_ADMIN | GNUNET_GE_BULK, "mmap",
                                    fn);
       GNUNET_free (fn);
-      GNUNET_IPC_semaphore_up (sem);
-      GNUNET_IPC_semaphore_destroy (sem);
+      GNUNET_URITRACK_index_close (idx);
       return GNUNET_SYSERR;
     }
   ret = buf.st_size;
-  pos = 0;
+  pos = *position;
   rval = 0;
   while (pos < ret)
     {
@@ -339,6 +324,7 @@ GNUNET_URITRACK_list (struct GNUNET_GE_Context *ectx,
           fi.meta = NULL;
         }
       pos = spos + msize;
+      *position = pos;
       if (iterator != NULL)
         {
           if (GNUNET_OK != iterator (&fi, NULL, GNUNET_NO, closure))
@@ -352,8 +338,7 @@ GNUNET_URITRACK_list (struct GNUNET_GE_Context *ectx,
                                              | GNUNET_GE_BULK, "munmap", fn);
               CLOSE (fd);
               GNUNET_free (fn);
-              GNUNET_IPC_semaphore_up (sem);
-              GNUNET_IPC_semaphore_destroy (sem);
+              GNUNET_URITRACK_index_close (idx);
               return GNUNET_SYSERR;     /* iteration aborted */
             }
         }
@@ -368,8 +353,7 @@ GNUNET_URITRACK_list (struct GNUNET_GE_Context *ectx,
                                  GNUNET_GE_BULK, "munmap", fn);
   CLOSE (fd);
   GNUNET_free (fn);
-  GNUNET_IPC_semaphore_up (sem);
-  GNUNET_IPC_semaphore_destroy (sem);
+  GNUNET_URITRACK_index_close (idx);
   return rval;
 FORMATERROR:
   GNUNET_GE_LOG (ectx,
@@ -381,11 +365,35 @@ FORMATERROR:
                                  GNUNET_GE_BULK, "munmap", fn);
   CLOSE (fd);
   GNUNET_free (fn);
-  GNUNET_IPC_semaphore_up (sem);
-  GNUNET_IPC_semaphore_destroy (sem);
+  GNUNET_URITRACK_index_close (idx);
   GNUNET_URITRACK_clear (ectx, cfg);
+  *position = 0;
   return GNUNET_SYSERR;
 }
 
+/**
+ * Iterate over all entries that match the given context
+ * mask.
+ *
+ * @param iterator function to call on each entry, may be NULL
+ * @param closure extra argument to the callback
+ * @param need_metadata GNUNET_YES if metadata should be
+ *        provided, GNUNET_NO if metadata is not needed (faster)
+ * @return number of entries found
+ */
+int
+GNUNET_URITRACK_list (struct GNUNET_GE_Context *ectx,
+                      struct GNUNET_GC_Configuration *cfg,
+                      int need_metadata,
+                      GNUNET_ECRS_SearchResultProcessor iterator,
+                      void *closure)
+{
+  unsigned long long position;
+
+  position = 0;
+  return GNUNET_URITRACK_list_since (ectx, cfg, need_metadata, &position,
+                                     iterator, closure);
+}
+
 
 /* end of file_info.c */
@@ -98,6 +98,9 @@ processor (const GNUNET_ECRS_FileInfo * fi,
 static int
 testTracking ()
 {
+  GNUNET_ECRS_FileInfo fi3;
+  unsigned long long position;
+
   fi1.uri = GNUNET_ECRS_keyword_string_to_uri (NULL, "foo");
   fi1.meta = GNUNET_meta_data_create ();
   GNUNET_meta_data_insert (fi1.meta, EXTRACTOR_MIMETYPE, "foo/bar");
@@ -121,8 +124,24 @@ testTracking ()
   CHECK (GNUNET_YES == GNUNET_URITRACK_get_tracking_status (NULL, cfg));
   GNUNET_URITRACK_track (NULL, cfg, &fi1);
   CHECK (1 == GNUNET_URITRACK_list (NULL, cfg, GNUNET_NO, NULL, NULL));
+  /* duplicates are not tracked */
+  GNUNET_URITRACK_track (NULL, cfg, &fi1);
+  CHECK (1 == GNUNET_URITRACK_list (NULL, cfg, GNUNET_NO, NULL, NULL));
   GNUNET_URITRACK_track (NULL, cfg, &fi2);
   CHECK (2 == GNUNET_URITRACK_list (NULL, cfg, GNUNET_YES, &processor, NULL));
+  /* incremental listing */
+  position = 0;
+  CHECK (2 == GNUNET_URITRACK_list_since (NULL, cfg, GNUNET_NO, &position,
+                                          NULL, NULL));
+  CHECK (0 == GNUNET_URITRACK_list_since (NULL, cfg, GNUNET_NO, &position,
+                                          NULL, NULL));
+  fi3.uri = GNUNET_ECRS_keyword_string_to_uri (NULL, "football");
+  fi3.meta = GNUNET_meta_data_create ();
+  GNUNET_URITRACK_track (NULL, cfg, &fi3);
+  CHECK (1 == GNUNET_URITRACK_list_since (NULL, cfg, GNUNET_NO, &position,
+                                          NULL, NULL));
+  GNUNET_ECRS_uri_destroy (fi3.uri);
+  GNUNET_meta_data_destroy (fi3.meta);
   GNUNET_URITRACK_toggle_tracking (NULL, cfg, GNUNET_NO);
   CHECK (GNUNET_NO == GNUNET_URITRACK_get_tracking_status (NULL, cfg));
   GNUNET_URITRACK_clear (NULL, cfg);
@@ -131,6 +150,80 @@ testTracking ()
   return 0;
 }
 
+static int
+testState ()
+{
+  struct GNUNET_ECRS_URI *uri;
+  struct GNUNET_ECRS_URI *uri2;
+
+  uri = GNUNET_ECRS_keyword_string_to_uri (NULL, "state");
+  uri2 = GNUNET_ECRS_keyword_string_to_uri (NULL, "other");
+  GNUNET_URITRACK_add_state (NULL, cfg, uri, GNUNET_URITRACK_FRESH);
+  GNUNET_URITRACK_add_state (NULL, cfg, uri,
+                             GNUNET_URITRACK_DOWNLOAD_STARTED);
+  CHECK (GNUNET_URITRACK_DOWNLOAD_STARTED ==
+         GNUNET_URITRACK_get_state (NULL, cfg, uri));
+  GNUNET_URITRACK_add_state (NULL, cfg, uri,
+                             GNUNET_URITRACK_DOWNLOAD_COMPLETED);
+  CHECK ((GNUNET_URITRACK_DOWNLOAD_STARTED |
+          GNUNET_URITRACK_DOWNLOAD_COMPLETED) ==
+         GNUNET_URITRACK_get_state (NULL, cfg, uri));
+  CHECK (GNUNET_URITRACK_FRESH ==
+         GNUNET_URITRACK_get_state (NULL, cfg, uri2));
+  /* state survives clearing the tracking database */
+  GNUNET_URITRACK_clear (NULL, cfg);
+  CHECK ((GNUNET_URITRACK_DOWNLOAD_STARTED |
+          GNUNET_URITRACK_DOWNLOAD_COMPLETED) ==
+         GNUNET_URITRACK_get_state (NULL, cfg, uri));
+  GNUNET_ECRS_uri_destroy (uri);
+  GNUNET_ECRS_uri_destroy (uri2);
+  return 0;
+}
+
+/**
+ * State recorded in the table of older versions (uri_info.db)
+ * must be picked up and copied into the index.
+ */
+static int
+testLegacyState ()
+{
+  struct GNUNET_ECRS_URI *uri;
+  unsigned char io[2];
+  char *fn;
+  char *s;
+  int crc;
+  int fd;
+  off_t o;
+
+  uri = GNUNET_ECRS_keyword_string_to_uri (NULL, "legacy");
+  s = GNUNET_ECRS_uri_to_string (uri);
+  crc = GNUNET_crc32_n (s, strlen (s));
+  GNUNET_free (s);
+  fn = GNUNET_get_home_filename (NULL, cfg, GNUNET_NO, "uri_info.db", NULL);
+  GNUNET_disk_directory_create_for_file (NULL, fn);
+  fd = GNUNET_disk_file_open (NULL, fn, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+  CHECK (fd != -1);
+  o = 2 * (crc % (1024 * 1024ULL));
+  io[0] = (unsigned char) crc;
+  io[1] = GNUNET_URITRACK_DOWNLOAD_COMPLETED;
+  CHECK (o == LSEEK (fd, o, SEEK_SET));
+  CHECK (2 == WRITE (fd, io, 2));
+  CHECK (GNUNET_URITRACK_DOWNLOAD_COMPLETED ==
+         GNUNET_URITRACK_get_state (NULL, cfg, uri));
+  /* wipe the old table; the state must have been imported */
+  io[0] = 0;
+  io[1] = 0;
+  CHECK (o == LSEEK (fd, o, SEEK_SET));
+  CHECK (2 == WRITE (fd, io, 2));
+  CLOSE (fd);
+  UNLINK (fn);
+  GNUNET_free (fn);
+  CHECK (GNUNET_URITRACK_DOWNLOAD_COMPLETED ==
+         GNUNET_URITRACK_get_state (NULL, cfg, uri));
+  GNUNET_ECRS_uri_destroy (uri);
+  return 0;
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -142,7 +235,13 @@ main (int argc, char *argv[])
       GNUNET_GC_free (cfg);
       return -1;
     }
+  /* URI states are persistent, start from scratch */
+  GNUNET_disk_directory_remove (NULL, "/tmp/gnunet-uritrack-test-driver");
+  /* must run first: the old table is only looked for when the
+     URI index is first opened */
+  failureCount += testLegacyState ();
   failureCount += testTracking ();
+  failureCount += testState ();
   GNUNET_GC_free (cfg);
   if (failureCount != 0)
     return 1;
@@ -0,0 +1,790 @@
+/*
+     This file is part of GNUnet.
+     (C) 2026 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 2, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+     Boston, MA 02111-1307, USA.
+*/
+
+/**
+ * @file applications/fs/uritrack/uri_index.c
+ * @brief hash index over the URI database
+ * @author Christian Grothoff
+ *
+ * The index is an open-addressing hash table (linear probing) on
+ * disk, keyed by the hash of the URI string.  For each URI it
+ * records whether (and where) the URI is in the append-only URI
+ * database and the URI's state bits (see uri_info.c).  The header
+ * remembers how much of the database has been indexed, so records
+ * appended by older versions are picked up incrementally.  If we
+ * crash while the index is being modified, the "dirty" flag in the
+ * header causes the index to be rebuilt from the database.
+ *
+ * An IPC semaphore is used to guard the access.  The index file
+ * (and the semaphore) stay open between accesses; each access only
+ * re-reads the header to pick up changes made by other processes.
+ *
+ * URI state recorded by older versions in the lossy uri_info.db
+ * table (indexed by the CRC of the URI) is looked up as a fallback
+ * and copied into the index when it is found.
+ */
+
+#include "platform.h"
+#include "gnunet_directories.h"
+#include "gnunet_util.h"
+#include "uri_index.h"
+
+#define DEBUG_URI_INDEX GNUNET_NO
+
+#define INDEX_NAME STATE_NAME ".idx"
+
+#define INDEX_MAGIC 0x55524931
+
+/**
+ * Number of slots in a new index.
+ */
+#define INITIAL_SLOTS 1024
+
+/**
+ * Slot is in use (possibly as a tombstone).
+ */
+#define SLOT_USED 1
+
+/**
+ * URI of the slot is in the URI database.
+ */
+#define SLOT_RECORD 2
+
+/**
+ * Header of the index file (all values in network byte order).
+ */
+typedef struct
+{
+  unsigned int magic;
+
+  /**
+   * Number of slots in the table.
+   */
+  unsigned int slots;
+
+  /**
+   * Number of used slots (including tombstones).
+   */
+  unsigned int used;
+
+  /**
+   * Number of slots for URIs that are not in the database.
+   */
+  unsigned int state_only;
+
+  /**
+   * GNUNET_YES while the index is being modified.
+   */
+  unsigned int dirty;
+
+  unsigned int reserved;
+
+  /**
+   * Number of bytes of the database that have been indexed.
+   */
+  unsigned long long indexed;
+} IndexHeader;
+
+/**
+ * Slot of the index (all values in network byte order).
+ */
+typedef struct
+{
+  GNUNET_HashCode key;
+
+  /**
+   * Offset of the record in the database (if SLOT_RECORD is set).
+   */
+  unsigned long long offset;
+
+  unsigned int state;
+
+  unsigned int flags;
+} IndexSlot;
+
+/**
+ * Name of the state table used by older versions.
+ */
+#define LEGACY_NAME "uri_info.db"
+
+struct GNUNET_URITRACK_Index
+{
+  struct GNUNET_GE_Context *ectx;
+
+  struct GNUNET_IPC_Semaphore *sem;
+
+  char *fn;
+
+  /**
+   * Name of the URI database.
+   */
+  char *dbName;
+
+  /**
+   * Header (in host byte order).
+   */
+  IndexHeader hdr;
+
+  int fd;
+
+  /**
+   * Has the header been marked dirty on disk?
+   */
+  int dirty;
+
+  /**
+   * Handle of the old uri_info.db table, -1 if there is none.
+   */
+  int legacy_fd;
+
+  /**
+   * Number of entries in the old table.
+   */
+  unsigned long long legacy_size;
+};
+
+/**
+ * Index handle that is kept open between accesses
+ * (NULL if none is open).
+ */
+static struct GNUNET_URITRACK_Index *cached;
+
+/**
+ * Lock for access to the cached index handle (held
+ * from GNUNET_URITRACK_index_open until
+ * GNUNET_URITRACK_index_close).
+ */
+static struct GNUNET_Mutex *lock;
+
+static struct GNUNET_IPC_Semaphore *
+createIPC (struct GNUNET_GE_Context *ectx,
+           struct GNUNET_GC_Configuration *cfg)
+{
+  char *ipcName;
+  struct GNUNET_IPC_Semaphore *sem;
+
+  ipcName =
+    GNUNET_get_home_filename (ectx, cfg, GNUNET_NO, "uritrack_ipc_lock",
+                              NULL);
+  sem = GNUNET_IPC_semaphore_create (ectx, ipcName, 1);
+  GNUNET_free (ipcName);
+  return sem;
+}
+
+char *
+GNUNET_URITRACK_get_db_name (struct GNUNET_GE_Context *ectx,
+                             struct GNUNET_GC_Configuration *cfg)
+{
+  return GNUNET_get_home_filename (ectx, cfg, GNUNET_NO, STATE_NAME, NULL);
+}
+
+void
+GNUNET_URITRACK_index_key (const struct GNUNET_ECRS_URI *uri,
+                           GNUNET_HashCode * key)
+{
+  char *s;
+
+  s = GNUNET_ECRS_uri_to_string (uri);
+  GNUNET_hash (s, strlen (s), key);
+  GNUNET_free (s);
+}
+
+static int
+write_header (struct GNUNET_URITRACK_Index *idx)
+{
+  IndexHeader hdr;
+
+  hdr.magic = htonl (idx->hdr.magic);
+  hdr.slots = htonl (idx->hdr.slots);
+  hdr.used = htonl (idx->hdr.used);
+  hdr.state_only = htonl (idx->hdr.state_only);
+  hdr.dirty = htonl (idx->hdr.dirty);
+  hdr.reserved = 0;
+  hdr.indexed = GNUNET_htonll (idx->hdr.indexed);
+  if ((0 != LSEEK (idx->fd, 0, SEEK_SET)) ||
+      (sizeof (IndexHeader) != WRITE (idx->fd, &hdr, sizeof (IndexHeader))))
+    {
+      GNUNET_GE_LOG_STRERROR_FILE (idx->ectx,
+                                   GNUNET_GE_ERROR | GNUNET_GE_USER |
+                                   GNUNET_GE_BULK, "write", idx->fn);
+      return GNUNET_SYSERR;
+    }
+  return GNUNET_OK;
+}
+
+/**
+ * Mark the index as dirty before the first modification.
+ */
+static int
+begin_update (struct GNUNET_URITRACK_Index *idx)
+{
+  if (idx->dirty == GNUNET_YES)
+    return GNUNET_OK;
+  idx->dirty = GNUNET_YES;
+  idx->hdr.dirty = GNUNET_YES;
+  return write_header (idx);
+}
+
+static int
+read_slot (struct GNUNET_URITRACK_Index *idx, unsigned int i,
+           IndexSlot * slot)
+{
+  off_t o;
+
+  o = sizeof (IndexHeader) + (off_t) i * sizeof (IndexSlot);
+  if ((o != LSEEK (idx->fd, o, SEEK_SET)) ||
+      (sizeof (IndexSlot) != READ (idx->fd, slot, sizeof (IndexSlot))))
+    return GNUNET_SYSERR;
+  return GNUNET_OK;
+}
+
+static int
+write_slot (struct GNUNET_URITRACK_Index *idx, unsigned int i,
+            const IndexSlot * slot)
+{
+  off_t o;
+
+  o = sizeof (IndexHeader) + (off_t) i * sizeof (IndexSlot);
+  if ((o != LSEEK (idx->fd, o, SEEK_SET)) ||
+      (sizeof (IndexSlot) != WRITE (idx->fd, slot, sizeof (IndexSlot))))
+    {
+      GNUNET_GE_LOG_STRERROR_FILE (idx->ectx,
+                                   GNUNET_GE_ERROR | GNUNET_GE_USER |
+                                   GNUNET_GE_BULK, "write", idx->fn);
+      return GNUNET_SYSERR;
+    }
+  return GNUNET_OK;
+}
+
+/**
+ * Reset the index to an empty table with the given number of slots.
+ */
+static int
+reset_index (struct GNUNET_URITRACK_Index *idx, unsigned int slots)
+{
+  idx->hdr.magic = INDEX_MAGIC;
+  idx->hdr.slots = slots;
+  idx->hdr.used = 0;
+  idx->hdr.state_only = 0;
+  idx->hdr.indexed = 0;
+  if ((0 != FTRUNCATE (idx->fd, 0)) ||
+      (0 != FTRUNCATE (idx->fd,
+                       sizeof (IndexHeader) +
+                       (off_t) slots * sizeof (IndexSlot))))
+    {
+      GNUNET_GE_LOG_STRERROR_FILE (idx->ectx,
+                                   GNUNET_GE_ERROR | GNUNET_GE_USER |
+                                   GNUNET_GE_BULK, "ftruncate", idx->fn);
+      return GNUNET_SYSERR;
+    }
+  idx->dirty = GNUNET_NO;
+  return begin_update (idx);
+}
+
+/**
+ * Find the slot for the given key.
+ *
+ * @param pos set to the slot of the key, or to the slot
+ *        where the key should be inserted
+ * @param slot set to the contents of that slot
+ * @return GNUNET_YES if the key was found, GNUNET_NO if not,
+ *         GNUNET_SYSERR on error
+ */
+static int
+find_slot (struct GNUNET_URITRACK_Index *idx,
+           const GNUNET_HashCode * key, unsigned int *pos, IndexSlot * slot)
+{
+  unsigned int i;
+  unsigned int n;
+  int have_tombstone;
+  IndexSlot tombstone;
+
+  have_tombstone = GNUNET_NO;
+  i = ((unsigned int) key->bits[0]) % idx->hdr.slots;
+  for (n = 0; n < idx->hdr.slots; n++)
+    {
+      if (GNUNET_OK != read_slot (idx, i, slot))
+        return GNUNET_SYSERR;
+      if (0 == (ntohl (slot->flags) & SLOT_USED))
+        {
+          if (have_tombstone == GNUNET_NO)
+            *pos = i;
+          else
+            *slot = tombstone;
+          return GNUNET_NO;
+        }
+      if (0 == memcmp (key, &slot->key, sizeof (GNUNET_HashCode)))
+        {
+          *pos = i;
+          return GNUNET_YES;
+        }
+      if ((have_tombstone == GNUNET_NO) &&
+          (0 == (ntohl (slot->flags) & SLOT_RECORD)) &&
+          (0 == ntohl (slot->state)))
+        {
+          have_tombstone = GNUNET_YES;
+          tombstone = *slot;
+          *pos = i;
+        }
+      i = (i + 1) % idx->hdr.slots;
+    }
+  if (have_tombstone == GNUNET_YES)
+    {
+      *slot = tombstone;
+      return GNUNET_NO;
+    }
+  GNUNET_GE_BREAK (idx->ectx, 0);       /* table full, should not happen */
+  return GNUNET_SYSERR;
+}
+
+/**
+ * Double the size of the index (dropping tombstones).
+ */
+static int
+grow_index (struct GNUNET_URITRACK_Index *idx)
+{
+  IndexSlot *old;
+  unsigned int slots;
+  unsigned int i;
+  unsigned int pos;
+  IndexSlot slot;
+
+  slots = idx->hdr.slots;
+  old = GNUNET_malloc_large (sizeof (IndexSlot) * slots);
+  if ((sizeof (IndexHeader) != LSEEK (idx->fd,
+                                      sizeof (IndexHeader), SEEK_SET)) ||
+      (sizeof (IndexSlot) * slots !=
+       READ (idx->fd, old, sizeof (IndexSlot) * slots)))
+    {
+      GNUNET_free (old);
+      return GNUNET_SYSERR;
+    }
+  idx->hdr.slots = 2 * slots;
+  idx->hdr.used = 0;
+  if ((0 != FTRUNCATE (idx->fd, sizeof (IndexHeader))) ||
+      (0 != FTRUNCATE (idx->fd,
+                       sizeof (IndexHeader) +
+                       (off_t) idx->hdr.slots * sizeof (IndexSlot))))
+    {
+      GNUNET_GE_LOG_STRERROR_FILE (idx->ectx,
+                                   GNUNET_GE_ERROR | GNUNET_GE_USER |
+                                   GNUNET_GE_BULK, "ftruncate", idx->fn);
+      GNUNET_free (old);
+      return GNUNET_SYSERR;
+    }
+  for (i = 0; i < slots; i++)
+    {
+      if ((0 == (ntohl (old[i].flags) & SLOT_USED)) ||
+          ((0 == (ntohl (old[i].flags) & SLOT_RECORD)) &&
+           (0 == ntohl (old[i].state))))
+        continue;
+      if (GNUNET_NO != find_slot (idx, &old[i].key, &pos, &slot))
+        {
+          GNUNET_free (old);
+          return GNUNET_SYSERR;
+        }
+      if (GNUNET_OK != write_slot (idx, pos, &old[i]))
+        {
+          GNUNET_free (old);
+          return GNUNET_SYSERR;
+        }
+      idx->hdr.used++;
+    }
+  GNUNET_free (old);
+  return GNUNET_OK;
+}
+
+/**
+ * Update (or create) the entry for the given key.
+ *
+ * @param state state bits to add
+ * @param offset offset of the record, -1 for none
+ * @param max maximum number of URIs without record
+ *        (only checked for new entries without record)
+ */
+static int
+update_entry (struct GNUNET_URITRACK_Index *idx,
+              const GNUNET_HashCode * key,
+              unsigned int state, long long offset, unsigned long long max)
+{
+  IndexSlot slot;
+  unsigned int pos;
+  unsigned int flags;
+  int ret;
+
+  if (GNUNET_OK != begin_update (idx))
+    return GNUNET_SYSERR;
+  ret = find_slot (idx, key, &pos, &slot);
+  if (ret == GNUNET_SYSERR)
+    return GNUNET_SYSERR;
+  if (ret == GNUNET_NO)
+    {
+      if ((offset == -1) && (state == 0))
+        return GNUNET_OK;
+      if ((offset == -1) && (idx->hdr.state_only >= max))
+        return GNUNET_NO;
+      if (4 * (idx->hdr.used + 1) > 3 * idx->hdr.slots)
+        {
+          if (GNUNET_OK != grow_index (idx))
+            return GNUNET_SYSERR;
+          if (GNUNET_NO != find_slot (idx, key, &pos, &slot))
+            return GNUNET_SYSERR;
+        }
+      if (0 == (ntohl (slot.flags) & SLOT_USED))
+        idx->hdr.used++;
+      memset (&slot, 0, sizeof (IndexSlot));
+      slot.key = *key;
+      slot.flags = htonl (SLOT_USED);
+      if (offset == -1)
+        idx->hdr.state_only++;
+    }
+  flags = ntohl (slot.flags);
+  if ((offset != -1) && (0 == (flags & SLOT_RECORD)))
+    {
+      if ((ret == GNUNET_YES) && (0 != ntohl (slot.state)))
+        idx->hdr.state_only--;
+      flags |= SLOT_RECORD;
+      slot.offset = GNUNET_htonll (offset);
+    }
+  slot.flags = htonl (flags);
+  slot.state = htonl (ntohl (slot.state) | state);
+  return write_slot (idx, pos, &slot);
+}
+
+/**
+ * Index records of the database that were appended
+ * since the index was last updated.
+ */
+static int
+sync_index (struct GNUNET_URITRACK_Index *idx, const char *dbName)
+{
+  struct stat buf;
+  GNUNET_HashCode key;
+  char *data;
+  unsigned long long len;
+  unsigned long long pos;
+  unsigned long long spos;
+  unsigned int msize;
+  int fd;
+
+  if ((0 != STAT (dbName, &buf)) || (buf.st_size == 0))
+    {
+      if (idx->hdr.indexed == 0)
+        return GNUNET_OK;
+      /* database was removed behind our back */
+      return reset_index (idx, INITIAL_SLOTS);
+    }
+  if (buf.st_size == idx->hdr.indexed)
+    return GNUNET_OK;
+  if (buf.st_size < idx->hdr.indexed)
+    {
+      if (GNUNET_OK != reset_index (idx, INITIAL_SLOTS))
+        return GNUNET_SYSERR;
+    }
+  fd = GNUNET_disk_file_open (idx->ectx, dbName, O_LARGEFILE | O_RDONLY);
+  if (fd == -1)
+    return GNUNET_SYSERR;
+  len = buf.st_size - idx->hdr.indexed;
+  data = GNUNET_malloc_large (len);
+  if ((idx->hdr.indexed != LSEEK (fd, idx->hdr.indexed, SEEK_SET)) ||
+      (len != (unsigned long long) READ (fd, data, len)))
+    {
+      GNUNET_free (data);
+      CLOSE (fd);
+      return GNUNET_SYSERR;
+    }
+  CLOSE (fd);
+  pos = 0;
+  while (pos < len)
+    {
+      spos = pos;
+      while ((spos < len) && (data[spos] != '\0'))
+        spos++;
+      if (spos + 1 + sizeof (int) > len)
+        break;
+      GNUNET_hash (&data[pos], spos - pos, &key);
+      spos++;                   /* skip '\0' */
+      memcpy (&msize, &data[spos], sizeof (int));
+      msize = ntohl (msize);
+      spos += sizeof (int);
+      if ((spos + msize > len) || (spos + msize < spos))
+        break;
+      if (GNUNET_SYSERR ==
+          update_entry (idx, &key, 0, idx->hdr.indexed + pos, 0))
+        {
+          GNUNET_free (data);
+          return GNUNET_SYSERR;
+        }
+      pos = spos + msize;
+    }
+  GNUNET_free (data);
+  if (pos < len)
+    GNUNET_GE_LOG (idx->ectx,
+                   GNUNET_GE_WARNING | GNUNET_GE_BULK | GNUNET_GE_USER,
+                   _("URI database `%s' is corrupt after offset %llu.\n"),
+                   dbName, idx->hdr.indexed + pos);
+  idx->hdr.indexed += pos;
+  return GNUNET_OK;
+}
+
+/**
+ * Open the index file and the semaphore.
+ *
+ * @param fn name of the index file (the handle takes ownership)
+ * @return NULL on error
+ */
+static struct GNUNET_URITRACK_Index *
+create_handle (struct GNUNET_GE_Context *ectx,
+               struct GNUNET_GC_Configuration *cfg, char *fn)
+{
+  struct GNUNET_URITRACK_Index *idx;
+  char *legacy;
+
+  idx = GNUNET_malloc (sizeof (struct GNUNET_URITRACK_Index));
+  idx->ectx = ectx;
+  idx->fn = fn;
+  idx->fd = GNUNET_disk_file_open (ectx,
+                                   idx->fn,
+                                   O_RDWR | O_CREAT | O_LARGEFILE,
+                                   S_IRUSR | S_IWUSR);
+  if (idx->fd == -1)
+    {
+      GNUNET_free (idx->fn);
+      GNUNET_free (idx);
+      return NULL;
+    }
+  /* the handle outlives the caller's error context */
+  idx->sem = createIPC (NULL, cfg);
+  idx->dbName = GNUNET_URITRACK_get_db_name (ectx, cfg);
+  idx->legacy_fd = -1;
+  legacy =
+    GNUNET_get_home_filename (ectx, cfg, GNUNET_NO, LEGACY_NAME, NULL);
+  if (GNUNET_YES == GNUNET_disk_file_test (ectx, legacy))
+    {
+      idx->legacy_fd = GNUNET_disk_file_open (ectx, legacy, O_RDONLY);
+      idx->legacy_size = 1024 * 1024;
+      GNUNET_GC_get_configuration_value_number (cfg,
+                                                "FS",
+                                                "URI_DB_SIZE",
+                                                1,
+                                                1024 * 1024 * 1024,
+                                                1024 * 1024,
+                                                &idx->legacy_size);
+    }
+  GNUNET_free (legacy);
+  return idx;
+}
+
+static void
+destroy_handle (struct GNUNET_URITRACK_Index *idx)
+{
+  if (idx->legacy_fd != -1)
+    CLOSE (idx->legacy_fd);
+  GNUNET_disk_file_close (NULL, idx->fn, idx->fd);
+  GNUNET_IPC_semaphore_destroy (idx->sem);
+  GNUNET_free (idx->dbName);
+  GNUNET_free (idx->fn);
+  GNUNET_free (idx);
+}
+
+struct GNUNET_URITRACK_Index *
+GNUNET_URITRACK_index_open (struct GNUNET_GE_Context *ectx,
+                            struct GNUNET_GC_Configuration *cfg)
+{
+  struct GNUNET_URITRACK_Index *idx;
+  IndexHeader hdr;
+  char *fn;
+  int ok;
+
+  fn = GNUNET_get_home_filename (ectx, cfg, GNUNET_NO, INDEX_NAME, NULL);
+  GNUNET_mutex_lock (lock);
+  if ((cached != NULL) && (0 != strcmp (cached->fn, fn)))
+    {
+      destroy_handle (cached);
+      cached = NULL;
+    }
+  if (cached == NULL)
+    {
+      cached = create_handle (ectx, cfg, fn);
+      if (cached == NULL)
+        {
+          GNUNET_mutex_unlock (lock);
+          return NULL;
+        }
+    }
+  else
+    GNUNET_free (fn);
+  idx = cached;
+  idx->ectx = ectx;
+  idx->dirty = GNUNET_NO;
+  GNUNET_IPC_semaphore_down (idx->sem, GNUNET_YES);
+  if ((0 == LSEEK (idx->fd, 0, SEEK_SET)) &&
+      (sizeof (IndexHeader) == READ (idx->fd, &hdr, sizeof (IndexHeader))) &&
+      (ntohl (hdr.magic) == INDEX_MAGIC) &&
+      (ntohl (hdr.dirty) == GNUNET_NO) && (ntohl (hdr.slots) > 0))
+    {
+      idx->hdr.magic = INDEX_MAGIC;
+      idx->hdr.slots = ntohl (hdr.slots);
+      idx->hdr.used = ntohl (hdr.used);
+      idx->hdr.state_only = ntohl (hdr.state_only);
+      idx->hdr.dirty = GNUNET_NO;
+      idx->hdr.indexed = GNUNET_ntohll (hdr.indexed);
+      ok = GNUNET_OK;
+    }
+  else
+    {
+#if DEBUG_URI_INDEX
+      GNUNET_GE_LOG (ectx,
+                     GNUNET_GE_DEBUG | GNUNET_GE_REQUEST | GNUNET_GE_USER,
+                     "Rebuilding URI index `%s'.\n", idx->fn);
+#endif
+      ok = reset_index (idx, INITIAL_SLOTS);
+    }
+  if (ok == GNUNET_OK)
+    ok = sync_index (idx, idx->dbName);
+  if (ok != GNUNET_OK)
+    {
+      /* leave the index marked dirty so that it gets rebuilt */
+      idx->dirty = GNUNET_NO;
+      GNUNET_URITRACK_index_close (idx);
+      return NULL;
+    }
+  return idx;
+}
+
+void
+GNUNET_URITRACK_index_close (struct GNUNET_URITRACK_Index *idx)
+{
+  if (idx->dirty == GNUNET_YES)
+    {
+      idx->hdr.dirty = GNUNET_NO;
+      write_header (idx);
+      idx->dirty = GNUNET_NO;
+    }
+  GNUNET_IPC_semaphore_up (idx->sem);
+  GNUNET_mutex_unlock (lock);
+}
+
+int
+GNUNET_URITRACK_index_get (struct GNUNET_URITRACK_Index *idx,
+                           const GNUNET_HashCode * key,
+                           unsigned int *state, int *tracked)
+{
+  IndexSlot slot;
+  unsigned int pos;
+
+  *state = 0;
+  *tracked = GNUNET_NO;
+  if (GNUNET_YES != find_slot (idx, key, &pos, &slot))
+    return GNUNET_NO;
+  *state = ntohl (slot.state);
+  if (0 != (ntohl (slot.flags) & SLOT_RECORD))
+    *tracked = GNUNET_YES;
+  return GNUNET_YES;
+}
+
+int
+GNUNET_URITRACK_index_put_record (struct GNUNET_URITRACK_Index *idx,
+                                  const GNUNET_HashCode * key,
+                                  unsigned long long offset,
+                                  unsigned long long end)
+{
+  if (GNUNET_SYSERR == update_entry (idx, key, 0, offset, 0))
+    return GNUNET_SYSERR;
+  if (idx->hdr.indexed == offset)
+    idx->hdr.indexed = end;
+  return GNUNET_OK;
+}
+
+int
+GNUNET_URITRACK_index_add_state (struct GNUNET_URITRACK_Index *idx,
+                                 const GNUNET_HashCode * key,
+                                 unsigned int state, unsigned long long max)
+{
+  return update_entry (idx, key, state, -1, max);
+}
+
+void
+GNUNET_URITRACK_index_clear_records (struct GNUNET_URITRACK_Index *idx)
+{
+  IndexSlot slot;
+  unsigned int i;
+  unsigned int flags;
+
+  if (GNUNET_OK != begin_update (idx))
+    return;
+  for (i = 0; i < idx->hdr.slots; i++)
+    {
+      if (GNUNET_OK != read_slot (idx, i, &slot))
+        return;
+      flags = ntohl (slot.flags);
+      if (0 == (flags & SLOT_RECORD))
+        continue;
+      /* entries without state remain as tombstones */
+      slot.flags = htonl (flags & ~SLOT_RECORD);
+      slot.offset = 0;
+      if (GNUNET_OK != write_slot (idx, i, &slot))
+        return;
+      if (0 != ntohl (slot.state))
+        idx->hdr.state_only++;
+    }
+  idx->hdr.indexed = 0;
+}
+
+int
+GNUNET_URITRACK_index_get_legacy_state (struct GNUNET_URITRACK_Index *idx,
+                                        const struct GNUNET_ECRS_URI *uri,
+                                        unsigned int *state)
+{
+  char *s;
+  int crc;
+  unsigned char io[2];
+  off_t o;
+
+  *state = 0;
+  if (idx->legacy_fd == -1)
+    return GNUNET_NO;
+  s = GNUNET_ECRS_uri_to_string (uri);
+  crc = GNUNET_crc32_n (s, strlen (s));
+  GNUNET_free (s);
+  o = 2 * (crc % idx->legacy_size);
+  if ((o != LSEEK (idx->legacy_fd, o, SEEK_SET)) ||
+      (2 != READ (idx->legacy_fd, io, 2)) ||
+      (io[0] != (unsigned char) crc) || (io[1] == 0))
+    return GNUNET_NO;
+  *state = io[1];
+  return GNUNET_YES;
+}
+
+void __attribute__ ((constructor)) GNUNET_URITRACK_index_ltdl_init ()
+{
+  lock = GNUNET_mutex_create (GNUNET_NO);
+}
+
+void __attribute__ ((destructor)) GNUNET_URITRACK_index_ltdl_fini ()
+{
+  if (cached != NULL)
+    destroy_handle (cached);
+  cached = NULL;
+  GNUNET_mutex_destroy (lock);
+  lock = NULL;
+}
+
+/* end of uri_index.c */
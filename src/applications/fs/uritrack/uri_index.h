@@ -0,0 +1,131 @@
+/*
+     This file is part of GNUnet.
+     (C) 2026 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 2, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+     Boston, MA 02111-1307, USA.
+*/
+
+/**
+ * @file applications/fs/uritrack/uri_index.h
+ * @brief hash index over the URI database
+ * @author Christian Grothoff
+ */
+
+#ifndef URITRACK_URI_INDEX_H
+#define URITRACK_URI_INDEX_H
+
+#include "gnunet_util.h"
+#include "gnunet_ecrs_lib.h"
+
+#define STATE_NAME DIR_SEPARATOR_STR "data" DIR_SEPARATOR_STR "fs_uridb"
+
+/**
+ * Handle to the URI index.  While the handle is open,
+ * the caller has exclusive access to the URI database.
+ */
+struct GNUNET_URITRACK_Index;
+
+/**
+ * Get the name of the URI database (append-only data file).
+ */
+char *GNUNET_URITRACK_get_db_name (struct GNUNET_GE_Context *ectx,
+                                   struct GNUNET_GC_Configuration *cfg);
+
+/**
+ * Compute the index key for a URI.
+ */
+void GNUNET_URITRACK_index_key (const struct GNUNET_ECRS_URI *uri,
+                                GNUNET_HashCode * key);
+
+/**
+ * Lock the URI database and open its index.  Records that were
+ * appended to the database but are not yet in the index are
+ * indexed; a missing or damaged index is rebuilt.
+ *
+ * @return NULL on error
+ */
+struct GNUNET_URITRACK_Index *GNUNET_URITRACK_index_open (struct
+                                                          GNUNET_GE_Context
+                                                          *ectx,
+                                                          struct
+                                                          GNUNET_GC_Configuration
+                                                          *cfg);
+
+/**
+ * Write back changes to the index and unlock the URI database
+ * (the index file itself is kept open for the next access).
+ */
+void GNUNET_URITRACK_index_close (struct GNUNET_URITRACK_Index *idx);
+
+/**
+ * Look up a URI in the index.
+ *
+ * @param state set to the recorded state of the URI
+ * @param tracked set to GNUNET_YES if the URI is in the database
+ * @return GNUNET_YES if the index has an entry for the URI
+ */
+int GNUNET_URITRACK_index_get (struct GNUNET_URITRACK_Index *idx,
+                               const GNUNET_HashCode * key,
+                               unsigned int *state, int *tracked);
+
+/**
+ * Record that the database contains the URI with the given
+ * key at the given offset.
+ *
+ * @param end size of the database after the record
+ * @return GNUNET_OK on success, GNUNET_SYSERR on error
+ */
+int GNUNET_URITRACK_index_put_record (struct GNUNET_URITRACK_Index *idx,
+                                      const GNUNET_HashCode * key,
+                                      unsigned long long offset,
+                                      unsigned long long end);
+
+/**
+ * Add state bits for the URI with the given key.
+ *
+ * @param max maximum number of URIs that are not in the
+ *        database to keep state for
+ * @return GNUNET_OK on success, GNUNET_NO if the state
+ *         was dropped, GNUNET_SYSERR on error
+ */
+int GNUNET_URITRACK_index_add_state (struct GNUNET_URITRACK_Index *idx,
+                                     const GNUNET_HashCode * key,
+                                     unsigned int state,
+                                     unsigned long long max);
+
+/**
+ * Look up the state of a URI in the table used by older
+ * versions (uri_info.db).  The table is indexed by the CRC
+ * of the URI, so with a chance of 1:256 a collision returns
+ * the state of a different URI.
+ *
+ * @param state set to the recorded state of the URI
+ * @return GNUNET_YES if the old table has state for the URI
+ */
+int GNUNET_URITRACK_index_get_legacy_state (struct GNUNET_URITRACK_Index
+                                            *idx,
+                                            const struct GNUNET_ECRS_URI
+                                            *uri, unsigned int *state);
+
+/**
+ * Forget about all records in the database (the database
+ * itself must be removed by the caller); state information
+ * is kept.
+ */
+void GNUNET_URITRACK_index_clear_records (struct GNUNET_URITRACK_Index
+                                          *idx);
+
+#endif
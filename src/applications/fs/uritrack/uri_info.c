@@ -23,21 +23,19 @@
  * @brief information about URIs
  * @author Christian Grothoff
  *
- * Note that the information is only accurate with "high
- * probability" but not at all guaranteed (this is done
- * to bound disk size of the DB and to get high performance).
+ * The state of a URI is kept in the URI index (see uri_index.c).
+ * For URIs that are not in the URI database, we only keep state
+ * for a bounded number of URIs (URI_DB_SIZE); once that limit is
+ * reached, the state of new URIs is not recorded.  State found in
+ * the uri_info.db table of older versions is copied into the index
+ * the first time the URI is looked up.
  */
 
 #include "platform.h"
 #include "gnunet_directories.h"
 #include "gnunet_util.h"
 #include "gnunet_uritrack_lib.h"
-
-static char *
-getDBName (struct GNUNET_GC_Configuration *cfg)
-{
-  return GNUNET_get_home_filename (NULL, cfg, GNUNET_NO, "uri_info.db", NULL);
-}
+#include "uri_index.h"
 
 static unsigned long long
 getDBSize (struct GNUNET_GC_Configuration *cfg)
@@ -58,60 +56,34 @@ getDBSize (struct GNUNET_GC_Configuration *cfg)
  * Find out what we know about a given URI's past.  Note that we only
  * track the states for a (finite) number of URIs and that the
  * information that we give back maybe inaccurate (returning
- * GNUNET_URITRACK_FRESH if the URI did not fit into our bounded-size map,
- * even if the URI is not fresh anymore; also, if the URI has a
- * GNUNET_hash-collision in the map, there is a 1:256 chance that we will
- * return information from the wrong URI without detecting it).
+ * GNUNET_URITRACK_FRESH if the URI did not fit into our bounded-size
+ * index, even if the URI is not fresh anymore).
  */
 enum GNUNET_URITRACK_STATE
 GNUNET_URITRACK_get_state (struct GNUNET_GE_Context *ectx,
                            struct GNUNET_GC_Configuration *cfg,
                            const struct GNUNET_ECRS_URI *uri)
 {
-  char *s;
-  int crc;
-  int fd;
-  unsigned long long size;
-  unsigned char io[2];
-  off_t o;
+  struct GNUNET_URITRACK_Index *idx;
+  GNUNET_HashCode key;
+  unsigned int state;
+  int tracked;
 
-  s = GNUNET_ECRS_uri_to_string (uri);
-  crc = GNUNET_crc32_n (s, strlen (s));
-  GNUNET_free (s);
-  s = getDBName (cfg);
-  if (GNUNET_NO == GNUNET_disk_file_test (ectx, s))
-    {
-      GNUNET_free (s);
-      return GNUNET_URITRACK_FRESH;
-    }
-  size = getDBSize (cfg);
-  fd = GNUNET_disk_file_open (ectx, s, O_RDONLY);
-  if (fd == -1)
+  GNUNET_URITRACK_index_key (uri, &key);
+  idx = GNUNET_URITRACK_index_open (ectx, cfg);
+  if (idx == NULL)
+    return GNUNET_URITRACK_FRESH;
+  if ((GNUNET_YES != GNUNET_URITRACK_index_get (idx, &key, &state, &tracked))
+      || (state == GNUNET_URITRACK_FRESH))
     {
-      GNUNET_free (s);
-      return GNUNET_URITRACK_FRESH;
+      if (GNUNET_YES ==
+          GNUNET_URITRACK_index_get_legacy_state (idx, uri, &state))
+        GNUNET_URITRACK_index_add_state (idx, &key, state, getDBSize (cfg));
+      else
+        state = GNUNET_URITRACK_FRESH;
     }
-  o = 2 * (crc % size);
-  if (o != LSEEK (fd, o, SEEK_SET))
-    {
-      GNUNET_GE_LOG_STRERROR_FILE (ectx,
-                                   GNUNET_GE_WARNING | GNUNET_GE_USER |
-                                   GNUNET_GE_ADMIN | GNUNET_GE_BULK, "lseek",
-                                   s);
-      CLOSE (fd);
-      GNUNET_free (s);
-      return GNUNET_URITRACK_FRESH;
-    }
-  GNUNET_free (s);
-  if (2 != read (fd, io, 2))
-    {
-      CLOSE (fd);
-      return GNUNET_URITRACK_FRESH;
-    }
-  CLOSE (fd);
-  if (io[0] == (unsigned char) crc)
-    return (enum GNUNET_URITRACK_STATE) io[1];
-  return GNUNET_URITRACK_FRESH;
+  GNUNET_URITRACK_index_close (idx);
+  return (enum GNUNET_URITRACK_STATE) state;
 }
 
 /**
@@ -123,63 +95,15 @@ GNUNET_URITRACK_add_state (struct GNUNET_GE_Context *ectx,
                            const struct GNUNET_ECRS_URI *uri,
                            enum GNUNET_URITRACK_STATE state)
 {
-  char *s;
-  int crc;
-  int fd;
-  unsigned long long size;
-  unsigned char io[2];
-  off_t o;
+  struct GNUNET_URITRACK_Index *idx;
+  GNUNET_HashCode key;
 
-  s = GNUNET_ECRS_uri_to_string (uri);
-  crc = GNUNET_crc32_n (s, strlen (s));
-  GNUNET_free (s);
-  s = getDBName (cfg);
-  size = getDBSize (cfg);
-  fd = GNUNET_disk_file_open (ectx, s, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
-  if (fd == -1)
-    {
-      GNUNET_free (s);
-      return;
-    }
-  o = 2 * (crc % size);
-  if (o != LSEEK (fd, o, SEEK_SET))
-    {
-      GNUNET_GE_LOG_STRERROR_FILE (ectx,
-                                   GNUNET_GE_WARNING | GNUNET_GE_USER |
-                                   GNUNET_GE_ADMIN | GNUNET_GE_BULK, "lseek",
-                                   s);
-      CLOSE (fd);
-      GNUNET_free (s);
-      return;
-    }
-  if (2 != read (fd, io, 2))
-    {
-      io[0] = crc;
-      io[1] = GNUNET_URITRACK_FRESH;
-    }
-  else if (io[0] != (unsigned char) crc)
-    {
-      io[0] = (unsigned char) crc;
-      io[1] = GNUNET_URITRACK_FRESH;
-    }
-  io[1] |= state;
-  if (o != LSEEK (fd, o, SEEK_SET))
-    {
-      GNUNET_GE_LOG_STRERROR_FILE (ectx,
-                                   GNUNET_GE_WARNING | GNUNET_GE_USER |
-                                   GNUNET_GE_ADMIN | GNUNET_GE_BULK, "lseek",
-                                   s);
-      CLOSE (fd);
-      GNUNET_free (s);
-      return;
-    }
-  if (2 != write (fd, io, 2))
-    GNUNET_GE_LOG_STRERROR_FILE (ectx,
-                                 GNUNET_GE_WARNING | GNUNET_GE_USER |
-                                 GNUNET_GE_ADMIN | GNUNET_GE_BULK, "write",
-                                 s);
-  GNUNET_disk_file_close (ectx, s, fd);
-  GNUNET_free (s);
+  GNUNET_URITRACK_index_key (uri, &key);
+  idx = GNUNET_URITRACK_index_open (ectx, cfg);
+  if (idx == NULL)
+    return;
+  GNUNET_URITRACK_index_add_state (idx, &key, state, getDBSize (cfg));
+  GNUNET_URITRACK_index_close (idx);
 }
 
 /* end of uri_info.c */
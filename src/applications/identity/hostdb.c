@@ -0,0 +1,462 @@
+/*
+     This file is part of GNUnet.
+     (C) 2026 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 2, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+     Boston, MA 02111-1307, USA.
+*/
+
+/**
+ * @file identity/hostdb.c
+ * @brief single-file database of HELLOs and trust values
+ * @author Christian Grothoff
+ *
+ * The database is a log of records that is only ever appended to.
+ * Later records override earlier ones; the identity module keeps
+ * the current state (indexed by the hash of the peer identity) in
+ * memory and replays the log when it starts.  Since records that
+ * were overridden stay in the file, the identity module rewrites
+ * the file from its in-memory state once in a while (compaction).
+ *
+ * If we crash while appending a record, the damaged record at the
+ * end of the file is cut off when the database is opened again.
+ */
+
+#include "platform.h"
+#include "gnunet_util.h"
+#include "hostdb.h"
+
+#define DEBUG_HOSTDB GNUNET_NO
+
+#define HOSTDB_MAGIC 0x474e4844
+
+#define HOSTDB_VERSION 1
+
+/**
+ * Size of the buffer used for reading the database.
+ */
+#define READ_BUFFER_SIZE (4 * GNUNET_MAX_BUFFER_SIZE)
+
+/**
+ * Header of the database file (all values in network byte order).
+ */
+typedef struct
+{
+  unsigned int magic;
+
+  unsigned int version;
+} HostDBHeader;
+
+/**
+ * Header of each record (all values in network byte order).
+ * For HELLO records, the HELLO follows.
+ */
+typedef struct
+{
+  /**
+   * Size of the record, including this header.
+   */
+  unsigned int size;
+
+  /**
+   * Type of the record (HOSTDB_RECORD_XXX).
+   */
+  unsigned int type;
+
+  GNUNET_PeerIdentity peer;
+
+  /**
+   * Protocol number (HELLO, DELETE) or trust value (TRUST).
+   */
+  unsigned int value;
+
+  /**
+   * When was this record written (in seconds)?
+   */
+  unsigned int timestamp;
+} HostDBRecord;
+
+struct HostDB
+{
+  struct GNUNET_GE_Context *ectx;
+
+  char *fn;
+
+  int fd;
+
+  /**
+   * Current size of the file.
+   */
+  unsigned long long size;
+};
+
+/**
+ * Append the given record (and the data that follows it)
+ * to the database.
+ */
+static int
+append_record (struct HostDB *db,
+               unsigned int type,
+               const GNUNET_PeerIdentity * peer,
+               unsigned int value,
+               unsigned int timestamp, const void *data, unsigned int len)
+{
+  char *buf;
+  HostDBRecord *rec;
+  unsigned int size;
+  int ret;
+
+  size = sizeof (HostDBRecord) + len;
+  buf = GNUNET_malloc (size);
+  rec = (HostDBRecord *) buf;
+  rec->size = htonl (size);
+  rec->type = htonl (type);
+  rec->peer = *peer;
+  rec->value = htonl (value);
+  rec->timestamp = htonl (timestamp);
+  memcpy (&rec[1], data, len);
+  ret = GNUNET_OK;
+  if (size != WRITE (db->fd, buf, size))
+    {
+      GNUNET_GE_LOG_STRERROR_FILE (db->ectx,
+                                   GNUNET_GE_ERROR | GNUNET_GE_ADMIN |
+                                   GNUNET_GE_BULK, "write", db->fn);
+      /* do not leave a partial record behind */
+      if ((0 != FTRUNCATE (db->fd, db->size)) ||
+          (db->size != LSEEK (db->fd, db->size, SEEK_SET)))
+        GNUNET_GE_LOG_STRERROR_FILE (db->ectx,
+                                     GNUNET_GE_ERROR | GNUNET_GE_ADMIN |
+                                     GNUNET_GE_BULK, "ftruncate", db->fn);
+      ret = GNUNET_SYSERR;
+    }
+  else
+    {
+      db->size += size;
+    }
+  GNUNET_free (buf);
+  return ret;
+}
+
+/**
+ * Check that a record is well-formed.
+ *
+ * @param rec the record (header and data, in network byte order)
+ * @return GNUNET_OK if the record can be used
+ */
+static int
+check_record (const HostDBRecord * rec)
+{
+  const GNUNET_MessageHello *hello;
+  unsigned int size;
+
+  size = ntohl (rec->size);
+  switch (ntohl (rec->type))
+    {
+    case HOSTDB_RECORD_HELLO:
+      if (size < sizeof (HostDBRecord) + sizeof (GNUNET_MessageHello))
+        return GNUNET_SYSERR;
+      hello = (const GNUNET_MessageHello *) &rec[1];
+      if ((size != sizeof (HostDBRecord) + GNUNET_sizeof_hello (hello)) ||
+          (ntohs (hello->protocol) != ntohl (rec->value)) ||
+          (0 != memcmp (&hello->senderIdentity,
+                        &rec->peer, sizeof (GNUNET_PeerIdentity))))
+        return GNUNET_SYSERR;
+      return GNUNET_OK;
+    case HOSTDB_RECORD_TRUST:
+    case HOSTDB_RECORD_DELETE:
+      if (size != sizeof (HostDBRecord))
+        return GNUNET_SYSERR;
+      return GNUNET_OK;
+    default:
+      return GNUNET_SYSERR;
+    }
+}
+
+/**
+ * Read all records of the database and pass them to the
+ * processor.  Cuts off the file after the last good record.
+ */
+static int
+read_records (struct HostDB *db, HostDBRecordProcessor proc, void *cls)
+{
+  char *buf;
+  const HostDBRecord *rec;
+  unsigned long long good;
+  unsigned int have;
+  unsigned int pos;
+  unsigned int size;
+  int ret;
+
+  buf = GNUNET_malloc (READ_BUFFER_SIZE);
+  good = sizeof (HostDBHeader);
+  have = 0;
+  pos = 0;
+  while (1)
+    {
+      size = 0;
+      if (have - pos >= sizeof (HostDBRecord))
+        {
+          size = ntohl (((const HostDBRecord *) &buf[pos])->size);
+          if ((size < sizeof (HostDBRecord)) ||
+              (size > sizeof (HostDBRecord) + GNUNET_MAX_BUFFER_SIZE))
+            break;              /* damaged */
+        }
+      if ((have - pos < sizeof (HostDBRecord)) || (have - pos < size))
+        {
+          /* need more data */
+          memmove (buf, &buf[pos], have - pos);
+          have -= pos;
+          pos = 0;
+          ret = READ (db->fd, &buf[have], READ_BUFFER_SIZE - have);
+          if (ret < 0)
+            {
+              GNUNET_GE_LOG_STRERROR_FILE (db->ectx,
+                                           GNUNET_GE_ERROR | GNUNET_GE_ADMIN |
+                                           GNUNET_GE_BULK, "read", db->fn);
+              GNUNET_free (buf);
+              return GNUNET_SYSERR;
+            }
+          if (ret == 0)
+            break;
+          have += ret;
+          continue;
+        }
+      rec = (const HostDBRecord *) &buf[pos];
+      if (GNUNET_OK != check_record (rec))
+        break;
+      if (proc != NULL)
+        proc (cls,
+              ntohl (rec->type),
+              &rec->peer,
+              ntohl (rec->value),
+              ntohl (rec->timestamp),
+              (ntohl (rec->type) == HOSTDB_RECORD_HELLO)
+              ? (const GNUNET_MessageHello *) &rec[1] : NULL);
+      pos += size;
+      good += size;
+    }
+  GNUNET_free (buf);
+  if (good != db->size)
+    {
+      GNUNET_GE_LOG (db->ectx,
+                     GNUNET_GE_WARNING | GNUNET_GE_ADMIN | GNUNET_GE_BULK,
+                     _("Host database `%s' is damaged, dropping %llu bytes "
+                       "at the end.\n"), db->fn, db->size - good);
+      if (0 != FTRUNCATE (db->fd, good))
+        {
+          GNUNET_GE_LOG_STRERROR_FILE (db->ectx,
+                                       GNUNET_GE_ERROR | GNUNET_GE_ADMIN |
+                                       GNUNET_GE_BULK, "ftruncate", db->fn);
+          return GNUNET_SYSERR;
+        }
+      db->size = good;
+    }
+  if (db->size != LSEEK (db->fd, db->size, SEEK_SET))
+    return GNUNET_SYSERR;
+  return GNUNET_OK;
+}
+
+/**
+ * Write the header to a new (empty) database file.
+ */
+static int
+write_header (struct GNUNET_GE_Context *ectx, const char *fn, int fd)
+{
+  HostDBHeader hdr;
+
+  hdr.magic = htonl (HOSTDB_MAGIC);
+  hdr.version = htonl (HOSTDB_VERSION);
+  if (sizeof (HostDBHeader) != WRITE (fd, &hdr, sizeof (HostDBHeader)))
+    {
+      GNUNET_GE_LOG_STRERROR_FILE (ectx,
+                                   GNUNET_GE_ERROR | GNUNET_GE_ADMIN |
+                                   GNUNET_GE_BULK, "write", fn);
+      return GNUNET_SYSERR;
+    }
+  return GNUNET_OK;
+}
+
+struct HostDB *
+hostdb_open (struct GNUNET_GE_Context *ectx,
+             const char *filename, HostDBRecordProcessor proc, void *cls)
+{
+  struct HostDB *db;
+  HostDBHeader hdr;
+  struct stat st;
+  int fd;
+
+  GNUNET_disk_directory_create_for_file (ectx, filename);
+  fd = GNUNET_disk_file_open (ectx,
+                              filename, O_RDWR | O_CREAT,
+                              S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (fd == -1)
+    return NULL;
+  if (0 != FSTAT (fd, &st))
+    {
+      GNUNET_GE_LOG_STRERROR_FILE (ectx,
+                                   GNUNET_GE_ERROR | GNUNET_GE_ADMIN |
+                                   GNUNET_GE_BULK, "fstat", filename);
+      GNUNET_disk_file_close (ectx, filename, fd);
+      return NULL;
+    }
+  if (st.st_size == 0)
+    {
+      if (GNUNET_OK != write_header (ectx, filename, fd))
+        {
+          GNUNET_disk_file_close (ectx, filename, fd);
+          return NULL;
+        }
+      st.st_size = sizeof (HostDBHeader);
+    }
+  else if ((sizeof (HostDBHeader) != READ (fd, &hdr, sizeof (HostDBHeader)))
+           || (ntohl (hdr.magic) != HOSTDB_MAGIC)
+           || (ntohl (hdr.version) != HOSTDB_VERSION))
+    {
+      GNUNET_GE_LOG (ectx,
+                     GNUNET_GE_ERROR | GNUNET_GE_ADMIN | GNUNET_GE_BULK,
+                     _("File `%s' is not a host database.\n"), filename);
+      GNUNET_disk_file_close (ectx, filename, fd);
+      return NULL;
+    }
+  db = GNUNET_malloc (sizeof (struct HostDB));
+  db->ectx = ectx;
+  db->fn = GNUNET_strdup (filename);
+  db->fd = fd;
+  db->size = st.st_size;
+  if (GNUNET_OK != read_records (db, proc, cls))
+    {
+      hostdb_close (db);
+      return NULL;
+    }
+  return db;
+}
+
+void
+hostdb_close (struct HostDB *db)
+{
+  GNUNET_disk_file_close (db->ectx, db->fn, db->fd);
+  GNUNET_free (db->fn);
+  GNUNET_free (db);
+}
+
+int
+hostdb_put_hello (struct HostDB *db,
+                  const GNUNET_MessageHello * hello, unsigned int timestamp)
+{
+  return append_record (db,
+                        HOSTDB_RECORD_HELLO,
+                        &hello->senderIdentity,
+                        ntohs (hello->protocol),
+                        timestamp, hello, GNUNET_sizeof_hello (hello));
+}
+
+int
+hostdb_put_trust (struct HostDB *db,
+                  const GNUNET_PeerIdentity * peer, unsigned int trust)
+{
+  return append_record (db,
+                        HOSTDB_RECORD_TRUST,
+                        peer, trust, (unsigned int) time (NULL), NULL, 0);
+}
+
+int
+hostdb_delete (struct HostDB *db,
+               const GNUNET_PeerIdentity * peer, unsigned short protocol)
+{
+  return append_record (db,
+                        HOSTDB_RECORD_DELETE,
+                        peer, protocol, (unsigned int) time (NULL), NULL, 0);
+}
+
+unsigned long long
+hostdb_get_size (struct HostDB *db)
+{
+  return db->size;
+}
+
+unsigned int
+hostdb_hello_record_size (const GNUNET_MessageHello * hello)
+{
+  return sizeof (HostDBRecord) + GNUNET_sizeof_hello (hello);
+}
+
+unsigned int
+hostdb_trust_record_size ()
+{
+  return sizeof (HostDBRecord);
+}
+
+int
+hostdb_compact (struct HostDB *db, HostDBWriter writer, void *cls)
+{
+  char *tmp;
+  int oldFd;
+  unsigned long long oldSize;
+  int ret;
+
+  tmp = GNUNET_malloc (strlen (db->fn) + 5);
+  strcpy (tmp, db->fn);
+  strcat (tmp, ".tmp");
+  oldFd = db->fd;
+  oldSize = db->size;
+  db->fd = GNUNET_disk_file_open (db->ectx,
+                                  tmp, O_RDWR | O_CREAT | O_TRUNC,
+                                  S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (db->fd == -1)
+    {
+      db->fd = oldFd;
+      GNUNET_free (tmp);
+      return GNUNET_SYSERR;
+    }
+  db->size = sizeof (HostDBHeader);
+  ret = write_header (db->ectx, tmp, db->fd);
+  if (ret == GNUNET_OK)
+    ret = writer (db, cls);
+  if ((ret == GNUNET_OK) && (0 != fsync (db->fd)))
+    {
+      GNUNET_GE_LOG_STRERROR_FILE (db->ectx,
+                                   GNUNET_GE_ERROR | GNUNET_GE_ADMIN |
+                                   GNUNET_GE_BULK, "fsync", tmp);
+      ret = GNUNET_SYSERR;
+    }
+  if ((ret == GNUNET_OK) && (0 != RENAME (tmp, db->fn)))
+    {
+      GNUNET_GE_LOG_STRERROR_FILE (db->ectx,
+                                   GNUNET_GE_ERROR | GNUNET_GE_ADMIN |
+                                   GNUNET_GE_BULK, "rename", tmp);
+      ret = GNUNET_SYSERR;
+    }
+  if (ret != GNUNET_OK)
+    {
+      GNUNET_disk_file_close (db->ectx, tmp, db->fd);
+      UNLINK (tmp);
+      db->fd = oldFd;
+      db->size = oldSize;
+    }
+  else
+    {
+      GNUNET_disk_file_close (db->ectx, db->fn, oldFd);
+#if DEBUG_HOSTDB
+      GNUNET_GE_LOG (db->ectx,
+                     GNUNET_GE_DEBUG | GNUNET_GE_DEVELOPER | GNUNET_GE_BULK,
+                     "Compacted host database from %llu to %llu bytes.\n",
+                     oldSize, db->size);
+#endif
+    }
+  GNUNET_free (tmp);
+  return ret;
+}
+
+/* end of hostdb.c */
@@ -0,0 +1,147 @@
+/*
+     This file is part of GNUnet.
+     (C) 2026 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 2, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+     Boston, MA 02111-1307, USA.
+*/
+
+/**
+ * @file identity/hostdb.h
+ * @brief single-file database of HELLOs and trust values
+ * @author Christian Grothoff
+ */
+
+#ifndef HOSTDB_H
+#define HOSTDB_H
+
+#include "gnunet_util.h"
+#include "gnunet_util_core.h"
+
+/**
+ * Record with the HELLO of a peer for a protocol.
+ */
+#define HOSTDB_RECORD_HELLO 1
+
+/**
+ * Record with the trust we have in a peer.
+ */
+#define HOSTDB_RECORD_TRUST 2
+
+/**
+ * Record that deletes the HELLO of a peer for a protocol.
+ */
+#define HOSTDB_RECORD_DELETE 3
+
+/**
+ * Handle to the host database.
+ */
+struct HostDB;
+
+/**
+ * Callback for each record found when opening the host database.
+ *
+ * @param type type of the record (HOSTDB_RECORD_XXX)
+ * @param peer the peer the record is about
+ * @param value protocol number (HELLO, DELETE) or trust (TRUST)
+ * @param timestamp when the record was written (in seconds)
+ * @param hello the HELLO (for HELLO records), otherwise NULL
+ */
+typedef void (*HostDBRecordProcessor) (void *cls,
+                                       unsigned int type,
+                                       const GNUNET_PeerIdentity * peer,
+                                       unsigned int value,
+                                       unsigned int timestamp,
+                                       const GNUNET_MessageHello * hello);
+
+/**
+ * Callback that writes all live records into the host
+ * database during compaction (using the hostdb_put functions).
+ *
+ * @return GNUNET_OK on success, GNUNET_SYSERR on error
+ */
+typedef int (*HostDBWriter) (struct HostDB * db, void *cls);
+
+/**
+ * Open (or create) the host database and call the processor
+ * for each record in it (in the order in which they were
+ * written).  A damaged tail of the file (from a crash while
+ * writing) is cut off.
+ *
+ * @param proc function to call for each record, can be NULL
+ * @return NULL on error
+ */
+struct HostDB *hostdb_open (struct GNUNET_GE_Context *ectx,
+                            const char *filename,
+                            HostDBRecordProcessor proc, void *cls);
+
+/**
+ * Close the host database.
+ */
+void hostdb_close (struct HostDB *db);
+
+/**
+ * Append a HELLO to the database.
+ *
+ * @param timestamp time to record for the HELLO (in seconds)
+ * @return GNUNET_OK on success, GNUNET_SYSERR on error
+ */
+int hostdb_put_hello (struct HostDB *db,
+                      const GNUNET_MessageHello * hello,
+                      unsigned int timestamp);
+
+/**
+ * Append the trust we have in a peer to the database.
+ *
+ * @return GNUNET_OK on success, GNUNET_SYSERR on error
+ */
+int hostdb_put_trust (struct HostDB *db,
+                      const GNUNET_PeerIdentity * peer, unsigned int trust);
+
+/**
+ * Record that the HELLO of a peer for the given protocol
+ * was deleted.
+ *
+ * @return GNUNET_OK on success, GNUNET_SYSERR on error
+ */
+int hostdb_delete (struct HostDB *db,
+                   const GNUNET_PeerIdentity * peer, unsigned short protocol);
+
+/**
+ * Get the size of the database file.
+ */
+unsigned long long hostdb_get_size (struct HostDB *db);
+
+/**
+ * Get the number of bytes a HELLO record takes in the file.
+ */
+unsigned int hostdb_hello_record_size (const GNUNET_MessageHello * hello);
+
+/**
+ * Get the number of bytes a trust record takes in the file.
+ */
+unsigned int hostdb_trust_record_size (void);
+
+/**
+ * Rewrite the database so that it only contains the records
+ * that the writer puts into it.  The old file is replaced
+ * atomically once the writer is done.
+ *
+ * @return GNUNET_OK on success, GNUNET_SYSERR on error (in
+ *         which case the old file is kept)
+ */
+int hostdb_compact (struct HostDB *db, HostDBWriter writer, void *cls);
+
+#endif
@@ -0,0 +1,195 @@
+/*
+     This file is part of GNUnet.
+     (C) 2026 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 2, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+     Boston, MA 02111-1307, USA.
+*/
+
+/**
+ * @file applications/identity/hostdbtest.c
+ * @brief testcase for hostdb.c
+ * @author Christian Grothoff
+ */
+
+#include "platform.h"
+#include "gnunet_util.h"
+#include "hostdb.h"
+
+#define FILENAME "/tmp/gnunet-hostdbtest/hostdb"
+
+#define HELLOS 100
+
+#define ABORT() { fprintf(stderr, "Error at %s:%d\n", __FILE__, __LINE__); return 1; }
+#define CHECK(c) { if (! (c)) ABORT(); }
+
+static GNUNET_MessageHello *hellos[HELLOS];
+
+/**
+ * Number of records of each type seen while loading.
+ */
+static unsigned int seen[4];
+
+/**
+ * Number of records that did not match what we wrote.
+ */
+static unsigned int bad;
+
+static void
+countRecords (void *cls,
+              unsigned int type,
+              const GNUNET_PeerIdentity * peer,
+              unsigned int value,
+              unsigned int timestamp, const GNUNET_MessageHello * hello)
+{
+  unsigned int i;
+
+  if (type > 3)
+    {
+      bad++;
+      return;
+    }
+  i = seen[type]++;
+  switch (type)
+    {
+    case HOSTDB_RECORD_HELLO:
+      if ((i >= HELLOS) ||
+          (GNUNET_sizeof_hello (hello) != GNUNET_sizeof_hello (hellos[i])) ||
+          (0 != memcmp (hello, hellos[i], GNUNET_sizeof_hello (hello))) ||
+          (timestamp != 1000 + i) || (value != ntohs (hellos[i]->protocol)))
+        bad++;
+      break;
+    case HOSTDB_RECORD_TRUST:
+      if (value != 42 + i)
+        bad++;
+      break;
+    case HOSTDB_RECORD_DELETE:
+      if ((i >= HELLOS) ||
+          (0 != memcmp (peer,
+                        &hellos[i]->senderIdentity,
+                        sizeof (GNUNET_PeerIdentity))))
+        bad++;
+      break;
+    default:
+      bad++;
+    }
+}
+
+static int
+writeSome (struct HostDB *db, void *cls)
+{
+  unsigned int i;
+
+  for (i = 0; i < *(unsigned int *) cls; i++)
+    if (GNUNET_OK != hostdb_put_hello (db, hellos[i], 1000 + i))
+      return GNUNET_SYSERR;
+  return GNUNET_OK;
+}
+
+static int
+load (unsigned int *hello, unsigned int *trust, unsigned int *del)
+{
+  struct HostDB *db;
+
+  memset (seen, 0, sizeof (seen));
+  bad = 0;
+  db = hostdb_open (NULL, FILENAME, &countRecords, NULL);
+  if (db == NULL)
+    return GNUNET_SYSERR;
+  hostdb_close (db);
+  *hello = seen[HOSTDB_RECORD_HELLO];
+  *trust = seen[HOSTDB_RECORD_TRUST];
+  *del = seen[HOSTDB_RECORD_DELETE];
+  return (bad == 0) ? GNUNET_OK : GNUNET_SYSERR;
+}
+
+static int
+testHostDB ()
+{
+  struct HostDB *db;
+  unsigned int i;
+  unsigned int h;
+  unsigned int t;
+  unsigned int d;
+  unsigned long long size;
+  int fd;
+
+  db = hostdb_open (NULL, FILENAME, &countRecords, NULL);
+  CHECK (db != NULL);
+  CHECK (seen[HOSTDB_RECORD_HELLO] == 0);
+  for (i = 0; i < HELLOS; i++)
+    CHECK (GNUNET_OK == hostdb_put_hello (db, hellos[i], 1000 + i));
+  for (i = 0; i < 10; i++)
+    CHECK (GNUNET_OK ==
+           hostdb_put_trust (db, &hellos[i]->senderIdentity, 42 + i));
+  for (i = 0; i < 5; i++)
+    CHECK (GNUNET_OK ==
+           hostdb_delete (db, &hellos[i]->senderIdentity,
+                          ntohs (hellos[i]->protocol)));
+  size = hostdb_get_size (db);
+  hostdb_close (db);
+
+  CHECK (GNUNET_OK == load (&h, &t, &d));
+  CHECK ((h == HELLOS) && (t == 10) && (d == 5));
+
+  /* a partial record at the end (crash while writing) is dropped */
+  fd = GNUNET_disk_file_open (NULL, FILENAME, O_WRONLY | O_APPEND);
+  CHECK (fd != -1);
+  CHECK (40 == WRITE (fd, hellos[0], 40));
+  CLOSE (fd);
+  CHECK (GNUNET_OK == load (&h, &t, &d));
+  CHECK ((h == HELLOS) && (t == 10) && (d == 5));
+  db = hostdb_open (NULL, FILENAME, NULL, NULL);
+  CHECK (db != NULL);
+  CHECK (size == hostdb_get_size (db));
+
+  /* compaction replaces the contents */
+  i = 3;
+  CHECK (GNUNET_OK == hostdb_compact (db, &writeSome, &i));
+  CHECK (hostdb_get_size (db) < size);
+  CHECK (GNUNET_OK == hostdb_put_trust (db, &hellos[0]->senderIdentity, 42));
+  hostdb_close (db);
+  CHECK (GNUNET_OK == load (&h, &t, &d));
+  CHECK ((h == 3) && (t == 1) && (d == 0));
+  return 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+  int failureCount;
+  unsigned int i;
+  unsigned short len;
+
+  GNUNET_disk_directory_remove (NULL, "/tmp/gnunet-hostdbtest");
+  for (i = 0; i < HELLOS; i++)
+    {
+      len = (unsigned short) (i % 17);
+      hellos[i] = GNUNET_malloc (sizeof (GNUNET_MessageHello) + len);
+      memset (hellos[i], (int) i, sizeof (GNUNET_MessageHello) + len);
+      hellos[i]->header.size = htons (sizeof (GNUNET_MessageHello) + len);
+      hellos[i]->senderAddressSize = htons (len);
+      hellos[i]->protocol = htons ((unsigned short) (i % 5));
+    }
+  failureCount = testHostDB ();
+  for (i = 0; i < HELLOS; i++)
+    GNUNET_free (hellos[i]);
+  GNUNET_disk_directory_remove (NULL, "/tmp/gnunet-hostdbtest");
+  if (failureCount != 0)
+    return 1;
+  return 0;
+}
+
+/* end of hostdbtest.c */
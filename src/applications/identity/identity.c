@@ -23,10 +23,11 @@
  * @brief maintains list of known peers
  *
  * Code to maintain the list of currently known hosts (in memory
- * structure of data/hosts) and (temporary) blacklisting information
+ * structure of data/hostdb) and (temporary) blacklisting information
  * and a list of hellos that are temporary unless confirmed via PONG
  * (used to give the transport module the required information for the
- * PING).
+ * PING).  HELLOs that are copied into data/hosts by hand are imported
+ * into the host database.
  *
  * @author Christian Grothoff
  */
@@ -39,6 +40,7 @@
 #include "gnunet_transport_service.h"
 #include "identity.h"
 #include "hostkey.h"
+#include "hostdb.h"
 
 #define DEBUG_IDENTITY GNUNET_NO
 
@@ -46,6 +48,7 @@
 
 #define TRUSTDIR "data/credit/"
 #define HOST_DIR "data/hosts/"
+#define HOST_DB "data/hostdb"
 
 /**
  * Masks to keep track when the trust has changed and
@@ -65,6 +68,17 @@
 
 #define CRON_DISCARDS_HOSTS_AFTER (3 * GNUNET_CRON_MONTHS)
 
+/**
+ * Compact the host database if less than this fraction
+ * (in percent) of the file is still in use.
+ */
+#define HOST_DB_MIN_USE 50
+
+/**
+ * Number of slots in the blacklist filter (must be a power of 2).
+ */
+#define BLACKLIST_FILTER_SIZE 4096
+
 typedef struct
 {
 
@@ -100,17 +114,53 @@ typedef struct
   int strict;
 
   /**
-   * trust rating for this peer
+   * Position of this entry in hosts_ (unused for
+   * temporary hosts).
    */
-  unsigned int trust;
+  unsigned int index;
+
+  /**
+   * When did we last store a HELLO for this host
+   * (in seconds)?
+   */
+  unsigned int lastHello;
 
 } HostEntry;
 
+/**
+ * Trust we have in a peer.  Kept apart from the HostEntry
+ * since the trust must survive the removal of the HELLOs.
+ */
+typedef struct
+{
+
+  GNUNET_PeerIdentity identity;
+
+  /**
+   * trust rating for this peer (TRUST_REFRESH_MASK is set
+   * if the value was not yet written to the host database)
+   */
+  unsigned int trust;
+
+} TrustEntry;
+
 /**
  * The list of known hosts.
  */
 static HostEntry **hosts_ = NULL;
 
+/**
+ * Map from the hash of the public key of a known host
+ * to its entry in hosts_.
+ */
+static struct GNUNET_MultiHashMap *hostMap;
+
+/**
+ * Map from the hash of the public key of a peer to
+ * the TrustEntry for it (includes peers without HELLOs).
+ */
+static struct GNUNET_MultiHashMap *trustMap;
+
 /**
  * The current (allocated) size of knownHosts
  */
@@ -127,20 +177,44 @@ static unsigned int numberOfHosts_;
 static struct GNUNET_Mutex *lock_;
 
 /**
- * Directory where the hellos are stored in (data/hosts)
+ * Directory from which hellos are imported (data/hosts)
  */
 static char *networkIdDirectory;
 
 /**
- * Where do we store trust information?
+ * Where did older versions store trust information?
  */
 static char *trustDirectory;
 
+/**
+ * Name of the host database.
+ */
+static char *hostDBFile;
+
+/**
+ * The host database (HELLOs and trust).
+ */
+static struct HostDB *hostDB;
+
 /**
  * The list of temporarily known hosts
  */
 static HostEntry tempHosts[MAX_TEMP_HOSTS];
 
+/**
+ * Blacklist filters, indexed by the hash of the peer identity.
+ * Each slot contains the time (in seconds) until which any of
+ * the peers mapping to the slot may be blacklisted; the first
+ * filter considers all blacklisting, the second only strict
+ * blacklisting.  Slots are only ever increased (under lock_),
+ * so if the current time is past the value of the slot, the
+ * peer is certainly not blacklisted and isBlacklisted can
+ * answer without acquiring the lock.
+ */
+static volatile unsigned int blacklistFilter[BLACKLIST_FILTER_SIZE];
+
+static volatile unsigned int strictBlacklistFilter[BLACKLIST_FILTER_SIZE];
+
 static GNUNET_PeerIdentity myIdentity;
 
 static struct GNUNET_GE_Context *ectx;
@@ -175,14 +249,17 @@ get_host_filename (const GNUNET_PeerIdentity * id, unsigned short protocol)
 static HostEntry *
 lookup_host_entry (const GNUNET_PeerIdentity * id)
 {
-  int i;
-
   GNUNET_GE_ASSERT (ectx, numberOfHosts_ <= sizeOfHosts_);
-  for (i = 0; i < numberOfHosts_; i++)
-    if ((0 ==
-         memcmp (id, &hosts_[i]->identity, sizeof (GNUNET_PeerIdentity))))
-      return hosts_[i];
-  return NULL;
+  return GNUNET_multi_hash_map_get (hostMap, &id->hashPubKey);
+}
+
+/**
+ * Get the slot of the given peer in the blacklist filters.
+ */
+static unsigned int
+blacklist_filter_slot (const GNUNET_PeerIdentity * id)
+{
+  return id->hashPubKey.bits[0] & (BLACKLIST_FILTER_SIZE - 1);
 }
 
 /**
@@ -197,9 +274,6 @@ add_host_to_known_hosts (const GNUNET_PeerIdentity * identity,
 {
   HostEntry *entry;
   int i;
-  GNUNET_EncName fil;
-  char *fn;
-  unsigned int trust;
 
   GNUNET_GE_ASSERT (ectx, numberOfHosts_ <= sizeOfHosts_);
   GNUNET_mutex_lock (lock_);
@@ -216,27 +290,15 @@ add_host_to_known_hosts (const GNUNET_PeerIdentity * identity,
       entry->strict = GNUNET_NO;
       entry->hellos = NULL;
       entry->helloCount = 0;
-      GNUNET_hash_to_enc (&identity->hashPubKey, &fil);
-      fn =
-        GNUNET_malloc (strlen (trustDirectory) + sizeof (GNUNET_EncName) + 1);
-      strcpy (fn, trustDirectory);
-      strcat (fn, (char *) &fil);
-      if ((GNUNET_disk_file_test (ectx,
-                                  fn) == GNUNET_YES) &&
-          (sizeof (unsigned int) ==
-           GNUNET_disk_file_read (ectx, fn, sizeof (unsigned int), &trust)))
-        {
-          entry->trust = ntohl (trust);
-        }
-      else
-        {
-          entry->trust = 0;
-        }
-      GNUNET_free (fn);
-
+      entry->lastHello = 0;
       if (numberOfHosts_ == sizeOfHosts_)
-        GNUNET_array_grow (hosts_, sizeOfHosts_, sizeOfHosts_ + 32);
+        GNUNET_array_grow (hosts_, sizeOfHosts_, sizeOfHosts_ * 2 + 32);
+      entry->index = numberOfHosts_;
       hosts_[numberOfHosts_++] = entry;
+      GNUNET_multi_hash_map_put (hostMap,
+                                 &identity->hashPubKey,
+                                 entry,
+                                 GNUNET_MultiHashMapOption_UNIQUE_FAST);
     }
   for (i = 0; i < entry->protocolCount; i++)
     {
@@ -252,6 +314,40 @@ add_host_to_known_hosts (const GNUNET_PeerIdentity * identity,
   GNUNET_mutex_unlock (lock_);
 }
 
+/**
+ * Find the trust entry for the given peer.  Call
+ * only when synchronized!
+ * @return NULL if not found
+ */
+static TrustEntry *
+lookup_trust_entry (const GNUNET_PeerIdentity * id)
+{
+  return GNUNET_multi_hash_map_get (trustMap, &id->hashPubKey);
+}
+
+/**
+ * Find or create the trust entry for the given peer.
+ * Call only when synchronized!
+ */
+static TrustEntry *
+get_trust_entry (const GNUNET_PeerIdentity * id)
+{
+  TrustEntry *entry;
+
+  entry = lookup_trust_entry (id);
+  if (entry == NULL)
+    {
+      entry = GNUNET_malloc (sizeof (TrustEntry));
+      entry->identity = *id;
+      entry->trust = 0;
+      GNUNET_multi_hash_map_put (trustMap,
+                                 &id->hashPubKey,
+                                 entry,
+                                 GNUNET_MultiHashMapOption_UNIQUE_FAST);
+    }
+  return entry;
+}
+
 /**
  * Increase the host credit by a value.
  *
@@ -263,31 +359,20 @@ add_host_to_known_hosts (const GNUNET_PeerIdentity * identity,
 static int
 change_host_trust (const GNUNET_PeerIdentity * hostId, int value)
 {
-  HostEntry *host;
+  TrustEntry *entry;
 
   if (value == 0)
     return 0;
   GNUNET_mutex_lock (lock_);
-  host = lookup_host_entry (hostId);
-  if (host == NULL)
-    {
-      add_host_to_known_hosts (hostId, GNUNET_TRANSPORT_PROTOCOL_NUMBER_NAT);
-      host = lookup_host_entry (hostId);
-    }
-  if (host == NULL)
-    {
-      GNUNET_GE_BREAK (ectx, 0);
-      GNUNET_mutex_unlock (lock_);
-      return 0;
-    }
-  if (((int) (host->trust & TRUST_ACTUAL_MASK)) + value < 0)
+  entry = get_trust_entry (hostId);
+  if (((int) (entry->trust & TRUST_ACTUAL_MASK)) + value < 0)
     {
-      value = -(host->trust & TRUST_ACTUAL_MASK);
-      host->trust = 0 | TRUST_REFRESH_MASK;     /* 0 remaining */
+      value = -(entry->trust & TRUST_ACTUAL_MASK);
+      entry->trust = 0 | TRUST_REFRESH_MASK;    /* 0 remaining */
     }
   else
     {
-      host->trust = ((host->trust & TRUST_ACTUAL_MASK) + value)
+      entry->trust = ((entry->trust & TRUST_ACTUAL_MASK) + value)
         | TRUST_REFRESH_MASK;
     }
   GNUNET_mutex_unlock (lock_);
@@ -303,21 +388,146 @@ change_host_trust (const GNUNET_PeerIdentity * hostId, int value)
 static int
 get_host_trust (const GNUNET_PeerIdentity * hostId)
 {
-  HostEntry *host;
+  TrustEntry *entry;
   int value;
 
   GNUNET_mutex_lock (lock_);
-  host = lookup_host_entry (hostId);
-  if (host == NULL)
-    {
-      GNUNET_mutex_unlock (lock_);
-      return 0;
-    }
-  value = ((int) (host->trust & TRUST_ACTUAL_MASK));
+  entry = lookup_trust_entry (hostId);
+  if (entry == NULL)
+    value = 0;
+  else
+    value = ((int) (entry->trust & TRUST_ACTUAL_MASK));
   GNUNET_mutex_unlock (lock_);
   return value;
 }
 
+/**
+ * Obtain identity from publicPrivateKey.
+ * @param pubKey the public key of the host
+ * @param result address where to write the identity of the node
+ */
+static void
+getPeerIdentity (const GNUNET_RSA_PublicKey * pubKey,
+                 GNUNET_PeerIdentity * result)
+{
+  if (pubKey == NULL)
+    memset (&result, 0, sizeof (GNUNET_PeerIdentity));
+  else
+    GNUNET_hash (pubKey, sizeof (GNUNET_RSA_PublicKey), &result->hashPubKey);
+}
+
+/**
+ * Remove a file containing an invalid HELLO.  LOG
+ * success or failure.
+ */
+static void
+remove_invalid_hello (const char *fn)
+{
+  if (0 == UNLINK (fn))
+    GNUNET_GE_LOG (ectx,
+                   GNUNET_GE_WARNING | GNUNET_GE_USER | GNUNET_GE_BULK,
+                   _
+                   ("Removed file `%s' containing invalid HELLO data.\n"),
+                   fn);
+  else
+    GNUNET_GE_LOG_STRERROR_FILE (ectx,
+                                 GNUNET_GE_ERROR | GNUNET_GE_ADMIN |
+                                 GNUNET_GE_USER | GNUNET_GE_BULK,
+                                 "unlink", fn);
+}
+
+/**
+ * Read the HELLO of the given host for the given protocol
+ * from data/hosts.  Files with invalid HELLOs are removed.
+ *
+ * @return NULL if we have no (valid) HELLO
+ */
+static GNUNET_MessageHello *
+load_hello (const GNUNET_PeerIdentity * hostId, unsigned short protocol)
+{
+  GNUNET_MessageHello buffer;
+  GNUNET_MessageHello *result;
+  GNUNET_PeerIdentity have;
+  char *fn;
+  int size;
+
+  fn = get_host_filename (hostId, protocol);
+  if (GNUNET_YES != GNUNET_disk_file_test (ectx, fn))
+    {
+      GNUNET_free (fn);
+      return NULL;
+    }
+  size =
+    GNUNET_disk_file_read (ectx, fn, sizeof (GNUNET_MessageHello), &buffer);
+  if ((size != sizeof (GNUNET_MessageHello)) ||
+      (ntohs (buffer.protocol) != protocol))
+    {
+      remove_invalid_hello (fn);
+      GNUNET_free (fn);
+      return NULL;
+    }
+  result = GNUNET_malloc (GNUNET_sizeof_hello (&buffer));
+  size =
+    GNUNET_disk_file_read (ectx, fn, GNUNET_sizeof_hello (&buffer), result);
+  getPeerIdentity (&result->publicKey, &have);
+  if (((unsigned int) size != GNUNET_sizeof_hello (&buffer)) ||
+      (0 != memcmp (&have,
+                    hostId,
+                    sizeof (GNUNET_PeerIdentity))) ||
+      (0 !=
+       memcmp (&have, &result->senderIdentity, sizeof (GNUNET_PeerIdentity))))
+    {
+      remove_invalid_hello (fn);
+      GNUNET_free (fn);
+      GNUNET_free (result);
+      return NULL;
+    }
+  GNUNET_free (fn);
+  return result;
+}
+
+/**
+ * Find the cached HELLO of a host for the given protocol.
+ * Call only when synchronized!
+ *
+ * @return NULL if we do not have a HELLO for the protocol
+ */
+static GNUNET_MessageHello *
+lookup_hello (HostEntry * host, unsigned short protocol)
+{
+  int i;
+
+  for (i = 0; i < host->helloCount; i++)
+    if (ntohs (host->hellos[i]->protocol) == protocol)
+      return host->hellos[i];
+  return NULL;
+}
+
+/**
+ * Put a copy of the given HELLO into the cache of the
+ * host, replacing the HELLO for the same protocol (if any).
+ * Call only when synchronized!
+ */
+static void
+cache_hello (HostEntry * host, const GNUNET_MessageHello * msg)
+{
+  int i;
+
+  for (i = 0; i < host->helloCount; i++)
+    {
+      if (msg->protocol == host->hellos[i]->protocol)
+        {
+          GNUNET_free (host->hellos[i]);
+          host->hellos[i] = NULL;
+          break;
+        }
+    }
+  if (i == host->helloCount)
+    GNUNET_array_grow (host->hellos, host->helloCount, host->helloCount + 1);
+  host->hellos[i] = GNUNET_malloc (GNUNET_sizeof_hello (msg));
+  memcpy (host->hellos[i], msg, GNUNET_sizeof_hello (msg));
+}
+
 /**
  * Remove a file that should not be there.  LOG
  * success or failure.
@@ -339,20 +549,26 @@ remove_garbage (const char *fullname)
 }
 
 
+/**
+ * Get the identity and protocol of the peer from the name of a
+ * HELLO file (of the form DIRECTORY/HOSTID.PROTOCOL).  Files
+ * that do not match this convention are removed.
+ *
+ * @return GNUNET_OK on success, GNUNET_SYSERR if the name is invalid
+ */
 static int
-hosts_directory_scan_callback (void *unused, const char *fullname)
+parse_host_filename (const char *fullname,
+                     GNUNET_PeerIdentity * identity,
+                     unsigned short *protocol)
 {
-  GNUNET_PeerIdentity identity;
   GNUNET_EncName id;
   unsigned int protoNumber;
   const char *filename;
 
-  if (GNUNET_disk_file_test (ectx, fullname) != GNUNET_YES)
-    return GNUNET_OK;           /* ignore non-files */
   if (strlen (fullname) < sizeof (GNUNET_EncName))
     {
       remove_garbage (fullname);
-      return GNUNET_OK;
+      return GNUNET_SYSERR;
     }
   filename = &fullname[strlen (fullname) + 1 - sizeof (GNUNET_EncName)];
   while ((filename[-1] != DIR_SEPARATOR) && (filename > fullname))
@@ -360,34 +576,85 @@ hosts_directory_scan_callback (void *unused, const char *fullname)
   if (filename[-1] != DIR_SEPARATOR)
     {
       remove_garbage (fullname);
-      return GNUNET_OK;
+      return GNUNET_SYSERR;
     }
-  GNUNET_GE_ASSERT (ectx, numberOfHosts_ <= sizeOfHosts_);
   GNUNET_GE_ASSERT (ectx, sizeof (GNUNET_EncName) == 104);
   if (2 != sscanf (filename, "%103c.%u", (char *) &id, &protoNumber))
     {
       remove_garbage (fullname);
-      return GNUNET_OK;
+      return GNUNET_SYSERR;
     }
   id.encoding[sizeof (GNUNET_EncName) - 1] = '\0';
-  if (GNUNET_OK != GNUNET_enc_to_hash ((char *) &id, &identity.hashPubKey))
+  if (GNUNET_OK != GNUNET_enc_to_hash ((char *) &id, &identity->hashPubKey))
     {
       remove_garbage (fullname);
-      return GNUNET_OK;
+      return GNUNET_SYSERR;
     }
-  add_host_to_known_hosts (&identity, (unsigned short) protoNumber);
+  *protocol = (unsigned short) protoNumber;
   return GNUNET_OK;
 }
 
 /**
- * Call this method periodically to scan data/hosts for new hosts.
+ * Import a HELLO that was copied into data/hosts into
+ * the host database.
+ */
+static int
+hosts_directory_scan_callback (void *unused, const char *fullname)
+{
+  GNUNET_PeerIdentity identity;
+  unsigned short protocol;
+  GNUNET_MessageHello *hello;
+  GNUNET_MessageHello *old;
+  HostEntry *entry;
+  int i;
+
+  if (GNUNET_disk_file_test (ectx, fullname) != GNUNET_YES)
+    return GNUNET_OK;           /* ignore non-files */
+  if (GNUNET_OK != parse_host_filename (fullname, &identity, &protocol))
+    return GNUNET_OK;
+  GNUNET_GE_ASSERT (ectx, numberOfHosts_ <= sizeOfHosts_);
+  GNUNET_mutex_lock (lock_);
+  entry = lookup_host_entry (&identity);
+  if (entry != NULL)
+    {
+      for (i = 0; i < entry->protocolCount; i++)
+        {
+          if (entry->protocols[i] == protocol)
+            {
+              GNUNET_mutex_unlock (lock_);
+              return GNUNET_OK; /* already known */
+            }
+        }
+    }
+  GNUNET_mutex_unlock (lock_);
+  hello = load_hello (&identity, protocol);
+  if (hello == NULL)
+    return GNUNET_OK;
+  GNUNET_mutex_lock (lock_);
+  add_host_to_known_hosts (&identity, protocol);
+  entry = lookup_host_entry (&identity);
+  old = lookup_hello (entry, protocol);
+  if ((old == NULL) ||
+      (ntohl (old->expiration_time) < ntohl (hello->expiration_time)))
+    {
+      cache_hello (entry, hello);
+      entry->lastHello = (unsigned int) time (NULL);
+      hostdb_put_hello (hostDB, hello, entry->lastHello);
+    }
+  GNUNET_mutex_unlock (lock_);
+  GNUNET_free (hello);
+  return GNUNET_OK;
+}
+
+/**
+ * Call this method periodically to import HELLOs that
+ * were copied into data/hosts.
  */
 static void
 cronScanDirectoryDataHosts (void *unused)
 {
   static GNUNET_CronTime lastRun;
   static int retries;
-  int count;
   GNUNET_CronTime now;
 
   now = GNUNET_get_time ();
@@ -395,10 +662,9 @@ cronScanDirectoryDataHosts (void *unused)
     return;                     /* prevent scanning more than
                                    once every 5 min */
   lastRun = now;
-  count =
-    GNUNET_disk_directory_scan (ectx, networkIdDirectory,
-                                &hosts_directory_scan_callback, NULL);
-  if (count <= 0)
+  GNUNET_disk_directory_scan (ectx, networkIdDirectory,
+                              &hosts_directory_scan_callback, NULL);
+  if (numberOfHosts_ == 0)
     {
       retries++;
       if ((retries & 32) > 0)
@@ -412,20 +678,95 @@ cronScanDirectoryDataHosts (void *unused)
   GNUNET_GE_ASSERT (ectx, numberOfHosts_ <= sizeOfHosts_);
 }
 
+/**
+ * Move a HELLO file of an older version into the host database.
+ *
+ * @param cls the host database
+ */
+static int
+migrate_hello_callback (void *cls, const char *fullname)
+{
+  struct HostDB *db = cls;
+  GNUNET_PeerIdentity identity;
+  unsigned short protocol;
+  GNUNET_MessageHello *hello;
+  struct stat st;
+
+  if (GNUNET_disk_file_test (ectx, fullname) != GNUNET_YES)
+    return GNUNET_OK;
+  if (GNUNET_OK != parse_host_filename (fullname, &identity, &protocol))
+    return GNUNET_OK;
+  hello = load_hello (&identity, protocol);
+  if (hello == NULL)
+    return GNUNET_OK;
+  if (0 != STAT (fullname, &st))
+    st.st_mtime = time (NULL);
+  if (GNUNET_OK ==
+      hostdb_put_hello (db, hello, (unsigned int) st.st_mtime))
+    UNLINK (fullname);
+  GNUNET_free (hello);
+  return GNUNET_OK;
+}
+
+/**
+ * Move a trust file of an older version into the host database.
+ *
+ * @param cls the host database
+ */
+static int
+migrate_trust_callback (void *cls, const char *fullname)
+{
+  struct HostDB *db = cls;
+  GNUNET_PeerIdentity identity;
+  const char *filename;
+  unsigned int trust;
+
+  filename = strrchr (fullname, DIR_SEPARATOR);
+  filename = (filename == NULL) ? fullname : filename + 1;
+  if ((strlen (filename) != sizeof (GNUNET_EncName) - 1) ||
+      (GNUNET_OK != GNUNET_enc_to_hash (filename, &identity.hashPubKey)) ||
+      (sizeof (unsigned int) !=
+       GNUNET_disk_file_read (ectx, fullname, sizeof (unsigned int), &trust)))
+    {
+      UNLINK (fullname);
+      return GNUNET_OK;
+    }
+  trust = ntohl (trust) & TRUST_ACTUAL_MASK;
+  if ((trust == 0) || (GNUNET_OK == hostdb_put_trust (db, &identity, trust)))
+    UNLINK (fullname);
+  return GNUNET_OK;
+}
 
 /**
- * Obtain identity from publicPrivateKey.
- * @param pubKey the public key of the host
- * @param result address where to write the identity of the node
+ * Move HELLOs and trust values that older versions stored
+ * in one file per peer (in data/hosts and data/credit) into
+ * the host database.
  */
 static void
-getPeerIdentity (const GNUNET_RSA_PublicKey * pubKey,
-                 GNUNET_PeerIdentity * result)
+migrate_legacy_hosts ()
 {
-  if (pubKey == NULL)
-    memset (&result, 0, sizeof (GNUNET_PeerIdentity));
-  else
-    GNUNET_hash (pubKey, sizeof (GNUNET_RSA_PublicKey), &result->hashPubKey);
+  struct HostDB *db;
+  int count;
+
+  db = hostdb_open (ectx, hostDBFile, NULL, NULL);
+  if (db == NULL)
+    return;
+  count = GNUNET_disk_directory_scan (ectx,
+                                      networkIdDirectory,
+                                      &migrate_hello_callback, db);
+  if (GNUNET_YES == GNUNET_disk_directory_test (ectx, trustDirectory))
+    {
+      GNUNET_disk_directory_scan (ectx,
+                                  trustDirectory,
+                                  &migrate_trust_callback, db);
+      RMDIR (trustDirectory);
+    }
+  if (count > 0)
+    GNUNET_GE_LOG (ectx,
+                   GNUNET_GE_INFO | GNUNET_GE_USER | GNUNET_GE_BULK,
+                   _("Moved %d HELLOs from `%s' to `%s'.\n"),
+                   count, networkIdDirectory, hostDBFile);
+  hostdb_close (db);
 }
 
 /**
@@ -449,7 +790,8 @@ addHostTemporarily (const GNUNET_MessageHello * tmp)
     }
   GNUNET_mutex_lock (lock_);
   entry = lookup_host_entry (&tmp->senderIdentity);
-  if ((entry != NULL) && (entry->helloCount > 0))
+  if ((entry != NULL) &&
+      (NULL != lookup_hello (entry, ntohs (tmp->protocol))))
     {
       GNUNET_mutex_unlock (lock_);
       return;
@@ -478,10 +820,56 @@ addHostTemporarily (const GNUNET_MessageHello * tmp)
   entry->hellos[0] = msg;
   entry->protocols[0] = ntohs (msg->protocol);
   entry->strict = GNUNET_NO;
-  entry->trust = 0;
   GNUNET_mutex_unlock (lock_);
 }
 
+/**
+ * Remove the given protocol (and the HELLO for it) from the
+ * in-memory entry of a host; the entry itself is freed once
+ * no protocols are left.  Call only when synchronized!
+ */
+static void
+remove_host_protocol (HostEntry * entry, unsigned short protocol)
+{
+  int i;
+  int j;
+
+  for (j = 0; j < entry->protocolCount; j++)
+    {
+      if (protocol == entry->protocols[j])
+        {
+          entry->protocols[j] = entry->protocols[entry->protocolCount - 1];
+          GNUNET_array_grow (entry->protocols,
+                             entry->protocolCount, entry->protocolCount - 1);
+        }
+    }
+  for (j = 0; j < entry->helloCount; j++)
+    {
+      if (protocol == ntohs (entry->hellos[j]->protocol))
+        {
+          GNUNET_free (entry->hellos[j]);
+          entry->hellos[j] = entry->hellos[entry->helloCount - 1];
+          GNUNET_array_grow (entry->hellos,
+                             entry->helloCount, entry->helloCount - 1);
+        }
+    }
+  if (entry->protocolCount == 0)
+    {
+      if (entry->helloCount > 0)
+        {
+          for (j = 0; j < entry->helloCount; j++)
+            GNUNET_free (entry->hellos[j]);
+          GNUNET_array_grow (entry->hellos, entry->helloCount, 0);
+        }
+      GNUNET_multi_hash_map_remove (hostMap,
+                                    &entry->identity.hashPubKey, entry);
+      i = entry->index;
+      hosts_[i] = hosts_[--numberOfHosts_];
+      hosts_[i]->index = i;
+      GNUNET_free (entry);
+    }
+}
+
 /**
  * Delete a host from the list.
  */
@@ -491,65 +879,28 @@ delHostFromKnown (const GNUNET_PeerIdentity * identity,
 {
   HostEntry *entry;
   char *fn;
-  int i;
-  int j;
 
   GNUNET_GE_ASSERT (ectx, numberOfHosts_ <= sizeOfHosts_);
   GNUNET_GE_ASSERT (ectx, protocol != GNUNET_TRANSPORT_PROTOCOL_NUMBER_ANY);
   GNUNET_mutex_lock (lock_);
-  for (i = 0; i < numberOfHosts_; i++)
+  entry = lookup_host_entry (identity);
+  if (entry == NULL)
     {
-      if ((0 == memcmp (identity,
-                        &hosts_[i]->identity, sizeof (GNUNET_PeerIdentity))))
-        {
-          entry = hosts_[i];
-          for (j = 0; j < entry->protocolCount; j++)
-            {
-              if (protocol == entry->protocols[j])
-                {
-                  entry->protocols[j]
-                    = entry->protocols[entry->protocolCount - 1];
-                  GNUNET_array_grow (entry->protocols,
-                                     entry->protocolCount,
-                                     entry->protocolCount - 1);
-                }
-            }
-          for (j = 0; j < entry->helloCount; j++)
-            {
-              if (protocol == ntohs (entry->hellos[j]->protocol))
-                {
-                  GNUNET_free (entry->hellos[j]);
-                  entry->hellos[j] = entry->hellos[entry->helloCount - 1];
-                  GNUNET_array_grow (entry->hellos,
-                                     entry->helloCount,
-                                     entry->helloCount - 1);
-                }
-            }
-          /* also remove hello file itself */
-          fn = get_host_filename (identity, protocol);
-          if (0 != UNLINK (fn))
-            GNUNET_GE_LOG_STRERROR_FILE (ectx,
-                                         GNUNET_GE_WARNING | GNUNET_GE_USER |
-                                         GNUNET_GE_BULK, "unlink", fn);
-          GNUNET_free (fn);
-
-          if (entry->protocolCount == 0)
-            {
-              if (entry->helloCount > 0)
-                {
-                  for (j = 0; j < entry->helloCount; j++)
-                    GNUNET_free (entry->hellos[j]);
-                  GNUNET_array_grow (entry->hellos, entry->helloCount, 0);
-                }
-              hosts_[i] = hosts_[--numberOfHosts_];
-              GNUNET_free (entry);
-            }
-          GNUNET_mutex_unlock (lock_);
-          GNUNET_GE_ASSERT (ectx, numberOfHosts_ <= sizeOfHosts_);
-          return;               /* deleted */
-        }
+      GNUNET_mutex_unlock (lock_);
+      return;
     }
+  hostdb_delete (hostDB, identity, protocol);
+  /* also remove hello file if it was copied into data/hosts
+     (otherwise we would import it again) */
+  fn = get_host_filename (identity, protocol);
+  if ((0 != UNLINK (fn)) && (errno != ENOENT))
+    GNUNET_GE_LOG_STRERROR_FILE (ectx,
+                                 GNUNET_GE_WARNING | GNUNET_GE_USER |
+                                 GNUNET_GE_BULK, "unlink", fn);
+  GNUNET_free (fn);
+  remove_host_protocol (entry, protocol);
   GNUNET_mutex_unlock (lock_);
+  GNUNET_GE_ASSERT (ectx, numberOfHosts_ <= sizeOfHosts_);
 }
 
 /**
@@ -559,12 +910,8 @@ delHostFromKnown (const GNUNET_PeerIdentity * identity,
 static void
 bindAddress (const GNUNET_MessageHello * msg)
 {
-  char *fn;
-  char *buffer;
   GNUNET_MessageHello *oldMsg;
-  int size;
   HostEntry *host;
-  int i;
   GNUNET_PeerIdentity have;
 
   getPeerIdentity (&msg->publicKey, &have);
@@ -575,48 +922,26 @@ bindAddress (const GNUNET_MessageHello * msg)
     }
   GNUNET_GE_ASSERT (ectx, numberOfHosts_ <= sizeOfHosts_);
   GNUNET_GE_ASSERT (ectx, msg != NULL);
-  fn = get_host_filename (&msg->senderIdentity, ntohs (msg->protocol));
-  buffer = GNUNET_malloc (GNUNET_MAX_BUFFER_SIZE);
-  if (GNUNET_disk_file_test (ectx, fn) == GNUNET_YES)
+  GNUNET_mutex_lock (lock_);
+  host = lookup_host_entry (&msg->senderIdentity);
+  if (host != NULL)
     {
-      size = GNUNET_disk_file_read (ectx, fn, GNUNET_MAX_BUFFER_SIZE, buffer);
-      if (size >= sizeof (GNUNET_MessageHello))
+      oldMsg = lookup_hello (host, ntohs (msg->protocol));
+      if ((oldMsg != NULL) &&
+          ((ntohl (oldMsg->expiration_time) > ntohl (msg->expiration_time))
+           || ((GNUNET_sizeof_hello (oldMsg) == GNUNET_sizeof_hello (msg))
+               && (0 == memcmp (oldMsg, msg, GNUNET_sizeof_hello (msg))))))
         {
-          oldMsg = (GNUNET_MessageHello *) buffer;
-          if ((unsigned int) size == GNUNET_sizeof_hello (oldMsg))
-            {
-              if (ntohl (oldMsg->expiration_time) >
-                  ntohl (msg->expiration_time))
-                {
-                  GNUNET_free (fn);
-                  GNUNET_free (buffer);
-                  return;       /* have more recent hello in stock */
-                }
-            }
+          GNUNET_mutex_unlock (lock_);
+          return;               /* have same or more recent hello in stock */
         }
     }
-  GNUNET_disk_file_write (ectx, fn, msg, GNUNET_sizeof_hello (msg), "644");
-  GNUNET_free (fn);
-  GNUNET_free (buffer);
-
-  GNUNET_mutex_lock (lock_);
   add_host_to_known_hosts (&msg->senderIdentity, ntohs (msg->protocol));
   host = lookup_host_entry (&msg->senderIdentity);
   GNUNET_GE_ASSERT (ectx, host != NULL);
-
-  for (i = 0; i < host->helloCount; i++)
-    {
-      if (msg->protocol == host->hellos[i]->protocol)
-        {
-          GNUNET_free (host->hellos[i]);
-          host->hellos[i] = NULL;
-          break;
-        }
-    }
-  if (i == host->helloCount)
-    GNUNET_array_grow (host->hellos, host->helloCount, host->helloCount + 1);
-  host->hellos[i] = GNUNET_malloc (GNUNET_sizeof_hello (msg));
-  memcpy (host->hellos[i], msg, GNUNET_sizeof_hello (msg));
+  cache_hello (host, msg);
+  host->lastHello = (unsigned int) time (NULL);
+  hostdb_put_hello (hostDB, msg, host->lastHello);
   GNUNET_mutex_unlock (lock_);
   GNUNET_GE_ASSERT (ectx, numberOfHosts_ <= sizeOfHosts_);
 }
@@ -638,11 +963,8 @@ identity2Hello (const GNUNET_PeerIdentity * hostId,
                 unsigned short protocol, int tryTemporaryList)
 {
   GNUNET_MessageHello *result;
+  GNUNET_MessageHello *hello;
   HostEntry *host;
-  char *fn;
-  GNUNET_MessageHello buffer;
-  GNUNET_PeerIdentity have;
-  int size;
   int i;
   int j;
 
@@ -683,95 +1005,32 @@ identity2Hello (const GNUNET_PeerIdentity * hostId,
               memcpy (result, host->hellos[j],
                       GNUNET_sizeof_hello (host->hellos[j]));
               GNUNET_mutex_unlock (lock_);
-              return result;
-            }
-        }
-    }
-
-  host = lookup_host_entry (hostId);
-  if ((host == NULL) || (host->protocolCount == 0))
-    {
-      GNUNET_mutex_unlock (lock_);
-      return NULL;
-    }
-
-  if (protocol == GNUNET_TRANSPORT_PROTOCOL_NUMBER_ANY)
-    protocol =
-      host->protocols[GNUNET_random_u32
-                      (GNUNET_RANDOM_QUALITY_WEAK, host->protocolCount)];
-
-  for (i = 0; i < host->helloCount; i++)
-    {
-      if (ntohs (host->hellos[i]->protocol) == protocol)
-        {
-          result = GNUNET_malloc (GNUNET_sizeof_hello (host->hellos[i]));
-          memcpy (result,
-                  host->hellos[i], GNUNET_sizeof_hello (host->hellos[i]));
-          GNUNET_mutex_unlock (lock_);
-          return result;
-        }
-    }
-
-  /* do direct read */
-  fn = get_host_filename (hostId, protocol);
-  if (1 != GNUNET_disk_file_test (ectx, fn))
-    {
-      GNUNET_free (fn);
-      GNUNET_mutex_unlock (lock_);
-      return NULL;
+              return result;
+            }
+        }
     }
-  size =
-    GNUNET_disk_file_read (ectx, fn, sizeof (GNUNET_MessageHello), &buffer);
-  if (size != sizeof (GNUNET_MessageHello))
+
+  host = lookup_host_entry (hostId);
+  if ((host == NULL) || (host->protocolCount == 0))
     {
-      if (0 == UNLINK (fn))
-        GNUNET_GE_LOG (ectx,
-                       GNUNET_GE_WARNING | GNUNET_GE_USER | GNUNET_GE_BULK,
-                       _
-                       ("Removed file `%s' containing invalid HELLO data.\n"),
-                       fn);
-      else
-        GNUNET_GE_LOG_STRERROR_FILE (ectx,
-                                     GNUNET_GE_ERROR | GNUNET_GE_ADMIN |
-                                     GNUNET_GE_USER | GNUNET_GE_BULK,
-                                     "unlink", fn);
-      GNUNET_free (fn);
       GNUNET_mutex_unlock (lock_);
       return NULL;
     }
-  result = GNUNET_malloc (GNUNET_sizeof_hello (&buffer));
-  size =
-    GNUNET_disk_file_read (ectx, fn, GNUNET_sizeof_hello (&buffer), result);
-  getPeerIdentity (&result->publicKey, &have);
-  if (((unsigned int) size != GNUNET_sizeof_hello (&buffer)) ||
-      (0 != memcmp (&have,
-                    hostId,
-                    sizeof (GNUNET_PeerIdentity))) ||
-      (0 !=
-       memcmp (&have, &result->senderIdentity, sizeof (GNUNET_PeerIdentity))))
+
+  if (protocol == GNUNET_TRANSPORT_PROTOCOL_NUMBER_ANY)
+    protocol =
+      host->protocols[GNUNET_random_u32
+                      (GNUNET_RANDOM_QUALITY_WEAK, host->protocolCount)];
+
+  /* all HELLOs of known hosts are kept in memory */
+  hello = lookup_hello (host, protocol);
+  if (hello == NULL)
     {
-      if (0 == UNLINK (fn))
-        GNUNET_GE_LOG (ectx,
-                       GNUNET_GE_WARNING | GNUNET_GE_USER | GNUNET_GE_BULK,
-                       _
-                       ("Removed file `%s' containing invalid HELLO data.\n"),
-                       fn);
-      else
-        GNUNET_GE_LOG_STRERROR_FILE (ectx,
-                                     GNUNET_GE_ERROR | GNUNET_GE_ADMIN |
-                                     GNUNET_GE_USER | GNUNET_GE_BULK,
-                                     "unlink", fn);
-      GNUNET_free (fn);
-      GNUNET_free (result);
       GNUNET_mutex_unlock (lock_);
       return NULL;
     }
-  GNUNET_free (fn);
-  GNUNET_array_grow (host->hellos, host->helloCount, host->helloCount + 1);
-  host->hellos[host->helloCount - 1]
-    = GNUNET_malloc (GNUNET_sizeof_hello (&buffer));
-  memcpy (host->hellos[host->helloCount - 1],
-          result, GNUNET_sizeof_hello (&buffer));
+  result = GNUNET_malloc (GNUNET_sizeof_hello (hello));
+  memcpy (result, hello, GNUNET_sizeof_hello (hello));
   GNUNET_mutex_unlock (lock_);
   return result;
 }
@@ -837,6 +1096,8 @@ blacklistHost (const GNUNET_PeerIdentity * identity,
   GNUNET_EncName hn;
   HostEntry *entry;
   int i;
+  unsigned int slot;
+  unsigned int until;
   GNUNET_CronTime now;
 
   GNUNET_GE_ASSERT (ectx, numberOfHosts_ <= sizeOfHosts_);
@@ -886,6 +1147,14 @@ blacklistHost (const GNUNET_PeerIdentity * identity,
     entry->delta = 4 * GNUNET_CRON_HOURS;
   entry->until = now + entry->delta;
   entry->strict = strict;
+  slot = blacklist_filter_slot (identity);
+  until =
+    (unsigned int) ((entry->until + GNUNET_CRON_SECONDS -
+                     1) / GNUNET_CRON_SECONDS);
+  if (blacklistFilter[slot] < until)
+    blacklistFilter[slot] = until;
+  if ((strict == GNUNET_YES) && (strictBlacklistFilter[slot] < until))
+    strictBlacklistFilter[slot] = until;
   GNUNET_hash_to_enc (&identity->hashPubKey, &hn);
 #if DEBUG_IDENTITY
   GNUNET_GE_LOG (ectx,
@@ -901,6 +1170,9 @@ blacklistHost (const GNUNET_PeerIdentity * identity,
 
 /**
  * Is the host currently blacklisted (i.e. we refuse to talk)?
+ * This is called for every message that we receive, so the
+ * common case (host not blacklisted) is answered from the
+ * blacklist filters without acquiring the lock.
  *
  * @param identity host to check
  * @return GNUNET_YES if true, else GNUNET_NO
@@ -910,8 +1182,17 @@ isBlacklisted (const GNUNET_PeerIdentity * identity, int strict)
 {
   GNUNET_CronTime now;
   HostEntry *entry;
+  unsigned int slot;
+  unsigned int until;
 
-  GNUNET_GE_ASSERT (ectx, numberOfHosts_ <= sizeOfHosts_);
+  slot = blacklist_filter_slot (identity);
+  if (strict == GNUNET_NO)
+    until = blacklistFilter[slot];
+  else
+    until = strictBlacklistFilter[slot];
+  now = GNUNET_get_time ();
+  if (now / GNUNET_CRON_SECONDS >= until)
+    return GNUNET_NO;
   GNUNET_mutex_lock (lock_);
   entry = lookup_host_entry (identity);
   if (entry == NULL)
@@ -919,7 +1200,6 @@ isBlacklisted (const GNUNET_PeerIdentity * identity, int strict)
       GNUNET_mutex_unlock (lock_);
       return GNUNET_NO;
     }
-  now = GNUNET_get_time ();
   if ((now < entry->until)
       && ((entry->strict == GNUNET_YES) || (strict == GNUNET_NO)))
     {
@@ -1092,96 +1372,145 @@ forEachHost (GNUNET_CronTime now, GNUNET_HostProcessor callback, void *data)
 }
 
 /**
- * Write host-trust information to a file - flush the buffer entry!
- * Assumes synchronized access.
+ * Write host-trust information to the host database - flush the
+ * buffer entry!  Assumes synchronized access.
  */
-static void
-flushHostCredit (HostEntry * host)
+static int
+flushHostCredit (const GNUNET_HashCode * key, void *value, void *cls)
 {
-  GNUNET_EncName fil;
-  char *fn;
-  unsigned int trust;
+  TrustEntry *entry = value;
 
-  if ((host->trust & TRUST_REFRESH_MASK) == 0)
-    return;                     /* unchanged */
-  host->trust = host->trust & TRUST_ACTUAL_MASK;
-  GNUNET_hash_to_enc (&host->identity.hashPubKey, &fil);
-  fn = GNUNET_malloc (strlen (trustDirectory) + sizeof (GNUNET_EncName) + 1);
-  strcpy (fn, trustDirectory);
-  strcat (fn, (char *) &fil);
-  if (host->trust == 0)
-    {
-      if ((0 != UNLINK (fn)) && (errno != ENOENT))
-        GNUNET_GE_LOG_STRERROR_FILE (ectx,
-                                     GNUNET_GE_WARNING | GNUNET_GE_USER |
-                                     GNUNET_GE_BULK, "unlink", fn);
-    }
-  else
-    {
-      trust = htonl (host->trust);
-      GNUNET_disk_file_write (ectx, fn, &trust, sizeof (unsigned int), "644");
-    }
-  GNUNET_free (fn);
+  if ((entry->trust & TRUST_REFRESH_MASK) == 0)
+    return GNUNET_OK;           /* unchanged */
+  entry->trust = entry->trust & TRUST_ACTUAL_MASK;
+  hostdb_put_trust (hostDB, &entry->identity, entry->trust);
+  return GNUNET_OK;
 }
 
 /**
- * Call once in a while to synchronize trust values with the disk.
+ * Write a trust value into the host database (during compaction).
  */
-static void
-cronFlushTrustBuffer (void *unused)
+static int
+write_trust_record (const GNUNET_HashCode * key, void *value, void *cls)
+{
+  struct HostDB *db = cls;
+  TrustEntry *entry = value;
+
+  if ((entry->trust & TRUST_ACTUAL_MASK) == 0)
+    return GNUNET_OK;
+  if (GNUNET_OK != hostdb_put_trust (db,
+                                     &entry->identity,
+                                     entry->trust & TRUST_ACTUAL_MASK))
+    return GNUNET_SYSERR;
+  return GNUNET_OK;
+}
+
+/**
+ * Write all HELLOs and trust values that we have in memory
+ * into the host database (during compaction).
+ */
+static int
+write_host_db (struct HostDB *db, void *unused)
 {
+  HostEntry *entry;
   int i;
-  GNUNET_mutex_lock (lock_);
+  int j;
+
   for (i = 0; i < numberOfHosts_; i++)
-    flushHostCredit (hosts_[i]);
-  GNUNET_mutex_unlock (lock_);
+    {
+      entry = hosts_[i];
+      for (j = 0; j < entry->helloCount; j++)
+        if (GNUNET_OK !=
+            hostdb_put_hello (db, entry->hellos[j], entry->lastHello))
+          return GNUNET_SYSERR;
+    }
+  if (GNUNET_SYSERR ==
+      GNUNET_multi_hash_map_iterate (trustMap, &write_trust_record, db))
+    return GNUNET_SYSERR;
+  return GNUNET_OK;
 }
 
 /**
- * @brief delete expired HELLO entries in data/hosts/
+ * Add the size of the trust record for the given entry
+ * (if any) to the live size of the host database.
  */
 static int
-discardHostsHelper (void *now, const char *fn)
+count_trust_record (const GNUNET_HashCode * key, void *value, void *cls)
 {
-  struct stat hostStat;
-  int hostFile;
+  unsigned long long *live = cls;
+  TrustEntry *entry = value;
 
-  hostFile = GNUNET_disk_file_open (ectx, fn, O_WRONLY);
-  if (hostFile != -1)
-    {
-      if (FSTAT (hostFile, &hostStat) == 0)
-        {
-          CLOSE (hostFile);
+  if ((entry->trust & TRUST_ACTUAL_MASK) != 0)
+    *live += hostdb_trust_record_size ();
+  return GNUNET_OK;
+}
 
-          if (hostStat.st_mtime +
-              (CRON_DISCARDS_HOSTS_AFTER / GNUNET_CRON_SECONDS) <
-              *((time_t *) now))
-            UNLINK (fn);
-        }
-      else
-      {
-        CLOSE (hostFile);
-        GNUNET_GE_LOG_STRERROR_FILE (ectx,
-                                     GNUNET_GE_ERROR | GNUNET_GE_USER |
-                                     GNUNET_GE_BULK, "unlink", fn);
-        return GNUNET_SYSERR;
-      }
+/**
+ * Rewrite the host database if most of it is taken up by
+ * records that have been overridden.  Call only when
+ * synchronized!
+ */
+static void
+compact_host_db ()
+{
+  unsigned long long live;
+  HostEntry *entry;
+  int i;
+  int j;
+
+  live = 0;
+  for (i = 0; i < numberOfHosts_; i++)
+    {
+      entry = hosts_[i];
+      for (j = 0; j < entry->helloCount; j++)
+        live += hostdb_hello_record_size (entry->hellos[j]);
     }
-  return GNUNET_OK;
+  GNUNET_multi_hash_map_iterate (trustMap, &count_trust_record, &live);
+  if (live * 100 >= hostdb_get_size (hostDB) * HOST_DB_MIN_USE)
+    return;
+  hostdb_compact (hostDB, &write_host_db, NULL);
+}
+
+/**
+ * Call once in a while to synchronize trust values with the disk.
+ */
+static void
+cronFlushTrustBuffer (void *unused)
+{
+  GNUNET_mutex_lock (lock_);
+  GNUNET_multi_hash_map_iterate (trustMap, &flushHostCredit, NULL);
+  compact_host_db ();
+  GNUNET_mutex_unlock (lock_);
 }
 
 /**
- * @brief scan host directory for expired entries
+ * @brief delete HELLOs of hosts that we have not heard
+ * from for a long time
  */
 static void
 cronDiscardHosts (void *unused)
 {
-  time_t timeNow;
+  HostEntry *entry;
+  GNUNET_PeerIdentity peer;
+  unsigned int limit;
+  int i;
 
-  timeNow = time (NULL);
-  GNUNET_disk_directory_scan (ectx,
-                              networkIdDirectory,
-                              &discardHostsHelper, (void *) &timeNow);
+  limit =
+    (unsigned int) (time (NULL) -
+                    CRON_DISCARDS_HOSTS_AFTER / GNUNET_CRON_SECONDS);
+  GNUNET_mutex_lock (lock_);
+  for (i = numberOfHosts_ - 1; i >= 0; i--)
+    {
+      entry = hosts_[i];
+      if ((entry->helloCount == 0) || (entry->lastHello >= limit))
+        continue;
+      peer = entry->identity;
+      /* deleting the last protocol frees the entry */
+      while ((NULL != (entry = lookup_host_entry (&peer))) &&
+             (entry->helloCount > 0))
+        delHostFromKnown (&peer, ntohs (entry->hellos[0]->protocol));
+    }
+  GNUNET_mutex_unlock (lock_);
 }
 
 
@@ -1243,6 +1572,7 @@ identityRequestHelloHandler (struct GNUNET_ClientHandle *sock,
     GNUNET_TRANSPORT_PROTOCOL_NUMBER_HTTP,
     GNUNET_TRANSPORT_PROTOCOL_NUMBER_SMTP,
     GNUNET_TRANSPORT_PROTOCOL_NUMBER_NAT,
+    GNUNET_TRANSPORT_PROTOCOL_NUMBER_LOOPBACK,
     0,
   };
   GNUNET_Transport_ServiceAPI *tapi;
@@ -1305,7 +1635,7 @@ hostInfoIterator (const GNUNET_PeerIdentity * identity,
   unsigned int len;
   unsigned int bpm;
   GNUNET_CronTime last;
-  HostEntry *he;
+  TrustEntry *te;
 
   if (confirmed == GNUNET_NO)
     return GNUNET_OK;
@@ -1341,11 +1671,13 @@ hostInfoIterator (const GNUNET_PeerIdentity * identity,
   reply->header.type = htons (GNUNET_CS_PROTO_IDENTITY_INFO);
   reply->peer = *identity;
   reply->last_message = GNUNET_htonll (last);
-  he = lookup_host_entry (identity);
-  if (he != NULL)    
-    reply->trust = htonl (he->trust & TRUST_ACTUAL_MASK);
+  GNUNET_mutex_lock (lock_);
+  te = lookup_trust_entry (identity);
+  if (te != NULL)
+    reply->trust = htonl (te->trust & TRUST_ACTUAL_MASK);
   else
     reply->trust = htonl (0);
+  GNUNET_mutex_unlock (lock_);
   reply->bpm = htonl (bpm);
   memcpy (&reply[1], address, len);
   GNUNET_free_non_null (address);
@@ -1363,6 +1695,146 @@ identityRequestInfoHandler (struct GNUNET_ClientHandle *sock,
 }
 
 
+/**
+ * Process a record of the host database when loading it.
+ */
+static void
+load_host_record (void *cls,
+                  unsigned int type,
+                  const GNUNET_PeerIdentity * peer,
+                  unsigned int value,
+                  unsigned int timestamp, const GNUNET_MessageHello * hello)
+{
+  HostEntry *entry;
+  TrustEntry *trust;
+  GNUNET_PeerIdentity have;
+
+  switch (type)
+    {
+    case HOSTDB_RECORD_HELLO:
+      getPeerIdentity (&hello->publicKey, &have);
+      if (0 != memcmp (&have, peer, sizeof (GNUNET_PeerIdentity)))
+        break;                  /* invalid, dropped by the next compaction */
+      add_host_to_known_hosts (peer, (unsigned short) value);
+      entry = lookup_host_entry (peer);
+      cache_hello (entry, hello);
+      if (entry->lastHello < timestamp)
+        entry->lastHello = timestamp;
+      break;
+    case HOSTDB_RECORD_TRUST:
+      trust = lookup_trust_entry (peer);
+      if ((trust == NULL) && (value != 0))
+        trust = get_trust_entry (peer);
+      if (trust != NULL)
+        trust->trust = value & TRUST_ACTUAL_MASK;
+      break;
+    case HOSTDB_RECORD_DELETE:
+      entry = lookup_host_entry (peer);
+      if (entry != NULL)
+        remove_host_protocol (entry, (unsigned short) value);
+      break;
+    default:
+      GNUNET_GE_BREAK (ectx, 0);
+    }
+}
+
+/**
+ * Determine the names of the directories and files used
+ * by the identity module.
+ *
+ * @return GNUNET_OK on success, GNUNET_SYSERR on error
+ */
+static int
+get_file_names (struct GNUNET_GC_Configuration *cfg)
+{
+  char *gnHome;
+  char *tmp;
+
+  gnHome = NULL;
+  GNUNET_GE_ASSERT (ectx,
+                    -1 !=
+                    GNUNET_GC_get_configuration_value_filename (cfg,
+                                                                "GNUNETD",
+                                                                "GNUNETD_HOME",
+                                                                GNUNET_DEFAULT_DAEMON_VAR_DIRECTORY,
+                                                                &gnHome));
+  if (gnHome == NULL)
+    return GNUNET_SYSERR;
+  GNUNET_disk_directory_create (ectx, gnHome);
+  tmp = GNUNET_malloc (strlen (gnHome) + strlen (HOST_DIR) + 2);
+  strcpy (tmp, gnHome);
+  strcat (tmp, DIR_SEPARATOR_STR);
+  strcat (tmp, HOST_DIR);
+  networkIdDirectory = NULL;
+  GNUNET_GE_ASSERT (ectx,
+                    -1 !=
+                    GNUNET_GC_get_configuration_value_filename (cfg,
+                                                                "GNUNETD",
+                                                                "HOSTS", tmp,
+                                                                &networkIdDirectory));
+  GNUNET_free (tmp);
+  GNUNET_disk_directory_create (ectx, networkIdDirectory);
+  trustDirectory = GNUNET_malloc (strlen (gnHome) + strlen (TRUSTDIR) + 2);
+  strcpy (trustDirectory, gnHome);
+  strcat (trustDirectory, DIR_SEPARATOR_STR);
+  strcat (trustDirectory, TRUSTDIR);
+  hostDBFile = GNUNET_malloc (strlen (gnHome) + strlen (HOST_DB) + 2);
+  strcpy (hostDBFile, gnHome);
+  strcat (hostDBFile, DIR_SEPARATOR_STR);
+  strcat (hostDBFile, HOST_DB);
+  GNUNET_free (gnHome);
+  return GNUNET_OK;
+}
+
+static void
+free_file_names ()
+{
+  GNUNET_free (networkIdDirectory);
+  networkIdDirectory = NULL;
+  GNUNET_free (trustDirectory);
+  trustDirectory = NULL;
+  GNUNET_free (hostDBFile);
+  hostDBFile = NULL;
+}
+
+/**
+ * Free a trust entry (at shutdown).
+ */
+static int
+free_trust_entry (const GNUNET_HashCode * key, void *value, void *cls)
+{
+  GNUNET_free (value);
+  return GNUNET_OK;
+}
+
+/**
+ * Free the in-memory list of known hosts and trust values.
+ */
+static void
+free_hosts ()
+{
+  HostEntry *entry;
+  int i;
+  int j;
+
+  for (i = 0; i < numberOfHosts_; i++)
+    {
+      entry = hosts_[i];
+      for (j = 0; j < entry->helloCount; j++)
+        GNUNET_free (entry->hellos[j]);
+      GNUNET_array_grow (entry->hellos, entry->helloCount, 0);
+      GNUNET_array_grow (entry->protocols, entry->protocolCount, 0);
+      GNUNET_free (entry);
+    }
+  GNUNET_array_grow (hosts_, sizeOfHosts_, 0);
+  numberOfHosts_ = 0;
+  GNUNET_multi_hash_map_destroy (hostMap);
+  hostMap = NULL;
+  GNUNET_multi_hash_map_iterate (trustMap, &free_trust_entry, NULL);
+  GNUNET_multi_hash_map_destroy (trustMap);
+  trustMap = NULL;
+}
+
 /**
  * Provide the Identity service.
  *
@@ -1373,8 +1845,6 @@ GNUNET_Identity_ServiceAPI *
 provide_module_identity (GNUNET_CoreAPIForPlugins * capi)
 {
   static GNUNET_Identity_ServiceAPI id;
-  char *gnHome;
-  char *tmp;
   int i;
 
   coreAPI = capi;
@@ -1398,45 +1868,40 @@ provide_module_identity (GNUNET_CoreAPIForPlugins * capi)
   for (i = 0; i < MAX_TEMP_HOSTS; i++)
     memset (&tempHosts[i], 0, sizeof (HostEntry));
   numberOfHosts_ = 0;
+  for (i = 0; i < BLACKLIST_FILTER_SIZE; i++)
+    {
+      blacklistFilter[i] = 0;
+      strictBlacklistFilter[i] = 0;
+    }
 
-  gnHome = NULL;
-  GNUNET_GE_ASSERT (ectx,
-                    -1 !=
-                    GNUNET_GC_get_configuration_value_filename (coreAPI->cfg,
-                                                                "GNUNETD",
-                                                                "GNUNETD_HOME",
-                                                                GNUNET_DEFAULT_DAEMON_VAR_DIRECTORY,
-                                                                &gnHome));
-  if (gnHome == NULL)
+  if (GNUNET_OK != get_file_names (coreAPI->cfg))
     return NULL;
-  GNUNET_disk_directory_create (ectx, gnHome);
-  tmp = GNUNET_malloc (strlen (gnHome) + strlen (HOST_DIR) + 2);
-  strcpy (tmp, gnHome);
-  strcat (tmp, DIR_SEPARATOR_STR);
-  strcat (tmp, HOST_DIR);
-  networkIdDirectory = NULL;
-  GNUNET_GE_ASSERT (ectx,
-                    -1 !=
-                    GNUNET_GC_get_configuration_value_filename (coreAPI->cfg,
-                                                                "GNUNETD",
-                                                                "HOSTS", tmp,
-                                                                &networkIdDirectory));
-  GNUNET_free (tmp);
-  GNUNET_disk_directory_create (ectx, networkIdDirectory);
-  trustDirectory = GNUNET_malloc (strlen (gnHome) + strlen (TRUSTDIR) + 2);
-  strcpy (trustDirectory, gnHome);
-  strcat (trustDirectory, DIR_SEPARATOR_STR);
-  strcat (trustDirectory, TRUSTDIR);
-  GNUNET_disk_directory_create (ectx, trustDirectory);
-  GNUNET_free (gnHome);
-
+  /* first start after an upgrade from the one-file-per-peer layout? */
+  if (GNUNET_YES != GNUNET_disk_file_test (ectx, hostDBFile))
+    migrate_legacy_hosts ();
   lock_ = GNUNET_mutex_create (GNUNET_YES);
+  hostMap = GNUNET_multi_hash_map_create (1024);
+  trustMap = GNUNET_multi_hash_map_create (1024);
+  GNUNET_mutex_lock (lock_);
+  hostDB = hostdb_open (ectx, hostDBFile, &load_host_record, NULL);
+  if (hostDB != NULL)
+    compact_host_db ();
+  GNUNET_mutex_unlock (lock_);
+  if (hostDB == NULL)
+    {
+      free_hosts ();
+      GNUNET_mutex_destroy (lock_);
+      lock_ = NULL;
+      free_file_names ();
+      return NULL;
+    }
   initPrivateKey (capi->ectx, capi->cfg);
   getPeerIdentity (getPublicPrivateKey (), &myIdentity);
   cronScanDirectoryDataHosts (NULL);
-  GNUNET_cron_add_job (coreAPI->cron,
-                       &cronScanDirectoryDataHosts,
-                       CRON_DATA_HOST_FREQ, CRON_DATA_HOST_FREQ, NULL);
+  GNUNET_cron_add_parallel_job (coreAPI->cron,
+                                &cronScanDirectoryDataHosts,
+                                CRON_DATA_HOST_FREQ,
+                                CRON_DATA_HOST_FREQ, NULL);
   GNUNET_cron_add_job (coreAPI->cron,
                        &cronFlushTrustBuffer,
                        CRON_TRUST_FLUSH_FREQ, CRON_TRUST_FLUSH_FREQ, NULL);
@@ -1492,25 +1957,28 @@ release_module_identity ()
   GNUNET_cron_del_job (coreAPI->cron, &cronDiscardHosts,
                        CRON_DISCARD_HOSTS_INTERVAL, NULL);
   cronFlushTrustBuffer (NULL);
+  hostdb_close (hostDB);
+  hostDB = NULL;
   GNUNET_mutex_destroy (lock_);
   lock_ = NULL;
-  for (i = 0; i < numberOfHosts_; i++)
-    {
-      entry = hosts_[i];
-      for (j = 0; j < entry->helloCount; j++)
-        GNUNET_free (entry->hellos[j]);
-      GNUNET_array_grow (entry->hellos, entry->helloCount, 0);
-      GNUNET_array_grow (entry->protocols, entry->protocolCount, 0);
-      GNUNET_free (entry);
-    }
-  GNUNET_array_grow (hosts_, sizeOfHosts_, 0);
-  numberOfHosts_ = 0;
-
-  GNUNET_free (networkIdDirectory);
-  networkIdDirectory = NULL;
-  GNUNET_free (trustDirectory);
-  trustDirectory = NULL;
+  free_hosts ();
+  free_file_names ();
   donePrivateKey ();
 }
 
+/**
+ * Update the identity module: move HELLOs and trust values that
+ * older versions stored in one file per peer into the host
+ * database.
+ */
+void
+update_module_identity (GNUNET_UpdateAPI * uapi)
+{
+  ectx = uapi->ectx;
+  if (GNUNET_OK != get_file_names (uapi->cfg))
+    return;
+  migrate_legacy_hosts ();
+  free_file_names ();
+}
+
 /* end of identity.c */
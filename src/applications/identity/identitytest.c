@@ -39,7 +39,7 @@ static struct GNUNET_GC_Configuration *cfg;
 
 
 #define ASSERT(cond) do { \
-  if (!cond) { \
+  if (!(cond)) { \
    printf("Assertion failed at %s:%d\n", \
           __FILE__, __LINE__); \
    GNUNET_cron_stop(cron); \
@@ -55,9 +55,11 @@ runTest ()
   GNUNET_Identity_ServiceAPI *identity;
   GNUNET_Transport_ServiceAPI *transport;
   GNUNET_PeerIdentity pid;
+  GNUNET_PeerIdentity other;
   const GNUNET_RSA_PublicKey *pkey;
   GNUNET_RSA_Signature sig;
   GNUNET_MessageHello *hello;
+  unsigned short protocol;
 
   transport = GNUNET_CORE_request_service ("transport");
   identity = GNUNET_CORE_request_service ("identity");
@@ -75,6 +77,7 @@ runTest ()
     }
   identity->addHost (hello);
   pid = hello->senderIdentity;
+  protocol = ntohs (hello->protocol);
   GNUNET_free (hello);
 
   identity->changeHostTrust (&pid, -identity->getHostTrust (&pid));
@@ -95,9 +98,46 @@ runTest ()
   ASSERT (GNUNET_OK == identity->signData ("TestData", 8, &sig));
   ASSERT (GNUNET_OK == GNUNET_RSA_verify ("TestData", 8, &sig, pkey));
 
+  /* HELLOs of known hosts are served from memory */
+  hello = identity->identity2Hello (&pid,
+                                    GNUNET_TRANSPORT_PROTOCOL_NUMBER_ANY,
+                                    GNUNET_NO);
+  ASSERT (hello != NULL);
+  ASSERT (0 == memcmp (&pid, &hello->senderIdentity, sizeof (pid)));
+  GNUNET_free (hello);
+
+  /* blacklisting */
+  ASSERT (GNUNET_NO == identity->isBlacklisted (&pid, GNUNET_NO));
+  ASSERT (GNUNET_NO == identity->isBlacklisted (&pid, GNUNET_YES));
+  ASSERT (GNUNET_OK == identity->blacklistHost (&pid, 60, GNUNET_YES));
+  ASSERT (GNUNET_YES == identity->isBlacklisted (&pid, GNUNET_NO));
+  ASSERT (GNUNET_YES == identity->isBlacklisted (&pid, GNUNET_YES));
+  ASSERT (GNUNET_OK == identity->whitelistHost (&pid));
+  ASSERT (GNUNET_NO == identity->isBlacklisted (&pid, GNUNET_NO));
+  ASSERT (GNUNET_NO == identity->isBlacklisted (&pid, GNUNET_YES));
+  GNUNET_create_random_hash (&other.hashPubKey);
+  ASSERT (GNUNET_SYSERR == identity->blacklistHost (&other, 60, GNUNET_YES));
+  ASSERT (GNUNET_NO == identity->isBlacklisted (&other, GNUNET_NO));
+
+  /* trust survives restarts and the removal of the HELLOs,
+     and does not require a HELLO in the first place */
+  ASSERT (3 == identity->changeHostTrust (&other, 3));
+  ASSERT (6 == identity->changeHostTrust (&pid, 6));
+  identity->delHostFromKnown (&pid, protocol);
+  ASSERT (6 == identity->getHostTrust (&pid));
+  GNUNET_CORE_release_service (identity);
+  identity = GNUNET_CORE_request_service ("identity");
+  ASSERT (3 == identity->getHostTrust (&other));
+  ASSERT (6 == identity->getHostTrust (&pid));
+  ASSERT (NULL == identity->identity2Hello (&other,
+                                            GNUNET_TRANSPORT_PROTOCOL_NUMBER_ANY,
+                                            GNUNET_NO));
+  ASSERT (-3 == identity->changeHostTrust (&other, -3));
+  ASSERT (-6 == identity->changeHostTrust (&pid, -6));
+
   /* to test:
      hello verification, temporary storage,
-     permanent storage, blacklisting, etc. */
+     permanent storage, etc. */
   GNUNET_cron_stop (cron);
   GNUNET_CORE_release_service (identity);
   GNUNET_CORE_release_service (transport);
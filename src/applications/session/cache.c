@@ -24,61 +24,184 @@
  *   sessionkey exchange requests
  * @author Christian Grothoff
  *
- * TODO: add code to evict very old entries from the cache!
+ * Two caches are kept, both indexed by the identity of the
+ * other peer and limited to MAX_CACHE_ENTRIES (evicting the
+ * least recently used entry): the signed SETKEY messages we
+ * created (so that repeated key exchanges do not require RSA
+ * operations) and the SETKEY messages of other peers that we
+ * verified (together with the session key they contained).
  */
 #include "platform.h"
 #include "cache.h"
 
-#define MAX_CACHE_ENTRIES 8
+/**
+ * Maximum number of entries in each cache.
+ */
+#define MAX_CACHE_ENTRIES 1024
 
 struct Entry
 {
+  /**
+   * Next (less recently used) entry.
+   */
   struct Entry *next;
+
+  /**
+   * Previous (more recently used) entry.
+   */
+  struct Entry *prev;
+
+  /**
+   * The signed message (NULL for verified messages).
+   */
   GNUNET_MessageHeader *msg;
+
   GNUNET_PeerIdentity peer;
+
   GNUNET_AES_SessionKey key;
+
   GNUNET_Int32Time time_limit;
+
+  /**
+   * Digest of the signed part of a verified message.
+   */
+  GNUNET_HashCode digest;
 };
 
-static unsigned int count;
+struct Cache
+{
+  /**
+   * Map from peer identities to entries.
+   */
+  struct GNUNET_MultiHashMap *map;
 
-static struct Entry *cache;
+  /**
+   * Most recently used entry.
+   */
+  struct Entry *head;
+
+  /**
+   * Least recently used entry.
+   */
+  struct Entry *tail;
+};
+
+/**
+ * Signed SETKEY messages that we created.
+ */
+static struct Cache signed_cache;
+
+/**
+ * SETKEY messages from other peers that passed verification.
+ */
+static struct Cache verified_cache;
 
 static struct GNUNET_Mutex *lock;
 
 static void
-expire_oldest_entries ()
+unlink_entry (struct Cache *c, struct Entry *e)
+{
+  if (e->prev == NULL)
+    c->head = e->next;
+  else
+    e->prev->next = e->next;
+  if (e->next == NULL)
+    c->tail = e->prev;
+  else
+    e->next->prev = e->prev;
+}
+
+/**
+ * Mark an entry as most recently used.
+ */
+static void
+touch_entry (struct Cache *c, struct Entry *e)
+{
+  if (c->head == e)
+    return;
+  unlink_entry (c, e);
+  e->prev = NULL;
+  e->next = c->head;
+  if (c->head != NULL)
+    c->head->prev = e;
+  c->head = e;
+  if (c->tail == NULL)
+    c->tail = e;
+}
+
+/**
+ * Find the entry for a peer (and mark it as used).
+ *
+ * @return NULL if the cache has no entry for the peer
+ */
+static struct Entry *
+lookup_entry (struct Cache *c, const GNUNET_PeerIdentity * peer)
 {
   struct Entry *e;
-  struct Entry *prev;
-  GNUNET_Int32Time oldest;
 
-  oldest = -1;                  /* infinity */
-  e = cache;
-  while (e != NULL)
+  e = GNUNET_multi_hash_map_get (c->map, &peer->hashPubKey);
+  if (e != NULL)
+    touch_entry (c, e);
+  return e;
+}
+
+/**
+ * Get the entry for a peer, creating it (and evicting the
+ * least recently used entry if the cache is full) if needed.
+ */
+static struct Entry *
+get_entry (struct Cache *c, const GNUNET_PeerIdentity * peer)
+{
+  struct Entry *e;
+
+  e = lookup_entry (c, peer);
+  if (e != NULL)
+    return e;
+  if (GNUNET_multi_hash_map_size (c->map) >= MAX_CACHE_ENTRIES)
     {
-      if (e->time_limit < oldest)
-        oldest = e->time_limit;
-      e = e->next;
+      e = c->tail;
+      unlink_entry (c, e);
+      GNUNET_multi_hash_map_remove (c->map, &e->peer.hashPubKey, e);
+      GNUNET_free_non_null (e->msg);
+      GNUNET_free (e);
     }
-  e = cache;
-  prev = NULL;
-  while (e != NULL)
+  e = GNUNET_malloc (sizeof (struct Entry));
+  memset (e, 0, sizeof (struct Entry));
+  e->peer = *peer;
+  e->next = c->head;
+  if (c->head != NULL)
+    c->head->prev = e;
+  c->head = e;
+  if (c->tail == NULL)
+    c->tail = e;
+  GNUNET_multi_hash_map_put (c->map, &peer->hashPubKey, e,
+                             GNUNET_MultiHashMapOption_UNIQUE_FAST);
+  return e;
+}
+
+static void
+cache_init (struct Cache *c)
+{
+  c->map = GNUNET_multi_hash_map_create (MAX_CACHE_ENTRIES / 4);
+  c->head = NULL;
+  c->tail = NULL;
+}
+
+static void
+cache_done (struct Cache *c)
+{
+  struct Entry *e;
+
+  while (c->head != NULL)
     {
-      if (e->time_limit == oldest)
-        {
-          if (prev == NULL)
-            cache = e->next;
-          else
-            prev->next = e->next;
-          GNUNET_free (e->msg);
-          GNUNET_free (e);
-          count--;
-          return;
-        }
-      prev = e;
-      e = e->next;
+      e = c->head;
+      c->head = e->next;
+      GNUNET_free_non_null (e->msg);
+      GNUNET_free (e);
     }
+  c->tail = NULL;
+  GNUNET_multi_hash_map_destroy (c->map);
+  c->map = NULL;
 }
 
 /**
@@ -98,23 +221,17 @@ GNUNET_session_cache_get (const GNUNET_PeerIdentity * peer,
   struct Entry *e;
 
   GNUNET_mutex_lock (lock);
-  e = cache;
-  while (e != NULL)
+  e = lookup_entry (&signed_cache, peer);
+  if ((e != NULL) &&
+      (0 == memcmp (&e->key,
+                    key,
+                    sizeof (GNUNET_AES_SessionKey))) &&
+      (e->time_limit == time_limit) && (ntohs (e->msg->size) == size))
     {
-      if ((0 == memcmp (&e->peer,
-                        peer,
-                        sizeof (GNUNET_PeerIdentity))) &&
-          (0 == memcmp (&e->key,
-                        key,
-                        sizeof (GNUNET_AES_SessionKey))) &&
-          (e->time_limit == time_limit) && (ntohs (e->msg->size) == size))
-        {
-          *msg = GNUNET_malloc (ntohs (e->msg->size));
-          memcpy (*msg, e->msg, ntohs (e->msg->size));
-          GNUNET_mutex_unlock (lock);
-          return GNUNET_OK;
-        }
-      e = e->next;
+      *msg = GNUNET_malloc (ntohs (e->msg->size));
+      memcpy (*msg, e->msg, ntohs (e->msg->size));
+      GNUNET_mutex_unlock (lock);
+      return GNUNET_OK;
     }
   GNUNET_mutex_unlock (lock);
   return GNUNET_SYSERR;
@@ -136,47 +253,77 @@ GNUNET_session_cache_put (const GNUNET_PeerIdentity * peer,
   struct Entry *e;
 
   GNUNET_mutex_lock (lock);
-  e = cache;
-  while (e != NULL)
-    {
-      if (0 == memcmp (&e->peer, peer, sizeof (GNUNET_PeerIdentity)))
-        break;
-      e = e->next;
-    }
-  if (e == NULL)
-    {
-      e = GNUNET_malloc (sizeof (struct Entry));
-      e->msg = NULL;
-      e->peer = *peer;
-      e->next = cache;
-      cache = e;
-      count++;
-    }
+  e = get_entry (&signed_cache, peer);
   GNUNET_free_non_null (e->msg);
   e->key = *key;
   e->time_limit = time_limit;
   e->msg = GNUNET_malloc (ntohs (msg->size));
   memcpy (e->msg, msg, ntohs (msg->size));
-  if (count > MAX_CACHE_ENTRIES)
-    expire_oldest_entries ();
+  GNUNET_mutex_unlock (lock);
+}
+
+/**
+ * Check if a key exchange message from the given peer
+ * was verified before.
+ *
+ * @param peer the sender of the message
+ * @param digest hash of the signed part of the message
+ * @param key set to the session key from the message
+ * @return GNUNET_OK if the message was verified before
+ */
+int
+GNUNET_session_cache_verified_get (const GNUNET_PeerIdentity * peer,
+                                   const GNUNET_HashCode * digest,
+                                   GNUNET_AES_SessionKey * key)
+{
+  struct Entry *e;
+
+  GNUNET_mutex_lock (lock);
+  e = lookup_entry (&verified_cache, peer);
+  if ((e != NULL) &&
+      (0 == memcmp (&e->digest, digest, sizeof (GNUNET_HashCode))))
+    {
+      *key = e->key;
+      GNUNET_mutex_unlock (lock);
+      return GNUNET_OK;
+    }
+  GNUNET_mutex_unlock (lock);
+  return GNUNET_SYSERR;
+}
+
+/**
+ * Remember that a key exchange message from the given
+ * peer passed verification.
+ *
+ * @param peer the sender of the message
+ * @param digest hash of the signed part of the message
+ * @param key the session key from the message
+ */
+void
+GNUNET_session_cache_verified_put (const GNUNET_PeerIdentity * peer,
+                                   const GNUNET_HashCode * digest,
+                                   const GNUNET_AES_SessionKey * key)
+{
+  struct Entry *e;
+
+  GNUNET_mutex_lock (lock);
+  e = get_entry (&verified_cache, peer);
+  e->digest = *digest;
+  e->key = *key;
   GNUNET_mutex_unlock (lock);
 }
 
 void __attribute__ ((constructor)) GNUNET_session_cache_ltdl_init ()
 {
   lock = GNUNET_mutex_create (GNUNET_NO);
+  cache_init (&signed_cache);
+  cache_init (&verified_cache);
 }
 
 void __attribute__ ((destructor)) GNUNET_session_cache_ltdl_fini ()
 {
-  struct Entry *e;
-  while (cache != NULL)
-    {
-      e = cache;
-      cache = e->next;
-      GNUNET_free (e->msg);
-      GNUNET_free (e);
-    }
+  cache_done (&signed_cache);
+  cache_done (&verified_cache);
   GNUNET_mutex_destroy (lock);
   lock = NULL;
 }
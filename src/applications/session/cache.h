@@ -56,4 +56,31 @@ GNUNET_session_cache_put (const GNUNET_PeerIdentity * peer,
                           const GNUNET_AES_SessionKey * key,
                           const GNUNET_MessageHeader * msg);
 
+/**
+ * Check if a key exchange message from the given peer
+ * was verified before.
+ *
+ * @param peer the sender of the message
+ * @param digest hash of the signed part of the message
+ * @param key set to the session key from the message
+ * @return GNUNET_OK if the message was verified before
+ */
+int
+GNUNET_session_cache_verified_get (const GNUNET_PeerIdentity * peer,
+                                   const GNUNET_HashCode * digest,
+                                   GNUNET_AES_SessionKey * key);
+
+/**
+ * Remember that a key exchange message from the given
+ * peer passed verification.
+ *
+ * @param peer the sender of the message
+ * @param digest hash of the signed part of the message
+ * @param key the session key from the message
+ */
+void
+GNUNET_session_cache_verified_put (const GNUNET_PeerIdentity * peer,
+                                   const GNUNET_HashCode * digest,
+                                   const GNUNET_AES_SessionKey * key);
+
 #endif
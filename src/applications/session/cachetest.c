@@ -0,0 +1,135 @@
+/*
+     This file is part of GNUnet.
+     (C) 2008 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 2, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+     Boston, MA 02111-1307, USA.
+*/
+
+/**
+ * @file session/cachetest.c
+ * @brief testcase for the session key exchange caches
+ */
+
+#include "platform.h"
+#include "cache.h"
+
+#define ENTRIES 2000
+
+#define ASSERT(c) do { if (!(c)) { GNUNET_GE_BREAK (NULL, 0); return 1; } } while (0)
+
+static void
+makePeer (unsigned int i, GNUNET_PeerIdentity * peer)
+{
+  GNUNET_hash (&i, sizeof (i), &peer->hashPubKey);
+}
+
+static int
+testSigned ()
+{
+  GNUNET_PeerIdentity peer;
+  GNUNET_AES_SessionKey key;
+  GNUNET_AES_SessionKey other;
+  GNUNET_MessageHeader msg[2];
+  GNUNET_MessageHeader *ret;
+  unsigned int i;
+
+  GNUNET_AES_create_session_key (&key);
+  GNUNET_AES_create_session_key (&other);
+  memset (msg, 0, sizeof (msg));
+  msg[0].size = htons (sizeof (msg));
+  makePeer (0, &peer);
+  ASSERT (GNUNET_OK != GNUNET_session_cache_get (&peer, 42, &key,
+                                                 sizeof (msg), &ret));
+  GNUNET_session_cache_put (&peer, 42, &key, msg);
+  ret = NULL;
+  ASSERT (GNUNET_OK == GNUNET_session_cache_get (&peer, 42, &key,
+                                                 sizeof (msg), &ret));
+  ASSERT (0 == memcmp (ret, msg, sizeof (msg)));
+  GNUNET_free (ret);
+  ASSERT (GNUNET_OK != GNUNET_session_cache_get (&peer, 43, &key,
+                                                 sizeof (msg), &ret));
+  ASSERT (GNUNET_OK != GNUNET_session_cache_get (&peer, 42, &other,
+                                                 sizeof (msg), &ret));
+  ASSERT (GNUNET_OK != GNUNET_session_cache_get (&peer, 42, &key,
+                                                 sizeof (msg) + 1, &ret));
+  /* fill the cache; peer 0 is used all the time and must survive */
+  for (i = 1; i < ENTRIES; i++)
+    {
+      makePeer (i, &peer);
+      GNUNET_session_cache_put (&peer, i, &key, msg);
+      makePeer (0, &peer);
+      ASSERT (GNUNET_OK == GNUNET_session_cache_get (&peer, 42, &key,
+                                                     sizeof (msg), &ret));
+      GNUNET_free (ret);
+    }
+  makePeer (1, &peer);
+  ASSERT (GNUNET_OK != GNUNET_session_cache_get (&peer, 1, &key,
+                                                 sizeof (msg), &ret));
+  makePeer (ENTRIES - 1, &peer);
+  ASSERT (GNUNET_OK == GNUNET_session_cache_get (&peer, ENTRIES - 1, &key,
+                                                 sizeof (msg), &ret));
+  GNUNET_free (ret);
+  return 0;
+}
+
+static int
+testVerified ()
+{
+  GNUNET_PeerIdentity peer;
+  GNUNET_AES_SessionKey key;
+  GNUNET_AES_SessionKey ret;
+  GNUNET_HashCode digest;
+  GNUNET_HashCode other;
+
+  GNUNET_AES_create_session_key (&key);
+  GNUNET_create_random_hash (&digest);
+  GNUNET_create_random_hash (&other);
+  makePeer (0, &peer);
+  ASSERT (GNUNET_OK !=
+          GNUNET_session_cache_verified_get (&peer, &digest, &ret));
+  GNUNET_session_cache_verified_put (&peer, &digest, &key);
+  ASSERT (GNUNET_OK ==
+          GNUNET_session_cache_verified_get (&peer, &digest, &ret));
+  ASSERT (0 == memcmp (&ret, &key, sizeof (GNUNET_AES_SessionKey)));
+  ASSERT (GNUNET_OK !=
+          GNUNET_session_cache_verified_get (&peer, &other, &ret));
+  makePeer (1, &peer);
+  ASSERT (GNUNET_OK !=
+          GNUNET_session_cache_verified_get (&peer, &digest, &ret));
+  /* a new key from the same peer replaces the old one */
+  makePeer (0, &peer);
+  GNUNET_session_cache_verified_put (&peer, &other, &key);
+  ASSERT (GNUNET_OK !=
+          GNUNET_session_cache_verified_get (&peer, &digest, &ret));
+  ASSERT (GNUNET_OK ==
+          GNUNET_session_cache_verified_get (&peer, &other, &ret));
+  return 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+  int ret;
+
+  ret = testSigned ();
+  if (ret == 0)
+    ret = testVerified ();
+  if (ret != 0)
+    fprintf (stderr, "Error in session cache test\n");
+  return ret;
+}
+
+/* end of cachetest.c */
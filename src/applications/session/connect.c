@@ -43,6 +43,18 @@
 
 #define EXTRA_CHECKS ALLOW_EXTRA_CHECKS
 
+/**
+ * How many threads perform the RSA operations of key
+ * exchanges?
+ */
+#define CRYPTO_THREAD_COUNT 2
+
+/**
+ * How many key exchanges may wait for a crypto thread
+ * (further requests are dropped)?
+ */
+#define MAX_PENDING_JOBS 256
+
 static GNUNET_CoreAPIForPlugins *coreAPI;
 
 static GNUNET_Identity_ServiceAPI *identity;
@@ -71,6 +83,53 @@ static int stat_pongSent;
 
 static int stat_pingSent;
 
+static int stat_jobsDropped;
+
+/**
+ * A key exchange waiting for a crypto thread.
+ */
+struct CryptoJob
+{
+  struct CryptoJob *next;
+
+  /**
+   * Peer to connect to or sender of the message.
+   */
+  GNUNET_PeerIdentity peer;
+
+  /**
+   * SETKEY message to process, NULL to initiate
+   * a key exchange with the peer.
+   */
+  GNUNET_MessageHeader *msg;
+
+  /**
+   * Transport session the message was received
+   * on (may be NULL).
+   */
+  GNUNET_TSession *tsession;
+};
+
+/**
+ * Queue of pending key exchanges (protected by jobLock).
+ */
+static struct CryptoJob *jobHead;
+
+static struct CryptoJob *jobTail;
+
+static unsigned int jobCount;
+
+static struct GNUNET_Mutex *jobLock;
+
+/**
+ * Signaled for each queued job (and on shutdown).
+ */
+static struct GNUNET_Semaphore *jobSignal;
+
+static struct GNUNET_ThreadHandle *cryptoThreads[CRYPTO_THREAD_COUNT];
+
+static volatile int cryptoThreadsRunning;
+
 /**
  * @brief message for session key exchange.
  */
@@ -162,11 +221,14 @@ notifyPONG (void *arg)
  *
  * @param hostId the sender of the key
  * @param sks the session key message
+ * @param verified GNUNET_YES if the signature is known to be
+ *        valid (only the policy is checked)
  * @return GNUNET_SYSERR if invalid, GNUNET_OK if valid, GNUNET_NO if
  *  connections are disallowed
  */
 static int
-verifySKS (const GNUNET_PeerIdentity * hostId, const P2P_setkey_MESSAGE * sks)
+verifySKS (const GNUNET_PeerIdentity * hostId,
+           const P2P_setkey_MESSAGE * sks, int verified)
 {
   const GNUNET_RSA_Signature *signature = &sks->signature;
   char *limited;
@@ -219,6 +281,8 @@ verifySKS (const GNUNET_PeerIdentity * hostId, const P2P_setkey_MESSAGE * sks)
         }
     }
   GNUNET_free (limited);
+  if (verified == GNUNET_YES)
+    return GNUNET_OK;
   if (GNUNET_OK != identity->verifyPeerSignature (hostId,
                                                   sks,
                                                   sizeof (P2P_setkey_MESSAGE)
@@ -345,7 +409,7 @@ makeSessionKeySigned (const GNUNET_PeerIdentity * hostId,
 #if EXTRA_CHECKS
   /* verify signature/SKS */
   GNUNET_GE_ASSERT (ectx,
-                    GNUNET_SYSERR != verifySKS (coreAPI->my_identity, msg));
+                    GNUNET_SYSERR != verifySKS (coreAPI->my_identity, msg, GNUNET_NO));
 #endif
 
   size = 0;
@@ -391,8 +455,9 @@ makeSessionKeySigned (const GNUNET_PeerIdentity * hostId,
 
 /**
  * Perform a session key exchange.  First sends a hello
- * and then the new SKEY (in two plaintext packets). When called, the
- * semaphore of at the given index must already be down
+ * and then the new SKEY (in two plaintext packets).  Called
+ * by the crypto threads; the global lock is only held while
+ * the session key is selected, not for the RSA operations.
  *
  * @param receiver peer to exchange a key with
  * @param tsession session to use for the exchange (maybe NULL)
@@ -448,6 +513,7 @@ exchangeKey (const GNUNET_PeerIdentity * receiver,
     }
 
   /* get or create our session key */
+  GNUNET_mutex_lock (lock);
   if (GNUNET_OK !=
       coreAPI->p2p_session_key_get (receiver, &sk, &age, GNUNET_YES))
     {
@@ -461,6 +527,7 @@ exchangeKey (const GNUNET_PeerIdentity * receiver,
                      printSKEY (&sk), &enc);
 #endif
     }
+  GNUNET_mutex_unlock (lock);
 
   /* build SKEY message */
   skey = makeSessionKeySigned (receiver, &sk, age, ping, pong);
@@ -527,11 +594,11 @@ exchangeKey (const GNUNET_PeerIdentity * receiver,
 }
 
 /**
- * Accept a session-key that has been sent by another host.
+ * Process a session-key that has been sent by another host.
  * The other host must be known (public key).  Notifies
  * the core about the new session key and possibly
  * triggers sending a session key ourselves (if not
- * already done).
+ * already done).  Called by the crypto threads.
  *
  * @param sender the identity of the sender host
  * @param tsession the transport session handle
@@ -539,9 +606,9 @@ exchangeKey (const GNUNET_PeerIdentity * receiver,
  * @return GNUNET_SYSERR or GNUNET_OK
  */
 static int
-acceptSessionKey (const GNUNET_PeerIdentity * sender,
-                  const GNUNET_MessageHeader * msg,
-                  GNUNET_TSession * tsession)
+processSessionKey (const GNUNET_PeerIdentity * sender,
+                   const GNUNET_MessageHeader * msg,
+                   GNUNET_TSession * tsession)
 {
   GNUNET_AES_SessionKey key;
   GNUNET_MessageHeader *ping;
@@ -555,6 +622,8 @@ acceptSessionKey (const GNUNET_PeerIdentity * sender,
   const GNUNET_RSA_Signature *sig;
   const P2P_setkey_MESSAGE *newMsg;
   const void *end;
+  GNUNET_HashCode digest;
+  int verified;
 
   if (sender == NULL)
     {
@@ -633,7 +702,17 @@ acceptSessionKey (const GNUNET_PeerIdentity * sender,
                      &enc, &ta);
       return GNUNET_SYSERR;     /* not for us! */
     }
-  ret = verifySKS (sender, newMsg);
+  /* the signed part covers the creation time, the encrypted
+     key and the target; if we saw it before, we need neither
+     the signature check nor the decryption */
+  GNUNET_hash (&newMsg->creationTime,
+               sizeof (P2P_setkey_MESSAGE) - sizeof (GNUNET_MessageHeader),
+               &digest);
+  verified =
+    (GNUNET_OK ==
+     GNUNET_session_cache_verified_get (sender, &digest,
+                                        &key)) ? GNUNET_YES : GNUNET_NO;
+  ret = verifySKS (sender, newMsg, verified);
   if (GNUNET_OK != ret)
     {
 #if DEBUG_SESSION
@@ -648,9 +727,16 @@ acceptSessionKey (const GNUNET_PeerIdentity * sender,
         stats->change (stat_skeyRejected, 1);
       return GNUNET_SYSERR;     /* rejected */
     }
-  memset (&key, 0, sizeof (GNUNET_AES_SessionKey));
-  size = identity->decryptData (&newMsg->key,
-                                &key, sizeof (GNUNET_AES_SessionKey));
+  if (verified == GNUNET_NO)
+    {
+      memset (&key, 0, sizeof (GNUNET_AES_SessionKey));
+      size = identity->decryptData (&newMsg->key,
+                                    &key, sizeof (GNUNET_AES_SessionKey));
+    }
+  else
+    {
+      size = sizeof (GNUNET_AES_SessionKey);
+    }
   if (size != sizeof (GNUNET_AES_SessionKey))
     {
       GNUNET_GE_LOG (ectx,
@@ -672,9 +758,12 @@ acceptSessionKey (const GNUNET_PeerIdentity * sender,
                      GNUNET_crc32_n (&key, GNUNET_SESSIONKEY_LEN));
 #endif
       GNUNET_GE_BREAK_OP (ectx, 0);
-      stats->change (stat_skeyRejected, 1);
+      if (stats != NULL)
+        stats->change (stat_skeyRejected, 1);
       return GNUNET_SYSERR;
     }
+  if (verified == GNUNET_NO)
+    GNUNET_session_cache_verified_put (sender, &digest, &key);
 
 #if DEBUG_SESSION
   GNUNET_GE_LOG (ectx,
@@ -786,9 +875,7 @@ acceptSessionKey (const GNUNET_PeerIdentity * sender,
           ping->type = htons (GNUNET_P2P_PROTO_PONG);
           if (stats != NULL)
             stats->change (stat_pongSent, 1);
-          GNUNET_mutex_lock (lock);
           exchangeKey (sender, tsession, ping); /* ping is now pong */
-          GNUNET_mutex_unlock (lock);
         }
       else
         {
@@ -800,6 +887,140 @@ acceptSessionKey (const GNUNET_PeerIdentity * sender,
   return GNUNET_OK;
 }
 
+/**
+ * Queue a key exchange for the crypto threads.
+ *
+ * @param peer peer to connect to or sender of the message
+ * @param msg SETKEY message to process (is copied), NULL to
+ *        initiate a key exchange with the peer
+ * @param tsession transport session of the message (may be NULL)
+ * @return GNUNET_OK if the job was queued, GNUNET_NO if a key
+ *         exchange with the peer is already queued,
+ *         GNUNET_SYSERR if the queue is full
+ */
+static int
+queueJob (const GNUNET_PeerIdentity * peer,
+          const GNUNET_MessageHeader * msg, GNUNET_TSession * tsession)
+{
+  struct CryptoJob *job;
+  struct CryptoJob *pos;
+
+  job = GNUNET_malloc (sizeof (struct CryptoJob));
+  job->next = NULL;
+  job->peer = *peer;
+  job->msg = NULL;
+  job->tsession = NULL;
+  if (msg != NULL)
+    {
+      job->msg = GNUNET_malloc (ntohs (msg->size));
+      memcpy (job->msg, msg, ntohs (msg->size));
+      if ((tsession != NULL) &&
+          (GNUNET_OK == transport->associate (tsession, __FILE__)))
+        job->tsession = tsession;
+    }
+  GNUNET_mutex_lock (jobLock);
+  pos = NULL;
+  if (msg == NULL)
+    {
+      pos = jobHead;
+      while ((pos != NULL) &&
+             ((pos->msg != NULL) ||
+              (0 != memcmp (&pos->peer, peer, sizeof (GNUNET_PeerIdentity)))))
+        pos = pos->next;
+    }
+  if ((pos != NULL) ||
+      (jobCount >= MAX_PENDING_JOBS) || (cryptoThreadsRunning != GNUNET_YES))
+    {
+      GNUNET_mutex_unlock (jobLock);
+      if ((pos == NULL) && (stats != NULL))
+        stats->change (stat_jobsDropped, 1);
+      if (job->tsession != NULL)
+        transport->disconnect (job->tsession, __FILE__);
+      GNUNET_free_non_null (job->msg);
+      GNUNET_free (job);
+      return (pos != NULL) ? GNUNET_NO : GNUNET_SYSERR;
+    }
+  if (jobTail == NULL)
+    jobHead = job;
+  else
+    jobTail->next = job;
+  jobTail = job;
+  jobCount++;
+  GNUNET_mutex_unlock (jobLock);
+  GNUNET_semaphore_up (jobSignal);
+  return GNUNET_OK;
+}
+
+/**
+ * Main loop of the crypto threads: process queued
+ * key exchanges.
+ */
+static void *
+cryptoThreadMain (void *cls)
+{
+  struct CryptoJob *job;
+
+  while (1)
+    {
+      GNUNET_semaphore_down (jobSignal, GNUNET_YES);
+      if (cryptoThreadsRunning != GNUNET_YES)
+        break;
+      GNUNET_mutex_lock (jobLock);
+      job = jobHead;
+      if (job != NULL)
+        {
+          jobHead = job->next;
+          if (jobHead == NULL)
+            jobTail = NULL;
+          jobCount--;
+        }
+      GNUNET_mutex_unlock (jobLock);
+      if (job == NULL)
+        continue;
+      if (job->msg == NULL)
+        exchangeKey (&job->peer, NULL, NULL);
+      else
+        processSessionKey (&job->peer, job->msg, job->tsession);
+      if (job->tsession != NULL)
+        transport->disconnect (job->tsession, __FILE__);
+      GNUNET_free_non_null (job->msg);
+      GNUNET_free (job);
+    }
+  return NULL;
+}
+
+/**
+ * Accept a session-key that has been sent by another host
+ * (the RSA operations are done by the crypto threads).
+ *
+ * @param sender the identity of the sender host
+ * @param tsession the transport session handle
+ * @param msg message with the session key
+ * @return GNUNET_SYSERR or GNUNET_OK
+ */
+static int
+acceptSessionKey (const GNUNET_PeerIdentity * sender,
+                  const GNUNET_MessageHeader * msg,
+                  GNUNET_TSession * tsession)
+{
+  const P2P_setkey_MESSAGE *newMsg;
+
+  if (sender == NULL)
+    {
+      GNUNET_GE_BREAK (NULL, 0);
+      return GNUNET_SYSERR;
+    }
+  /* cheap checks right away, the rest is done by processSessionKey */
+  newMsg = (const P2P_setkey_MESSAGE *) msg;
+  if ((ntohs (msg->size) < sizeof (P2P_setkey_MESSAGE)) ||
+      (0 != memcmp (&coreAPI->my_identity->hashPubKey,
+                    &newMsg->target.hashPubKey, sizeof (GNUNET_HashCode))))
+    return processSessionKey (sender, msg, tsession);   /* logs and fails */
+  if (GNUNET_OK != queueJob (sender, msg, tsession))
+    return GNUNET_SYSERR;
+  return GNUNET_OK;
+}
+
 /**
  * Try to connect to the given peer.
  *
@@ -846,19 +1067,14 @@ tryConnect (const GNUNET_PeerIdentity * peer)
 #endif
       return GNUNET_NO;         /* not allowed right now! */
     }
-  GNUNET_mutex_lock (lock);
 #if DEBUG_SESSION
   GNUNET_GE_LOG (ectx,
                  GNUNET_GE_DEBUG | GNUNET_GE_USER | GNUNET_GE_REQUEST,
                  "Trying to exchange key with `%s'.\n", &enc);
 #endif
-  if (GNUNET_OK == exchangeKey (peer, NULL, NULL))
-    {
-      GNUNET_mutex_unlock (lock);
-      return GNUNET_NO;
-    }
-  GNUNET_mutex_unlock (lock);
-  return GNUNET_SYSERR;
+  if (GNUNET_SYSERR == queueJob (peer, NULL, NULL))
+    return GNUNET_SYSERR;
+  return GNUNET_NO;
 }
 
 /**
@@ -870,7 +1086,8 @@ static int
 acceptSessionKeyUpdate (const GNUNET_PeerIdentity * sender,
                         const GNUNET_MessageHeader * msg)
 {
-  acceptSessionKey (sender, msg, NULL);
+  if (sender != NULL)
+    queueJob (sender, msg, NULL);
   return GNUNET_OK;
 }
 
@@ -882,6 +1099,7 @@ GNUNET_Session_ServiceAPI *
 provide_module_session (GNUNET_CoreAPIForPlugins * capi)
 {
   static GNUNET_Session_ServiceAPI ret;
+  int i;
 
   ectx = capi->ectx;
   coreAPI = capi;
@@ -924,8 +1142,25 @@ provide_module_session (GNUNET_CoreAPIForPlugins * capi)
         = stats->create (gettext_noop ("# encrypted PING messages sent"));
       stat_pongSent
         = stats->create (gettext_noop ("# encrypted PONG messages sent"));
+      stat_jobsDropped
+        =
+        stats->create (gettext_noop
+                       ("# key exchanges dropped (crypto queue full)"));
     }
   lock = capi->global_lock_get ();
+  jobLock = GNUNET_mutex_create (GNUNET_NO);
+  jobSignal = GNUNET_semaphore_create (0);
+  jobHead = NULL;
+  jobTail = NULL;
+  jobCount = 0;
+  cryptoThreadsRunning = GNUNET_YES;
+  for (i = 0; i < CRYPTO_THREAD_COUNT; i++)
+    {
+      cryptoThreads[i] =
+        GNUNET_thread_create (&cryptoThreadMain, NULL, 128 * 1024);
+      if (cryptoThreads[i] == NULL)
+        GNUNET_GE_LOG_STRERROR (ectx, GNUNET_GE_ERROR, "pthread_create");
+    }
   GNUNET_GE_LOG (ectx,
                  GNUNET_GE_INFO | GNUNET_GE_USER | GNUNET_GE_REQUEST,
                  _
@@ -945,10 +1180,40 @@ provide_module_session (GNUNET_CoreAPIForPlugins * capi)
 int
 release_module_session ()
 {
+  struct CryptoJob *job;
+  void *unused;
+  int i;
+
   coreAPI->p2p_plaintext_handler_unregister (GNUNET_P2P_PROTO_SET_KEY,
                                              &acceptSessionKey);
   coreAPI->p2p_ciphertext_handler_unregister (GNUNET_P2P_PROTO_SET_KEY,
                                               &acceptSessionKeyUpdate);
+  GNUNET_mutex_lock (jobLock);
+  cryptoThreadsRunning = GNUNET_NO;
+  GNUNET_mutex_unlock (jobLock);
+  for (i = 0; i < CRYPTO_THREAD_COUNT; i++)
+    GNUNET_semaphore_up (jobSignal);
+  for (i = 0; i < CRYPTO_THREAD_COUNT; i++)
+    {
+      if (cryptoThreads[i] != NULL)
+        GNUNET_thread_join (cryptoThreads[i], &unused);
+      cryptoThreads[i] = NULL;
+    }
+  while (jobHead != NULL)
+    {
+      job = jobHead;
+      jobHead = job->next;
+      if (job->tsession != NULL)
+        transport->disconnect (job->tsession, __FILE__);
+      GNUNET_free_non_null (job->msg);
+      GNUNET_free (job);
+    }
+  jobTail = NULL;
+  jobCount = 0;
+  GNUNET_semaphore_destroy (jobSignal);
+  jobSignal = NULL;
+  GNUNET_mutex_destroy (jobLock);
+  jobLock = NULL;
   if (topology != NULL)
     {
       coreAPI->service_release (topology);
@@ -167,6 +167,9 @@ GNUNET_STATS_cs_message_type_to_string (unsigned short type)
     case GNUNET_CS_PROTO_GAP_RESULT:
       name = "CS_PROTO_gap_RESULT";
       break;
+    case GNUNET_CS_PROTO_GAP_RESULT_FROM:
+      name = "CS_PROTO_gap_RESULT_FROM";
+      break;
     case GNUNET_CS_PROTO_GAP_INSERT:
       name = "CS_PROTO_gap_INSERT";
       break;
@@ -208,6 +211,12 @@ GNUNET_STATS_cs_message_type_to_string (unsigned short type)
     case GNUNET_CS_PROTO_STATS_GET_P2P_MESSAGE_SUPPORTED:
       name = "GNUNET_CS_PROTO_STATS_GET_P2P_MESSAGE_SUPPORTED";
       break;
+    case GNUNET_CS_PROTO_STATS_GET_HISTOGRAMS:
+      name = "GNUNET_CS_PROTO_STATS_GET_HISTOGRAMS";
+      break;
+    case GNUNET_CS_PROTO_STATS_HISTOGRAM:
+      name = "GNUNET_CS_PROTO_STATS_HISTOGRAM";
+      break;
 
     case GNUNET_CS_PROTO_TBENCH_REQUEST:
       name = "GNUNET_CS_PROTO_TBENCH_REQUEST";
@@ -215,6 +224,12 @@ GNUNET_STATS_cs_message_type_to_string (unsigned short type)
     case GNUNET_CS_PROTO_TBENCH_REPLY:
       name = "GNUNET_CS_PROTO_TBENCH_REPLY";
       break;
+    case GNUNET_CS_PROTO_TBENCH_FLOWS_REQUEST:
+      name = "GNUNET_CS_PROTO_TBENCH_FLOWS_REQUEST";
+      break;
+    case GNUNET_CS_PROTO_TBENCH_FLOWS_REPLY:
+      name = "GNUNET_CS_PROTO_TBENCH_FLOWS_REPLY";
+      break;
 
     case GNUNET_CS_PROTO_TRACEKIT_PROBE:
       name = "GNUNET_CS_PROTO_TRACEKIT_PROBE";
@@ -377,6 +392,171 @@ GNUNET_STATS_get_statistics (struct GNUNET_GE_Context *ectx,
 }
 
 
+/**
+ * Request the histograms from TCP socket.
+ * @param sock the socket to use
+ * @param processor function to call on each histogram
+ * @return GNUNET_OK on success, GNUNET_SYSERR on error
+ */
+int
+GNUNET_STATS_get_histograms (struct GNUNET_GE_Context *ectx,
+                             struct GNUNET_ClientServerConnection *sock,
+                             GNUNET_STATS_HistogramProcessor processor,
+                             void *cls)
+{
+  CS_stats_histogram_MESSAGE *msg;
+  GNUNET_MessageHeader csHdr;
+  unsigned long long *values;
+  unsigned int count;
+  unsigned int total;
+  unsigned int buckets;
+  unsigned int i;
+  unsigned short mlen;
+  int ret;
+
+  ret = GNUNET_OK;
+  csHdr.size = htons (sizeof (GNUNET_MessageHeader));
+  csHdr.type = htons (GNUNET_CS_PROTO_STATS_GET_HISTOGRAMS);
+  if (GNUNET_SYSERR == GNUNET_client_connection_write (sock, &csHdr))
+    return GNUNET_SYSERR;
+  count = 0;
+  total = 1;                    /* to ensure we enter the loop */
+  while (count < total)
+    {
+      msg = NULL;
+      if (GNUNET_SYSERR ==
+          GNUNET_client_connection_read (sock,
+                                         (GNUNET_MessageHeader **) & msg))
+        return GNUNET_SYSERR;
+      mlen = ntohs (msg->header.size);
+      if ((mlen <= sizeof (CS_stats_histogram_MESSAGE)) ||
+          (ntohs (msg->header.type) != GNUNET_CS_PROTO_STATS_HISTOGRAM) ||
+          (((const char *) msg)[mlen - 1] != '\0'))
+        {
+          GNUNET_GE_BREAK (ectx, 0);
+          GNUNET_free (msg);
+          return GNUNET_SYSERR;
+        }
+      total = ntohl (msg->totalHistograms);
+      buckets = ntohl (msg->buckets);
+      if ((buckets > HISTOGRAM_BUCKETS) ||
+          (sizeof (CS_stats_histogram_MESSAGE) +
+           buckets * sizeof (unsigned long long) >= mlen))
+        {
+          GNUNET_GE_BREAK (ectx, 0);
+          GNUNET_free (msg);
+          return GNUNET_SYSERR;
+        }
+      if (buckets > 0)
+        {
+          values = (unsigned long long *) &msg[1];
+          for (i = 0; i < buckets; i++)
+            values[i] = GNUNET_ntohll (values[i]);
+          if (ret != GNUNET_SYSERR)
+            ret = processor ((const char *) &values[buckets],
+                             values, buckets, cls);
+        }
+      GNUNET_free (msg);
+      count++;
+    }
+  return ret;
+}
+
+/**
+ * Find the bucket of a histogram that counts the given value.
+ *
+ * @return bucket index (below HISTOGRAM_BUCKETS)
+ */
+unsigned int
+GNUNET_STATS_histogram_bucket (unsigned long long value)
+{
+  unsigned int msb;
+
+  if (value < (1 << HISTOGRAM_SUB_BITS))
+    return (unsigned int) value;
+#ifdef __GNUC__
+  msb = 63 - __builtin_clzll (value);
+#else
+  msb = HISTOGRAM_SUB_BITS;
+  while ((msb < 63) && ((value >> (msb + 1)) != 0))
+    msb++;
+#endif
+  if (msb >= HISTOGRAM_MAX_BITS)
+    return HISTOGRAM_BUCKETS - 1;
+  return ((msb - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS) +
+    ((value >> (msb - HISTOGRAM_SUB_BITS)) & ((1 << HISTOGRAM_SUB_BITS) - 1));
+}
+
+/**
+ * Compute the largest value that falls into the
+ * given bucket of a histogram (larger values counted
+ * in the last bucket are not taken into account).
+ */
+static unsigned long long
+histogram_bucket_max (unsigned int bucket)
+{
+  unsigned int shift;
+  unsigned long long sub;
+
+  if (bucket < (1 << HISTOGRAM_SUB_BITS))
+    return bucket;
+  shift = (bucket >> HISTOGRAM_SUB_BITS) - 1;
+  sub = bucket & ((1 << HISTOGRAM_SUB_BITS) - 1);
+  return ((((1ULL << HISTOGRAM_SUB_BITS) + sub + 1) << shift)) - 1;
+}
+
+/**
+ * Compute a percentile of a histogram.
+ *
+ * @param buckets the bucket counters
+ * @param count number of buckets
+ * @param percent which percentile (0 to 100)
+ * @return upper limit of the bucket holding the percentile
+ *         (0 if the histogram is empty)
+ */
+unsigned long long
+GNUNET_STATS_histogram_percentile (const unsigned long long *buckets,
+                                   unsigned int count, double percent)
+{
+  unsigned long long total;
+  unsigned long long sum;
+  unsigned long long want;
+  unsigned int i;
+
+  total = GNUNET_STATS_histogram_total (buckets, count);
+  if (total == 0)
+    return 0;
+  want = (unsigned long long) (total * percent / 100.0);
+  if (want < 1)
+    want = 1;
+  if (want > total)
+    want = total;
+  sum = 0;
+  for (i = 0; i < count; i++)
+    {
+      sum += buckets[i];
+      if (sum >= want)
+        return histogram_bucket_max (i);
+    }
+  return histogram_bucket_max (count - 1);
+}
+
+/**
+ * Get the number of samples in a histogram.
+ */
+unsigned long long
+GNUNET_STATS_histogram_total (const unsigned long long *buckets,
+                              unsigned int count)
+{
+  unsigned long long total;
+  unsigned int i;
+
+  total = 0;
+  for (i = 0; i < count; i++)
+    total += buckets[i];
+  return total;
+}
+
 /**
  * Request available protocols from TCP socket.
  * @param sock the socket to use
@@ -49,6 +49,25 @@ printStatistics (const char *name, unsigned long long value, void *cls)
   return GNUNET_OK;
 }
 
+/**
+ * Print the percentiles of a histogram.
+ */
+static int
+printHistogram (const char *name,
+                const unsigned long long *buckets, unsigned int count,
+                void *cls)
+{
+  FILE *stream = cls;
+
+  FPRINTF (stream, "%-40s %10llu %10llu %10llu %10llu %10llu\n", _(name),
+           GNUNET_STATS_histogram_total (buckets, count),
+           GNUNET_STATS_histogram_percentile (buckets, count, 50),
+           GNUNET_STATS_histogram_percentile (buckets, count, 90),
+           GNUNET_STATS_histogram_percentile (buckets, count, 99),
+           GNUNET_STATS_histogram_percentile (buckets, count, 100));
+  return GNUNET_OK;
+}
+
 static int
 printProtocols (unsigned short type, int isP2P, void *cls)
 {
@@ -86,6 +105,9 @@ static struct GNUNET_CommandLineOption gnunetstatsOptions[] = {
   {'p', "protocols", NULL,
    gettext_noop ("prints supported protocol messages"),
    0, &GNUNET_getopt_configure_set_option, "STATS:PRINT-PROTOCOLS=YES"},
+  {'P', "percentiles", NULL,
+   gettext_noop ("prints percentiles of the histograms (such as latencies)"),
+   0, &GNUNET_getopt_configure_set_option, "STATS:PRINT-HISTOGRAMS=YES"},
   GNUNET_COMMAND_LINE_OPTION_VERSION (PACKAGE_VERSION), /* -v */
   GNUNET_COMMAND_LINE_OPTION_END,
 };
@@ -121,7 +143,18 @@ main (int argc, char *const *argv)
       fprintf (stderr, _("Error establishing connection with gnunetd.\n"));
       return 1;
     }
-  res = GNUNET_STATS_get_statistics (ectx, sock, &printStatistics, stdout);
+  if (GNUNET_YES == GNUNET_GC_get_configuration_value_yesno (cfg,
+                                                             "STATS",
+                                                             "PRINT-HISTOGRAMS",
+                                                             GNUNET_NO))
+    {
+      fprintf (stdout, "%-40s %10s %10s %10s %10s %10s\n",
+               _("Histogram"), _("samples"), "50%", "90%", "99%", "max");
+      res = GNUNET_STATS_get_histograms (ectx, sock, &printHistogram,
+                                         stdout);
+    }
+  else
+    res = GNUNET_STATS_get_statistics (ectx, sock, &printStatistics, stdout);
   if ((GNUNET_YES == GNUNET_GC_get_configuration_value_yesno (cfg,
                                                               "STATS",
                                                               "PRINT-PROTOCOLS",
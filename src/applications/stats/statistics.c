@@ -31,7 +31,13 @@
  * on.<p>
  *
  * When loaded by gnunetd, the gnunet-stats tool can be used to
- * print the statistical information stored in this module.
+ * print the statistical information stored in this module.<p>
+ *
+ * Updates do not take a lock: every thread adds to its own shard of
+ * the counters (with atomic operations, since several threads may
+ * share a shard) and the shards are only summed up when a value is
+ * read; histogram buckets are sharded the same way.  Handles are
+ * found by the hash of their description.
  */
 
 #include "platform.h"
@@ -52,6 +58,24 @@
 
 /* *************** service *************** */
 
+/**
+ * Number of shards for the counter values.  Each thread
+ * updates the values of one shard, so threads rarely touch
+ * the same cache lines.
+ */
+#define STAT_SHARDS 16
+
+/**
+ * Number of counters per block; blocks are allocated as
+ * needed and never move, so updates need no lock.
+ */
+#define STAT_BLOCK_SIZE 256
+
+/**
+ * Maximum number of blocks (and thus of counters / STAT_BLOCK_SIZE).
+ */
+#define STAT_MAX_BLOCKS 256
+
 /**
  * When did the module start?
  */
@@ -59,7 +83,6 @@ static GNUNET_CronTime startTime;
 
 struct StatEntry
 {
-  unsigned long long value;
   char *description;
   unsigned int descStrLen;
 };
@@ -72,7 +95,26 @@ static struct StatEntry *entries;
 static unsigned int statCounters;
 
 /**
- * lock for the stat module
+ * Number of entries that have counters (entries are
+ * created before their counters are published; use
+ * STAT_PUBLISH and STAT_READY to access).
+ */
+static volatile unsigned int statReady;
+
+/**
+ * Blocks of counter values.  Block b holds the values of the
+ * counters b * STAT_BLOCK_SIZE and following, for shard s
+ * at offset s * STAT_BLOCK_SIZE.
+ */
+static unsigned long long *blocks[STAT_MAX_BLOCKS];
+
+/**
+ * Map from the hash of a description to the handle (plus one).
+ */
+static struct GNUNET_MultiHashMap *handleMap;
+
+/**
+ * lock for the stat module (protects creating handles)
  */
 static struct GNUNET_Mutex *statLock;
 
@@ -85,6 +127,105 @@ static GNUNET_CoreAPIForPlugins *coreAPI;
 extern volatile int GNUNET_memory_usage;
 #endif
 
+#ifdef __GNUC__
+/**
+ * Shard of the calling thread (-1 if not yet assigned).
+ */
+static __thread int myShard = -1;
+
+/**
+ * Counter used to assign shards to threads.
+ */
+static unsigned int nextShard;
+
+/**
+ * Get the shard of the calling thread.
+ */
+static int
+getShard ()
+{
+  if (myShard == -1)
+    myShard = __sync_fetch_and_add (&nextShard, 1) % STAT_SHARDS;
+  return myShard;
+}
+
+#define STAT_ADD(ptr, delta) __sync_fetch_and_add (ptr, delta)
+
+/**
+ * Publish a new number of ready entries; everything written
+ * before (the new counters) becomes visible to threads that
+ * see the new number.
+ */
+#define STAT_PUBLISH(var, val) __atomic_store_n (&(var), val, __ATOMIC_RELEASE)
+
+/**
+ * Read a number of ready entries published with STAT_PUBLISH.
+ */
+#define STAT_READY(var) __atomic_load_n (&(var), __ATOMIC_ACQUIRE)
+#else
+/**
+ * Without atomic operations, all threads use the first
+ * shard and updates are done under the lock.
+ */
+static int
+getShard ()
+{
+  return 0;
+}
+
+#define STAT_ADD(ptr, delta) do { \
+  GNUNET_mutex_lock (statLock); \
+  *(ptr) += (delta); \
+  GNUNET_mutex_unlock (statLock); \
+} while (0)
+
+/**
+ * Entries are published under the lock, so taking the lock
+ * before reading the number of ready entries orders the reads.
+ */
+#define STAT_PUBLISH(var, val) ((var) = (val))
+
+static unsigned int
+statReadyLocked (volatile unsigned int *var)
+{
+  unsigned int ret;
+
+  GNUNET_mutex_lock (statLock);
+  ret = *var;
+  GNUNET_mutex_unlock (statLock);
+  return ret;
+}
+
+#define STAT_READY(var) statReadyLocked (&(var))
+#endif
+
+/**
+ * Get the value of the given counter for the calling thread.
+ */
+static unsigned long long *
+getCounter (const int handle)
+{
+  return &blocks[handle / STAT_BLOCK_SIZE][getShard () * STAT_BLOCK_SIZE +
+                                           handle % STAT_BLOCK_SIZE];
+}
+
+/**
+ * Compute the value of a counter (sum over all shards).
+ */
+static unsigned long long
+sumCounter (const int handle)
+{
+  unsigned long long *block;
+  unsigned long long ret;
+  unsigned int i;
+
+  block = blocks[handle / STAT_BLOCK_SIZE];
+  ret = 0;
+  for (i = 0; i < STAT_SHARDS; i++)
+    ret += block[i * STAT_BLOCK_SIZE + handle % STAT_BLOCK_SIZE];
+  return ret;
+}
+
 /**
  * Get a handle to a statistical entity.
  *
@@ -94,20 +235,41 @@ extern volatile int GNUNET_memory_usage;
 static int
 statHandle (const char *name)
 {
+  GNUNET_HashCode key;
+  void *val;
   int i;
+
   GNUNET_GE_ASSERT (NULL, name != NULL);
+  GNUNET_hash (name, strlen (name), &key);
   GNUNET_mutex_lock (statLock);
-  for (i = 0; i < statCounters; i++)
-    if (0 == strcmp (entries[i].description, name))
-      {
-        GNUNET_mutex_unlock (statLock);
-        return i;
-      }
+  val = GNUNET_multi_hash_map_get (handleMap, &key);
+  if (val != NULL)
+    {
+      GNUNET_mutex_unlock (statLock);
+      return (int) ((size_t) val - 1);
+    }
+  if (statCounters == STAT_BLOCK_SIZE * STAT_MAX_BLOCKS)
+    {
+      GNUNET_GE_BREAK (NULL, 0);
+      GNUNET_mutex_unlock (statLock);
+      return -1;
+    }
   GNUNET_array_grow (entries, statCounters, statCounters + 1);
   i = statCounters - 1;
   entries[i].description = GNUNET_strdup (name);
   entries[i].descStrLen = strlen (name);
-  entries[i].value = 0;
+  if (blocks[i / STAT_BLOCK_SIZE] == NULL)
+    {
+      blocks[i / STAT_BLOCK_SIZE]
+        =
+        GNUNET_malloc (sizeof (unsigned long long) * STAT_SHARDS *
+                       STAT_BLOCK_SIZE);
+      memset (blocks[i / STAT_BLOCK_SIZE], 0,
+              sizeof (unsigned long long) * STAT_SHARDS * STAT_BLOCK_SIZE);
+    }
+  GNUNET_multi_hash_map_put (handleMap, &key, (void *) (size_t) (i + 1),
+                             GNUNET_MultiHashMapOption_UNIQUE_FAST);
+  STAT_PUBLISH (statReady, statCounters);
   GNUNET_mutex_unlock (statLock);
   return i;
 }
@@ -116,37 +278,37 @@ statHandle (const char *name)
  * Manipulate statistics. Sets the statistics associated with the
  * handle to value.
  *
+ * Sets are done by adding the difference to the current value, so
+ * they are serialized with each other (under the lock), but not
+ * with concurrent changes: a change made by another thread while
+ * the set is in progress may be lost or counted twice.  Values
+ * that are set should therefore not also be changed.
+ *
  * @param handle the handle for the value to change
  * @param value to what the value should be set
  */
 static void
 statSet (const int handle, const unsigned long long value)
 {
-  GNUNET_mutex_lock (statLock);
-  if ((handle < 0) || (handle >= statCounters))
+  if ((handle < 0) || (handle >= STAT_READY (statReady)))
     {
       GNUNET_GE_BREAK (NULL, 0);
-      GNUNET_mutex_unlock (statLock);
       return;
     }
-  entries[handle].value = value;
+  GNUNET_mutex_lock (statLock);
+  STAT_ADD (getCounter (handle), value - sumCounter (handle));
   GNUNET_mutex_unlock (statLock);
 }
 
 static unsigned long long
 statGet (const int handle)
 {
-  unsigned long long ret;
-  GNUNET_mutex_lock (statLock);
-  if ((handle < 0) || (handle >= statCounters))
+  if ((handle < 0) || (handle >= STAT_READY (statReady)))
     {
       GNUNET_GE_BREAK (NULL, 0);
-      GNUNET_mutex_unlock (statLock);
       return -1;
     }
-  ret = entries[handle].value;
-  GNUNET_mutex_unlock (statLock);
-  return ret;
+  return sumCounter (handle);
 }
 
 /**
@@ -159,15 +321,108 @@ statGet (const int handle)
 static void
 statChange (const int handle, const int delta)
 {
+  if ((handle < 0) || (handle >= STAT_READY (statReady)))
+    {
+      GNUNET_GE_BREAK (NULL, 0);
+      return;
+    }
+  STAT_ADD (getCounter (handle), (unsigned long long) (long long) delta);
+}
+
+/**
+ * Maximum number of histograms.
+ */
+#define MAX_HISTOGRAMS 1024
+
+struct Histogram
+{
+  char *description;
+  unsigned int descStrLen;
+
+  /**
+   * Bucket counts of each shard (summed up when the
+   * histogram is read, like the counter values).
+   */
+  unsigned long long buckets[STAT_SHARDS][HISTOGRAM_BUCKETS];
+};
+
+/**
+ * The histograms (entries never move once created).
+ */
+static struct Histogram *histograms[MAX_HISTOGRAMS];
+
+/**
+ * Number of histograms (use STAT_PUBLISH and STAT_READY
+ * to access without the lock).
+ */
+static volatile unsigned int histogramCount;
+
+/**
+ * Map from the hash of a description to the histogram
+ * handle (plus one).
+ */
+static struct GNUNET_MultiHashMap *histogramMap;
+
+/**
+ * Get a handle to a histogram.
+ *
+ * @param name a description of the histogram
+ * @return a handle for adding samples
+ */
+static int
+histogramHandle (const char *name)
+{
+  GNUNET_HashCode key;
+  struct Histogram *h;
+  void *val;
+  int i;
+
+  GNUNET_GE_ASSERT (NULL, name != NULL);
+  GNUNET_hash (name, strlen (name), &key);
   GNUNET_mutex_lock (statLock);
-  if ((handle < 0) || (handle >= statCounters))
+  val = GNUNET_multi_hash_map_get (histogramMap, &key);
+  if (val != NULL)
+    {
+      GNUNET_mutex_unlock (statLock);
+      return (int) ((size_t) val - 1);
+    }
+  if (histogramCount == MAX_HISTOGRAMS)
     {
       GNUNET_GE_BREAK (NULL, 0);
       GNUNET_mutex_unlock (statLock);
-      return;
+      return -1;
     }
-  entries[handle].value += delta;
+  i = histogramCount;
+  h = GNUNET_malloc (sizeof (struct Histogram));
+  memset (h, 0, sizeof (struct Histogram));
+  h->description = GNUNET_strdup (name);
+  h->descStrLen = strlen (name);
+  histograms[i] = h;
+  GNUNET_multi_hash_map_put (histogramMap, &key, (void *) (size_t) (i + 1),
+                             GNUNET_MultiHashMapOption_UNIQUE_FAST);
+  STAT_PUBLISH (histogramCount, i + 1);
   GNUNET_mutex_unlock (statLock);
+  return i;
+}
+
+/**
+ * Add a sample to a histogram.
+ *
+ * @param handle the handle of the histogram
+ * @param value the sample
+ */
+static void
+histogramRecord (const int handle, const unsigned long long value)
+{
+  unsigned int bucket;
+
+  if ((handle < 0) || (handle >= STAT_READY (histogramCount)))
+    {
+      GNUNET_GE_BREAK (NULL, 0);
+      return;
+    }
+  bucket = GNUNET_STATS_histogram_bucket (value);
+  STAT_ADD (&histograms[handle]->buckets[getShard ()][bucket], 1);
 }
 
 
@@ -180,9 +435,24 @@ release_module_stats ()
   int i;
 
   GNUNET_mutex_destroy (statLock);
+  GNUNET_multi_hash_map_destroy (handleMap);
   for (i = 0; i < statCounters; i++)
     GNUNET_free (entries[i].description);
+  for (i = 0; i < STAT_MAX_BLOCKS; i++)
+    {
+      GNUNET_free_non_null (blocks[i]);
+      blocks[i] = NULL;
+    }
+  statReady = 0;
   GNUNET_array_grow (entries, statCounters, 0);
+  GNUNET_multi_hash_map_destroy (histogramMap);
+  for (i = 0; i < histogramCount; i++)
+    {
+      GNUNET_free (histograms[i]->description);
+      GNUNET_free (histograms[i]);
+      histograms[i] = NULL;
+    }
+  histogramCount = 0;
 }
 
 
@@ -199,8 +469,12 @@ provide_module_stats (GNUNET_CoreAPIForPlugins * capi)
   api.set = &statSet;
   api.change = &statChange;
   api.get = &statGet;
+  api.create_histogram = &histogramHandle;
+  api.record = &histogramRecord;
   startTime = GNUNET_get_time ();
   statLock = GNUNET_mutex_create (GNUNET_YES);
+  handleMap = GNUNET_multi_hash_map_create (128);
+  histogramMap = GNUNET_multi_hash_map_create (32);
   return &api;
 }
 
@@ -216,6 +490,7 @@ static int stat_handle_cpu_load;
 static int stat_handle_io_load;
 static int stat_bytes_noise_received;
 static int stat_connected;
+static int stat_cron_lateness[GNUNET_CRON_LATENESS_BUCKETS];
 #ifdef MINGW
 static int stat_handles;
 static int stat_socks;
@@ -238,6 +513,10 @@ extern unsigned int uiHandleCount;
 static void
 initializeStats ()
 {
+  int i;
+
+  for (i = 0; i < GNUNET_CRON_LATENESS_BUCKETS; i++)
+    stat_cron_lateness[i] = -1;
   stat_handle_network_load_up = statHandle (gettext_noop (      /* xgettext:no-c-format */
                                                            "% of allowed network load (up)"));
   stat_handle_network_load_down = statHandle (gettext_noop (    /* xgettext:no-c-format */
@@ -261,6 +540,44 @@ initializeStats ()
 #endif
 }
 
+/**
+ * Export the histogram of how late cron jobs were started.
+ * Entries are only created for buckets that are used.
+ */
+static void
+updateCronLateness ()
+{
+  unsigned long long histogram[GNUNET_CRON_LATENESS_BUCKETS];
+  char name[64];
+  unsigned int i;
+
+  GNUNET_cron_get_lateness (coreAPI->cron, histogram);
+  for (i = 0; i < GNUNET_CRON_LATENESS_BUCKETS; i++)
+    {
+      if ((histogram[i] == 0) && (stat_cron_lateness[i] == -1))
+        continue;
+      if (stat_cron_lateness[i] == -1)
+        {
+          if (i == 0)
+            GNUNET_snprintf (name, sizeof (name),
+                             "# cron jobs started in time");
+          else if (i == GNUNET_CRON_LATENESS_BUCKETS - 1)
+            GNUNET_snprintf (name, sizeof (name),
+                             "# cron jobs started %u ms or more late",
+                             1 << (i - 1));
+          else if (i == 1)
+            GNUNET_snprintf (name, sizeof (name),
+                             "# cron jobs started 1 ms late");
+          else
+            GNUNET_snprintf (name, sizeof (name),
+                             "# cron jobs started %u-%u ms late",
+                             1 << (i - 1), (1 << i) - 1);
+          stat_cron_lateness[i] = statHandle (name);
+        }
+      statSet (stat_cron_lateness[i], histogram[i]);
+    }
+}
+
 static void
 immediateUpdates ()
 {
@@ -289,6 +606,7 @@ immediateUpdates ()
     load = 0;
   statSet (stat_handle_network_load_down, load);
   statSet (stat_connected, coreAPI->p2p_connections_iterate (NULL, NULL));
+  updateCronLateness ();
 #ifdef MINGW
   statSet (stat_handles, plibc_get_handle_count ());
   statSet (stat_socks, uiSockCount);
@@ -330,6 +648,7 @@ sendStatistics (struct GNUNET_ClientHandle *sock,
   start = 0;
   while (start < statCounters)
     {
+      GNUNET_mutex_lock (statLock);
       pos = start;
       /* first pass: gauge how many statistic numbers
          and their descriptions we can send in one message */
@@ -341,7 +660,7 @@ sendStatistics (struct GNUNET_ClientHandle *sock,
 	       < GNUNET_MAX_BUFFER_SIZE - sizeof (CS_stats_reply_MESSAGE)))
         {
           moff += sizeof (unsigned long long);  /* value */
-	  values[pos - start] = GNUNET_htonll (entries[pos].value);
+	  values[pos - start] = GNUNET_htonll (sumCounter (pos));
           moff += entries[pos].descStrLen + 1;
           pos++;
         }
@@ -358,6 +677,7 @@ sendStatistics (struct GNUNET_ClientHandle *sock,
                   entries[pos].descStrLen + 1);
           moff += entries[pos].descStrLen + 1;
         }
+      GNUNET_mutex_unlock (statLock);
       msize = moff 
 	+ sizeof(unsigned long long) * mcnt 
 	+ sizeof (CS_stats_reply_MESSAGE);
@@ -373,6 +693,67 @@ sendStatistics (struct GNUNET_ClientHandle *sock,
   return GNUNET_OK;
 }
 
+/**
+ * Send the histograms to a client (one message per histogram).
+ */
+static int
+sendHistograms (struct GNUNET_ClientHandle *sock,
+                const GNUNET_MessageHeader * originalRequestMessage)
+{
+  CS_stats_histogram_MESSAGE *msg;
+  unsigned long long *values;
+  struct Histogram *h;
+  unsigned int total;
+  unsigned long long sum;
+  unsigned int i;
+  unsigned int j;
+  unsigned int k;
+  unsigned short msize;
+  int ret;
+
+  total = STAT_READY (histogramCount);
+  msg = GNUNET_malloc (GNUNET_MAX_BUFFER_SIZE);
+  msg->header.type = htons (GNUNET_CS_PROTO_STATS_HISTOGRAM);
+  msg->totalHistograms = htonl (total);
+  msg->reserved = 0;
+  values = (unsigned long long *) &msg[1];
+  ret = GNUNET_OK;
+  if (total == 0)
+    {
+      msg->buckets = htonl (0);
+      ((char *) &msg[1])[0] = '\0';
+      msg->header.size = htons (sizeof (CS_stats_histogram_MESSAGE) + 1);
+      if (GNUNET_SYSERR ==
+          coreAPI->cs_send_message (sock, &msg->header, GNUNET_YES))
+        ret = GNUNET_SYSERR;
+    }
+  for (i = 0; i < total; i++)
+    {
+      h = histograms[i];
+      msize = sizeof (CS_stats_histogram_MESSAGE) +
+        HISTOGRAM_BUCKETS * sizeof (unsigned long long) + h->descStrLen + 1;
+      GNUNET_GE_ASSERT (NULL, msize < GNUNET_MAX_BUFFER_SIZE);
+      msg->buckets = htonl (HISTOGRAM_BUCKETS);
+      for (j = 0; j < HISTOGRAM_BUCKETS; j++)
+        {
+          sum = 0;
+          for (k = 0; k < STAT_SHARDS; k++)
+            sum += h->buckets[k][j];
+          values[j] = GNUNET_htonll (sum);
+        }
+      memcpy (&values[HISTOGRAM_BUCKETS], h->description, h->descStrLen + 1);
+      msg->header.size = htons (msize);
+      if (GNUNET_SYSERR ==
+          coreAPI->cs_send_message (sock, &msg->header, GNUNET_YES))
+        {
+          ret = GNUNET_SYSERR;
+          break;                /* abort, socket error! */
+        }
+    }
+  GNUNET_free (msg);
+  return ret;
+}
+
 /**
  * Handle a request to see if a particular p2p message is supported.
  */
@@ -453,6 +834,8 @@ initialize_module_stats (GNUNET_CoreAPIForPlugins * capi)
                  GNUNET_P2P_PROTO_NOISE);
   capi->cs_handler_register (GNUNET_CS_PROTO_STATS_GET_STATISTICS,
                              &sendStatistics);
+  capi->cs_handler_register (GNUNET_CS_PROTO_STATS_GET_HISTOGRAMS,
+                             &sendHistograms);
   capi->cs_handler_register
     (GNUNET_CS_PROTO_STATS_GET_P2P_MESSAGE_SUPPORTED,
      &handleMessageSupported);
@@ -485,6 +868,8 @@ done_module_stats ()
   GNUNET_GE_ASSERT (NULL, myCoreAPI != NULL);
   coreAPI->cs_handler_unregister (GNUNET_CS_PROTO_STATS_GET_STATISTICS,
                                   &sendStatistics);
+  coreAPI->cs_handler_unregister (GNUNET_CS_PROTO_STATS_GET_HISTOGRAMS,
+                                  &sendHistograms);
   coreAPI->cs_handler_unregister
     (GNUNET_CS_PROTO_STATS_GET_P2P_MESSAGE_SUPPORTED,
      &handleMessageSupported);
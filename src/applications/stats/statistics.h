@@ -26,6 +26,7 @@
 #define CHAT_CHAT_H
 
 #include "gnunet_util.h"
+#include "gnunet_stats_lib.h"
 
 /**
  * Statistics message. Contains the timestamp and an aribtrary
@@ -61,6 +62,51 @@ typedef struct
 
 } CS_stats_reply_MESSAGE;
 
+/**
+ * Number of linear sub-buckets per power of two in a
+ * histogram (as a power of two).
+ */
+#define HISTOGRAM_SUB_BITS GNUNET_STATS_HISTOGRAM_SUB_BITS
+
+/**
+ * Values of 2^HISTOGRAM_MAX_BITS and more are counted
+ * in the last bucket of a histogram.
+ */
+#define HISTOGRAM_MAX_BITS GNUNET_STATS_HISTOGRAM_MAX_BITS
+
+/**
+ * Number of buckets of a histogram.
+ */
+#define HISTOGRAM_BUCKETS GNUNET_STATS_HISTOGRAM_BUCKETS
+
+/**
+ * Histogram message.  One message is sent per histogram; if there
+ * are no histograms, a single message without buckets is sent.
+ *
+ * The struct is followed by the bucket counters (64-bit) and
+ * the 0-terminated name of the histogram.
+ */
+typedef struct
+{
+  GNUNET_MessageHeader header;
+
+  /**
+   * total number of histograms
+   */
+  unsigned int totalHistograms GNUNET_PACKED;
+
+  /**
+   * number of bucket counters in this message
+   */
+  unsigned int buckets GNUNET_PACKED;
+
+  /**
+   * For 64-bit alignment...
+   */
+  int reserved GNUNET_PACKED;
+
+} CS_stats_histogram_MESSAGE;
+
 /**
  * Query protocol supported message.  Contains the type of
  * the message we are requesting the status of.
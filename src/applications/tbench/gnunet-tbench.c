@@ -51,6 +51,14 @@ static GNUNET_CronTime messageTimeOut = DEFAULT_TIMEOUT;
 
 static GNUNET_CronTime messageSpacing = DEFAULT_SPACING;
 
+static unsigned long long messageMaxSize;
+
+static char *messageDistribution;
+
+static unsigned long long messageLargeShare = 100;
+
+static char *messagePriorities;
+
 static int outputFormat = OF_HUMAN_READABLE;
 
 static char *cfgFilename = GNUNET_DEFAULT_CLIENT_CONFIG_FILE;
@@ -61,6 +69,10 @@ static char *cfgFilename = GNUNET_DEFAULT_CLIENT_CONFIG_FILE;
 static struct GNUNET_CommandLineOption gnunettbenchOptions[] = {
   GNUNET_COMMAND_LINE_OPTION_CFG_FILE (&cfgFilename),   /* -c */
   GNUNET_COMMAND_LINE_OPTION_HELP (gettext_noop ("Start GNUnet transport benchmarking tool.")), /* -h */
+  {'d', "distribution", "DIST",
+   gettext_noop
+   ("distribution of the message sizes (fixed, uniform or bimodal)"), 1,
+   &GNUNET_getopt_configure_set_string, &messageDistribution},
   {'g', "gnuplot", NULL,
    gettext_noop ("output in gnuplot format"), 0,
    &GNUNET_getopt_configure_set_one, &outputFormat},
@@ -68,12 +80,25 @@ static struct GNUNET_CommandLineOption gnunettbenchOptions[] = {
   {'i', "iterations", "ITER",
    gettext_noop ("number of iterations"), 1,
    &GNUNET_getopt_configure_set_ulong, &messageIterations},
+  {'l', "large", "PERMILLE",
+   gettext_noop ("per mille of large messages (for bimodal sizes)"), 1,
+   &GNUNET_getopt_configure_set_ulong, &messageLargeShare},
   GNUNET_COMMAND_LINE_OPTION_LOGGING,   /* -L */
+  {'m', "max-size", "SIZE",
+   gettext_noop ("maximum message size (for uniform or bimodal sizes)"), 1,
+   &GNUNET_getopt_configure_set_ulong, &messageMaxSize},
   {'n', "msg", "MESSAGES",
    gettext_noop ("number of messages to use per iteration"), 1,
    &GNUNET_getopt_configure_set_ulong, &messageCnt},
-  {'r', "rec", "RECEIVER",
-   gettext_noop ("receiver host identifier (ENC file name)"), 1,
+  {'p', "priority", "PRIORITIES",
+   gettext_noop
+   ("comma-separated list of priorities (one flow per receiver and priority)"),
+   1,
+   &GNUNET_getopt_configure_set_string, &messagePriorities},
+  {'r', "rec", "RECEIVERS",
+   gettext_noop
+   ("comma-separated list of receiver host identifiers (ENC file names)"),
+   1,
    &GNUNET_getopt_configure_set_string, &messageReceiver},
   {'s', "size", "SIZE",
    gettext_noop ("message size"), 1,
@@ -93,6 +118,115 @@ static struct GNUNET_CommandLineOption gnunettbenchOptions[] = {
 };
 
 
+/**
+ * Split a comma-separated list (in place).
+ *
+ * @param max size of the elements array
+ * @return number of elements, -1 if there are too many
+ */
+static int
+splitList (char *list, char **elements, unsigned int max)
+{
+  unsigned int count;
+  char *pos;
+
+  count = 0;
+  pos = list;
+  while (1)
+    {
+      if (count == max)
+        return -1;
+      elements[count++] = pos;
+      pos = strchr (pos, ',');
+      if (pos == NULL)
+        break;
+      *pos = '\0';
+      pos++;
+    }
+  return count;
+}
+
+/**
+ * Print the results of a benchmark.
+ *
+ * @param flows the flows that were requested
+ * @param receivers the names of the receivers of the flows
+ */
+static void
+printResults (const CS_tbench_flows_reply_MESSAGE * reply,
+              const CS_tbench_flow * flows, char *const *receivers)
+{
+  const CS_tbench_flow_result *res;
+  unsigned long long wallTime;
+  unsigned long long cpuTime;
+  unsigned long long bytes;
+  unsigned long long sent;
+  unsigned long long received;
+  unsigned int flowCount;
+  unsigned int i;
+  double kb;
+
+  flowCount = ntohl (reply->flowCount);
+  wallTime = GNUNET_ntohll (reply->wallTime);
+  cpuTime = GNUNET_ntohll (reply->cpuTime);
+  res = (const CS_tbench_flow_result *) &reply[1];
+  bytes = 0;
+  sent = 0;
+  received = 0;
+  for (i = 0; i < flowCount; i++)
+    {
+      bytes += GNUNET_ntohll (res[i].bytesReceived);
+      sent += ntohl (res[i].msgSent);
+      received += ntohl (res[i].msgReceived);
+    }
+  kb = bytes / 1024.0;
+  if (outputFormat == OF_GNUPLOT_INPUT)
+    {
+      printf ("%f %f %f %f\n",
+              wallTime / 1000.0 / messageIterations,
+              (sent == 0) ? 0.0 : (double) received / sent,
+              (wallTime == 0) ? 0.0 : kb * 1000000.0 / wallTime,
+              (kb == 0) ? 0.0 : cpuTime / kb);
+      return;
+    }
+  for (i = 0; i < flowCount; i++)
+    {
+      printf (_("Flow %u to `%.8s' with priority %u:\n"),
+              i, receivers[i], ntohl (flows[i].priority));
+      PRINTF (_("\tsent      %u messages (%llu bytes)\n"),
+              ntohl (res[i].msgSent), GNUNET_ntohll (res[i].bytesSent));
+      PRINTF (_("\treceived  %u messages (%llu bytes, %u duplicates)\n"),
+              ntohl (res[i].msgReceived),
+              GNUNET_ntohll (res[i].bytesReceived),
+              ntohl (res[i].duplicates));
+      if (ntohl (res[i].msgSent) > 0)
+        printf (_("\tloss      %8.4f%%\n"),
+                100.0 - 100.0 * ntohl (res[i].msgReceived) /
+                ntohl (res[i].msgSent));
+      PRINTF (_("\tlatency   p50 %lluus  p90 %lluus  p99 %lluus"
+                "  p99.9 %lluus  max %lluus\n"),
+              GNUNET_ntohll (res[i].latency[0]),
+              GNUNET_ntohll (res[i].latency[1]),
+              GNUNET_ntohll (res[i].latency[2]),
+              GNUNET_ntohll (res[i].latency[3]),
+              GNUNET_ntohll (res[i].latency[4]));
+    }
+  printf (_("Total:\n"));
+  PRINTF (_("\ttime      %llums\n"), wallTime / 1000);
+  if (wallTime > 0)
+    printf (_("\tthroughput %8.2f kB/s\n"), kb * 1000000.0 / wallTime);
+  if (cpuTime > 0)
+    {
+      PRINTF (_("\tCPU       %lluus"), cpuTime);
+      if (kb > 0)
+        printf (_(" (%8.2f us/kB)"), cpuTime / kb);
+      printf ("\n");
+    }
+  else
+    printf (_("\tCPU       not measured (not supported, or other"
+              " benchmarks ran at the same time)\n"));
+}
+
 /**
  * Tool to benchmark the performance of the P2P transports.
  *
@@ -104,12 +238,23 @@ int
 main (int argc, char *const *argv)
 {
   struct GNUNET_ClientServerConnection *sock;
-  CS_tbench_request_MESSAGE msg;
-  CS_tbench_reply_MESSAGE *buffer;
-  float messagesPercentLoss;
+  CS_tbench_flows_request_MESSAGE *msg;
+  CS_tbench_flows_reply_MESSAGE *buffer;
+  CS_tbench_flow *flows;
   struct GNUNET_GE_Context *ectx;
   struct GNUNET_GC_Configuration *cfg;
+  char *receivers[TBENCH_MAX_FLOWS];
+  char *priorities[TBENCH_MAX_FLOWS];
+  char *flowReceivers[TBENCH_MAX_FLOWS];
+  GNUNET_PeerIdentity receiverId;
+  unsigned int distribution;
+  unsigned int flowCount;
+  unsigned int size;
+  int receiverCount;
+  int priorityCount;
   int res;
+  int i;
+  int j;
 
   res = GNUNET_init (argc,
                      argv,
@@ -120,47 +265,110 @@ main (int argc, char *const *argv)
       GNUNET_fini (ectx, cfg);
       return -1;
     }
-  sock = GNUNET_client_connection_create (ectx, cfg);
-  if (sock == NULL)
+  if (messageReceiver == NULL)
     {
-      fprintf (stderr, _("Error establishing connection with gnunetd.\n"));
+      fprintf (stderr, _("You must specify a receiver!\n"));
       GNUNET_fini (ectx, cfg);
       return 1;
     }
-
-  msg.header.size = htons (sizeof (CS_tbench_request_MESSAGE));
-  msg.header.type = htons (GNUNET_CS_PROTO_TBENCH_REQUEST);
-  msg.msgSize = htonl (messageSize);
-  msg.msgCnt = htonl (messageCnt);
-  msg.iterations = htonl (messageIterations);
-  msg.intPktSpace = GNUNET_htonll (messageSpacing);
-  msg.trainSize = htonl (messageTrainSize);
-  msg.timeOut = GNUNET_htonll (messageTimeOut);
-  msg.priority = htonl (5);
-  if (messageReceiver == NULL)
+  if (messagePriorities == NULL)
+    messagePriorities = GNUNET_strdup ("5");
+  if (messageMaxSize < messageSize)
+    messageMaxSize = messageSize;
+  if (messageDistribution == NULL)
+    distribution = (messageMaxSize > messageSize)
+      ? TBENCH_SIZE_UNIFORM : TBENCH_SIZE_FIXED;
+  else if (0 == strcasecmp (messageDistribution, "fixed"))
+    distribution = TBENCH_SIZE_FIXED;
+  else if (0 == strcasecmp (messageDistribution, "uniform"))
+    distribution = TBENCH_SIZE_UNIFORM;
+  else if (0 == strcasecmp (messageDistribution, "bimodal"))
+    distribution = TBENCH_SIZE_BIMODAL;
+  else
     {
-      fprintf (stderr, _("You must specify a receiver!\n"));
-      GNUNET_client_connection_destroy (sock);
+      fprintf (stderr,
+               _("Unknown size distribution `%s'.\n"), messageDistribution);
+      GNUNET_free (messageDistribution);
+      GNUNET_free (messagePriorities);
+      GNUNET_free (messageReceiver);
       GNUNET_fini (ectx, cfg);
       return 1;
     }
-  if (GNUNET_OK !=
-      GNUNET_enc_to_hash (messageReceiver, &msg.receiverId.hashPubKey))
+  GNUNET_free_non_null (messageDistribution);
+  receiverCount = splitList (messageReceiver, receivers, TBENCH_MAX_FLOWS);
+  priorityCount =
+    splitList (messagePriorities, priorities, TBENCH_MAX_FLOWS);
+  if ((receiverCount == -1) ||
+      (priorityCount == -1) ||
+      (receiverCount * priorityCount > TBENCH_MAX_FLOWS))
     {
-      fprintf (stderr,
-               _
-               ("Invalid receiver peer ID specified (`%s' is not valid name).\n"),
-               messageReceiver);
+      fprintf (stderr, _("Too many flows (at most %u).\n"),
+               TBENCH_MAX_FLOWS);
+      GNUNET_free (messagePriorities);
       GNUNET_free (messageReceiver);
-      GNUNET_client_connection_destroy (sock);
       GNUNET_fini (ectx, cfg);
       return 1;
     }
-  GNUNET_free (messageReceiver);
+  flowCount = receiverCount * priorityCount;
+  size = sizeof (CS_tbench_flows_request_MESSAGE) +
+    flowCount * sizeof (CS_tbench_flow);
+  msg = GNUNET_malloc (size);
+  memset (msg, 0, size);
+  msg->header.size = htons (size);
+  msg->header.type = htons (GNUNET_CS_PROTO_TBENCH_FLOWS_REQUEST);
+  msg->iterations = htonl (messageIterations);
+  msg->flowCount = htonl (flowCount);
+  msg->timeOut = GNUNET_htonll (messageTimeOut);
+  flows = (CS_tbench_flow *) & msg[1];
+  for (i = 0; i < receiverCount; i++)
+    {
+      if (GNUNET_OK !=
+          GNUNET_enc_to_hash (receivers[i], &receiverId.hashPubKey))
+        {
+          fprintf (stderr,
+                   _
+                   ("Invalid receiver peer ID specified (`%s' is not valid name).\n"),
+                   receivers[i]);
+          GNUNET_free (msg);
+          GNUNET_free (messagePriorities);
+          GNUNET_free (messageReceiver);
+          GNUNET_fini (ectx, cfg);
+          return 1;
+        }
+      for (j = 0; j < priorityCount; j++)
+        {
+          flowReceivers[i * priorityCount + j] = receivers[i];
+          flows[i * priorityCount + j].receiverId = receiverId;
+          flows[i * priorityCount + j].msgCnt = htonl (messageCnt);
+          flows[i * priorityCount + j].minSize = htonl (messageSize);
+          flows[i * priorityCount + j].maxSize = htonl (messageMaxSize);
+          flows[i * priorityCount + j].distribution = htonl (distribution);
+          flows[i * priorityCount + j].largeShare =
+            htonl (messageLargeShare);
+          flows[i * priorityCount + j].priority =
+            htonl (strtoul (priorities[j], NULL, 10));
+          flows[i * priorityCount + j].trainSize = htonl (messageTrainSize);
+          flows[i * priorityCount + j].intPktSpace =
+            GNUNET_htonll (messageSpacing);
+        }
+    }
 
-  if (GNUNET_SYSERR == GNUNET_client_connection_write (sock, &msg.header))
+  sock = GNUNET_client_connection_create (ectx, cfg);
+  if (sock == NULL)
+    {
+      fprintf (stderr, _("Error establishing connection with gnunetd.\n"));
+      GNUNET_free (msg);
+      GNUNET_free (messagePriorities);
+      GNUNET_free (messageReceiver);
+      GNUNET_fini (ectx, cfg);
+      return 1;
+    }
+  if (GNUNET_SYSERR == GNUNET_client_connection_write (sock, &msg->header))
     {
       GNUNET_client_connection_destroy (sock);
+      GNUNET_free (msg);
+      GNUNET_free (messagePriorities);
+      GNUNET_free (messageReceiver);
       GNUNET_fini (ectx, cfg);
       return -1;
     }
@@ -170,40 +378,14 @@ main (int argc, char *const *argv)
       GNUNET_client_connection_read (sock,
                                      (GNUNET_MessageHeader **) & buffer))
     {
-      GNUNET_GE_ASSERT (ectx,
-                        ntohs (buffer->header.size) ==
-                        sizeof (CS_tbench_reply_MESSAGE));
-      if ((float) buffer->mean_loss < 0)
-        {
-          GNUNET_GE_BREAK (ectx, 0);
-          messagesPercentLoss = 0.0;
-        }
+      if ((ntohs (buffer->header.size) < sizeof (CS_tbench_flows_reply_MESSAGE)) ||
+          (ntohl (buffer->flowCount) != flowCount) ||
+          (ntohs (buffer->header.size) !=
+           sizeof (CS_tbench_flows_reply_MESSAGE) +
+           flowCount * sizeof (CS_tbench_flow_result)))
+        GNUNET_GE_BREAK (ectx, 0);
       else
-        {
-          messagesPercentLoss =
-            (buffer->mean_loss / ((float) htons (msg.msgCnt)));
-        }
-      switch (outputFormat)
-        {
-        case OF_HUMAN_READABLE:
-          printf (_("Time:\n"));
-          PRINTF (_("\tmax      %llums\n"), GNUNET_ntohll (buffer->max_time));
-          PRINTF (_("\tmin      %llums\n"), GNUNET_ntohll (buffer->min_time));
-          printf (_("\tmean     %8.4fms\n"), buffer->mean_time);
-          printf (_("\tvariance %8.4fms\n"), buffer->variance_time);
-
-          printf (_("Loss:\n"));
-          printf (_("\tmax      %u\n"), ntohl (buffer->max_loss));
-          printf (_("\tmin      %u\n"), ntohl (buffer->min_loss));
-          printf (_("\tmean     %8.4f\n"), buffer->mean_loss);
-          printf (_("\tvariance %8.4f\n"), buffer->variance_loss);
-          break;
-        case OF_GNUPLOT_INPUT:
-          printf ("%f %f\n", buffer->mean_time, 1.0 - messagesPercentLoss);
-          break;
-        default:
-          printf (_("Output format not known, this should not happen.\n"));
-        }
+        printResults (buffer, flows, flowReceivers);
       GNUNET_free (buffer);
     }
   else
@@ -211,6 +393,9 @@ main (int argc, char *const *argv)
             ("\nDid not receive the message from gnunetd. Is gnunetd running?\n"));
 
   GNUNET_client_connection_destroy (sock);
+  GNUNET_free (msg);
+  GNUNET_free (messagePriorities);
+  GNUNET_free (messageReceiver);
   GNUNET_fini (ectx, cfg);
   return 0;
 }
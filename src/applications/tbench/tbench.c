@@ -21,23 +21,27 @@
 /**
  * @file applications/tbench/tbench.c
  * @author Paul Ruth
- * @brief module to enable transport profiling.
+ * @brief module to enable transport profiling.  Runs one or more
+ *        flows of messages to other peers (that echo them back)
+ *        and measures loss, round-trip times and CPU usage.
  */
 
 #include "platform.h"
 #include "gnunet_protocols.h"
+#include "gnunet_stats_lib.h"
 #include "tbench.h"
 
 #define DEBUG_TBENCH GNUNET_NO
 
-typedef struct
-{
-  GNUNET_CronTime totalTime;
-  unsigned char *packetsReceived;
-  unsigned int maxPacketNumber;
-  unsigned int lossCount;
-  unsigned int duplicateCount;
-} IterationData;
+/**
+ * Maximum number of messages per flow and iteration.
+ */
+#define MAX_MESSAGES (1024 * 1024)
+
+/**
+ * Maximum number of iterations of one request.
+ */
+#define MAX_ITERATIONS (1024 * 1024)
 
 /**
  * Message exchanged between peers for profiling
@@ -53,39 +57,180 @@ typedef struct
   unsigned int crc;
 } P2P_tbench_MESSAGE;
 
+struct Session;
+
 /**
- * Lock for access to semaphores.
+ * State of one flow of a benchmark.
  */
-static struct GNUNET_Mutex *lock;
+struct Flow
+{
+  /**
+   * Next flow in the list of running flows.
+   */
+  struct Flow *next;
+
+  struct Session *session;
+
+  GNUNET_PeerIdentity receiver;
+
+  /**
+   * Message buffer (large enough for maxSize).
+   */
+  P2P_tbench_MESSAGE *p2p;
+
+  /**
+   * When was each message of the current iteration
+   * sent (GNUNET_get_time_us)?
+   */
+  unsigned long long *sendTime;
+
+  /**
+   * Which replies of the current iteration did we get?
+   */
+  unsigned char *packetsReceived;
+
+  /**
+   * Number of messages lost in each iteration.
+   */
+  unsigned int *lossCount;
+
+  /**
+   * Histogram of the round-trip times (in microseconds).
+   */
+  unsigned long long latency[GNUNET_STATS_HISTOGRAM_BUCKETS];
+
+  unsigned long long maxLatency;
+
+  unsigned long long bytesSent;
+
+  unsigned long long bytesReceived;
+
+  unsigned int msgSent;
+
+  unsigned int msgReceived;
+
+  unsigned int duplicates;
+
+  unsigned int msgCnt;
+
+  unsigned int minSize;
+
+  unsigned int maxSize;
 
-static struct GNUNET_Semaphore *postsem;
+  unsigned int distribution;
 
-static struct GNUNET_CronManager * cron;
+  unsigned int largeShare;
+
+  unsigned int priority;
+
+  unsigned int trainSize;
+
+  GNUNET_CronTime intPktSpace;
+
+  /**
+   * Nounce of the current iteration.
+   */
+  unsigned int nounce;
+
+  unsigned int iteration;
+
+  /**
+   * Number of the next message to send in this iteration.
+   */
+  unsigned int packetNum;
+
+  /**
+   * When may we send the next message?
+   */
+  GNUNET_CronTime nextSend;
+
+  /**
+   * Payload size for which "crc" was computed (the payload
+   * only changes between iterations, so for fixed sizes we
+   * compute the CRC once per iteration).
+   */
+  unsigned int crcSize;
+
+  unsigned int crc;
+};
 
 /**
- * What is the current iteration counter? (Used to verify
- * that replies match the current request series).
+ * A benchmark run (one client request).
  */
-static unsigned int currIteration;
+struct Session
+{
+  struct Flow *flows;
 
-static unsigned int currNounce;
+  unsigned int flowCount;
+
+  unsigned int iterations;
+
+  /**
+   * Signaled once all replies of an iteration were
+   * received or on timeout.
+   */
+  struct GNUNET_Semaphore *sem;
+
+  /**
+   * Number of replies still missing in this iteration.
+   */
+  unsigned int outstanding;
+
+  /**
+   * Is the current iteration over (GNUNET_YES/GNUNET_NO)?
+   * Replies received afterwards are not counted.
+   */
+  int done;
+
+  /**
+   * Did we receive the last reply for the current iteration
+   * before the timeout? If so, when?
+   */
+  GNUNET_CronTime earlyEnd;
+
+  /**
+   * How long did each iteration take?
+   */
+  GNUNET_CronTime *iterationTime;
+
+  /**
+   * Time spent on all iterations (in microseconds).
+   */
+  unsigned long long wallTime;
+
+  /**
+   * CPU time used by gnunetd during the iterations
+   * (in microseconds, 0 if other sessions overlapped).
+   */
+  unsigned long long cpuTime;
+};
 
 /**
- * Did the current iteration time-out? (GNUNET_YES/GNUNET_NO)
+ * Lock for access to the flows.
  */
-static int timeoutOccured;
-
-static struct GNUNET_GE_Context *ectx;
+static struct GNUNET_Mutex *lock;
 
-static GNUNET_CoreAPIForPlugins *coreAPI;
+/**
+ * Flows that are currently running (of all sessions).
+ */
+static struct Flow *runningFlows;
 
-static IterationData *results;
+/**
+ * Number of sessions that are currently running.
+ */
+static unsigned int activeSessions;
 
 /**
- * Did we receive the last response for the current iteration
- * before the timeout? If so, when?
+ * Number of sessions started so far (to detect sessions
+ * that started while another one was running).
  */
-static GNUNET_CronTime earlyEnd;
+static unsigned int startedSessions;
+
+static struct GNUNET_CronManager *cron;
+
+static struct GNUNET_GE_Context *ectx;
+
+static GNUNET_CoreAPIForPlugins *coreAPI;
 
 
 /**
@@ -140,8 +285,12 @@ handleTBenchReply (const GNUNET_PeerIdentity * sender,
                    const GNUNET_MessageHeader * message)
 {
   const P2P_tbench_MESSAGE *pmsg;
-  unsigned int lastPacketNumber;
-  IterationData *res;
+  struct Flow *flow;
+  struct Session *session;
+  unsigned long long now;
+  unsigned long long rtt;
+  unsigned int packetNum;
+  unsigned int nounce;
 
   if (ntohs (message->size) < sizeof (P2P_tbench_MESSAGE))
     {
@@ -156,33 +305,48 @@ handleTBenchReply (const GNUNET_PeerIdentity * sender,
       GNUNET_GE_BREAK (ectx, 0);
       return GNUNET_SYSERR;
     }
+  now = GNUNET_get_time_us ();
+  nounce = ntohl (pmsg->nounce);
   GNUNET_mutex_lock (lock);
-  if ((timeoutOccured == GNUNET_NO) &&
-      (postsem != NULL) &&
-      (htonl (pmsg->iterationNum) == currIteration) &&
-      (htonl (pmsg->nounce) == currNounce))
+  flow = runningFlows;
+  while ((flow != NULL) &&
+         ((flow->nounce != nounce) ||
+          (0 != memcmp (sender, &flow->receiver,
+                        sizeof (GNUNET_PeerIdentity)))))
+    flow = flow->next;
+  if ((flow != NULL) &&
+      (flow->session->done == GNUNET_NO) &&
+      (ntohl (pmsg->iterationNum) == flow->iteration) &&
+      (ntohl (pmsg->packetNum) < flow->packetNum))
     {
-      res = &results[currIteration];
-      lastPacketNumber = ntohl (pmsg->packetNum);
-      if (lastPacketNumber <= res->maxPacketNumber)
+      session = flow->session;
+      packetNum = ntohl (pmsg->packetNum);
+      if (flow->packetsReceived[packetNum] == 0)
         {
-          if (0 == res->packetsReceived[lastPacketNumber]++)
+          flow->packetsReceived[packetNum] = 1;
+          rtt = now - flow->sendTime[packetNum];
+          flow->latency[GNUNET_STATS_histogram_bucket (rtt)]++;
+          if (rtt > flow->maxLatency)
+            flow->maxLatency = rtt;
+          flow->msgReceived++;
+          flow->bytesReceived += ntohs (message->size);
+          flow->lossCount[flow->iteration]--;
+          session->outstanding--;
+          if (session->outstanding == 0)
             {
-              res->lossCount--;
-              if (res->lossCount == 0)
-                earlyEnd = GNUNET_get_time ();
-            }
-          else
-            {
-              res->duplicateCount++;
+              session->earlyEnd = GNUNET_get_time ();
+              GNUNET_semaphore_up (session->sem);
             }
         }
+      else
+        {
+          flow->duplicates++;
+        }
 #if DEBUG_TBENCH
       GNUNET_GE_LOG (ectx,
                      GNUNET_GE_DEBUG | GNUNET_GE_BULK | GNUNET_GE_USER,
                      "Received response %u from iteration %u/%u on time!\n",
-                     htonl (pmsg->packetNum),
-                     htonl (pmsg->iterationNum), htonl (pmsg->nounce));
+                     packetNum, flow->iteration, nounce);
 #endif
     }
   else
@@ -190,9 +354,9 @@ handleTBenchReply (const GNUNET_PeerIdentity * sender,
 #if DEBUG_TBENCH
       GNUNET_GE_LOG (ectx,
                      GNUNET_GE_DEBUG | GNUNET_GE_BULK | GNUNET_GE_USER,
-                     "Received message %u from iteration %u too late (now at iteration %u)\n",
+                     "Received message %u from iteration %u/%u too late\n",
                      ntohl (pmsg->packetNum),
-                     ntohl (pmsg->iterationNum), currIteration);
+                     ntohl (pmsg->iterationNum), nounce);
 #endif
     }
   GNUNET_mutex_unlock (lock);
@@ -205,28 +369,379 @@ handleTBenchReply (const GNUNET_PeerIdentity * sender,
 static void
 semaUp (void *cls)
 {
-  struct GNUNET_Semaphore *sem = cls;
-  timeoutOccured = GNUNET_YES;
-  GNUNET_semaphore_up (sem);
+  struct Session *session = cls;
+
+  GNUNET_mutex_lock (lock);
+  session->done = GNUNET_YES;
+  GNUNET_mutex_unlock (lock);
+  GNUNET_semaphore_up (session->sem);
+}
+
+/**
+ * Get the CPU time (user and system) used by gnunetd.
+ *
+ * @return CPU time in microseconds, 0 if not available
+ */
+static unsigned long long
+getCPUTime ()
+{
+#if HAVE_GETRUSAGE
+  struct rusage ru;
+
+  if (0 != getrusage (RUSAGE_SELF, &ru))
+    return 0;
+  return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000ULL +
+    ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+#else
+  return 0;
+#endif
+}
+
+/**
+ * Set up a flow from its description.
+ *
+ * @return GNUNET_OK on success, GNUNET_SYSERR if the
+ *         description is invalid
+ */
+static int
+initFlow (struct Session *session,
+          struct Flow *flow, const CS_tbench_flow * spec)
+{
+  flow->session = session;
+  flow->receiver = spec->receiverId;
+  flow->msgCnt = ntohl (spec->msgCnt);
+  flow->minSize = ntohl (spec->minSize);
+  flow->maxSize = ntohl (spec->maxSize);
+  flow->distribution = ntohl (spec->distribution);
+  flow->largeShare = ntohl (spec->largeShare);
+  flow->priority = ntohl (spec->priority);
+  flow->trainSize = ntohl (spec->trainSize);
+  flow->intPktSpace = GNUNET_ntohll (spec->intPktSpace);
+  if (flow->distribution == TBENCH_SIZE_FIXED)
+    flow->maxSize = flow->minSize;
+  if ((flow->distribution > TBENCH_SIZE_BIMODAL) ||
+      (flow->minSize > flow->maxSize) ||
+      (flow->maxSize >=
+       GNUNET_MAX_BUFFER_SIZE - sizeof (P2P_tbench_MESSAGE)) ||
+      (flow->msgCnt > MAX_MESSAGES))
+    return GNUNET_SYSERR;
+  flow->p2p = GNUNET_malloc (sizeof (P2P_tbench_MESSAGE) + flow->maxSize);
+  memset (flow->p2p, 0, sizeof (P2P_tbench_MESSAGE));
+  flow->p2p->header.type = htons (GNUNET_P2P_PROTO_TBENCH_REQUEST);
+  flow->p2p->priority = htonl (flow->priority);
+  flow->sendTime =
+    GNUNET_malloc (sizeof (unsigned long long) * (flow->msgCnt + 1));
+  flow->packetsReceived = GNUNET_malloc (flow->msgCnt + 1);
+  flow->lossCount =
+    GNUNET_malloc (sizeof (unsigned int) * session->iterations);
+  return GNUNET_OK;
+}
+
+/**
+ * Unregister the flows of a session and free it.
+ */
+static void
+destroySession (struct Session *session)
+{
+  struct Flow *pos;
+  struct Flow *prev;
+  unsigned int i;
+
+  GNUNET_mutex_lock (lock);
+  prev = NULL;
+  pos = runningFlows;
+  while (pos != NULL)
+    {
+      if (pos->session == session)
+        {
+          if (prev == NULL)
+            runningFlows = pos->next;
+          else
+            prev->next = pos->next;
+        }
+      else
+        prev = pos;
+      pos = pos->next;
+    }
+  GNUNET_mutex_unlock (lock);
+  for (i = 0; i < session->flowCount; i++)
+    {
+      GNUNET_free (session->flows[i].p2p);
+      GNUNET_free (session->flows[i].sendTime);
+      GNUNET_free (session->flows[i].packetsReceived);
+      GNUNET_free (session->flows[i].lossCount);
+    }
+  GNUNET_semaphore_destroy (session->sem);
+  GNUNET_free (session->flows);
+  GNUNET_free (session->iterationTime);
+  GNUNET_free (session);
+}
+
+/**
+ * Create a session and register its flows with the reply handler.
+ *
+ * @param flows the descriptions of the flows
+ * @return NULL if a flow description is invalid
+ */
+static struct Session *
+createSession (unsigned int iterations,
+               unsigned int flowCount, const CS_tbench_flow * flows)
+{
+  struct Session *session;
+  unsigned int i;
+
+  session = GNUNET_malloc (sizeof (struct Session));
+  memset (session, 0, sizeof (struct Session));
+  session->iterations = iterations;
+  session->iterationTime =
+    GNUNET_malloc (sizeof (GNUNET_CronTime) * iterations);
+  session->flows = GNUNET_malloc (sizeof (struct Flow) * flowCount);
+  memset (session->flows, 0, sizeof (struct Flow) * flowCount);
+  session->sem = GNUNET_semaphore_create (0);
+  session->done = GNUNET_YES;
+  GNUNET_mutex_lock (lock);
+  for (i = 0; i < flowCount; i++)
+    {
+      if (GNUNET_OK != initFlow (session, &session->flows[i], &flows[i]))
+        {
+          GNUNET_mutex_unlock (lock);
+          destroySession (session);
+          return NULL;
+        }
+      session->flows[i].next = runningFlows;
+      runningFlows = &session->flows[i];
+      session->flowCount++;
+    }
+  GNUNET_mutex_unlock (lock);
+  return session;
+}
+
+/**
+ * Pick the payload size of the next message of a flow.
+ */
+static unsigned int
+chooseSize (const struct Flow *flow)
+{
+  switch (flow->distribution)
+    {
+    case TBENCH_SIZE_UNIFORM:
+      return flow->minSize +
+        GNUNET_random_u32 (GNUNET_RANDOM_QUALITY_WEAK,
+                           flow->maxSize - flow->minSize + 1);
+    case TBENCH_SIZE_BIMODAL:
+      if (GNUNET_random_u32 (GNUNET_RANDOM_QUALITY_WEAK, 1000) <
+          flow->largeShare)
+        return flow->maxSize;
+      return flow->minSize;
+    default:
+      return flow->minSize;
+    }
+}
+
+/**
+ * Prepare a flow for the next iteration.  Call only when
+ * synchronized!
+ */
+static void
+startIteration (struct Flow *flow, unsigned int iteration)
+{
+  flow->iteration = iteration;
+  flow->nounce = GNUNET_random_u32 (GNUNET_RANDOM_QUALITY_WEAK, 0xFFFFFF);
+  flow->packetNum = 0;
+  flow->nextSend = 0;
+  flow->lossCount[iteration] = flow->msgCnt;
+  memset (flow->packetsReceived, 0, flow->msgCnt);
+  flow->p2p->iterationNum = htonl (iteration);
+  flow->p2p->nounce = htonl (flow->nounce);
+  memset (&flow->p2p[1],
+          GNUNET_random_u32 (GNUNET_RANDOM_QUALITY_WEAK, 256),
+          flow->maxSize);
+  flow->crcSize = flow->maxSize + 1;    /* invalid */
+}
+
+/**
+ * Send the next message of a flow.
+ */
+static void
+sendMessage (struct Flow *flow)
+{
+  unsigned int size;
+  unsigned int packetNum;
+
+  size = chooseSize (flow);
+  if (size != flow->crcSize)
+    {
+      flow->crc = GNUNET_crc32_n (&flow->p2p[1], size);
+      flow->crcSize = size;
+    }
+  flow->p2p->header.size = htons (sizeof (P2P_tbench_MESSAGE) + size);
+  flow->p2p->crc = htonl (flow->crc);
+  GNUNET_mutex_lock (lock);
+  packetNum = flow->packetNum;
+  flow->p2p->packetNum = htonl (packetNum);
+  flow->sendTime[packetNum] = GNUNET_get_time_us ();
+  flow->packetNum++;
+  flow->msgSent++;
+  flow->bytesSent += sizeof (P2P_tbench_MESSAGE) + size;
+  GNUNET_mutex_unlock (lock);
+#if DEBUG_TBENCH
+  GNUNET_GE_LOG (ectx,
+                 GNUNET_GE_DEBUG | GNUNET_GE_BULK | GNUNET_GE_USER,
+                 "Sending message %u of size %u in iteration %u\n",
+                 packetNum, size, flow->iteration);
+#endif
+  coreAPI->ciphertext_send (&flow->receiver, &flow->p2p->header, flow->priority, 0);    /* no delay */
+  if ((flow->intPktSpace != 0) &&
+      (flow->trainSize != 0) && (packetNum % flow->trainSize) == 0)
+    flow->nextSend = GNUNET_get_time () + flow->intPktSpace;
+}
+
+/**
+ * Send the messages of all flows of a session for one
+ * iteration.  The flows take turns; a flow that has to pause
+ * between trains does not hold up the others.
+ *
+ * @return GNUNET_OK on success, GNUNET_SYSERR on shutdown
+ */
+static int
+sendAll (struct Session *session)
+{
+  struct Flow *flow;
+  struct Flow *next;
+  GNUNET_CronTime now;
+  unsigned int last;
+  unsigned int chosen;
+  unsigned int i;
+  unsigned int j;
+
+  last = session->flowCount - 1;
+  while (1)
+    {
+      if (GNUNET_YES == GNUNET_shutdown_test ())
+        return GNUNET_SYSERR;
+      /* earliest flow with messages left, round-robin on ties */
+      next = NULL;
+      chosen = last;
+      for (i = 1; i <= session->flowCount; i++)
+        {
+          j = (last + i) % session->flowCount;
+          flow = &session->flows[j];
+          if ((flow->packetNum < flow->msgCnt) &&
+              ((next == NULL) || (flow->nextSend < next->nextSend)))
+            {
+              next = flow;
+              chosen = j;
+            }
+        }
+      if (next == NULL)
+        break;
+      last = chosen;
+      now = GNUNET_get_time ();
+      if (next->nextSend > now)
+        GNUNET_thread_sleep (next->nextSend - now);
+      sendMessage (next);
+    }
+  return GNUNET_OK;
+}
+
+/**
+ * Run all iterations of a session.
+ *
+ * @param timeOut how long to wait for the replies of
+ *        an iteration (in milliseconds)
+ * @return GNUNET_OK on success, GNUNET_SYSERR on shutdown
+ */
+static int
+runSession (struct Session *session, GNUNET_CronTime timeOut)
+{
+  unsigned long long startWall;
+  unsigned long long startCPU;
+  GNUNET_CronTime startTime;
+  unsigned int iteration;
+  unsigned int i;
+  unsigned int started;
+  int overlap;
+  int ret;
+  int wait;
+  int early;
+
+  ret = GNUNET_OK;
+  GNUNET_mutex_lock (lock);
+  overlap = (activeSessions > 0) ? GNUNET_YES : GNUNET_NO;
+  activeSessions++;
+  started = ++startedSessions;
+  GNUNET_mutex_unlock (lock);
+  startWall = GNUNET_get_time_us ();
+  startCPU = getCPUTime ();
+  for (iteration = 0; iteration < session->iterations; iteration++)
+    {
+      GNUNET_mutex_lock (lock);
+      session->outstanding = 0;
+      session->earlyEnd = 0;
+      for (i = 0; i < session->flowCount; i++)
+        {
+          startIteration (&session->flows[i], iteration);
+          session->outstanding += session->flows[i].msgCnt;
+        }
+      wait = (session->outstanding > 0) ? GNUNET_YES : GNUNET_NO;
+      session->done = GNUNET_NO;
+      GNUNET_mutex_unlock (lock);
+      startTime = GNUNET_get_time ();
+      if (wait == GNUNET_YES)
+        {
+          GNUNET_cron_add_job (cron,
+                               &semaUp,
+                               timeOut * GNUNET_CRON_MILLISECONDS, 0,
+                               session);
+          if (GNUNET_OK != sendAll (session))
+            ret = GNUNET_SYSERR;
+          GNUNET_semaphore_down (session->sem, GNUNET_YES);
+        }
+      GNUNET_mutex_lock (lock);
+      session->done = GNUNET_YES;
+      early = (session->earlyEnd != 0) ? GNUNET_YES : GNUNET_NO;
+      GNUNET_mutex_unlock (lock);
+      /* if the timeout job ran (or is running) after the last
+         reply arrived, it signals the semaphore once more */
+      if ((wait == GNUNET_YES) &&
+          (0 == GNUNET_cron_del_job (cron, &semaUp, 0, session)) &&
+          (early == GNUNET_YES))
+        GNUNET_semaphore_down (session->sem, GNUNET_YES);
+      if (early == GNUNET_YES)
+        session->iterationTime[iteration] = session->earlyEnd - startTime;
+      else
+        session->iterationTime[iteration] = GNUNET_get_time () - startTime;
+      if (ret != GNUNET_OK)
+        break;
+    }
+  session->wallTime = GNUNET_get_time_us () - startWall;
+  session->cpuTime = getCPUTime () - startCPU;
+  GNUNET_mutex_lock (lock);
+  activeSessions--;
+  if (started != startedSessions)
+    overlap = GNUNET_YES;
+  GNUNET_mutex_unlock (lock);
+  /* the CPU time is that of the whole process; do not report
+     it if another session may have contributed to it */
+  if (overlap == GNUNET_YES)
+    session->cpuTime = 0;
+  return ret;
 }
 
 /**
- * Handle client request (main function)
+ * Handle client request for a single flow (iteration statistics
+ * of time and loss).
  */
 static int
 csHandleTBenchRequest (struct GNUNET_ClientHandle *client,
                        const GNUNET_MessageHeader * message)
 {
-  CS_tbench_request_MESSAGE *msg;
+  const CS_tbench_request_MESSAGE *msg;
   CS_tbench_reply_MESSAGE reply;
-  P2P_tbench_MESSAGE *p2p;
-  unsigned short size;
+  CS_tbench_flow spec;
+  struct Session *session;
+  struct Flow *flow;
   unsigned int iteration;
-  unsigned int packetNum;
-  GNUNET_CronTime startTime;
-  GNUNET_CronTime endTime;
-  GNUNET_CronTime now;
-  GNUNET_CronTime delay;
   unsigned long long sum_loss;
   unsigned int max_loss;
   unsigned int min_loss;
@@ -235,143 +750,59 @@ csHandleTBenchRequest (struct GNUNET_ClientHandle *client,
   GNUNET_CronTime max_time;
   double sum_variance_time;
   double sum_variance_loss;
-  unsigned int msgCnt;
   unsigned int iterations;
 
-#if DEBUG_TBENCH
-  GNUNET_GE_LOG (ectx,
-                 GNUNET_GE_DEBUG | GNUNET_GE_USER | GNUNET_GE_BULK,
-                 "Tbench received request from client.\n", msgCnt, size,
-                 iterations);
-#endif
   if (ntohs (message->size) != sizeof (CS_tbench_request_MESSAGE))
     return GNUNET_SYSERR;
-
-  msg = (CS_tbench_request_MESSAGE *) message;
-  size = sizeof (P2P_tbench_MESSAGE) + ntohl (msg->msgSize);
-  if (size < sizeof (P2P_tbench_MESSAGE))
-    return GNUNET_SYSERR;
-  delay = GNUNET_ntohll (msg->intPktSpace);
+  msg = (const CS_tbench_request_MESSAGE *) message;
   iterations = ntohl (msg->iterations);
-  msgCnt = ntohl (msg->msgCnt);
+  if ((iterations == 0) || (iterations > MAX_ITERATIONS))
+    return GNUNET_SYSERR;
 #if DEBUG_TBENCH
   GNUNET_GE_LOG (ectx,
                  GNUNET_GE_INFO | GNUNET_GE_USER | GNUNET_GE_BULK,
                  "Tbench runs %u test messages of size %u in %u iterations.\n",
-                 msgCnt, size, iterations);
+                 ntohl (msg->msgCnt), ntohl (msg->msgSize), iterations);
 #endif
-  GNUNET_mutex_lock (lock);
-  if (results != NULL)
+  memset (&spec, 0, sizeof (CS_tbench_flow));
+  spec.receiverId = msg->receiverId;
+  spec.msgCnt = msg->msgCnt;
+  spec.minSize = msg->msgSize;
+  spec.maxSize = msg->msgSize;
+  spec.distribution = htonl (TBENCH_SIZE_FIXED);
+  spec.priority = msg->priority;
+  spec.trainSize = msg->trainSize;
+  spec.intPktSpace = msg->intPktSpace;
+  session = createSession (iterations, 1, &spec);
+  if (session == NULL)
+    return GNUNET_SYSERR;
+  if (GNUNET_OK != runSession (session, GNUNET_ntohll (msg->timeOut)))
     {
-      GNUNET_GE_LOG (ectx,
-                     GNUNET_GE_WARNING | GNUNET_GE_USER | GNUNET_GE_IMMEDIATE,
-                     "Cannot run multiple tbench sessions at the same time!\n");
-      GNUNET_mutex_unlock (lock);
+      destroySession (session);
       return GNUNET_SYSERR;
     }
-  results = GNUNET_malloc (sizeof (IterationData) * iterations);
-
-  p2p = GNUNET_malloc (size);
-  memset (p2p, 0, size);
-  p2p->header.size = htons (size);
-  p2p->header.type = htons (GNUNET_P2P_PROTO_TBENCH_REQUEST);
-  p2p->priority = msg->priority;
-
-  for (iteration = 0; iteration < iterations; iteration++)
-    {
-      if (GNUNET_YES == GNUNET_shutdown_test())
-	{
-	  GNUNET_free (p2p);
-	  GNUNET_free (results);
-	  GNUNET_mutex_unlock (lock);
-	  return GNUNET_SYSERR;
-	}
-      results[iteration].maxPacketNumber = msgCnt;
-      results[iteration].packetsReceived = GNUNET_malloc (msgCnt);
-      memset (results[iteration].packetsReceived, 0, msgCnt);
-      results[iteration].lossCount = msgCnt;
-      results[iteration].duplicateCount = 0;
-
-      earlyEnd = 0;
-      postsem = GNUNET_semaphore_create (0);
-      currNounce = GNUNET_random_u32 (GNUNET_RANDOM_QUALITY_WEAK, 0xFFFFFF);
-      p2p->nounce = htonl (currNounce);
-      currIteration = iteration;
-      p2p->iterationNum = htonl (currIteration);
-      memset (&p2p[1],
-              GNUNET_random_u32 (GNUNET_RANDOM_QUALITY_WEAK, 256),
-              size - sizeof (P2P_tbench_MESSAGE));
-      p2p->crc =
-        htonl (GNUNET_crc32_n (&p2p[1], size - sizeof (P2P_tbench_MESSAGE)));
-      GNUNET_mutex_unlock (lock);       /* allow receiving */
-
-      startTime = GNUNET_get_time ();
-      endTime = startTime + GNUNET_ntohll (msg->timeOut);
-
-      timeoutOccured = GNUNET_NO;
-      GNUNET_cron_add_job (cron,
-                           &semaUp,
-                           GNUNET_ntohll (msg->timeOut) *
-                           GNUNET_CRON_MILLISECONDS, 0, postsem);
-      for (packetNum = 0; packetNum < msgCnt; packetNum++)
-        {
-	  if (GNUNET_YES == GNUNET_shutdown_test())
-	    {
-	      GNUNET_free(p2p);
-	      GNUNET_free (results);
-	      return GNUNET_SYSERR;
-	    }
-          now = GNUNET_get_time ();
-          p2p->packetNum = htonl (packetNum);
-#if DEBUG_TBENCH
-          GNUNET_GE_LOG (ectx,
-                         GNUNET_GE_DEBUG | GNUNET_GE_BULK | GNUNET_GE_USER,
-                         "Sending message %u of size %u in iteration %u\n",
-                         packetNum, size, iteration);
-#endif
-          coreAPI->ciphertext_send (&msg->receiverId, &p2p->header, ntohl (msg->priority), 0);  /* no delay */
-          if ((delay != 0) &&
-              (htonl (msg->trainSize) != 0) &&
-              (packetNum % htonl (msg->trainSize)) == 0)
-            GNUNET_thread_sleep (delay);
-        }
-      GNUNET_semaphore_down (postsem, GNUNET_YES);
-      GNUNET_mutex_lock (lock);
-      if (earlyEnd == 0)
-        earlyEnd = GNUNET_get_time ();
-      results[iteration].totalTime = earlyEnd - startTime;
-      GNUNET_free (results[iteration].packetsReceived);
-      GNUNET_semaphore_destroy (postsem);
-      postsem = NULL;
-    }
-  GNUNET_mutex_unlock (lock);
-  GNUNET_free (p2p);
-#if DEBUG_TBENCH
-  GNUNET_GE_LOG (ectx,
-                 GNUNET_GE_DEBUG | GNUNET_GE_BULK | GNUNET_GE_USER,
-                 "Done waiting for response.\n", packetNum, size, iteration);
-#endif
+  flow = &session->flows[0];
 
   sum_loss = 0;
   sum_time = 0;
   max_loss = 0;
-  min_loss = msgCnt;
+  min_loss = flow->msgCnt;
   min_time = 1 * GNUNET_CRON_YEARS;
   max_time = 0;
   /* data post-processing */
   for (iteration = 0; iteration < iterations; iteration++)
     {
-      sum_loss += results[iteration].lossCount;
-      sum_time += results[iteration].totalTime;
-
-      if (results[iteration].lossCount > max_loss)
-        max_loss = results[iteration].lossCount;
-      if (results[iteration].lossCount < min_loss)
-        min_loss = results[iteration].lossCount;
-      if (results[iteration].totalTime > max_time)
-        max_time = results[iteration].totalTime;
-      if (results[iteration].totalTime < min_time)
-        min_time = results[iteration].totalTime;
+      sum_loss += flow->lossCount[iteration];
+      sum_time += session->iterationTime[iteration];
+
+      if (flow->lossCount[iteration] > max_loss)
+        max_loss = flow->lossCount[iteration];
+      if (flow->lossCount[iteration] < min_loss)
+        min_loss = flow->lossCount[iteration];
+      if (session->iterationTime[iteration] > max_time)
+        max_time = session->iterationTime[iteration];
+      if (session->iterationTime[iteration] < min_time)
+        min_time = session->iterationTime[iteration];
     }
 
   sum_variance_time = 0.0;
@@ -379,12 +810,13 @@ csHandleTBenchRequest (struct GNUNET_ClientHandle *client,
   for (iteration = 0; iteration < iterations; iteration++)
     {
       sum_variance_time +=
-        (results[iteration].totalTime - sum_time / iterations) *
-        (results[iteration].totalTime - sum_time / iterations);
+        (session->iterationTime[iteration] - sum_time / iterations) *
+        (session->iterationTime[iteration] - sum_time / iterations);
       sum_variance_loss +=
-        (results[iteration].lossCount - sum_loss / iterations) *
-        (results[iteration].lossCount - sum_loss / iterations);
+        (flow->lossCount[iteration] - sum_loss / iterations) *
+        (flow->lossCount[iteration] - sum_loss / iterations);
     }
+  destroySession (session);
 
   /* send collected stats back to client */
   reply.header.size = htons (sizeof (CS_tbench_reply_MESSAGE));
@@ -397,11 +829,92 @@ csHandleTBenchRequest (struct GNUNET_ClientHandle *client,
   reply.min_time = GNUNET_htonll (min_time);
   reply.variance_time = sum_variance_time / (iterations - 1);
   reply.variance_loss = sum_variance_loss / (iterations - 1);
-  GNUNET_free (results);
-  results = NULL;
   return coreAPI->cs_send_message (client, &reply.header, GNUNET_YES);
 }
 
+/**
+ * Handle client request to run several flows at the same time.
+ */
+static int
+csHandleTBenchFlowsRequest (struct GNUNET_ClientHandle *client,
+                            const GNUNET_MessageHeader * message)
+{
+  static const double percentiles[TBENCH_PERCENTILES - 1] =
+    { 50.0, 90.0, 99.0, 99.9 };
+  const CS_tbench_flows_request_MESSAGE *msg;
+  CS_tbench_flows_reply_MESSAGE *reply;
+  CS_tbench_flow_result *res;
+  struct Session *session;
+  struct Flow *flow;
+  unsigned long long latency;
+  unsigned int flowCount;
+  unsigned int iterations;
+  unsigned int size;
+  unsigned int i;
+  unsigned int j;
+  int ret;
+
+  if (ntohs (message->size) < sizeof (CS_tbench_flows_request_MESSAGE))
+    return GNUNET_SYSERR;
+  msg = (const CS_tbench_flows_request_MESSAGE *) message;
+  flowCount = ntohl (msg->flowCount);
+  iterations = ntohl (msg->iterations);
+  if ((flowCount == 0) ||
+      (flowCount > TBENCH_MAX_FLOWS) ||
+      (ntohs (message->size) !=
+       sizeof (CS_tbench_flows_request_MESSAGE) +
+       flowCount * sizeof (CS_tbench_flow)) ||
+      (iterations == 0) || (iterations > MAX_ITERATIONS))
+    {
+      GNUNET_GE_BREAK (ectx, 0);
+      return GNUNET_SYSERR;
+    }
+  session = createSession (iterations,
+                           flowCount, (const CS_tbench_flow *) &msg[1]);
+  if (session == NULL)
+    return GNUNET_SYSERR;
+  if (GNUNET_OK != runSession (session, GNUNET_ntohll (msg->timeOut)))
+    {
+      destroySession (session);
+      return GNUNET_SYSERR;
+    }
+  size = sizeof (CS_tbench_flows_reply_MESSAGE) +
+    flowCount * sizeof (CS_tbench_flow_result);
+  reply = GNUNET_malloc (size);
+  memset (reply, 0, size);
+  reply->header.size = htons (size);
+  reply->header.type = htons (GNUNET_CS_PROTO_TBENCH_FLOWS_REPLY);
+  reply->flowCount = htonl (flowCount);
+  reply->wallTime = GNUNET_htonll (session->wallTime);
+  reply->cpuTime = GNUNET_htonll (session->cpuTime);
+  res = (CS_tbench_flow_result *) & reply[1];
+  for (i = 0; i < flowCount; i++)
+    {
+      flow = &session->flows[i];
+      res[i].bytesSent = GNUNET_htonll (flow->bytesSent);
+      res[i].bytesReceived = GNUNET_htonll (flow->bytesReceived);
+      res[i].msgSent = htonl (flow->msgSent);
+      res[i].msgReceived = htonl (flow->msgReceived);
+      res[i].duplicates = htonl (flow->duplicates);
+      for (j = 0; j < TBENCH_PERCENTILES - 1; j++)
+        {
+          latency =
+            GNUNET_STATS_histogram_percentile (flow->latency,
+                                               GNUNET_STATS_HISTOGRAM_BUCKETS,
+                                               percentiles[j]);
+          if (latency > flow->maxLatency)
+            latency = flow->maxLatency;
+          res[i].latency[j] = GNUNET_htonll (latency);
+        }
+      res[i].latency[TBENCH_PERCENTILES - 1] =
+        GNUNET_htonll (flow->maxLatency);
+    }
+  destroySession (session);
+  ret = coreAPI->cs_send_message (client, &reply->header, GNUNET_YES);
+  GNUNET_free (reply);
+  return ret;
+}
+
 /**
  * Initialize the AFS module. This method name must match
  * the library name (libgnunet_XXX => initialize_XXX).
@@ -427,6 +940,10 @@ initialize_module_tbench (GNUNET_CoreAPIForPlugins * capi)
       capi->cs_handler_register (GNUNET_CS_PROTO_TBENCH_REQUEST,
                                  &csHandleTBenchRequest))
     ok = GNUNET_SYSERR;
+  if (GNUNET_SYSERR ==
+      capi->cs_handler_register (GNUNET_CS_PROTO_TBENCH_FLOWS_REQUEST,
+                                 &csHandleTBenchFlowsRequest))
+    ok = GNUNET_SYSERR;
   cron = GNUNET_cron_create(capi->ectx);
   GNUNET_cron_start(cron);
   GNUNET_GE_ASSERT (capi->ectx,
@@ -449,6 +966,8 @@ done_module_tbench ()
                                               &handleTBenchReply);
   coreAPI->cs_handler_unregister (GNUNET_CS_PROTO_TBENCH_REQUEST,
                                   &csHandleTBenchRequest);
+  coreAPI->cs_handler_unregister (GNUNET_CS_PROTO_TBENCH_FLOWS_REQUEST,
+                                  &csHandleTBenchFlowsRequest);
   GNUNET_mutex_destroy (lock);
   GNUNET_cron_stop(cron);
   GNUNET_cron_destroy (cron);
@@ -89,4 +89,161 @@ typedef struct
   float variance_time GNUNET_PACKED;
 } CS_tbench_reply_MESSAGE;
 
+/**
+ * All messages of a flow have "minSize" bytes.
+ */
+#define TBENCH_SIZE_FIXED 0
+
+/**
+ * Message sizes of a flow are uniformly distributed
+ * between "minSize" and "maxSize".
+ */
+#define TBENCH_SIZE_UNIFORM 1
+
+/**
+ * Messages of a flow have "maxSize" bytes with a probability
+ * of "largeShare" per mille, "minSize" bytes otherwise.
+ */
+#define TBENCH_SIZE_BIMODAL 2
+
+/**
+ * Maximum number of flows in one request.
+ */
+#define TBENCH_MAX_FLOWS 64
+
+/**
+ * Number of latency percentiles in a flow result
+ * (50, 90, 99, 99.9 and 100).
+ */
+#define TBENCH_PERCENTILES 5
+
+/**
+ * One flow of a multi-flow request.
+ */
+typedef struct
+{
+  /**
+   * Which peer should receive the messages?
+   */
+  GNUNET_PeerIdentity receiverId;
+  /**
+   * How many messages should be transmitted in
+   * each iteration?
+   */
+  unsigned int msgCnt GNUNET_PACKED;
+  /**
+   * Smallest message size (plus headers).
+   */
+  unsigned int minSize GNUNET_PACKED;
+  /**
+   * Largest message size (plus headers).
+   */
+  unsigned int maxSize GNUNET_PACKED;
+  /**
+   * How are the sizes distributed (TBENCH_SIZE_XXX)?
+   */
+  unsigned int distribution GNUNET_PACKED;
+  /**
+   * Per mille of large messages (for TBENCH_SIZE_BIMODAL).
+   */
+  unsigned int largeShare GNUNET_PACKED;
+  /**
+   * Which priority should be used?
+   */
+  unsigned int priority GNUNET_PACKED;
+  /**
+   * intPktSpace delay is only introduced every
+   * trainSize messages.
+   */
+  unsigned int trainSize GNUNET_PACKED;
+  /**
+   * For 64-bit alignment...
+   */
+  unsigned int reserved GNUNET_PACKED;
+  /**
+   * Inter packet space in milliseconds.
+   */
+  GNUNET_CronTime intPktSpace GNUNET_PACKED;
+} CS_tbench_flow;
+
+/**
+ * Client requests peer to run several flows at the same time
+ * (to the same or to different peers).  Followed by "flowCount"
+ * flow descriptions.
+ */
+typedef struct
+{
+  GNUNET_MessageHeader header;
+  /**
+   * How many iterations should be performed?  In each
+   * iteration, all flows send their messages.
+   */
+  unsigned int iterations GNUNET_PACKED;
+  /**
+   * How many flows follow?
+   */
+  unsigned int flowCount GNUNET_PACKED;
+  /**
+   * Time to wait for the arrival of all replies
+   * in one iteration (in milliseconds).
+   */
+  GNUNET_CronTime timeOut GNUNET_PACKED;
+} CS_tbench_flows_request_MESSAGE;
+
+/**
+ * Results of one flow.
+ */
+typedef struct
+{
+  /**
+   * Bytes of the messages sent (plus headers).
+   */
+  unsigned long long bytesSent GNUNET_PACKED;
+  /**
+   * Bytes of the replies received in time.
+   */
+  unsigned long long bytesReceived GNUNET_PACKED;
+  unsigned int msgSent GNUNET_PACKED;
+  unsigned int msgReceived GNUNET_PACKED;
+  unsigned int duplicates GNUNET_PACKED;
+  /**
+   * For 64-bit alignment...
+   */
+  unsigned int reserved GNUNET_PACKED;
+  /**
+   * Round-trip times (in microseconds) of the replies
+   * received in time: median, 90th, 99th and 99.9th
+   * percentile and maximum.  Percentiles are the upper
+   * limit of a log-linear histogram bucket (at most 12.5%
+   * too large).
+   */
+  unsigned long long latency[TBENCH_PERCENTILES] GNUNET_PACKED;
+} CS_tbench_flow_result;
+
+/**
+ * Response from server to a multi-flow request.
+ * Followed by "flowCount" flow results (in the
+ * order of the request).
+ */
+typedef struct
+{
+  GNUNET_MessageHeader header;
+  unsigned int flowCount GNUNET_PACKED;
+  /**
+   * For 64-bit alignment...
+   */
+  unsigned int reserved GNUNET_PACKED;
+  /**
+   * Time spent on all iterations (in microseconds).
+   */
+  unsigned long long wallTime GNUNET_PACKED;
+  /**
+   * CPU time (user and system) used by gnunetd during that
+   * time (in microseconds, 0 if not available).  This is the
+   * whole process, including other concurrent work; it is not
+   * reported (0) if other tbench sessions overlapped.
+   */
+  unsigned long long cpuTime GNUNET_PACKED;
+} CS_tbench_flows_reply_MESSAGE;
+
 #endif
@@ -100,6 +100,79 @@ test (struct GNUNET_ClientServerConnection *sock,
   return ret;
 }
 
+/**
+ * Run two concurrent flows with different priorities and
+ * bimodal message sizes and check that both deliver.
+ */
+static int
+testFlows (struct GNUNET_ClientServerConnection *sock)
+{
+  char buf[sizeof (CS_tbench_flows_request_MESSAGE) +
+           2 * sizeof (CS_tbench_flow)];
+  CS_tbench_flows_request_MESSAGE *msg;
+  CS_tbench_flows_reply_MESSAGE *buffer;
+  CS_tbench_flow *flows;
+  CS_tbench_flow_result *res;
+  int ret;
+  int i;
+
+  printf (_("Using two flows with bimodal message sizes.\n"));
+  memset (buf, 0, sizeof (buf));
+  msg = (CS_tbench_flows_request_MESSAGE *) buf;
+  msg->header.size = htons (sizeof (buf));
+  msg->header.type = htons (GNUNET_CS_PROTO_TBENCH_FLOWS_REQUEST);
+  msg->iterations = htonl (2);
+  msg->flowCount = htonl (2);
+  msg->timeOut = GNUNET_htonll (5 * GNUNET_CRON_SECONDS);
+  flows = (CS_tbench_flow *) & msg[1];
+  for (i = 0; i < 2; i++)
+    {
+      flows[i].receiverId = peer2;
+      flows[i].msgCnt = htonl (50);
+      flows[i].minSize = htonl (64);
+      flows[i].maxSize = htonl (4096);
+      flows[i].distribution = htonl (TBENCH_SIZE_BIMODAL);
+      flows[i].largeShare = htonl (200);
+      flows[i].priority = htonl (1 + 9 * i);
+      flows[i].trainSize = htonl (1);
+      flows[i].intPktSpace = GNUNET_htonll (10 * GNUNET_CRON_MILLISECONDS);
+    }
+  if (GNUNET_SYSERR == GNUNET_client_connection_write (sock, &msg->header))
+    return -1;
+  buffer = NULL;
+  if (GNUNET_OK !=
+      GNUNET_client_connection_read (sock,
+                                     (GNUNET_MessageHeader **) & buffer))
+    {
+      printf (_("\nFailed to receive reply from gnunetd.\n"));
+      return -1;
+    }
+  ret = 0;
+  if ((ntohs (buffer->header.size) !=
+       sizeof (CS_tbench_flows_reply_MESSAGE) +
+       2 * sizeof (CS_tbench_flow_result)) || (ntohl (buffer->flowCount) != 2))
+    {
+      GNUNET_GE_BREAK (NULL, 0);
+      GNUNET_free (buffer);
+      return -1;
+    }
+  res = (CS_tbench_flow_result *) & buffer[1];
+  for (i = 0; i < 2; i++)
+    {
+      printf (_("Flow %d: sent %u received %u  latency p50 %llu p99 %llu max %llu us\n"),
+              i, ntohl (res[i].msgSent), ntohl (res[i].msgReceived),
+              GNUNET_ntohll (res[i].latency[0]),
+              GNUNET_ntohll (res[i].latency[2]),
+              GNUNET_ntohll (res[i].latency[4]));
+      if ((ntohl (res[i].msgSent) != 100) || (ntohl (res[i].msgReceived) == 0))
+        ret = -1;
+    }
+  printf (_("Time %llu us, CPU %llu us\n"),
+          GNUNET_ntohll (buffer->wallTime), GNUNET_ntohll (buffer->cpuTime));
+  GNUNET_free (buffer);
+  return ret;
+}
+
 /**
  * Testcase to test p2p communications.
  *
@@ -166,6 +239,9 @@ main (int argc, char **argv)
     ret =
       test (sock, 32768, 10, 10, 500 * GNUNET_CRON_MILLISECONDS, 1,
             10 * GNUNET_CRON_SECONDS);
+  /* concurrent flows with mixed sizes and priorities */
+  if ((ret == 0) && (GNUNET_shutdown_test () != GNUNET_YES))
+    ret = testFlows (sock);
   GNUNET_client_connection_destroy (sock);
 #if START_PEERS
   GNUNET_TESTING_stop_daemons (peers);
@@ -32,6 +32,67 @@
 
 #define VERBOSE GNUNET_NO
 
+/**
+ * Option that overrides gnunet-testing.conf for all
+ * daemons that are started.
+ */
+struct DaemonOption
+{
+  struct DaemonOption *next;
+
+  char *section;
+
+  char *option;
+
+  char *value;
+};
+
+static struct DaemonOption *daemon_options;
+
+/**
+ * Set a configuration option for all daemons that are
+ * started from now on (overrides gnunet-testing.conf,
+ * transport ports are still updated for each daemon).
+ *
+ * @param value new value, NULL to use gnunet-testing.conf again
+ */
+void
+GNUNET_TESTING_set_daemon_option (const char *section,
+                                  const char *option, const char *value)
+{
+  struct DaemonOption *pos;
+  struct DaemonOption *prev;
+
+  prev = NULL;
+  pos = daemon_options;
+  while ((pos != NULL) &&
+         ((0 != strcmp (pos->section, section)) ||
+          (0 != strcmp (pos->option, option))))
+    {
+      prev = pos;
+      pos = pos->next;
+    }
+  if (pos != NULL)
+    {
+      if (prev == NULL)
+        daemon_options = pos->next;
+      else
+        prev->next = pos->next;
+      GNUNET_free (pos->section);
+      GNUNET_free (pos->option);
+      GNUNET_free (pos->value);
+      GNUNET_free (pos);
+    }
+  if (value == NULL)
+    return;
+  pos = GNUNET_malloc (sizeof (struct DaemonOption));
+  pos->section = GNUNET_strdup (section);
+  pos->option = GNUNET_strdup (option);
+  pos->value = GNUNET_strdup (value);
+  pos->next = daemon_options;
+  daemon_options = pos;
+}
+
 static void
 updatePort (struct GNUNET_GC_Configuration *cfg,
             const char *section, unsigned short offset)
@@ -84,6 +145,7 @@ GNUNET_TESTING_start_daemon (unsigned short app_port,
   char host[128];
   struct GNUNET_ClientServerConnection *sock;
   GNUNET_MessageHello *hello;
+  struct DaemonOption *opt;
   int round;
 
 #if VERBOSE
@@ -111,10 +173,16 @@ GNUNET_TESTING_start_daemon (unsigned short app_port,
       return GNUNET_SYSERR;
     }
   GNUNET_free (dpath);
+  for (opt = daemon_options; opt != NULL; opt = opt->next)
+    GNUNET_GC_set_configuration_value_string (cfg,
+                                              NULL,
+                                              opt->section,
+                                              opt->option, opt->value);
   updatePort (cfg, "TCP", tra_offset);
   updatePort (cfg, "UDP", tra_offset);
   updatePort (cfg, "HTTP", tra_offset);
   updatePort (cfg, "SMTP", tra_offset);
+  updatePort (cfg, "LOOPBACK", tra_offset);
   GNUNET_GC_set_configuration_value_string (cfg,
                                             NULL,
                                             "PATHS", "GNUNETD_HOME",
@@ -461,6 +461,22 @@ transportGetMTU (unsigned short ttype)
   return tapis[ttype]->mtu;
 }
 
+/**
+ * Get the MTU for a given transport session.
+ */
+static unsigned int
+transportGetSessionMTU (GNUNET_TSession * tsession)
+{
+  unsigned short ttype;
+
+  ttype = tsession->ttype;
+  if ((ttype >= tapis_count) || (tapis[ttype] == NULL))
+    return 0;
+  if (tapis[ttype]->mtu_get_session != NULL)
+    return tapis[ttype]->mtu_get_session (tsession);
+  return tapis[ttype]->mtu;
+}
+
 /**
  * Create a hello advertisement for the given
  * transport type for this node.
@@ -850,6 +866,7 @@ provide_module_transport (GNUNET_CoreAPIForPlugins * capi)
   ret.hello_verify = &transportVerifyHello;
   ret.hello_to_address = &helloToAddress;
   ret.mtu_get = &transportGetMTU;
+  ret.mtu_get_session = &transportGetSessionMTU;
   ret.hello_create = &transportCreatehello;
   ret.hello_advertisements_get = &getAdvertisedhellos;
   ret.send_now_test = &testWouldTry;
@@ -42,7 +42,7 @@ typedef struct
   GNUNET_MessageHeader header;
 
   /**
-   * Should be zero.
+   * Options (GNUNET_FS_SEARCH_OPTION_*); zero for none.
    */
   int reserved GNUNET_PACKED;
 
@@ -95,6 +95,41 @@ typedef struct
 
 } CS_fs_reply_content_MESSAGE;
 
+/**
+ * Option for CS_fs_request_search_MESSAGE: the client understands
+ * CS_fs_reply_content_from_MESSAGE replies.  Daemons that do not
+ * know the option ignore it and keep sending plain replies.
+ */
+#define GNUNET_FS_SEARCH_OPTION_RESPONDER 1
+
+/**
+ * Server to client: content received from another peer (in response
+ * to a CS_fs_request_search_MESSAGE with the
+ * GNUNET_FS_SEARCH_OPTION_RESPONDER option).  The header is followed
+ * by the variable size data of a GNUNET_EC_DBlock.
+ */
+typedef struct
+{
+  GNUNET_MessageHeader header;
+
+  /**
+   * Anonymity level for the content, maybe
+   * 0 if not known.
+   */
+  unsigned int anonymity_level GNUNET_PACKED;
+
+  /**
+   * Expiration time of the response (relative to now).
+   */
+  GNUNET_CronTime expiration_time GNUNET_PACKED;
+
+  /**
+   * Identity of the peer that sent us the response.
+   */
+  GNUNET_PeerIdentity responder;
+
+} CS_fs_reply_content_from_MESSAGE;
+
 
 /**
  * Client to server: insert content.
@@ -129,6 +164,97 @@ typedef struct
 
 } CS_fs_request_insert_MESSAGE;
 
+/**
+ * Magic number at the beginning of a file used
+ * for shared inserts.
+ */
+#define GNUNET_FS_SHARED_MAGIC 0x474e4653
+
+/**
+ * Template (for mkstemp) of the name of a file used for
+ * shared inserts.  gnunetd refuses to open any other file.
+ * The file is only readable by the user that created it,
+ * so a gnunetd running as another user cannot open it
+ * (and the client falls back to inserting over the socket).
+ */
+#define GNUNET_FS_SHARED_TEMPLATE "/tmp/gnunet-fs-sharedXXXXXX"
+
+/**
+ * Header of a file used for shared inserts.  The client
+ * places GNUNET_DatastoreValues (8-byte aligned) into the
+ * file after the header and only sends their location
+ * to gnunetd, which reads them from the file (into its
+ * own memory, so the client can not change a block while
+ * it is being validated).  All fields are in network byte
+ * order.
+ */
+typedef struct
+{
+  /**
+   * Must be GNUNET_FS_SHARED_MAGIC.
+   */
+  unsigned int magic GNUNET_PACKED;
+
+  /**
+   * Random value chosen by the client; requests must
+   * include it (guards against stale files and against
+   * a file of the same name on another machine).
+   */
+  unsigned int cookie GNUNET_PACKED;
+
+  /**
+   * Total size of the file.
+   */
+  unsigned int size GNUNET_PACKED;
+
+  /**
+   * Reserved (should be zero).  For alignment.
+   */
+  unsigned int reserved GNUNET_PACKED;
+
+} GNUNET_FS_SharedHeader;
+
+/**
+ * Location of a block in a file used for shared inserts.
+ */
+typedef struct
+{
+  /**
+   * Offset of the GNUNET_DatastoreValue in the file.
+   */
+  unsigned int offset GNUNET_PACKED;
+
+  /**
+   * Size of the GNUNET_DatastoreValue (including the content).
+   */
+  unsigned int size GNUNET_PACKED;
+
+} GNUNET_FS_SharedBlock;
+
+/**
+ * Client to server: insert a batch of blocks that are
+ * stored in a shared file.  This struct is followed by
+ * "count" GNUNET_FS_SharedBlocks and the 0-terminated
+ * name of the file.  The reply is the result for the
+ * whole batch (GNUNET_SYSERR if any block failed,
+ * GNUNET_NO if any block did not fit into the datastore).
+ */
+typedef struct
+{
+  GNUNET_MessageHeader header;
+
+  /**
+   * Cookie of the file (must match the file header).
+   */
+  unsigned int cookie GNUNET_PACKED;
+
+  /**
+   * Number of blocks in the batch.
+   */
+  unsigned int count GNUNET_PACKED;
+
+} CS_fs_request_insert_shared_MESSAGE;
+
 /**
  * Client to server: initialize to index content
  * (for on-demand encoding).  This struct is followed
@@ -715,6 +715,32 @@ struct GNUNET_ECRS_DownloadContext
                                             GNUNET_ECRS_DownloadProgressCallback
                                             dpcb, void *dpcbClosure);
 
+/**
+ * Add another peer that is known to share the file that is being
+ * downloaded.  Requests are distributed over all known sources in
+ * proportion to the rate at which they reply.  Peers that answer
+ * requests of the download are added as sources automatically.
+ *
+ * @param uri location URI for the file being downloaded
+ * @return GNUNET_OK on success, GNUNET_NO if too many sources are
+ *         known already, GNUNET_SYSERR if the URI is not a location
+ *         URI for this file
+ */
+int
+GNUNET_ECRS_file_download_add_location (struct GNUNET_ECRS_DownloadContext
+                                        *rm,
+                                        const struct GNUNET_ECRS_URI *uri);
+
+/**
+ * Move requests that have been waiting for a slow source for too
+ * long to other sources.  Should be called periodically by clients
+ * that drive downloads started with
+ * GNUNET_ECRS_file_download_partial_start.
+ */
+void
+GNUNET_ECRS_file_download_rebalance (struct GNUNET_ECRS_DownloadContext
+                                     *rm);
+
 /**
  * Stop a download (aborts if download is incomplete).
  */
@@ -722,6 +748,51 @@ int
 GNUNET_ECRS_file_download_partial_stop (struct GNUNET_ECRS_DownloadContext
                                         *rm);
 
+/**
+ * Start a streaming download ASYNCHRONOUSLY.  The file is not
+ * stored on disk; instead, the client reads it as a contiguous
+ * byte stream using GNUNET_ECRS_file_download_stream_read.
+ * Blocks are requested in file order, at most "readahead" bytes
+ * ahead of the current read position.  Use
+ * GNUNET_ECRS_file_download_partial_stop to stop the download.
+ *
+ * @param sc context to use for searching, you can pass NULL (then
+ *        ECRS will manage its own context)
+ * @param uri the URI of the file (determines what to download)
+ * @param readahead size of the read-ahead buffer in bytes
+ *        (rounded up to the 32k ECRS block size)
+ * @param dpcb function to call with progress information, maybe NULL
+ * @return NULL on error
+ */
+struct GNUNET_ECRS_DownloadContext
+  *GNUNET_ECRS_file_download_stream_start (struct GNUNET_GE_Context *ectx,
+                                           struct GNUNET_GC_Configuration
+                                           *cfg,
+                                           struct GNUNET_FS_SearchContext
+                                           *sc,
+                                           const struct GNUNET_ECRS_URI *uri,
+                                           unsigned int anonymityLevel,
+                                           unsigned long long readahead,
+                                           GNUNET_ECRS_DownloadProgressCallback
+                                           dpcb, void *dpcbClosure);
+
+/**
+ * Read the next bytes of a streaming download.  Blocks
+ * until at least one byte at the current read position
+ * is available.
+ *
+ * @param buf where to store the data
+ * @param size maximum number of bytes to read
+ * @param tt function to test if the read should be aborted, maybe NULL
+ * @return number of bytes read, 0 at the end of the file,
+ *         GNUNET_SYSERR on error or if the read was aborted
+ */
+int
+GNUNET_ECRS_file_download_stream_read (struct GNUNET_ECRS_DownloadContext
+                                       *rm, void *buf, unsigned int size,
+                                       GNUNET_ECRS_TestTerminate tt,
+                                       void *ttClosure);
+
 /**
  * DOWNLOAD a file.
  *
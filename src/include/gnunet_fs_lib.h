@@ -107,6 +107,19 @@ GNUNET_FS_stop_search (struct
                        *ctx,
                        GNUNET_DatastoreValueIterator callback, void *closure);
 
+/**
+ * Obtain the identity of the peer that produced the result
+ * that is currently being passed to a callback of this
+ * search context.  Only meaningful when called from within
+ * such a callback.
+ *
+ * @param peer set to the responder; all-zeros if the result
+ *        came from the local datastore or the DHT
+ */
+void
+GNUNET_FS_get_current_responder (struct GNUNET_FS_SearchContext *ctx,
+                                 GNUNET_PeerIdentity * peer);
+
 /**
  * Insert a block.  Note that while the API is VERY similar to
  * GNUNET_FS_index in terms of signature, the block for GNUNET_FS_index must be in
@@ -119,6 +132,59 @@ GNUNET_FS_stop_search (struct
 int GNUNET_FS_insert (struct GNUNET_ClientServerConnection *sock,
                       const GNUNET_DatastoreValue * block);
 
+/**
+ * Handle for a file shared with a gnunetd running on
+ * the same machine that allows inserting blocks
+ * without sending their contents over the socket.
+ */
+struct GNUNET_FS_SharedRing;
+
+/**
+ * Create a shared file for inserts.
+ *
+ * @return NULL on error (use GNUNET_FS_insert in that case)
+ */
+struct GNUNET_FS_SharedRing *GNUNET_FS_shared_ring_create (struct
+                                                           GNUNET_GE_Context
+                                                           *ectx);
+
+/**
+ * Destroy a shared file for inserts (blocks that were
+ * not flushed are discarded).
+ */
+void GNUNET_FS_shared_ring_destroy (struct GNUNET_FS_SharedRing *ring);
+
+/**
+ * Insert a block via the shared file.  The block is only
+ * copied into the file; gnunetd inserts the blocks in
+ * batches (when the batch or the file is full, and on
+ * GNUNET_FS_shared_ring_flush).  Hence an error may be
+ * reported for blocks of earlier calls.  If gnunetd cannot
+ * use the shared file (not on the same machine, running
+ * as another user, or too old) the blocks are sent over
+ * the socket and the ring is not used again.
+ *
+ * @param ring the shared file, NULL to always use the socket
+ * @param block the block (properly encoded and all)
+ * @return GNUNET_OK on success, GNUNET_SYSERR on error,
+ *         GNUNET_NO on transient error
+ */
+int GNUNET_FS_insert_shared (struct GNUNET_ClientServerConnection *sock,
+                             struct GNUNET_FS_SharedRing *ring,
+                             const GNUNET_DatastoreValue * block);
+
+/**
+ * Have gnunetd insert all blocks that were placed into the
+ * shared file so far.  Must be called before the blocks are
+ * expected to be in the datastore.
+ *
+ * @param ring the shared file, NULL for none
+ * @return GNUNET_OK on success, GNUNET_SYSERR on error,
+ *         GNUNET_NO on transient error
+ */
+int GNUNET_FS_shared_ring_flush (struct GNUNET_ClientServerConnection *sock,
+                                 struct GNUNET_FS_SharedRing *ring);
+
 
 /**
  * Initialize to index a file.  Tries to do the symlinking.
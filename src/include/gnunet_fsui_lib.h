@@ -908,6 +908,14 @@ typedef void *(*GNUNET_FSUI_EventProcessor) (void *cls,
  * meaning, however, the name of the UI would still be a good choice).
  * <p>
  *
+ * With doResume, FSUI writes a checkpoint of its state periodically
+ * and records search results as they arrive, so a crash loses at most
+ * the activities started since the last checkpoint.  Search results
+ * of resumed searches are not included in the search_resumed event;
+ * they are loaded in the background after GNUNET_FSUI_start returns
+ * and passed to the UI as search_result events.
+ * <p>
+ *
  * Note that suspend/resume is not implemented in this version of
  * GNUnet.
  *
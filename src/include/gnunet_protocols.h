@@ -63,6 +63,12 @@ extern "C"
  */
 #define GNUNET_TRANSPORT_PROTOCOL_NUMBER_NAT 1
 
+/**
+ * protocol number for 'LOOPBACK' (peers on the same machine
+ * with an emulated link, for testing and benchmarking).
+ */
+#define GNUNET_TRANSPORT_PROTOCOL_NUMBER_LOOPBACK 2
+
 /**
  * protocol number of TCP.
  */
@@ -165,6 +171,17 @@ extern "C"
  */
 #define GNUNET_CS_PROTO_GAP_INIT_INDEX 15
 
+/**
+ * client to gnunetd: insert content from a shared file
+ */
+#define GNUNET_CS_PROTO_GAP_INSERT_SHARED 16
+
+/**
+ * gnunetd to client: here is your answer, and
+ * this is the peer that sent it to us
+ */
+#define GNUNET_CS_PROTO_GAP_RESULT_FROM 54
+
 
 /* *********** messages for identity module ************* */
 
@@ -250,12 +267,32 @@ extern "C"
  */
 #define GNUNET_CS_PROTO_STATS_GET_P2P_MESSAGE_SUPPORTED 39
 
+/**
+ * client to stats module: request histograms
+ */
+#define GNUNET_CS_PROTO_STATS_GET_HISTOGRAMS 50
+
+/**
+ * stats module to client: a histogram
+ */
+#define GNUNET_CS_PROTO_STATS_HISTOGRAM 51
+
 
 /* ********** CS TBENCH application messages ********** */
 
 #define GNUNET_CS_PROTO_TBENCH_REQUEST	40
 #define GNUNET_CS_PROTO_TBENCH_REPLY	41
 
+/**
+ * client to tbench: run several flows at the same time
+ */
+#define GNUNET_CS_PROTO_TBENCH_FLOWS_REQUEST 52
+
+/**
+ * tbench to client: results of the flows
+ */
+#define GNUNET_CS_PROTO_TBENCH_FLOWS_REPLY 53
+
 
 /* ********** CS TRACEKIT application messages ********* */
 
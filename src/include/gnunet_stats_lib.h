@@ -70,6 +70,81 @@ int GNUNET_STATS_get_statistics (struct GNUNET_GE_Context *ectx,
                                  GNUNET_STATS_StatisticsProcessor processor,
                                  void *cls);
 
+/**
+ * @param name the name of the histogram
+ * @param buckets the bucket counters (see
+ *        GNUNET_STATS_histogram_percentile)
+ * @param count the number of buckets
+ * @return GNUNET_OK to continue, GNUNET_SYSERR to abort iteration
+ */
+typedef int (*GNUNET_STATS_HistogramProcessor) (const char *name,
+                                                const unsigned long long
+                                                *buckets, unsigned int count,
+                                                void *cls);
+
+/**
+ * Request the histograms from TCP socket.
+ * @param sock the socket to use
+ * @param processor function to call on each histogram
+ * @return GNUNET_OK on success, GNUNET_SYSERR on error
+ */
+int GNUNET_STATS_get_histograms (struct GNUNET_GE_Context *ectx,
+                                 struct GNUNET_ClientServerConnection *sock,
+                                 GNUNET_STATS_HistogramProcessor processor,
+                                 void *cls);
+
+/**
+ * Number of linear sub-buckets per power of two in a
+ * histogram (as a power of two).
+ */
+#define GNUNET_STATS_HISTOGRAM_SUB_BITS 3
+
+/**
+ * Values of 2^GNUNET_STATS_HISTOGRAM_MAX_BITS and more are
+ * counted in the last bucket of a histogram.
+ */
+#define GNUNET_STATS_HISTOGRAM_MAX_BITS 40
+
+/**
+ * Number of buckets of a histogram.  Values below
+ * 2^GNUNET_STATS_HISTOGRAM_SUB_BITS have a bucket each; above,
+ * each power of two is split into 2^GNUNET_STATS_HISTOGRAM_SUB_BITS
+ * buckets.
+ */
+#define GNUNET_STATS_HISTOGRAM_BUCKETS \
+  ((GNUNET_STATS_HISTOGRAM_MAX_BITS - GNUNET_STATS_HISTOGRAM_SUB_BITS + 1) \
+   << GNUNET_STATS_HISTOGRAM_SUB_BITS)
+
+/**
+ * Find the bucket of a histogram that counts the given value.
+ * Allows other modules to keep histograms in the same format
+ * as the stats service.
+ *
+ * @return bucket index (below GNUNET_STATS_HISTOGRAM_BUCKETS)
+ */
+unsigned int GNUNET_STATS_histogram_bucket (unsigned long long value);
+
+/**
+ * Compute a percentile of a histogram.
+ *
+ * @param buckets the bucket counters
+ * @param count number of buckets
+ * @param percent which percentile (0 to 100)
+ * @return upper limit of the bucket holding the percentile
+ *         (0 if the histogram is empty)
+ */
+unsigned long long GNUNET_STATS_histogram_percentile (const unsigned long
+                                                      long *buckets,
+                                                      unsigned int count,
+                                                      double percent);
+
+/**
+ * Get the number of samples in a histogram.
+ */
+unsigned long long GNUNET_STATS_histogram_total (const unsigned long long
+                                                 *buckets,
+                                                 unsigned int count);
+
 /**
  * @param type the type ID of the message
  * @param isP2P GNUNET_YES for P2P, GNUNET_NO for CS types
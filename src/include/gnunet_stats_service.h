@@ -75,6 +75,25 @@ typedef struct
    */
   void (*change) (const int handle, const int delta);
 
+  /**
+   * Get a handle to a histogram (for example of latencies
+   * in microseconds, see GNUNET_get_time_us).  Histograms
+   * use log-linear buckets (with a relative error of at
+   * most 12.5%); gnunet-stats prints their percentiles.
+   *
+   * @param name a description of the histogram
+   * @return a handle for adding samples to the histogram
+   */
+  int (*create_histogram) (const char *name);
+
+  /**
+   * Add a sample to a histogram.
+   *
+   * @param handle the handle of the histogram
+   * @param value the sample
+   */
+  void (*record) (const int handle, const unsigned long long value);
+
 } GNUNET_Stats_ServiceAPI;
 
 #if 0                           /* keep Emacsens' auto-indent happy */
@@ -42,6 +42,17 @@ extern "C"
 #endif
 #endif
 
+/**
+ * Set a configuration option for all daemons that are
+ * started from now on (overrides gnunet-testing.conf,
+ * transport ports are still updated for each daemon).
+ *
+ * @param value new value, NULL to use gnunet-testing.conf again
+ */
+void GNUNET_TESTING_set_daemon_option (const char *section,
+                                       const char *option,
+                                       const char *value);
+
 /**
  * Starts a gnunet daemon.
  *
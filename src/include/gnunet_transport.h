@@ -69,8 +69,9 @@ typedef struct
   GNUNET_PeerIdentity sender;
 
   /**
-   * The message itself. The GNUnet core will call 'GNUNET_free' once
-   * processing of msg is complete.
+   * The message itself. The GNUnet core will call 'msg_free' (or
+   * 'GNUNET_free' if msg_free is NULL) once processing of msg is
+   * complete.
    */
   char *msg;
 
@@ -79,6 +80,13 @@ typedef struct
    */
   unsigned int size;
 
+  /**
+   * Function that gives msg back to the transport (i.e. to a
+   * buffer pool), or NULL.  The core calls it for all packets
+   * before the transport is unloaded.
+   */
+  void (*msg_free) (char *msg);
+
 } GNUNET_TransportPacket;
 
 /**
@@ -339,6 +347,16 @@ typedef struct
   int (*send_now_test) (GNUNET_TSession * tsession, unsigned int size,
                         int important);
 
+  /**
+   * Get the MTU for a particular session.  Transports that
+   * discover the path MTU to each peer can use this to allow
+   * the core to build frames that are larger (or smaller) than
+   * "mtu".  Optional, if NULL, "mtu" applies to all sessions.
+   *
+   * @return the MTU for the session (0 for streams)
+   */
+  unsigned int (*mtu_get_session) (GNUNET_TSession * tsession);
+
   /**
    * Start the server process to receive inbound traffic.
    * @return GNUNET_OK on success, GNUNET_SYSERR if the operation failed
@@ -89,6 +89,13 @@ typedef struct
    */
   int (*mtu_get) (unsigned short ttype);
 
+  /**
+   * Get the MTU for a given transport session (may differ
+   * from the MTU of the transport type if the transport
+   * probes the path MTU to each peer).
+   */
+  unsigned int (*mtu_get_session) (GNUNET_TSession * tsession);
+
 
   /**
    * Connect to a remote host using the advertised transport
@@ -72,6 +72,16 @@ void GNUNET_URITRACK_track (struct GNUNET_GE_Context *ectx, struct GNUNET_GC_Con
  */
 int GNUNET_URITRACK_list (struct GNUNET_GE_Context *ectx, struct GNUNET_GC_Configuration *cfg, int need_metadata, GNUNET_ECRS_SearchResultProcessor iterator, void *closure);   /* file_info.c */
 
+/**
+ * List the URIs that were added since the given position.
+ *
+ * @param position position to start at (0 to list all URIs);
+ *        set to the position after the last URI listed
+ * @param need_metadata GNUNET_YES if metadata should be
+ *        provided, GNUNET_NO if metadata is not needed (faster)
+ */
+int GNUNET_URITRACK_list_since (struct GNUNET_GE_Context *ectx, struct GNUNET_GC_Configuration *cfg, int need_metadata, unsigned long long *position, GNUNET_ECRS_SearchResultProcessor iterator, void *closure);     /* file_info.c */
+
 /**
  * Register a handler that is called whenever
  * a URI is tracked.  If URIs are already in
@@ -87,8 +97,8 @@ int GNUNET_URITRACK_unregister_track_callback (GNUNET_ECRS_SearchResultProcessor
 
 /**
  * Possible ways in which a given URI has been used or encountered.
- * Note that we only have 8-bits when storing this on the disk,
- * so do not add additional entries (without changing uri_info).
+ * Note that we only had 8-bits when storing this on the disk in
+ * the past, so do not add additional entries lightly.
  */
 enum GNUNET_URITRACK_STATE
 {
@@ -107,10 +117,8 @@ enum GNUNET_URITRACK_STATE
  * Find out what we know about a given URI's past.  Note that we only
  * track the states for a (finite) number of URIs and that the
  * information that we give back maybe inaccurate (returning
- * GNUNET_URITRACK_FRESH if the URI did not fit into our bounded-size map,
- * even if the URI is not fresh anymore; also, if the URI has a
- * GNUNET_hash-collision in the map, there is a 1:256 chance that we will
- * return information from the wrong URI without detecting it).
+ * GNUNET_URITRACK_FRESH if the URI did not fit into our bounded-size
+ * index, even if the URI is not fresh anymore).
  */
 enum GNUNET_URITRACK_STATE
 GNUNET_URITRACK_get_state (struct GNUNET_GE_Context *ectx,
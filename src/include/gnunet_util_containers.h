@@ -72,6 +72,28 @@ struct GNUNET_BloomFilter *GNUNET_bloomfilter_load (struct GNUNET_GE_Context
                                                     unsigned int size,
                                                     unsigned int k);
 
+/**
+ * Load a blocked bloom-filter from a file.  Blocked filters place
+ * all bits of an element into one 64 byte block, which makes them
+ * faster but uses a different layout than regular filters; they
+ * must not be exchanged with peers that expect a regular filter.
+ *
+ * @param filename the name of the file (or the prefix)
+ * @param size the size of the bloom-filter (number of
+ *        bytes of storage space to use)
+ * @param k the number of GNUNET_hash-functions to apply per
+ *        element (number of bits set per element in the set)
+ * @return the bloomfilter
+ */
+struct GNUNET_BloomFilter *GNUNET_bloomfilter_load_blocked (struct
+                                                            GNUNET_GE_Context
+                                                            *ectx,
+                                                            const char
+                                                            *filename,
+                                                            unsigned int
+                                                            size,
+                                                            unsigned int k);
+
 /**
  * Create a bloom filter from raw bits.
  *
@@ -91,6 +113,28 @@ struct GNUNET_BloomFilter *GNUNET_bloomfilter_init (struct GNUNET_GE_Context
                                                     unsigned int size,
                                                     unsigned int k);
 
+/**
+ * Create a blocked bloom filter from raw bits.
+ *
+ * @param data the raw bits in memory (maybe NULL,
+ *        in which case all bits should be considered
+ *        to be zero).
+ * @param size the size of the bloom-filter (number of
+ *        bytes of storage space to use); also size of data
+ *        -- unless data is NULL.  Must be a power of 2
+ *        and at least 64.
+ * @param k the number of GNUNET_hash-functions to apply per
+ *        element (number of bits set per element in the set)
+ * @return the bloomfilter
+ */
+struct GNUNET_BloomFilter *GNUNET_bloomfilter_init_blocked (struct
+                                                            GNUNET_GE_Context
+                                                            *ectx,
+                                                            const char *data,
+                                                            unsigned int
+                                                            size,
+                                                            unsigned int k);
+
 /**
  * Copy the raw data of this bloomfilter into
  * the given data array.
@@ -111,6 +155,19 @@ int GNUNET_bloomfilter_get_raw_data (struct GNUNET_BloomFilter *bf,
 int GNUNET_bloomfilter_test (struct GNUNET_BloomFilter *bf,
                              const GNUNET_HashCode * e);
 
+/**
+ * Test if several elements are in the filter.
+ * @param bf the filter
+ * @param count number of elements to test
+ * @param e the elements
+ * @param results set to GNUNET_YES or GNUNET_NO for each element
+ * @return number of elements that are in the filter
+ */
+unsigned int GNUNET_bloomfilter_test_many (struct GNUNET_BloomFilter *bf,
+                                           unsigned int count,
+                                           const GNUNET_HashCode * e,
+                                           int *results);
+
 /**
  * Add an element to the filter
  * @param bf the filter
@@ -159,7 +216,8 @@ int GNUNET_bloomfilter_or (struct GNUNET_BloomFilter *bf,
  * @param bf the filter
  * @param iterator an iterator over all elements stored in the BF
  * @param iterator_arg argument to the iterator function
- * @param size the new size for the filter
+ * @param size the new size for the filter (rounded up to a power
+ *        of 2, and to the block size for blocked filters)
  * @param k the new number of GNUNET_hash-function to apply per element
  */
 void GNUNET_bloomfilter_resize (struct GNUNET_BloomFilter *bf,
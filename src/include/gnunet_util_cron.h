@@ -63,7 +63,8 @@ void GNUNET_cron_stop (struct GNUNET_CronManager *mgr);
  * checkself is GNUNET_NO.  If checkself is GNUNET_YES and this method is called
  * within a cron-job, nothing happens.
  *
- * @param checkself, if GNUNET_YES and this thread is the cron thread, do nothing
+ * @param checkself, if GNUNET_YES and this thread is the cron thread
+ *        (or one of its workers), do nothing
  */
 void GNUNET_cron_suspend_jobs (struct GNUNET_CronManager *mgr, int checkself);
 
@@ -72,7 +73,8 @@ void GNUNET_cron_suspend_jobs (struct GNUNET_CronManager *mgr, int checkself);
  * previous call to cron_suspend_jobs with identical
  * arguments.
  *
- * @param checkself, if GNUNET_YES and this thread is the cron thread, do nothing
+ * @param checkself, if GNUNET_YES and this thread is the cron thread
+ *        (or one of its workers), do nothing
  */
 void GNUNET_cron_resume_jobs (struct GNUNET_CronManager *mgr, int checkself);
 
@@ -94,10 +96,54 @@ void GNUNET_cron_add_job (struct GNUNET_CronManager *mgr,
                           unsigned int delta, unsigned int deltaRepeat,
                           void *data);
 
+/**
+ * Add a cron-job that may run on one of the worker threads of the
+ * cron manager (see GNUNET_cron_set_workers) instead of the cron
+ * thread.  The job may thus run at the same time as other jobs and
+ * must do its own locking.  If a periodic job is still running when
+ * it is due again, that run is skipped.  Without workers, the job
+ * runs on the cron thread like any other job.
+ *
+ * @param method which method should we run
+ * @param delta how many milliseconds until we run the method
+ * @param deltaRepeat if this is a periodic, the time between
+ *        the runs, otherwise 0.
+ * @param data argument to pass to the method
+ */
+void GNUNET_cron_add_parallel_job (struct GNUNET_CronManager *mgr,
+                                   GNUNET_CronJob method,
+                                   unsigned int delta,
+                                   unsigned int deltaRepeat, void *data);
+
+/**
+ * Set the number of worker threads for parallel jobs
+ * (default: 0).  May only be called while cron is stopped.
+ */
+void GNUNET_cron_set_workers (struct GNUNET_CronManager *mgr,
+                              unsigned int count);
+
+/**
+ * Number of buckets of the lateness histogram.
+ */
+#define GNUNET_CRON_LATENESS_BUCKETS 16
+
+/**
+ * Get a histogram of how late (compared to their deadline) the jobs
+ * were started.  Bucket 0 counts the jobs that started in time,
+ * bucket i counts the jobs that started between 2^(i-1) and 2^i - 1
+ * ms late; the last bucket also counts all jobs that were even later.
+ *
+ * @param histogram set to the counters, must have room for
+ *        GNUNET_CRON_LATENESS_BUCKETS values
+ */
+void GNUNET_cron_get_lateness (struct GNUNET_CronManager *mgr,
+                               unsigned long long *histogram);
+
 /**
  * If the specified cron-job exists in th delta-list, move it to the
  * head of the list.  If it is running, do nothing.  If it is does not
- * exist and is not running, add it to the list to run it next.
+ * exist and is not running, add it to the list to run it next (unless
+ * the list is empty, in which case nothing is done).
  *
  * @param method which method should we run
  * @param deltaRepeat if this is a periodic, the time between
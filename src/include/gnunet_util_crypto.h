@@ -269,6 +269,37 @@ unsigned int GNUNET_hash_distance_u32 (const GNUNET_HashCode * a,
 void GNUNET_hash (const void *block, unsigned int size,
                   GNUNET_HashCode * ret);
 
+/**
+ * Hash several independent blocks (in parallel if the
+ * CPU supports it).
+ * @param count number of blocks
+ * @param blocks the blocks to hash
+ * @param sizes sizes of the blocks
+ * @param ret array of count hash codes for the results
+ */
+void GNUNET_hash_many (unsigned int count,
+                       const void *const *blocks,
+                       const unsigned int *sizes, GNUNET_HashCode * ret);
+
+/**
+ * Select the SHA-512 implementation (the fastest
+ * one supported by the CPU is used by default).
+ * @param name name of the implementation, NULL for the default
+ * @return GNUNET_OK on success, GNUNET_SYSERR if the
+ *         implementation is unknown or not supported by the CPU
+ */
+int GNUNET_hash_set_implementation (const char *name);
+
+/**
+ * Get the name of the SHA-512 implementation in use.
+ */
+const char *GNUNET_hash_get_implementation (void);
+
+/**
+ * Get the name of the i-th SHA-512 implementation.
+ * @return NULL if there is no such implementation
+ */
+const char *GNUNET_hash_get_implementation_name (unsigned int i);
 
 /**
  * Compute the GNUNET_hash of an entire file.
@@ -337,6 +368,45 @@ struct GNUNET_RSA_PrivateKey *GNUNET_RSA_create_key_from_hash (const
                                                                GNUNET_HashCode
                                                                * input);
 
+/**
+ * Deterministically create the keys for several hash codes,
+ * generating keys that are not yet cached in parallel.
+ *
+ * @param count number of keys to create
+ * @param input hash codes to derive the keys from
+ * @param keys array of count entries set to the resulting
+ *        keys (caller must free them)
+ */
+void GNUNET_RSA_create_keys_from_hashes (unsigned int count,
+                                         const GNUNET_HashCode * input,
+                                         struct GNUNET_RSA_PrivateKey
+                                         **keys);
+
+/**
+ * Use the given file as a persistent cache for keys created
+ * with GNUNET_RSA_create_key_from_hash.  The file holds at
+ * most the given number of keys (1 KB each).
+ *
+ * @param filename name of the cache file
+ * @param slots number of keys the file can hold, 0 to
+ *        disable the persistent cache
+ * @return GNUNET_OK on success, GNUNET_SYSERR on error
+ */
+int GNUNET_RSA_kblock_key_cache_open (struct GNUNET_GE_Context *ectx,
+                                      const char *filename,
+                                      unsigned int slots);
+
+/**
+ * Stop using the persistent cache for KBlock keys.
+ */
+void GNUNET_RSA_kblock_key_cache_close (void);
+
+/**
+ * Drop all keys from the in-memory cache of KBlock keys
+ * (the persistent cache is not affected).
+ */
+void GNUNET_RSA_kblock_key_cache_flush (void);
+
 /**
  * Free memory occupied by hostkey
  * @param hostkey pointer to the memory to free
@@ -54,6 +54,22 @@ struct GNUNET_ClientServerConnection *GNUNET_client_connection_create (struct
                                                                        GNUNET_GC_Configuration
                                                                        *cfg);
 
+/**
+ * Get the name of the UNIX domain socket on which gnunetd
+ * listens for local clients (option UNIX-PATH in section
+ * NETWORK, by default gnunetd-PORT.sock in /var/run/gnunetd).
+ * Clients connecting to gnunetd on the local host try this
+ * socket before using TCP if it is owned by root, by the
+ * client's user or by the user that gnunetd runs as.
+ *
+ * @param port the TCP port of gnunetd (in host byte order)
+ * @return NULL if UNIX domain sockets are not supported or
+ *         disabled (option UNIX-SOCKET in section NETWORK),
+ *         otherwise the filename (caller must free)
+ */
+char *GNUNET_client_connection_get_unix_path (struct GNUNET_GC_Configuration
+                                              *cfg, unsigned short port);
+
 /**
  * Close a GNUnet TCP socket for now (use to temporarily close
  * a TCP connection that will probably not be used for a long
@@ -96,6 +112,16 @@ int GNUNET_client_connection_test_connected (struct
                                              GNUNET_ClientServerConnection
                                              *sock);
 
+/**
+ * Is gnunetd configured to run on the local host (option HOST
+ * in section NETWORK)?
+ *
+ * @return GNUNET_YES if so, GNUNET_NO if gnunetd may be remote
+ */
+int GNUNET_client_connection_test_local (struct
+                                         GNUNET_ClientServerConnection
+                                         *sock);
+
 /**
  * Check a socket, open and connect if it is closed and it is a
  * client-socket.
@@ -116,7 +142,9 @@ int GNUNET_client_connection_ensure_connected (struct
  *         was closed by the other side (if the socket is a
  *         client socket and is used again, the next
  *         read/write call will automatically attempt
- *         to re-establish the connection).
+ *         to re-establish the connection).  Replies to
+ *         pipelined requests that arrive before the next
+ *         message are passed to their handlers first.
  */
 int GNUNET_client_connection_read (struct GNUNET_ClientServerConnection *sock,
                                    GNUNET_MessageHeader ** buffer);
@@ -133,6 +161,58 @@ int GNUNET_client_connection_write (struct GNUNET_ClientServerConnection
                                     *sock,
                                     const GNUNET_MessageHeader * buffer);
 
+/**
+ * Handler for replies to a pipelined request.  Handlers are
+ * called from the reader thread of the connection (or from a
+ * thread in GNUNET_client_connection_read) and must not call
+ * any function on the same connection.
+ *
+ * @param cls closure
+ * @param reply the reply, NULL if the connection failed before
+ *        (all) replies were received
+ * @return GNUNET_OK if this was the last reply to the request,
+ *         GNUNET_NO if more replies are expected
+ */
+typedef int (*GNUNET_ClientReplyHandler) (void *cls,
+                                          const GNUNET_MessageHeader *
+                                          reply);
+
+/**
+ * Queue a request for transmission without waiting for
+ * its reply.  Queued requests are sent together by the
+ * next call to GNUNET_client_connection_flush or
+ * GNUNET_client_connection_write (or earlier, if the
+ * write buffer is full).  Replies are matched to requests
+ * in the order in which the requests were queued, so
+ * a connection must not be used for pipelined requests while
+ * another thread waits for the reply to a synchronous request.
+ *
+ * @param sock the connection
+ * @param request the request to send (is copied)
+ * @param handler function to call with the replies,
+ *        NULL if gnunetd does not reply to the request
+ * @param cls closure for handler
+ * @return GNUNET_OK on success, GNUNET_SYSERR if the connection
+ *         failed (handlers of requests queued earlier
+ *         will be called with NULL)
+ */
+int GNUNET_client_connection_queue (struct GNUNET_ClientServerConnection
+                                    *sock,
+                                    const GNUNET_MessageHeader * request,
+                                    GNUNET_ClientReplyHandler handler,
+                                    void *cls);
+
+/**
+ * Send all queued requests (with a single system call if
+ * possible).  The replies are then delivered to the handlers
+ * by the reader thread of the connection.
+ *
+ * @return GNUNET_OK on success, GNUNET_SYSERR if the connection
+ *         failed
+ */
+int GNUNET_client_connection_flush (struct GNUNET_ClientServerConnection
+                                    *sock);
+
 /**
  * Obtain a simple return value from the connection.
  * Note that the protocol will automatically communicate
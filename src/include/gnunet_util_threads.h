@@ -152,6 +152,14 @@ void GNUNET_thread_sleep (GNUNET_CronTime time);
  */
 GNUNET_CronTime GNUNET_get_time (void);
 
+/**
+ * Get a timestamp in microseconds for measuring how long
+ * something takes (not related to the time of day).
+ *
+ * @return the current timestamp
+ */
+unsigned long long GNUNET_get_time_us (void);
+
 /**
  * Stop the sleep of another thread.
  */
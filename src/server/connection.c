@@ -731,6 +731,10 @@ static int stat_received;
 
 static int stat_decrypted;
 
+static int stat_encrypt_time;
+
+static int stat_decrypt_time;
+
 static int stat_noise_sent;
 
 static int stat_total_allowed_sent;
@@ -1675,17 +1679,27 @@ fragmentIfNecessary (BufferEntry * be)
 
 /**
  * Try to make sure that the transport service for the given buffer is
- * connected.  If the transport service changes, this function also
- * ensures that the pending messages are properly fragmented (if
- * needed).
+ * connected.  If the transport service (or the MTU of the session,
+ * i.e. after path MTU discovery) changes, this function also ensures
+ * that the pending messages are properly fragmented (if needed).
  *
  * @return GNUNET_OK on success, GNUNET_NO on error
  */
 static int
 ensureTransportConnected (BufferEntry * be)
 {
+  unsigned int mtu;
+
   if (be->session.tsession != NULL)
-    return GNUNET_OK;
+    {
+      mtu = transport->mtu_get_session (be->session.tsession);
+      if (mtu != be->session.mtu)
+        {
+          be->session.mtu = mtu;
+          fragmentIfNecessary (be);
+        }
+      return GNUNET_OK;
+    }
   be->session.tsession =
     transport->connect_freely (&be->session.sender, GNUNET_NO, __FILE__);
   if (be->session.tsession == NULL)
@@ -1696,7 +1710,7 @@ ensureTransportConnected (BufferEntry * be)
       be->time_established = 0;
       return GNUNET_NO;
     }
-  be->session.mtu = transport->mtu_get (be->session.tsession->ttype);
+  be->session.mtu = transport->mtu_get_session (be->session.tsession);
   fragmentIfNecessary (be);
   return GNUNET_OK;
 }
@@ -1724,10 +1738,12 @@ sendBuffer (BufferEntry * be)
   char *plaintextMsg;
   void *encryptedMsg;
   unsigned int totalMessageSize;
+  unsigned int paddedSize;
   int ret;
   SendEntry **entries;
   unsigned int stotal;
   GNUNET_TSession *tsession;
+  unsigned long long start;
 
   ENTRY ();
   /* fast ways out */
@@ -1888,17 +1904,28 @@ sendBuffer (BufferEntry * be)
       be->inSendBuffer = GNUNET_NO;
       return GNUNET_NO;
     }
+  /* Fill the rest of the frame (callbacks, noise) only up to
+     the MTU of the transport type: the MTU of the session may be
+     much larger (path MTU discovery), and padding every frame
+     to it would make small messages expensive. */
+  paddedSize = totalMessageSize;
+  if (be->session.mtu != 0)
+    {
+      i = transport->mtu_get (be->session.tsession->ttype);
+      if ((i != 0) && (i < paddedSize))
+        paddedSize = (p > i) ? p : i;
+    }
   /* still room left? try callbacks! */
   pos = scl_head;
-  while ((pos != NULL) && (p < totalMessageSize))
+  while ((pos != NULL) && (p < paddedSize))
     {
       if ((pos->minimumPadding + p >= p) &&
-          (pos->minimumPadding + p <= totalMessageSize))
+          (pos->minimumPadding + p <= paddedSize))
         {
           rsi = pos->callback (&be->session.sender,
-                               &plaintextMsg[p], totalMessageSize - p);
-          GNUNET_GE_BREAK (ectx, rsi + p <= totalMessageSize);
-          if ((rsi + p < p) || (rsi + p > totalMessageSize))
+                               &plaintextMsg[p], paddedSize - p);
+          GNUNET_GE_BREAK (ectx, rsi + p <= paddedSize);
+          if ((rsi + p < p) || (rsi + p > paddedSize))
             {
               GNUNET_GE_BREAK (ectx, 0);
               GNUNET_free (plaintextMsg);
@@ -1918,20 +1945,20 @@ sendBuffer (BufferEntry * be)
       return GNUNET_NO;
     }
   /* finally padd with noise */
-  if ((p + sizeof (GNUNET_MessageHeader) <= totalMessageSize) &&
-      (p < totalMessageSize) &&
+  if ((p + sizeof (GNUNET_MessageHeader) <= paddedSize) &&
+      (p < paddedSize) &&
       (p + sizeof (GNUNET_MessageHeader) > p)
       && (disable_random_padding == GNUNET_NO))
     {
       GNUNET_MessageHeader part;
-      unsigned short noiseLen = totalMessageSize - p;
+      unsigned short noiseLen = paddedSize - p;
 
       part.size = htons (noiseLen);
       part.type = htons (GNUNET_P2P_PROTO_NOISE);
       memcpy (&plaintextMsg[p], &part, sizeof (GNUNET_MessageHeader));
-      for (i = p + sizeof (GNUNET_MessageHeader); i < totalMessageSize; i++)
+      for (i = p + sizeof (GNUNET_MessageHeader); i < paddedSize; i++)
         plaintextMsg[i] = (char) rand ();
-      p = totalMessageSize;
+      p = paddedSize;
       if (stats != NULL)
         stats->change (stat_noise_sent, noiseLen);
     }
@@ -1945,6 +1972,7 @@ sendBuffer (BufferEntry * be)
     }
 
   encryptedMsg = GNUNET_malloc (p);
+  start = GNUNET_get_time_us ();
   GNUNET_hash (&p2pHdr->sequenceNumber,
                p - sizeof (GNUNET_HashCode),
                (GNUNET_HashCode *) encryptedMsg);
@@ -1952,7 +1980,10 @@ sendBuffer (BufferEntry * be)
                             &((GNUNET_TransportPacket_HEADER *)
                               encryptedMsg)->sequenceNumber);
   if (stats != NULL)
-    stats->change (stat_encrypted, p - sizeof (GNUNET_HashCode));
+    {
+      stats->record (stat_encrypt_time, GNUNET_get_time_us () - start);
+      stats->change (stat_encrypted, p - sizeof (GNUNET_HashCode));
+    }
   GNUNET_GE_ASSERT (ectx, be->session.tsession != NULL);
   ret = transport->send (be->session.tsession, encryptedMsg, p, GNUNET_NO);
   if ((ret == GNUNET_NO) && (priority >= GNUNET_EXTREME_PRIORITY))
@@ -3157,6 +3188,7 @@ GNUNET_CORE_connection_check_header (const GNUNET_PeerIdentity * sender,
   char *tmp;
   GNUNET_HashCode hc;
   GNUNET_EncName enc;
+  unsigned long long start;
 
   ENTRY ();
   GNUNET_GE_ASSERT (ectx, msg != NULL);
@@ -3209,9 +3241,12 @@ GNUNET_CORE_connection_check_header (const GNUNET_PeerIdentity * sender,
       return GNUNET_SYSERR;     /* could not decrypt */
     }
   tmp = GNUNET_malloc (size - sizeof (GNUNET_HashCode));
+  start = GNUNET_get_time_us ();
   res = GNUNET_AES_decrypt (&be->skey_remote, &msg->sequenceNumber, size - sizeof (GNUNET_HashCode), (const GNUNET_AES_InitializationVector *) &msg->hash,      /* IV */
                             tmp);
   GNUNET_hash (tmp, size - sizeof (GNUNET_HashCode), &hc);
+  if (stats != NULL)
+    stats->record (stat_decrypt_time, GNUNET_get_time_us () - start);
   if (!
       ((res != GNUNET_OK)
        && (0 == memcmp (&hc, &msg->hash, sizeof (GNUNET_HashCode)))))
@@ -3646,7 +3681,7 @@ GNUNET_CORE_connection_consider_takeover (const GNUNET_PeerIdentity * sender,
           transport->disconnect (ts, __FILE__);
         }
       be->session.tsession = tsession;
-      be->session.mtu = transport->mtu_get (tsession->ttype);
+      be->session.mtu = transport->mtu_get_session (tsession);
       if ((be->consider_transport_switch == GNUNET_YES) &&
           (transport->mtu_get (tsession->ttype) == 0))
         be->consider_transport_switch = GNUNET_NO;
@@ -3825,6 +3860,10 @@ GNUNET_CORE_connection_init (struct GNUNET_GE_Context *e,
                                                     "# bytes received"));
       stat_decrypted = stats->create (gettext_noop (    /* bytes successfully decrypted */
                                                      "# bytes decrypted"));
+      stat_encrypt_time =
+        stats->create_histogram (gettext_noop ("p2p encryption time (us)"));
+      stat_decrypt_time =
+        stats->create_histogram (gettext_noop ("p2p decryption time (us)"));
       stat_noise_sent = stats->create (gettext_noop ("# bytes noise sent"));
       stat_total_allowed_sent
         =
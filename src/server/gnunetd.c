@@ -103,6 +103,7 @@ gnunet_main ()
 {
   struct GNUNET_SignalHandlerContext *shc_hup;
   int filedes[2];               /* pipe between client and parent */
+  unsigned long long workers;
 
   if ((GNUNET_NO == debug_flag) && (GNUNET_NO == no_daemonize_flag)
       && (GNUNET_OK != GNUNET_terminal_detach (ectx, cfg, filedes,
@@ -120,6 +121,11 @@ gnunet_main ()
     }
   cron = GNUNET_cron_create (ectx);
   GNUNET_GE_ASSERT (ectx, cron != NULL);
+  if (0 == GNUNET_GC_get_configuration_value_number (cfg,
+                                                     "GNUNETD",
+                                                     "CRON-WORKERS",
+                                                     0, 64, 2, &workers))
+    GNUNET_cron_set_workers (cron, (unsigned int) workers);
 #ifndef WINDOWS
   shc_hup = GNUNET_signal_handler_install (SIGHUP, &reread_config);
 #endif
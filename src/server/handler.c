@@ -28,6 +28,7 @@
 #include "gnunet_protocols.h"
 #include "gnunet_transport_service.h"
 #include "gnunet_identity_service.h"
+#include "gnunet_stats_service.h"
 
 #include "core.h"
 #include "handler.h"
@@ -41,12 +42,6 @@
  */
 #define TRACK_DISCARD GNUNET_NO
 
-/**
- * Track how much time was spent on each
- * type of message?
- */
-#define MEASURE_TIME GNUNET_NO
-
 /**
  * Should we validate that handlers do not
  * modify the messages that they are given?
@@ -75,6 +70,17 @@ static GNUNET_Transport_ServiceAPI *transport;
  */
 static GNUNET_Identity_ServiceAPI *identity;
 
+/**
+ * Stats service (may be NULL)
+ */
+static GNUNET_Stats_ServiceAPI *stats;
+
+/**
+ * Histograms of the time spent by the handlers for
+ * each message type (-1 if not yet created).
+ */
+static int stat_handler_time[GNUNET_P2P_PROTO_MAX_USED];
+
 
 static GNUNET_TransportPacket *bufferQueue_[QUEUE_LENGTH];
 
@@ -129,11 +135,6 @@ static struct GNUNET_Mutex *handlerLock;
 
 static struct GNUNET_GE_Context *ectx;
 
-#if MEASURE_TIME
-static GNUNET_CronTime time_by_type[GNUNET_P2P_PROTO_MAX_USED];
-static unsigned int count_by_type[GNUNET_P2P_PROTO_MAX_USED];
-#endif
-
 
 /**
  * Register a method as a handler for specific message types.  Note
@@ -389,6 +390,27 @@ GNUNET_CORE_p2p_test_handler_registered (unsigned short type,
 #define ALIGN_REQUIRED sizeof(unsigned long long)
 #endif
 
+/**
+ * Record how long the handlers for a message type took.
+ *
+ * @param start when the handlers were started (GNUNET_get_time_us)
+ */
+static void
+recordHandlerTime (unsigned short ptyp, unsigned long long start)
+{
+  char name[64];
+
+  if ((stats == NULL) || (ptyp >= GNUNET_P2P_PROTO_MAX_USED))
+    return;
+  if (stat_handler_time[ptyp] == -1)
+    {
+      GNUNET_snprintf (name, sizeof (name),
+                       "p2p handler time for message type %u (us)", ptyp);
+      stat_handler_time[ptyp] = stats->create_histogram (name);
+    }
+  stats->record (stat_handler_time[ptyp], GNUNET_get_time_us () - start);
+}
+
 /**
  * Handle a message (that was decrypted if needed).
  * Processes the message by calling the registered
@@ -410,9 +432,7 @@ GNUNET_CORE_p2p_inject_message (const GNUNET_PeerIdentity * sender,
   GNUNET_MessageHeader *copy;
   int last;
   GNUNET_EncName enc;
-#if MEASURE_TIME
-  GNUNET_CronTime now;
-#endif
+  unsigned long long start;
 #if VALIDATE_CLIENT
   void *old_value;
 #endif
@@ -492,9 +512,7 @@ GNUNET_CORE_p2p_inject_message (const GNUNET_PeerIdentity * sender,
                              ptyp);
               continue;         /* no handler registered, go to next part */
             }
-#if MEASURE_TIME
-          now = GNUNET_get_time ();
-#endif
+          start = GNUNET_get_time_us ();
           last = 0;
           while (NULL != (callback = handlers[ptyp][last]))
             {
@@ -530,13 +548,7 @@ GNUNET_CORE_p2p_inject_message (const GNUNET_PeerIdentity * sender,
 
               last++;
             }
-#if MEASURE_TIME
-          if (ptyp < GNUNET_P2P_PROTO_MAX_USED)
-            {
-              time_by_type[ptyp] += GNUNET_get_time () - now;
-              count_by_type[ptyp]++;
-            }
-#endif
+          recordHandlerTime (ptyp, start);
         }
       else
         {                       /* isEncrypted == GNUNET_NO */
@@ -552,9 +564,7 @@ GNUNET_CORE_p2p_inject_message (const GNUNET_PeerIdentity * sender,
                              ptyp);
               continue;         /* no handler registered, go to next part */
             }
-#if MEASURE_TIME
-          now = GNUNET_get_time ();
-#endif
+          start = GNUNET_get_time_us ();
           last = 0;
           while (NULL != (callback = plaintextHandlers[ptyp][last]))
             {
@@ -573,13 +583,7 @@ GNUNET_CORE_p2p_inject_message (const GNUNET_PeerIdentity * sender,
                 }
               last++;
             }
-#if MEASURE_TIME
-          if (ptyp < GNUNET_P2P_PROTO_MAX_USED)
-            {
-              time_by_type[ptyp] += GNUNET_get_time () - now;
-              count_by_type[ptyp]++;
-            }
-#endif
+          recordHandlerTime (ptyp, start);
 
         }                       /* if plaintext */
     }                           /* while loop */
@@ -625,6 +629,21 @@ handleMessage (GNUNET_TSession * tsession,
                                   tsession);
 }
 
+/**
+ * Free a packet received from the transport layer
+ * (giving the message back to the transport if it
+ * wants it).
+ */
+static void
+free_packet (GNUNET_TransportPacket * mp)
+{
+  if (mp->msg_free != NULL)
+    mp->msg_free (mp->msg);
+  else
+    GNUNET_free (mp->msg);
+  GNUNET_free (mp);
+}
+
 /**
  * This is the main loop of each thread.  It loops *forever* waiting
  * for incomming packets in the packet queue. Then it calls "handle"
@@ -654,8 +673,7 @@ threadMain (void *cls)
       handleMessage (mp->tsession, &mp->sender, mp->msg, mp->size);
       if (mp->tsession != NULL)
         transport->disconnect (mp->tsession, __FILE__);
-      GNUNET_free (mp->msg);
-      GNUNET_free (mp);
+      free_packet (mp);
     }
   GNUNET_semaphore_up (mainShutdownSignal);
   return NULL;
@@ -670,8 +688,7 @@ GNUNET_CORE_p2p_receive (GNUNET_TransportPacket * mp)
 {
   if (threads_running != GNUNET_YES)
     {
-      GNUNET_free (mp->msg);
-      GNUNET_free (mp);
+      free_packet (mp);
       return;
     }
   if ((mp->tsession != NULL) &&
@@ -680,8 +697,7 @@ GNUNET_CORE_p2p_receive (GNUNET_TransportPacket * mp)
                sizeof (GNUNET_PeerIdentity))))
     {
       GNUNET_GE_BREAK (NULL, 0);
-      GNUNET_free (mp->msg);
-      GNUNET_free (mp);
+      free_packet (mp);
       return;
     }
   if ((threads_running == GNUNET_NO) || (mainShutdownSignal != NULL))
@@ -725,8 +741,7 @@ GNUNET_CORE_p2p_receive (GNUNET_TransportPacket * mp)
                        1.0 * accepted / (blacklisted + discarded + 1));
       GNUNET_mutex_unlock (globalLock_);
 #endif
-      GNUNET_free (mp->msg);
-      GNUNET_free (mp);
+      free_packet (mp);
       return;
     }
   if ((threads_running == GNUNET_NO) ||
@@ -742,8 +757,7 @@ GNUNET_CORE_p2p_receive (GNUNET_TransportPacket * mp)
                      "Discarding message of size %u -- buffer full!\n",
                      mp->size);
 #endif
-      GNUNET_free (mp->msg);
-      GNUNET_free (mp);
+      free_packet (mp);
 #if TRACK_DISCARD
       GNUNET_mutex_lock (globalLock_);
       discarded++;
@@ -824,6 +838,20 @@ GNUNET_CORE_p2p_disable_processing ()
     }
   GNUNET_semaphore_destroy (mainShutdownSignal);
   mainShutdownSignal = NULL;
+  /* give unprocessed messages back while the transports
+     that they came from are still loaded */
+  GNUNET_mutex_lock (globalLock_);
+  for (i = 0; i < QUEUE_LENGTH; i++)
+    {
+      if (bufferQueue_[i] == NULL)
+        continue;
+      free_packet (bufferQueue_[i]);
+      bufferQueue_[i] = NULL;
+      GNUNET_semaphore_down (bufferQueueRead_, GNUNET_NO);
+      GNUNET_semaphore_up (bufferQueueWrite_);
+    }
+  bq_firstFull_ = bq_firstFree_;
+  GNUNET_mutex_unlock (globalLock_);
 }
 
 /**
@@ -840,6 +868,9 @@ GNUNET_CORE_p2p_init (struct GNUNET_GE_Context *e)
   GNUNET_GE_ASSERT (ectx, transport != NULL);
   identity = GNUNET_CORE_request_service ("identity");
   GNUNET_GE_ASSERT (ectx, identity != NULL);
+  stats = GNUNET_CORE_request_service ("stats");
+  for (i = 0; i < GNUNET_P2P_PROTO_MAX_USED; i++)
+    stat_handler_time[i] = -1;
   /* initialize sync mechanisms for message handling threads */
   bufferQueueRead_ = GNUNET_semaphore_create (0);
   bufferQueueWrite_ = GNUNET_semaphore_create (QUEUE_LENGTH);
@@ -895,19 +926,11 @@ GNUNET_CORE_p2p_done ()
   transport = NULL;
   GNUNET_CORE_release_service (identity);
   identity = NULL;
-#if MEASURE_TIME
-  for (i = 0; i < GNUNET_P2P_PROTO_MAX_USED; i++)
+  if (stats != NULL)
     {
-      if (count_by_type[i] == 0)
-        continue;
-      GNUNET_GE_LOG (ectx,
-                     GNUNET_GE_DEBUG | GNUNET_GE_DEVELOPER |
-                     GNUNET_GE_REQUEST,
-                     "%10u msgs of type %2u took %16llu ms (%llu on average)\n",
-                     count_by_type[i], i, time_by_type[i],
-                     time_by_type[i] / count_by_type[i]);
+      GNUNET_CORE_release_service (stats);
+      stats = NULL;
     }
-#endif
 }
 
 
@@ -69,6 +69,17 @@ static struct GNUNET_Mutex *handlerlock;
  */
 static struct GNUNET_SelectHandle *selector;
 
+/**
+ * The thread that waits for new connections from local
+ * clients on the UNIX domain socket (or NULL).
+ */
+static struct GNUNET_SelectHandle *unix_selector;
+
+/**
+ * Filename of the UNIX domain socket (or NULL).
+ */
+static char *unix_path;
+
 static struct GNUNET_GE_Context *ectx;
 
 static struct GNUNET_GC_Configuration *cfg;
@@ -81,6 +92,11 @@ typedef struct GNUNET_ClientHandle
 
   struct GNUNET_SocketHandle *sock;
 
+  /**
+   * The select handle responsible for the socket.
+   */
+  struct GNUNET_SelectHandle *sh;
+
 } ClientHandle;
 
 /**
@@ -173,6 +189,15 @@ select_accept_handler (void *ah_cls,
   struct sockaddr_in *a4;
   struct sockaddr_in6 *a6;
 
+#ifndef MINGW
+  if ((addr_len >= sizeof (sa_family_t)) &&
+      (((const struct sockaddr *) addr)->sa_family == AF_UNIX))
+    {
+      /* local client; the socket is only offered if
+         the local host is trusted */
+    }
+  else
+#endif
   if (addr_len == sizeof (struct sockaddr_in6))
     {
       a6 = (struct sockaddr_in6 *) addr;
@@ -214,6 +239,7 @@ select_accept_handler (void *ah_cls,
     }
   session = GNUNET_malloc (sizeof (ClientHandle));
   session->sock = sock;
+  session->sh = sh;
   return session;
 }
 
@@ -246,7 +272,7 @@ GNUNET_CORE_cs_send_to_client (struct GNUNET_ClientHandle *handle,
                                const GNUNET_MessageHeader * message,
                                int force)
 {
-  return GNUNET_select_write (selector, handle->sock, message, GNUNET_NO,
+  return GNUNET_select_write (handle->sh, handle->sock, message, GNUNET_NO,
                               force);
 }
 
@@ -254,14 +280,14 @@ int
 GNUNET_CORE_cs_test_send_to_client_now (struct GNUNET_ClientHandle *handle,
                                         unsigned int size, int force)
 {
-  return GNUNET_select_test_write_now (selector, handle->sock,
+  return GNUNET_select_test_write_now (handle->sh, handle->sock,
                                        size, GNUNET_NO, force);
 }
 
 void
 GNUNET_CORE_cs_terminate_client_connection (struct GNUNET_ClientHandle *sock)
 {
-  GNUNET_select_disconnect (selector, sock->sock);
+  GNUNET_select_disconnect (sock->sh, sock->sock);
 }
 
 static int
@@ -429,6 +455,128 @@ startTCPServer ()
   return GNUNET_OK;
 }
 
+#ifndef MINGW
+/**
+ * Make sure that the directory of the UNIX domain socket exists
+ * and that only root or we can create files in it (otherwise
+ * another local user could pose as gnunetd).
+ *
+ * @return GNUNET_OK if the directory is safe to use
+ */
+static int
+checkUnixDirectory (const char *path)
+{
+  struct stat st;
+  char *dir;
+  char *pos;
+  int ret;
+
+  dir = GNUNET_strdup (path);
+  pos = strrchr (dir, DIR_SEPARATOR);
+  if ((pos == NULL) || (pos == dir))
+    {
+      GNUNET_free (dir);
+      return GNUNET_SYSERR;
+    }
+  *pos = '\0';
+  GNUNET_disk_directory_create (ectx, dir);
+  ret = GNUNET_OK;
+  if ((0 != lstat (dir, &st)) ||
+      (!S_ISDIR (st.st_mode)) ||
+      ((st.st_uid != 0) && (st.st_uid != geteuid ())) ||
+      (0 != (st.st_mode & (S_IWGRP | S_IWOTH))))
+    {
+      GNUNET_GE_LOG (ectx,
+                     GNUNET_GE_WARNING | GNUNET_GE_ADMIN | GNUNET_GE_BULK,
+                     _("Not offering UNIX domain socket `%s': directory "
+                       "`%s' is missing or writable by other users.\n"),
+                     path, dir);
+      ret = GNUNET_SYSERR;
+    }
+  GNUNET_free (dir);
+  return ret;
+}
+#endif
+
+/**
+ * Offer a UNIX domain socket to local clients (if the
+ * local host is trusted).  Failing to do so is not fatal
+ * since local clients can still use TCP.
+ */
+static void
+startUnixServer ()
+{
+#ifndef MINGW
+  struct sockaddr_un serverAddr;
+  struct in_addr loopback;
+  int listenerFD;
+
+  loopback.s_addr = htonl (INADDR_LOOPBACK);
+  if (!isWhitelisted4 (&loopback))
+    return;
+  unix_path = GNUNET_client_connection_get_unix_path (cfg, getGNUnetPort ());
+  if (unix_path == NULL)
+    return;
+  if (GNUNET_OK != checkUnixDirectory (unix_path))
+    {
+      GNUNET_free (unix_path);
+      unix_path = NULL;
+      return;
+    }
+  memset (&serverAddr, 0, sizeof (serverAddr));
+  serverAddr.sun_family = AF_UNIX;
+  strncpy (serverAddr.sun_path, unix_path, sizeof (serverAddr.sun_path) - 1);
+  /* remove socket left behind by a previous gnunetd on this port
+     (we hold the TCP port, so it cannot be in use); if we can not
+     replace it, do not listen at all */
+  if ((0 != UNLINK (unix_path)) && (errno != ENOENT))
+    {
+      GNUNET_GE_LOG_STRERROR_FILE (ectx,
+                                   GNUNET_GE_WARNING | GNUNET_GE_ADMIN |
+                                   GNUNET_GE_BULK, "unlink", unix_path);
+      GNUNET_free (unix_path);
+      unix_path = NULL;
+      return;
+    }
+  listenerFD = SOCKET (PF_UNIX, SOCK_STREAM, 0);
+  if (listenerFD < 0)
+    {
+      GNUNET_GE_LOG_STRERROR (ectx,
+                              GNUNET_GE_WARNING | GNUNET_GE_ADMIN |
+                              GNUNET_GE_BULK, "socket");
+      GNUNET_free (unix_path);
+      unix_path = NULL;
+      return;
+    }
+  if (BIND (listenerFD, (struct sockaddr *) &serverAddr,
+            sizeof (serverAddr)) < 0)
+    {
+      GNUNET_GE_LOG_STRERROR_FILE (ectx,
+                                   GNUNET_GE_WARNING | GNUNET_GE_ADMIN |
+                                   GNUNET_GE_BULK, "bind", unix_path);
+      CLOSE (listenerFD);
+      GNUNET_free (unix_path);
+      unix_path = NULL;
+      return;
+    }
+  unix_selector = GNUNET_select_create ("unixserver", GNUNET_NO, ectx, NULL, listenerFD, sizeof (struct sockaddr_un), 0,        /* no timeout */
+                                        &select_message_handler,
+                                        NULL,
+                                        &select_accept_handler,
+                                        NULL,
+                                        &select_close_handler,
+                                        NULL, 0 /* no memory quota */ ,
+                                        256 /* max sockets */ );
+  if (unix_selector == NULL)
+    {
+      CLOSE (listenerFD);
+      UNLINK (unix_path);
+      GNUNET_free (unix_path);
+      unix_path = NULL;
+    }
+#endif
+}
+
 int
 GNUNET_CORE_cs_done ()
 {
@@ -527,6 +675,8 @@ GNUNET_CORE_cs_init (struct GNUNET_GE_Context *e,
       GNUNET_CORE_cs_done ();
       return GNUNET_SYSERR;
     }
+  if (selector != NULL)
+    startUnixServer ();
   return GNUNET_OK;
 }
 
@@ -536,6 +686,17 @@ GNUNET_CORE_cs_init (struct GNUNET_GE_Context *e,
 int
 GNUNET_CORE_stop_cs_server ()
 {
+  if (unix_selector != NULL)
+    {
+      GNUNET_select_destroy (unix_selector);
+      unix_selector = NULL;
+    }
+  if (unix_path != NULL)
+    {
+      UNLINK (unix_path);
+      GNUNET_free (unix_path);
+      unix_path = NULL;
+    }
   if (selector != NULL)
     {
       GNUNET_select_destroy (selector);
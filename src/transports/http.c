@@ -62,6 +62,19 @@
  */
 #define HTTP_BUF_SIZE (64 * 1024)
 
+/**
+ * After how many bytes do we end a PUT (and start a new one
+ * for the following messages)?
+ */
+#define HTTP_PUT_STREAM_SIZE (4 * 1024 * 1024)
+
+/**
+ * For how long may a PUT stay idle (no data sent) before we end
+ * it?  PUTs only end when there is no message in the buffer, so
+ * that messages are never split between two PUTs.
+ */
+#define HTTP_PUT_STREAM_TIME (60 * GNUNET_CRON_SECONDS)
+
 /**
  * Text of the response sent back after the last bytes of a PUT
  * request have been received (just to formally obey the HTTP
@@ -73,7 +86,10 @@
 #include "common.c"
 
 /**
- * Client-side data per PUT request.
+ * Client-side data per PUT request.  A PUT is a long-lived
+ * (chunked) stream that carries all messages of the session
+ * until it has been used for HTTP_PUT_STREAM_SIZE bytes or
+ * has been idle for HTTP_PUT_STREAM_TIME.
  */
 struct HTTPPutData
 {
@@ -82,6 +98,11 @@ struct HTTPPutData
    */
   struct HTTPPutData *next;
 
+  /**
+   * Session that the PUT belongs to.
+   */
+  struct HTTPSession *session;
+
   /**
    * Handle to our CURL request.
    */
@@ -93,24 +114,27 @@ struct HTTPPutData
   GNUNET_CronTime last_activity;
 
   /**
-   * The message we are sending.
+   * Number of bytes sent with this PUT so far.
    */
-  char *msg;
+  unsigned long long sent;
 
   /**
-   * Size of msg.
+   * Is the PUT paused (because the write buffer
+   * of the session is empty)?
    */
-  unsigned int size;
+  int paused;
 
   /**
-   * Current position in msg.
+   * Have we ended the body of this PUT?  Messages
+   * queued afterwards must use a new PUT.
    */
-  unsigned int pos;
+  int finishing;
 
   /**
    * Are we done sending?  Set to 1 after we
    * completed sending and started to receive
-   * a response ("Thank you!") or once the
+   * a response ("Thank you!"), once CURL is
+   * done with the request or once the
    * timeout has been reached.
    */
   int done;
@@ -344,10 +368,31 @@ typedef struct HTTPSession
       char *url;
 
       /**
-       * Linked list of PUT operations.
+       * Linked list of PUT operations (at most one of
+       * them is not yet finishing).
        */
       struct HTTPPutData *puts;
 
+      /**
+       * Messages waiting to be sent with the PUT.
+       */
+      char *wbuff;
+
+      /**
+       * Current read position in wbuff
+       */
+      unsigned int woff;
+
+      /**
+       * Number of valid bytes in wbuff (starting at woff)
+       */
+      unsigned int wpos;
+
+      /**
+       * Size of the write buffer.
+       */
+      unsigned int wsize;
+
     } client;
 
   } cs;
@@ -398,6 +443,11 @@ static int signal_pipe[2];
 
 static char *proxy;
 
+/**
+ * Extra headers for our PUTs.
+ */
+static struct curl_slist *put_headers;
+
 /**
  * Daemon for listening for new connections.
  */
@@ -532,10 +582,11 @@ destroy_tsession (GNUNET_TSession * tsession)
           http_requests_pending--;
           signal_select ();
           curl_easy_cleanup (pos->curl_put);
-          GNUNET_free (pos->msg);
           GNUNET_free (pos);
           pos = next;
         }
+      GNUNET_array_grow (httpsession->cs.client.wbuff,
+                         httpsession->cs.client.wsize, 0);
       GNUNET_free (httpsession);
       GNUNET_free (tsession);
     }
@@ -968,6 +1019,7 @@ accessHandlerCallback (void *cls,
           mp->sender = httpSession->sender;
           mp->tsession = httpSession->tsession;
           mp->size = ntohs (hdr->size) - sizeof (GNUNET_MessageHeader);
+          mp->msg_free = NULL;
 #if DEBUG_HTTP
           GNUNET_GE_LOG (coreAPI->ectx,
                          GNUNET_GE_DEBUG | GNUNET_GE_REQUEST | GNUNET_GE_USER,
@@ -1057,6 +1109,7 @@ receiveContentCallback (void *ptr, size_t size, size_t nmemb, void *ctx)
       mp->sender = httpSession->sender;
       mp->tsession = httpSession->tsession;
       mp->size = ntohs (hdr->size) - sizeof (GNUNET_MessageHeader);
+      mp->msg_free = NULL;
       coreAPI->receive (mp);
       httpSession->cs.client.rbuff2 = NULL;
       httpSession->cs.client.rpos2 = 0;
@@ -1071,21 +1124,47 @@ receiveContentCallback (void *ptr, size_t size, size_t nmemb, void *ctx)
 
 /**
  * Provide bits for upload: we're using CURL for a PUT request
- * and now need to provide data from the message we are transmitting.
+ * and now need to provide data from the write buffer of the
+ * session.  If the buffer is empty, we pause the PUT (httpSend
+ * resumes it), unless it is time to end the PUT.
+ *
+ * Called by CURL with the lock held.
  */
 static size_t
 sendContentCallback (void *ptr, size_t size, size_t nmemb, void *ctx)
 {
   struct HTTPPutData *put = ctx;
+  HTTPSession *httpSession = put->session;
   size_t max = size * nmemb;
+  GNUNET_CronTime now;
 
   if (stats != NULL)
     stats->change (stat_curl_send_callbacks, 1);
-  put->last_activity = GNUNET_get_time ();
-  if (max > put->size - put->pos)
-    max = put->size - put->pos;
-  memcpy (ptr, &put->msg[put->pos], max);
-  put->pos += max;
+  now = GNUNET_get_time ();
+  if (httpSession->cs.client.wpos == 0)
+    {
+      if ((put->finishing == GNUNET_YES) ||
+          (put->sent >= HTTP_PUT_STREAM_SIZE) ||
+          (put->last_activity + HTTP_PUT_STREAM_TIME < now))
+        {
+          /* end of this PUT; the buffer is empty, so no
+             message is split between two PUTs */
+          put->finishing = GNUNET_YES;
+          return 0;
+        }
+      put->paused = GNUNET_YES;
+      return CURL_READFUNC_PAUSE;
+    }
+  put->last_activity = now;
+  if (max > httpSession->cs.client.wpos)
+    max = httpSession->cs.client.wpos;
+  memcpy (ptr,
+          &httpSession->cs.client.wbuff[httpSession->cs.client.woff], max);
+  httpSession->cs.client.woff += max;
+  httpSession->cs.client.wpos -= max;
+  if (httpSession->cs.client.wpos == 0)
+    httpSession->cs.client.woff = 0;
+  put->sent += max;
 #if DEBUG_HTTP
   GNUNET_GE_LOG (coreAPI->ectx,
                  GNUNET_GE_DEBUG | GNUNET_GE_REQUEST | GNUNET_GE_USER,
@@ -1326,21 +1405,72 @@ discardContentCallback (void *data, size_t size, size_t nmemb, void *put_cls)
   /* this condition should pretty much always be
      true; just checking here in case the PUT
      response comes early somehow */
-  if (put->pos == put->size)
+  if (put->finishing == GNUNET_YES)
     put->done = GNUNET_YES;
   return size * nmemb;
 }
 
 /**
- * Create a new PUT request for the given PUT data.
+ * CURL is done with a PUT request.  If the PUT failed before
+ * we finished its body, the message that was being sent is
+ * incomplete; since we cannot tell where the next message
+ * starts in the write buffer, all queued messages are lost
+ * (as they would be with a broken TCP connection).
+ *
+ * Called with the lock held.
+ */
+static void
+put_completed (struct HTTPPutData *put, CURLcode result)
+{
+  HTTPSession *httpSession = put->session;
+
+  put->done = GNUNET_YES;
+  if ((result == CURLE_OK) || (put->finishing == GNUNET_YES))
+    return;
+  put->finishing = GNUNET_YES;
+#if DEBUG_HTTP
+  GNUNET_GE_LOG (coreAPI->ectx,
+                 GNUNET_GE_DEBUG | GNUNET_GE_REQUEST | GNUNET_GE_USER,
+                 "HTTP/CURL PUT failed: `%s'.\n",
+                 curl_easy_strerror (result));
+#endif
+  if (stats != NULL)
+    stats->change (stat_bytesDropped, httpSession->cs.client.wpos);
+  httpSession->cs.client.wpos = 0;
+  httpSession->cs.client.woff = 0;
+}
+
+/**
+ * Find the PUT of the session that new messages
+ * should be sent with.
+ *
+ * @return NULL if we need to start a new PUT
+ */
+static struct HTTPPutData *
+get_active_put (HTTPSession * httpSession)
+{
+  struct HTTPPutData *put;
+
+  put = httpSession->cs.client.puts;
+  while ((put != NULL) &&
+         ((put->finishing == GNUNET_YES) || (put->done == GNUNET_YES)))
+    put = put->next;
+  return put;
+}
+
+/**
+ * Create a new PUT request that streams the messages in the
+ * write buffer of the session (using chunked encoding).
+ *
+ * @return GNUNET_OK on success, GNUNET_SYSERR on error
  */
 static int
-create_curl_put (HTTPSession * httpSession, struct HTTPPutData *put)
+create_curl_put (HTTPSession * httpSession)
 {
+  struct HTTPPutData *put;
   CURL *curl_put;
   CURLcode ret;
   CURLMcode mret;
-  long size;
 
   /* we should have initiated a GET earlier,
      so URL must not be NULL here */
@@ -1349,11 +1479,14 @@ create_curl_put (HTTPSession * httpSession, struct HTTPPutData *put)
   curl_put = curl_easy_init ();
   if (curl_put == NULL)
     return GNUNET_SYSERR;
+  put = GNUNET_malloc (sizeof (struct HTTPPutData));
+  memset (put, 0, sizeof (struct HTTPPutData));
+  put->session = httpSession;
   CURL_EASY_SETOPT (curl_put, CURLOPT_FAILONERROR, 1);
   CURL_EASY_SETOPT (curl_put, CURLOPT_URL, httpSession->cs.client.url);
   if (strlen (proxy) > 0)
     CURL_EASY_SETOPT (curl_put, CURLOPT_PROXY, proxy);
-  CURL_EASY_SETOPT (curl_put, CURLOPT_BUFFERSIZE, put->size);
+  CURL_EASY_SETOPT (curl_put, CURLOPT_BUFFERSIZE, 32 * 1024);
   if (0 == strncmp (httpSession->cs.client.url, "http", 4))
     CURL_EASY_SETOPT (curl_put, CURLOPT_USERAGENT, "GNUnet-http");
   CURL_EASY_SETOPT (curl_put, CURLOPT_UPLOAD, 1);
@@ -1365,36 +1498,46 @@ create_curl_put (HTTPSession * httpSession, struct HTTPPutData *put)
      setting NOSIGNAL results in really weird
      crashes on my system! */
   CURL_EASY_SETOPT (curl_put, CURLOPT_NOSIGNAL, 1);
-  CURL_EASY_SETOPT (curl_put, CURLOPT_TIMEOUT, 150L);
-  size = put->size;
-  CURL_EASY_SETOPT (curl_put, CURLOPT_INFILESIZE, size);
+  /* no CURLOPT_TIMEOUT: the PUT lives as long as it is
+     busy; cleanup_connections ends PUTs that make no progress */
+  /* size unknown: CURL uses chunked encoding */
+  CURL_EASY_SETOPT (curl_put, CURLOPT_INFILESIZE, -1L);
+  CURL_EASY_SETOPT (curl_put, CURLOPT_HTTPHEADER, put_headers);
   CURL_EASY_SETOPT (curl_put, CURLOPT_READFUNCTION, &sendContentCallback);
   CURL_EASY_SETOPT (curl_put, CURLOPT_READDATA, put);
   CURL_EASY_SETOPT (curl_put, CURLOPT_WRITEFUNCTION, &discardContentCallback);
   CURL_EASY_SETOPT (curl_put, CURLOPT_WRITEDATA, put);
+  CURL_EASY_SETOPT (curl_put, CURLOPT_PRIVATE, put);
   CURL_EASY_SETOPT (curl_put, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
   if (ret != CURLE_OK)
     {
       curl_easy_cleanup (curl_put);
+      GNUNET_free (put);
       return GNUNET_SYSERR;
     }
+  put->curl_put = curl_put;
+  put->last_activity = GNUNET_get_time ();
   GNUNET_mutex_lock (lock);
   mret = curl_multi_add_handle (curl_multi, curl_put);
-  http_requests_pending++;
-  GNUNET_mutex_unlock (lock);
-  if (stats != NULL)
-    stats->change (stat_put_issued, 1);
   if (mret != CURLM_OK)
     {
+      GNUNET_mutex_unlock (lock);
       GNUNET_GE_LOG (coreAPI->ectx,
                      GNUNET_GE_ERROR | GNUNET_GE_ADMIN | GNUNET_GE_USER |
                      GNUNET_GE_BULK, _("%s failed at %s:%d: `%s'\n"),
                      "curl_multi_add_handle", __FILE__, __LINE__,
                      curl_multi_strerror (mret));
+      curl_easy_cleanup (curl_put);
+      GNUNET_free (put);
       return GNUNET_SYSERR;
     }
+  http_requests_pending++;
+  put->next = httpSession->cs.client.puts;
+  httpSession->cs.client.puts = put;
+  GNUNET_mutex_unlock (lock);
+  if (stats != NULL)
+    stats->change (stat_put_issued, 1);
   signal_select ();
-  put->curl_put = curl_put;
 #if DEBUG_HTTP
   GNUNET_GE_LOG (coreAPI->ectx,
                  GNUNET_GE_DEBUG | GNUNET_GE_REQUEST | GNUNET_GE_USER,
@@ -1404,6 +1547,61 @@ create_curl_put (HTTPSession * httpSession, struct HTTPPutData *put)
   return GNUNET_OK;
 }
 
+/**
+ * Append a message (preceded by a GNUNET_MessageHeader) to a
+ * write buffer.  The buffer only grows beyond its current size
+ * (at least HTTP_BUF_SIZE) for important messages.
+ *
+ * @param size size of msg (without the header)
+ * @return GNUNET_OK on success, GNUNET_NO if the buffer is full
+ */
+static int
+append_to_buffer (char **wbuff,
+                  unsigned int *woff,
+                  unsigned int *wpos,
+                  unsigned int *wsize,
+                  const void *msg, unsigned int size, int important)
+{
+  GNUNET_MessageHeader *hdr;
+  char *tmp;
+
+  if (*wsize == 0)
+    GNUNET_array_grow (*wbuff, *wsize, HTTP_BUF_SIZE);
+  size += sizeof (GNUNET_MessageHeader);
+  if (*wpos + size > *wsize)
+    {
+      /* need to grow or discard */
+      if (!important)
+        return GNUNET_NO;
+      tmp = GNUNET_malloc (*wpos + size);
+      memcpy (tmp, &(*wbuff)[*woff], *wpos);
+      hdr = (GNUNET_MessageHeader *) & tmp[*wpos];
+      hdr->type = htons (0);
+      hdr->size = htons (size);
+      memcpy (&hdr[1], msg, size - sizeof (GNUNET_MessageHeader));
+      GNUNET_free (*wbuff);
+      *wbuff = tmp;
+      *wsize = *wpos + size;
+      *woff = 0;
+      *wpos = *wpos + size;
+      return GNUNET_OK;
+    }
+  /* fits without growing */
+  if (*wpos + *woff + size > *wsize)
+    {
+      /* need to compact first */
+      memmove (*wbuff, &(*wbuff)[*woff], *wpos);
+      *woff = 0;
+    }
+  /* append */
+  hdr = (GNUNET_MessageHeader *) & (*wbuff)[*woff + *wpos];
+  hdr->size = htons (size);
+  hdr->type = htons (0);
+  memcpy (&hdr[1], msg, size - sizeof (GNUNET_MessageHeader));
+  *wpos += size;
+  return GNUNET_OK;
+}
+
 
 /**
  * Test if the transport would even try to send
@@ -1438,10 +1636,17 @@ httpTestWouldTry (GNUNET_TSession * tsession, const unsigned int size,
     }
   if (httpSession->is_client)
     {
-      /* client */
-      if ((important != GNUNET_YES) && (httpSession->cs.client.puts != NULL))
-        return GNUNET_NO;
-      return GNUNET_YES;
+      /* client: is there space in the buffer of the PUT stream? */
+      GNUNET_mutex_lock (lock);
+      if ((important != GNUNET_YES) &&
+          (httpSession->cs.client.wpos + size +
+           sizeof (GNUNET_MessageHeader) >
+           GNUNET_MAX (httpSession->cs.client.wsize, HTTP_BUF_SIZE)))
+        ret = GNUNET_NO;
+      else
+        ret = GNUNET_YES;
+      GNUNET_mutex_unlock (lock);
+      return ret;
     }
   else
     {
@@ -1480,11 +1685,10 @@ httpSend (GNUNET_TSession * tsession,
 {
   HTTPSession *httpSession = tsession->internal;
   struct HTTPPutData *putData;
-  GNUNET_MessageHeader *hdr;
 #if DO_GET
   struct MHDGetData *getData;
-  char *tmp;
 #endif
+  int ret;
 
   if (stats != NULL)
     stats->change (stat_send_calls, 1);
@@ -1498,39 +1702,38 @@ httpSend (GNUNET_TSession * tsession,
           GNUNET_GE_BREAK (NULL, 0);
           return GNUNET_SYSERR;
         }
-      if (important != GNUNET_YES)
+      GNUNET_mutex_lock (lock);
+      /* queue the message for the PUT stream; if the buffer
+         is full, the core has to try again later */
+      ret = append_to_buffer (&httpSession->cs.client.wbuff,
+                              &httpSession->cs.client.woff,
+                              &httpSession->cs.client.wpos,
+                              &httpSession->cs.client.wsize,
+                              msg, size, important);
+      if (ret != GNUNET_OK)
         {
-          GNUNET_mutex_lock (lock);
-          if (httpSession->cs.client.puts != NULL)
+          GNUNET_mutex_unlock (lock);
+          if (stats != NULL)
+            stats->change (stat_bytesDropped, size);
+          return ret;
+        }
+      putData = get_active_put (httpSession);
+      if (putData == NULL)
+        {
+          if (GNUNET_OK != create_curl_put (httpSession))
             {
-              /* do not queue more than one unimportant PUT at a time */
-              signal_select (); /* do clean up now! */
+              httpSession->cs.client.wpos -=
+                size + sizeof (GNUNET_MessageHeader);
               GNUNET_mutex_unlock (lock);
-              if (stats != NULL)
-                stats->change (stat_bytesDropped, size);
-
-              return GNUNET_NO;
+              return GNUNET_SYSERR;
             }
-          GNUNET_mutex_unlock (lock);
         }
-      putData = GNUNET_malloc (sizeof (struct HTTPPutData));
-      memset (putData, 0, sizeof (struct HTTPPutData));
-      putData->msg = GNUNET_malloc (size + sizeof (GNUNET_MessageHeader));
-      hdr = (GNUNET_MessageHeader *) putData->msg;
-      hdr->size = htons (size + sizeof (GNUNET_MessageHeader));
-      hdr->type = htons (0);
-      memcpy (&putData->msg[sizeof (GNUNET_MessageHeader)], msg, size);
-      putData->size = size + sizeof (GNUNET_MessageHeader);
-      putData->last_activity = GNUNET_get_time ();
-      if (GNUNET_OK != create_curl_put (httpSession, putData))
+      else if (putData->paused == GNUNET_YES)
         {
-          GNUNET_free (putData->msg);
-          GNUNET_free (putData);
-          return GNUNET_SYSERR;
+          putData->paused = GNUNET_NO;
+          curl_easy_pause (putData->curl_put, CURLPAUSE_CONT);
+          signal_select ();
         }
-      GNUNET_mutex_lock (lock);
-      putData->next = httpSession->cs.client.puts;
-      httpSession->cs.client.puts = putData;
       GNUNET_mutex_unlock (lock);
       return GNUNET_OK;
     }
@@ -1551,47 +1754,13 @@ httpSend (GNUNET_TSession * tsession,
       GNUNET_mutex_unlock (lock);
       return GNUNET_SYSERR;
     }
-  if (getData->wsize == 0)
-    GNUNET_array_grow (getData->wbuff, getData->wsize, HTTP_BUF_SIZE);
-  size += sizeof (GNUNET_MessageHeader);
-  if (getData->wpos + size > getData->wsize)
+  if (GNUNET_OK != append_to_buffer (&getData->wbuff,
+                                     &getData->woff,
+                                     &getData->wpos,
+                                     &getData->wsize, msg, size, important))
     {
-      /* need to grow or discard */
-      if (!important)
-        {
-          GNUNET_mutex_unlock (lock);
-          return GNUNET_NO;
-        }
-      tmp = GNUNET_malloc (getData->wpos + size);
-      memcpy (tmp, &getData->wbuff[getData->woff], getData->wpos);
-      hdr = (GNUNET_MessageHeader *) & tmp[getData->wpos];
-      hdr->type = htons (0);
-      hdr->size = htons (size);
-      memcpy (&hdr[1], msg, size - sizeof (GNUNET_MessageHeader));
-      GNUNET_free (getData->wbuff);
-      getData->wbuff = tmp;
-      getData->wsize = getData->wpos + size;
-      getData->woff = 0;
-      getData->wpos = getData->wpos + size;
-    }
-  else
-    {
-      /* fits without growing */
-      if (getData->wpos + getData->woff + size > getData->wsize)
-        {
-          /* need to compact first */
-          memmove (getData->wbuff,
-                   &getData->wbuff[getData->woff], getData->wpos);
-          getData->woff = 0;
-        }
-      /* append */
-      hdr =
-        (GNUNET_MessageHeader *) & getData->wbuff[getData->woff +
-                                                  getData->wpos];
-      hdr->size = htons (size);
-      hdr->type = htons (0);
-      memcpy (&hdr[1], msg, size - sizeof (GNUNET_MessageHeader));
-      getData->wpos += size;
+      GNUNET_mutex_unlock (lock);
+      return GNUNET_NO;
     }
   signal_select ();
   GNUNET_mutex_unlock (lock);
@@ -1651,15 +1820,22 @@ cleanup_connections ()
           pos = s->cs.client.puts;
           while (pos != NULL)
             {
-              if (pos->last_activity + HTTP_TIMEOUT < now)
-                pos->done = GNUNET_YES;
+              if ((pos->done == GNUNET_NO) &&
+                  (pos->last_activity + HTTP_TIMEOUT < now))
+                put_completed (pos, CURLE_OPERATION_TIMEDOUT);
+              if ((pos->paused == GNUNET_YES) &&
+                  (pos->last_activity + HTTP_PUT_STREAM_TIME < now))
+                {
+                  /* let the read callback end the idle PUT */
+                  pos->paused = GNUNET_NO;
+                  curl_easy_pause (pos->curl_put, CURLPAUSE_CONT);
+                }
               if (pos->done)
                 {
                   if (prev == NULL)
                     s->cs.client.puts = pos->next;
                   else
                     prev->next = pos->next;
-                  GNUNET_free (pos->msg);
                   curl_multi_remove_handle (curl_multi, pos->curl_put);
                   http_requests_pending--;
                   signal_select ();
@@ -1760,11 +1936,14 @@ curl_runner (void *unused)
   int max;
   struct timeval tv;
   int running;
+  int queued;
   unsigned long long timeout;
   long ms;
   int have_tv;
   char buf[128];                /* for reading from pipe */
   int ret;
+  CURLMsg *cmsg;
+  char *put;
 
 #if DEBUG_HTTP
   GNUNET_GE_LOG (coreAPI->ectx,
@@ -1837,6 +2016,17 @@ curl_runner (void *unused)
                        GNUNET_GE_BULK, _("%s failed at %s:%d: `%s'\n"),
                        "curl_multi_perform", __FILE__, __LINE__,
                        curl_multi_strerror (mret));
+      GNUNET_mutex_lock (lock);
+      while (NULL != (cmsg = curl_multi_info_read (curl_multi, &queued)))
+        {
+          if (cmsg->msg != CURLMSG_DONE)
+            continue;
+          put = NULL;
+          curl_easy_getinfo (cmsg->easy_handle, CURLINFO_PRIVATE, &put);
+          if (put != NULL)
+            put_completed ((struct HTTPPutData *) put, cmsg->data.result);
+        }
+      GNUNET_mutex_unlock (lock);
       if (mhd_daemon != NULL)
         MHD_run (mhd_daemon);
       cleanup_connections ();
@@ -2066,6 +2256,8 @@ inittransport_http (GNUNET_CoreAPIForTransport * core)
   GNUNET_GC_get_configuration_value_string (coreAPI->cfg,
                                             "GNUNETD", "HTTP-PROXY", "",
                                             &proxy);
+  /* PUTs are streamed; do not wait for "100 Continue" */
+  put_headers = curl_slist_append (NULL, "Expect:");
 
   myAPI.protocol_number = GNUNET_TRANSPORT_PROTOCOL_NUMBER_HTTP;
   myAPI.mtu = 0;
@@ -2087,6 +2279,8 @@ inittransport_http (GNUNET_CoreAPIForTransport * core)
 void
 donetransport_http ()
 {
+  curl_slist_free_all (put_headers);
+  put_headers = NULL;
   curl_global_cleanup ();
   GNUNET_free_non_null (proxy);
   proxy = NULL;
@@ -0,0 +1,1024 @@
+/*
+     This file is part of GNUnet
+     (C) 2026 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 2, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+     Boston, MA 02111-1307, USA.
+*/
+
+/**
+ * @file transports/loopback.c
+ * @brief Transport between peers on the same machine with an
+ *        emulated link (latency, bandwidth, loss)
+ * @author Christian Grothoff
+ *
+ * Each peer binds a UNIX domain datagram socket whose name is
+ * derived from the configured "port".  The sender models its
+ * uplink: datagrams are serialized at the configured bandwidth
+ * through a tail-drop queue of limited size and lost with the
+ * configured probability.  Each datagram carries the (absolute)
+ * time at which it arrives at the receiver, which holds it back
+ * until then.  Since all peers run on the same machine, they share
+ * the clock.  This makes benchmarks of the core reproducible on a
+ * single machine without touching the real network stack.
+ */
+
+#include "platform.h"
+#include "gnunet_util.h"
+#include "gnunet_protocols.h"
+#include "gnunet_directories.h"
+#include "gnunet_transport.h"
+#include "gnunet_stats_service.h"
+#include "common.h"
+
+#ifndef MINGW
+#include <sys/un.h>
+#endif
+
+#define DEBUG_LOOPBACK GNUNET_NO
+
+#define MY_TRANSPORT_NAME "LOOPBACK"
+
+/**
+ * Default maximum size of each datagram (same as for UDP).
+ */
+#define MESSAGE_SIZE 1472
+
+/**
+ * Name of the socket (in GNUNETD_HOME) of the peer listening
+ * on the given "port".
+ */
+#define LOOPBACK_SOCKET_FORMAT "loopback-%u"
+
+/**
+ * How many datagrams may wait at the receiver for the emulated
+ * latency to pass?  More datagrams are dropped.
+ */
+#define LOOPBACK_MAX_PENDING 4096
+
+/**
+ * Message-Packet header.
+ */
+typedef struct
+{
+  /**
+   * size of the message, in bytes, including this header.
+   */
+  GNUNET_MessageHeader header;
+
+  /**
+   * What is the identity of the sender (GNUNET_hash of public key)
+   */
+  GNUNET_PeerIdentity sender;
+
+  /**
+   * When should the receiver pass the message to its core?
+   */
+  GNUNET_CronTime deliver_at GNUNET_PACKED;
+
+} LoopbackMessage;
+
+/**
+ * Datagram waiting at the receiver for its delivery time.
+ */
+struct LoopbackPending
+{
+  struct LoopbackPending *next;
+
+  GNUNET_CronTime deliver_at;
+
+  GNUNET_TransportPacket *mp;
+};
+
+/* *********** globals ************* */
+
+static GNUNET_TransportAPI myAPI;
+
+static GNUNET_CoreAPIForTransport *coreAPI;
+
+static GNUNET_Stats_ServiceAPI *stats;
+
+static struct GNUNET_GC_Configuration *cfg;
+
+static struct GNUNET_LoadMonitor *load_monitor;
+
+static int stat_bytesReceived;
+
+static int stat_bytesSent;
+
+static int stat_bytesDropped;
+
+static int stat_bytesLost;
+
+/**
+ * thread that receives inbound datagrams and delivers
+ * them once their latency has passed
+ */
+static struct GNUNET_ThreadHandle *io_thread;
+
+/**
+ * Pipe used to wake up the I/O thread.
+ */
+static int io_signal_pipe[2];
+
+/**
+ * Should the I/O thread terminate?
+ */
+static int io_shutdown;
+
+/**
+ * The socket that we receive and send with (or -1).
+ */
+static int loopback_sock = -1;
+
+/**
+ * Our "port" (0 if we only send).
+ */
+static unsigned short loopback_port;
+
+/**
+ * Path of our socket (NULL if we only send).
+ */
+static char *socket_path;
+
+/**
+ * Datagrams received but not yet delivered, sorted by
+ * delivery time (only used by the I/O thread).
+ */
+static struct LoopbackPending *pending_head;
+
+static unsigned int pending_count;
+
+/**
+ * Buffer for receiving one datagram (only used by the I/O thread).
+ */
+static char *recv_buf;
+
+/**
+ * Buffer for building outbound datagrams (protected by send_lock).
+ */
+static LoopbackMessage *send_buf;
+
+/**
+ * Lock for loopback_sock, send_buf and the uplink state.
+ */
+static struct GNUNET_Mutex *send_lock;
+
+/**
+ * Emulated one-way latency.
+ */
+static GNUNET_CronTime latency;
+
+/**
+ * Emulated uplink bandwidth in bytes per second (0 for unlimited).
+ */
+static unsigned long long bandwidth;
+
+/**
+ * Probability of losing a datagram (per thousand).
+ */
+static unsigned int loss;
+
+/**
+ * How many bytes may be queued on the emulated uplink?
+ */
+static unsigned long long queue_size;
+
+/**
+ * Time (in microseconds) at which the emulated uplink has
+ * transmitted everything that was queued so far.
+ */
+static unsigned long long link_free;
+
+
+/**
+ * Wake up the I/O thread.
+ */
+static void
+signal_io_thread ()
+{
+  static char i = '\0';
+
+  if ((-1 == WRITE (io_signal_pipe[1], &i, sizeof (char))) &&
+      (errno != EAGAIN) && (errno != EWOULDBLOCK))
+    GNUNET_GE_LOG_STRERROR (coreAPI->ectx,
+                            GNUNET_GE_ERROR | GNUNET_GE_ADMIN |
+                            GNUNET_GE_BULK, "write");
+}
+
+/**
+ * Fill in the socket address for the given socket path.
+ *
+ * @return GNUNET_OK on success, GNUNET_SYSERR if the path is too long
+ */
+static int
+make_address (struct sockaddr_un *addr, const char *path)
+{
+  memset (addr, 0, sizeof (struct sockaddr_un));
+  addr->sun_family = AF_UNIX;
+  if (strlen (path) >= sizeof (addr->sun_path))
+    return GNUNET_SYSERR;
+  strcpy (addr->sun_path, path);
+  return GNUNET_OK;
+}
+
+/**
+ * Get the path of our socket for the given "port".  Sockets
+ * live in GNUNETD_HOME (not in a world-writable directory), so
+ * other users can neither take over nor remove them.
+ *
+ * @return path (caller must free), NULL on error
+ */
+static char *
+get_socket_path (unsigned short port)
+{
+  char *home;
+  char *path;
+  size_t len;
+
+  home = NULL;
+  if ((-1 == GNUNET_GC_get_configuration_value_filename (cfg,
+                                                         "GNUNETD",
+                                                         "GNUNETD_HOME",
+                                                         GNUNET_DEFAULT_DAEMON_VAR_DIRECTORY,
+                                                         &home)) ||
+      (home == NULL))
+    return NULL;
+  GNUNET_disk_directory_create (coreAPI->ectx, home);
+  len = strlen (home);
+  while ((len > 1) && (home[len - 1] == DIR_SEPARATOR))
+    home[--len] = '\0';
+  len += strlen (LOOPBACK_SOCKET_FORMAT) + 8;
+  path = GNUNET_malloc (len);
+  GNUNET_snprintf (path, len,
+                   "%s%s" LOOPBACK_SOCKET_FORMAT,
+                   home, DIR_SEPARATOR_STR, port);
+  GNUNET_free (home);
+  return path;
+}
+
+/**
+ * How many bytes are queued on the emulated uplink right now?
+ * Also moves the link clock forward to "now".
+ *
+ * This function may only be called if the send_lock is
+ * already held by the caller.
+ *
+ * @param now current time in microseconds
+ */
+static unsigned long long
+get_backlog (unsigned long long now)
+{
+  if (link_free < now)
+    link_free = now;
+  if (bandwidth == 0)
+    return 0;
+  return (link_free - now) * bandwidth / 1000000LL;
+}
+
+/**
+ * Get the port of our socket from the configuration.
+ */
+static unsigned short
+get_port ()
+{
+  unsigned long long port;
+
+  if (-1 == GNUNET_GC_get_configuration_value_number (cfg,
+                                                      MY_TRANSPORT_NAME,
+                                                      "PORT", 0, 65535, 2088,
+                                                      &port))
+    port = 0;
+  return (unsigned short) port;
+}
+
+/**
+ * Verify that a hello-Message is correct (a valid local
+ * address with a port, followed by the path of the socket).
+ * The path must name a loopback socket for that port, so that
+ * a hello can not make us send to arbitrary local sockets.
+ *
+ * @return GNUNET_OK on success, GNUNET_SYSERR on error
+ */
+static int
+verify_hello (const GNUNET_MessageHello * hello)
+{
+  const HostAddress *haddr;
+  const char *path;
+  const char *base;
+  struct sockaddr_un addr;
+  char name[32];
+  unsigned int size;
+
+  haddr = (const HostAddress *) &hello[1];
+  path = (const char *) &haddr[1];
+  size = ntohs (hello->senderAddressSize);
+  if ((size < sizeof (HostAddress) + 2) ||
+      (size > sizeof (HostAddress) + sizeof (addr.sun_path)) ||
+      (ntohs (hello->header.size) != GNUNET_sizeof_hello (hello)) ||
+      (ntohs (haddr->port) == 0) ||
+      (path[size - sizeof (HostAddress) - 1] != '\0') ||
+      (path[0] != DIR_SEPARATOR))
+    {
+      GNUNET_GE_BREAK_OP (NULL, 0);
+      return GNUNET_SYSERR;     /* invalid (external error) */
+    }
+  GNUNET_snprintf (name, sizeof (name),
+                   LOOPBACK_SOCKET_FORMAT, ntohs (haddr->port));
+  base = strrchr (path, DIR_SEPARATOR);
+  if (0 != strcmp (&base[1], name))
+    {
+      GNUNET_GE_BREAK_OP (NULL, 0);
+      return GNUNET_SYSERR;     /* invalid (external error) */
+    }
+  if ((ntohs (hello->protocol) != myAPI.protocol_number) ||
+      (ntohs (hello->header.type) != GNUNET_P2P_PROTO_HELLO))
+    {
+      GNUNET_GE_BREAK (NULL, 0);
+      return GNUNET_SYSERR;     /* invalid (internal error) */
+    }
+  return GNUNET_OK;
+}
+
+/**
+ * Create a hello-Message for the current node.  The address
+ * is the "port" of our socket (and 127.0.0.1 for display),
+ * followed by the 0-terminated path of the socket.
+ *
+ * @return hello on success, NULL on error
+ */
+static GNUNET_MessageHello *
+create_hello ()
+{
+  GNUNET_MessageHello *msg;
+  HostAddress *haddr;
+  unsigned short port;
+  char *path;
+  unsigned int size;
+
+  port = get_port ();
+  if (port == 0)
+    return NULL;
+  path = get_socket_path (port);
+  if (path == NULL)
+    return NULL;
+  size = sizeof (HostAddress) + strlen (path) + 1;
+  msg = GNUNET_malloc (sizeof (GNUNET_MessageHello) + size);
+  memset (msg, 0, sizeof (GNUNET_MessageHello) + size);
+  msg->header.size = htons (sizeof (GNUNET_MessageHello) + size);
+  haddr = (HostAddress *) & msg[1];
+  haddr->ipv4.s_addr = htonl (INADDR_LOOPBACK);
+  haddr->port = htons (port);
+  haddr->availability = htons (VERSION_AVAILABLE_IPV4);
+  strcpy ((char *) &haddr[1], path);
+  GNUNET_free (path);
+  msg->senderAddressSize = htons (size);
+  msg->protocol = htons (myAPI.protocol_number);
+  msg->MTU = htonl (myAPI.mtu);
+  return msg;
+}
+
+/**
+ * Convert a loopback hello to an IP address (127.0.0.1 and
+ * the "port").
+ */
+static int
+hello_to_address (const GNUNET_MessageHello * hello,
+                  void **sa, unsigned int *sa_len)
+{
+  const HostAddress *haddr = (const HostAddress *) &hello[1];
+  struct sockaddr_in *serverAddr4;
+
+  *sa_len = sizeof (struct sockaddr_in);
+  serverAddr4 = GNUNET_malloc (sizeof (struct sockaddr_in));
+  *sa = serverAddr4;
+  memset (serverAddr4, 0, sizeof (struct sockaddr_in));
+  serverAddr4->sin_family = AF_INET;
+  serverAddr4->sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  serverAddr4->sin_port = haddr->port;
+  return GNUNET_OK;
+}
+
+/**
+ * Pass all pending datagrams whose delivery time has come
+ * to the core.
+ *
+ * @return time until the next datagram is due
+ *         (0 if none is pending)
+ */
+static GNUNET_CronTime
+deliver_pending ()
+{
+  struct LoopbackPending *pos;
+  GNUNET_CronTime now;
+
+  now = GNUNET_get_time ();
+  while ((NULL != (pos = pending_head)) && (pos->deliver_at <= now))
+    {
+      pending_head = pos->next;
+      pending_count--;
+      coreAPI->receive (pos->mp);
+      GNUNET_free (pos);
+    }
+  if (pending_head == NULL)
+    return 0;
+  return pending_head->deliver_at - now;
+}
+
+/**
+ * Queue a received datagram until its delivery time.  Datagrams
+ * from one sender arrive in order of their delivery time, so
+ * we usually append at the end.
+ */
+static void
+queue_pending (GNUNET_TransportPacket * mp, GNUNET_CronTime deliver_at)
+{
+  struct LoopbackPending *pending;
+  struct LoopbackPending *prev;
+  struct LoopbackPending *pos;
+
+  if (pending_count >= LOOPBACK_MAX_PENDING)
+    {
+      if (stats != NULL)
+        stats->change (stat_bytesDropped, mp->size);
+      GNUNET_free (mp->msg);
+      GNUNET_free (mp);
+      return;
+    }
+  pending = GNUNET_malloc (sizeof (struct LoopbackPending));
+  pending->deliver_at = deliver_at;
+  pending->mp = mp;
+  prev = NULL;
+  pos = pending_head;
+  while ((pos != NULL) && (pos->deliver_at <= deliver_at))
+    {
+      prev = pos;
+      pos = pos->next;
+    }
+  pending->next = pos;
+  if (prev == NULL)
+    pending_head = pending;
+  else
+    prev->next = pending;
+  pending_count++;
+}
+
+/**
+ * Receive all datagrams that are waiting in the socket.
+ */
+static void
+receive_datagrams ()
+{
+  const LoopbackMessage *lm;
+  GNUNET_TransportPacket *mp;
+  GNUNET_CronTime deliver_at;
+  unsigned long long received;
+  ssize_t ret;
+  unsigned int len;
+
+  received = 0;
+  while (1)
+    {
+      ret = RECV (loopback_sock,
+                  recv_buf, sizeof (LoopbackMessage) + myAPI.mtu,
+                  MSG_DONTWAIT);
+      if (ret == -1)
+        {
+          if (errno == EINTR)
+            continue;
+          if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+            GNUNET_GE_LOG_STRERROR (coreAPI->ectx,
+                                    GNUNET_GE_WARNING | GNUNET_GE_ADMIN |
+                                    GNUNET_GE_BULK, "recv");
+          break;
+        }
+      lm = (const LoopbackMessage *) recv_buf;
+      if ((ret <= sizeof (LoopbackMessage)) ||
+          (ntohs (lm->header.size) != ret))
+        {
+          GNUNET_GE_LOG (coreAPI->ectx,
+                         GNUNET_GE_WARNING | GNUNET_GE_USER | GNUNET_GE_BULK,
+                         _("Received malformed message via %s. Ignored.\n"),
+                         "LOOPBACK");
+          continue;
+        }
+      received += ret;
+      len = ret - sizeof (LoopbackMessage);
+      mp = GNUNET_malloc (sizeof (GNUNET_TransportPacket));
+      mp->msg = GNUNET_malloc (len);
+      memcpy (mp->msg, &lm[1], len);
+      mp->size = len;
+      mp->sender = lm->sender;
+      mp->tsession = NULL;
+      mp->msg_free = NULL;
+      deliver_at = GNUNET_ntohll (lm->deliver_at);
+      if ((pending_head == NULL) && (deliver_at <= GNUNET_get_time ()))
+        coreAPI->receive (mp);
+      else
+        queue_pending (mp, deliver_at);
+    }
+  if (received == 0)
+    return;
+  if (load_monitor != NULL)
+    GNUNET_network_monitor_notify_transmission (load_monitor,
+                                                GNUNET_ND_DOWNLOAD, received);
+  if (stats != NULL)
+    stats->change (stat_bytesReceived, received);
+}
+
+/**
+ * Main method of the I/O thread: receive datagrams and
+ * deliver them once their latency has passed.
+ */
+static void *
+loopback_io_thread (void *unused)
+{
+  fd_set readSet;
+  struct timeval timeout;
+  GNUNET_CronTime delay;
+  char buf[64];
+  int max;
+
+  delay = 0;
+  while (GNUNET_NO == io_shutdown)
+    {
+      FD_ZERO (&readSet);
+      FD_SET (io_signal_pipe[0], &readSet);
+      max = io_signal_pipe[0];
+      if (loopback_port != 0)
+        {
+          FD_SET (loopback_sock, &readSet);
+          if (loopback_sock > max)
+            max = loopback_sock;
+        }
+      timeout.tv_sec = delay / GNUNET_CRON_SECONDS;
+      timeout.tv_usec = (delay % GNUNET_CRON_SECONDS) * 1000;
+      if (-1 == SELECT (max + 1, &readSet, NULL, NULL,
+                        (delay == 0) ? NULL : &timeout))
+        {
+          if (errno == EINTR)
+            continue;
+          GNUNET_GE_LOG_STRERROR (coreAPI->ectx,
+                                  GNUNET_GE_ERROR | GNUNET_GE_ADMIN |
+                                  GNUNET_GE_BULK, "select");
+          break;
+        }
+      if (FD_ISSET (io_signal_pipe[0], &readSet))
+        while (0 < READ (io_signal_pipe[0], buf, sizeof (buf)))
+          ;
+      if ((loopback_port != 0) && (FD_ISSET (loopback_sock, &readSet)))
+        receive_datagrams ();
+      delay = deliver_pending ();
+    }
+  return NULL;
+}
+
+/**
+ * Establish a connection to a remote node.
+ *
+ * @param hello the hello-Message for the target node
+ * @param tsessionPtr the session handle that is to be set
+ * @return GNUNET_OK on success, GNUNET_SYSERR if the operation failed
+ */
+static int
+loopback_connect (const GNUNET_MessageHello * hello,
+                  GNUNET_TSession ** tsessionPtr, int may_reuse)
+{
+  GNUNET_TSession *tsession;
+
+  /* hellos loaded from the host database were not verified by us
+     (and may still use the address format without the path) */
+  if (GNUNET_OK != verify_hello (hello))
+    return GNUNET_SYSERR;
+  tsession = GNUNET_malloc (sizeof (GNUNET_TSession));
+  memset (tsession, 0, sizeof (GNUNET_TSession));
+  tsession->internal = GNUNET_malloc (GNUNET_sizeof_hello (hello));
+  memcpy (tsession->internal, hello, GNUNET_sizeof_hello (hello));
+  tsession->ttype = myAPI.protocol_number;
+  tsession->peer = hello->senderIdentity;
+  *tsessionPtr = tsession;
+  return GNUNET_OK;
+}
+
+/**
+ * Loopback sessions are not associated with core sessions
+ * (like UDP, every datagram stands on its own).
+ *
+ * @return GNUNET_SYSERR
+ */
+static int
+loopback_associate (GNUNET_TSession * tsession)
+{
+  return GNUNET_SYSERR;
+}
+
+/**
+ * Disconnect from a remote node.
+ *
+ * @param tsession the session that is closed
+ * @return GNUNET_OK on success, GNUNET_SYSERR if the operation failed
+ */
+static int
+loopback_disconnect (GNUNET_TSession * tsession)
+{
+  if (tsession != NULL)
+    {
+      GNUNET_free_non_null (tsession->internal);
+      GNUNET_free (tsession);
+    }
+  return GNUNET_OK;
+}
+
+/**
+ * Test if the transport would even try to send a message of
+ * the given size and importance for the given session.
+ * Unimportant messages are refused while the emulated uplink
+ * queue is full.
+ *
+ * @return GNUNET_YES if the transport would try,
+ *         GNUNET_NO if the transport would just drop the message,
+ *         GNUNET_SYSERR if the size/session is invalid
+ */
+static int
+loopback_test_would_try (GNUNET_TSession * tsession, unsigned int size,
+                         int important)
+{
+  int ret;
+
+  if ((size == 0) || (size > myAPI.mtu))
+    {
+      GNUNET_GE_BREAK (coreAPI->ectx, 0);
+      return GNUNET_SYSERR;
+    }
+  if (tsession->internal == NULL)
+    return GNUNET_SYSERR;
+  GNUNET_mutex_lock (send_lock);
+  if (loopback_sock == -1)
+    ret = GNUNET_SYSERR;
+  else if ((important != GNUNET_YES) &&
+           (get_backlog (GNUNET_get_time () * 1000LL) + size +
+            sizeof (LoopbackMessage) > queue_size))
+    ret = GNUNET_NO;
+  else
+    ret = GNUNET_YES;
+  GNUNET_mutex_unlock (send_lock);
+  return ret;
+}
+
+/**
+ * Send a message to the specified remote node.  Datagrams that
+ * do not fit into the emulated uplink queue, that the emulated
+ * link loses or that the receiver does not accept right now are
+ * dropped (as they would be by the network).
+ *
+ * @param tsession the GNUNET_MessageHello identifying the remote node
+ * @param message what to send
+ * @param size the size of the message
+ * @return GNUNET_SYSERR on error, GNUNET_OK on success
+ */
+static int
+loopback_send (GNUNET_TSession * tsession,
+               const void *message, const unsigned int size, int important)
+{
+  const GNUNET_MessageHello *hello;
+  const HostAddress *haddr;
+  struct sockaddr_un addr;
+  unsigned long long now;
+  unsigned int len;
+  ssize_t ret;
+
+  if ((size == 0) || (size > myAPI.mtu))
+    {
+      GNUNET_GE_BREAK (coreAPI->ectx, 0);
+      return GNUNET_SYSERR;
+    }
+  hello = (const GNUNET_MessageHello *) tsession->internal;
+  if (hello == NULL)
+    return GNUNET_SYSERR;
+  haddr = (const HostAddress *) &hello[1];
+  if (GNUNET_OK != make_address (&addr, (const char *) &haddr[1]))
+    return GNUNET_SYSERR;
+  len = size + sizeof (LoopbackMessage);
+  GNUNET_mutex_lock (send_lock);
+  if (loopback_sock == -1)
+    {
+      GNUNET_mutex_unlock (send_lock);
+      return GNUNET_SYSERR;
+    }
+  now = GNUNET_get_time () * 1000LL;
+  if (get_backlog (now) + len > queue_size)
+    {
+      GNUNET_mutex_unlock (send_lock);
+      if (stats != NULL)
+        stats->change (stat_bytesDropped, len);
+      return GNUNET_OK;
+    }
+  if (bandwidth > 0)
+    link_free += len * 1000000LL / bandwidth;
+  if ((loss > 0) &&
+      (GNUNET_random_u32 (GNUNET_RANDOM_QUALITY_WEAK, 1000) < loss))
+    {
+      GNUNET_mutex_unlock (send_lock);
+      if (stats != NULL)
+        stats->change (stat_bytesLost, len);
+      return GNUNET_OK;
+    }
+  send_buf->header.size = htons (len);
+  send_buf->header.type = htons (0);
+  send_buf->sender = *(coreAPI->my_identity);
+  send_buf->deliver_at = GNUNET_htonll (link_free / 1000LL + latency);
+  memcpy (&send_buf[1], message, size);
+  /* never wait here: we hold send_lock and the core may hold
+     its connection lock; if the socket of the receiver is full
+     the datagram is dropped (like by a full router queue) */
+  do
+    ret = SENDTO (loopback_sock,
+                  send_buf, len,
+                  MSG_DONTWAIT,
+                  (const struct sockaddr *) &addr,
+                  sizeof (struct sockaddr_un));
+  while ((ret == -1) && (errno == EINTR));
+  GNUNET_mutex_unlock (send_lock);
+  if (ret == -1)
+    {
+#if DEBUG_LOOPBACK
+      GNUNET_GE_LOG_STRERROR (coreAPI->ectx,
+                              GNUNET_GE_DEBUG | GNUNET_GE_DEVELOPER |
+                              GNUNET_GE_BULK, "sendto");
+#endif
+      if (stats != NULL)
+        stats->change (stat_bytesDropped, len);
+      return GNUNET_OK;
+    }
+  if (load_monitor != NULL)
+    GNUNET_network_monitor_notify_transmission (load_monitor,
+                                                GNUNET_ND_UPLOAD, len);
+  if (stats != NULL)
+    stats->change (stat_bytesSent, len);
+  return GNUNET_OK;
+}
+
+/**
+ * Start the server process to receive inbound traffic.
+ *
+ * @return GNUNET_OK on success, GNUNET_SYSERR if the operation failed
+ */
+static int
+loopback_transport_server_start ()
+{
+  struct sockaddr_un addr;
+  int sock;
+
+  GNUNET_GE_ASSERT (coreAPI->ectx, io_thread == NULL);
+  loopback_port = get_port ();
+  sock = SOCKET (PF_UNIX, SOCK_DGRAM, 0);
+  if (sock == -1)
+    {
+      GNUNET_GE_LOG_STRERROR (coreAPI->ectx,
+                              GNUNET_GE_ERROR | GNUNET_GE_ADMIN |
+                              GNUNET_GE_BULK, "socket");
+      return GNUNET_SYSERR;
+    }
+  if (loopback_port != 0)
+    {
+      socket_path = get_socket_path (loopback_port);
+      if ((socket_path == NULL) ||
+          (GNUNET_OK != make_address (&addr, socket_path)))
+        {
+          GNUNET_GE_LOG (coreAPI->ectx,
+                         GNUNET_GE_FATAL | GNUNET_GE_ADMIN |
+                         GNUNET_GE_IMMEDIATE,
+                         _("Path for the %s socket is too long.\n"),
+                         MY_TRANSPORT_NAME);
+          GNUNET_free_non_null (socket_path);
+          socket_path = NULL;
+          CLOSE (sock);
+          return GNUNET_SYSERR;
+        }
+      /* remove our own socket if we did not shut down cleanly */
+      UNLINK (socket_path);
+      if (BIND (sock,
+                (const struct sockaddr *) &addr,
+                sizeof (struct sockaddr_un)) < 0)
+        {
+          GNUNET_GE_LOG_STRERROR (coreAPI->ectx,
+                                  GNUNET_GE_FATAL | GNUNET_GE_ADMIN |
+                                  GNUNET_GE_IMMEDIATE, "bind");
+          GNUNET_GE_LOG (coreAPI->ectx,
+                         GNUNET_GE_FATAL | GNUNET_GE_ADMIN |
+                         GNUNET_GE_IMMEDIATE,
+                         _("Failed to bind to %s port %d.\n"),
+                         MY_TRANSPORT_NAME, loopback_port);
+          GNUNET_free (socket_path);
+          socket_path = NULL;
+          CLOSE (sock);
+          return GNUNET_SYSERR;
+        }
+    }
+  if ((0 != PIPE (io_signal_pipe)) ||
+      (GNUNET_OK !=
+       GNUNET_pipe_make_nonblocking (coreAPI->ectx, io_signal_pipe[0])) ||
+      (GNUNET_OK !=
+       GNUNET_pipe_make_nonblocking (coreAPI->ectx, io_signal_pipe[1])))
+    {
+      GNUNET_GE_LOG_STRERROR (coreAPI->ectx,
+                              GNUNET_GE_ERROR | GNUNET_GE_ADMIN |
+                              GNUNET_GE_IMMEDIATE, "pipe");
+      CLOSE (sock);
+      if (socket_path != NULL)
+        {
+          UNLINK (socket_path);
+          GNUNET_free (socket_path);
+          socket_path = NULL;
+        }
+      return GNUNET_SYSERR;
+    }
+  recv_buf = GNUNET_malloc (sizeof (LoopbackMessage) + myAPI.mtu);
+  io_shutdown = GNUNET_NO;
+  GNUNET_mutex_lock (send_lock);
+  send_buf = GNUNET_malloc (sizeof (LoopbackMessage) + myAPI.mtu);
+  link_free = 0;
+  loopback_sock = sock;
+  GNUNET_mutex_unlock (send_lock);
+  io_thread = GNUNET_thread_create (&loopback_io_thread, NULL, 64 * 1024);
+  if (io_thread == NULL)
+    {
+      GNUNET_GE_LOG_STRERROR (coreAPI->ectx,
+                              GNUNET_GE_ERROR | GNUNET_GE_ADMIN |
+                              GNUNET_GE_IMMEDIATE, "pthread_create");
+      GNUNET_mutex_lock (send_lock);
+      loopback_sock = -1;
+      GNUNET_free (send_buf);
+      send_buf = NULL;
+      GNUNET_mutex_unlock (send_lock);
+      CLOSE (sock);
+      if (socket_path != NULL)
+        {
+          UNLINK (socket_path);
+          GNUNET_free (socket_path);
+          socket_path = NULL;
+        }
+      CLOSE (io_signal_pipe[0]);
+      CLOSE (io_signal_pipe[1]);
+      GNUNET_free (recv_buf);
+      recv_buf = NULL;
+      return GNUNET_SYSERR;
+    }
+  return GNUNET_OK;
+}
+
+/**
+ * Shutdown the server process (stop receiving inbound traffic).
+ * Datagrams that are still waiting for their delivery time are
+ * dropped.  Maybe restarted later!
+ */
+static int
+loopback_transport_server_stop ()
+{
+  struct LoopbackPending *pos;
+  void *unused;
+
+  GNUNET_GE_ASSERT (coreAPI->ectx, loopback_sock != -1);
+  io_shutdown = GNUNET_YES;
+  signal_io_thread ();
+  GNUNET_thread_join (io_thread, &unused);
+  io_thread = NULL;
+  GNUNET_mutex_lock (send_lock);
+  if (0 != CLOSE (loopback_sock))
+    GNUNET_GE_LOG_STRERROR (coreAPI->ectx,
+                            GNUNET_GE_ERROR | GNUNET_GE_ADMIN |
+                            GNUNET_GE_BULK, "close");
+  loopback_sock = -1;
+  GNUNET_free (send_buf);
+  send_buf = NULL;
+  GNUNET_mutex_unlock (send_lock);
+  if (socket_path != NULL)
+    {
+      UNLINK (socket_path);
+      GNUNET_free (socket_path);
+      socket_path = NULL;
+    }
+  if ((0 != CLOSE (io_signal_pipe[0])) || (0 != CLOSE (io_signal_pipe[1])))
+    GNUNET_GE_LOG_STRERROR (coreAPI->ectx,
+                            GNUNET_GE_ERROR | GNUNET_GE_ADMIN |
+                            GNUNET_GE_BULK, "close");
+  while (NULL != (pos = pending_head))
+    {
+      pending_head = pos->next;
+      GNUNET_free (pos->mp->msg);
+      GNUNET_free (pos->mp);
+      GNUNET_free (pos);
+    }
+  pending_count = 0;
+  GNUNET_free (recv_buf);
+  recv_buf = NULL;
+  return GNUNET_OK;
+}
+
+/**
+ * The exported method. Makes the core api available via a global and
+ * returns the loopback transport API.
+ */
+GNUNET_TransportAPI *
+inittransport_loopback (GNUNET_CoreAPIForTransport * core)
+{
+  unsigned long long mtu;
+  unsigned long long lat;
+  unsigned long long lss;
+
+  coreAPI = core;
+  cfg = core->cfg;
+  load_monitor = core->load_monitor;
+  GNUNET_GE_ASSERT (coreAPI->ectx, sizeof (LoopbackMessage) == 76);
+  if ((-1 == GNUNET_GC_get_configuration_value_number (cfg,
+                                                       MY_TRANSPORT_NAME,
+                                                       "MTU",
+                                                       sizeof
+                                                       (LoopbackMessage) +
+                                                       GNUNET_P2P_MESSAGE_OVERHEAD
+                                                       +
+                                                       sizeof
+                                                       (GNUNET_MessageHeader)
+                                                       + 32, 65500,
+                                                       MESSAGE_SIZE, &mtu)) ||
+      (-1 == GNUNET_GC_get_configuration_value_number (cfg,
+                                                       MY_TRANSPORT_NAME,
+                                                       "LATENCY",
+                                                       0,
+                                                       60 * 60 * 1000,
+                                                       0, &lat)) ||
+      (-1 == GNUNET_GC_get_configuration_value_number (cfg,
+                                                       MY_TRANSPORT_NAME,
+                                                       "BANDWIDTH",
+                                                       0,
+                                                       (unsigned long long)
+                                                       -1, 0, &bandwidth)) ||
+      (-1 == GNUNET_GC_get_configuration_value_number (cfg,
+                                                       MY_TRANSPORT_NAME,
+                                                       "LOSS",
+                                                       0, 1000, 0, &lss)) ||
+      (-1 == GNUNET_GC_get_configuration_value_number (cfg,
+                                                       MY_TRANSPORT_NAME,
+                                                       "QUEUE",
+                                                       mtu,
+                                                       (unsigned long long)
+                                                       -1, 64 * 1024,
+                                                       &queue_size)))
+    return NULL;
+  latency = lat * GNUNET_CRON_MILLISECONDS;
+  loss = (unsigned int) lss;
+  send_lock = GNUNET_mutex_create (GNUNET_NO);
+  stats = coreAPI->service_request ("stats");
+  if (stats != NULL)
+    {
+      stat_bytesReceived
+        = stats->create (gettext_noop ("# bytes received via LOOPBACK"));
+      stat_bytesSent
+        = stats->create (gettext_noop ("# bytes sent via LOOPBACK"));
+      stat_bytesDropped
+        =
+        stats->create (gettext_noop ("# bytes dropped by LOOPBACK (queue)"));
+      stat_bytesLost =
+        stats->create (gettext_noop ("# bytes lost by LOOPBACK (emulated)"));
+    }
+  myAPI.protocol_number = GNUNET_TRANSPORT_PROTOCOL_NUMBER_LOOPBACK;
+  myAPI.mtu = mtu - sizeof (LoopbackMessage);
+  myAPI.cost = 100;
+  myAPI.hello_verify = &verify_hello;
+  myAPI.hello_create = &create_hello;
+  myAPI.connect = &loopback_connect;
+  myAPI.send = &loopback_send;
+  myAPI.associate = &loopback_associate;
+  myAPI.disconnect = &loopback_disconnect;
+  myAPI.server_start = &loopback_transport_server_start;
+  myAPI.server_stop = &loopback_transport_server_stop;
+  myAPI.hello_to_address = &hello_to_address;
+  myAPI.send_now_test = &loopback_test_would_try;
+  return &myAPI;
+}
+
+void
+donetransport_loopback ()
+{
+  if (stats != NULL)
+    {
+      coreAPI->service_release (stats);
+      stats = NULL;
+    }
+  GNUNET_mutex_destroy (send_lock);
+  send_lock = NULL;
+}
+
+/* end of loopback.c */
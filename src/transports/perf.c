@@ -0,0 +1,247 @@
+/*
+     This file is part of GNUnet.
+     (C) 2026 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 2, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+     Boston, MA 02111-1307, USA.
+*/
+
+/**
+ * @file transports/perf.c
+ * @brief Packets-per-second benchmark for the transports.
+ * @author Christian Grothoff
+ *
+ * The transport sends small messages to itself for a few
+ * seconds; we report how many messages per second were sent
+ * and received.  The test only fails if nothing arrives.
+ */
+
+#include "platform.h"
+#include "gnunet_util.h"
+#include "gnunet_directories.h"
+#include "gnunet_protocols.h"
+#include "gnunet_transport.h"
+#include "common.h"
+
+/**
+ * How long should we send?
+ */
+#define DURATION (2 * GNUNET_CRON_SECONDS)
+
+/**
+ * Size of the messages we send.
+ */
+#define MESSAGE_SIZE 128
+
+/**
+ * Name of the configuration file.
+ */
+static char *cfgFilename = "test.conf";
+
+/**
+ * How many messages did we receive so far?
+ */
+static unsigned int msg_count;
+
+/**
+ * How many bytes did we receive so far?
+ */
+static unsigned long long byte_count;
+
+static struct GNUNET_Mutex *lock;
+
+/**
+ * No options.
+ */
+static struct GNUNET_CommandLineOption testOptions[] = {
+  GNUNET_COMMAND_LINE_OPTION_END,
+};
+
+static void *
+request_service (const char *name)
+{
+  return NULL;
+}
+
+static int
+connection_assert_tsession_unused (GNUNET_TSession * tsession)
+{
+  return GNUNET_OK;
+}
+
+/**
+ * Free a packet that the transport passed to us.
+ */
+static void
+free_packet (GNUNET_TransportPacket * mp)
+{
+  if (mp->msg_free != NULL)
+    mp->msg_free (mp->msg);
+  else
+    GNUNET_free (mp->msg);
+  GNUNET_free (mp);
+}
+
+static void
+receive (GNUNET_TransportPacket * mp)
+{
+  GNUNET_mutex_lock (lock);
+  msg_count++;
+  byte_count += mp->size;
+  GNUNET_mutex_unlock (lock);
+  free_packet (mp);
+}
+
+int
+main (int argc, char *const *argv)
+{
+  GNUNET_CoreAPIForTransport api;
+  struct GNUNET_PluginHandle *plugin;
+  GNUNET_TransportMainMethod init;
+  GNUNET_TransportAPI *transport;
+  void (*done) ();
+  GNUNET_PeerIdentity me;
+  GNUNET_TSession *tsession;
+  GNUNET_MessageHello *hello;
+  GNUNET_CronTime start;
+  GNUNET_CronTime end;
+  char *trans;
+  char msg[MESSAGE_SIZE];
+  unsigned int sent;
+  unsigned int failed;
+  unsigned int received;
+  unsigned int i;
+  int res;
+
+  memset (&api, 0, sizeof (GNUNET_CoreAPIForTransport));
+  res = GNUNET_init (argc,
+                     argv,
+                     "transport-perf",
+                     &cfgFilename, testOptions, &api.ectx, &api.cfg);
+  if (res == -1)
+    {
+      GNUNET_fini (api.ectx, api.cfg);
+      return 1;
+    }
+  trans = strstr (argv[0], "_");
+  if (trans == NULL)
+    {
+      GNUNET_fini (api.ectx, api.cfg);
+      return 1;
+    }
+  trans = GNUNET_strdup (trans + 1);
+  if (NULL != strstr (trans, "."))
+    strstr (trans, ".")[0] = '\0';
+  /* disable blacklists (loopback is often blacklisted)... */
+  GNUNET_GC_set_configuration_value_string (api.cfg, api.ectx, "UDP",
+                                            "BLACKLISTV4", "");
+  GNUNET_GC_set_configuration_value_string (api.cfg, api.ectx, "UDP",
+                                            "BLACKLISTV6", "");
+  GNUNET_GC_set_configuration_value_string (api.cfg, api.ectx, "UDP", "UPNP",
+                                            "NO");
+  GNUNET_GC_set_configuration_value_number (api.cfg, api.ectx, "UDP", "PORT",
+                                            4450);
+  GNUNET_GC_set_configuration_value_number (api.cfg, api.ectx, "LOOPBACK",
+                                            "PORT", 4451);
+  GNUNET_create_random_hash (&me.hashPubKey);
+  plugin = GNUNET_plugin_load (api.ectx, "libgnunettransport_", trans);
+  GNUNET_free (trans);
+  if (plugin == NULL)
+    {
+      fprintf (stderr, "Error loading plugin...\n");
+      GNUNET_fini (api.ectx, api.cfg);
+      return 1;
+    }
+  init =
+    GNUNET_plugin_resolve_function (plugin, "inittransport_", GNUNET_YES);
+  if (init == NULL)
+    {
+      GNUNET_plugin_unload (plugin);
+      GNUNET_fini (api.ectx, api.cfg);
+      return 1;
+    }
+  lock = GNUNET_mutex_create (GNUNET_NO);
+  api.cron = GNUNET_cron_create (api.ectx);
+  api.my_identity = &me;
+  api.receive = &receive;
+  api.service_request = &request_service;
+  api.service_release = NULL;   /* not needed */
+  api.tsession_assert_unused = &connection_assert_tsession_unused;
+  GNUNET_cron_start (api.cron);
+  res = 0;
+  transport = init (&api);
+  if ((transport == NULL) || (GNUNET_OK != transport->server_start ()))
+    {
+      fprintf (stderr, "Error initializing plugin...\n");
+      res = 1;
+      goto cleanup;
+    }
+  hello = transport->hello_create ();
+  if ((hello == NULL) ||
+      (GNUNET_OK != transport->connect (hello, &tsession, GNUNET_NO)))
+    {
+      GNUNET_free_non_null (hello);
+      transport->server_stop ();
+      res = 1;
+      goto cleanup;
+    }
+  GNUNET_free (hello);
+  for (i = 0; i < MESSAGE_SIZE; i++)
+    msg[i] = 'A' + (i % 26);
+  sent = 0;
+  failed = 0;
+  start = GNUNET_get_time ();
+  end = start + DURATION;
+  while (GNUNET_get_time () < end)
+    {
+      for (i = 0; i < 256; i++)
+        {
+          if (GNUNET_OK ==
+              transport->send (tsession, msg, MESSAGE_SIZE, GNUNET_NO))
+            sent++;
+          else
+            failed++;
+        }
+      /* let the receiver keep up */
+      GNUNET_thread_sleep (GNUNET_CRON_MILLISECONDS);
+    }
+  end = GNUNET_get_time ();
+  GNUNET_thread_sleep (100 * GNUNET_CRON_MILLISECONDS);
+  transport->disconnect (tsession);
+  transport->server_stop ();
+  GNUNET_mutex_lock (lock);
+  received = msg_count;
+  GNUNET_mutex_unlock (lock);
+  printf ("sent:     %10llu messages/s (%u failed)\n",
+          sent * 1000ULL / (end - start + 1), failed);
+  printf ("received: %10llu messages/s (%llu kB/s, %u%% of sent)\n",
+          received * 1000ULL / (end - start + 1),
+          byte_count / (end - start + 1),
+          (sent == 0) ? 0 : (unsigned int) (received * 100ULL / sent));
+  if (received == 0)
+    res = 1;
+cleanup:
+  done = GNUNET_plugin_resolve_function (plugin, "donetransport_", GNUNET_NO);
+  if ((transport != NULL) && (done != NULL))
+    done ();
+  GNUNET_plugin_unload (plugin);
+  GNUNET_cron_stop (api.cron);
+  GNUNET_cron_destroy (api.cron);
+  GNUNET_mutex_destroy (lock);
+  GNUNET_fini (api.ectx, api.cfg);
+  return res;
+}
+
+/* end of perf.c */
@@ -383,6 +383,7 @@ listenAndDistribute (void *unused)
           coreMP->size = size - sizeof (SMTPMessage);
           coreMP->tsession = NULL;
           coreMP->sender = mp->sender;
+          coreMP->msg_free = NULL;
 #if DEBUG_SMTP
           GNUNET_GE_LOG (ectx,
                          GNUNET_GE_DEBUG | GNUNET_GE_REQUEST | GNUNET_GE_USER,
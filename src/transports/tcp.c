@@ -334,6 +334,7 @@ select_message_handler (void *mh_cls,
       mp->sender = tcpSession->sender;
       mp->size = len - sizeof (GNUNET_MessageHeader);
       mp->tsession = tsession;
+      mp->msg_free = NULL;
       coreAPI->receive (mp);
     }
   tcp_disconnect (tsession);
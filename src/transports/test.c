@@ -96,6 +96,40 @@ connection_assert_tsession_unused (GNUNET_TSession * tsession)
   return GNUNET_OK;
 }
 
+/**
+ * Free a packet that the transport passed to us.
+ */
+static void
+free_packet (GNUNET_TransportPacket * mp)
+{
+  if (mp->msg_free != NULL)
+    mp->msg_free (mp->msg);
+  else
+    GNUNET_free (mp->msg);
+  GNUNET_free (mp);
+}
+
+/**
+ * Change the port in a hello that we created for ourselves (the
+ * loopback transport also names its socket after the port, so the
+ * socket path that follows the address is changed as well).
+ */
+static void
+change_port (GNUNET_MessageHello * hello, int delta)
+{
+  HostAddress *haddr;
+  char *name;
+
+  haddr = (HostAddress *) & hello[1];
+  haddr->port = htons (ntohs (haddr->port) + delta);
+  if (ntohs (hello->senderAddressSize) <= sizeof (HostAddress))
+    return;
+  name = strrchr ((char *) &haddr[1], '-');
+  if (name != NULL)
+    GNUNET_snprintf (&name[1], strlen (&name[1]) + 1,
+                     "%u", ntohs (haddr->port));
+}
+
 /**
  * We received a message.  The "client" should try to echo it back,
  * the "server" should validate that it got the right reply.
@@ -116,13 +150,11 @@ receive (GNUNET_TransportPacket * mp)
         {
           hello = transport->hello_create ();
           /* HACK hello -- change port! */
-          ((HostAddress *) & hello[1])->port =
-            htons (ntohs (((HostAddress *) & hello[1])->port) - OFFSET);
+          change_port (hello, -OFFSET);
           if (GNUNET_OK != transport->connect (hello, &tsession, GNUNET_NO))
             {
               GNUNET_free (hello);
-              GNUNET_free (mp->msg);
-              GNUNET_free (mp);
+              free_packet (mp);
               error_count++;
               return;
             }
@@ -157,8 +189,53 @@ receive (GNUNET_TransportPacket * mp)
       else
         msg_count++;
     }
-  GNUNET_free (mp->msg);
-  GNUNET_free (mp);
+  free_packet (mp);
+}
+
+/**
+ * Test path MTU discovery: the loopback interface carries
+ * datagrams that are larger than the default MTU, so the
+ * MTU of the session should grow and messages of that
+ * size should get through.
+ */
+static int
+testPathMTU (GNUNET_TSession * tsession)
+{
+  unsigned int mtu;
+  unsigned int count;
+  int pos;
+
+  pos = 0;
+  while ((pos++ < 100) && (transport->mtu_get_session (tsession) <=
+                           transport->mtu))
+    {
+      transport->send (tsession, expectedValue, expectedSize, GNUNET_NO);
+      GNUNET_thread_sleep (50 * GNUNET_CRON_MILLISECONDS);
+    }
+  mtu = transport->mtu_get_session (tsession);
+  if (mtu <= transport->mtu)
+    {
+      fprintf (stderr, "Path MTU discovery failed (MTU: %u)\n", mtu);
+      return GNUNET_SYSERR;
+    }
+  /* let the echos of the probing phase arrive */
+  GNUNET_thread_sleep (500 * GNUNET_CRON_MILLISECONDS);
+  GNUNET_free (expectedValue);
+  expectedSize = mtu;
+  expectedValue = GNUNET_malloc (expectedSize);
+  for (pos = 0; pos < expectedSize; pos++)
+    expectedValue[pos] = 'A' + (pos % 26);
+  count = msg_count;
+  transport->send (tsession, expectedValue, expectedSize, GNUNET_YES);
+  pos = 0;
+  while ((pos++ < 100) && (msg_count == count))
+    GNUNET_thread_sleep (50 * GNUNET_CRON_MILLISECONDS);
+  if (msg_count == count)
+    {
+      fprintf (stderr, "Message of %u bytes was not received\n", mtu);
+      return GNUNET_SYSERR;
+    }
+  return GNUNET_OK;
 }
 
 int
@@ -228,6 +305,8 @@ main (int argc, char *const *argv)
                                             4446 + pos);
   GNUNET_GC_set_configuration_value_number (api.cfg, api.ectx, "HTTP", "PORT",
                                             4448 + pos);
+  GNUNET_GC_set_configuration_value_number (api.cfg, api.ectx, "LOOPBACK",
+                                            "PORT", 4449 + pos);
   GNUNET_create_random_hash (&me.hashPubKey);
   plugin = GNUNET_plugin_load (api.ectx, "libgnunettransport_", trans);
   GNUNET_free (trans);
@@ -273,8 +352,7 @@ main (int argc, char *const *argv)
       /* client - initiate requests */
       hello = transport->hello_create ();
       /* HACK hello -- change port! */
-      ((HostAddress *) & hello[1])->port =
-        htons (ntohs (((HostAddress *) & hello[1])->port) + OFFSET);
+      change_port (hello, OFFSET);
       if (GNUNET_OK != transport->connect (hello, &tsession, GNUNET_NO))
         {
           GNUNET_free (hello);
@@ -311,6 +389,9 @@ main (int argc, char *const *argv)
                      "WARNING: only %u/%u messages received (maybe ok, try again?)\n",
                      msg_count, ROUNDS);
         }
+      else if ((transport->mtu_get_session != NULL) &&
+               (GNUNET_OK != testPathMTU (tsession)))
+        res = GNUNET_SYSERR;
       transport->disconnect (tsession);
     }
 
@@ -98,6 +98,40 @@ connection_assert_tsession_unused (GNUNET_TSession * tsession)
   return GNUNET_OK;
 }
 
+/**
+ * Free a packet that the transport passed to us.
+ */
+static void
+free_packet (GNUNET_TransportPacket * mp)
+{
+  if (mp->msg_free != NULL)
+    mp->msg_free (mp->msg);
+  else
+    GNUNET_free (mp->msg);
+  GNUNET_free (mp);
+}
+
+/**
+ * Change the port in a hello that we created for ourselves (the
+ * loopback transport also names its socket after the port, so the
+ * socket path that follows the address is changed as well).
+ */
+static void
+change_port (GNUNET_MessageHello * hello, int delta)
+{
+  HostAddress *haddr;
+  char *name;
+
+  haddr = (HostAddress *) & hello[1];
+  haddr->port = htons (ntohs (haddr->port) + delta);
+  if (ntohs (hello->senderAddressSize) <= sizeof (HostAddress))
+    return;
+  name = strrchr ((char *) &haddr[1], '-');
+  if (name != NULL)
+    GNUNET_snprintf (&name[1], strlen (&name[1]) + 1,
+                     "%u", ntohs (haddr->port));
+}
+
 /**
  * We received a message.  The "client" should try to echo it back,
  * the "server" should validate that it got the right reply.
@@ -118,13 +152,11 @@ receive (GNUNET_TransportPacket * mp)
         {
           hello = transport->hello_create ();
           /* HACK hello -- change port! */
-          ((HostAddress *) & hello[1])->port =
-            htons (ntohs (((HostAddress *) & hello[1])->port) - OFFSET);
+          change_port (hello, -OFFSET);
           if (GNUNET_OK != transport->connect (hello, &tsession, GNUNET_NO))
             {
               GNUNET_free (hello);
-              GNUNET_free (mp->msg);
-              GNUNET_free (mp);
+              free_packet (mp);
               error_count++;
               return;
             }
@@ -159,8 +191,7 @@ receive (GNUNET_TransportPacket * mp)
       else
         msg_count++;
     }
-  GNUNET_free (mp->msg);
-  GNUNET_free (mp);
+  free_packet (mp);
 }
 
 int
@@ -235,6 +266,8 @@ main (int argc, char *const *argv)
                                             4447 + pos);
   GNUNET_GC_set_configuration_value_number (api.cfg, api.ectx, "HTTP", "PORT",
                                             4448 + pos);
+  GNUNET_GC_set_configuration_value_number (api.cfg, api.ectx, "LOOPBACK",
+                                            "PORT", 4449 + pos);
   GNUNET_create_random_hash (&me.hashPubKey);
   plugin = GNUNET_plugin_load (api.ectx, "libgnunettransport_", trans);
   GNUNET_free (trans);
@@ -283,8 +316,7 @@ main (int argc, char *const *argv)
           /* client - initiate requests */
           hello = transport->hello_create ();
           /* HACK hello -- change port! */
-          ((HostAddress *) & hello[1])->port =
-            htons (ntohs (((HostAddress *) & hello[1])->port) + OFFSET);
+          change_port (hello, OFFSET);
           if (GNUNET_OK != transport->connect (hello, &tsession, GNUNET_NO))
             {
               GNUNET_free (hello);
@@ -57,9 +57,199 @@ typedef struct
 
 } UDPMessage;
 
+/**
+ * Types of UDP datagrams (in the header of the UDPMessage).
+ * Peers that do not know about MTU probes pass probes
+ * to the core, which discards them.
+ */
+#define UDP_TYPE_DATA 0
+
+#define UDP_TYPE_PROBE 1
+
+#define UDP_TYPE_PROBE_ACK 2
+
+/**
+ * Body of an MTU probe (followed by padding up to the probed
+ * size) and of the acknowledgement for a probe.
+ */
+typedef struct
+{
+  /**
+   * Peer that the probe is for (the path MTU information of
+   * the sender is kept per peer).
+   */
+  GNUNET_PeerIdentity target;
+
+  /**
+   * Payload size (excluding the UDPMessage) that is probed.
+   */
+  unsigned int size;
+
+  /**
+   * Random nonce, copied into the acknowledgement.
+   */
+  unsigned int nonce;
+
+  /**
+   * Always zero (acknowledgements go to the address and port that
+   * the probe came from, never to a port named in the probe).
+   */
+  unsigned int reserved;
+
+} UDPProbe;
+
 #define MY_TRANSPORT_NAME "UDP"
 #include "common.c"
 
+/**
+ * How many datagrams do we receive with one system call?
+ */
+#define UDP_BATCH_SIZE 32
+
+/**
+ * How many outbound datagrams can be queued for the I/O thread?
+ */
+#define UDP_SEND_QUEUE_SIZE 64
+
+/**
+ * Largest UDP datagram that we are willing to receive.
+ */
+#define UDP_MAX_DATAGRAM 65536
+
+/**
+ * How many batches does the I/O thread receive before
+ * it checks the send queue again?
+ */
+#define UDP_MAX_BATCHES 4
+
+/**
+ * How many payload buffers that the core gave back do we
+ * keep for receiving further datagrams?
+ */
+#define UDP_POOL_SIZE 256
+
+/**
+ * How long do we wait for the acknowledgement of an MTU probe?
+ */
+#define UDP_PROBE_TIMEOUT (5 * GNUNET_CRON_SECONDS)
+
+/**
+ * How often may a probe get lost before we give up on
+ * probing the peer for a while?
+ */
+#define UDP_PROBE_MAX_LOST 3
+
+/**
+ * How long do we wait before probing a peer again after
+ * probing failed?
+ */
+#define UDP_PROBE_BACKOFF (15 * GNUNET_CRON_MINUTES)
+
+/**
+ * For how many peers do we keep path MTU information?
+ */
+#define UDP_MAX_PATHS 1024
+
+/**
+ * Datagram sizes (including the UDPMessage) that we try when
+ * probing the path MTU: IPv6 minimum, PPPoE, Ethernet, jumbo
+ * frames.  Larger datagrams would be fragmented by IP on any
+ * real link.
+ */
+static const unsigned int probe_sizes[] = {
+  1232, 1452, 1472, 4052, 8972, 0
+};
+
+/**
+ * Buffers for receiving one datagram.  The UDPMessage header is
+ * received into "header", the payload directly into "payload"
+ * (a buffer from the pool), which is handed to the core as it
+ * is.  Payloads that are larger than our own MTU spill over into
+ * "overflow".  Without recvmsg, the datagram is received into
+ * recv_buffer and copied into these buffers.
+ */
+struct UDPReceiveSlot
+{
+  UDPMessage header;
+
+  struct sockaddr_in6 addr;
+
+  socklen_t addrlen;
+
+#ifndef MINGW
+  struct iovec iov[3];
+
+  struct msghdr msg;
+#endif
+
+  char *payload;
+
+  char *overflow;
+
+  /**
+   * Size of the datagram that was received.
+   */
+  unsigned int len;
+
+  /**
+   * Was the datagram larger than our buffers?
+   */
+  int truncated;
+};
+
+/**
+ * Datagram waiting in the send queue.
+ */
+struct UDPSendSlot
+{
+  struct sockaddr_in6 addr;
+
+  socklen_t addrlen;
+
+  /**
+   * The datagram (of max_mtu + sizeof(UDPMessage) bytes).
+   */
+  UDPMessage *msg;
+};
+
+/**
+ * What we know about the path MTU to a peer.
+ */
+struct UDPPath
+{
+  /**
+   * Largest payload (excluding the UDPMessage) that we
+   * send to the peer.
+   */
+  unsigned int mtu;
+
+  /**
+   * Payload size of the probe in flight (0 for none).
+   */
+  unsigned int probe;
+
+  /**
+   * Nonce of the probe in flight.
+   */
+  unsigned int nonce;
+
+  /**
+   * If a probe is in flight, when was it sent?  Otherwise,
+   * when may we send the next probe?
+   */
+  GNUNET_CronTime probe_time;
+
+  /**
+   * How many probes of this size were not acknowledged?
+   */
+  unsigned int lost;
+
+  /**
+   * Did the peer acknowledge a probe of "mtu" bytes?
+   */
+  int confirmed;
+};
+
 /* *********** globals ************* */
 
 static int stat_bytesReceived;
@@ -71,79 +261,782 @@ static int stat_bytesDropped;
 static int stat_udpConnected;
 
 /**
- * thread that listens for inbound messages
+ * thread that receives inbound messages and sends
+ * queued outbound messages
+ */
+static struct GNUNET_ThreadHandle *io_thread;
+
+/**
+ * Pipe used to wake up the I/O thread.
  */
-static struct GNUNET_SelectHandle *selector;
+static int io_signal_pipe[2];
 
 /**
- * the socket that we transmit all data with
+ * Should the I/O thread terminate?
  */
-static struct GNUNET_SocketHandle *udp_sock;
+static int io_shutdown;
+
+/**
+ * the socket that we receive inbound messages with (or -1)
+ */
+static int udp_listen_sock = -1;
+
+/**
+ * the socket that we transmit all data with (or -1)
+ */
+static int udp_sock = -1;
 
 static struct GNUNET_LoadMonitor *load_monitor;
 
+/**
+ * Buffers for receiving a batch of datagrams (only
+ * used by the I/O thread).
+ */
+static struct UDPReceiveSlot *recv_slots;
+
+/**
+ * Memory for the overflow buffers of all receive slots.
+ * Pages are only touched if a peer sends datagrams larger
+ * than our MTU.
+ */
+static char *recv_overflow;
+
+#ifdef MINGW
+/**
+ * Buffer for receiving a complete datagram (no recvmsg).
+ */
+static char *recv_buffer;
+#endif
+
+/**
+ * Payload buffers (of myAPI.mtu bytes) that the core gave
+ * back and that we use for receiving further datagrams.
+ */
+static char *buffer_pool[UDP_POOL_SIZE];
+
+/**
+ * Number of buffers in buffer_pool.
+ */
+static unsigned int buffer_pool_size;
+
+/**
+ * Lock for buffer_pool (the core gives buffers back from
+ * its own threads).
+ */
+static struct GNUNET_Mutex *pool_lock;
+
+/**
+ * Queue of datagrams waiting to be sent.
+ */
+static struct UDPSendSlot send_queue[UDP_SEND_QUEUE_SIZE];
+
+/**
+ * Number of datagrams in the send queue.
+ */
+static unsigned int send_queue_size;
+
+/**
+ * Lock for the send queue, udp_sock, probe_sock and paths.
+ */
+static struct GNUNET_Mutex *send_lock;
+
+/**
+ * Socket with the don't-fragment bit set that we send MTU probes
+ * with (or -1 if we do not probe).
+ */
+static int probe_sock = -1;
+
+/**
+ * Buffer for building MTU probes.
+ */
+static UDPMessage *probe_buf;
+
+/**
+ * Path MTU information (struct UDPPath) for each peer.
+ */
+static struct GNUNET_MultiHashMap *paths;
+
+/**
+ * Largest payload that we send in one datagram.
+ */
+static unsigned int max_mtu;
+
+
+/**
+ * Wake up the I/O thread.
+ */
+static void
+signal_io_thread ()
+{
+  static char i = '\0';
+
+  if ((-1 == WRITE (io_signal_pipe[1], &i, sizeof (char))) &&
+      (errno != EAGAIN) && (errno != EWOULDBLOCK))
+    GNUNET_GE_LOG_STRERROR (coreAPI->ectx,
+                            GNUNET_GE_ERROR | GNUNET_GE_ADMIN |
+                            GNUNET_GE_BULK, "write");
+}
+
+/**
+ * Free a path (helper for free_paths).
+ */
+static int
+free_path (const GNUNET_HashCode * key, void *value, void *cls)
+{
+  GNUNET_free (value);
+  return GNUNET_OK;
+}
+
+/**
+ * Forget everything we know about the path MTUs.
+ *
+ * This function may only be called if the send_lock is
+ * already held by the caller.
+ */
+static void
+free_paths ()
+{
+  if (paths == NULL)
+    return;
+  GNUNET_multi_hash_map_iterate (paths, &free_path, NULL);
+  GNUNET_multi_hash_map_destroy (paths);
+  paths = NULL;
+}
 
 /**
- * The socket of session has data waiting, process!
+ * Get the path MTU information for a peer.
  *
- * This function may only be called if the tcplock is
+ * This function may only be called if the send_lock is
  * already held by the caller.
+ *
+ * @param create create the entry if it does not exist yet
+ * @return NULL if we have no information about the peer
  */
-static int
-select_message_handler (void *mh_cls,
-                        struct GNUNET_SelectHandle *sh,
-                        struct GNUNET_SocketHandle *sock,
-                        void *sock_ctx, const GNUNET_MessageHeader * msg)
+static struct UDPPath *
+get_path (const GNUNET_PeerIdentity * peer, int create)
+{
+  struct UDPPath *path;
+
+  if (paths != NULL)
+    {
+      path = GNUNET_multi_hash_map_get (paths, &peer->hashPubKey);
+      if (path != NULL)
+        return path;
+    }
+  if ((create == GNUNET_NO) || (probe_sock == -1))
+    return NULL;
+  if ((paths != NULL) &&
+      (GNUNET_multi_hash_map_size (paths) >= UDP_MAX_PATHS))
+    free_paths ();              /* rare; just start over */
+  if (paths == NULL)
+    paths = GNUNET_multi_hash_map_create (128);
+  path = GNUNET_malloc (sizeof (struct UDPPath));
+  memset (path, 0, sizeof (struct UDPPath));
+  path->mtu = myAPI.mtu;
+  path->probe_time = GNUNET_get_time ();
+  GNUNET_multi_hash_map_put (paths,
+                             &peer->hashPubKey,
+                             path, GNUNET_MultiHashMapOption_UNIQUE_FAST);
+  return path;
+}
+
+/**
+ * Find the next larger payload size to probe.
+ *
+ * @return 0 if there is none
+ */
+static unsigned int
+probe_size_above (unsigned int mtu)
+{
+  unsigned int i;
+  unsigned int size;
+
+  for (i = 0; probe_sizes[i] != 0; i++)
+    {
+      size = probe_sizes[i] - sizeof (UDPMessage);
+      if (size > max_mtu)
+        break;
+      if (size > mtu)
+        return size;
+    }
+  return 0;
+}
+
+/**
+ * Find the next smaller payload size to probe.
+ *
+ * @return 0 if there is none
+ */
+static unsigned int
+probe_size_below (unsigned int mtu)
+{
+  unsigned int i;
+  unsigned int ret;
+
+  ret = 0;
+  for (i = 0; probe_sizes[i] != 0; i++)
+    {
+      if (probe_sizes[i] - sizeof (UDPMessage) >= mtu)
+        break;
+      ret = probe_sizes[i] - sizeof (UDPMessage);
+    }
+  return ret;
+}
+
+/**
+ * Send an MTU probe to the given peer if it is time to do so.
+ * We first confirm that the peer receives datagrams of the
+ * current MTU and then try the next larger size.  Probes are
+ * sent with the don't-fragment bit set; if the OS already knows
+ * that the path can not carry a probe, we lower the MTU.
+ *
+ * This function may only be called if the send_lock is
+ * already held by the caller.
+ */
+static void
+send_probe (struct UDPPath *path,
+            const GNUNET_PeerIdentity * peer,
+            const struct sockaddr_in6 *addr, socklen_t addrlen)
+{
+  GNUNET_CronTime now;
+  UDPProbe *probe;
+  unsigned int size;
+
+  now = GNUNET_get_time ();
+  if (path->probe != 0)
+    {
+      if (now < path->probe_time + UDP_PROBE_TIMEOUT)
+        return;                 /* still waiting for the ack */
+      path->probe = 0;
+      path->probe_time = now;
+      if (++path->lost >= UDP_PROBE_MAX_LOST)
+        {
+          path->lost = 0;
+          path->probe_time = now + UDP_PROBE_BACKOFF;
+        }
+    }
+  if (now < path->probe_time)
+    return;
+  if (path->confirmed == GNUNET_YES)
+    size = probe_size_above (path->mtu);
+  else
+    size = path->mtu;
+  if (size == 0)
+    {
+      path->probe_time = now + UDP_PROBE_BACKOFF;
+      return;
+    }
+  probe_buf->header.size = htons (size + sizeof (UDPMessage));
+  probe_buf->header.type = htons (UDP_TYPE_PROBE);
+  probe_buf->sender = *(coreAPI->my_identity);
+  probe = (UDPProbe *) & probe_buf[1];
+  path->nonce = GNUNET_random_u32 (GNUNET_RANDOM_QUALITY_WEAK, 0xFFFFFFFF);
+  probe->target = *peer;
+  probe->size = htonl (size);
+  probe->nonce = htonl (path->nonce);
+  probe->reserved = 0;
+  probe->reserved = 0;
+  if (-1 != SENDTO (probe_sock,
+                    probe_buf,
+                    size + sizeof (UDPMessage),
+                    MSG_DONTWAIT, (const struct sockaddr *) addr, addrlen))
+    {
+      path->probe = size;
+      path->probe_time = now;
+      return;
+    }
+  if (errno != EMSGSIZE)
+    return;                     /* try again with the next message */
+  if (size > path->mtu)
+    {
+      /* the path can not carry the next size */
+      path->probe_time = now + UDP_PROBE_BACKOFF;
+      return;
+    }
+  /* the path can not even carry what we are sending now */
+  size = probe_size_below (size);
+  if (size != 0)
+    path->mtu = size;
+  else
+    path->probe_time = now + UDP_PROBE_BACKOFF;
+}
+
+/**
+ * Handle the acknowledgement for one of our probes.
+ */
+static void
+handle_probe_ack (const UDPProbe * probe)
 {
+  struct UDPPath *path;
+
+  GNUNET_mutex_lock (send_lock);
+  path = get_path (&probe->target, GNUNET_NO);
+  if ((path != NULL) &&
+      (path->probe != 0) &&
+      (path->probe == ntohl (probe->size)) &&
+      (path->nonce == ntohl (probe->nonce)))
+    {
+#if DEBUG_UDP
+      if (path->probe != path->mtu)
+        GNUNET_GE_LOG (coreAPI->ectx,
+                       GNUNET_GE_DEBUG | GNUNET_GE_DEVELOPER |
+                       GNUNET_GE_BULK,
+                       "Path MTU to peer is at least %u bytes.\n",
+                       path->probe);
+#endif
+      path->mtu = path->probe;
+      path->confirmed = GNUNET_YES;
+      path->probe = 0;
+      path->lost = 0;
+      path->probe_time = GNUNET_get_time ();
+    }
+  GNUNET_mutex_unlock (send_lock);
+}
+
+/**
+ * Handle an MTU probe or the acknowledgement for one of our
+ * probes (called by the I/O thread).
+ */
+static void
+handle_probe (struct UDPReceiveSlot *slot)
+{
+  struct
+  {
+    UDPMessage header;
+    UDPProbe probe;
+  } ack;
+  UDPProbe *probe;
   unsigned int len;
-  GNUNET_TransportPacket *mp;
-  const UDPMessage *um;
 
-  len = ntohs (msg->size);
-  if (len <= sizeof (UDPMessage))
+  len = slot->len - sizeof (UDPMessage);
+  if (len < sizeof (UDPProbe))
+    return;
+  probe = (UDPProbe *) slot->payload;
+  switch (ntohs (slot->header.header.type))
     {
-      GNUNET_GE_LOG (coreAPI->ectx,
-                     GNUNET_GE_WARNING | GNUNET_GE_USER | GNUNET_GE_BULK,
-                     _("Received malformed message via %s. Ignored.\n"),
-                     "UDP");
-      return GNUNET_SYSERR;
+    case UDP_TYPE_PROBE:
+      if (ntohl (probe->size) != len)
+        return;
+      /* acknowledge only to where the probe came from; the ack is
+         much smaller than the probe, so a spoofed probe can not be
+         used to direct more traffic at a third party than was sent */
+      ack.header.header.size = htons (sizeof (ack));
+      ack.header.header.type = htons (UDP_TYPE_PROBE_ACK);
+      ack.header.sender = *(coreAPI->my_identity);
+      ack.probe = *probe;
+      ack.probe.reserved = 0;
+      SENDTO (udp_sock,
+              &ack,
+              sizeof (ack),
+              MSG_DONTWAIT,
+              (const struct sockaddr *) &slot->addr, slot->addrlen);
+      break;
+    case UDP_TYPE_PROBE_ACK:
+      handle_probe_ack (probe);
+      break;
+    default:
+      break;
+    }
+}
+
+/**
+ * Get a buffer for receiving the payload of a datagram.
+ *
+ * @return buffer of myAPI.mtu bytes
+ */
+static char *
+pool_get ()
+{
+  char *buf;
+
+  GNUNET_mutex_lock (pool_lock);
+  if (buffer_pool_size > 0)
+    buf = buffer_pool[--buffer_pool_size];
+  else
+    buf = NULL;
+  GNUNET_mutex_unlock (pool_lock);
+  if (buf == NULL)
+    buf = GNUNET_malloc (myAPI.mtu);
+  return buf;
+}
+
+/**
+ * Give a payload buffer back to the pool (called by the core
+ * once it has processed the message, see GNUNET_TransportPacket).
+ */
+static void
+pool_release (char *buf)
+{
+  GNUNET_mutex_lock (pool_lock);
+  if (buffer_pool_size < UDP_POOL_SIZE)
+    {
+      buffer_pool[buffer_pool_size++] = buf;
+      buf = NULL;
     }
-  um = (const UDPMessage *) msg;
-  mp = GNUNET_malloc (sizeof (GNUNET_TransportPacket));
-  mp->msg = GNUNET_malloc (len - sizeof (UDPMessage));
-  memcpy (mp->msg, &um[1], len - sizeof (UDPMessage));
-  mp->sender = um->sender;
-  mp->size = len - sizeof (UDPMessage);
-  mp->tsession = NULL;
-  coreAPI->receive (mp);
+  GNUNET_mutex_unlock (pool_lock);
+  GNUNET_free_non_null (buf);
+}
+
+/**
+ * Send all datagrams in the send queue.  Datagrams that the
+ * OS does not accept right now are dropped (as they would
+ * be by the network).
+ *
+ * This function may only be called if the send_lock is
+ * already held by the caller.
+ */
+static void
+flush_send_queue ()
+{
+  struct UDPSendSlot *slot;
+  unsigned long long sent;
+  unsigned long long dropped;
+  unsigned int off;
+  int ret;
+#if HAVE_SENDMMSG
+  struct mmsghdr msgs[UDP_SEND_QUEUE_SIZE];
+  struct iovec iov[UDP_SEND_QUEUE_SIZE];
+  unsigned int i;
+#endif
+
+  if (send_queue_size == 0)
+    return;
+  sent = 0;
+  dropped = 0;
+#if HAVE_SENDMMSG
+  memset (msgs, 0, sizeof (struct mmsghdr) * send_queue_size);
+  for (i = 0; i < send_queue_size; i++)
+    {
+      slot = &send_queue[i];
+      iov[i].iov_base = slot->msg;
+      iov[i].iov_len = ntohs (slot->msg->header.size);
+      msgs[i].msg_hdr.msg_name = &slot->addr;
+      msgs[i].msg_hdr.msg_namelen = slot->addrlen;
+      msgs[i].msg_hdr.msg_iov = &iov[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+  off = 0;
+  while (off < send_queue_size)
+    {
+      ret = sendmmsg (udp_sock,
+                      &msgs[off], send_queue_size - off,
+                      MSG_DONTWAIT);
+      if (ret > 0)
+        {
+          for (i = off; i < off + ret; i++)
+            sent += msgs[i].msg_len;
+          off += ret;
+          continue;
+        }
+      if ((ret == -1) && (errno == EINTR))
+        continue;
+      if ((ret == -1) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+        break;
+      /* the first datagram could not be sent (i.e. to a bad
+         address); skip it and try the others */
+      dropped += iov[off].iov_len;
+      off++;
+    }
+#else
+  for (off = 0; off < send_queue_size; off++)
+    {
+      slot = &send_queue[off];
+      ret = SENDTO (udp_sock,
+                    slot->msg,
+                    ntohs (slot->msg->header.size),
+                    MSG_DONTWAIT,
+                    (const struct sockaddr *) &slot->addr, slot->addrlen);
+      if ((ret == -1) && (errno == EINTR))
+        {
+          off--;
+          continue;
+        }
+      if (ret == -1)
+        {
+          if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            break;
+          dropped += ntohs (slot->msg->header.size);
+          continue;
+        }
+      sent += ret;
+    }
+#endif
+  for (; off < send_queue_size; off++)
+    dropped += ntohs (send_queue[off].msg->header.size);
+  send_queue_size = 0;
+  if ((sent > 0) && (load_monitor != NULL))
+    GNUNET_network_monitor_notify_transmission (load_monitor,
+                                                GNUNET_ND_UPLOAD, sent);
   if (stats != NULL)
-    stats->change (stat_bytesReceived, len);
-  return GNUNET_OK;
+    {
+      if (sent > 0)
+        stats->change (stat_bytesSent, sent);
+      if (dropped > 0)
+        stats->change (stat_bytesDropped, dropped);
+    }
 }
 
-static void *
-select_accept_handler (void *ah_cls,
-                       struct GNUNET_SelectHandle *sh,
-                       struct GNUNET_SocketHandle *sock,
-                       const void *addr, unsigned int addr_len)
+/**
+ * Receive a batch of datagrams from the listen socket and pass
+ * them to the core.
+ *
+ * @return number of datagrams received
+ */
+static unsigned int
+receive_batch ()
 {
-  static int nonnullpointer;
+  struct UDPReceiveSlot *slot;
+  GNUNET_TransportPacket *mp;
+  unsigned long long received;
+  unsigned long long accepted;
+  unsigned int count;
+  unsigned int len;
+  unsigned int i;
+#if HAVE_RECVMMSG
+  struct mmsghdr msgs[UDP_BATCH_SIZE];
+  int ret;
+#else
+  ssize_t ret;
+#endif
 
-  if (GNUNET_NO != is_rejected_tester (addr, addr_len))
-    return NULL;
-  return &nonnullpointer;
+  for (i = 0; i < UDP_BATCH_SIZE; i++)
+    {
+      slot = &recv_slots[i];
+      if (slot->payload == NULL)
+        {
+          slot->payload = pool_get ();
+#ifndef MINGW
+          slot->iov[1].iov_base = slot->payload;
+#endif
+        }
+#ifndef MINGW
+      slot->msg.msg_namelen = sizeof (struct sockaddr_in6);
+      slot->msg.msg_flags = 0;
+#endif
+    }
+#if HAVE_RECVMMSG
+  for (i = 0; i < UDP_BATCH_SIZE; i++)
+    {
+      msgs[i].msg_hdr = recv_slots[i].msg;
+      msgs[i].msg_len = 0;
+    }
+  ret = recvmmsg (udp_listen_sock, msgs, UDP_BATCH_SIZE, MSG_DONTWAIT,
+                  NULL);
+  if (ret == -1)
+    {
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+        GNUNET_GE_LOG_STRERROR (coreAPI->ectx,
+                                GNUNET_GE_WARNING | GNUNET_GE_ADMIN |
+                                GNUNET_GE_BULK, "recvmmsg");
+      return 0;
+    }
+  count = ret;
+  for (i = 0; i < count; i++)
+    {
+      slot = &recv_slots[i];
+      slot->addrlen = msgs[i].msg_hdr.msg_namelen;
+      slot->truncated = (0 != (msgs[i].msg_hdr.msg_flags & MSG_TRUNC));
+      slot->len = msgs[i].msg_len;
+    }
+#elif !defined(MINGW)
+  for (count = 0; count < UDP_BATCH_SIZE; count++)
+    {
+      slot = &recv_slots[count];
+      ret = recvmsg (udp_listen_sock, &slot->msg, MSG_DONTWAIT);
+      if (ret == -1)
+        {
+          if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+            GNUNET_GE_LOG_STRERROR (coreAPI->ectx,
+                                    GNUNET_GE_WARNING | GNUNET_GE_ADMIN |
+                                    GNUNET_GE_BULK, "recvmsg");
+          break;
+        }
+      slot->addrlen = slot->msg.msg_namelen;
+      slot->truncated = (0 != (slot->msg.msg_flags & MSG_TRUNC));
+      slot->len = ret;
+    }
+#else
+  for (count = 0; count < UDP_BATCH_SIZE; count++)
+    {
+      slot = &recv_slots[count];
+      slot->addrlen = sizeof (struct sockaddr_in6);
+      ret = RECVFROM (udp_listen_sock,
+                      recv_buffer,
+                      UDP_MAX_DATAGRAM,
+                      MSG_DONTWAIT,
+                      (struct sockaddr *) &slot->addr, &slot->addrlen);
+      if (ret == -1)
+        {
+          if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+            GNUNET_GE_LOG_STRERROR (coreAPI->ectx,
+                                    GNUNET_GE_WARNING | GNUNET_GE_ADMIN |
+                                    GNUNET_GE_BULK, "recvfrom");
+          break;
+        }
+      slot->truncated = GNUNET_NO;
+      slot->len = ret;
+      len = ret;
+      if (len > sizeof (UDPMessage))
+        {
+          memcpy (&slot->header, recv_buffer, sizeof (UDPMessage));
+          len -= sizeof (UDPMessage);
+          memcpy (slot->payload,
+                  &recv_buffer[sizeof (UDPMessage)],
+                  (len < myAPI.mtu) ? len : myAPI.mtu);
+          if (len > myAPI.mtu)
+            memcpy (slot->overflow,
+                    &recv_buffer[sizeof (UDPMessage) + myAPI.mtu],
+                    len - myAPI.mtu);
+        }
+    }
+#endif
+  received = 0;
+  accepted = 0;
+  for (i = 0; i < count; i++)
+    {
+      slot = &recv_slots[i];
+      len = slot->len;
+      received += len;
+      if ((slot->truncated) ||
+          (len <= sizeof (UDPMessage)) ||
+          (ntohs (slot->header.header.size) != len))
+        {
+          /* empty datagrams are silently ignored */
+          if (len > 0)
+            GNUNET_GE_LOG (coreAPI->ectx,
+                           GNUNET_GE_WARNING | GNUNET_GE_USER |
+                           GNUNET_GE_BULK,
+                           _("Received malformed message via %s. Ignored.\n"),
+                           "UDP");
+          continue;
+        }
+      if (GNUNET_NO != is_rejected_tester (&slot->addr, slot->addrlen))
+        continue;
+      if (ntohs (slot->header.header.type) != UDP_TYPE_DATA)
+        {
+          handle_probe (slot);
+          continue;
+        }
+      accepted += len;
+      len -= sizeof (UDPMessage);
+      mp = GNUNET_malloc (sizeof (GNUNET_TransportPacket));
+      if (len <= myAPI.mtu)
+        {
+          mp->msg = slot->payload;
+          mp->msg_free = &pool_release;
+          slot->payload = NULL;
+        }
+      else
+        {
+          mp->msg = GNUNET_malloc (len);
+          mp->msg_free = NULL;
+          memcpy (mp->msg, slot->payload, myAPI.mtu);
+          memcpy (&mp->msg[myAPI.mtu], slot->overflow, len - myAPI.mtu);
+        }
+      mp->sender = slot->header.sender;
+      mp->size = len;
+      mp->tsession = NULL;
+      coreAPI->receive (mp);
+    }
+  if ((received > 0) && (load_monitor != NULL))
+    GNUNET_network_monitor_notify_transmission (load_monitor,
+                                                GNUNET_ND_DOWNLOAD,
+                                                received);
+  if ((stats != NULL) && (accepted > 0))
+    stats->change (stat_bytesReceived, accepted);
+  return count;
 }
 
 /**
- * Select has been forced to close a connection.
- * Free the associated context.
+ * Receive the acknowledgements for our MTU probes (they are
+ * sent back to probe_sock, the socket that sent the probes).
  */
 static void
-select_close_handler (void *ch_cls,
-                      struct GNUNET_SelectHandle *sh,
-                      struct GNUNET_SocketHandle *sock, void *sock_ctx)
+receive_probe_acks ()
 {
-  /* do nothing */
+  struct
+  {
+    UDPMessage header;
+    UDPProbe probe;
+  } ack;
+  struct sockaddr_in6 addr;
+  socklen_t addrlen;
+  int ret;
+
+  while (1)
+    {
+      addrlen = sizeof (addr);
+      ret = RECVFROM (probe_sock,
+                      (char *) &ack,
+                      sizeof (ack),
+                      MSG_DONTWAIT, (struct sockaddr *) &addr, &addrlen);
+      if (ret < 0)
+        break;
+      if ((ret != sizeof (ack)) ||
+          (ntohs (ack.header.header.size) != sizeof (ack)) ||
+          (ntohs (ack.header.header.type) != UDP_TYPE_PROBE_ACK))
+        continue;
+      handle_probe_ack (&ack.probe);
+    }
+}
+
+/**
+ * Main method of the I/O thread: receive inbound datagrams
+ * in batches and send the datagrams in the send queue.
+ */
+static void *
+udp_io_thread (void *unused)
+{
+  fd_set readSet;
+  char buf[64];
+  unsigned int batches;
+  int max;
+
+  while (GNUNET_NO == io_shutdown)
+    {
+      FD_ZERO (&readSet);
+      FD_SET (io_signal_pipe[0], &readSet);
+      max = io_signal_pipe[0];
+      if (udp_listen_sock != -1)
+        {
+          FD_SET (udp_listen_sock, &readSet);
+          if (udp_listen_sock > max)
+            max = udp_listen_sock;
+        }
+      if (probe_sock != -1)
+        {
+          FD_SET (probe_sock, &readSet);
+          if (probe_sock > max)
+            max = probe_sock;
+        }
+      if (-1 == SELECT (max + 1, &readSet, NULL, NULL, NULL))
+        {
+          if (errno == EINTR)
+            continue;
+          GNUNET_GE_LOG_STRERROR (coreAPI->ectx,
+                                  GNUNET_GE_ERROR | GNUNET_GE_ADMIN |
+                                  GNUNET_GE_BULK, "select");
+          break;
+        }
+      if (FD_ISSET (io_signal_pipe[0], &readSet))
+        {
+          while (0 < READ (io_signal_pipe[0], buf, sizeof (buf)))
+            ;
+          GNUNET_mutex_lock (send_lock);
+          flush_send_queue ();
+          GNUNET_mutex_unlock (send_lock);
+        }
+      if ((udp_listen_sock != -1) && (FD_ISSET (udp_listen_sock, &readSet)))
+        {
+          batches = 0;
+          while ((UDP_BATCH_SIZE == receive_batch ()) &&
+                 (++batches < UDP_MAX_BATCHES))
+            ;
+        }
+      if ((probe_sock != -1) && (FD_ISSET (probe_sock, &readSet)))
+        receive_probe_acks ();
+    }
+  return NULL;
 }
 
 /**
@@ -215,14 +1108,52 @@ udp_disconnect (GNUNET_TSession * tsession)
 static int
 udp_transport_server_stop ()
 {
-  GNUNET_GE_ASSERT (coreAPI->ectx, udp_sock != NULL);
-  if (selector != NULL)
-    {
-      GNUNET_select_destroy (selector);
-      selector = NULL;
-    }
-  GNUNET_socket_destroy (udp_sock);
-  udp_sock = NULL;
+  void *unused;
+  unsigned int i;
+
+  GNUNET_GE_ASSERT (coreAPI->ectx, udp_sock != -1);
+  io_shutdown = GNUNET_YES;
+  signal_io_thread ();
+  GNUNET_thread_join (io_thread, &unused);
+  io_thread = NULL;
+  GNUNET_mutex_lock (send_lock);
+  flush_send_queue ();
+  if (0 != CLOSE (udp_sock))
+    GNUNET_GE_LOG_STRERROR (coreAPI->ectx,
+                            GNUNET_GE_ERROR | GNUNET_GE_ADMIN |
+                            GNUNET_GE_BULK, "close");
+  udp_sock = -1;
+  if ((probe_sock != -1) && (0 != CLOSE (probe_sock)))
+    GNUNET_GE_LOG_STRERROR (coreAPI->ectx,
+                            GNUNET_GE_ERROR | GNUNET_GE_ADMIN |
+                            GNUNET_GE_BULK, "close");
+  probe_sock = -1;
+  GNUNET_free_non_null (probe_buf);
+  probe_buf = NULL;
+  free_paths ();
+  GNUNET_mutex_unlock (send_lock);
+  if ((udp_listen_sock != -1) && (0 != CLOSE (udp_listen_sock)))
+    GNUNET_GE_LOG_STRERROR (coreAPI->ectx,
+                            GNUNET_GE_ERROR | GNUNET_GE_ADMIN |
+                            GNUNET_GE_BULK, "close");
+  udp_listen_sock = -1;
+  if ((0 != CLOSE (io_signal_pipe[0])) || (0 != CLOSE (io_signal_pipe[1])))
+    GNUNET_GE_LOG_STRERROR (coreAPI->ectx,
+                            GNUNET_GE_ERROR | GNUNET_GE_ADMIN |
+                            GNUNET_GE_BULK, "close");
+  for (i = 0; i < UDP_BATCH_SIZE; i++)
+    if (recv_slots[i].payload != NULL)
+      pool_release (recv_slots[i].payload);
+  GNUNET_free (recv_slots);
+  recv_slots = NULL;
+  GNUNET_free (recv_overflow);
+  recv_overflow = NULL;
+#ifdef MINGW
+  GNUNET_free (recv_buffer);
+  recv_buffer = NULL;
+#endif
+  GNUNET_free (send_queue[0].msg);
+  memset (send_queue, 0, sizeof (send_queue));
   return GNUNET_OK;
 }
 
@@ -245,14 +1176,14 @@ udp_test_would_try (GNUNET_TSession * tsession, unsigned int size,
 {
   const GNUNET_MessageHello *hello;
 
-  if (udp_sock == NULL)
+  if (udp_sock == -1)
     return GNUNET_SYSERR;
   if (size == 0)
     {
       GNUNET_GE_BREAK (coreAPI->ectx, 0);
       return GNUNET_SYSERR;
     }
-  if (size > myAPI.mtu)
+  if (size > max_mtu)
     {
       GNUNET_GE_BREAK (coreAPI->ectx, 0);
       return GNUNET_SYSERR;
@@ -263,6 +1194,23 @@ udp_test_would_try (GNUNET_TSession * tsession, unsigned int size,
   return GNUNET_YES;
 }
 
+/**
+ * Get the MTU for the given session (as determined by
+ * path MTU discovery).
+ */
+static unsigned int
+udp_mtu_get_session (GNUNET_TSession * tsession)
+{
+  struct UDPPath *path;
+  unsigned int mtu;
+
+  GNUNET_mutex_lock (send_lock);
+  path = get_path (&tsession->peer, GNUNET_NO);
+  mtu = (path != NULL) ? path->mtu : myAPI.mtu;
+  GNUNET_mutex_unlock (send_lock);
+  return mtu;
+}
+
 /**
  * Create a UDP socket.  If possible, use IPv6, otherwise
  * try IPv4.  Update available_protocols accordingly.
@@ -307,6 +1255,50 @@ udp_create_socket ()
   return s;
 }
 
+/**
+ * Create the socket for MTU probes (a UDP socket that sets
+ * the don't-fragment bit).
+ *
+ * @return -1 if the OS does not support this
+ */
+static int
+udp_create_probe_socket ()
+{
+#if defined(IP_MTU_DISCOVER) && defined(IP_PMTUDISC_DO)
+  int sock;
+  int val;
+
+  sock = udp_create_socket ();
+  if (sock == -1)
+    return -1;
+  val = IP_PMTUDISC_DO;
+  if (0 != SETSOCKOPT (sock, IPPROTO_IP, IP_MTU_DISCOVER, &val, sizeof (val)))
+    {
+      GNUNET_GE_LOG_STRERROR (coreAPI->ectx,
+                              GNUNET_GE_WARNING | GNUNET_GE_ADMIN |
+                              GNUNET_GE_BULK, "setsockopt");
+      CLOSE (sock);
+      return -1;
+    }
+#if defined(IPV6_MTU_DISCOVER) && defined(IPV6_PMTUDISC_DO)
+  val = IPV6_PMTUDISC_DO;
+  if ((0 != (available_protocols & VERSION_AVAILABLE_IPV6)) &&
+      (0 != SETSOCKOPT (sock, IPPROTO_IPV6, IPV6_MTU_DISCOVER, &val,
+                        sizeof (val))))
+    {
+      GNUNET_GE_LOG_STRERROR (coreAPI->ectx,
+                              GNUNET_GE_WARNING | GNUNET_GE_ADMIN |
+                              GNUNET_GE_BULK, "setsockopt");
+      CLOSE (sock);
+      return -1;
+    }
+#endif
+  return sock;
+#else
+  return -1;
+#endif
+}
+
 /**
  * Send a message to the specified remote node.
  *
@@ -321,25 +1313,21 @@ udp_send (GNUNET_TSession * tsession,
 {
   const GNUNET_MessageHello *hello;
   const HostAddress *haddr;
-  UDPMessage *mp;
-  struct sockaddr_in serverAddrv4;
-  struct sockaddr_in6 serverAddrv6;
-  struct sockaddr *serverAddr;
-  socklen_t addrlen;
+  struct UDPSendSlot *slot;
+  struct sockaddr_in *serverAddrv4;
+  struct sockaddr_in6 *serverAddrv6;
+  struct UDPPath *path;
   unsigned short available;
-  int ok;
-  int ssize;
-  size_t sent;
 
   GNUNET_GE_ASSERT (NULL, tsession != NULL);
-  if (udp_sock == NULL)
+  if (udp_sock == -1)
     return GNUNET_SYSERR;
   if (size == 0)
     {
       GNUNET_GE_BREAK (coreAPI->ectx, 0);
       return GNUNET_SYSERR;
     }
-  if (size > myAPI.mtu)
+  if (size > max_mtu)
     {
       GNUNET_GE_BREAK (coreAPI->ectx, 0);
       return GNUNET_SYSERR;
@@ -359,57 +1347,46 @@ udp_send (GNUNET_TSession * tsession,
       else
         available = VERSION_AVAILABLE_IPV6;
     }
-  ssize = size + sizeof (UDPMessage);
-  mp = GNUNET_malloc (ssize);
-  mp->header.size = htons (ssize);
-  mp->header.type = 0;
-  mp->sender = *(coreAPI->my_identity);
-  memcpy (&mp[1], message, size);
-  ok = GNUNET_SYSERR;
-
-  if ((available & VERSION_AVAILABLE_IPV4) > 0)
+  GNUNET_mutex_lock (send_lock);
+  if (udp_sock == -1)
     {
-      memset (&serverAddrv4, 0, sizeof (serverAddrv4));
-      serverAddrv4.sin_family = AF_INET;
-      serverAddrv4.sin_port = haddr->port;
-      memcpy (&serverAddrv4.sin_addr, &haddr->ipv4, sizeof (struct in_addr));
-      addrlen = sizeof (serverAddrv4);
-      serverAddr = (struct sockaddr *) &serverAddrv4;
+      GNUNET_mutex_unlock (send_lock);
+      return GNUNET_SYSERR;
     }
-  else
+  if (send_queue_size == UDP_SEND_QUEUE_SIZE)
+    flush_send_queue ();
+  slot = &send_queue[send_queue_size++];
+  memset (&slot->addr, 0, sizeof (slot->addr));
+  if ((available & VERSION_AVAILABLE_IPV4) > 0)
     {
-      memset (&serverAddrv6, 0, sizeof (serverAddrv6));
-      serverAddrv6.sin6_family = AF_INET;
-      serverAddrv6.sin6_port = haddr->port;
-      memcpy (&serverAddrv6.sin6_addr, &haddr->ipv6,
-              sizeof (struct in6_addr));
-      addrlen = sizeof (serverAddrv6);
-      serverAddr = (struct sockaddr *) &serverAddrv6;
-    }
-#ifndef MINGW
-  if (GNUNET_YES == GNUNET_socket_send_to (udp_sock,
-                                           GNUNET_NC_NONBLOCKING,
-                                           mp,
-                                           ssize, &sent,
-                                           (const char *) serverAddr,
-                                           addrlen))
-#else
-  sent =
-    win_ols_sendto (udp_sock, mp, ssize, (const char *) serverAddr, addrlen);
-  if (sent != SOCKET_ERROR)
-#endif
-    {
-      ok = GNUNET_OK;
-      if (stats != NULL)
-        stats->change (stat_bytesSent, sent);
+      serverAddrv4 = (struct sockaddr_in *) &slot->addr;
+      serverAddrv4->sin_family = AF_INET;
+      serverAddrv4->sin_port = haddr->port;
+      memcpy (&serverAddrv4->sin_addr, &haddr->ipv4, sizeof (struct in_addr));
+      slot->addrlen = sizeof (struct sockaddr_in);
     }
   else
     {
-      if (stats != NULL)
-        stats->change (stat_bytesDropped, ssize);
+      serverAddrv6 = &slot->addr;
+      serverAddrv6->sin6_family = AF_INET6;
+      serverAddrv6->sin6_port = haddr->port;
+      memcpy (&serverAddrv6->sin6_addr, &haddr->ipv6,
+              sizeof (struct in6_addr));
+      slot->addrlen = sizeof (struct sockaddr_in6);
     }
-  GNUNET_free (mp);
-  return ok;
+  slot->msg->header.size = htons (size + sizeof (UDPMessage));
+  slot->msg->header.type = htons (UDP_TYPE_DATA);
+  slot->msg->sender = *(coreAPI->my_identity);
+  memcpy (&slot->msg[1], message, size);
+  path = get_path (&tsession->peer, GNUNET_YES);
+  if (path != NULL)
+    send_probe (path, &tsession->peer, &slot->addr, slot->addrlen);
+  /* the I/O thread sends everything that is queued
+     by the time it wakes up with a single system call */
+  if (send_queue_size == 1)
+    signal_io_thread ();
+  GNUNET_mutex_unlock (send_lock);
+  return GNUNET_OK;
 }
 
 /**
@@ -427,8 +1404,12 @@ udp_transport_server_start ()
   int sock;
   const int on = 1;
   unsigned short port;
+  unsigned int overflow;
+  unsigned int i;
+  struct UDPReceiveSlot *slot;
+  char *buf;
 
-  GNUNET_GE_ASSERT (coreAPI->ectx, selector == NULL);
+  GNUNET_GE_ASSERT (coreAPI->ectx, io_thread == NULL);
   /* initialize UDP network */
   port = get_port ();
   if (port != 0)
@@ -478,16 +1459,7 @@ udp_transport_server_start ()
                                     "close");
           return GNUNET_SYSERR;
         }
-      selector = GNUNET_select_create ("udp", GNUNET_YES, coreAPI->ectx, load_monitor, sock, addrlen, 0,        /* timeout */
-                                       &select_message_handler,
-                                       NULL,
-                                       &select_accept_handler,
-                                       NULL,
-                                       &select_close_handler,
-                                       NULL, 64 * 1024,
-                                       16 /* max sockets */ );
-      if (selector == NULL)
-        return GNUNET_SYSERR;
+      udp_listen_sock = sock;
     }
   sock = udp_create_socket ();
   if (sock == -1)
@@ -495,12 +1467,109 @@ udp_transport_server_start ()
       GNUNET_GE_LOG_STRERROR (coreAPI->ectx,
                               GNUNET_GE_ERROR | GNUNET_GE_ADMIN |
                               GNUNET_GE_BULK, "socket");
-      GNUNET_select_destroy (selector);
-      selector = NULL;
+      if (udp_listen_sock != -1)
+        CLOSE (udp_listen_sock);
+      udp_listen_sock = -1;
+      return GNUNET_SYSERR;
+    }
+  if ((0 != PIPE (io_signal_pipe)) ||
+      (GNUNET_OK !=
+       GNUNET_pipe_make_nonblocking (coreAPI->ectx, io_signal_pipe[0])) ||
+      (GNUNET_OK !=
+       GNUNET_pipe_make_nonblocking (coreAPI->ectx, io_signal_pipe[1])))
+    {
+      GNUNET_GE_LOG_STRERROR (coreAPI->ectx,
+                              GNUNET_GE_ERROR | GNUNET_GE_ADMIN |
+                              GNUNET_GE_IMMEDIATE, "pipe");
+      CLOSE (sock);
+      if (udp_listen_sock != -1)
+        CLOSE (udp_listen_sock);
+      udp_listen_sock = -1;
+      return GNUNET_SYSERR;
+    }
+  /* receive buffers: header, payload (up to our MTU), overflow */
+  overflow = UDP_MAX_DATAGRAM - sizeof (UDPMessage) - myAPI.mtu;
+  recv_slots = GNUNET_malloc (UDP_BATCH_SIZE *
+                              sizeof (struct UDPReceiveSlot));
+  memset (recv_slots, 0, UDP_BATCH_SIZE * sizeof (struct UDPReceiveSlot));
+  recv_overflow = GNUNET_malloc (UDP_BATCH_SIZE * overflow);
+  for (i = 0; i < UDP_BATCH_SIZE; i++)
+    {
+      slot = &recv_slots[i];
+      slot->overflow = &recv_overflow[i * overflow];
+#ifndef MINGW
+      slot->iov[0].iov_base = &slot->header;
+      slot->iov[0].iov_len = sizeof (UDPMessage);
+      slot->iov[1].iov_len = myAPI.mtu;
+      slot->iov[2].iov_base = slot->overflow;
+      slot->iov[2].iov_len = overflow;
+      slot->msg.msg_name = &slot->addr;
+      slot->msg.msg_iov = slot->iov;
+      slot->msg.msg_iovlen = 3;
+#endif
+    }
+#ifdef MINGW
+  recv_buffer = GNUNET_malloc (UDP_MAX_DATAGRAM);
+#endif
+  /* path MTU discovery: probes are acknowledged to probe_sock */
+  max_mtu = myAPI.mtu;
+  if ((udp_listen_sock != -1) &&
+      (GNUNET_YES ==
+       GNUNET_GC_get_configuration_value_yesno (cfg, "UDP", "MTU-DISCOVERY",
+                                                GNUNET_YES)))
+    {
+      probe_sock = udp_create_probe_socket ();
+      if (probe_sock != -1)
+        {
+          for (i = 0; probe_sizes[i] != 0; i++)
+            if (probe_sizes[i] - sizeof (UDPMessage) > max_mtu)
+              max_mtu = probe_sizes[i] - sizeof (UDPMessage);
+          probe_buf = GNUNET_malloc (sizeof (UDPMessage) + max_mtu);
+          memset (probe_buf, 0, sizeof (UDPMessage) + max_mtu);
+        }
+    }
+  /* send queue: one buffer per slot, allocated in one block */
+  buf = GNUNET_malloc (UDP_SEND_QUEUE_SIZE * (sizeof (UDPMessage) + max_mtu));
+  for (i = 0; i < UDP_SEND_QUEUE_SIZE; i++)
+    send_queue[i].msg =
+      (UDPMessage *) & buf[i * (sizeof (UDPMessage) + max_mtu)];
+  send_queue_size = 0;
+  io_shutdown = GNUNET_NO;
+  GNUNET_mutex_lock (send_lock);
+  udp_sock = sock;
+  GNUNET_mutex_unlock (send_lock);
+  io_thread = GNUNET_thread_create (&udp_io_thread, NULL, 256 * 1024);
+  if (io_thread == NULL)
+    {
+      GNUNET_GE_LOG_STRERROR (coreAPI->ectx,
+                              GNUNET_GE_ERROR | GNUNET_GE_ADMIN |
+                              GNUNET_GE_IMMEDIATE, "pthread_create");
+      GNUNET_mutex_lock (send_lock);
+      udp_sock = -1;
+      if (probe_sock != -1)
+        CLOSE (probe_sock);
+      probe_sock = -1;
+      GNUNET_free_non_null (probe_buf);
+      probe_buf = NULL;
+      GNUNET_mutex_unlock (send_lock);
+      CLOSE (sock);
+      if (udp_listen_sock != -1)
+        CLOSE (udp_listen_sock);
+      udp_listen_sock = -1;
+      CLOSE (io_signal_pipe[0]);
+      CLOSE (io_signal_pipe[1]);
+      GNUNET_free (recv_slots);
+      recv_slots = NULL;
+      GNUNET_free (recv_overflow);
+      recv_overflow = NULL;
+#ifdef MINGW
+      GNUNET_free (recv_buffer);
+      recv_buffer = NULL;
+#endif
+      GNUNET_free (buf);
+      memset (send_queue, 0, sizeof (send_queue));
       return GNUNET_SYSERR;
     }
-  udp_sock = GNUNET_socket_create (coreAPI->ectx, load_monitor, sock);
-  GNUNET_GE_ASSERT (coreAPI->ectx, udp_sock != NULL);
   return GNUNET_OK;
 }
 
@@ -517,6 +1586,7 @@ inittransport_udp (GNUNET_CoreAPIForTransport * core)
   load_monitor = core->load_monitor;
   GNUNET_GE_ASSERT (coreAPI->ectx, sizeof (UDPMessage) == 68);
   GNUNET_GE_ASSERT (coreAPI->ectx, sizeof (HostAddress) == 24);
+  GNUNET_GE_ASSERT (coreAPI->ectx, sizeof (UDPProbe) == 76);
   coreAPI = core;
   if (-1 == GNUNET_GC_get_configuration_value_number (cfg,
                                                       "UDP",
@@ -544,6 +1614,9 @@ inittransport_udp (GNUNET_CoreAPIForTransport * core)
       lock = NULL;
       return NULL;
     }
+  send_lock = GNUNET_mutex_create (GNUNET_NO);
+  pool_lock = GNUNET_mutex_create (GNUNET_NO);
+  buffer_pool_size = 0;
   if (GNUNET_GC_get_configuration_value_yesno (cfg, "UDP", "UPNP", GNUNET_YES)
       == GNUNET_YES)
     {
@@ -579,6 +1652,7 @@ inittransport_udp (GNUNET_CoreAPIForTransport * core)
   myAPI.server_stop = &udp_transport_server_stop;
   myAPI.hello_to_address = &hello_to_address;
   myAPI.send_now_test = &udp_test_would_try;
+  myAPI.mtu_get_session = &udp_mtu_get_session;
 
   return &myAPI;
 }
@@ -587,6 +1661,12 @@ void
 donetransport_udp ()
 {
   do_shutdown ();
+  GNUNET_mutex_destroy (send_lock);
+  send_lock = NULL;
+  while (buffer_pool_size > 0)
+    GNUNET_free (buffer_pool[--buffer_pool_size]);
+  GNUNET_mutex_destroy (pool_lock);
+  pool_lock = NULL;
 }
 
 /* end of udp.c */
@@ -35,6 +35,28 @@
  * a 4 bit counter in the file on the drive (we still use only one
  * bit in memory).
  *
+ * The counter file is mapped into memory (MAP_SHARED), so adding or
+ * removing an element only touches memory instead of doing a seek,
+ * read, seek and write for every bit.  Crash consistency is the same
+ * as with the write-through code it replaces: every counter update
+ * is in the page cache as soon as it is made, so a crash of the
+ * process loses nothing; only a crash of the operating system can
+ * lose counter updates that were not yet written back.  The kernel
+ * writes dirty pages back periodically and we flush the mapping
+ * (msync) when the filter is freed, cleared or resized.  If mapping
+ * the file fails (for example, too little address space), we fall
+ * back to accessing the counters with individual reads and writes.
+ *
+ * Blocked filters place all bits of an element into a single 64 byte
+ * block (one cache line), so adding or testing an element touches
+ * one cache line instead of k; the bit positions within the block
+ * are taken from the hash of the element, so no additional hashing
+ * is needed for k up to BLOCK_ADDRESSES.  The price is a slightly
+ * higher false positive rate for the same size.  Since the bit
+ * positions differ from those of regular filters, blocked filters
+ * must only be used where both sides agree on the layout (i.e. not
+ * for filters that are exchanged with other peers).
+ *
  * @author Igor Wronsky
  * @author Christian Grothoff
  */
@@ -71,6 +93,17 @@ typedef struct GNUNET_BloomFilter
    */
   int fd;
 
+  /**
+   * The bit counter file mapped into memory, NULL if
+   * we have no file or mapping it failed.
+   */
+  unsigned char *counters;
+
+  /**
+   * Size of the mapped counter file in bytes.
+   */
+  size_t countersSize;
+
   /**
    * How many bits we set for each stored element
    */
@@ -81,6 +114,11 @@ typedef struct GNUNET_BloomFilter
    */
   unsigned int bitArraySize;
 
+  /**
+   * GNUNET_YES if all bits of an element are in one block.
+   */
+  int blocked;
+
 } Bloomfilter;
 
 
@@ -141,17 +179,64 @@ testBit (char *bitArray, unsigned int bitIdx)
     return GNUNET_NO;
 }
 
+/**
+ * Read one byte (two 4 bit counters) of the counter file.
+ *
+ * @param bf the filter
+ * @param fileSlot offset of the byte in the counter file
+ * @return the byte, 0 if it is not yet in the file
+ */
+static unsigned char
+readCounters (Bloomfilter * bf, unsigned int fileSlot)
+{
+  unsigned char value;
+
+  if (bf->counters != NULL)
+    return bf->counters[fileSlot];
+  if (fileSlot != (unsigned int) LSEEK (bf->fd, fileSlot, SEEK_SET))
+    GNUNET_GE_DIE_STRERROR (NULL,
+                            GNUNET_GE_ADMIN | GNUNET_GE_USER | GNUNET_GE_FATAL
+                            | GNUNET_GE_IMMEDIATE, "lseek");
+  value = 0;
+  READ (bf->fd, &value, 1);
+  return value;
+}
+
+/**
+ * Write one byte (two 4 bit counters) of the counter file.
+ *
+ * @param bf the filter
+ * @param fileSlot offset of the byte in the counter file
+ * @param value the new value of the byte
+ */
+static void
+writeCounters (Bloomfilter * bf, unsigned int fileSlot, unsigned char value)
+{
+  if (bf->counters != NULL)
+    {
+      bf->counters[fileSlot] = value;
+      return;
+    }
+  if (fileSlot != (unsigned int) LSEEK (bf->fd, fileSlot, SEEK_SET))
+    GNUNET_GE_DIE_STRERROR (NULL,
+                            GNUNET_GE_ADMIN | GNUNET_GE_USER | GNUNET_GE_FATAL
+                            | GNUNET_GE_IMMEDIATE, "lseek");
+  if (1 != WRITE (bf->fd, &value, 1))
+    GNUNET_GE_DIE_STRERROR (NULL,
+                            GNUNET_GE_ADMIN | GNUNET_GE_USER | GNUNET_GE_FATAL
+                            | GNUNET_GE_IMMEDIATE, "write");
+}
+
 /**
  * Sets a bit active in the bitArray and increments
  * bit-specific usage counter on disk (but only if
  * the counter was below 4 bit max (==15)).
  *
- * @param bitArray memory area to set the bit in
- * @param bitIdx which bit to test
- * @param fd A file to keep the 4 bit address usage counters in
+ * @param bf the filter
+ * @param bitIdx which bit to set
  */
 static void
-incrementBit (char *bitArray, unsigned int bitIdx, int fd)
+incrementBit (Bloomfilter * bf, unsigned int bitIdx)
 {
   unsigned int fileSlot;
   unsigned char value;
@@ -159,20 +244,14 @@ incrementBit (char *bitArray, unsigned int bitIdx, int fd)
   unsigned int low;
   unsigned int targetLoc;
 
-  setBit (bitArray, bitIdx);
-  if (fd == -1)
+  setBit (bf->bitArray, bitIdx);
+  if (bf->fd == -1)
     return;
   /* Update the counter file on disk */
   fileSlot = bitIdx / 2;
   targetLoc = bitIdx % 2;
 
-  if (fileSlot != (unsigned int) LSEEK (fd, fileSlot, SEEK_SET))
-    GNUNET_GE_DIE_STRERROR (NULL,
-                            GNUNET_GE_ADMIN | GNUNET_GE_USER | GNUNET_GE_FATAL
-                            | GNUNET_GE_IMMEDIATE, "lseek");
-  value = 0;
-  READ (fd, &value, 1);
-
+  value = readCounters (bf, fileSlot);
   low = value & 0xF;
   high = (value & (~0xF)) >> 4;
 
@@ -187,27 +266,18 @@ incrementBit (char *bitArray, unsigned int bitIdx, int fd)
         high++;
     }
   value = ((high << 4) | low);
-  if (fileSlot != (unsigned int) LSEEK (fd, fileSlot, SEEK_SET))
-    GNUNET_GE_DIE_STRERROR (NULL,
-                            GNUNET_GE_ADMIN | GNUNET_GE_USER | GNUNET_GE_FATAL
-                            | GNUNET_GE_IMMEDIATE, "lseek");
-  if (1 != WRITE (fd, &value, 1))
-    GNUNET_GE_DIE_STRERROR (NULL,
-                            GNUNET_GE_ADMIN | GNUNET_GE_USER | GNUNET_GE_FATAL
-                            | GNUNET_GE_IMMEDIATE, "write");
-
+  writeCounters (bf, fileSlot, value);
 }
 
 /**
  * Clears a bit from bitArray if the respective usage
  * counter on the disk hits/is zero.
  *
- * @param bitArray memory area to set the bit in
- * @param bitIdx which bit to test
- * @param fd A file to keep the 4bit address usage counters in
+ * @param bf the filter
+ * @param bitIdx which bit to clear
  */
 static void
-decrementBit (char *bitArray, unsigned int bitIdx, int fd)
+decrementBit (Bloomfilter * bf, unsigned int bitIdx)
 {
   unsigned int fileSlot;
   unsigned char value;
@@ -215,15 +285,12 @@ decrementBit (char *bitArray, unsigned int bitIdx, int fd)
   unsigned int low;
   unsigned int targetLoc;
 
-  if (fd == -1)
+  if (bf->fd == -1)
     return;                     /* cannot decrement! */
-  GNUNET_GE_ASSERT (NULL, fd != -1);
   /* Each char slot in the counter file holds two 4 bit counters */
   fileSlot = bitIdx / 2;
   targetLoc = bitIdx % 2;
-  LSEEK (fd, fileSlot, SEEK_SET);
-  value = 0;
-  READ (fd, &value, 1);
+  value = readCounters (bf, fileSlot);
 
   low = value & 0xF;
   high = (value & 0xF0) >> 4;
@@ -235,7 +302,7 @@ decrementBit (char *bitArray, unsigned int bitIdx, int fd)
         low--;
       if (low == 0)
         {
-          clearBit (bitArray, bitIdx);
+          clearBit (bf->bitArray, bitIdx);
         }
     }
   else
@@ -244,15 +311,11 @@ decrementBit (char *bitArray, unsigned int bitIdx, int fd)
         high--;
       if (high == 0)
         {
-          clearBit (bitArray, bitIdx);
+          clearBit (bf->bitArray, bitIdx);
         }
     }
   value = ((high << 4) | low);
-  LSEEK (fd, fileSlot, SEEK_SET);
-  if (1 != WRITE (fd, &value, 1))
-    GNUNET_GE_DIE_STRERROR (NULL,
-                            GNUNET_GE_ADMIN | GNUNET_GE_USER | GNUNET_GE_FATAL
-                            | GNUNET_GE_IMMEDIATE, "write");
+  writeCounters (bf, fileSlot, value);
 }
 
 #define BUFFSIZE 65536
@@ -303,6 +366,109 @@ makeEmptyFile (int fd, unsigned int size)
   return GNUNET_OK;
 }
 
+/**
+ * Map the counter file of the filter into memory.  The file is
+ * extended (with zeros) to hold a counter for every bit of the
+ * filter.  If mapping fails, the counters will be accessed with
+ * individual reads and writes instead.
+ *
+ * @param bf the filter
+ */
+static void
+mapCounters (Bloomfilter * bf)
+{
+  struct stat buf;
+  size_t size;
+  void *map;
+
+  bf->counters = NULL;
+  bf->countersSize = 0;
+  if (bf->fd == -1)
+    return;
+  size = (size_t) bf->bitArraySize * 4;
+  if (0 != FSTAT (bf->fd, &buf))
+    {
+      GNUNET_GE_LOG_STRERROR_FILE (bf->ectx,
+                                   GNUNET_GE_WARNING | GNUNET_GE_ADMIN |
+                                   GNUNET_GE_BULK, "fstat", bf->filename);
+      return;
+    }
+  if ((buf.st_size < size) && (0 != FTRUNCATE (bf->fd, size)))
+    {
+      GNUNET_GE_LOG_STRERROR_FILE (bf->ectx,
+                                   GNUNET_GE_WARNING | GNUNET_GE_ADMIN |
+                                   GNUNET_GE_BULK, "ftruncate", bf->filename);
+      return;
+    }
+  map = MMAP (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, bf->fd, 0);
+  if (map == MAP_FAILED)
+    {
+      GNUNET_GE_LOG_STRERROR_FILE (bf->ectx,
+                                   GNUNET_GE_WARNING | GNUNET_GE_ADMIN |
+                                   GNUNET_GE_BULK, "mmap", bf->filename);
+      return;
+    }
+  bf->counters = map;
+  bf->countersSize = size;
+}
+
+/**
+ * Write the mapped counters back to disk and unmap them.
+ *
+ * @param bf the filter
+ */
+static void
+unmapCounters (Bloomfilter * bf)
+{
+  if (bf->counters == NULL)
+    return;
+#ifndef MINGW
+  if (0 != msync (bf->counters, bf->countersSize, MS_SYNC))
+    GNUNET_GE_LOG_STRERROR_FILE (bf->ectx,
+                                 GNUNET_GE_WARNING | GNUNET_GE_ADMIN |
+                                 GNUNET_GE_BULK, "msync", bf->filename);
+#endif
+  MUNMAP (bf->counters, bf->countersSize);
+  bf->counters = NULL;
+  bf->countersSize = 0;
+}
+
+/**
+ * Reset all counters of the filter to zero.
+ *
+ * @param bf the filter
+ */
+static void
+clearCounters (Bloomfilter * bf)
+{
+  if (bf->counters != NULL)
+    memset (bf->counters, 0, bf->countersSize);
+  else if (bf->fd != -1)
+    makeEmptyFile (bf->fd, bf->bitArraySize * 4);
+}
+
+/**
+ * Size of a block (in bytes) of a blocked filter.
+ */
+#define BLOCK_SIZE 64
+
+/**
+ * Number of bits needed to address a bit within a block.
+ */
+#define BLOCK_ADDRESS_BITS 9
+
+/**
+ * Number of bit addresses within a block that we can take from a
+ * hash code (the first 32 bits of the first hash select the block).
+ */
+#define BLOCK_ADDRESSES \
+  ((sizeof (GNUNET_HashCode) * 8 - 32) / BLOCK_ADDRESS_BITS)
+
+/**
+ * How many elements do we process together in test_many?
+ */
+#define TEST_BATCH 32
+
 /* ************** GNUNET_BloomFilter GNUNET_hash iterator ********* */
 
 /**
@@ -316,6 +482,148 @@ makeEmptyFile (int fd, unsigned int size)
  */
 typedef void (*BitIterator) (Bloomfilter * bf, unsigned int bit, void *arg);
 
+/**
+ * Extract the n-th bit address within a block from a hash code.
+ *
+ * @param hc the hash code
+ * @param n index of the address, must be below BLOCK_ADDRESSES
+ * @return bit offset within the block
+ */
+static unsigned int
+blockAddress (const GNUNET_HashCode * hc, unsigned int n)
+{
+  const unsigned char *bytes = (const unsigned char *) hc;
+  unsigned int pos;
+  unsigned int word;
+
+  pos = 32 + n * BLOCK_ADDRESS_BITS;
+  word = bytes[pos / 8] | (bytes[pos / 8 + 1] << 8);
+  return (word >> (pos % 8)) & ((1 << BLOCK_ADDRESS_BITS) - 1);
+}
+
+/**
+ * Get the index of the first bit of the block of a blocked filter
+ * that holds the bits of the given element.
+ *
+ * @param bf the filter
+ * @param key the element
+ * @return bit index of the start of the block
+ */
+static unsigned int
+blockStart (const Bloomfilter * bf, const GNUNET_HashCode * key)
+{
+  return (((const unsigned int *) key)[0] &
+          ((bf->bitArraySize / BLOCK_SIZE) - 1)) * BLOCK_SIZE * 8;
+}
+
+/**
+ * Call an iterator for each bit that a blocked bloomfilter
+ * must test or set for this element.
+ *
+ * @param bf the filter
+ * @param callback the method to call
+ * @param arg extra argument to callback
+ * @param key the key for which we iterate over the BF bits
+ */
+static void
+iterateBlockedBits (Bloomfilter * bf,
+                    BitIterator callback, void *arg,
+                    const GNUNET_HashCode * key)
+{
+  GNUNET_HashCode tmp[2];
+  unsigned int start;
+  unsigned int bitCount;
+  unsigned int n;
+  int round;
+
+  start = blockStart (bf, key);
+  bitCount = bf->addressesPerElement;
+  memcpy (&tmp[0], key, sizeof (GNUNET_HashCode));
+  round = 0;
+  while (bitCount > 0)
+    {
+      for (n = 0; (n < BLOCK_ADDRESSES) && (bitCount > 0); n++, bitCount--)
+        callback (bf, start + blockAddress (&tmp[round & 1], n), arg);
+      if (bitCount > 0)
+        {
+          GNUNET_hash (&tmp[round & 1], sizeof (GNUNET_HashCode),
+                       &tmp[(round + 1) & 1]);
+          round++;
+        }
+    }
+}
+
+#ifdef __GNUC__
+/**
+ * A vector covering one block of a blocked filter.
+ */
+typedef unsigned long long BlockVector
+  __attribute__ ((vector_size (BLOCK_SIZE)));
+#endif
+
+/**
+ * Test if all bits of an element are set in a blocked filter.  We
+ * build a mask of the bits of the element and compare it against the
+ * whole block at once (with vector instructions where available).
+ *
+ * @param bf the filter
+ * @param key the element
+ * @return GNUNET_YES if all bits are set, GNUNET_NO if not
+ */
+static int
+testBlocked (const Bloomfilter * bf, const GNUNET_HashCode * key)
+{
+  GNUNET_HashCode tmp[2];
+  unsigned long long mask[BLOCK_SIZE / sizeof (unsigned long long)];
+  unsigned long long block[BLOCK_SIZE / sizeof (unsigned long long)];
+  unsigned char *maskBytes = (unsigned char *) mask;
+  unsigned int bitCount;
+  unsigned int bit;
+  unsigned int n;
+  int round;
+#ifdef __GNUC__
+  BlockVector m;
+  BlockVector b;
+#else
+  unsigned long long missing;
+  unsigned int i;
+#endif
+
+  memset (mask, 0, sizeof (mask));
+  bitCount = bf->addressesPerElement;
+  memcpy (&tmp[0], key, sizeof (GNUNET_HashCode));
+  round = 0;
+  while (bitCount > 0)
+    {
+      for (n = 0; (n < BLOCK_ADDRESSES) && (bitCount > 0); n++, bitCount--)
+        {
+          bit = blockAddress (&tmp[round & 1], n);
+          maskBytes[bit / 8] |= (1 << (bit % 8));
+        }
+      if (bitCount > 0)
+        {
+          GNUNET_hash (&tmp[round & 1], sizeof (GNUNET_HashCode),
+                       &tmp[(round + 1) & 1]);
+          round++;
+        }
+    }
+  memcpy (block, &bf->bitArray[blockStart (bf, key) / 8], BLOCK_SIZE);
+#ifdef __GNUC__
+  memcpy (&m, mask, BLOCK_SIZE);
+  memcpy (&b, block, BLOCK_SIZE);
+  m &= ~b;
+  memcpy (mask, &m, BLOCK_SIZE);
+  return ((mask[0] | mask[1] | mask[2] | mask[3] |
+           mask[4] | mask[5] | mask[6] | mask[7]) == 0)
+    ? GNUNET_YES : GNUNET_NO;
+#else
+  missing = 0;
+  for (i = 0; i < BLOCK_SIZE / sizeof (unsigned long long); i++)
+    missing |= mask[i] & ~block[i];
+  return (missing == 0) ? GNUNET_YES : GNUNET_NO;
+#endif
+}
+
 /**
  * Call an iterator for each bit that the bloomfilter
  * must test or set for this element.
@@ -334,6 +642,11 @@ iterateBits (Bloomfilter * bf,
   int round;
   unsigned int slot = 0;
 
+  if (bf->blocked)
+    {
+      iterateBlockedBits (bf, callback, arg, key);
+      return;
+    }
   bitCount = bf->addressesPerElement;
   memcpy (&tmp[0], key, sizeof (GNUNET_HashCode));
   round = 0;
@@ -369,7 +682,7 @@ iterateBits (Bloomfilter * bf,
 static void
 incrementBitCallback (Bloomfilter * bf, unsigned int bit, void *arg)
 {
-  incrementBit (bf->bitArray, bit, bf->fd);
+  incrementBit (bf, bit);
 }
 
 /**
@@ -382,7 +695,7 @@ incrementBitCallback (Bloomfilter * bf, unsigned int bit, void *arg)
 static void
 decrementBitCallback (Bloomfilter * bf, unsigned int bit, void *arg)
 {
-  decrementBit (bf->bitArray, bit, bf->fd);
+  decrementBit (bf, bit);
 }
 
 /**
@@ -410,12 +723,14 @@ testBitCallback (Bloomfilter * bf, unsigned int bit, void *cls)
  *        bytes of storage space to use)
  * @param k the number of GNUNET_hash-functions to apply per
  *        element (number of bits set per element in the set)
+ * @param blocked GNUNET_YES to place all bits of an element
+ *        into one block
  * @return the bloomfilter
  */
-Bloomfilter *
-GNUNET_bloomfilter_load (struct GNUNET_GE_Context *ectx,
-                         const char *filename, unsigned int size,
-                         unsigned int k)
+static Bloomfilter *
+loadFilter (struct GNUNET_GE_Context *ectx,
+            const char *filename, unsigned int size,
+            unsigned int k, int blocked)
 {
   Bloomfilter *bf;
   char *rbuff;
@@ -463,9 +778,21 @@ GNUNET_bloomfilter_load (struct GNUNET_GE_Context *ectx,
   bf->bitArray = GNUNET_malloc_large (size);
   bf->bitArraySize = size;
   bf->addressesPerElement = k;
+  bf->blocked = blocked;
   memset (bf->bitArray, 0, bf->bitArraySize);
 
-  if (bf->fd != -1)
+  mapCounters (bf);
+  if (bf->counters != NULL)
+    {
+      for (ui = 0; ui < bf->countersSize; ui++)
+        {
+          if ((bf->counters[ui] & 0x0F) != 0)
+            setBit (bf->bitArray, ui * 2);
+          if ((bf->counters[ui] & 0xF0) != 0)
+            setBit (bf->bitArray, ui * 2 + 1);
+        }
+    }
+  else if (bf->fd != -1)
     {
       /* Read from the file what bits we can */
       rbuff = GNUNET_malloc (BUFFSIZE);
@@ -494,6 +821,42 @@ GNUNET_bloomfilter_load (struct GNUNET_GE_Context *ectx,
 }
 
 
+/**
+ * Load a bloom-filter from a file.
+ *
+ * @param filename the name of the file (or the prefix)
+ * @param size the size of the bloom-filter (number of
+ *        bytes of storage space to use)
+ * @param k the number of GNUNET_hash-functions to apply per
+ *        element (number of bits set per element in the set)
+ * @return the bloomfilter
+ */
+Bloomfilter *
+GNUNET_bloomfilter_load (struct GNUNET_GE_Context *ectx,
+                         const char *filename, unsigned int size,
+                         unsigned int k)
+{
+  return loadFilter (ectx, filename, size, k, GNUNET_NO);
+}
+
+/**
+ * Load a blocked bloom-filter from a file.
+ *
+ * @param filename the name of the file (or the prefix)
+ * @param size the size of the bloom-filter (number of
+ *        bytes of storage space to use)
+ * @param k the number of GNUNET_hash-functions to apply per
+ *        element (number of bits set per element in the set)
+ * @return the bloomfilter
+ */
+Bloomfilter *
+GNUNET_bloomfilter_load_blocked (struct GNUNET_GE_Context *ectx,
+                                 const char *filename, unsigned int size,
+                                 unsigned int k)
+{
+  return loadFilter (ectx, filename, size, k, GNUNET_YES);
+}
+
 /**
  * Create a bloom filter from raw bits.
  *
@@ -505,12 +868,13 @@ GNUNET_bloomfilter_load (struct GNUNET_GE_Context *ectx,
  *        -- unless data is NULL
  * @param k the number of GNUNET_hash-functions to apply per
  *        element (number of bits set per element in the set)
+ * @param blocked GNUNET_YES to place all bits of an element
+ *        into one block
  * @return the bloomfilter
  */
-struct GNUNET_BloomFilter *
-GNUNET_bloomfilter_init (struct GNUNET_GE_Context
-                         *ectx,
-                         const char *data, unsigned int size, unsigned int k)
+static Bloomfilter *
+initFilter (struct GNUNET_GE_Context *ectx,
+            const char *data, unsigned int size, unsigned int k, int blocked)
 {
   Bloomfilter *bf;
   unsigned int ui;
@@ -520,7 +884,7 @@ GNUNET_bloomfilter_init (struct GNUNET_GE_Context
   ui = 1;
   while (ui < size)
     ui *= 2;
-  if (size != ui)
+  if ((size != ui) || ((blocked) && (size < BLOCK_SIZE)))
     {
       GNUNET_GE_BREAK (NULL, 0);
       return NULL;
@@ -529,10 +893,13 @@ GNUNET_bloomfilter_init (struct GNUNET_GE_Context
   bf->ectx = ectx;
   bf->fd = -1;
   bf->filename = NULL;
+  bf->counters = NULL;
+  bf->countersSize = 0;
   bf->lock = GNUNET_mutex_create (GNUNET_YES);
   bf->bitArray = GNUNET_malloc_large (size);
   bf->bitArraySize = size;
   bf->addressesPerElement = k;
+  bf->blocked = blocked;
   if (data != NULL)
     memcpy (bf->bitArray, data, size);
   else
@@ -541,6 +908,50 @@ GNUNET_bloomfilter_init (struct GNUNET_GE_Context
 }
 
 
+/**
+ * Create a bloom filter from raw bits.
+ *
+ * @param data the raw bits in memory (maybe NULL,
+ *        in which case all bits should be considered
+ *        to be zero).
+ * @param size the size of the bloom-filter (number of
+ *        bytes of storage space to use); also size of data
+ *        -- unless data is NULL
+ * @param k the number of GNUNET_hash-functions to apply per
+ *        element (number of bits set per element in the set)
+ * @return the bloomfilter
+ */
+struct GNUNET_BloomFilter *
+GNUNET_bloomfilter_init (struct GNUNET_GE_Context
+                         *ectx,
+                         const char *data, unsigned int size, unsigned int k)
+{
+  return initFilter (ectx, data, size, k, GNUNET_NO);
+}
+
+/**
+ * Create a blocked bloom filter from raw bits.
+ *
+ * @param data the raw bits in memory (maybe NULL,
+ *        in which case all bits should be considered
+ *        to be zero).
+ * @param size the size of the bloom-filter (number of
+ *        bytes of storage space to use); also size of data
+ *        -- unless data is NULL
+ * @param k the number of GNUNET_hash-functions to apply per
+ *        element (number of bits set per element in the set)
+ * @return the bloomfilter
+ */
+struct GNUNET_BloomFilter *
+GNUNET_bloomfilter_init_blocked (struct GNUNET_GE_Context
+                                 *ectx,
+                                 const char *data, unsigned int size,
+                                 unsigned int k)
+{
+  return initFilter (ectx, data, size, k, GNUNET_YES);
+}
+
+
 /**
  * Copy the raw data of this bloomfilter into
  * the given data array.
@@ -580,6 +991,7 @@ GNUNET_bloomfilter_free (Bloomfilter * bf)
   if (NULL == bf)
     return;
   GNUNET_mutex_destroy (bf->lock);
+  unmapCounters (bf);
   if (bf->fd != -1)
     GNUNET_disk_file_close (bf->ectx, bf->filename, bf->fd);
   GNUNET_free_non_null (bf->filename);
@@ -600,8 +1012,7 @@ GNUNET_bloomfilter_clear (Bloomfilter * bf)
 
   GNUNET_mutex_lock (bf->lock);
   memset (bf->bitArray, 0, bf->bitArraySize);
-  if (bf->fd != -1)
-    makeEmptyFile (bf->fd, bf->bitArraySize * 4);
+  clearCounters (bf);
   GNUNET_mutex_unlock (bf->lock);
 }
 
@@ -621,12 +1032,154 @@ GNUNET_bloomfilter_test (Bloomfilter * bf, const GNUNET_HashCode * e)
   if (NULL == bf)
     return GNUNET_YES;
   GNUNET_mutex_lock (bf->lock);
-  res = GNUNET_YES;
-  iterateBits (bf, &testBitCallback, &res, e);
+  if (bf->blocked)
+    {
+      res = testBlocked (bf, e);
+    }
+  else
+    {
+      res = GNUNET_YES;
+      iterateBits (bf, &testBitCallback, &res, e);
+    }
   GNUNET_mutex_unlock (bf->lock);
   return res;
 }
 
+/**
+ * Test a batch of elements against a regular filter.  The bit
+ * addresses of all elements are taken from the same round of
+ * hashing, so the additional hashes needed for k > 16 are computed
+ * with GNUNET_hash_many.
+ *
+ * @param bf the filter
+ * @param count number of elements, at most TEST_BATCH
+ * @param e the elements
+ * @param results set to GNUNET_YES or GNUNET_NO for each element
+ */
+static void
+testBatch (Bloomfilter * bf,
+           unsigned int count, const GNUNET_HashCode * e, int *results)
+{
+  GNUNET_HashCode tmp[2][TEST_BATCH];
+  const void *blocks[TEST_BATCH];
+  unsigned int sizes[TEST_BATCH];
+  unsigned int live[TEST_BATCH];
+  unsigned int liveCount;
+  unsigned int bitCount;
+  unsigned int slots;
+  unsigned int slot;
+  unsigned int mask;
+  unsigned int bit;
+  unsigned int i;
+  unsigned int j;
+  int round;
+
+  mask = (bf->bitArraySize * 8) - 1;
+  liveCount = count;
+  for (i = 0; i < count; i++)
+    {
+      results[i] = GNUNET_YES;
+      live[i] = i;
+      tmp[0][i] = e[i];
+    }
+  bitCount = bf->addressesPerElement;
+  round = 0;
+  while (liveCount > 0)
+    {
+      slots = sizeof (GNUNET_HashCode) / sizeof (unsigned int);
+      if (slots > bitCount)
+        slots = bitCount;
+      for (slot = 0; slot < slots; slot++)
+        for (i = 0; i < liveCount; i++)
+          {
+            bit = ((unsigned int *) &tmp[round & 1][live[i]])[slot] & mask;
+            if (GNUNET_NO == testBit (bf->bitArray, bit))
+              results[live[i]] = GNUNET_NO;
+          }
+      bitCount -= slots;
+      if (bitCount == 0)
+        break;
+      /* only elements that may still be in the set need more bits */
+      j = 0;
+      for (i = 0; i < liveCount; i++)
+        if (results[live[i]] == GNUNET_YES)
+          live[j++] = live[i];
+      liveCount = j;
+      for (i = 0; i < liveCount; i++)
+        {
+          blocks[i] = &tmp[round & 1][live[i]];
+          sizes[i] = sizeof (GNUNET_HashCode);
+        }
+      if (liveCount > 0)
+        {
+          GNUNET_hash_many (liveCount, blocks, sizes,
+                            &tmp[(round + 1) & 1][0]);
+          /* GNUNET_hash_many wrote the results densely */
+          for (i = liveCount; i > 0; i--)
+            tmp[(round + 1) & 1][live[i - 1]] =
+              tmp[(round + 1) & 1][i - 1];
+        }
+      round++;
+    }
+}
+
+/**
+ * Test if several elements are in the filter.  This is faster than
+ * testing the elements one at a time: the bits of the elements are
+ * processed together, so the memory accesses for different elements
+ * can overlap.
+ *
+ * @param bf the filter
+ * @param count number of elements to test
+ * @param e the elements
+ * @param results set to GNUNET_YES or GNUNET_NO for each element
+ * @return number of elements that are in the filter
+ */
+unsigned int
+GNUNET_bloomfilter_test_many (struct GNUNET_BloomFilter *bf,
+                              unsigned int count,
+                              const GNUNET_HashCode * e, int *results)
+{
+  unsigned int found;
+  unsigned int batch;
+  unsigned int off;
+  unsigned int i;
+
+  if (NULL == bf)
+    {
+      for (i = 0; i < count; i++)
+        results[i] = GNUNET_YES;
+      return count;
+    }
+  found = 0;
+  GNUNET_mutex_lock (bf->lock);
+  for (off = 0; off < count; off += batch)
+    {
+      batch = count - off;
+      if (batch > TEST_BATCH)
+        batch = TEST_BATCH;
+      if (bf->blocked)
+        {
+#ifdef __GNUC__
+          for (i = 0; i < batch; i++)
+            __builtin_prefetch (&bf->bitArray
+                                [blockStart (bf, &e[off + i]) / 8]);
+#endif
+          for (i = 0; i < batch; i++)
+            results[off + i] = testBlocked (bf, &e[off + i]);
+        }
+      else
+        {
+          testBatch (bf, batch, &e[off], &results[off]);
+        }
+      for (i = 0; i < batch; i++)
+        if (results[off + i] == GNUNET_YES)
+          found++;
+    }
+  GNUNET_mutex_unlock (bf->lock);
+  return found;
+}
+
 /**
  * Add an element to the filter
  *
@@ -700,7 +1253,8 @@ GNUNET_bloomfilter_remove (Bloomfilter * bf, const GNUNET_HashCode * e)
  * @param bf the filter
  * @param iterator an iterator over all elements stored in the BF
  * @param iterator_arg argument to the iterator function
- * @param size the new size for the filter
+ * @param size the new size for the filter (rounded up to a power
+ *        of 2, and to the block size for blocked filters)
  * @param k the new number of GNUNET_hash-function to apply per element
  */
 void
@@ -713,17 +1267,20 @@ GNUNET_bloomfilter_resize (Bloomfilter * bf,
   unsigned int i;
 
   GNUNET_mutex_lock (bf->lock);
+  unmapCounters (bf);
   GNUNET_free (bf->bitArray);
   i = 1;
   while (i < size)
     i *= 2;
   size = i;                     /* make sure it's a power of 2 */
+  if ((bf->blocked) && (size < BLOCK_SIZE))
+    size = BLOCK_SIZE;          /* elements must fit into one block */
 
   bf->bitArraySize = size;
   bf->bitArray = GNUNET_malloc (size);
   memset (bf->bitArray, 0, bf->bitArraySize);
-  if (bf->fd != -1)
-    makeEmptyFile (bf->fd, bf->bitArraySize * 4);
+  mapCounters (bf);
+  clearCounters (bf);
   while (GNUNET_YES == iterator (&hc, iterator_arg))
     GNUNET_bloomfilter_add (bf, &hc);
   GNUNET_mutex_unlock (bf->lock);
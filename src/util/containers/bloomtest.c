@@ -31,6 +31,17 @@
 #define K 4
 #define SIZE 65536
 
+/**
+ * How long do we run each throughput measurement?
+ */
+#define MEASURE_TIME (200 * GNUNET_CRON_MILLISECONDS)
+
+/**
+ * How many distinct elements do we add and remove
+ * in each round of the throughput measurement?
+ */
+#define BATCH 1024
+
 /**
  * Generate a random hashcode.
  */
@@ -40,6 +51,251 @@ nextHC (GNUNET_HashCode * hc)
   GNUNET_create_random_hash (hc);
 }
 
+/**
+ * Add and remove elements for MEASURE_TIME and report the
+ * throughput.
+ *
+ * @param filename file for the counters, NULL for an
+ *        in-memory filter (where remove is a no-op)
+ */
+static void
+perfAddRemove (const char *filename)
+{
+  struct GNUNET_BloomFilter *bf;
+  GNUNET_HashCode *keys;
+  GNUNET_CronTime start;
+  GNUNET_CronTime delta;
+  unsigned long long ops;
+  int i;
+
+  if (filename != NULL)
+    UNLINK (filename);
+  bf = GNUNET_bloomfilter_load (NULL, filename, SIZE, K);
+  keys = GNUNET_malloc (BATCH * sizeof (GNUNET_HashCode));
+  for (i = 0; i < BATCH; i++)
+    nextHC (&keys[i]);
+  ops = 0;
+  start = GNUNET_get_time ();
+  do
+    {
+      for (i = 0; i < BATCH; i++)
+        GNUNET_bloomfilter_add (bf, &keys[i]);
+      for (i = 0; i < BATCH; i++)
+        GNUNET_bloomfilter_remove (bf, &keys[i]);
+      ops += 2 * BATCH;
+      delta = GNUNET_get_time () - start;
+    }
+  while (delta < MEASURE_TIME);
+  if (delta == 0)
+    delta = 1;
+  printf ("%-7s add/remove: %10.0f ops/s\n",
+          filename != NULL ? "file" : "memory", ops * 1000.0 / delta);
+  GNUNET_free (keys);
+  GNUNET_bloomfilter_free (bf);
+  if (filename != NULL)
+    UNLINK (filename);
+}
+
+/**
+ * Check that test_many agrees with testing the elements
+ * one at a time.
+ *
+ * @param blocked GNUNET_YES to check a blocked filter
+ * @param k number of bits per element
+ * @return 0 on success
+ */
+static int
+checkTestMany (int blocked, unsigned int k)
+{
+  struct GNUNET_BloomFilter *bf;
+  GNUNET_HashCode keys[300];
+  int results[300];
+  unsigned int found;
+  unsigned int expected;
+  int i;
+
+  if (blocked)
+    bf = GNUNET_bloomfilter_init_blocked (NULL, NULL, 1024, k);
+  else
+    bf = GNUNET_bloomfilter_init (NULL, NULL, 1024, k);
+  for (i = 0; i < 300; i++)
+    nextHC (&keys[i]);
+  for (i = 0; i < 100; i++)
+    GNUNET_bloomfilter_add (bf, &keys[i]);
+  found = GNUNET_bloomfilter_test_many (bf, 300, keys, results);
+  expected = 0;
+  for (i = 0; i < 300; i++)
+    {
+      if (results[i] != GNUNET_bloomfilter_test (bf, &keys[i]))
+        {
+          printf (" test_many disagrees with test for element %d"
+                  " (blocked: %d, k: %u)\n", i, blocked, k);
+          GNUNET_bloomfilter_free (bf);
+          return 1;
+        }
+      if (results[i] == GNUNET_YES)
+        expected++;
+    }
+  GNUNET_bloomfilter_free (bf);
+  if ((found != expected) || (found < 100))
+    {
+      printf (" test_many found %u elements, expected %u"
+              " (blocked: %d, k: %u)\n", found, expected, blocked, k);
+      return 1;
+    }
+  return 0;
+}
+
+/**
+ * Check adding, removing and reloading of a blocked filter.
+ *
+ * @return 0 on success
+ */
+static int
+checkBlocked ()
+{
+  struct GNUNET_BloomFilter *bf;
+  GNUNET_HashCode keys[200];
+  int i;
+  int ok;
+
+  UNLINK ("/tmp/bloomtest.dat");
+  bf = GNUNET_bloomfilter_load_blocked (NULL, "/tmp/bloomtest.dat", SIZE, K);
+  for (i = 0; i < 200; i++)
+    {
+      nextHC (&keys[i]);
+      GNUNET_bloomfilter_add (bf, &keys[i]);
+    }
+  GNUNET_bloomfilter_free (bf);
+  bf = GNUNET_bloomfilter_load_blocked (NULL, "/tmp/bloomtest.dat", SIZE, K);
+  for (i = 0; i < 100; i++)
+    GNUNET_bloomfilter_remove (bf, &keys[i]);
+  ok = 0;
+  for (i = 0; i < 200; i++)
+    if (GNUNET_bloomfilter_test (bf, &keys[i]) == GNUNET_YES)
+      ok++;
+  GNUNET_bloomfilter_free (bf);
+  UNLINK ("/tmp/bloomtest.dat");
+  if (ok != 100)
+    {
+      printf (" Expected 100 elements in blocked filter"
+              " after adding 200 and deleting 100, got %d\n", ok);
+      return 1;
+    }
+  return 0;
+}
+
+struct ResizeClosure
+{
+  GNUNET_HashCode *keys;
+
+  unsigned int pos;
+
+  unsigned int count;
+};
+
+static int
+resizeIterator (GNUNET_HashCode * next, void *arg)
+{
+  struct ResizeClosure *rc = arg;
+
+  if (rc->pos == rc->count)
+    return GNUNET_NO;
+  *next = rc->keys[rc->pos++];
+  return GNUNET_YES;
+}
+
+/**
+ * Check that a blocked filter can be shrunk below the
+ * block size.
+ *
+ * @return 0 on success
+ */
+static int
+checkResizeBlocked ()
+{
+  struct GNUNET_BloomFilter *bf;
+  struct ResizeClosure rc;
+  GNUNET_HashCode keys[20];
+  int i;
+
+  bf = GNUNET_bloomfilter_init_blocked (NULL, NULL, 1024, K);
+  for (i = 0; i < 20; i++)
+    {
+      nextHC (&keys[i]);
+      GNUNET_bloomfilter_add (bf, &keys[i]);
+    }
+  rc.keys = keys;
+  rc.pos = 0;
+  rc.count = 20;
+  GNUNET_bloomfilter_resize (bf, &resizeIterator, &rc, 8, K);
+  for (i = 0; i < 20; i++)
+    if (GNUNET_bloomfilter_test (bf, &keys[i]) != GNUNET_YES)
+      {
+        printf (" Element %d missing after resizing blocked filter\n", i);
+        GNUNET_bloomfilter_free (bf);
+        return 1;
+      }
+  GNUNET_bloomfilter_free (bf);
+  return 0;
+}
+
+/**
+ * Test elements against a large filter for MEASURE_TIME and
+ * report the throughput.
+ *
+ * @param blocked GNUNET_YES to use a blocked filter
+ * @param many GNUNET_YES to use test_many
+ */
+static void
+perfTest (int blocked, int many)
+{
+  struct GNUNET_BloomFilter *bf;
+  GNUNET_HashCode *keys;
+  int results[BATCH];
+  GNUNET_CronTime start;
+  GNUNET_CronTime delta;
+  unsigned long long ops;
+  int i;
+
+  if (blocked)
+    bf = GNUNET_bloomfilter_init_blocked (NULL, NULL, 16 * 1024 * 1024,
+                                          16);
+  else
+    bf = GNUNET_bloomfilter_init (NULL, NULL, 16 * 1024 * 1024, 16);
+  keys = GNUNET_malloc (BATCH * sizeof (GNUNET_HashCode));
+  for (i = 0; i < BATCH; i++)
+    {
+      nextHC (&keys[i]);
+      if (i % 2 == 0)
+        GNUNET_bloomfilter_add (bf, &keys[i]);
+    }
+  ops = 0;
+  start = GNUNET_get_time ();
+  do
+    {
+      if (many)
+        {
+          GNUNET_bloomfilter_test_many (bf, BATCH, keys, results);
+        }
+      else
+        {
+          for (i = 0; i < BATCH; i++)
+            results[i] = GNUNET_bloomfilter_test (bf, &keys[i]);
+        }
+      ops += BATCH;
+      delta = GNUNET_get_time () - start;
+    }
+  while (delta < MEASURE_TIME);
+  if (delta == 0)
+    delta = 1;
+  printf ("%-7s %-9s 16 MB, k=16: %10.0f tests/s\n",
+          blocked ? "blocked" : "regular",
+          many ? "test_many" : "test", ops * 1000.0 / delta);
+  GNUNET_free (keys);
+  GNUNET_bloomfilter_free (bf);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -116,6 +372,24 @@ main (int argc, char *argv[])
       return -1;
     }
 
+  GNUNET_bloomfilter_free (bf);
+  bf = GNUNET_bloomfilter_load (NULL, "/tmp/bloomtest.dat", SIZE, K);
+
+  srand (1);
+  ok = 0;
+  for (i = 0; i < 200; i++)
+    {
+      nextHC (&tmp);
+      if (GNUNET_bloomfilter_test (bf, &tmp) == GNUNET_YES)
+        ok++;
+    }
+  if (ok != 100)
+    {
+      printf (" Expected 100 elements in filter"
+              " after reloading, got %d\n", ok);
+      return -1;
+    }
+
   srand (3);
 
   falseok = 0;
@@ -129,5 +403,20 @@ main (int argc, char *argv[])
   GNUNET_bloomfilter_free (bf);
 
   UNLINK ("/tmp/bloomtest.dat");
+
+  if ((0 != checkBlocked ()) || (0 != checkResizeBlocked ()))
+    return -1;
+  if ((0 != checkTestMany (GNUNET_NO, K)) ||
+      (0 != checkTestMany (GNUNET_NO, 40)) ||
+      (0 != checkTestMany (GNUNET_YES, K)) ||
+      (0 != checkTestMany (GNUNET_YES, 60)))
+    return -1;
+
+  perfAddRemove ("/tmp/bloomtest.dat");
+  perfAddRemove (NULL);
+  perfTest (GNUNET_NO, GNUNET_NO);
+  perfTest (GNUNET_NO, GNUNET_YES);
+  perfTest (GNUNET_YES, GNUNET_NO);
+  perfTest (GNUNET_YES, GNUNET_YES);
   return 0;
 }
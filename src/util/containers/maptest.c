@@ -90,6 +90,177 @@ testMap (int i)
   return 0;
 }
 
+/**
+ * Iterator that removes each entry from the map.
+ */
+static int
+removeIterator (const GNUNET_HashCode * key, void *value, void *cls)
+{
+  struct GNUNET_MultiHashMap *m = cls;
+
+  if (GNUNET_YES != GNUNET_multi_hash_map_remove (m, key, value))
+    return GNUNET_SYSERR;
+  return GNUNET_OK;
+}
+
+/**
+ * Iterator that adds a new entry for every entry it sees.
+ */
+static int
+putIterator (const GNUNET_HashCode * key, void *value, void *cls)
+{
+  struct GNUNET_MultiHashMap *m = cls;
+  GNUNET_HashCode k;
+
+  GNUNET_hash (key, sizeof (GNUNET_HashCode), &k);
+  GNUNET_multi_hash_map_put (m, &k, value, GNUNET_MultiHashMapOption_MULTIPLE);
+  return GNUNET_OK;
+}
+
+/**
+ * Test a map with many distinct keys (so that the map has
+ * to grow) and changes to the map during iterations.
+ */
+static int
+testGrow ()
+{
+  struct GNUNET_MultiHashMap *m;
+  GNUNET_HashCode *keys;
+  unsigned int i;
+
+  m = NULL;
+  keys = GNUNET_malloc (10000 * sizeof (GNUNET_HashCode));
+  for (i = 0; i < 10000; i++)
+    GNUNET_create_random_hash (&keys[i]);
+  CHECK (NULL != (m = GNUNET_multi_hash_map_create (4)));
+  for (i = 0; i < 10000; i++)
+    {
+      CHECK (GNUNET_OK == GNUNET_multi_hash_map_put (m,
+                                                     &keys[i],
+                                                     &keys[i],
+                                                     GNUNET_MultiHashMapOption_UNIQUE_ONLY));
+      if (i % 3 == 0)
+        CHECK (GNUNET_YES ==
+               GNUNET_multi_hash_map_remove (m, &keys[i / 3], &keys[i / 3]));
+    }
+  for (i = 0; i < 10000; i++)
+    {
+      if (i < 3334)
+        {
+          CHECK (GNUNET_NO == GNUNET_multi_hash_map_contains (m, &keys[i]));
+        }
+      else
+        {
+          CHECK (&keys[i] == GNUNET_multi_hash_map_get (m, &keys[i]));
+        }
+    }
+  CHECK (10000 - 3334 == GNUNET_multi_hash_map_size (m));
+  CHECK (10000 - 3334 == GNUNET_multi_hash_map_iterate (m, NULL, NULL));
+  /* adding entries while iterating must not break the map */
+  GNUNET_multi_hash_map_iterate (m, &putIterator, m);
+  CHECK (GNUNET_multi_hash_map_size (m) ==
+         GNUNET_multi_hash_map_iterate (m, NULL, NULL));
+  CHECK (GNUNET_multi_hash_map_size (m) >= 10000 - 3334);
+  /* removing entries while iterating must visit all of them */
+  CHECK (GNUNET_SYSERR !=
+         GNUNET_multi_hash_map_iterate (m, &removeIterator, m));
+  CHECK (0 == GNUNET_multi_hash_map_size (m));
+  CHECK (0 == GNUNET_multi_hash_map_iterate (m, NULL, NULL));
+  GNUNET_multi_hash_map_destroy (m);
+  GNUNET_free (keys);
+  return 0;
+}
+
+/**
+ * Check that every key can be found after every put, so that
+ * lookups are tested while migrations are in flight.
+ */
+static int
+testMigration ()
+{
+  struct GNUNET_MultiHashMap *m;
+  GNUNET_HashCode *keys;
+  unsigned int i;
+  unsigned int j;
+
+  m = NULL;
+  keys = GNUNET_malloc (2000 * sizeof (GNUNET_HashCode));
+  for (i = 0; i < 2000; i++)
+    GNUNET_create_random_hash (&keys[i]);
+  CHECK (NULL != (m = GNUNET_multi_hash_map_create (4)));
+  for (i = 0; i < 2000; i++)
+    {
+      CHECK (GNUNET_OK == GNUNET_multi_hash_map_put (m,
+                                                     &keys[i],
+                                                     &keys[i],
+                                                     GNUNET_MultiHashMapOption_UNIQUE_FAST));
+      for (j = 0; j <= i; j++)
+        CHECK (&keys[j] == GNUNET_multi_hash_map_get (m, &keys[j]));
+    }
+  GNUNET_multi_hash_map_destroy (m);
+  GNUNET_free (keys);
+  return 0;
+}
+
+/**
+ * Get the current time in microseconds.
+ */
+static unsigned long long
+now_us ()
+{
+  struct timeval tv;
+
+  GETTIMEOFDAY (&tv, NULL);
+  return ((unsigned long long) tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+/**
+ * Measure throughput of put, get and remove and the
+ * worst-case latency of a single put.
+ */
+static void
+perfMap (unsigned int count)
+{
+  struct GNUNET_MultiHashMap *m;
+  GNUNET_HashCode *keys;
+  unsigned long long start;
+  unsigned long long t;
+  unsigned long long delta;
+  unsigned long long worst;
+  unsigned int i;
+
+  keys = GNUNET_malloc (count * sizeof (GNUNET_HashCode));
+  for (i = 0; i < count; i++)
+    GNUNET_create_random_hash (&keys[i]);
+  m = GNUNET_multi_hash_map_create (4);
+  worst = 0;
+  start = now_us ();
+  for (i = 0; i < count; i++)
+    {
+      t = now_us ();
+      GNUNET_multi_hash_map_put (m, &keys[i], &keys[i],
+                                 GNUNET_MultiHashMapOption_UNIQUE_FAST);
+      t = now_us () - t;
+      if (t > worst)
+        worst = t;
+    }
+  delta = now_us () - start + 1;
+  printf ("put:    %10.0f ops/s (worst put: %llu us)\n",
+          count * 1000000.0 / delta, worst);
+  start = now_us ();
+  for (i = 0; i < count; i++)
+    GNUNET_multi_hash_map_get (m, &keys[i]);
+  delta = now_us () - start + 1;
+  printf ("get:    %10.0f ops/s\n", count * 1000000.0 / delta);
+  start = now_us ();
+  for (i = 0; i < count; i++)
+    GNUNET_multi_hash_map_remove (m, &keys[i], &keys[i]);
+  delta = now_us () - start + 1;
+  printf ("remove: %10.0f ops/s\n", count * 1000000.0 / delta);
+  GNUNET_multi_hash_map_destroy (m);
+  GNUNET_free (keys);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -98,6 +269,10 @@ main (int argc, char *argv[])
 
   for (i = 1; i < 255; i++)
     failureCount += testMap (i);
+  failureCount += testGrow ();
+  failureCount += testMigration ();
+  if (failureCount == 0)
+    perfMap (500000);
   if (failureCount != 0)
     return 1;
   return 0;
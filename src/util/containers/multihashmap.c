@@ -21,6 +21,22 @@
  * @file util/containers/multihashmap.c
  * @brief hash map where the same key maybe present multiple times
  * @author Christian Grothoff
+ *
+ * The map uses open addressing with linear probing.  Entries are
+ * stored inline in the table, so put does not allocate memory
+ * (except when the table grows).  Next to the entries, the table
+ * keeps an array with a 32-bit tag (mixed from the key) for each
+ * slot, which marks slots as empty or deleted and allows us to skip
+ * most non-matching slots without looking at the entry.
+ *
+ * Removal only marks slots as deleted (entries never move), so
+ * iterator callbacks may remove entries from the map.  When the
+ * table gets too full, a new table is allocated and the entries are
+ * moved over incrementally: every put migrates a few slots of the
+ * old table, so there are no latency spikes from rehashing a large
+ * map at once.  While a migration is in progress, lookups check both
+ * tables.  Tables are never released while an iteration is in
+ * progress.
  */
 
 #include "platform.h"
@@ -31,66 +47,397 @@
 
 #if WRITE_MEM_STATS
   #define HM_MALLOC malloc
+  #define HM_MALLOC_LARGE malloc
   #define HM_FREE free
 #else
   #define HM_MALLOC GNUNET_malloc
+  #define HM_MALLOC_LARGE GNUNET_malloc_large
   #define HM_FREE GNUNET_free
 #endif
 
+/**
+ * Tag of a slot that was never used.
+ */
+#define TAG_EMPTY 0
+
+/**
+ * Tag of a slot whose entry was removed.
+ */
+#define TAG_DELETED 1
+
+/**
+ * Smallest table we create.
+ */
+#define MIN_LENGTH 8
+
+/**
+ * How many slots of the old table does each put migrate
+ * while a resize is in progress?
+ */
+#define MIGRATE_STEP 32
+
 struct MapEntry
 {
   GNUNET_HashCode key;
   void *value;
-  struct MapEntry *next;
+};
+
+struct Table
+{
+  /**
+   * Tag of each slot (TAG_EMPTY, TAG_DELETED or the tag of
+   * the key of the entry in the slot).
+   */
+  unsigned int *tags;
+
+  /**
+   * Entries (only valid if the tag of the slot is neither
+   * TAG_EMPTY nor TAG_DELETED).
+   */
+  struct MapEntry *entries;
+
+  /**
+   * Number of slots, always a power of 2.
+   */
+  unsigned int length;
+
+  /**
+   * Number of slots that are not TAG_EMPTY.
+   */
+  unsigned int used;
+};
+
+/**
+ * Table that was replaced while an iteration was in
+ * progress; freed once the iteration is done.
+ */
+struct RetiredTable
+{
+  struct RetiredTable *next;
+
+  struct Table table;
 };
 
 struct GNUNET_MultiHashMap
 {
 
-  struct MapEntry **map;
+  /**
+   * Table for new entries.
+   */
+  struct Table cur;
 
-  unsigned int size;
+  /**
+   * Table we are migrating entries from (tags is NULL if
+   * no resize is in progress).
+   */
+  struct Table old;
 
-  unsigned int map_length;
+  /**
+   * Tables waiting for the end of an iteration.
+   */
+  struct RetiredTable *retired;
+
+  /**
+   * Next slot of the old table to migrate.
+   */
+  unsigned int migrate_pos;
+
+  /**
+   * Number of iterations in progress.
+   */
+  unsigned int iterating;
+
+  unsigned int size;
 };
 
+/**
+ * Compute the tag for a key.  The tag also determines the
+ * first slot to probe for the key.
+ */
+static unsigned int
+tag_of (const GNUNET_HashCode * key)
+{
+  const unsigned int *w = (const unsigned int *) key;
+  unsigned int h;
+
+  h = w[0] * 0x9E3779B1U;
+  h ^= w[1];
+  h *= 0x85EBCA77U;
+  h ^= h >> 15;
+  if (h <= TAG_DELETED)
+    h += 2;
+  return h;
+}
+
+static void
+table_init (struct Table *t, unsigned int length)
+{
+  t->length = length;
+  t->used = 0;
+  t->tags = HM_MALLOC_LARGE (length * sizeof (unsigned int));
+  memset (t->tags, 0, length * sizeof (unsigned int));
+  t->entries = HM_MALLOC_LARGE (length * sizeof (struct MapEntry));
+}
+
+static void
+table_free (struct Table *t)
+{
+  HM_FREE (t->tags);
+  HM_FREE (t->entries);
+  t->tags = NULL;
+  t->entries = NULL;
+}
+
+/**
+ * Release a table that is no longer used by the map (delayed if
+ * an iteration might still look at it).
+ */
+static void
+table_retire (struct GNUNET_MultiHashMap *map, struct Table *t)
+{
+  struct RetiredTable *r;
+
+  if (map->iterating == 0)
+    {
+      table_free (t);
+      return;
+    }
+  r = HM_MALLOC (sizeof (struct RetiredTable));
+  r->table = *t;
+  r->next = map->retired;
+  map->retired = r;
+  t->tags = NULL;
+  t->entries = NULL;
+}
+
+/**
+ * Mark the start of an iteration.
+ */
+static void
+iteration_begin (const struct GNUNET_MultiHashMap *map)
+{
+  ((struct GNUNET_MultiHashMap *) map)->iterating++;
+}
+
+/**
+ * Mark the end of an iteration and release tables
+ * that were retired during the iteration.
+ */
+static void
+iteration_end (const struct GNUNET_MultiHashMap *map)
+{
+  struct GNUNET_MultiHashMap *m = (struct GNUNET_MultiHashMap *) map;
+  struct RetiredTable *r;
+
+  m->iterating--;
+  if (m->iterating > 0)
+    return;
+  while (NULL != (r = m->retired))
+    {
+      m->retired = r->next;
+      table_free (&r->table);
+      HM_FREE (r);
+    }
+}
+
+/**
+ * Store an entry in the first free slot of its probe sequence.
+ * The table must have a free slot.
+ */
+static void
+table_insert (struct Table *t, unsigned int tag,
+              const GNUNET_HashCode * key, void *value)
+{
+  unsigned int mask;
+  unsigned int i;
+
+  mask = t->length - 1;
+  i = tag & mask;
+  while (t->tags[i] > TAG_DELETED)
+    i = (i + 1) & mask;
+  if (t->tags[i] == TAG_EMPTY)
+    t->used++;
+  t->tags[i] = tag;
+  t->entries[i].key = *key;
+  t->entries[i].value = value;
+}
+
+/**
+ * Remove the entry in the given slot.  If the slot is at the end
+ * of a probe sequence, it (and deleted slots before it) can be
+ * marked as empty; otherwise it must be marked as deleted.
+ */
+static void
+table_delete (struct Table *t, unsigned int i)
+{
+  unsigned int mask;
+
+  mask = t->length - 1;
+  if (t->tags[(i + 1) & mask] != TAG_EMPTY)
+    {
+      t->tags[i] = TAG_DELETED;
+      return;
+    }
+  t->tags[i] = TAG_EMPTY;
+  t->used--;
+  i = (i - 1) & mask;
+  while (t->tags[i] == TAG_DELETED)
+    {
+      t->tags[i] = TAG_EMPTY;
+      t->used--;
+      i = (i - 1) & mask;
+    }
+}
+
+/**
+ * Find the next slot with the given key.
+ *
+ * @param t table to search
+ * @param tag tag of the key
+ * @param key the key
+ * @param pos slot to start probing at; set to the slot
+ *        of the match
+ * @return GNUNET_YES if a match was found
+ */
+static int
+table_find (const struct Table *t, unsigned int tag,
+            const GNUNET_HashCode * key, unsigned int *pos)
+{
+  unsigned int mask;
+  unsigned int i;
+  unsigned int n;
+
+  if (t->tags == NULL)
+    return GNUNET_NO;
+  mask = t->length - 1;
+  i = *pos & mask;
+  for (n = 0; n < t->length; n++)
+    {
+      if (t->tags[i] == TAG_EMPTY)
+        return GNUNET_NO;
+      if ((t->tags[i] == tag) &&
+          (0 == memcmp (key, &t->entries[i].key, sizeof (GNUNET_HashCode))))
+        {
+          *pos = i;
+          return GNUNET_YES;
+        }
+      i = (i + 1) & mask;
+    }
+  return GNUNET_NO;
+}
+
+/**
+ * Move up to "steps" slots from the old table to the current
+ * table; releases the old table once it is empty.
+ */
+static void
+migrate (struct GNUNET_MultiHashMap *map, unsigned int steps)
+{
+  struct Table *old;
+  unsigned int i;
+
+  old = &map->old;
+  if (old->tags == NULL)
+    return;
+  while ((steps > 0) && (map->migrate_pos < old->length))
+    {
+      i = map->migrate_pos++;
+      if (old->tags[i] > TAG_DELETED)
+        {
+          table_insert (&map->cur, old->tags[i],
+                        &old->entries[i].key, old->entries[i].value);
+          /* iterations over the old table must not see it again;
+             TAG_EMPTY would cut the probe sequences of entries
+             that have not been migrated yet */
+          old->tags[i] = TAG_DELETED;
+        }
+      steps--;
+    }
+  if (map->migrate_pos == old->length)
+    table_retire (map, old);
+}
+
+/**
+ * Move all entries of a table into a new table.
+ */
+static void
+move_all (struct Table *dst, struct Table *src)
+{
+  unsigned int i;
+
+  for (i = 0; i < src->length; i++)
+    {
+      if (src->tags[i] <= TAG_DELETED)
+        continue;
+      table_insert (dst, src->tags[i],
+                    &src->entries[i].key, src->entries[i].value);
+      src->tags[i] = TAG_DELETED;
+    }
+}
+
+/**
+ * The current table is too full; start moving the entries to a new
+ * table that is at most half full.  If the table is mostly filled
+ * with deleted slots, the new table has the same size.
+ */
+static void
+start_resize (struct GNUNET_MultiHashMap *map)
+{
+  struct Table t;
+  unsigned int length;
+
+  length = map->cur.length;
+  while ((map->size + 1) * 2 > length)
+    length *= 2;
+  if (map->old.tags != NULL)
+    {
+      /* previous migration did not finish (iterations
+         stopped it); move everything at once */
+      table_init (&t, length);
+      move_all (&t, &map->old);
+      move_all (&t, &map->cur);
+      table_retire (map, &map->old);
+      table_retire (map, &map->cur);
+      map->cur = t;
+      return;
+    }
+  map->old = map->cur;
+  map->migrate_pos = 0;
+  table_init (&map->cur, length);
+}
+
 struct GNUNET_MultiHashMap *
 GNUNET_multi_hash_map_create (unsigned int len)
 {
   struct GNUNET_MultiHashMap *ret;
+  unsigned int length;
 
+  length = MIN_LENGTH;
+  while (length < len)
+    length *= 2;
   ret = HM_MALLOC (sizeof (struct GNUNET_MultiHashMap));
-  ret->size = 0;
-  ret->map = HM_MALLOC (len * sizeof (struct MapEntry *));
-  memset (ret->map, 0, len * sizeof (struct MapEntry *));
-  ret->map_length = len;
+  memset (ret, 0, sizeof (struct GNUNET_MultiHashMap));
+  table_init (&ret->cur, length);
   return ret;
 }
 
 void
 GNUNET_multi_hash_map_destroy (struct GNUNET_MultiHashMap *map)
 {
-  unsigned int i;
-  struct MapEntry *e;
+  struct RetiredTable *r;
 
-  for (i = 0; i < map->map_length; i++)
+  table_free (&map->cur);
+  if (map->old.tags != NULL)
+    table_free (&map->old);
+  while (NULL != (r = map->retired))
     {
-      while (NULL != (e = map->map[i]))
-        {
-          map->map[i] = e->next;
-          HM_FREE (e);
-        }
+      map->retired = r->next;
+      table_free (&r->table);
+      HM_FREE (r);
     }
-  HM_FREE (map->map);
   HM_FREE (map);
 }
 
-static unsigned int
-idx_of (const struct GNUNET_MultiHashMap *m, const GNUNET_HashCode * key)
-{
-  return (*(unsigned int *) key) % m->map_length;
-}
-
 unsigned int
 GNUNET_multi_hash_map_size (const struct GNUNET_MultiHashMap *map)
 {
@@ -101,15 +448,16 @@ void *
 GNUNET_multi_hash_map_get (const struct GNUNET_MultiHashMap *map,
                            const GNUNET_HashCode * key)
 {
-  struct MapEntry *e;
+  unsigned int tag;
+  unsigned int i;
 
-  e = map->map[idx_of (map, key)];
-  while (e != NULL)
-    {
-      if (0 == memcmp (key, &e->key, sizeof (GNUNET_HashCode)))
-        return e->value;
-      e = e->next;
-    }
+  tag = tag_of (key);
+  i = tag;
+  if (table_find (&map->cur, tag, key, &i))
+    return map->cur.entries[i].value;
+  i = tag;
+  if (table_find (&map->old, tag, key, &i))
+    return map->old.entries[i].value;
   return NULL;
 }
 
@@ -117,24 +465,34 @@ int
 GNUNET_multi_hash_map_iterate (const struct GNUNET_MultiHashMap *map,
                                GNUNET_HashMapIterator it, void *cls)
 {
+  struct Table tables[2];
   int count;
   unsigned int i;
-  struct MapEntry *e;
-  struct MapEntry *nxt;
+  unsigned int t;
 
   count = 0;
-  for (i = 0; i < map->map_length; i++)
+  iteration_begin (map);
+  tables[0] = map->old;
+  tables[1] = map->cur;
+  for (t = 0; t < 2; t++)
     {
-      e = map->map[i];
-      while (e != NULL)
+      if (tables[t].tags == NULL)
+        continue;
+      for (i = 0; i < tables[t].length; i++)
         {
-	  nxt = e->next;
-          if ((NULL != it) && (GNUNET_OK != it (&e->key, e->value, cls)))
-            return GNUNET_SYSERR;
+          if (tables[t].tags[i] <= TAG_DELETED)
+            continue;
+          if ((NULL != it) &&
+              (GNUNET_OK != it (&tables[t].entries[i].key,
+                                tables[t].entries[i].value, cls)))
+            {
+              iteration_end (map);
+              return GNUNET_SYSERR;
+            }
           count++;
-          e = nxt;
         }
     }
+  iteration_end (map);
   return count;
 }
 
@@ -142,28 +500,27 @@ int
 GNUNET_multi_hash_map_remove (struct GNUNET_MultiHashMap *map,
                               const GNUNET_HashCode * key, void *value)
 {
-  struct MapEntry *e;
-  struct MapEntry *p;
+  struct Table *tables[2];
+  unsigned int tag;
   unsigned int i;
+  unsigned int t;
 
-  i = idx_of (map, key);
-  p = NULL;
-  e = map->map[i];
-  while (e != NULL)
+  tag = tag_of (key);
+  tables[0] = &map->cur;
+  tables[1] = &map->old;
+  for (t = 0; t < 2; t++)
     {
-      if ((0 == memcmp (key, &e->key, sizeof (GNUNET_HashCode))) &&
-          (value == e->value))
+      i = tag;
+      while (table_find (tables[t], tag, key, &i))
         {
-          if (p == NULL)
-            map->map[i] = e->next;
-          else
-            p->next = e->next;
-          HM_FREE (e);
-          map->size--;
-          return GNUNET_YES;
+          if (tables[t]->entries[i].value == value)
+            {
+              table_delete (tables[t], i);
+              map->size--;
+              return GNUNET_YES;
+            }
+          i++;
         }
-      p = e;
-      e = e->next;
     }
   return GNUNET_NO;
 }
@@ -172,35 +529,25 @@ int
 GNUNET_multi_hash_map_remove_all (struct GNUNET_MultiHashMap *map,
                                   const GNUNET_HashCode * key)
 {
-  struct MapEntry *e;
-  struct MapEntry *p;
+  struct Table *tables[2];
+  unsigned int tag;
   unsigned int i;
+  unsigned int t;
   int ret;
 
   ret = 0;
-  i = idx_of (map, key);
-  p = NULL;
-  e = map->map[i];
-  while (e != NULL)
+  tag = tag_of (key);
+  tables[0] = &map->cur;
+  tables[1] = &map->old;
+  for (t = 0; t < 2; t++)
     {
-      if (0 == memcmp (key, &e->key, sizeof (GNUNET_HashCode)))
+      i = tag;
+      while (table_find (tables[t], tag, key, &i))
         {
-          if (p == NULL)
-            map->map[i] = e->next;
-          else
-            p->next = e->next;
-          HM_FREE (e);
+          table_delete (tables[t], i);
           map->size--;
-          if (p == NULL)
-            e = map->map[i];
-          else
-            e = p->next;
           ret++;
-        }
-      else
-        {
-          p = e;
-          e = e->next;
+          i++;
         }
     }
   return ret;
@@ -210,81 +557,56 @@ int
 GNUNET_multi_hash_map_contains (const struct GNUNET_MultiHashMap *map,
                                 const GNUNET_HashCode * key)
 {
-  struct MapEntry *e;
+  unsigned int tag;
   unsigned int i;
 
-  i = idx_of (map, key);
-  e = map->map[i];
-  while (e != NULL)
-    {
-      if (0 == memcmp (key, &e->key, sizeof (GNUNET_HashCode)))
-        return GNUNET_YES;
-      e = e->next;
-    }
+  tag = tag_of (key);
+  i = tag;
+  if (table_find (&map->cur, tag, key, &i))
+    return GNUNET_YES;
+  i = tag;
+  if (table_find (&map->old, tag, key, &i))
+    return GNUNET_YES;
   return GNUNET_NO;
 }
 
-static void
-grow (struct GNUNET_MultiHashMap *map)
-{
-  struct MapEntry **old;
-  struct MapEntry *e;
-  unsigned int i;
-  unsigned int l;
-
-  old = map->map;
-  l = map->map_length;
-  map->map_length *= 2;
-  map->map = HM_MALLOC (sizeof (struct MapEntry *) * map->map_length);
-  memset (map->map, 0, sizeof (struct MapEntry *) * map->map_length);
-  for (i = 0; i < l; i++)
-    {
-      while (NULL != (e = old[i]))
-        {
-          old[i] = e->next;
-          e->next = map->map[idx_of (map, &e->key)];
-          map->map[idx_of (map, &e->key)] = e;
-        }
-    }
-  HM_FREE (old);
-}
-
 int
 GNUNET_multi_hash_map_put (struct GNUNET_MultiHashMap *map,
                            const GNUNET_HashCode * key,
                            void *value, enum GNUNET_MultiHashMapOption opt)
 {
-  struct MapEntry *e;
+  struct Table *tables[2];
+  unsigned int tag;
   unsigned int i;
+  unsigned int t;
 
-  i = idx_of (map, key);
+  tag = tag_of (key);
   if ((opt != GNUNET_MultiHashMapOption_MULTIPLE) &&
       (opt != GNUNET_MultiHashMapOption_UNIQUE_FAST))
     {
-      e = map->map[i];
-      while (e != NULL)
+      tables[0] = &map->cur;
+      tables[1] = &map->old;
+      for (t = 0; t < 2; t++)
         {
-          if ((0 == memcmp (key, &e->key, sizeof (GNUNET_HashCode))) &&
-              (value == e->value))
+          i = tag;
+          while (table_find (tables[t], tag, key, &i))
             {
-              if (opt == GNUNET_MultiHashMapOption_UNIQUE_ONLY)
-                return GNUNET_SYSERR;
-              e->value = value;
-              return GNUNET_NO;
+              if (tables[t]->entries[i].value == value)
+                {
+                  if (opt == GNUNET_MultiHashMapOption_UNIQUE_ONLY)
+                    return GNUNET_SYSERR;
+                  tables[t]->entries[i].value = value;
+                  return GNUNET_NO;
+                }
+              i++;
             }
-          e = e->next;
         }
     }
-  if (map->size / 3 > map->map_length / 4)
-    {
-      grow (map);
-      i = idx_of (map, key);
-    }
-  e = HM_MALLOC (sizeof (struct MapEntry));
-  e->key = *key;
-  e->value = value;
-  e->next = map->map[i];
-  map->map[i] = e;
+  if (map->iterating == 0)
+    migrate (map, MIGRATE_STEP);
+  if ((map->cur.used + 1) * 4 > map->cur.length * 3)
+    start_resize (map);
+  table_insert (&map->cur, tag, key, value);
   map->size++;
   return GNUNET_OK;
 }
@@ -294,59 +616,60 @@ GNUNET_multi_hash_map_get_multiple (const struct GNUNET_MultiHashMap *map,
                                     const GNUNET_HashCode * key,
                                     GNUNET_HashMapIterator it, void *cls)
 {
+  struct Table tables[2];
+  unsigned int tag;
+  unsigned int i;
+  unsigned int t;
   int count;
-  struct MapEntry *e;
 
   count = 0;
-  e = map->map[idx_of (map, key)];
-  while (e != NULL)
+  tag = tag_of (key);
+  iteration_begin (map);
+  tables[0] = map->cur;
+  tables[1] = map->old;
+  for (t = 0; t < 2; t++)
     {
-      if (0 == memcmp (key, &e->key, sizeof (GNUNET_HashCode)))
+      i = tag;
+      while (table_find (&tables[t], tag, key, &i))
         {
-          if ((it != NULL) && (GNUNET_OK != it (&e->key, e->value, cls)))
-            return GNUNET_SYSERR;
+          if ((it != NULL) &&
+              (GNUNET_OK != it (&tables[t].entries[i].key,
+                                tables[t].entries[i].value, cls)))
+            {
+              iteration_end (map);
+              return GNUNET_SYSERR;
+            }
           count++;
+          i++;
         }
-      e = e->next;
     }
+  iteration_end (map);
   return count;
 }
 
 void *
 GNUNET_multi_hash_map_get_random (const struct GNUNET_MultiHashMap *map)
 {
+  unsigned int old_length;
   unsigned int rand;
-  unsigned int rand_entry;
-  unsigned int count;
-  struct MapEntry *e;
-  e = NULL;
 
   if (map->size == 0)
     return NULL;
-
-  while (e == NULL)
+  old_length = (map->old.tags != NULL) ? map->old.length : 0;
+  while (1)
     {
-      rand = GNUNET_random_u32 (GNUNET_RANDOM_QUALITY_WEAK, map->map_length);
-      e = map->map[rand];
-    }
-
-  count = 0;
-  while (e != NULL)
-    {
-      e = e->next;
-      count++;
-    }
-
-  rand_entry = GNUNET_random_u32 (GNUNET_RANDOM_QUALITY_WEAK, count);
-  e = map->map[rand];
-  count = 0;
-  while (count < rand_entry)
-    {
-      e = e->next;
-      count++;
+      rand = GNUNET_random_u32 (GNUNET_RANDOM_QUALITY_WEAK,
+                                map->cur.length + old_length);
+      if (rand < old_length)
+        {
+          if (map->old.tags[rand] > TAG_DELETED)
+            return map->old.entries[rand].value;
+        }
+      else if (map->cur.tags[rand - old_length] > TAG_DELETED)
+        {
+          return map->cur.entries[rand - old_length].value;
+        }
     }
-
-  return e->value;
 }
 
 /* end of multihashmap.c */
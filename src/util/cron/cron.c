@@ -23,15 +23,28 @@
  * @author Christian Grothoff
  * @brief Module for periodic background (cron) jobs.
  *
- * The module only uses one thread, thus every cron-job must be
- * short-lived, should never block for an indefinite amount of
- * time. Specified deadlines are only a guide-line, the 10ms
- * timer-resolution is only an upper-bound on the possible precision,
- * in practice it will be worse (depending on the other cron-jobs).
+ * Jobs added with GNUNET_cron_add_job run one after the other on the
+ * cron thread, thus every such cron-job must be short-lived, should
+ * never block for an indefinite amount of time. Specified deadlines
+ * are only a guide-line, the 10ms timer-resolution is only an
+ * upper-bound on the possible precision, in practice it will be worse
+ * (depending on the other cron-jobs).
  *
- * If you need to schedule a long-running or blocking cron-job,
- * run a function that will start another thread that will
- * then run the actual job.
+ * Jobs added with GNUNET_cron_add_parallel_job are handed to a pool
+ * of worker threads (if GNUNET_cron_set_workers was used to create
+ * one), so slow jobs of this kind do not delay the other jobs.  Such
+ * jobs must do their own locking.  A periodic parallel job never runs
+ * twice at the same time; if it is still running when it is due
+ * again, that run is skipped.  For every job, the manager records
+ * how late it was started (see GNUNET_cron_get_lateness).
+ *
+ * Jobs are kept in a hierarchical timing wheel: WHEEL_LEVELS levels
+ * of WHEEL_SLOTS slots each, where a slot of level L covers
+ * WHEEL_SLOTS^L milliseconds.  A job is put into the lowest level
+ * whose range covers its deadline; when the wheel reaches a slot of
+ * a higher level, the jobs in it are moved (cascaded) to the lower
+ * levels.  Jobs are also in a hash table by (method, data, repeat),
+ * so adding, deleting and advancing jobs takes constant time.
  */
 
 #include "gnunet_util.h"
@@ -80,7 +93,30 @@
 
 
 /**
- * @brief The Delta-list for the cron jobs.
+ * Number of bits of the deadline used per level of the wheel.
+ */
+#define WHEEL_BITS 6
+
+/**
+ * Number of slots per level of the wheel.
+ */
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+
+/**
+ * Number of levels of the wheel (covers 2^36 ms, more than
+ * the largest delay that can be passed to add_job).
+ */
+#define WHEEL_LEVELS 6
+
+/**
+ * Is the job an ordinary cron job or can it run on a worker?
+ */
+#define JOB_SERIAL 0
+
+#define JOB_PARALLEL 1
+
+/**
+ * @brief Entry for a cron job.
  */
 typedef struct
 {
@@ -107,26 +143,130 @@ typedef struct
   unsigned int deltaRepeat;
 
   /**
-   * The index of the next entry in the delta list
-   * after this one (-1 for none)
+   * The index of the next entry in the slot of the wheel
+   * (or in the free list) after this one (-1 for none)
    */
   int next;
 
+  /**
+   * The index of the previous entry in the slot of the
+   * wheel (-1 for none)
+   */
+  int prev;
+
+  /**
+   * Next and previous entry in the hash chain.
+   */
+  int hnext;
+
+  int hprev;
+
+  /**
+   * Slot of the wheel (level * WHEEL_SLOTS + index)
+   * holding this entry, -1 if the entry is free.
+   */
+  int slot;
+
+  /**
+   * JOB_SERIAL or JOB_PARALLEL.
+   */
+  int affinity;
+
 } UTIL_cron_DeltaListEntry;
 
+/**
+ * A parallel job that is due and waiting for a worker.
+ */
+struct CronWorkItem
+{
+  struct CronWorkItem *next;
+
+  GNUNET_CronJob method;
+
+  void *data;
+
+  unsigned int deltaRepeat;
+
+  /**
+   * When was the job supposed to run?
+   */
+  GNUNET_CronTime scheduled;
+};
+
+/**
+ * A worker thread for parallel jobs.
+ */
+struct CronWorker
+{
+  struct GNUNET_CronManager *cron;
+
+  struct GNUNET_ThreadHandle *thread;
+
+  /**
+   * The job that the worker is running (method is NULL
+   * if the worker is idle).
+   */
+  GNUNET_CronJob method;
+
+  void *data;
+
+  unsigned int deltaRepeat;
+};
+
+/**
+ * A slot of the timing wheel.
+ */
+typedef struct
+{
+  /**
+   * First and last job in the slot (-1 for none).
+   */
+  int head;
+
+  int tail;
+
+} UTIL_cron_WheelSlot;
+
 typedef struct GNUNET_CronManager
 {
 
   /**
-   * The lock for the delta-list.
+   * The lock for the job table.
    */
   struct GNUNET_Mutex *deltaListLock_;
 
   /**
-   * The delta-list of waiting tasks.
+   * The table of job entries.
    */
   UTIL_cron_DeltaListEntry *deltaList_;
 
+  /**
+   * The slots of the timing wheel.
+   */
+  UTIL_cron_WheelSlot wheel_[WHEEL_LEVELS * WHEEL_SLOTS];
+
+  /**
+   * Bitmap of the non-empty slots for each level.
+   */
+  unsigned long long occupied_[WHEEL_LEVELS];
+
+  /**
+   * Heads of the hash chains (indexed by the hash of
+   * method, data and repeat).
+   */
+  int *hashTable_;
+
+  /**
+   * Time up to which the wheel has been processed.
+   */
+  GNUNET_CronTime wheelTime_;
+
+  /**
+   * When does the cron thread plan to wake up next
+   * (0 if it is not sleeping)?
+   */
+  GNUNET_CronTime nextWakeup_;
+
   /**
    * The currently running job.
    */
@@ -150,20 +290,16 @@ typedef struct GNUNET_CronManager
   unsigned int runningRepeat_;
 
   /**
-   * The current size of the DeltaList.
+   * The current size of the job table (and of
+   * the hash table).
    */
   unsigned int deltaListSize_;
 
   /**
-   * The first empty slot in the delta-list.
+   * The first empty slot in the job table.
    */
   int firstFree_;
 
-  /**
-   * The first empty slot in the delta-list.
-   */
-  int firstUsed_;
-
   /**
    * Set to yes if we are shutting down or shut down.
    */
@@ -176,9 +312,508 @@ typedef struct GNUNET_CronManager
 
   struct GNUNET_Semaphore *sig;
 
+  /**
+   * The worker threads (NULL if there are none).
+   */
+  struct CronWorker *workers_;
+
+  /**
+   * Number of worker threads.
+   */
+  unsigned int workerCount_;
+
+  /**
+   * Parallel jobs waiting for a worker.
+   */
+  struct CronWorkItem *workHead_;
+
+  struct CronWorkItem *workTail_;
+
+  /**
+   * Counts the items in the work queue (plus one for
+   * each worker when the workers are told to exit).
+   */
+  struct GNUNET_Semaphore *workSignal_;
+
+  /**
+   * Signalled when a worker completes a job and
+   * there are waiters.
+   */
+  struct GNUNET_Semaphore *workDone_;
+
+  /**
+   * Number of threads waiting for workDone_.
+   */
+  unsigned int workWaiters_;
+
+  /**
+   * Set to GNUNET_YES to make the workers exit once the
+   * work queue is empty.
+   */
+  int workerShutdown_;
+
+  /**
+   * Histogram of how late jobs were started.
+   */
+  unsigned long long lateness_[GNUNET_CRON_LATENESS_BUCKETS];
+
 } CronManager;
 
 
+/**
+ * Compute the hash chain for a job.
+ */
+static unsigned int
+hash_job (const struct GNUNET_CronManager *cron,
+          GNUNET_CronJob method, unsigned int repeat, void *data)
+{
+  unsigned long long h;
+
+  h = (unsigned long long) (size_t) method;
+  h = h * 31 + (unsigned long long) (size_t) data;
+  h = h * 31 + repeat;
+  h *= 0x9E3779B97F4A7C15ULL;
+  return (unsigned int) (h >> 32) & (cron->deltaListSize_ - 1);
+}
+
+/**
+ * Add an entry to its hash chain.
+ */
+static void
+hash_insert (struct GNUNET_CronManager *cron, int jobId)
+{
+  UTIL_cron_DeltaListEntry *job;
+  unsigned int h;
+
+  job = &cron->deltaList_[jobId];
+  h = hash_job (cron, job->method, job->deltaRepeat, job->data);
+  job->hprev = -1;
+  job->hnext = cron->hashTable_[h];
+  if (job->hnext != -1)
+    cron->deltaList_[job->hnext].hprev = jobId;
+  cron->hashTable_[h] = jobId;
+}
+
+/**
+ * Remove an entry from its hash chain.
+ */
+static void
+hash_remove (struct GNUNET_CronManager *cron, int jobId)
+{
+  UTIL_cron_DeltaListEntry *job;
+
+  job = &cron->deltaList_[jobId];
+  if (job->hprev != -1)
+    cron->deltaList_[job->hprev].hnext = job->hnext;
+  else
+    cron->hashTable_[hash_job (cron, job->method, job->deltaRepeat,
+                               job->data)] = job->hnext;
+  if (job->hnext != -1)
+    cron->deltaList_[job->hnext].hprev = job->hprev;
+}
+
+/**
+ * Find a job by method, repeat and data.
+ *
+ * @return index of the job, -1 if there is no such job
+ */
+static int
+hash_find (struct GNUNET_CronManager *cron,
+           GNUNET_CronJob method, unsigned int repeat, void *data)
+{
+  int jobId;
+  UTIL_cron_DeltaListEntry *job;
+
+  jobId = cron->hashTable_[hash_job (cron, method, repeat, data)];
+  while (jobId != -1)
+    {
+      job = &cron->deltaList_[jobId];
+      if ((job->method == method) &&
+          (job->data == data) && (job->deltaRepeat == repeat))
+        return jobId;
+      jobId = job->hnext;
+    }
+  return -1;
+}
+
+/**
+ * Put a job into the slot of the wheel for its deadline.
+ */
+static void
+wheel_insert (struct GNUNET_CronManager *cron, int jobId)
+{
+  UTIL_cron_DeltaListEntry *job;
+  UTIL_cron_WheelSlot *slot;
+  unsigned int level;
+  unsigned int idx;
+
+  job = &cron->deltaList_[jobId];
+  if (job->delta <= cron->wheelTime_)
+    {
+      /* due now (or the clock went backwards) */
+      level = 0;
+      idx = cron->wheelTime_ & (WHEEL_SLOTS - 1);
+    }
+  else
+    {
+      /* lowest level on which the job is less than a full
+         rotation of the wheel away */
+      level = 0;
+      while ((level < WHEEL_LEVELS - 1) &&
+             ((job->delta >> (WHEEL_BITS * level)) -
+              (cron->wheelTime_ >> (WHEEL_BITS * level)) >= WHEEL_SLOTS))
+        level++;
+      if ((job->delta >> (WHEEL_BITS * level)) -
+          (cron->wheelTime_ >> (WHEEL_BITS * level)) >= WHEEL_SLOTS)
+        /* beyond the wheel; park in the last slot of the top level */
+        idx = ((cron->wheelTime_ >> (WHEEL_BITS * level)) - 1)
+          & (WHEEL_SLOTS - 1);
+      else
+        idx = (job->delta >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1);
+    }
+  job->slot = level * WHEEL_SLOTS + idx;
+  slot = &cron->wheel_[job->slot];
+  job->next = -1;
+  job->prev = slot->tail;
+  if (slot->tail != -1)
+    cron->deltaList_[slot->tail].next = jobId;
+  else
+    slot->head = jobId;
+  slot->tail = jobId;
+  cron->occupied_[level] |= 1ULL << idx;
+}
+
+/**
+ * Take a job out of its slot of the wheel.
+ */
+static void
+wheel_remove (struct GNUNET_CronManager *cron, int jobId)
+{
+  UTIL_cron_DeltaListEntry *job;
+  UTIL_cron_WheelSlot *slot;
+
+  job = &cron->deltaList_[jobId];
+  slot = &cron->wheel_[job->slot];
+  if (job->prev != -1)
+    cron->deltaList_[job->prev].next = job->next;
+  else
+    slot->head = job->next;
+  if (job->next != -1)
+    cron->deltaList_[job->next].prev = job->prev;
+  else
+    slot->tail = job->prev;
+  if (slot->head == -1)
+    cron->occupied_[job->slot / WHEEL_SLOTS] &=
+      ~(1ULL << (job->slot % WHEEL_SLOTS));
+  job->slot = -1;
+}
+
+/**
+ * Remove a job from the wheel and the hash table and
+ * put its entry on the free list.
+ */
+static void
+free_job (struct GNUNET_CronManager *cron, int jobId)
+{
+  UTIL_cron_DeltaListEntry *job;
+
+  job = &cron->deltaList_[jobId];
+  wheel_remove (cron, jobId);
+  hash_remove (cron, jobId);
+  job->method = NULL;
+  job->data = NULL;
+  job->deltaRepeat = 0;
+  job->affinity = JOB_SERIAL;
+  job->next = cron->firstFree_;
+  cron->firstFree_ = jobId;
+}
+
+/**
+ * Double the size of the job table and the hash table.
+ */
+static void
+grow_table (struct GNUNET_CronManager *cron)
+{
+  unsigned int i;
+
+  GNUNET_array_grow (cron->deltaList_, cron->deltaListSize_,
+                     cron->deltaListSize_ * 2);
+  for (i = cron->deltaListSize_ / 2; i < cron->deltaListSize_; i++)
+    {
+      cron->deltaList_[i].next = i - 1;
+      cron->deltaList_[i].slot = -1;
+    }
+  cron->deltaList_[cron->deltaListSize_ / 2].next = -1;
+  cron->firstFree_ = cron->deltaListSize_ - 1;
+  GNUNET_free (cron->hashTable_);
+  cron->hashTable_ = GNUNET_malloc (sizeof (int) * cron->deltaListSize_);
+  for (i = 0; i < cron->deltaListSize_; i++)
+    cron->hashTable_[i] = -1;
+  for (i = 0; i < cron->deltaListSize_ / 2; i++)
+    if (cron->deltaList_[i].slot != -1)
+      hash_insert (cron, i);
+}
+
+/**
+ * Compute the earliest time at which the wheel has work to do:
+ * the start of the first non-empty slot on any level.
+ *
+ * @return (GNUNET_CronTime) -1 if there are no jobs
+ */
+static GNUNET_CronTime
+wheel_next_event (const struct GNUNET_CronManager *cron)
+{
+  GNUNET_CronTime best;
+  GNUNET_CronTime start;
+  unsigned long long bits;
+  unsigned int level;
+  unsigned int cur;
+  unsigned int k;
+
+  best = (GNUNET_CronTime) - 1;
+  for (level = 0; level < WHEEL_LEVELS; level++)
+    {
+      bits = cron->occupied_[level];
+      if (bits == 0)
+        continue;
+      cur = (cron->wheelTime_ >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1);
+      /* rotate so that bit 0 is the current slot */
+      if (cur != 0)
+        bits = (bits >> cur) | (bits << (WHEEL_SLOTS - cur));
+      k = 0;
+      while (0 == (bits & (1ULL << k)))
+        k++;
+      if (level == 0)
+        start = cron->wheelTime_ + k;
+      else
+        start = ((cron->wheelTime_ >> (WHEEL_BITS * level)) + k)
+          << (WHEEL_BITS * level);
+      if (start < best)
+        best = start;
+    }
+  return best;
+}
+
+/**
+ * Move the jobs of the current slots of the higher levels of the
+ * wheel to the lower levels (called when the wheel reaches the
+ * start of those slots).
+ */
+static void
+wheel_cascade (struct GNUNET_CronManager *cron)
+{
+  UTIL_cron_WheelSlot *slot;
+  unsigned int level;
+  unsigned int idx;
+  int jobId;
+
+  level = 1;
+  while ((level < WHEEL_LEVELS) &&
+         (0 == (cron->wheelTime_ &
+                ((1ULL << (WHEEL_BITS * level)) - 1))))
+    level++;
+  /* levels 1 .. level-1 start a new slot now; move the
+     jobs down, starting from the highest level */
+  while (--level > 0)
+    {
+      idx = (cron->wheelTime_ >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1);
+      slot = &cron->wheel_[level * WHEEL_SLOTS + idx];
+      while (-1 != (jobId = slot->head))
+        {
+          wheel_remove (cron, jobId);
+          wheel_insert (cron, jobId);
+        }
+    }
+}
+
+/**
+ * Advance the wheel towards the given time.  Stops at the first
+ * slot of level 0 that has jobs (or at "now").
+ *
+ * @return GNUNET_YES if the current slot of level 0 has
+ *         jobs that are due
+ */
+static int
+wheel_advance (struct GNUNET_CronManager *cron, GNUNET_CronTime now)
+{
+  GNUNET_CronTime next;
+
+  while (1)
+    {
+      if (-1 != cron->wheel_[cron->wheelTime_ & (WHEEL_SLOTS - 1)].head)
+        return GNUNET_YES;
+      if (cron->wheelTime_ >= now)
+        return GNUNET_NO;
+      next = wheel_next_event (cron);
+      if (next > now)
+        {
+          /* nothing happens until after now; all slots
+             we skip are empty */
+          cron->wheelTime_ = now;
+          return GNUNET_NO;
+        }
+      cron->wheelTime_ = next;
+      wheel_cascade (cron);
+    }
+}
+
+/**
+ * Record in the lateness histogram that a job that was
+ * scheduled for the given time is started now.  The
+ * caller must hold the lock.
+ */
+static void
+record_lateness (struct GNUNET_CronManager *cron,
+                 GNUNET_CronTime scheduled, GNUNET_CronTime now)
+{
+  GNUNET_CronTime late;
+  unsigned int bucket;
+
+  late = (now > scheduled) ? now - scheduled : 0;
+  bucket = 0;
+  while ((late > 0) && (bucket < GNUNET_CRON_LATENESS_BUCKETS - 1))
+    {
+      late >>= 1;
+      bucket++;
+    }
+  cron->lateness_[bucket]++;
+}
+
+/**
+ * Are there no jobs on the wheel?  The caller must hold the lock.
+ */
+static int
+queue_empty (struct GNUNET_CronManager *cron)
+{
+  unsigned int level;
+
+  for (level = 0; level < WHEEL_LEVELS; level++)
+    if (cron->occupied_[level] != 0)
+      return GNUNET_NO;
+  return GNUNET_YES;
+}
+
+/**
+ * Is the given job running on a worker or waiting for one?
+ * The caller must hold the lock.
+ */
+static int
+job_in_flight (struct GNUNET_CronManager *cron,
+               GNUNET_CronJob method, unsigned int repeat, void *data)
+{
+  struct CronWorkItem *item;
+  unsigned int i;
+
+  for (i = 0; i < cron->workerCount_; i++)
+    if ((cron->workers_[i].method == method) &&
+        (cron->workers_[i].data == data) &&
+        (cron->workers_[i].deltaRepeat == repeat))
+      return GNUNET_YES;
+  for (item = cron->workHead_; item != NULL; item = item->next)
+    if ((item->method == method) &&
+        (item->data == data) && (item->deltaRepeat == repeat))
+      return GNUNET_YES;
+  return GNUNET_NO;
+}
+
+/**
+ * Is the calling thread the cron thread or one of the workers?
+ */
+static int
+test_self (struct GNUNET_CronManager *cron)
+{
+  unsigned int i;
+
+  if (GNUNET_NO != GNUNET_thread_test_self (cron->cron_handle))
+    return GNUNET_YES;
+  for (i = 0; i < cron->workerCount_; i++)
+    if ((cron->workers_[i].thread != NULL) &&
+        (GNUNET_NO != GNUNET_thread_test_self (cron->workers_[i].thread)))
+      return GNUNET_YES;
+  return GNUNET_NO;
+}
+
+/**
+ * Wait until the workers have run all queued jobs and
+ * are idle.  The caller must hold the lock (it is released
+ * while waiting).
+ */
+static void
+wait_for_workers (struct GNUNET_CronManager *cron)
+{
+  unsigned int i;
+  int busy;
+
+  while (1)
+    {
+      busy = (cron->workHead_ != NULL) ? GNUNET_YES : GNUNET_NO;
+      for (i = 0; i < cron->workerCount_; i++)
+        if (cron->workers_[i].method != NULL)
+          busy = GNUNET_YES;
+      if (busy == GNUNET_NO)
+        return;
+      cron->workWaiters_++;
+      GNUNET_mutex_unlock (cron->deltaListLock_);
+      GNUNET_semaphore_down (cron->workDone_, GNUNET_YES);
+      GNUNET_mutex_lock (cron->deltaListLock_);
+    }
+}
+
+/**
+ * Main method of a worker thread: run parallel jobs from
+ * the work queue until told to exit.
+ */
+static void *
+worker_main_method (void *ctx)
+{
+  struct CronWorker *worker = ctx;
+  struct GNUNET_CronManager *cron = worker->cron;
+  struct CronWorkItem *item;
+
+  while (1)
+    {
+      GNUNET_semaphore_down (cron->workSignal_, GNUNET_YES);
+      GNUNET_mutex_lock (cron->deltaListLock_);
+      item = cron->workHead_;
+      if (item == NULL)
+        {
+          if (cron->workerShutdown_ == GNUNET_YES)
+            {
+              GNUNET_mutex_unlock (cron->deltaListLock_);
+              break;
+            }
+          GNUNET_mutex_unlock (cron->deltaListLock_);
+          continue;
+        }
+      cron->workHead_ = item->next;
+      if (cron->workHead_ == NULL)
+        cron->workTail_ = NULL;
+      worker->method = item->method;
+      worker->data = item->data;
+      worker->deltaRepeat = item->deltaRepeat;
+      record_lateness (cron, item->scheduled, GNUNET_get_time ());
+      GNUNET_mutex_unlock (cron->deltaListLock_);
+#if DEBUG_CRON
+      GNUNET_GE_LOG (cron->ectx,
+                     GNUNET_GE_STATUS | GNUNET_GE_DEVELOPER | GNUNET_GE_BULK,
+                     "worker running job %p-%p\n", item->method, item->data);
+#endif
+      item->method (item->data);
+      GNUNET_free (item);
+      GNUNET_mutex_lock (cron->deltaListLock_);
+      worker->method = NULL;
+      worker->data = NULL;
+      worker->deltaRepeat = 0;
+      while (cron->workWaiters_ > 0)
+        {
+          cron->workWaiters_--;
+          GNUNET_semaphore_up (cron->workDone_);
+        }
+      GNUNET_mutex_unlock (cron->deltaListLock_);
+    }
+  return NULL;
+}
+
 struct GNUNET_CronManager *
 GNUNET_cron_create (struct GNUNET_GE_Context *ectx)
 {
@@ -192,13 +827,25 @@ GNUNET_cron_create (struct GNUNET_GE_Context *ectx)
     =
     GNUNET_malloc (sizeof (UTIL_cron_DeltaListEntry) * cron->deltaListSize_);
   for (i = 0; i < cron->deltaListSize_; i++)
-    cron->deltaList_[i].next = i - 1;
+    {
+      cron->deltaList_[i].next = i - 1;
+      cron->deltaList_[i].slot = -1;
+    }
   cron->firstFree_ = cron->deltaListSize_ - 1;
+  cron->hashTable_ = GNUNET_malloc (sizeof (int) * cron->deltaListSize_);
+  for (i = 0; i < cron->deltaListSize_; i++)
+    cron->hashTable_[i] = -1;
+  for (i = 0; i < WHEEL_LEVELS * WHEEL_SLOTS; i++)
+    {
+      cron->wheel_[i].head = -1;
+      cron->wheel_[i].tail = -1;
+    }
+  cron->wheelTime_ = GNUNET_get_time ();
   cron->deltaListLock_ = GNUNET_mutex_create (GNUNET_YES);
   cron->inBlockLock_ = GNUNET_mutex_create (GNUNET_NO);
   cron->runningJob_ = NULL;
-  cron->firstUsed_ = -1;
   cron->cron_signal_up = GNUNET_semaphore_create (0);
+  cron->workDone_ = GNUNET_semaphore_create (0);
   cron->ectx = ectx;
   cron->cron_shutdown = GNUNET_YES;
   cron->sig = NULL;
@@ -220,6 +867,7 @@ void
 GNUNET_cron_stop (struct GNUNET_CronManager *cron)
 {
   void *unused;
+  unsigned int i;
 
 #if DEBUG_CRON
   GNUNET_GE_LOG (cron->ectx,
@@ -232,6 +880,22 @@ GNUNET_cron_stop (struct GNUNET_CronManager *cron)
   GNUNET_semaphore_destroy (cron->cron_signal);
   cron->cron_signal = NULL;
   GNUNET_thread_join (cron->cron_handle, &unused);
+  if (cron->workerCount_ > 0)
+    {
+      /* let the workers finish the queue, then exit */
+      GNUNET_mutex_lock (cron->deltaListLock_);
+      cron->workerShutdown_ = GNUNET_YES;
+      GNUNET_mutex_unlock (cron->deltaListLock_);
+      for (i = 0; i < cron->workerCount_; i++)
+        GNUNET_semaphore_up (cron->workSignal_);
+      for (i = 0; i < cron->workerCount_; i++)
+        {
+          GNUNET_thread_join (cron->workers_[i].thread, &unused);
+          cron->workers_[i].thread = NULL;
+        }
+      GNUNET_semaphore_destroy (cron->workSignal_);
+      cron->workSignal_ = NULL;
+    }
 #if DEBUG_CRON
   GNUNET_GE_LOG (NULL,
                  GNUNET_GE_STATUS | GNUNET_GE_DEVELOPER | GNUNET_GE_BULK,
@@ -249,6 +913,10 @@ block (void *cls)
   struct GNUNET_CronManager *cron = cls;
   int ok = GNUNET_SYSERR;
 
+  /* parallel jobs must not run while we are suspended either */
+  GNUNET_mutex_lock (cron->deltaListLock_);
+  wait_for_workers (cron);
+  GNUNET_mutex_unlock (cron->deltaListLock_);
   if (cron->sig != NULL)
     GNUNET_semaphore_up (cron->sig);
   while (ok == GNUNET_SYSERR)
@@ -266,11 +934,9 @@ void
 GNUNET_cron_suspend_jobs (struct GNUNET_CronManager *cron, int checkSelf)
 {
   if ((GNUNET_YES == checkSelf) &&
-      (cron->cron_shutdown == GNUNET_NO) &&
-      (GNUNET_NO != GNUNET_thread_test_self (cron->cron_handle)))
+      (cron->cron_shutdown == GNUNET_NO) && (GNUNET_YES == test_self (cron)))
     return;
-  GNUNET_GE_ASSERT (NULL,
-                    GNUNET_NO == GNUNET_thread_test_self (cron->cron_handle));
+  GNUNET_GE_ASSERT (NULL, GNUNET_NO == test_self (cron));
   GNUNET_mutex_lock (cron->inBlockLock_);
   cron->inBlock++;
   if (cron->inBlock == 1)
@@ -297,8 +963,7 @@ void
 GNUNET_cron_resume_jobs (struct GNUNET_CronManager *cron, int checkSelf)
 {
   if ((GNUNET_YES == checkSelf) &&
-      (cron->cron_shutdown == GNUNET_NO) &&
-      (GNUNET_NO != GNUNET_thread_test_self (cron->cron_handle)))
+      (cron->cron_shutdown == GNUNET_NO) && (GNUNET_YES == test_self (cron)))
     return;
   GNUNET_GE_ASSERT (NULL, cron->inBlock > 0);
   GNUNET_semaphore_up (cron->cron_signal_up);
@@ -327,29 +992,71 @@ printCronTab (struct GNUNET_CronManager *cron)
   now = GNUNET_get_time ();
   GNUNET_mutex_lock (cron->deltaListLock_);
 
-  jobId = cron->firstUsed_;
-  while (jobId != -1)
+  for (jobId = 0; jobId < cron->deltaListSize_; jobId++)
     {
       tab = &cron->deltaList_[jobId];
+      if (tab->slot == -1)
+        continue;
       GNUNET_GE_LOG (NULL,
                      GNUNET_GE_STATUS | GNUNET_GE_DEVELOPER | GNUNET_GE_BULK,
                      "%3u: delta %8lld CU --- method %p --- repeat %8u CU\n",
                      jobId, tab->delta - now, (int) tab->method,
                      tab->deltaRepeat);
-      jobId = tab->next;
     }
   GNUNET_mutex_unlock (cron->deltaListLock_);
 }
 #endif
 
+/**
+ * Add a job with the given affinity.
+ */
+static void
+add_job (struct GNUNET_CronManager *cron,
+         GNUNET_CronJob method,
+         unsigned int delta, unsigned int deltaRepeat, void *data,
+         int affinity)
+{
+  UTIL_cron_DeltaListEntry *entry;
+  int jobId;
+
+#if DEBUG_CRON
+  GNUNET_GE_LOG (cron->ectx,
+                 GNUNET_GE_STATUS | GNUNET_GE_DEVELOPER | GNUNET_GE_BULK,
+                 "Adding job %p-%p to fire in %d CU\n", method, data, delta);
+#endif
+
+  GNUNET_mutex_lock (cron->deltaListLock_);
+  if (cron->firstFree_ == -1)
+    grow_table (cron);          /* need to grow */
+  jobId = cron->firstFree_;
+  entry = &cron->deltaList_[jobId];
+  cron->firstFree_ = entry->next;
+  entry->method = method;
+  entry->data = data;
+  entry->deltaRepeat = deltaRepeat;
+  entry->affinity = affinity;
+  entry->delta = GNUNET_get_time () + delta;
+  wheel_insert (cron, jobId);
+  hash_insert (cron, jobId);
+  if ((cron->nextWakeup_ != 0) && (entry->delta < cron->nextWakeup_))
+    {
+      /* interrupt sleeping cron-thread! */
+      cron->nextWakeup_ = 0;
+      abortSleep (cron);
+    }
+#if HAVE_PRINT_CRON_TAB
+  printCronTab (cron);
+#endif
+  GNUNET_mutex_unlock (cron->deltaListLock_);
+}
+
 void
 GNUNET_cron_advance_job (struct GNUNET_CronManager *cron,
                          GNUNET_CronJob method, unsigned int deltaRepeat,
                          void *data)
 {
-  UTIL_cron_DeltaListEntry *job;
-  UTIL_cron_DeltaListEntry *last;
   int jobId;
+  int affinity;
 
 #if DEBUG_CRON
   GNUNET_GE_LOG (NULL,
@@ -357,37 +1064,26 @@ GNUNET_cron_advance_job (struct GNUNET_CronManager *cron,
                  "Advancing job %p-%p\n", method, data);
 #endif
   GNUNET_mutex_lock (cron->deltaListLock_);
-  jobId = cron->firstUsed_;
+  jobId = hash_find (cron, method, deltaRepeat, data);
   if (jobId == -1)
     {
-      /* not in queue - do nothing! */
-      GNUNET_mutex_unlock (cron->deltaListLock_);
-      return;
-    }
-  last = NULL;
-  job = &cron->deltaList_[jobId];
-  while ((job->method != method) ||
-         (job->data != data) || (job->deltaRepeat != deltaRepeat))
-    {
-      last = job;
-      if (job->next == -1)
+      /* not in queue; add if not running (but not if
+         the queue is empty) */
+      if ((GNUNET_NO == queue_empty (cron)) &&
+          ((method != cron->runningJob_) ||
+           (data != cron->runningData_) ||
+           (deltaRepeat != cron->runningRepeat_)) &&
+          (GNUNET_NO == job_in_flight (cron, method, deltaRepeat, data)))
         {
-          /* not in queue; add if not running */
-          if ((method != cron->runningJob_) ||
-              (data != cron->runningData_) ||
-              (deltaRepeat != cron->runningRepeat_))
-            {
-              GNUNET_cron_add_job (cron, method, 0, deltaRepeat, data);
-            }
-          GNUNET_mutex_unlock (cron->deltaListLock_);
-          return;
+          add_job (cron, method, 0, deltaRepeat, data, JOB_SERIAL);
         }
-      jobId = job->next;
-      job = &cron->deltaList_[jobId];
+      GNUNET_mutex_unlock (cron->deltaListLock_);
+      return;
     }
   /* ok, found it; remove, re-add with time 0 */
-  GNUNET_cron_del_job (cron, method, deltaRepeat, data);
-  GNUNET_cron_add_job (cron, method, 0, deltaRepeat, data);
+  affinity = cron->deltaList_[jobId].affinity;
+  free_job (cron, jobId);
+  add_job (cron, method, 0, deltaRepeat, data, affinity);
   GNUNET_mutex_unlock (cron->deltaListLock_);
 }
 
@@ -396,108 +1092,96 @@ GNUNET_cron_add_job (struct GNUNET_CronManager *cron,
                      GNUNET_CronJob method,
                      unsigned int delta, unsigned int deltaRepeat, void *data)
 {
-  UTIL_cron_DeltaListEntry *entry;
-  UTIL_cron_DeltaListEntry *pos;
-  int last;
-  int current;
+  add_job (cron, method, delta, deltaRepeat, data, JOB_SERIAL);
+}
 
-#if DEBUG_CRON
-  GNUNET_GE_LOG (cron->ectx,
-                 GNUNET_GE_STATUS | GNUNET_GE_DEVELOPER | GNUNET_GE_BULK,
-                 "Adding job %p-%p to fire in %d CU\n", method, data, delta);
-#endif
+void
+GNUNET_cron_add_parallel_job (struct GNUNET_CronManager *cron,
+                              GNUNET_CronJob method,
+                              unsigned int delta, unsigned int deltaRepeat,
+                              void *data)
+{
+  add_job (cron, method, delta, deltaRepeat, data, JOB_PARALLEL);
+}
 
-  GNUNET_mutex_lock (cron->deltaListLock_);
-  if (cron->firstFree_ == -1)
-    {                           /* need to grow */
-      unsigned int i;
-
-      GNUNET_array_grow (cron->deltaList_, cron->deltaListSize_,
-                         cron->deltaListSize_ * 2);
-      for (i = cron->deltaListSize_ / 2; i < cron->deltaListSize_; i++)
-        cron->deltaList_[i].next = i - 1;
-      cron->deltaList_[cron->deltaListSize_ / 2].next = -1;
-      cron->firstFree_ = cron->deltaListSize_ - 1;
-    }
-  entry = &cron->deltaList_[cron->firstFree_];
-  entry->method = method;
-  entry->data = data;
-  entry->deltaRepeat = deltaRepeat;
-  entry->delta = GNUNET_get_time () + delta;
-  if (cron->firstUsed_ == -1)
+void
+GNUNET_cron_set_workers (struct GNUNET_CronManager *cron, unsigned int count)
+{
+  GNUNET_GE_ASSERT (cron->ectx, cron->cron_signal == NULL);
+  GNUNET_free_non_null (cron->workers_);
+  cron->workers_ = NULL;
+  cron->workerCount_ = count;
+  if (count > 0)
     {
-      cron->firstUsed_ = cron->firstFree_;
-      cron->firstFree_ = entry->next;
-      entry->next = -1;         /* end of list */
-      GNUNET_mutex_unlock (cron->deltaListLock_);
-      /* interrupt sleeping cron-thread! */
-      abortSleep (cron);
-      return;
+      cron->workers_ = GNUNET_malloc (sizeof (struct CronWorker) * count);
+      memset (cron->workers_, 0, sizeof (struct CronWorker) * count);
     }
-  /* no, there are jobs waiting */
-  last = -1;
-  current = cron->firstUsed_;
-  pos = &cron->deltaList_[current];
+}
 
-  while (entry->delta > pos->delta)
-    {
-      if (pos->next != -1)
-        {
-          last = current;
-          current = pos->next;
-          pos = &cron->deltaList_[current];
-        }
-      else
-        {                       /* append */
-          pos->next = cron->firstFree_;
-          cron->firstFree_ = entry->next;
-          entry->next = -1;
-          GNUNET_mutex_unlock (cron->deltaListLock_);
-#if HAVE_PRINT_CRON_TAB
-          printCronTab ();
-#endif
-          return;
-        }
-    }
-  /* insert before pos */
-  if (last == -1)
-    {
-      cron->firstUsed_ = cron->firstFree_;
-      abortSleep (cron);
-    }
-  else
-    {
-      cron->deltaList_[last].next = cron->firstFree_;
-#if HAVE_PRINT_CRON_TAB
-      printCronTab ();
-#endif
-    }
-  cron->firstFree_ = entry->next;
-  entry->next = current;
+void
+GNUNET_cron_get_lateness (struct GNUNET_CronManager *cron,
+                          unsigned long long *histogram)
+{
+  GNUNET_mutex_lock (cron->deltaListLock_);
+  memcpy (histogram, cron->lateness_, sizeof (cron->lateness_));
   GNUNET_mutex_unlock (cron->deltaListLock_);
 }
 
 /**
- * Process the cron-job at the beginning of the waiting queue, that
+ * Process the first cron-job in the current slot of the wheel, that
  * is, remove, invoke, and re-insert if it is a periodical job. Make
  * sure the cron job is held when calling this method, but
  * note that it will be released briefly for the time
  * where the job is running (the job to run may add other
- * jobs!)
+ * jobs!)  Parallel jobs are passed to the workers instead.
  */
 static void
-runJob (struct GNUNET_CronManager *cron)
+runJob (struct GNUNET_CronManager *cron, GNUNET_CronTime now)
 {
   UTIL_cron_DeltaListEntry *job;
+  struct CronWorkItem *item;
   int jobId;
   GNUNET_CronJob method;
   void *data;
   unsigned int repeat;
 
-  jobId = cron->firstUsed_;
+  jobId = cron->wheel_[cron->wheelTime_ & (WHEEL_SLOTS - 1)].head;
   if (jobId == -1)
     return;                     /* no job to be done */
   job = &cron->deltaList_[jobId];
+  if ((job->affinity == JOB_PARALLEL) && (cron->workerCount_ > 0))
+    {
+      method = job->method;
+      data = job->data;
+      repeat = job->deltaRepeat;
+      if ((repeat > 0) &&
+          (GNUNET_YES == job_in_flight (cron, method, repeat, data)))
+        {
+          /* previous run has not finished yet, skip this one */
+          item = NULL;
+        }
+      else
+        {
+          item = GNUNET_malloc (sizeof (struct CronWorkItem));
+          item->next = NULL;
+          item->method = method;
+          item->data = data;
+          item->deltaRepeat = repeat;
+          item->scheduled = job->delta;
+          if (cron->workTail_ == NULL)
+            cron->workHead_ = item;
+          else
+            cron->workTail_->next = item;
+          cron->workTail_ = item;
+        }
+      free_job (cron, jobId);
+      if (repeat > 0)
+        add_job (cron, method, repeat, repeat, data, JOB_PARALLEL);
+      if (item != NULL)
+        GNUNET_semaphore_up (cron->workSignal_);
+      return;
+    }
+  record_lateness (cron, job->delta, now);
   method = job->method;
   cron->runningJob_ = method;
   data = job->data;
@@ -505,9 +1189,7 @@ runJob (struct GNUNET_CronManager *cron)
   repeat = job->deltaRepeat;
   cron->runningRepeat_ = repeat;
   /* remove from queue */
-  cron->firstUsed_ = job->next;
-  job->next = cron->firstFree_;
-  cron->firstFree_ = jobId;
+  free_job (cron, jobId);
   GNUNET_mutex_unlock (cron->deltaListLock_);
   /* re-insert */
   if (repeat > 0)
@@ -551,32 +1233,32 @@ cron_main_method (void *ctx)
 #if HAVE_PRINT_CRON_TAB
       printCronTab (cron);
 #endif
-      now = GNUNET_get_time ();
-      next = now + 0xFFFFFFFF;
       GNUNET_mutex_lock (cron->deltaListLock_);
-      while ((cron->cron_shutdown == GNUNET_NO) && (cron->firstUsed_ != -1))
+      now = GNUNET_get_time ();
+      while ((cron->cron_shutdown == GNUNET_NO) &&
+             (GNUNET_YES == wheel_advance (cron, now)))
         {
-          now = GNUNET_get_time ();
-          next = cron->deltaList_[cron->firstUsed_].delta;
-          if (next <= now)
-            {
 #if DEBUG_CRON
-              GNUNET_GE_LOG (cron->ectx,
-                             GNUNET_GE_STATUS | GNUNET_GE_DEVELOPER |
-                             GNUNET_GE_BULK, "running cron job, table is\n");
-              printCronTab (cron);
+          GNUNET_GE_LOG (cron->ectx,
+                         GNUNET_GE_STATUS | GNUNET_GE_DEVELOPER |
+                         GNUNET_GE_BULK, "running cron job, table is\n");
+          printCronTab (cron);
 #endif
-              runJob (cron);
+          runJob (cron, now);
 #if DEBUG_CRON
-              GNUNET_GE_LOG (cron->ectx,
-                             GNUNET_GE_STATUS | GNUNET_GE_DEVELOPER |
-                             GNUNET_GE_BULK, "job run, new table is\n");
-              printCronTab (cron);
+          GNUNET_GE_LOG (cron->ectx,
+                         GNUNET_GE_STATUS | GNUNET_GE_DEVELOPER |
+                         GNUNET_GE_BULK, "job run, new table is\n");
+          printCronTab (cron);
 #endif
-            }
-          else
-            break;
+          now = GNUNET_get_time ();
         }
+      next = wheel_next_event (cron);
+      if (next > now + MAXSLEEP)
+        next = now + MAXSLEEP;
+      if (next <= now)
+        next = now + 1;
+      cron->nextWakeup_ = next;
       GNUNET_mutex_unlock (cron->deltaListLock_);
       next = next - now;        /* how long to sleep */
 #if DEBUG_CRON
@@ -585,10 +1267,11 @@ cron_main_method (void *ctx)
                      "Sleeping at %llu for %llu CU (%llu s, %llu CU)\n",
                      now, next, next / GNUNET_CRON_SECONDS, next);
 #endif
-      if (next > MAXSLEEP)
-        next = MAXSLEEP;
       if (cron->cron_shutdown == GNUNET_NO)
         GNUNET_thread_sleep (next);
+      GNUNET_mutex_lock (cron->deltaListLock_);
+      cron->nextWakeup_ = 0;
+      GNUNET_mutex_unlock (cron->deltaListLock_);
 #if DEBUG_CRON
       GNUNET_GE_LOG (cron->ectx,
                      GNUNET_GE_STATUS | GNUNET_GE_DEVELOPER | GNUNET_GE_BULK,
@@ -616,16 +1299,16 @@ GNUNET_cron_destroy (struct GNUNET_CronManager *cron)
   int i;
 
   GNUNET_GE_ASSERT (cron->ectx, cron->cron_signal == NULL);
-  i = cron->firstUsed_;
-  while (i != -1)
-    {
+  for (i = 0; i < cron->deltaListSize_; i++)
+    if (cron->deltaList_[i].slot != -1)
       GNUNET_free_non_null (cron->deltaList_[i].data);
-      i = cron->deltaList_[i].next;
-    }
   GNUNET_mutex_destroy (cron->deltaListLock_);
   GNUNET_mutex_destroy (cron->inBlockLock_);
   GNUNET_free (cron->deltaList_);
+  GNUNET_free (cron->hashTable_);
+  GNUNET_free_non_null (cron->workers_);
   GNUNET_semaphore_destroy (cron->cron_signal_up);
+  GNUNET_semaphore_destroy (cron->workDone_);
   GNUNET_free (cron);
 }
 
@@ -635,9 +1318,28 @@ GNUNET_cron_destroy (struct GNUNET_CronManager *cron)
 void
 GNUNET_cron_start (struct GNUNET_CronManager *cron)
 {
+  unsigned int i;
+
   GNUNET_GE_ASSERT (cron->ectx, cron->cron_signal == NULL);
   cron->cron_shutdown = GNUNET_NO;
   cron->cron_signal = GNUNET_semaphore_create (0);
+  if (cron->workerCount_ > 0)
+    {
+      cron->workerShutdown_ = GNUNET_NO;
+      cron->workSignal_ = GNUNET_semaphore_create (0);
+      for (i = 0; i < cron->workerCount_; i++)
+        {
+          cron->workers_[i].cron = cron;
+          cron->workers_[i].thread =
+            GNUNET_thread_create (&worker_main_method, &cron->workers_[i],
+                                  256 * 1024);
+          if (cron->workers_[i].thread == NULL)
+            GNUNET_GE_DIE_STRERROR (cron->ectx,
+                                    GNUNET_GE_FATAL | GNUNET_GE_ADMIN |
+                                    GNUNET_GE_USER | GNUNET_GE_BULK,
+                                    "pthread_create");
+        }
+    }
   /* large stack, we don't know for sure
      what the cron jobs may be doing */
   cron->cron_handle =
@@ -652,8 +1354,8 @@ int
 GNUNET_cron_del_job (struct GNUNET_CronManager *cron,
                      GNUNET_CronJob method, unsigned int repeat, void *data)
 {
-  UTIL_cron_DeltaListEntry *job;
-  UTIL_cron_DeltaListEntry *last;
+  struct CronWorkItem *item;
+  struct CronWorkItem *prev;
   int jobId;
 
 #if DEBUG_CRON
@@ -662,41 +1364,37 @@ GNUNET_cron_del_job (struct GNUNET_CronManager *cron,
                  "deleting job %p-%p\n", method, data);
 #endif
   GNUNET_mutex_lock (cron->deltaListLock_);
-  jobId = cron->firstUsed_;
+  jobId = hash_find (cron, method, repeat, data);
   if (jobId == -1)
     {
-      GNUNET_mutex_unlock (cron->deltaListLock_);
-      return 0;
-    }
-  last = NULL;
-  job = &cron->deltaList_[jobId];
-  while ((job->method != method) ||
-         (job->data != data) || (job->deltaRepeat != repeat))
-    {
-      last = job;
-      if (job->next == -1)
+      /* maybe it is due and waiting for a worker */
+      prev = NULL;
+      item = cron->workHead_;
+      while ((item != NULL) &&
+             ((item->method != method) ||
+              (item->data != data) || (item->deltaRepeat != repeat)))
+        {
+          prev = item;
+          item = item->next;
+        }
+      if (item == NULL)
         {
           GNUNET_mutex_unlock (cron->deltaListLock_);
           return 0;
         }
-      jobId = job->next;
-      job = &cron->deltaList_[jobId];
+      if (prev == NULL)
+        cron->workHead_ = item->next;
+      else
+        prev->next = item->next;
+      if (cron->workTail_ == item)
+        cron->workTail_ = prev;
+      GNUNET_free (item);
+      GNUNET_mutex_unlock (cron->deltaListLock_);
+      return 1;
     }
-  if (last != NULL)
-    last->next = job->next;
-  else
-    cron->firstUsed_ = job->next;
-  job->next = cron->firstFree_;
-  cron->firstFree_ = jobId;
-  job->method = NULL;
-  job->data = NULL;
-  job->deltaRepeat = 0;
+  free_job (cron, jobId);
   GNUNET_mutex_unlock (cron->deltaListLock_);
   return 1;
 }
 
-
-
-
-
 /* end of cron.c */
@@ -114,6 +114,278 @@ testDelCron ()
   return 0;
 }
 
+static int advanced;
+
+static void
+advanceJob (void *unused)
+{
+  advanced++;
+}
+
+/**
+ * Check that advancing a job that is not queued only adds
+ * it if the queue is not empty.
+ */
+static int
+testAdvance ()
+{
+  struct GNUNET_CronManager *acron;
+
+  advanced = 0;
+  acron = GNUNET_cron_create (NULL);
+  GNUNET_cron_start (acron);
+  GNUNET_cron_advance_job (acron, &advanceJob, 0, NULL);
+  GNUNET_thread_sleep (200 * GNUNET_CRON_MILLISECONDS);
+  if (advanced != 0)
+    {
+      fprintf (stderr, "advancing a job added it to an empty queue\n");
+      GNUNET_cron_stop (acron);
+      GNUNET_cron_destroy (acron);
+      return 1;
+    }
+  GNUNET_cron_add_job (acron, &advanceJob, 60 * GNUNET_CRON_SECONDS, 0,
+                       &acron);
+  GNUNET_cron_advance_job (acron, &advanceJob, 0, NULL);
+  GNUNET_thread_sleep (200 * GNUNET_CRON_MILLISECONDS);
+  GNUNET_cron_stop (acron);
+  GNUNET_cron_del_job (acron, &advanceJob, 0, &acron);
+  GNUNET_cron_destroy (acron);
+  if (advanced != 1)
+    {
+      fprintf (stderr, "advanced job ran %d times, expected once\n",
+               advanced);
+      return 1;
+    }
+  return 0;
+}
+
+static unsigned int order[16];
+
+static unsigned int orderPos;
+
+static void
+orderJob (void *cls)
+{
+  order[orderPos++] = (unsigned int) (size_t) cls;
+}
+
+/**
+ * Check that jobs run in the order of their deadlines,
+ * including jobs that move between levels of the wheel.
+ */
+static int
+testOrder ()
+{
+  static const unsigned int delays[16] = {
+    1500, 10, 700, 70, 1200, 300, 5, 4200,
+    900, 130, 2600, 60, 1000, 20, 3100, 450
+  };
+  unsigned int i;
+  unsigned int j;
+
+  orderPos = 0;
+  for (i = 0; i < 16; i++)
+    GNUNET_cron_add_job (cron, &orderJob, delays[i], 0,
+                         (void *) (size_t) delays[i]);
+  GNUNET_thread_sleep (5 * GNUNET_CRON_SECONDS);
+  if (orderPos != 16)
+    {
+      fprintf (stderr, "Only %u of 16 jobs ran\n", orderPos);
+      return 1;
+    }
+  for (i = 1; i < 16; i++)
+    if (order[i - 1] > order[i])
+      {
+        fprintf (stderr, "Jobs ran out of order:");
+        for (j = 0; j < 16; j++)
+          fprintf (stderr, " %u", order[j]);
+        fprintf (stderr, "\n");
+        return 1;
+      }
+  return 0;
+}
+
+/**
+ * Number of outstanding jobs for the benchmark.
+ */
+#define BENCH_JOBS 100000
+
+static void
+benchJob (void *unused)
+{
+}
+
+/**
+ * Get the current time in microseconds.
+ */
+static unsigned long long
+now_us ()
+{
+  struct timeval tv;
+
+  GETTIMEOFDAY (&tv, NULL);
+  return ((unsigned long long) tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+/**
+ * Measure adding, advancing and deleting jobs with
+ * BENCH_JOBS jobs outstanding (the jobs are due in
+ * one to two hours, so they never run).
+ */
+static int
+benchCron ()
+{
+  unsigned int *delays;
+  unsigned long long start;
+  unsigned long long delta;
+  unsigned int i;
+  unsigned int j;
+  int ret;
+
+  ret = 0;
+  delays = GNUNET_malloc (BENCH_JOBS * sizeof (unsigned int));
+  for (i = 0; i < BENCH_JOBS; i++)
+    delays[i] = GNUNET_CRON_HOURS +
+      GNUNET_random_u32 (GNUNET_RANDOM_QUALITY_WEAK, GNUNET_CRON_HOURS);
+  start = now_us ();
+  for (i = 0; i < BENCH_JOBS; i++)
+    GNUNET_cron_add_job (cron, &benchJob, delays[i], 0,
+                         (void *) (size_t) (i + 1));
+  delta = now_us () - start + 1;
+  printf ("add:     %10.0f jobs/s\n", BENCH_JOBS * 1000000.0 / delta);
+  start = now_us ();
+  for (i = 0; i < 1000; i++)
+    {
+      /* re-adding with a new delay is the common "reset a timer"
+         pattern (e.g. retransmission timers) */
+      j = GNUNET_random_u32 (GNUNET_RANDOM_QUALITY_WEAK, BENCH_JOBS);
+      if (1 != GNUNET_cron_del_job (cron, &benchJob, 0,
+                                    (void *) (size_t) (j + 1)))
+        ret = 1;
+      GNUNET_cron_add_job (cron, &benchJob, delays[j], 0,
+                           (void *) (size_t) (j + 1));
+    }
+  delta = now_us () - start + 1;
+  printf ("reset:   %10.0f jobs/s\n", 1000 * 1000000.0 / delta);
+  start = now_us ();
+  for (i = 0; i < BENCH_JOBS; i++)
+    {
+      j = (i * 7919) % BENCH_JOBS;
+      if (1 != GNUNET_cron_del_job (cron, &benchJob, 0,
+                                    (void *) (size_t) (j + 1)))
+        ret = 1;
+    }
+  delta = now_us () - start + 1;
+  printf ("delete:  %10.0f jobs/s\n", BENCH_JOBS * 1000000.0 / delta);
+  GNUNET_free (delays);
+  if (ret != 0)
+    fprintf (stderr, "benchmark job could not be deleted\n");
+  return ret;
+}
+
+static struct GNUNET_Mutex *parallelLock;
+
+static int slowActive;
+
+static int slowOverlap;
+
+static int slowRuns;
+
+static int fastRuns;
+
+static void
+slowJob (void *unused)
+{
+  GNUNET_mutex_lock (parallelLock);
+  if (slowActive > 0)
+    slowOverlap++;
+  slowActive++;
+  slowRuns++;
+  GNUNET_mutex_unlock (parallelLock);
+  GNUNET_thread_sleep (300 * GNUNET_CRON_MILLISECONDS);
+  GNUNET_mutex_lock (parallelLock);
+  slowActive--;
+  GNUNET_mutex_unlock (parallelLock);
+}
+
+static void
+fastJob (void *unused)
+{
+  GNUNET_mutex_lock (parallelLock);
+  fastRuns++;
+  GNUNET_mutex_unlock (parallelLock);
+}
+
+/**
+ * Check that a slow parallel job does not delay other
+ * jobs, never runs twice at the same time and is not
+ * running while cron is suspended.
+ */
+static int
+testParallel ()
+{
+  struct GNUNET_CronManager *pcron;
+  unsigned long long histogram[GNUNET_CRON_LATENESS_BUCKETS];
+  unsigned long long total;
+  int active;
+  int ret;
+  int i;
+
+  ret = 0;
+  parallelLock = GNUNET_mutex_create (GNUNET_NO);
+  pcron = GNUNET_cron_create (NULL);
+  GNUNET_cron_set_workers (pcron, 2);
+  GNUNET_cron_start (pcron);
+  GNUNET_cron_add_parallel_job (pcron, &slowJob, 0,
+                                50 * GNUNET_CRON_MILLISECONDS, NULL);
+  GNUNET_cron_add_job (pcron, &fastJob, 0,
+                       10 * GNUNET_CRON_MILLISECONDS, NULL);
+  GNUNET_thread_sleep (GNUNET_CRON_SECONDS);
+  GNUNET_cron_suspend_jobs (pcron, GNUNET_NO);
+  GNUNET_mutex_lock (parallelLock);
+  active = slowActive;
+  GNUNET_mutex_unlock (parallelLock);
+  GNUNET_cron_resume_jobs (pcron, GNUNET_NO);
+  GNUNET_cron_del_job (pcron, &slowJob, 50 * GNUNET_CRON_MILLISECONDS,
+                       NULL);
+  GNUNET_cron_del_job (pcron, &fastJob, 10 * GNUNET_CRON_MILLISECONDS,
+                       NULL);
+  GNUNET_cron_stop (pcron);
+  GNUNET_cron_get_lateness (pcron, histogram);
+  GNUNET_cron_destroy (pcron);
+  GNUNET_mutex_destroy (parallelLock);
+  total = 0;
+  for (i = 0; i < GNUNET_CRON_LATENESS_BUCKETS; i++)
+    total += histogram[i];
+  if (active != 0)
+    {
+      fprintf (stderr, "parallel job running while cron is suspended\n");
+      ret = 1;
+    }
+  if (slowOverlap != 0)
+    {
+      fprintf (stderr, "periodic parallel job ran twice at once\n");
+      ret = 1;
+    }
+  /* the slow job blocks the serial jobs for 300 ms per run
+     if it does not run on a worker */
+  if ((slowRuns < 2) || (fastRuns < 50))
+    {
+      fprintf (stderr, "parallel: %d slow runs, %d fast runs\n",
+               slowRuns, fastRuns);
+      ret = 1;
+    }
+  /* (the histogram also counts the internal jobs used for
+     suspending and stopping cron) */
+  if (total < slowRuns + fastRuns)
+    {
+      fprintf (stderr, "lateness histogram has %llu jobs, expected %d\n",
+               total, slowRuns + fastRuns);
+      ret = 1;
+    }
+  return ret;
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -123,6 +395,10 @@ main (int argc, char *argv[])
   GNUNET_cron_start (cron);
   failureCount += testCron ();
   failureCount += testDelCron ();
+  failureCount += testOrder ();
+  failureCount += testAdvance ();
+  failureCount += testParallel ();
+  failureCount += benchCron ();
   GNUNET_cron_stop (cron);
   GNUNET_cron_destroy (cron);
   if (failureCount != 0)
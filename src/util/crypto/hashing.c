@@ -138,8 +138,14 @@ const unsigned long long sha512_K[80] = {
 #define BLEND_OP(I, W) \
   W[I] = s1(W[I-2]) + W[I-7] + s0(W[I-15]) + W[I-16];
 
-static void
-sha512_transform (unsigned long long *state, const unsigned char *input)
+/**
+ * Portable SHA-512 compression function.  Inlined into each of
+ * the implementation-specific variants below so that the compiler
+ * can use the instructions enabled for that variant.
+ */
+static inline __attribute__ ((always_inline)) void
+sha512_transform_body (unsigned long long *state,
+                       const unsigned char *input)
 {
   unsigned long long a, b, c, d, e, f, g, h, t1, t2;
   unsigned long long W[80];
@@ -218,6 +224,206 @@ sha512_transform (unsigned long long *state, const unsigned char *input)
   memset (W, 0, 80 * sizeof (unsigned long long));
 }
 
+static void
+sha512_transform_generic (unsigned long long *state,
+                          const unsigned char *input)
+{
+  sha512_transform_body (state, input);
+}
+
+/**
+ * Signature of a function that runs the SHA-512 compression
+ * function on one 128-byte block for each of several independent
+ * messages.  The state of message l is stored in state[i * lanes + l].
+ */
+typedef void (*MultiTransform) (unsigned long long *state,
+                                const unsigned char *const *blocks);
+
+/**
+ * Maximum number of messages that a multi-buffer
+ * implementation processes at once.
+ */
+#define MAX_LANES 8
+
+#if defined(__GNUC__) && (__GNUC__ >= 5) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_DISPATCH 1
+#endif
+
+#if HAVE_X86_DISPATCH
+
+/**
+ * Same code as the generic version, but the compiler may use
+ * BMI2 rotates (rorx), which do not touch the flags and thus
+ * allow for more parallelism in the rounds.
+ */
+static __attribute__ ((target ("bmi2"))) void
+sha512_transform_bmi2 (unsigned long long *state, const unsigned char *input)
+{
+  sha512_transform_body (state, input);
+}
+
+#define MB_ROR(x,n) (((x) >> (n)) | ((x) << (64 - (n))))
+#define MB_E0(x) (MB_ROR(x,28) ^ MB_ROR(x,34) ^ MB_ROR(x,39))
+#define MB_E1(x) (MB_ROR(x,14) ^ MB_ROR(x,18) ^ MB_ROR(x,41))
+#define MB_S0(x) (MB_ROR(x, 1) ^ MB_ROR(x, 8) ^ ((x) >> 7))
+#define MB_S1(x) (MB_ROR(x,19) ^ MB_ROR(x,61) ^ ((x) >> 6))
+#define MB_CH(x,y,z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MB_MAJ(x,y,z) (((x) & (y)) | ((z) & ((x) | (y))))
+
+#define MB_NAME sha512_transform_avx2
+#define MB_VECTOR sha512_v4
+#define MB_LANES 4
+#define MB_TARGET "avx2"
+#include "sha512_mb.h"
+
+#define MB_NAME sha512_transform_avx512
+#define MB_VECTOR sha512_v8
+#define MB_LANES 8
+#define MB_TARGET "avx512f"
+#include "sha512_mb.h"
+
+#endif
+
+/**
+ * A SHA-512 implementation.
+ */
+struct HashImplementation
+{
+  const char *name;
+
+  /**
+   * Compression function for a single message.
+   */
+  void (*transform) (unsigned long long *state, const unsigned char *input);
+
+  /**
+   * Multi-buffer compression function, NULL for none.
+   */
+  MultiTransform multi;
+
+  /**
+   * Number of messages processed by multi.
+   */
+  unsigned int lanes;
+
+  /**
+   * CPU feature required for this implementation (NULL for none).
+   */
+  const char *feature;
+};
+
+/**
+ * Available implementations, fastest last.
+ */
+static const struct HashImplementation implementations[] = {
+  {"generic", &sha512_transform_generic, NULL, 1, NULL},
+#if HAVE_X86_DISPATCH
+  {"bmi2", &sha512_transform_bmi2, NULL, 1, "bmi2"},
+  {"avx2", &sha512_transform_bmi2, &sha512_transform_avx2, 4, "avx2"},
+  {"avx512", &sha512_transform_bmi2, &sha512_transform_avx512, 8,
+   "avx512f"},
+#endif
+  {NULL, NULL, NULL, 0, NULL}
+};
+
+/**
+ * Implementation in use (NULL until first use).
+ */
+static const struct HashImplementation *implementation;
+
+/**
+ * Check if the CPU supports the given implementation.
+ */
+static int
+implementation_supported (const struct HashImplementation *impl)
+{
+  if (impl->feature == NULL)
+    return GNUNET_YES;
+#if HAVE_X86_DISPATCH
+  __builtin_cpu_init ();
+  if (0 == strcmp (impl->feature, "bmi2"))
+    return __builtin_cpu_supports ("bmi2") ? GNUNET_YES : GNUNET_NO;
+  if (0 == strcmp (impl->feature, "avx2"))
+    return (__builtin_cpu_supports ("avx2") &&
+            __builtin_cpu_supports ("bmi2")) ? GNUNET_YES : GNUNET_NO;
+  if (0 == strcmp (impl->feature, "avx512f"))
+    return (__builtin_cpu_supports ("avx512f") &&
+            __builtin_cpu_supports ("bmi2")) ? GNUNET_YES : GNUNET_NO;
+#endif
+  return GNUNET_NO;
+}
+
+static const struct HashImplementation *
+get_implementation ()
+{
+  const struct HashImplementation *impl;
+  int i;
+
+  impl = implementation;
+  if (impl != NULL)
+    return impl;
+  impl = &implementations[0];
+  for (i = 1; implementations[i].name != NULL; i++)
+    if (GNUNET_YES == implementation_supported (&implementations[i]))
+      impl = &implementations[i];
+  implementation = impl;
+  return impl;
+}
+
+/**
+ * Select the SHA-512 implementation to use.
+ *
+ * @param name name of the implementation, NULL for the
+ *        fastest one supported by this CPU
+ * @return GNUNET_OK on success, GNUNET_SYSERR if the
+ *         implementation is unknown or not supported
+ */
+int
+GNUNET_hash_set_implementation (const char *name)
+{
+  int i;
+
+  if (name == NULL)
+    {
+      implementation = NULL;
+      get_implementation ();
+      return GNUNET_OK;
+    }
+  for (i = 0; implementations[i].name != NULL; i++)
+    {
+      if (0 != strcmp (name, implementations[i].name))
+        continue;
+      if (GNUNET_YES != implementation_supported (&implementations[i]))
+        return GNUNET_SYSERR;
+      implementation = &implementations[i];
+      return GNUNET_OK;
+    }
+  return GNUNET_SYSERR;
+}
+
+/**
+ * Get the name of the SHA-512 implementation in use.
+ */
+const char *
+GNUNET_hash_get_implementation ()
+{
+  return get_implementation ()->name;
+}
+
+/**
+ * Get the name of the i-th SHA-512 implementation
+ * (whether or not this CPU supports it).
+ *
+ * @return NULL if i is out of range
+ */
+const char *
+GNUNET_hash_get_implementation_name (unsigned int i)
+{
+  if (i >= sizeof (implementations) / sizeof (implementations[0]) - 1)
+    return NULL;
+  return implementations[i].name;
+}
+
 static void
 sha512_init (struct sha512_ctx *sctx)
 {
@@ -238,7 +444,10 @@ sha512_update (struct sha512_ctx *sctx,
                const unsigned char *data, unsigned int len)
 {
   unsigned int i, index, part_len;
+  void (*sha512_transform) (unsigned long long *state,
+                            const unsigned char *input);
 
+  sha512_transform = get_implementation ()->transform;
   /* Compute number of bytes mod 128 */
   index = (unsigned int) ((sctx->count[0] >> 3) & 0x7F);
 
@@ -371,6 +580,168 @@ GNUNET_hash (const void *block, unsigned int size, GNUNET_HashCode * ret)
   sha512_final (&ctx, (unsigned char *) ret);
 }
 
+/**
+ * State of a message that is being hashed by a
+ * multi-buffer implementation.
+ */
+struct MultiLane
+{
+  /**
+   * The message.
+   */
+  const unsigned char *data;
+
+  /**
+   * Number of complete 128-byte blocks in the message.
+   */
+  unsigned int full;
+
+  /**
+   * Total number of blocks (including padding).
+   */
+  unsigned int blocks;
+
+  /**
+   * Next block to process.
+   */
+  unsigned int next;
+
+  /**
+   * Index of the message in the input, -1 if the lane is idle.
+   */
+  int index;
+
+  /**
+   * Last (partial) block(s) of the message with padding.
+   */
+  unsigned char tail[256];
+};
+
+static void
+lane_start (struct MultiLane *lane,
+            const unsigned char *data, unsigned int size, int index)
+{
+  unsigned long long bits;
+  unsigned int rem;
+
+  lane->data = data;
+  lane->index = index;
+  lane->next = 0;
+  lane->full = size / 128;
+  rem = size % 128;
+  lane->blocks = lane->full + ((rem < 112) ? 1 : 2);
+  memset (lane->tail, 0, sizeof (lane->tail));
+  if (rem > 0)
+    memcpy (lane->tail, &data[lane->full * 128], rem);
+  lane->tail[rem] = 0x80;
+  bits = GNUNET_htonll (((unsigned long long) size) << 3);
+  memcpy (&lane->tail[(lane->blocks - lane->full) * 128 - 8],
+          &bits, sizeof (unsigned long long));
+}
+
+/**
+ * Hash several messages with a multi-buffer implementation.
+ * Each lane takes the next message as soon as it is done
+ * with the previous one, so messages of different sizes
+ * keep all lanes busy.
+ */
+static void
+sha512_many (const struct HashImplementation *impl,
+             unsigned int count,
+             const void *const *blocks,
+             const unsigned int *sizes, GNUNET_HashCode * ret)
+{
+  static const unsigned char idle_block[128];
+  static const unsigned long long H[8] = { H0, H1, H2, H3, H4, H5, H6, H7 };
+  struct MultiLane lanes[MAX_LANES];
+  const unsigned char *input[MAX_LANES];
+  unsigned long long state[8 * MAX_LANES];
+  unsigned long long word;
+  unsigned char *out;
+  struct MultiLane *lane;
+  unsigned int nl;
+  unsigned int next;
+  unsigned int active;
+  unsigned int l;
+  unsigned int i;
+
+  nl = impl->lanes;
+  next = 0;
+  active = 0;
+  for (l = 0; l < nl; l++)
+    lanes[l].index = -1;
+  while (1)
+    {
+      for (l = 0; l < nl; l++)
+        {
+          lane = &lanes[l];
+          if ((lane->index == -1) && (next < count))
+            {
+              lane_start (lane, blocks[next], sizes[next], next);
+              for (i = 0; i < 8; i++)
+                state[i * nl + l] = H[i];
+              next++;
+              active++;
+            }
+          if (lane->index == -1)
+            input[l] = idle_block;
+          else if (lane->next < lane->full)
+            input[l] = &lane->data[lane->next * 128];
+          else
+            input[l] = &lane->tail[(lane->next - lane->full) * 128];
+        }
+      if (active == 0)
+        break;
+      impl->multi (state, input);
+      for (l = 0; l < nl; l++)
+        {
+          lane = &lanes[l];
+          if (lane->index == -1)
+            continue;
+          if (++lane->next < lane->blocks)
+            continue;
+          out = (unsigned char *) &ret[lane->index];
+          for (i = 0; i < 8; i++)
+            {
+              word = GNUNET_htonll (state[i * nl + l]);
+              memcpy (&out[8 * i], &word, sizeof (unsigned long long));
+            }
+          lane->index = -1;
+          active--;
+        }
+    }
+  memset (lanes, 0, sizeof (lanes));
+  memset (state, 0, sizeof (state));
+}
+
+/**
+ * Hash several independent blocks.  On CPUs with SIMD
+ * support, the blocks are hashed in parallel, which is
+ * much faster than calling GNUNET_hash for each block.
+ *
+ * @param count number of blocks
+ * @param blocks the blocks to hash
+ * @param sizes sizes of the blocks
+ * @param ret array of count hash codes, set to the hashes of the blocks
+ */
+void
+GNUNET_hash_many (unsigned int count,
+                  const void *const *blocks,
+                  const unsigned int *sizes, GNUNET_HashCode * ret)
+{
+  const struct HashImplementation *impl;
+  unsigned int i;
+
+  impl = get_implementation ();
+  if ((impl->multi == NULL) || (count < 2))
+    {
+      for (i = 0; i < count; i++)
+        GNUNET_hash (blocks[i], sizes[i], &ret[i]);
+      return;
+    }
+  sha512_many (impl, count, blocks, sizes, ret);
+}
+
 /**
  * Compute the GNUNET_hash of an entire file.  Does NOT load the entire file
  * into memory but instead processes it in blocks.  Very important for
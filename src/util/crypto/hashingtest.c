@@ -57,6 +57,83 @@ testEncoding ()
   return 0;
 }
 
+#define SIZES 14
+
+static unsigned int sizes[SIZES] =
+  { 0, 1, 3, 64, 111, 112, 113, 127, 128, 129, 255, 256, 1000, 32768 };
+
+/**
+ * Check that all SHA-512 implementations supported by this
+ * CPU agree with each other, both for GNUNET_hash and
+ * GNUNET_hash_many.
+ */
+static int
+testImplementations ()
+{
+  static const unsigned char abc[] = {
+    0xdd, 0xaf, 0x35, 0xa1, 0x93, 0x61, 0x7a, 0xba,
+    0xcc, 0x41, 0x73, 0x49, 0xae, 0x20, 0x41, 0x31
+  };
+  GNUNET_HashCode expected[SIZES * 2];
+  GNUNET_HashCode hc[SIZES * 2];
+  const void *blocks[SIZES * 2];
+  unsigned int lens[SIZES * 2];
+  const char *name;
+  char *buf;
+  int ret;
+  int i;
+  int j;
+
+  ret = 0;
+  buf = GNUNET_malloc (32768);
+  for (i = 0; i < 32768; i++)
+    buf[i] = (char) i;
+  for (i = 0; i < SIZES * 2; i++)
+    {
+      /* mix different sizes so that lanes finish at different times */
+      lens[i] = sizes[(i * 5) % SIZES];
+      blocks[i] = &buf[32768 - lens[i]];
+    }
+  GNUNET_hash_set_implementation ("generic");
+  for (i = 0; i < SIZES * 2; i++)
+    GNUNET_hash (blocks[i], lens[i], &expected[i]);
+  for (j = 0; NULL != (name = GNUNET_hash_get_implementation_name (j)); j++)
+    {
+      if (GNUNET_OK != GNUNET_hash_set_implementation (name))
+        continue;
+      GNUNET_hash ("abc", 3, &hc[0]);
+      if (0 != memcmp (&hc[0], abc, sizeof (abc)))
+        {
+          printf ("SHA-512 (%s) of `abc' is wrong!\n", name);
+          ret++;
+        }
+      for (i = 0; i < SIZES * 2; i++)
+        {
+          GNUNET_hash (blocks[i], lens[i], &hc[i]);
+          if (0 != memcmp (&hc[i], &expected[i], sizeof (GNUNET_HashCode)))
+            {
+              printf ("GNUNET_hash (%s) wrong for size %u!\n", name,
+                      lens[i]);
+              ret++;
+            }
+        }
+      for (i = 1; i <= SIZES * 2; i++)
+        {
+          memset (hc, 0, sizeof (hc));
+          GNUNET_hash_many (i, blocks, lens, hc);
+          if (0 != memcmp (hc, expected, i * sizeof (GNUNET_HashCode)))
+            {
+              printf ("GNUNET_hash_many (%s) wrong for %d blocks!\n",
+                      name, i);
+              ret++;
+            }
+        }
+    }
+  GNUNET_hash_set_implementation (NULL);
+  GNUNET_free (buf);
+  return ret;
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -65,6 +142,7 @@ main (int argc, char *argv[])
 
   for (i = 0; i < 10; i++)
     failureCount += testEncoding ();
+  failureCount += testImplementations ();
   if (failureCount != 0)
     return 1;
   return 0;
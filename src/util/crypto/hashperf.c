@@ -19,7 +19,7 @@
 */
 
 /**
- * Test for hashing.c
+ * Benchmark for the SHA-512 implementations in hashing.c
  * @author Christian Grothoff
  * @file util/crypto/hashperf.c
  */
@@ -28,35 +28,85 @@
 #include "gnunet_util_crypto.h"
 #include "platform.h"
 
+/**
+ * How long do we run each measurement?
+ */
+#define MEASURE_TIME (200 * GNUNET_CRON_MILLISECONDS)
+
+/**
+ * How many blocks do we pass to GNUNET_hash_many at once?
+ */
+#define BATCH 64
+
+/**
+ * Hash blocks of the given size (one at a time or in
+ * batches) for MEASURE_TIME and report the throughput.
+ */
 static void
-perfHash ()
+perfHash (const char *name, unsigned int size, int many)
 {
-  GNUNET_HashCode hc1;
-  GNUNET_HashCode hc2;
-  GNUNET_HashCode hc3;
-  int i;
+  GNUNET_HashCode hc[BATCH];
+  const void *blocks[BATCH];
+  unsigned int sizes[BATCH];
+  GNUNET_CronTime start;
+  GNUNET_CronTime delta;
+  unsigned long long hashes;
   char *buf;
+  int i;
 
-  buf = GNUNET_malloc (1024 * 64);
-  memset (buf, 1, 1024 * 64);
-  GNUNET_hash ("foo", 3, &hc1);
-  for (i = 0; i < 1024; i++)
+  buf = GNUNET_malloc (size * BATCH);
+  memset (buf, 1, size * BATCH);
+  for (i = 0; i < BATCH; i++)
+    {
+      blocks[i] = &buf[i * size];
+      sizes[i] = size;
+    }
+  hashes = 0;
+  start = GNUNET_get_time ();
+  do
     {
-      GNUNET_hash (&hc1, sizeof (GNUNET_HashCode), &hc2);
-      GNUNET_hash (&hc2, sizeof (GNUNET_HashCode), &hc1);
-      GNUNET_hash (buf, 1024 * 64, &hc3);
+      if (many)
+        {
+          GNUNET_hash_many (BATCH, blocks, sizes, hc);
+        }
+      else
+        {
+          for (i = 0; i < BATCH; i++)
+            GNUNET_hash (blocks[i], size, &hc[i]);
+        }
+      hashes += BATCH;
+      delta = GNUNET_get_time () - start;
     }
+  while (delta < MEASURE_TIME);
+  if (delta == 0)
+    delta = 1;
+  printf ("%-8s %-10s %6u bytes: %10.0f hashes/s %8.1f MB/s\n",
+          name, many ? "hash_many" : "hash", size,
+          hashes * 1000.0 / delta,
+          hashes * (double) size * 1000.0 / delta / 1024 / 1024);
   GNUNET_free (buf);
 }
 
 int
 main (int argc, char *argv[])
 {
-  GNUNET_CronTime start;
+  const char *name;
+  unsigned int i;
 
-  start = GNUNET_get_time ();
-  perfHash ();
-  printf ("Hash perf took %llu ms\n", GNUNET_get_time () - start);
+  for (i = 0; NULL != (name = GNUNET_hash_get_implementation_name (i)); i++)
+    {
+      if (GNUNET_OK != GNUNET_hash_set_implementation (name))
+        {
+          printf ("%-8s not supported by this CPU\n", name);
+          continue;
+        }
+      perfHash (name, sizeof (GNUNET_HashCode), GNUNET_NO);
+      perfHash (name, sizeof (GNUNET_HashCode), GNUNET_YES);
+      perfHash (name, 32 * 1024, GNUNET_NO);
+      perfHash (name, 32 * 1024, GNUNET_YES);
+    }
+  GNUNET_hash_set_implementation (NULL);
+  printf ("Default implementation: %s\n", GNUNET_hash_get_implementation ());
   return 0;
 }
 
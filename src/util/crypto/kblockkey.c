@@ -517,16 +517,297 @@ makeKblockKeyInternal (const GNUNET_HashCode * hc)
   return retval;
 }
 
-typedef struct
+/**
+ * How many encoded keys do we keep in memory?
+ */
+#define MEMORY_CACHE_SIZE 128
+
+/**
+ * Size of a slot in the on-disk cache.  Encoded 1024-bit keys
+ * are less than 600 bytes, so this leaves plenty of room.
+ */
+#define DISK_SLOT_SIZE 1024
+
+/**
+ * Stack size for key generation threads.
+ */
+#define KEYGEN_STACK_SIZE (128 * 1024)
+
+typedef struct KBlockKeyCacheLine
 {
+  /**
+   * This is a doubly-linked list (LRU order).
+   */
+  struct KBlockKeyCacheLine *next;
+
+  /**
+   * This is a doubly-linked list (LRU order).
+   */
+  struct KBlockKeyCacheLine *prev;
+
   GNUNET_HashCode hc;
+
   GNUNET_RSA_PrivateKeyEncoded *pke;
 } KBlockKeyCacheLine;
 
-static KBlockKeyCacheLine **cache;
-static unsigned int cacheSize;
+/**
+ * Header of a slot in the on-disk cache.  The slot
+ * that a key is stored in is determined by the hash
+ * that the key was derived from; the header is followed
+ * by the GNUNET_RSA_PrivateKeyEncoded.
+ */
+typedef struct
+{
+  /**
+   * Hash that the key was derived from.
+   */
+  GNUNET_HashCode hc;
+
+  /**
+   * CRC32 of the encoded key (in network byte order);
+   * used to detect slots that were only partially written.
+   */
+  int crc;
+} KBlockKeyDiskSlot;
+
+/**
+ * Map from hash codes to cache lines.
+ */
+static struct GNUNET_MultiHashMap *cache;
+
+/**
+ * Most recently used cache line.
+ */
+static KBlockKeyCacheLine *cache_head;
+
+/**
+ * Least recently used cache line.
+ */
+static KBlockKeyCacheLine *cache_tail;
+
+/**
+ * Name of the on-disk cache, NULL if not open.
+ */
+static char *disk_cache_name;
+
+/**
+ * Handle of the on-disk cache, -1 if not open.
+ */
+static int disk_cache_fd = -1;
+
+/**
+ * Number of slots in the on-disk cache.
+ */
+static unsigned int disk_cache_slots;
+
 static struct GNUNET_Mutex *lock;
 
+/**
+ * Find a key in the memory cache and mark it as
+ * most recently used.  Caller must hold the lock.
+ *
+ * @return NULL if the key is not cached
+ */
+static KBlockKeyCacheLine *
+memory_cache_lookup (const GNUNET_HashCode * hc)
+{
+  KBlockKeyCacheLine *line;
+
+  line = GNUNET_multi_hash_map_get (cache, hc);
+  if (line == NULL)
+    return NULL;
+  if (line != cache_head)
+    {
+      GNUNET_DLL_remove (cache_head, cache_tail, line);
+      GNUNET_DLL_insert (cache_head, cache_tail, line);
+    }
+  return line;
+}
+
+/**
+ * Add a key to the memory cache, evicting the least
+ * recently used key if the cache is full.  Caller must
+ * hold the lock.  Takes ownership of pke.
+ */
+static void
+memory_cache_insert (const GNUNET_HashCode * hc,
+                     GNUNET_RSA_PrivateKeyEncoded * pke)
+{
+  KBlockKeyCacheLine *line;
+
+  if (GNUNET_YES == GNUNET_multi_hash_map_contains (cache, hc))
+    {
+      GNUNET_free (pke);
+      return;
+    }
+  line = GNUNET_malloc (sizeof (KBlockKeyCacheLine));
+  line->hc = *hc;
+  line->pke = pke;
+  GNUNET_DLL_insert (cache_head, cache_tail, line);
+  GNUNET_multi_hash_map_put (cache, hc, line,
+                             GNUNET_MultiHashMapOption_UNIQUE_FAST);
+  if (GNUNET_multi_hash_map_size (cache) <= MEMORY_CACHE_SIZE)
+    return;
+  line = cache_tail;
+  GNUNET_DLL_remove (cache_head, cache_tail, line);
+  GNUNET_multi_hash_map_remove (cache, &line->hc, line);
+  GNUNET_free (line->pke);
+  GNUNET_free (line);
+}
+
+/**
+ * Compute the offset of the disk cache slot for the given hash.
+ */
+static off_t
+disk_cache_offset (const GNUNET_HashCode * hc)
+{
+  return (off_t) (((unsigned int) hc->bits[0]) % disk_cache_slots) *
+    DISK_SLOT_SIZE;
+}
+
+/**
+ * Try to read a key from the on-disk cache.  Caller
+ * must hold the lock.
+ *
+ * @return NULL if the key is not in the cache (or the
+ *         slot is corrupt), otherwise the encoded key
+ */
+static GNUNET_RSA_PrivateKeyEncoded *
+disk_cache_lookup (const GNUNET_HashCode * hc)
+{
+  char buf[DISK_SLOT_SIZE];
+  const KBlockKeyDiskSlot *slot;
+  const GNUNET_RSA_PrivateKeyEncoded *enc;
+  GNUNET_RSA_PrivateKeyEncoded *ret;
+  unsigned short len;
+
+  if (disk_cache_fd == -1)
+    return NULL;
+  if (disk_cache_offset (hc) != LSEEK (disk_cache_fd,
+                                       disk_cache_offset (hc), SEEK_SET))
+    return NULL;
+  if (DISK_SLOT_SIZE != READ (disk_cache_fd, buf, DISK_SLOT_SIZE))
+    return NULL;
+  slot = (const KBlockKeyDiskSlot *) buf;
+  if (0 != memcmp (hc, &slot->hc, sizeof (GNUNET_HashCode)))
+    return NULL;
+  enc = (const GNUNET_RSA_PrivateKeyEncoded *) &slot[1];
+  len = ntohs (enc->len);
+  if ((len < sizeof (GNUNET_RSA_PrivateKeyEncoded)) ||
+      (len > DISK_SLOT_SIZE - sizeof (KBlockKeyDiskSlot)) ||
+      (ntohl (slot->crc) != GNUNET_crc32_n (enc, len)))
+    return NULL;
+  ret = GNUNET_malloc (len);
+  memcpy (ret, enc, len);
+  return ret;
+}
+
+/**
+ * Store a key in the on-disk cache, replacing whatever
+ * was in its slot.  Caller must hold the lock.
+ */
+static void
+disk_cache_store (const GNUNET_HashCode * hc,
+                  const GNUNET_RSA_PrivateKeyEncoded * pke)
+{
+  char buf[DISK_SLOT_SIZE];
+  KBlockKeyDiskSlot *slot;
+  unsigned short len;
+
+  if (disk_cache_fd == -1)
+    return;
+  len = ntohs (pke->len);
+  if (len > DISK_SLOT_SIZE - sizeof (KBlockKeyDiskSlot))
+    return;
+  memset (buf, 0, sizeof (buf));
+  slot = (KBlockKeyDiskSlot *) buf;
+  slot->hc = *hc;
+  slot->crc = htonl (GNUNET_crc32_n (pke, len));
+  memcpy (&slot[1], pke, len);
+  if (disk_cache_offset (hc) != LSEEK (disk_cache_fd,
+                                       disk_cache_offset (hc), SEEK_SET))
+    return;
+  WRITE (disk_cache_fd, buf, DISK_SLOT_SIZE);
+}
+
+/**
+ * Use the given file as a persistent cache for KBlock
+ * keys (in addition to the in-memory cache).  The file
+ * is bounded in size; keys that map to the same slot
+ * replace each other.
+ *
+ * @param filename name of the cache file
+ * @param slots number of keys the file can hold
+ * @return GNUNET_OK on success, GNUNET_SYSERR on error
+ */
+int
+GNUNET_RSA_kblock_key_cache_open (struct GNUNET_GE_Context *ectx,
+                                  const char *filename, unsigned int slots)
+{
+  int fd;
+
+  GNUNET_mutex_lock (lock);
+  if ((disk_cache_name != NULL) &&
+      (0 == strcmp (disk_cache_name, filename)) &&
+      (disk_cache_slots == slots))
+    {
+      GNUNET_mutex_unlock (lock);
+      return GNUNET_OK;
+    }
+  GNUNET_mutex_unlock (lock);
+  GNUNET_RSA_kblock_key_cache_close ();
+  if (slots == 0)
+    return GNUNET_OK;
+  if (GNUNET_OK != GNUNET_disk_directory_create_for_file (ectx, filename))
+    return GNUNET_SYSERR;
+  fd = GNUNET_disk_file_open (ectx, filename, O_RDWR | O_CREAT,
+                              S_IRUSR | S_IWUSR);
+  if (fd == -1)
+    return GNUNET_SYSERR;
+  GNUNET_mutex_lock (lock);
+  disk_cache_fd = fd;
+  disk_cache_slots = slots;
+  disk_cache_name = GNUNET_strdup (filename);
+  GNUNET_mutex_unlock (lock);
+  return GNUNET_OK;
+}
+
+/**
+ * Stop using the persistent cache for KBlock keys.
+ */
+void
+GNUNET_RSA_kblock_key_cache_close ()
+{
+  GNUNET_mutex_lock (lock);
+  if (disk_cache_fd != -1)
+    CLOSE (disk_cache_fd);
+  disk_cache_fd = -1;
+  disk_cache_slots = 0;
+  GNUNET_free_non_null (disk_cache_name);
+  disk_cache_name = NULL;
+  GNUNET_mutex_unlock (lock);
+}
+
+/**
+ * Drop all keys from the in-memory cache (the persistent
+ * cache is not affected).
+ */
+void
+GNUNET_RSA_kblock_key_cache_flush ()
+{
+  KBlockKeyCacheLine *line;
+
+  GNUNET_mutex_lock (lock);
+  while (NULL != (line = cache_head))
+    {
+      GNUNET_DLL_remove (cache_head, cache_tail, line);
+      GNUNET_multi_hash_map_remove (cache, &line->hc, line);
+      GNUNET_free (line->pke);
+      GNUNET_free (line);
+    }
+  GNUNET_mutex_unlock (lock);
+}
+
 /**
  * Deterministically (!) create a hostkey using only the
  * given HashCode as input to the PRNG.
@@ -536,42 +817,134 @@ GNUNET_RSA_create_key_from_hash (const GNUNET_HashCode * hc)
 {
   struct GNUNET_RSA_PrivateKey *ret;
   KBlockKeyCacheLine *line;
-  int i;
+  GNUNET_RSA_PrivateKeyEncoded *pke;
 
   GNUNET_mutex_lock (lock);
-  for (i = 0; i < cacheSize; i++)
+  line = memory_cache_lookup (hc);
+  if (line != NULL)
     {
-      if (0 == memcmp (hc, &cache[i]->hc, sizeof (GNUNET_HashCode)))
+      ret = GNUNET_RSA_decode_key (line->pke);
+      GNUNET_mutex_unlock (lock);
+      return ret;
+    }
+  pke = disk_cache_lookup (hc);
+  if (pke != NULL)
+    {
+      ret = GNUNET_RSA_decode_key (pke);
+      if (ret != NULL)
         {
-          ret = GNUNET_RSA_decode_key (cache[i]->pke);
+          memory_cache_insert (hc, pke);
           GNUNET_mutex_unlock (lock);
           return ret;
         }
+      GNUNET_free (pke);
     }
-
-  line = GNUNET_malloc (sizeof (KBlockKeyCacheLine));
-  line->hc = *hc;
-  line->pke = makeKblockKeyInternal (hc);
-  GNUNET_array_grow (cache, cacheSize, cacheSize + 1);
-  cache[cacheSize - 1] = line;
   GNUNET_mutex_unlock (lock);
-  return GNUNET_RSA_decode_key (line->pke);
+  /* generate without holding the lock so that
+     other threads can generate keys concurrently */
+  pke = makeKblockKeyInternal (hc);
+  ret = GNUNET_RSA_decode_key (pke);
+  GNUNET_mutex_lock (lock);
+  disk_cache_store (hc, pke);
+  memory_cache_insert (hc, pke);
+  GNUNET_mutex_unlock (lock);
+  return ret;
+}
+
+/**
+ * Shared state of the threads of a batch key generation.
+ */
+struct KeyGenerationBatch
+{
+  const GNUNET_HashCode *input;
+
+  struct GNUNET_RSA_PrivateKey **keys;
+
+  struct GNUNET_Mutex *lock;
+
+  unsigned int count;
+
+  unsigned int next;
+};
+
+/**
+ * Main function of a key generation thread: keep
+ * generating keys of the batch until none are left.
+ */
+static void *
+generate_keys_thread (void *cls)
+{
+  struct KeyGenerationBatch *batch = cls;
+  unsigned int i;
+
+  while (1)
+    {
+      GNUNET_mutex_lock (batch->lock);
+      i = batch->next++;
+      GNUNET_mutex_unlock (batch->lock);
+      if (i >= batch->count)
+        break;
+      batch->keys[i] = GNUNET_RSA_create_key_from_hash (&batch->input[i]);
+    }
+  return NULL;
+}
+
+/**
+ * Deterministically create the keys for several hash codes,
+ * using one thread per CPU for keys that are not yet cached.
+ *
+ * @param count number of keys to create
+ * @param input hash codes to derive the keys from
+ * @param keys array of count entries set to the resulting
+ *        keys (caller must free them)
+ */
+void
+GNUNET_RSA_create_keys_from_hashes (unsigned int count,
+                                    const GNUNET_HashCode * input,
+                                    struct GNUNET_RSA_PrivateKey **keys)
+{
+  struct KeyGenerationBatch batch;
+  struct GNUNET_ThreadHandle **threads;
+  unsigned int cpus;
+  unsigned int i;
+  void *unused;
+
+  cpus = 1;
+#ifdef _SC_NPROCESSORS_ONLN
+  if (sysconf (_SC_NPROCESSORS_ONLN) > 1)
+    cpus = (unsigned int) sysconf (_SC_NPROCESSORS_ONLN);
+#endif
+  if (cpus > count)
+    cpus = count;
+  batch.input = input;
+  batch.keys = keys;
+  batch.count = count;
+  batch.next = 0;
+  batch.lock = GNUNET_mutex_create (GNUNET_NO);
+  threads = GNUNET_malloc (sizeof (struct GNUNET_ThreadHandle *) *
+                           (cpus + 1));
+  for (i = 1; i < cpus; i++)
+    threads[i] = GNUNET_thread_create (&generate_keys_thread,
+                                       &batch, KEYGEN_STACK_SIZE);
+  generate_keys_thread (&batch);
+  for (i = 1; i < cpus; i++)
+    if (threads[i] != NULL)
+      GNUNET_thread_join (threads[i], &unused);
+  GNUNET_free (threads);
+  GNUNET_mutex_destroy (batch.lock);
 }
 
 void __attribute__ ((constructor)) GNUNET_crypto_kblock_ltdl_init ()
 {
   lock = GNUNET_mutex_create (GNUNET_NO);
+  cache = GNUNET_multi_hash_map_create (MEMORY_CACHE_SIZE);
 }
 
 void __attribute__ ((destructor)) GNUNET_crypto_kblock_ltdl_fini ()
 {
-  int i;
-  for (i = 0; i < cacheSize; i++)
-    {
-      GNUNET_free (cache[i]->pke);
-      GNUNET_free (cache[i]);
-    }
-  GNUNET_array_grow (cache, cacheSize, 0);
+  GNUNET_RSA_kblock_key_cache_close ();
+  GNUNET_RSA_kblock_key_cache_flush ();
+  GNUNET_multi_hash_map_destroy (cache);
   GNUNET_mutex_destroy (lock);
 }
 
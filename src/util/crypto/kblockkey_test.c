@@ -225,6 +225,118 @@ testPrivateKeyEncoding (const struct GNUNET_RSA_PrivateKey *hostkey)
   return ok;
 }
 
+#define BATCH_SIZE 4
+
+#define CACHE_FILE "/tmp/gnunet-kblockkey-test.cache"
+
+static int
+testBatch ()
+{
+  GNUNET_HashCode in[BATCH_SIZE];
+  struct GNUNET_RSA_PrivateKey *keys[BATCH_SIZE];
+  struct GNUNET_RSA_PrivateKey *hostkey;
+  GNUNET_RSA_PublicKey pkey;
+  GNUNET_RSA_PublicKey pkey1;
+  int ok;
+  int i;
+
+  fprintf (stderr, "Testing batch KBlock key generation ");
+  for (i = 0; i < BATCH_SIZE; i++)
+    GNUNET_create_random_hash (&in[i]);
+  GNUNET_RSA_create_keys_from_hashes (BATCH_SIZE, in, keys);
+  ok = GNUNET_OK;
+  for (i = 0; i < BATCH_SIZE; i++)
+    {
+      fprintf (stderr, ".");
+      if (keys[i] == NULL)
+        {
+          GNUNET_GE_BREAK (NULL, 0);
+          ok = GNUNET_SYSERR;
+          continue;
+        }
+      hostkey = GNUNET_RSA_create_key_from_hash (&in[i]);
+      GNUNET_RSA_get_public_key (keys[i], &pkey);
+      GNUNET_RSA_get_public_key (hostkey, &pkey1);
+      if (0 != memcmp (&pkey, &pkey1, sizeof (GNUNET_RSA_PublicKey)))
+        {
+          GNUNET_GE_BREAK (NULL, 0);
+          ok = GNUNET_SYSERR;
+        }
+      GNUNET_RSA_free_key (hostkey);
+      GNUNET_RSA_free_key (keys[i]);
+    }
+  fprintf (stderr, ok == GNUNET_OK ? " OK\n" : " ERROR\n");
+  return ok;
+}
+
+static int
+testDiskCache ()
+{
+  GNUNET_HashCode in;
+  struct GNUNET_RSA_PrivateKey *hostkey;
+  GNUNET_RSA_PublicKey pkey;
+  GNUNET_RSA_PublicKey pkey1;
+  unsigned long long size;
+  char garbage[4096];
+  int fd;
+  int ok;
+
+  fprintf (stderr, "Testing persistent KBlock key cache ");
+  ok = GNUNET_OK;
+  UNLINK (CACHE_FILE);
+  if (GNUNET_OK != GNUNET_RSA_kblock_key_cache_open (NULL, CACHE_FILE, 16))
+    {
+      fprintf (stderr, " ERROR\n");
+      return GNUNET_SYSERR;
+    }
+  GNUNET_create_random_hash (&in);
+  hostkey = GNUNET_RSA_create_key_from_hash (&in);
+  GNUNET_RSA_get_public_key (hostkey, &pkey);
+  GNUNET_RSA_free_key (hostkey);
+  GNUNET_RSA_kblock_key_cache_close ();
+  if ((GNUNET_OK != GNUNET_disk_file_size (NULL, CACHE_FILE, &size,
+                                           GNUNET_YES)) || (size == 0)
+      || (size > 16 * 1024))
+    {
+      GNUNET_GE_BREAK (NULL, 0);
+      ok = GNUNET_SYSERR;
+    }
+  /* the key must now come from the file, not from memory */
+  GNUNET_RSA_kblock_key_cache_flush ();
+  GNUNET_RSA_kblock_key_cache_open (NULL, CACHE_FILE, 16);
+  hostkey = GNUNET_RSA_create_key_from_hash (&in);
+  GNUNET_RSA_get_public_key (hostkey, &pkey1);
+  GNUNET_RSA_free_key (hostkey);
+  GNUNET_RSA_kblock_key_cache_close ();
+  if (0 != memcmp (&pkey, &pkey1, sizeof (GNUNET_RSA_PublicKey)))
+    {
+      GNUNET_GE_BREAK (NULL, 0);
+      ok = GNUNET_SYSERR;
+    }
+  /* a corrupt cache must not result in bad keys */
+  memset (garbage, 42, sizeof (garbage));
+  fd = GNUNET_disk_file_open (NULL, CACHE_FILE, O_WRONLY);
+  if (fd != -1)
+    {
+      WRITE (fd, garbage, sizeof (garbage));
+      CLOSE (fd);
+    }
+  GNUNET_RSA_kblock_key_cache_flush ();
+  GNUNET_RSA_kblock_key_cache_open (NULL, CACHE_FILE, 16);
+  hostkey = GNUNET_RSA_create_key_from_hash (&in);
+  GNUNET_RSA_get_public_key (hostkey, &pkey1);
+  GNUNET_RSA_free_key (hostkey);
+  if (0 != memcmp (&pkey, &pkey1, sizeof (GNUNET_RSA_PublicKey)))
+    {
+      GNUNET_GE_BREAK (NULL, 0);
+      ok = GNUNET_SYSERR;
+    }
+  GNUNET_RSA_kblock_key_cache_close ();
+  UNLINK (CACHE_FILE);
+  fprintf (stderr, ok == GNUNET_OK ? "OK\n" : "ERROR\n");
+  return ok;
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -250,6 +362,10 @@ main (int argc, char *argv[])
     failureCount++;
   if (GNUNET_OK != testPrivateKeyEncoding (hostkey))
     failureCount++;
+  if (GNUNET_OK != testBatch ())
+    failureCount++;
+  if (GNUNET_OK != testDiskCache ())
+    failureCount++;
   GNUNET_RSA_free_key (hostkey);
 
   if (failureCount != 0)
@@ -0,0 +1,103 @@
+/*
+     This file is part of GNUnet.
+     (C) 2026 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 2, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+     Boston, MA 02111-1307, USA.
+*/
+
+/**
+ * @file util/crypto/sha512_mb.h
+ * @brief multi-buffer SHA-512 compression function
+ * @author Christian Grothoff
+ *
+ * This file is included by hashing.c once for each vector width.
+ * Before inclusion, MB_NAME (function name), MB_VECTOR (name for
+ * the vector type), MB_LANES (number of 64-bit lanes) and MB_TARGET
+ * (instruction set for the function) must be defined.  Each lane
+ * of the vectors holds the state of one message.
+ */
+
+typedef unsigned long long MB_VECTOR
+  __attribute__ ((vector_size (8 * MB_LANES)));
+
+static __attribute__ ((target (MB_TARGET))) void
+MB_NAME (unsigned long long *state, const unsigned char *const *blocks)
+{
+  MB_VECTOR W[80];
+  MB_VECTOR a, b, c, d, e, f, g, h, t1, t2;
+  unsigned long long tmp[MB_LANES];
+  unsigned long long word;
+  unsigned int l;
+  int i;
+
+  /* load the input, one message per lane (x86 is little-endian) */
+  for (i = 0; i < 16; i++)
+    {
+      for (l = 0; l < MB_LANES; l++)
+        {
+          memcpy (&word, &blocks[l][8 * i], sizeof (unsigned long long));
+          tmp[l] = __builtin_bswap64 (word);
+        }
+      memcpy (&W[i], tmp, sizeof (MB_VECTOR));
+    }
+  for (i = 16; i < 80; i++)
+    W[i] = MB_S1 (W[i - 2]) + W[i - 7] + MB_S0 (W[i - 15]) + W[i - 16];
+
+  memcpy (&a, &state[0 * MB_LANES], sizeof (MB_VECTOR));
+  memcpy (&b, &state[1 * MB_LANES], sizeof (MB_VECTOR));
+  memcpy (&c, &state[2 * MB_LANES], sizeof (MB_VECTOR));
+  memcpy (&d, &state[3 * MB_LANES], sizeof (MB_VECTOR));
+  memcpy (&e, &state[4 * MB_LANES], sizeof (MB_VECTOR));
+  memcpy (&f, &state[5 * MB_LANES], sizeof (MB_VECTOR));
+  memcpy (&g, &state[6 * MB_LANES], sizeof (MB_VECTOR));
+  memcpy (&h, &state[7 * MB_LANES], sizeof (MB_VECTOR));
+
+  for (i = 0; i < 80; i++)
+    {
+      t1 = h + MB_E1 (e) + MB_CH (e, f, g) + sha512_K[i] + W[i];
+      t2 = MB_E0 (a) + MB_MAJ (a, b, c);
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+
+#define MB_ADD(v, off) \
+  memcpy (&t1, &state[(off) * MB_LANES], sizeof (MB_VECTOR)); \
+  t1 += v; \
+  memcpy (&state[(off) * MB_LANES], &t1, sizeof (MB_VECTOR));
+  MB_ADD (a, 0);
+  MB_ADD (b, 1);
+  MB_ADD (c, 2);
+  MB_ADD (d, 3);
+  MB_ADD (e, 4);
+  MB_ADD (f, 5);
+  MB_ADD (g, 6);
+  MB_ADD (h, 7);
+#undef MB_ADD
+
+  /* erase our data */
+  memset (W, 0, sizeof (W));
+}
+
+#undef MB_NAME
+#undef MB_VECTOR
+#undef MB_LANES
+#undef MB_TARGET
@@ -429,7 +429,9 @@ GNUNET_socket_recv (struct GNUNET_SocketHandle *s,
       GNUNET_GE_ASSERT (NULL, pos + ret >= pos);
       pos += ret;
     }
-  while ((pos < max) && (0 != (nc & GNUNET_NC_BLOCKING)));
+  while ((pos < max) &&
+         (GNUNET_NC_COMPLETE_TRANSFER ==
+          (nc & GNUNET_NC_COMPLETE_TRANSFER)));
   *read = pos;
   return GNUNET_YES;
 }
@@ -25,11 +25,24 @@
  *
  * Generic TCP code for reliable, mostly blocking, record-oriented TCP
  * connections. GNUnet uses the "tcpio" code for trusted client-server
- * (e.g. gnunet-gtk to gnunetd via loopback) communications.  Note
+ * (e.g. gnunet-gtk to gnunetd via loopback) communications.  Clients
+ * on the same host as gnunetd use a UNIX domain socket instead of
+ * TCP if gnunetd offers one.  Note
  * that an unblocking write is also provided since if both client and
  * server use blocking IO, both may block on a write and cause a
  * mutual inter-process deadlock.
  *
+ * Requests can also be pipelined: GNUNET_client_connection_queue
+ * appends a request to a write buffer (sent with a single system
+ * call by GNUNET_client_connection_flush) and registers a handler
+ * for its replies.  gnunetd answers the requests of a client in
+ * order, so replies are matched to the handlers in FIFO order.
+ * They are delivered by a reader thread (started on first use) or
+ * by a concurrent synchronous reader, which passes replies for
+ * pending handlers on before returning the next message to its
+ * caller.  The synchronous write simply queues its message without
+ * a handler and flushes.
+ *
  * Since we do not want other peers (!) to be able to block a peer by
  * not reading from the TCP stream, the peer-to-peer TCP transport
  * uses unreliable, buffered, non-blocking, record-oriented TCP code
@@ -37,7 +50,9 @@
  * provided in transports/tcp.c.
  */
 
+#include "gnunet_directories.h"
 #include "gnunet_util_network.h"
+#include "gnunet_util_network_client.h"
 #include "gnunet_util_os.h"
 #include "gnunet_util_config.h"
 #include "gnunet_protocols.h"
@@ -45,6 +60,35 @@
 
 #define DEBUG_TCPIO GNUNET_NO
 
+/**
+ * Size of the read buffer of a connection (must be
+ * larger than the largest message).
+ */
+#define READ_BUFFER_SIZE 65536
+
+/**
+ * Size of the write buffer of a connection (must be
+ * larger than the largest message).
+ */
+#define WRITE_BUFFER_SIZE 65536
+
+/**
+ * A request that waits for its replies.
+ */
+struct PendingReply
+{
+  struct PendingReply *next;
+
+  GNUNET_ClientReplyHandler handler;
+
+  void *cls;
+
+  /**
+   * Was the request transmitted (GNUNET_YES/GNUNET_NO)?
+   */
+  int sent;
+};
+
 /**
  * Struct to refer to a GNUnet TCP connection.
  * This is more than just a socket because if the server
@@ -69,6 +113,62 @@ typedef struct GNUNET_ClientServerConnection
 
   struct GNUNET_GC_Configuration *cfg;
 
+  /**
+   * Data received from gnunetd that was not yet returned
+   * by GNUNET_client_connection_read (protected by readlock).
+   */
+  char *rbuf;
+
+  /**
+   * Offset of the first byte in rbuf that was not yet returned.
+   */
+  unsigned int rstart;
+
+  /**
+   * Number of bytes in rbuf.
+   */
+  unsigned int rend;
+
+  /**
+   * Requests that were queued but not yet sent
+   * (protected by writelock).
+   */
+  char *wbuf;
+
+  /**
+   * Number of bytes in wbuf.
+   */
+  unsigned int wlen;
+
+  /**
+   * Requests waiting for replies, in the order in which they
+   * were queued (protected by pendinglock).
+   */
+  struct PendingReply *pending;
+
+  /**
+   * Last element of the pending list.
+   */
+  struct PendingReply *pendingTail;
+
+  struct GNUNET_Mutex *pendinglock;
+
+  /**
+   * Thread delivering replies to pending requests,
+   * NULL if not yet started (protected by pendinglock).
+   */
+  struct GNUNET_ThreadHandle *reader;
+
+  /**
+   * Signals the reader thread that requests were sent.
+   */
+  struct GNUNET_Semaphore *readerSignal;
+
+  /**
+   * Set to GNUNET_YES to stop the reader thread.
+   */
+  int readerStop;
+
   int dead;
 
 } ClientServerConnection;
@@ -174,6 +274,117 @@ getGNUnetdHost (struct GNUNET_GE_Context *ectx,
   return res;
 }
 
+char *
+GNUNET_client_connection_get_unix_path (struct GNUNET_GC_Configuration *cfg,
+                                        unsigned short port)
+{
+#ifndef MINGW
+  char def[64];
+  char *path;
+
+  if (GNUNET_NO ==
+      GNUNET_GC_get_configuration_value_yesno (cfg,
+                                               "NETWORK",
+                                               "UNIX-SOCKET", GNUNET_YES))
+    return NULL;
+  GNUNET_snprintf (def, sizeof (def), GNUNET_DEFAULT_UNIX_SOCKET_DIRECTORY
+                   DIR_SEPARATOR_STR "gnunetd-%u.sock", port);
+  path = NULL;
+  if (-1 == GNUNET_GC_get_configuration_value_filename (cfg,
+                                                        "NETWORK",
+                                                        "UNIX-PATH",
+                                                        def, &path))
+    return NULL;
+  if ((path != NULL) && (strlen (path) > 0))
+    return path;
+  GNUNET_free_non_null (path);
+  return GNUNET_strdup (def);
+#else
+  return NULL;
+#endif
+}
+
+/**
+ * Is the given host name the local host?
+ */
+static int
+is_local_host (const char *host)
+{
+  return ((0 == strcmp (host, "localhost")) ||
+          (0 == strncmp (host, "127.", 4)) || (0 == strcmp (host, "::1")));
+}
+
+#ifndef MINGW
+/**
+ * Was the socket at the given path created by gnunetd?  Only
+ * sockets owned by root, by us or by the user that gnunetd
+ * runs as (option USER in section GNUNETD) are trusted, so that
+ * other local users can not pose as gnunetd.
+ */
+static int
+is_trusted_socket (struct GNUNET_GC_Configuration *cfg, const char *path)
+{
+  struct stat st;
+  struct passwd *pws;
+  char *user;
+  int ret;
+
+  if ((0 != lstat (path, &st)) || (!S_ISSOCK (st.st_mode)))
+    return GNUNET_NO;
+  if ((st.st_uid == 0) || (st.st_uid == geteuid ()))
+    return GNUNET_YES;
+  ret = GNUNET_NO;
+  user = NULL;
+  GNUNET_GC_get_configuration_value_string (cfg, "GNUNETD", "USER", "",
+                                            &user);
+  if ((user != NULL) && (strlen (user) > 0))
+    {
+      pws = getpwnam (user);
+      if ((pws != NULL) && (pws->pw_uid == st.st_uid))
+        ret = GNUNET_YES;
+    }
+  GNUNET_free_non_null (user);
+  return ret;
+}
+
+/**
+ * Try to connect to gnunetd via its UNIX domain socket.
+ *
+ * @return the socket, -1 if gnunetd can not be reached this way
+ */
+static int
+connect_unix (struct GNUNET_ClientServerConnection *sock,
+              unsigned short port)
+{
+  struct sockaddr_un addr;
+  char *path;
+  int osock;
+
+  path = GNUNET_client_connection_get_unix_path (sock->cfg, port);
+  if (path == NULL)
+    return -1;
+  if (GNUNET_YES != is_trusted_socket (sock->cfg, path))
+    {
+      GNUNET_free (path);
+      return -1;
+    }
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  strncpy (addr.sun_path, path, sizeof (addr.sun_path) - 1);
+  GNUNET_free (path);
+  osock = SOCKET (PF_UNIX, SOCK_STREAM, 0);
+  if (osock == -1)
+    return -1;
+  if (0 != CONNECT (osock, (struct sockaddr *) &addr, sizeof (addr)))
+    {
+      /* gnunetd is not running or does not offer the socket */
+      CLOSE (osock);
+      return -1;
+    }
+  return osock;
+}
+#endif
+
 struct GNUNET_ClientServerConnection *
 GNUNET_client_connection_create (struct GNUNET_GE_Context *ectx,
                                  struct GNUNET_GC_Configuration *cfg)
@@ -187,61 +398,138 @@ GNUNET_client_connection_create (struct GNUNET_GE_Context *ectx,
   result->destroylock = GNUNET_mutex_create (GNUNET_YES);
   result->ectx = ectx;
   result->cfg = cfg;
+  result->rbuf = GNUNET_malloc (READ_BUFFER_SIZE);
+  result->rstart = 0;
+  result->rend = 0;
+  result->wbuf = GNUNET_malloc (WRITE_BUFFER_SIZE);
+  result->wlen = 0;
+  result->pending = NULL;
+  result->pendingTail = NULL;
+  result->pendinglock = GNUNET_mutex_create (GNUNET_NO);
+  result->reader = NULL;
+  result->readerSignal = GNUNET_semaphore_create (0);
+  result->readerStop = GNUNET_NO;
+  result->dead = GNUNET_NO;
   return result;
 }
 
+/**
+ * Remove all pending requests (and the unsent requests)
+ * of a connection.  Caller must hold readlock and writelock.
+ *
+ * @return the list of removed requests
+ */
+static struct PendingReply *
+detach_pending (struct GNUNET_ClientServerConnection *sock)
+{
+  struct PendingReply *ret;
+
+  sock->wlen = 0;
+  GNUNET_mutex_lock (sock->pendinglock);
+  ret = sock->pending;
+  sock->pending = NULL;
+  sock->pendingTail = NULL;
+  GNUNET_mutex_unlock (sock->pendinglock);
+  return ret;
+}
+
+/**
+ * Notify the handlers of removed requests that no
+ * reply will arrive and free the list.
+ */
+static void
+fail_pending (struct PendingReply *pos)
+{
+  struct PendingReply *next;
+
+  while (pos != NULL)
+    {
+      next = pos->next;
+      pos->handler (pos->cls, NULL);
+      GNUNET_free (pos);
+      pos = next;
+    }
+}
+
 void
 GNUNET_client_connection_close_temporarily (struct
                                             GNUNET_ClientServerConnection
                                             *sock)
 {
+  struct PendingReply *failed;
+
   GNUNET_GE_ASSERT (NULL, sock != NULL);
   GNUNET_mutex_lock (sock->destroylock);
+  if (sock->sock != NULL)
+    GNUNET_socket_close (sock->sock);
+  GNUNET_mutex_lock (sock->readlock);
+  GNUNET_mutex_lock (sock->writelock);
   if (sock->sock != NULL)
     {
-      GNUNET_socket_close (sock->sock);
-      GNUNET_mutex_lock (sock->readlock);
-      GNUNET_mutex_lock (sock->writelock);
       GNUNET_socket_destroy (sock->sock);
       sock->sock = NULL;
-      GNUNET_mutex_unlock (sock->writelock);
-      GNUNET_mutex_unlock (sock->readlock);
+      sock->rstart = 0;
+      sock->rend = 0;
     }
+  failed = detach_pending (sock);
+  GNUNET_mutex_unlock (sock->writelock);
+  GNUNET_mutex_unlock (sock->readlock);
   GNUNET_mutex_unlock (sock->destroylock);
+  fail_pending (failed);
 }
 
 void
 GNUNET_client_connection_close_forever (struct GNUNET_ClientServerConnection
                                         *sock)
 {
+  struct PendingReply *failed;
+
   GNUNET_GE_ASSERT (NULL, sock != NULL);
   GNUNET_mutex_lock (sock->destroylock);
+  if (sock->sock != NULL)
+    GNUNET_socket_close (sock->sock);
+  GNUNET_mutex_lock (sock->readlock);
+  GNUNET_mutex_lock (sock->writelock);
   if (sock->sock != NULL)
     {
-      GNUNET_socket_close (sock->sock);
-      GNUNET_mutex_lock (sock->readlock);
-      GNUNET_mutex_lock (sock->writelock);
       GNUNET_socket_destroy (sock->sock);
       sock->sock = NULL;
-      sock->dead = GNUNET_YES;
-      GNUNET_mutex_unlock (sock->writelock);
-      GNUNET_mutex_unlock (sock->readlock);
-    }
-  else
-    {
-      sock->dead = GNUNET_YES;
+      sock->rstart = 0;
+      sock->rend = 0;
     }
+  sock->dead = GNUNET_YES;
+  failed = detach_pending (sock);
+  GNUNET_mutex_unlock (sock->writelock);
+  GNUNET_mutex_unlock (sock->readlock);
   GNUNET_mutex_unlock (sock->destroylock);
+  fail_pending (failed);
 }
 
 void
 GNUNET_client_connection_destroy (struct GNUNET_ClientServerConnection *sock)
 {
+  struct GNUNET_ThreadHandle *reader;
+  void *unused;
+
   GNUNET_GE_ASSERT (NULL, sock != NULL);
   GNUNET_client_connection_close_forever (sock);
+  GNUNET_mutex_lock (sock->pendinglock);
+  reader = sock->reader;
+  sock->reader = NULL;
+  GNUNET_mutex_unlock (sock->pendinglock);
+  if (reader != NULL)
+    {
+      sock->readerStop = GNUNET_YES;
+      GNUNET_semaphore_up (sock->readerSignal);
+      GNUNET_thread_join (reader, &unused);
+    }
+  GNUNET_semaphore_destroy (sock->readerSignal);
+  GNUNET_mutex_destroy (sock->pendinglock);
   GNUNET_mutex_destroy (sock->readlock);
   GNUNET_mutex_destroy (sock->writelock);
   GNUNET_mutex_destroy (sock->destroylock);
+  GNUNET_free (sock->wbuf);
+  GNUNET_free (sock->rbuf);
   GNUNET_free (sock);
 }
 
@@ -252,6 +540,21 @@ GNUNET_client_connection_test_connected (struct GNUNET_ClientServerConnection
   return (sock->sock != NULL);
 }
 
+int
+GNUNET_client_connection_test_local (struct GNUNET_ClientServerConnection
+                                     *sock)
+{
+  char *host;
+  int ret;
+
+  host = getGNUnetdHost (sock->ectx, sock->cfg);
+  if (host == NULL)
+    return GNUNET_NO;
+  ret = is_local_host (host) ? GNUNET_YES : GNUNET_NO;
+  GNUNET_free (host);
+  return ret;
+}
+
 /**
  * Check a socket, open and connect if it is closed.  This code
  * supports IPv4 and IPv6 (and may try both).  It also waits a bounded
@@ -308,6 +611,27 @@ GNUNET_client_connection_ensure_connected (struct
   host = getGNUnetdHost (sock->ectx, sock->cfg);
   if (host == NULL)
     return GNUNET_SYSERR;
+#ifndef MINGW
+  /* local clients talk to gnunetd via its UNIX domain socket
+     if possible (and fall back to TCP otherwise) */
+  if ((GNUNET_YES == is_local_host (host)) &&
+      (-1 != (osock = connect_unix (sock, port))))
+    {
+      GNUNET_free (host);
+      GNUNET_mutex_lock (sock->destroylock);
+      if ((sock->sock != NULL) || (sock->dead == GNUNET_YES))
+        {
+          CLOSE (osock);
+          ret = (sock->sock != NULL) ? GNUNET_OK : GNUNET_SYSERR;
+          GNUNET_mutex_unlock (sock->destroylock);
+          return ret;
+        }
+      sock->sock = GNUNET_socket_create (sock->ectx, NULL, osock);
+      GNUNET_socket_set_blocking (sock->sock, GNUNET_YES);
+      GNUNET_mutex_unlock (sock->destroylock);
+      return GNUNET_OK;
+    }
+#endif
   af_index = 0;
   /* we immediately advance if there is a DNS lookup error
    * (which would likely persist) or a socket API error
@@ -480,21 +804,15 @@ GNUNET_client_connection_ensure_connected (struct
 }
 
 /**
- * Write to a GNUnet TCP socket.  Will also potentially complete the
- * sending of a previous non-blocking GNUNET_client_connection_write call.
+ * Acquire writelock for a connection that is open
+ * (connecting if necessary).
  *
- * @param sock the socket to write to
- * @param buffer the buffer to write
- * @return GNUNET_OK if the write was sucessful, otherwise GNUNET_SYSERR.
+ * @return GNUNET_OK on success (writelock is held),
+ *         GNUNET_SYSERR if we could not connect
  */
-int
-GNUNET_client_connection_write (struct GNUNET_ClientServerConnection *sock,
-                                const GNUNET_MessageHeader * buffer)
+static int
+lock_connected (struct GNUNET_ClientServerConnection *sock)
 {
-  size_t size;
-  size_t sent;
-  int res;
-
   GNUNET_mutex_lock (sock->destroylock);
   GNUNET_mutex_lock (sock->writelock);
   if (GNUNET_SYSERR == GNUNET_client_connection_ensure_connected (sock))
@@ -504,78 +822,156 @@ GNUNET_client_connection_write (struct GNUNET_ClientServerConnection *sock,
       return GNUNET_SYSERR;
     }
   GNUNET_mutex_unlock (sock->destroylock);
+  /* closing the connection requires writelock, so it stays open */
   GNUNET_GE_ASSERT (NULL, sock->sock != NULL);
-  size = ntohs (buffer->size);
+  return GNUNET_OK;
+}
+
+/**
+ * Send the queued requests.  Caller must hold writelock
+ * (obtained with lock_connected); if sending fails, the
+ * lock is released and the connection is closed.
+ *
+ * @return GNUNET_OK on success, GNUNET_SYSERR on error
+ *         (writelock was released)
+ */
+static int
+flush_locked (struct GNUNET_ClientServerConnection *sock)
+{
+  struct PendingReply *pos;
+  size_t sent;
+  int res;
+
+  if (sock->wlen == 0)
+    return GNUNET_OK;
   res =
-    GNUNET_socket_send (sock->sock, GNUNET_NC_COMPLETE_TRANSFER, buffer, size,
-                        &sent);
-  if ((res != GNUNET_YES) || (sent != size))
+    GNUNET_socket_send (sock->sock, GNUNET_NC_COMPLETE_TRANSFER, sock->wbuf,
+                        sock->wlen, &sent);
+  if ((res != GNUNET_YES) || (sent != sock->wlen))
     {
       GNUNET_mutex_unlock (sock->writelock);
       GNUNET_client_connection_close_temporarily (sock);
       return GNUNET_SYSERR;
     }
-  GNUNET_mutex_unlock (sock->writelock);
+#if DEBUG_TCPIO
+  GNUNET_GE_LOG (sock->ectx,
+                 GNUNET_GE_DEBUG | GNUNET_GE_REQUEST | GNUNET_GE_USER,
+                 "Sent %u bytes of requests to gnunetd.\n", sock->wlen);
+#endif
+  sock->wlen = 0;
+  GNUNET_mutex_lock (sock->pendinglock);
+  pos = sock->pending;
+  while (pos != NULL)
+    {
+      pos->sent = GNUNET_YES;
+      pos = pos->next;
+    }
+  GNUNET_mutex_unlock (sock->pendinglock);
+  return GNUNET_OK;
+}
+
+/**
+ * Append a request to the write buffer (flushing the
+ * buffer first if it is full).  Caller must hold writelock.
+ *
+ * @return GNUNET_OK on success, GNUNET_SYSERR on error
+ *         (writelock was released)
+ */
+static int
+append_locked (struct GNUNET_ClientServerConnection *sock,
+               const GNUNET_MessageHeader * buffer)
+{
+  unsigned short size;
+
+  size = ntohs (buffer->size);
+  if ((sock->wlen + size > WRITE_BUFFER_SIZE) &&
+      (GNUNET_OK != flush_locked (sock)))
+    return GNUNET_SYSERR;
+  memcpy (&sock->wbuf[sock->wlen], buffer, size);
+  sock->wlen += size;
   return GNUNET_OK;
 }
 
+/**
+ * Write to a GNUnet TCP socket.  Will also send all requests
+ * that were queued with GNUNET_client_connection_queue.
+ *
+ * @param sock the socket to write to
+ * @param buffer the buffer to write
+ * @return GNUNET_OK if the write was sucessful, otherwise GNUNET_SYSERR.
+ */
 int
-GNUNET_client_connection_read (struct GNUNET_ClientServerConnection *sock,
-                               GNUNET_MessageHeader ** buffer)
+GNUNET_client_connection_write (struct GNUNET_ClientServerConnection *sock,
+                                const GNUNET_MessageHeader * buffer)
+{
+  if (GNUNET_OK != lock_connected (sock))
+    return GNUNET_SYSERR;
+  if ((GNUNET_OK != append_locked (sock, buffer)) ||
+      (GNUNET_OK != flush_locked (sock)))
+    return GNUNET_SYSERR;
+  GNUNET_mutex_unlock (sock->writelock);
+  return GNUNET_OK;
+}
+
+/**
+ * Read the next message from the connection (RETURN_ERROR
+ * messages are logged and skipped).  Caller must hold readlock
+ * and the connection must be open.
+ *
+ * @return GNUNET_OK on success, GNUNET_SYSERR if the connection
+ *         must be closed
+ */
+static int
+read_message (struct GNUNET_ClientServerConnection *sock,
+              GNUNET_MessageHeader ** buffer)
 {
-  int res;
   size_t pos;
   char *buf;
   unsigned short size;
+  unsigned int avail;
   GNUNET_MessageReturnErrorMessage *rem;
 
-  GNUNET_mutex_lock (sock->destroylock);
-  GNUNET_mutex_lock (sock->readlock);
-  if (GNUNET_OK != GNUNET_client_connection_ensure_connected (sock))
-    {
-      GNUNET_mutex_unlock (sock->readlock);
-      GNUNET_mutex_unlock (sock->destroylock);
-      return GNUNET_SYSERR;
-    }
-  GNUNET_mutex_unlock (sock->destroylock);
-  GNUNET_GE_ASSERT (NULL, sock->sock != NULL);
   while (1)
     {
-      pos = 0;
-      res = 0;
-      if ((GNUNET_OK != GNUNET_socket_recv (sock->sock,
-                                            GNUNET_NC_COMPLETE_TRANSFER,
-                                            &size,
-                                            sizeof (unsigned short),
-                                            &pos))
-          || (pos != sizeof (unsigned short)))
+      /* make sure that the buffer contains a complete message;
+         we read whatever is available, so one recv often
+         yields several messages */
+      while (1)
         {
-          GNUNET_mutex_unlock (sock->readlock);
-          GNUNET_client_connection_close_temporarily (sock);
-          return GNUNET_SYSERR;
+          avail = sock->rend - sock->rstart;
+          if (avail >= sizeof (GNUNET_MessageHeader))
+            {
+              memcpy (&size, &sock->rbuf[sock->rstart],
+                      sizeof (unsigned short));
+              size = ntohs (size);
+              if (size < sizeof (GNUNET_MessageHeader))
+                {
+                  GNUNET_GE_BREAK (sock->ectx, 0);
+                  return GNUNET_SYSERR; /* invalid header */
+                }
+              if (avail >= size)
+                break;
+            }
+          if (sock->rstart > 0)
+            {
+              memmove (sock->rbuf, &sock->rbuf[sock->rstart], avail);
+              sock->rstart = 0;
+              sock->rend = avail;
+            }
+          pos = 0;
+          if ((GNUNET_OK != GNUNET_socket_recv (sock->sock,
+                                                GNUNET_NC_BLOCKING |
+                                                GNUNET_NC_IGNORE_INT,
+                                                &sock->rbuf[sock->rend],
+                                                READ_BUFFER_SIZE -
+                                                sock->rend, &pos))
+              || (pos == 0))
+            return GNUNET_SYSERR;
+          sock->rend += pos;
         }
-      size = ntohs (size);
-      if (size < sizeof (GNUNET_MessageHeader))
-        {
-          GNUNET_GE_BREAK (sock->ectx, 0);
-          GNUNET_mutex_unlock (sock->readlock);
-          GNUNET_client_connection_close_temporarily (sock);
-          return GNUNET_SYSERR; /* invalid header */
-        }
-
       buf = GNUNET_malloc (size);
-      if ((GNUNET_OK != GNUNET_socket_recv (sock->sock,
-                                            GNUNET_NC_COMPLETE_TRANSFER,
-                                            &buf[pos],
-                                            size - pos,
-                                            &pos)) ||
-          (pos + sizeof (unsigned short) != size))
-        {
-          GNUNET_free (buf);
-          GNUNET_mutex_unlock (sock->readlock);
-          GNUNET_client_connection_close_temporarily (sock);
-          return GNUNET_SYSERR;
-        }
+      memcpy (buf, &sock->rbuf[sock->rstart], size);
+      sock->rstart += size;
 #if DEBUG_TCPIO
       GNUNET_GE_LOG (sock->ectx,
                      GNUNET_GE_DEBUG | GNUNET_GE_REQUEST | GNUNET_GE_USER,
@@ -583,17 +979,14 @@ GNUNET_client_connection_read (struct GNUNET_ClientServerConnection *sock,
                      size);
 #endif
       *buffer = (GNUNET_MessageHeader *) buf;
-      (*buffer)->size = htons (size);
 
       if (ntohs ((*buffer)->type) != GNUNET_CS_PROTO_RETURN_ERROR)
-        break;                  /* got actual message! */
+        return GNUNET_OK;       /* got actual message! */
       rem = (GNUNET_MessageReturnErrorMessage *) * buffer;
       if (ntohs (rem->header.size) <
           sizeof (GNUNET_MessageReturnErrorMessage))
         {
           GNUNET_GE_BREAK (sock->ectx, 0);
-          GNUNET_mutex_unlock (sock->readlock);
-          GNUNET_client_connection_close_temporarily (sock);
           GNUNET_free (buf);
           return GNUNET_SYSERR;
         }
@@ -602,7 +995,173 @@ GNUNET_client_connection_read (struct GNUNET_ClientServerConnection *sock,
       GNUNET_GE_LOG (sock->ectx, ntohl (rem->kind), "%.*s", (int) size,
                      &rem[1]);
       GNUNET_free (rem);
-    }                           /* while (1) */
+    }
+}
+
+/**
+ * Do we wait for a reply to a request that was sent?
+ */
+static int
+reply_expected (struct GNUNET_ClientServerConnection *sock)
+{
+  int ret;
+
+  GNUNET_mutex_lock (sock->pendinglock);
+  ret = (sock->pending != NULL) && (sock->pending->sent == GNUNET_YES);
+  GNUNET_mutex_unlock (sock->pendinglock);
+  return ret;
+}
+
+/**
+ * Pass a message to the handler of the oldest pending
+ * request.  Caller must hold readlock.
+ *
+ * @return GNUNET_YES if a handler took the message,
+ *         GNUNET_NO if no request is pending
+ */
+static int
+dispatch_reply (struct GNUNET_ClientServerConnection *sock,
+                const GNUNET_MessageHeader * msg)
+{
+  struct PendingReply *head;
+
+  GNUNET_mutex_lock (sock->pendinglock);
+  head = sock->pending;
+  if ((head != NULL) && (head->sent != GNUNET_YES))
+    head = NULL;
+  GNUNET_mutex_unlock (sock->pendinglock);
+  if (head == NULL)
+    return GNUNET_NO;
+  /* only holders of readlock remove the head, so
+     it can not go away while the handler runs */
+  if (GNUNET_NO == head->handler (head->cls, msg))
+    return GNUNET_YES;          /* more replies to come */
+  GNUNET_mutex_lock (sock->pendinglock);
+  sock->pending = head->next;
+  if (sock->pending == NULL)
+    sock->pendingTail = NULL;
+  GNUNET_mutex_unlock (sock->pendinglock);
+  GNUNET_free (head);
+  return GNUNET_YES;
+}
+
+/**
+ * Main function of the reader thread: deliver replies to
+ * the pending requests whenever requests were sent.
+ */
+static void *
+reader_main (void *cls)
+{
+  struct GNUNET_ClientServerConnection *sock = cls;
+  GNUNET_MessageHeader *msg;
+
+  while (1)
+    {
+      GNUNET_semaphore_down (sock->readerSignal, GNUNET_YES);
+      if (sock->readerStop == GNUNET_YES)
+        break;
+      GNUNET_mutex_lock (sock->readlock);
+      while ((sock->sock != NULL) && (GNUNET_YES == reply_expected (sock)))
+        {
+          msg = NULL;
+          if (GNUNET_OK != read_message (sock, &msg))
+            {
+              GNUNET_mutex_unlock (sock->readlock);
+              GNUNET_client_connection_close_temporarily (sock);
+              GNUNET_mutex_lock (sock->readlock);
+              break;
+            }
+          if (GNUNET_NO == dispatch_reply (sock, msg))
+            GNUNET_GE_BREAK (sock->ectx, 0);
+          GNUNET_free (msg);
+        }
+      GNUNET_mutex_unlock (sock->readlock);
+    }
+  return NULL;
+}
+
+int
+GNUNET_client_connection_queue (struct GNUNET_ClientServerConnection *sock,
+                                const GNUNET_MessageHeader * request,
+                                GNUNET_ClientReplyHandler handler, void *cls)
+{
+  struct PendingReply *pr;
+
+  if (GNUNET_OK != lock_connected (sock))
+    return GNUNET_SYSERR;
+  if (GNUNET_OK != append_locked (sock, request))
+    return GNUNET_SYSERR;
+  if (handler != NULL)
+    {
+      pr = GNUNET_malloc (sizeof (struct PendingReply));
+      pr->next = NULL;
+      pr->handler = handler;
+      pr->cls = cls;
+      pr->sent = GNUNET_NO;
+      GNUNET_mutex_lock (sock->pendinglock);
+      if (sock->pendingTail == NULL)
+        sock->pending = pr;
+      else
+        sock->pendingTail->next = pr;
+      sock->pendingTail = pr;
+      GNUNET_mutex_unlock (sock->pendinglock);
+    }
+  GNUNET_mutex_unlock (sock->writelock);
+  return GNUNET_OK;
+}
+
+int
+GNUNET_client_connection_flush (struct GNUNET_ClientServerConnection *sock)
+{
+  if (GNUNET_OK != lock_connected (sock))
+    return GNUNET_SYSERR;
+  if (GNUNET_OK != flush_locked (sock))
+    return GNUNET_SYSERR;
+  GNUNET_mutex_unlock (sock->writelock);
+  if (GNUNET_YES != reply_expected (sock))
+    return GNUNET_OK;
+  GNUNET_mutex_lock (sock->pendinglock);
+  if ((sock->reader == NULL) && (sock->dead == GNUNET_NO))
+    {
+      sock->reader = GNUNET_thread_create (&reader_main, sock, 64 * 1024);
+      if (sock->reader == NULL)
+        GNUNET_GE_LOG_STRERROR (sock->ectx,
+                                GNUNET_GE_ERROR | GNUNET_GE_USER |
+                                GNUNET_GE_BULK, "pthread_create");
+    }
+  GNUNET_mutex_unlock (sock->pendinglock);
+  GNUNET_semaphore_up (sock->readerSignal);
+  return GNUNET_OK;
+}
+
+int
+GNUNET_client_connection_read (struct GNUNET_ClientServerConnection *sock,
+                               GNUNET_MessageHeader ** buffer)
+{
+  GNUNET_mutex_lock (sock->destroylock);
+  GNUNET_mutex_lock (sock->readlock);
+  if (GNUNET_OK != GNUNET_client_connection_ensure_connected (sock))
+    {
+      GNUNET_mutex_unlock (sock->readlock);
+      GNUNET_mutex_unlock (sock->destroylock);
+      return GNUNET_SYSERR;
+    }
+  GNUNET_mutex_unlock (sock->destroylock);
+  GNUNET_GE_ASSERT (NULL, sock->sock != NULL);
+  while (1)
+    {
+      if (GNUNET_OK != read_message (sock, buffer))
+        {
+          GNUNET_mutex_unlock (sock->readlock);
+          GNUNET_client_connection_close_temporarily (sock);
+          return GNUNET_SYSERR;
+        }
+      /* replies to pipelined requests come first */
+      if (GNUNET_NO == dispatch_reply (sock, *buffer))
+        break;
+      GNUNET_free (*buffer);
+      *buffer = NULL;
+    }
   GNUNET_mutex_unlock (sock->readlock);
   return GNUNET_OK;             /* success */
 }
@@ -24,6 +24,7 @@
 
 #include "gnunet_util.h"
 #include "platform.h"
+#include "gnunet_protocols.h"
 
 static struct GNUNET_GC_Configuration *cfg;
 
@@ -173,6 +174,244 @@ testTransmission (struct GNUNET_ClientServerConnection *a,
   return 0;
 }
 
+/**
+ * Send several messages with a single write and check
+ * that the client returns them one by one.
+ */
+static int
+testBatchedRead (struct GNUNET_ClientServerConnection *a,
+                 struct GNUNET_SocketHandle *b)
+{
+  static unsigned short sizes[] = { 4, 100, 7, 60000, 4, 1024, 0 };
+  GNUNET_MessageHeader *hdr;
+  GNUNET_MessageHeader *msg;
+  char *buf;
+  size_t total;
+  size_t sent;
+  size_t pos;
+  int i;
+
+  total = 0;
+  for (i = 0; sizes[i] != 0; i++)
+    total += sizes[i];
+  buf = GNUNET_malloc (total);
+  pos = 0;
+  for (i = 0; sizes[i] != 0; i++)
+    {
+      hdr = (GNUNET_MessageHeader *) & buf[pos];
+      memset (hdr, i, sizes[i]);
+      hdr->size = htons (sizes[i]);
+      hdr->type = htons (GNUNET_CS_PROTO_MAX_USED);
+      pos += sizes[i];
+    }
+  if ((GNUNET_YES != GNUNET_socket_send (b,
+                                         GNUNET_NC_COMPLETE_TRANSFER,
+                                         buf, total, &sent)) ||
+      (sent != total))
+    {
+      GNUNET_free (buf);
+      return 5;
+    }
+  pos = 0;
+  for (i = 0; sizes[i] != 0; i++)
+    {
+      msg = NULL;
+      if (GNUNET_OK != GNUNET_client_connection_read (a, &msg))
+        {
+          GNUNET_free (buf);
+          return 6;
+        }
+      if ((ntohs (msg->size) != sizes[i]) ||
+          (0 != memcmp (msg, &buf[pos], sizes[i])))
+        {
+          GNUNET_free (msg);
+          GNUNET_free (buf);
+          return 7;
+        }
+      pos += sizes[i];
+      GNUNET_free (msg);
+    }
+  GNUNET_free (buf);
+  return 0;
+}
+
+/**
+ * Number of requests used by testPipelined.
+ */
+#define PIPELINE_REQUESTS 32
+
+/**
+ * Replies received by the handlers of testPipelined
+ * (-1: connection failure).
+ */
+static int replies[PIPELINE_REQUESTS + 1];
+
+static int
+replyHandler (void *cls, const GNUNET_MessageHeader * reply)
+{
+  int *slot = cls;
+
+  if (reply == NULL)
+    {
+      *slot = -1;
+      return GNUNET_OK;
+    }
+  (*slot)++;
+  /* the first request gets two replies */
+  if ((slot == &replies[0]) && (*slot < 2))
+    return GNUNET_NO;
+  return GNUNET_OK;
+}
+
+/**
+ * Queue several requests, check that they are sent together
+ * and that the replies are passed to the right handlers
+ * before a synchronous read returns the next message.
+ */
+static int
+testPipelined (struct GNUNET_ClientServerConnection *a,
+               struct GNUNET_SocketHandle *b)
+{
+  GNUNET_MessageHeader req[PIPELINE_REQUESTS];
+  GNUNET_MessageHeader rep[PIPELINE_REQUESTS + 2];
+  GNUNET_MessageHeader *msg;
+  size_t total;
+  size_t pos;
+  size_t rd;
+  int i;
+
+  memset (replies, 0, sizeof (replies));
+  for (i = 0; i < PIPELINE_REQUESTS; i++)
+    {
+      req[i].size = htons (sizeof (GNUNET_MessageHeader));
+      req[i].type = htons (i);
+      if (GNUNET_OK !=
+          GNUNET_client_connection_queue (a, &req[i], &replyHandler,
+                                          &replies[i]))
+        return 20;
+    }
+  if (GNUNET_OK != GNUNET_client_connection_flush (a))
+    return 21;
+  total = sizeof (req);
+  pos = 0;
+  while (pos < total)
+    {
+      rd = 0;
+      if (GNUNET_SYSERR == GNUNET_socket_recv (b,
+                                               GNUNET_NC_BLOCKING,
+                                               &((char *) rep)[pos],
+                                               total - pos, &rd))
+        return 22;
+      pos += rd;
+    }
+  if (0 != memcmp (rep, req, total))
+    return 23;
+  /* one extra reply for the first request and one
+     unsolicited message for the synchronous reader */
+  for (i = 0; i < PIPELINE_REQUESTS + 2; i++)
+    {
+      rep[i].size = htons (sizeof (GNUNET_MessageHeader));
+      rep[i].type = htons (GNUNET_CS_PROTO_MAX_USED);
+    }
+  total = sizeof (rep);
+  if ((GNUNET_YES != GNUNET_socket_send (b,
+                                         GNUNET_NC_COMPLETE_TRANSFER,
+                                         rep, total, &rd)) || (rd != total))
+    return 24;
+  msg = NULL;
+  if (GNUNET_OK != GNUNET_client_connection_read (a, &msg))
+    return 25;
+  GNUNET_free (msg);
+  if (replies[0] != 2)
+    return 26;
+  for (i = 1; i < PIPELINE_REQUESTS; i++)
+    if (replies[i] != 1)
+      return 27;
+  /* a request whose reply never arrives */
+  if ((GNUNET_OK !=
+       GNUNET_client_connection_queue (a, &req[0], &replyHandler,
+                                       &replies[PIPELINE_REQUESTS])) ||
+      (GNUNET_OK != GNUNET_client_connection_flush (a)))
+    return 28;
+  GNUNET_client_connection_close_temporarily (a);
+  if (replies[PIPELINE_REQUESTS] != -1)
+    return 29;
+  return 0;
+}
+
+/**
+ * Check that the client uses the UNIX domain socket
+ * if one is offered for the port (and ignores it if
+ * it is owned by another user).
+ */
+static int
+testUnix (struct GNUNET_ClientServerConnection *a)
+{
+  struct sockaddr_un addr;
+  struct GNUNET_SocketHandle *sh;
+  socklen_t addrlen;
+  char *path;
+  char *dir;
+  int listenerFD;
+  int acceptSocket;
+  int ret;
+
+  path = GNUNET_client_connection_get_unix_path (cfg, getGNUnetPort ());
+  if (path == NULL)
+    return 0;                   /* not supported */
+  dir = GNUNET_strdup (path);
+  *strrchr (dir, DIR_SEPARATOR) = '\0';
+  GNUNET_disk_directory_create (NULL, dir);
+  GNUNET_free (dir);
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  strncpy (addr.sun_path, path, sizeof (addr.sun_path) - 1);
+  UNLINK (path);
+  listenerFD = SOCKET (PF_UNIX, SOCK_STREAM, 0);
+  if ((listenerFD < 0) ||
+      (0 != BIND (listenerFD, (struct sockaddr *) &addr, sizeof (addr))) ||
+      (0 != LISTEN (listenerFD, 5)))
+    {
+      if (listenerFD >= 0)
+        CLOSE (listenerFD);
+      GNUNET_free (path);
+      return 10;
+    }
+  /* the TCP server socket is closed, so this only
+     works via the UNIX domain socket */
+  ret = 0;
+  if ((geteuid () == 0) && (0 == chown (path, 1, 1)))
+    {
+      /* a socket of another user must not be used */
+      if (GNUNET_OK == GNUNET_client_connection_ensure_connected (a))
+        ret = 13;
+      GNUNET_client_connection_close_temporarily (a);
+      if (0 != chown (path, 0, 0))
+        ret = 14;
+    }
+  if ((ret == 0) &&
+      (GNUNET_OK != GNUNET_client_connection_ensure_connected (a)))
+    ret = 11;
+  if (ret == 0)
+    {
+      addrlen = sizeof (addr);
+      acceptSocket = ACCEPT (listenerFD, (struct sockaddr *) &addr, &addrlen);
+      if (acceptSocket == -1)
+        ret = 12;
+    }
+  if (ret == 0)
+    {
+      sh = GNUNET_socket_create (NULL, NULL, acceptSocket);
+      ret = testTransmission (a, sh) | testBatchedRead (a, sh);
+      GNUNET_client_connection_close_temporarily (a);
+      GNUNET_socket_destroy (sh);
+    }
+  CLOSE (listenerFD);
+  UNLINK (path);
+  GNUNET_free (path);
+  return ret;
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -210,11 +449,15 @@ main (int argc, char *argv[])
         }
       sh = GNUNET_socket_create (NULL, NULL, acceptSocket);
       ret = ret | testTransmission (clientSocket, sh);
+      ret = ret | testBatchedRead (clientSocket, sh);
+      ret = ret | testPipelined (clientSocket, sh);
       GNUNET_client_connection_close_temporarily (clientSocket);
       GNUNET_socket_destroy (sh);
     }
-  GNUNET_client_connection_destroy (clientSocket);
   CLOSE (serverSocket);
+  if (ret == 0)
+    ret = testUnix (clientSocket);
+  GNUNET_client_connection_destroy (clientSocket);
   fprintf (stderr, "\n");
   if (ret > 0)
     fprintf (stderr, "Error %d\n", ret);
@@ -40,3 +40,25 @@ GNUNET_get_time ()
   GETTIMEOFDAY (&tv, NULL);
   return (((GNUNET_CronTime) tv.tv_sec) * 1000) + (tv.tv_usec / 1000);
 }
+
+/**
+ * Get a timestamp in microseconds for measuring how long
+ * something takes.  Uses a monotonic clock if possible, so
+ * the value is not related to the time of day.
+ *
+ * @return the current timestamp
+ */
+unsigned long long
+GNUNET_get_time_us ()
+{
+  struct timeval tv;
+#if defined(CLOCK_MONOTONIC) && !defined(MINGW)
+  struct timespec ts;
+
+  if (0 == clock_gettime (CLOCK_MONOTONIC, &ts))
+    return (((unsigned long long) ts.tv_sec) * 1000000) +
+      (ts.tv_nsec / 1000);
+#endif
+  GETTIMEOFDAY (&tv, NULL);
+  return (((unsigned long long) tv.tv_sec) * 1000000) + tv.tv_usec;
+}